@@ -49,12 +49,20 @@ namespace gr {
        * \param itemsize The size (in bytes) of the item datatype
        * \param host The name or IP address of the transmitting host; can be
        * NULL, None, or "0.0.0.0" to allow reading from any
-       * interface on the host
+       * interface on the host, or shm:name to take the samples from the shared memory ring published
+       * by a sdrdaemonrx on the same host with -O name (no UDP, FEC or per datagram work, port is ignored)
+       * or ring:interface to receive the datagrams to port on any address of the host through a memory
+       * mapped packet ring on this network interface (needs CAP_NET_RAW, else the socket is used)
        * \param port The port number on which to receive data; use 0 to
        * have the system assign an unused port number
-       * \param payload_size UDP payload size by default set to 512
+       * \param payload_size UDP payload size by default set to 512. Must be at least the size of
+       * the datagrams sent by SDRdaemon (the decoder follows the size of the received datagrams)
+       * \param reorder_window Number of frames (1 to 8) decoded concurrently so that UDP blocks
+       * arriving out of order still count for their frame. Frames are always output in order.
+       * \param complex_output Output complex float samples (itemsize is then a multiple of sizeof(gr_complex))
+       * converted from the 16 bit I/Q samples to the [-1.0, 1.0) range, saving a conversion block downstream.
        */
-      static sptr make(std::size_t itemsize, const std::string &host, int port, int payload_size = 512);
+      static sptr make(std::size_t itemsize, const std::string &host, int port, int payload_size = 512, int reorder_window = 1, bool complex_output = false);
 
       /*! \brief Change the connection to a new destination
       *
@@ -96,6 +104,16 @@ namespace gr {
 
       /*! \brief return the average number of recovery blocks used */
       virtual float get_avg_nb_recovery() = 0;
+
+      /*! \brief return the average one-way latency of the frames in milliseconds: kernel arrival
+       * time of the meta data block minus the time stamp of the meta data (needs synchronized clocks) */
+      virtual float get_latency_ms() = 0;
+
+      /*! \brief return the largest one-way latency in milliseconds since the last call */
+      virtual float get_max_latency_ms() = 0;
+
+      /*! \brief return the inter-arrival jitter of the frames in milliseconds (RFC 3550) */
+      virtual float get_jitter_ms() = 0;
     };
 
   } // namespace sdrdaemon
@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_CRC32C_H_
+#define INCLUDE_CRC32C_H_
+
+#include <stdint.h>
+#include <cstddef>
+
+/**
+ * CRC-32C (Castagnoli polynomial as in iSCSI and SCTP)
+ *
+ * Computed with the CRC32 instruction of SSE4.2 (x86, selected at run time) or of ARMv8 (when built
+ * with the CRC extension) at several bytes per cycle, else with slicing-by-8 tables. Self contained
+ * so that it can be shared with the GNUradio module.
+ */
+class CRC32C
+{
+public:
+    /**
+     * CRC of the data continuing the CRC of the data before it (0 to start). The result is the standard
+     * CRC-32C (0xE3069283 for "123456789")
+     */
+    static uint32_t calculate(const uint8_t *stream, std::size_t length, uint32_t crc = 0);
+
+    /** The CPU instruction is used */
+    static bool hardware() { return m_hardware; }
+
+private:
+    static bool detect();
+    static uint32_t crcSlicing8(const uint8_t *stream, std::size_t length, uint32_t crc);
+    static uint32_t crcHardware(const uint8_t *stream, std::size_t length, uint32_t crc);
+
+    struct Tables
+    {
+        Tables();
+        uint32_t m_table[8][256];
+    };
+
+    static const Tables m_tables;
+    static const bool m_hardware;
+};
+
+#endif /* INCLUDE_CRC32C_H_ */
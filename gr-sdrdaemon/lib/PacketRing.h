@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_PACKETRING_H_
+#define INCLUDE_PACKETRING_H_
+
+#include <stdint.h>
+#include <string>
+#include <time.h>
+#include <netinet/in.h>
+
+#define PACKETRING_BLOCKSIZE   (1<<20) // bytes of a ring block. Holds about 1500 datagrams of 512 bytes
+#define PACKETRING_NBBLOCKS    16      // number of ring blocks
+#define PACKETRING_RETIRETIME  10      // milliseconds after which a partly filled block is handed over
+
+/**
+ * Receive UDP datagrams through a memory mapped packet ring (Linux TPACKET_V3) instead of
+ * one or a batch of datagrams per system call.
+ *
+ * The kernel copies the datagrams sent to a UDP port into blocks of a ring shared with the
+ * process and hands over a whole block at once (when it is full or after a few milliseconds).
+ * The payloads are then used in place from the ring. A system call is only made to wait for the
+ * next block (poll) so the per datagram kernel overhead is gone. The kernel filters the datagrams
+ * by destination port with a BPF program so several streams on the same host each open their own
+ * ring. Fragmented datagrams are dropped and checksums are not verified.
+ *
+ * A packet socket needs the CAP_NET_RAW capability (root). The UDP socket bound to the port
+ * must be kept open, else the host answers with ICMP port unreachable, but it should not queue
+ * the datagrams any more (see CSocket::SetDropFilter).
+ */
+class PacketRing
+{
+public:
+    PacketRing();
+    ~PacketRing();
+
+    /**
+     * Open a ring for the UDP datagrams to the given port on the given network interface.
+     * Returns false on error (see error()).
+     */
+    bool open(const std::string& interface, unsigned short port);
+    void close();
+
+    /**
+     * Get up to count UDP payloads of the datagrams received. The pointers stay valid until the next call.
+     * Waits at most timeoutMs (-1 for ever) for datagrams to arrive.
+     * \param payloads    receives the pointers to the UDP payloads
+     * \param lengths     receives the length of each payload
+     * \param count       maximum number of payloads
+     * \param timeoutMs   maximum time to wait if no datagram is available
+     * \param sourceAddrs if not null receives the source address of each datagram
+     * \param timestamps  if not null receives the arrival time of each datagram (kernel timestamp)
+     * \return number of payloads returned. 0 after a timeout.
+     */
+    int receive(uint8_t **payloads, int *lengths, int count, int timeoutMs, sockaddr_in *sourceAddrs = 0, timespec *timestamps = 0);
+
+    /** Number of datagrams dropped by the kernel because the ring was full since the last call */
+    unsigned int getNbDrops();
+
+    operator bool() const { return m_fd >= 0; }
+    const std::string& error() const { return m_error; }
+
+private:
+    bool nextBlock(int timeoutMs);
+    void releaseBlock();
+    int collect(uint8_t **payloads, int *lengths, int count, sockaddr_in *sourceAddrs, timespec *timestamps);
+
+    int         m_fd;
+    uint8_t    *m_ring;
+    int         m_blockIndex;  //!< current ring block
+    int         m_nbPackets;   //!< number of packets left in the current block (-1 if no block is held)
+    uint8_t    *m_packet;      //!< next packet of the current block
+    std::string m_error;
+};
+
+#endif /* INCLUDE_PACKETRING_H_ */
@@ -19,23 +19,37 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.          //
 ///////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
 
-#include "SDRdaemonFECBuffer.h"
+#ifdef HAS_LZ4
+#include <lz4.h>
+#endif
 
-SDRdaemonFECBuffer::SDRdaemonFECBuffer()
+#include "SDRdaemonFECBuffer.h"
+#include "CRC32C.h"
+
+SDRdaemonFECBuffer::SDRdaemonFECBuffer() :
+    m_udpSize(0),
+    m_blockSize(0),
+    m_nbDecoderSlots(2),
+    m_reorderWindow(1),
+    m_frameHead(-1),
+    m_frameTail(-1),
+    m_nbLateBlocks(0),
+    m_lateRun(0),
+    m_nbLargeBlocks(0)
 {
     m_currentMeta.init();
     m_outputMeta.init();
-    m_paramsCM256.BlockBytes = sizeof(ProtectedBlock);
+    setUdpSize(SDRDAEMONFEC_UDPSIZE);
     m_paramsCM256.OriginalCount = nbOriginalBlocks;
     m_paramsCM256.RecoveryCount = -1;
-    m_decoderIndexHead = nbDecoderSlots / 2;
-    m_frameHead = -1;
     m_curNbBlocks = 0;
     m_curNbRecovery = 0;
+    m_curNbOriginalBlocks = nbOriginalBlocks;
 
     if (cm256_init()) {
         m_cm256_OK = false;
@@ -60,17 +74,91 @@ void SDRdaemonFECBuffer::printMeta(MetaDataFEC *metaData)
             << ":" << (int) metaData->m_nbFECBlocks
             << "|" << metaData->m_tv_sec
             << ":" << metaData->m_tv_usec
+            << "|" << (metaData->m_udpSize == 0 ? SDRDAEMONFEC_UDPSIZE : metaData->m_udpSize)
             << "|" << std::endl;
 }
 
-void SDRdaemonFECBuffer::getSlotData(uint8_t *data, uint32_t& dataLength)
+/**
+ * Check the CRC32C ending a superblock flagged with SDRDAEMONFEC_BLOCKCRC and strip it from the length.
+ * Superblocks without the flag always pass.
+ */
+bool SDRdaemonFECBuffer::checkBlockCRC(const uint8_t *array, std::size_t& length)
+{
+    if ((length < sizeof(Header) + sizeof(uint32_t)) || !(((const Header *) array)->filler & SDRDAEMONFEC_BLOCKCRC)) {
+        return true;
+    }
+
+    uint32_t crc;
+    length -= sizeof(uint32_t);
+    memcpy(&crc, &array[length], sizeof(crc));
+    return CRC32C::calculate(array, length) == crc;
+}
+
+bool SDRdaemonFECBuffer::setUdpSize(std::size_t udpSize)
+{
+    if ((udpSize < sizeof(Header) + sizeof(MetaDataFEC)) || (udpSize > SDRDAEMONFEC_UDPSIZEMAX)
+        || ((udpSize - sizeof(Header)) % sizeof(Sample) != 0))
+    {
+        return false;
+    }
+
+    m_udpSize = udpSize;
+    m_blockSize = udpSize - sizeof(Header);
+    m_paramsCM256.BlockBytes = m_blockSize;
+    m_decoderSlots.resize(m_nbDecoderSlots);
+
+    for (std::vector<DecoderSlot>::iterator it = m_decoderSlots.begin(); it != m_decoderSlots.end(); ++it)
+    {
+        it->m_frame.assign(nbOriginalBlocks * m_blockSize, 0);
+        it->m_recoveryBlocks.assign(nbOriginalBlocks * m_blockSize, 0);
+        it->m_nbOriginalBlocks = nbOriginalBlocks;
+        it->m_blockCount = 0;
+        it->m_recoveryCount = 0;
+        it->m_decoded = false;
+        it->m_metaRetrieved = false;
+        memset(it->m_received, 0, sizeof(it->m_received));
+    }
+
+    return true;
+}
+
+void SDRdaemonFECBuffer::setReorderWindow(int nbFrames)
+{
+    if (nbFrames < 1) {
+        nbFrames = 1;
+    } else if (nbFrames > SDRDAEMONFEC_REORDERWINDOWMAX) {
+        nbFrames = SDRDAEMONFEC_REORDERWINDOWMAX;
+    }
+
+    int nbDecoderSlots = 2;
+
+    while (nbDecoderSlots < 2*nbFrames) {
+        nbDecoderSlots *= 2;
+    }
+
+    m_reorderWindow = nbFrames;
+    m_nbDecoderSlots = nbDecoderSlots;
+    setUdpSize(m_udpSize); // re-initialize all slots
+    m_frameHead = -1;
+}
+
+void SDRdaemonFECBuffer::getSlotData(DecoderSlot& slot, uint8_t *data, uint32_t& dataLength)
 {
-    dataLength = (nbOriginalBlocks - 1) * samplesPerBlock * sizeof(Sample);
-    memcpy((void *) data, (const void *) &m_decoderSlot.m_frame.m_blocks[1], dataLength); // skip block 0
+    int frameBlocks = slot.m_nbOriginalBlocks;
+
+    if (!slot.m_decoded) // the lost blocks are silence: the slot is not cleared between frames
+    {
+        for (int blockIndex = 0; blockIndex < frameBlocks; blockIndex++)
+        {
+            if (!slot.received(blockIndex)) {
+                memset((void *) frameBlock(slot, blockIndex), 0, m_blockSize);
+            }
+        }
+    }
 
-    if (m_decoderSlot.m_metaRetrieved)
+    if (slot.m_metaRetrieved)
     {
-        MetaDataFEC *metaData = (MetaDataFEC *) &m_decoderSlot.m_frame.m_blocks[0];
+        MetaDataFEC *metaData = (MetaDataFEC *) frameBlock(slot, 0);
 
         if (!(*metaData == m_outputMeta))
         {
@@ -78,37 +166,276 @@ void SDRdaemonFECBuffer::getSlotData(uint8_t *data, uint32_t& dataLength)
         }
     }
 
-    if (!m_decoderSlot.m_decoded)
+    if (m_outputMeta.m_sampleBytes & SDRDAEMONFEC_SQUELCH) // keep-alive frame: silence, up to twice the frame size
+    {
+        uint32_t nbSamples = std::min(m_outputMeta.m_squelchSamples, (uint32_t) (frameBlocks - 1) * (m_blockSize / 2));
+        dataLength = nbSamples * sizeof(Sample);
+        memset((void *) data, 0, dataLength);
+    }
+    else if (m_outputMeta.m_sampleBytes & SDRDAEMONFEC_LZ4) // up to SDRDAEMONFEC_LZ4RATIO times more once widened
+    {
+        getCompressedData(slot, data, dataLength);
+    }
+    else if (m_outputMeta.m_sampleBytes & SDRDAEMONFEC_PACKED8) // widen to 2x16 bits I/Q: twice the frame size
+    {
+        int nbSamples = m_blockSize / 2;
+        dataLength = (frameBlocks - 1) * nbSamples * sizeof(Sample);
+
+        for (int blockIndex = 1; blockIndex < frameBlocks; blockIndex++) {
+            widenBlock(frameBlock(slot, blockIndex), &((Sample *) data)[(blockIndex - 1) * nbSamples], nbSamples);
+        }
+    }
+    else if (m_outputMeta.m_sampleBytes & SDRDAEMONFEC_PACKED12) // unpack to 2x16 bits I/Q: 4/3 of the frame size
+    {
+        int nbSamples = m_blockSize / 3;
+        dataLength = (frameBlocks - 1) * nbSamples * sizeof(Sample);
+
+        for (int blockIndex = 1; blockIndex < frameBlocks; blockIndex++) {
+            unpackBlock(frameBlock(slot, blockIndex), &((Sample *) data)[(blockIndex - 1) * nbSamples], nbSamples);
+        }
+    }
+    else
+    {
+        dataLength = (frameBlocks - 1) * m_blockSize;
+        memcpy((void *) data, (const void *) frameBlock(slot, 1), dataLength); // skip block 0
+    }
+
+    if (!slot.m_decoded)
     {
         std::cerr << "SDRdaemonFECBuffer::getSlotData: incomplete frame:"
-                << " m_blockCount: " << m_decoderSlot.m_blockCount
-                << " m_recoveryCount: " << m_decoderSlot.m_recoveryCount << std::endl;
+                << " m_blockCount: " << slot.m_blockCount
+                << " m_recoveryCount: " << slot.m_recoveryCount << std::endl;
     }
 }
 
-void SDRdaemonFECBuffer::initDecodeSlot()
+/** Decompress the data blocks of the frame and widen the samples of the network format to 2x16 bits I/Q */
+void SDRdaemonFECBuffer::getCompressedData(DecoderSlot& slot, uint8_t *data, uint32_t& dataLength)
+{
+    int frameBlocks = slot.m_nbOriginalBlocks;
+    const MetaDataFEC *metaData = (const MetaDataFEC *) frameBlock(slot, 0); // the frame and compressed lengths are not in m_outputMeta
+    dataLength = 0;
+
+    if (!slot.m_metaRetrieved || (metaData->m_frameBytes > (uint32_t) SDRDAEMONFEC_LZ4RATIO * (frameBlocks - 1) * m_blockSize))
+    {
+        std::cerr << "SDRdaemonFECBuffer::getCompressedData: compressed frame without its meta data" << std::endl;
+        return;
+    }
+#ifdef HAS_LZ4
+    m_decompressed.resize(metaData->m_frameBytes);
+    int frameBytes = LZ4_decompress_safe((const char *) frameBlock(slot, 1), (char *) &m_decompressed[0],
+            std::min((int) metaData->m_compressedBytes, (frameBlocks - 1) * m_blockSize), metaData->m_frameBytes);
+
+    if (frameBytes != (int) metaData->m_frameBytes)
+    {
+        std::cerr << "SDRdaemonFECBuffer::getCompressedData: LZ4 decompression error" << std::endl;
+        return;
+    }
+
+    if (metaData->m_sampleBytes & SDRDAEMONFEC_PACKED8)
+    {
+        widenBlock(&m_decompressed[0], (Sample *) data, frameBytes / 2);
+        dataLength = (frameBytes / 2) * sizeof(Sample);
+    }
+    else if (metaData->m_sampleBytes & SDRDAEMONFEC_PACKED12)
+    {
+        unpackBlock(&m_decompressed[0], (Sample *) data, frameBytes / 3);
+        dataLength = (frameBytes / 3) * sizeof(Sample);
+    }
+    else
+    {
+        dataLength = frameBytes - (frameBytes % sizeof(Sample));
+        memcpy((void *) data, (const void *) &m_decompressed[0], dataLength);
+    }
+#else
+    (void) data;
+    std::cerr << "SDRdaemonFECBuffer::getCompressedData: compressed frame: not built with LZ4" << std::endl;
+#endif
+}
+
+/** Unpack the 12 most significant bits of I/Q pairs from 3 bytes: I[11:4], I[15:12] | Q[7:4], Q[15:8] */
+void SDRdaemonFECBuffer::unpackBlock(const uint8_t *block, Sample *samples, int nbSamples)
+{
+    for (int i = 0; i < nbSamples; i++, block += 3)
+    {
+        samples[i].i = (int16_t) ((block[0] | (block[1] << 8)) << 4);
+        samples[i].q = (int16_t) ((block[1] | (block[2] << 8)) & 0xFFF0);
+    }
+}
+
+/** 8 bit I/Q pairs of 2 bytes to the 8 most significant bits */
+void SDRdaemonFECBuffer::widenBlock(const uint8_t *block, Sample *samples, int nbSamples)
+{
+    for (int i = 0; i < nbSamples; i++, block += 2)
+    {
+        samples[i].i = (int16_t) (block[0] << 8);
+        samples[i].q = (int16_t) (block[1] << 8);
+    }
+}
+
+void SDRdaemonFECBuffer::initDecodeSlot(DecoderSlot& slot)
 {
     // collect stats before voiding the slot
-    m_curNbBlocks = m_decoderSlot.m_blockCount;
-    m_curNbRecovery = m_decoderSlot.m_recoveryCount;
+    m_curNbBlocks = slot.m_blockCount;
+    m_curNbRecovery = slot.m_recoveryCount;
+    m_curNbOriginalBlocks = slot.m_nbOriginalBlocks;
     m_avgNbBlocks(m_curNbBlocks);
     m_avgNbRecovery(m_curNbRecovery);
     // void the slot
-    m_decoderSlot.m_blockCount = 0;
-    m_decoderSlot.m_recoveryCount = 0;
-    m_decoderSlot.m_decoded = false;
-    m_decoderSlot.m_metaRetrieved = false;
-    memset((void *) &m_decoderSlot.m_frame, 0, sizeof(BufferFrame0));
+    slot.m_nbOriginalBlocks = nbOriginalBlocks;
+    slot.m_blockCount = 0;
+    slot.m_recoveryCount = 0;
+    slot.m_decoded = false;
+    slot.m_metaRetrieved = false;
+    memset(slot.m_received, 0, sizeof(slot.m_received));
 }
 
-bool SDRdaemonFECBuffer::writeAndRead(uint8_t *array, std::size_t length, uint8_t *data, uint32_t& dataLength)
+void SDRdaemonFECBuffer::storeBlock(DecoderSlot& slot, int blockIndex, uint8_t *protectedBlock)
 {
-    assert(length == udpSize);
+    if (slot.received(blockIndex)) { // network duplicate
+        return;
+    }
+
+    slot.m_received[blockIndex >> 6] |= 1ULL << (blockIndex & 63);
+    slot.m_blockCount++;
+
+    if (slot.m_decoded || (slot.m_blockCount > slot.m_nbOriginalBlocks)) { // complete, restored or given up: the blocks arriving later are only counted
+        return;
+    }
+
+    if (blockIndex < slot.m_nbOriginalBlocks) // data block
+    {
+        memcpy((void *) frameBlock(slot, blockIndex), (const void *) protectedBlock, m_blockSize);
+
+        if (blockIndex == 0) // first block with meta
+        {
+            slot.m_metaRetrieved = true;
+        }
+    }
+    else // redundancy block
+    {
+        memcpy((void *) recoveryBlock(slot, slot.m_recoveryCount), (const void *) protectedBlock, m_blockSize);
+        slot.m_recoveryIndexes[slot.m_recoveryCount] = blockIndex;
+        slot.m_recoveryCount++;
+    }
+
+    if ((blockIndex == 0) && (((MetaDataFEC *) frameBlock(slot, 0))->m_sampleBytes & SDRDAEMONFEC_SQUELCH))
+    {
+        slot.m_decoded = true; // keep-alive frame: the meta data is the whole frame
+        MetaDataFEC *metaData = (MetaDataFEC *) frameBlock(slot, 0);
 
+        if (!(*metaData == m_currentMeta))
+        {
+            m_currentMeta = *metaData;
+            printMeta(metaData);
+        }
+    }
+    else if (slot.m_blockCount == slot.m_nbOriginalBlocks) // ready to decode
+    {
+        slot.m_decoded = true; // lossless frame (no recovery block): the original blocks are in place already
+
+        if (slot.m_recoveryCount > 0) {
+            slot.m_decoded = decodeSlot(slot);
+        }
+
+        if (slot.m_metaRetrieved) // meta data retrieved
+        {
+            MetaDataFEC *metaData = (MetaDataFEC *) frameBlock(slot, 0);
+
+            if (!(*metaData == m_currentMeta))
+            {
+                m_currentMeta = *metaData;
+                printMeta(metaData);
+            }
+        }
+    } // decode frame
+}
+
+/**
+ * Restore the lost original blocks of a frame from its recovery blocks. The CM256 descriptors are only
+ * set up here: the original blocks received first then the recovery blocks that CM256 decodes in place.
+ */
+bool SDRdaemonFECBuffer::decodeSlot(DecoderSlot& slot)
+{
+    if (!m_cm256_OK) { // CM256 decoder not available
+        return false;
+    }
+
+    const MetaDataFEC *metaData = slot.m_metaRetrieved ? (const MetaDataFEC *) frameBlock(slot, 0) : &m_currentMeta;
+
+    if (metaData->m_fecCodec != 0) { // only CM256 is decoded here: the lost blocks of the frame stay zeroed
+        return false;
+    }
+
+    int nbDescriptors = 0;
+
+    for (int blockIndex = 0; blockIndex < slot.m_nbOriginalBlocks; blockIndex++)
+    {
+        if (slot.received(blockIndex))
+        {
+            m_cm256DescriptorBlocks[nbDescriptors].Block = (void *) frameBlock(slot, blockIndex);
+            m_cm256DescriptorBlocks[nbDescriptors].Index = blockIndex;
+            nbDescriptors++;
+        }
+    }
+
+    for (int ir = 0; ir < slot.m_recoveryCount; ir++)
+    {
+        m_cm256DescriptorBlocks[nbDescriptors + ir].Block = (void *) recoveryBlock(slot, ir);
+        m_cm256DescriptorBlocks[nbDescriptors + ir].Index = slot.m_recoveryIndexes[ir];
+    }
+
+    m_paramsCM256.OriginalCount = slot.m_nbOriginalBlocks;
+    m_paramsCM256.RecoveryCount = slot.m_recoveryCount;
+
+    if (cm256_decode(m_paramsCM256, m_cm256DescriptorBlocks)) // failure to decode
+    {
+        std::cerr << "SDRdaemonFECBuffer::writeAndRead: CM256 decode error" << std::endl;
+        return false;
+    }
+
+    std::cerr << "SDRdaemonFECBuffer::writeAndRead: CM256 decode success:"
+            << " nb recovery blocks: " << slot.m_recoveryCount << std::endl;
+
+    for (int ir = 0; ir < slot.m_recoveryCount; ir++) // recover lost blocks: the decoder gives their index in the recovery descriptors
+    {
+        const cm256_block& recovered = m_cm256DescriptorBlocks[nbDescriptors + ir];
+        memcpy((void *) frameBlock(slot, recovered.Index), (const void *) recovered.Block, m_blockSize);
+    }
+
+    return true;
+}
+
+bool SDRdaemonFECBuffer::writeAndRead(uint8_t *array, std::size_t length, uint8_t *data, uint32_t& dataLength)
+{
     bool dataAvailable = false;
     dataLength = 0;
-    SuperBlock *superBlock = (SuperBlock *) array;
-    int frameIndex = superBlock->header.frameIndex;
+    Header *header = (Header *) array;
+    uint8_t *protectedBlock = array + sizeof(Header);
+    int frameIndex = header->frameIndex;
+
+    if (!checkBlockCRC(array, length)) { // dropped: FEC restores it as a lost block
+        return false;
+    }
+
+    if ((header->filler >> SDRDAEMONFEC_BLOCKSSHIFT) == SDRDAEMONFEC_LARGEFRAME) // 16 bit block indexes in a trailer: use sdrdaemontx
+    {
+        if (m_nbLargeBlocks++ == 0) {
+            std::cerr << "SDRdaemonFECBuffer::writeAndRead: large frames are not supported: blocks dropped" << std::endl;
+        }
+
+        return false;
+    }
+
+    if ((int) length != m_udpSize) // the sender changed the datagram size: restart on the current frame
+    {
+        if (!setUdpSize(length)) {
+            return false; // not a SuperBlock
+        }
+
+        std::cerr << "SDRdaemonFECBuffer::writeAndRead: UDP datagram size: " << length << std::endl;
+        m_frameHead = frameIndex;
+        m_frameTail = frameIndex;
+    }
 
 //    std::cerr << "SDRdaemonFECBuffer::writeAndRead:"
 //            << " frameIndex: " << frameIndex
@@ -124,121 +451,72 @@ bool SDRdaemonFECBuffer::writeAndRead(uint8_t *array, std::size_t length, uint8_
 //
 //    std::cerr << std::endl;
 
-    if ( m_frameHead != frameIndex)
+    if (m_frameHead < 0) // first block
     {
-        getSlotData(data, dataLength); // copy slot data to output buffer
-        dataAvailable = true;
-        initDecodeSlot(); // re-initialize slot
         m_frameHead = frameIndex;
+        m_frameTail = frameIndex;
     }
 
-    // decoderIndex should now be correctly set
+    int frameDelta = (int16_t) (frameIndex - m_frameHead); // frame index wraps around at 65536
 
-    if (m_decoderSlot.m_blockCount < nbOriginalBlocks) // not enough blocks to decode -> store data
+    if ((frameDelta < 0) && (m_lateRun < nbOriginalBlocks)) // block of a frame already output
     {
-        int blockCount = m_decoderSlot.m_blockCount;
-        int recoveryCount = m_decoderSlot.m_recoveryCount;
-        int blockIndex = superBlock->header.blockIndex;
-        m_decoderSlot.m_cm256DescriptorBlocks[blockCount].Index = blockIndex;
+        m_nbLateBlocks++;
+        m_lateRun++;
+        return false;
+    }
 
-        if (blockIndex == 0) // first block with meta
-        {
-            m_decoderSlot.m_metaRetrieved = true;
-        }
+    m_lateRun = 0;
 
-        if (blockIndex < nbOriginalBlocks) // data block
+    if ((frameDelta < 0) || (frameDelta >= m_nbDecoderSlots)) // sender restarted (only late blocks for a whole frame) or whole frames lost: resync on this frame
+    {
+        DecoderSlot& headSlot = decoderSlot(m_frameHead);
+
+        if (headSlot.m_blockCount > 0)
         {
-            m_decoderSlot.m_frame.m_blocks[blockIndex] = superBlock->protectedBlock;
-            m_decoderSlot.m_cm256DescriptorBlocks[blockCount].Block = (void *) &m_decoderSlot.m_frame.m_blocks[blockIndex];
+            getSlotData(headSlot, data, dataLength); // copy slot data to output buffer
+            dataAvailable = true;
         }
-        else // redundancy block
+
+        for (std::vector<DecoderSlot>::iterator it = m_decoderSlots.begin(); it != m_decoderSlots.end(); ++it)
         {
-            m_decoderSlot.m_recoveryBlocks[recoveryCount] = superBlock->protectedBlock;
-            m_decoderSlot.m_cm256DescriptorBlocks[blockCount].Block = (void *) &m_decoderSlot.m_recoveryBlocks[recoveryCount];
-            m_decoderSlot.m_recoveryCount++;
+            if (it->m_blockCount > 0) {
+                initDecodeSlot(*it);
+            }
         }
+
+        m_frameHead = frameIndex;
+        m_frameTail = frameIndex;
+    }
+    else if ((int16_t) (frameIndex - m_frameTail) > 0)
+    {
+        m_frameTail = frameIndex;
     }
 
-    m_decoderSlot.m_blockCount++;
+    DecoderSlot& slot = decoderSlot(frameIndex);
 
-    if (m_decoderSlot.m_blockCount == nbOriginalBlocks) // ready to decode
-    {
-        m_decoderSlot.m_decoded = true;
+    if (slot.m_blockCount == 0) {
+        slot.m_nbOriginalBlocks = headerNbOriginalBlocks(header);
+    }
 
-        if (m_cm256_OK && (m_decoderSlot.m_recoveryCount > 0)) // recovery data used and CM256 decoder available
-        {
-            m_paramsCM256.RecoveryCount = m_decoderSlot.m_recoveryCount;
-//            // debug print
-//            for (int ir = 0; ir < m_decoderSlots[decoderIndex].m_recoveryCount; ir++) // recovery blocks
-//            {
-//                int blockIndex = m_decoderSlots[decoderIndex].m_cm256DescriptorBlocks[nbRxOriginalBlocks+ir].Index;
-//                ProtectedBlock *recoveryBlock = (ProtectedBlock *) m_decoderSlots[decoderIndex].m_cm256DescriptorBlocks[nbRxOriginalBlocks+ir].Block;
-//
-//                std::cerr << "SDRdaemonFECBuffer::writeAndRead:"
-//                        << " recovery block #" << blockIndex
-//                        << " i.q: ";
-//
-//                for (int i = 0; i < 10; i++)
-//                {
-//                    std::cerr << " " << recoveryBlock->samples[i].i
-//                            << "." << recoveryBlock->samples[i].q;
-//                }
-//
-//                std::cerr << std::endl;
-//            }
-//            // end debug print
+    storeBlock(slot, header->blockIndex, protectedBlock);
 
-            if (cm256_decode(m_paramsCM256, m_decoderSlot.m_cm256DescriptorBlocks)) // failure to decode
-            {
-                std::cerr << "SDRdaemonFECBuffer::writeAndRead: CM256 decode error" << std::endl;
-            }
-            else // success to decode
-            {
-                int nbRxOriginalBlocks = nbOriginalBlocks - m_decoderSlot.m_recoveryCount;
-
-                std::cerr << "SDRdaemonFECBuffer::writeAndRead: CM256 decode success:"
-                        << " nb recovery blocks: " << m_decoderSlot.m_recoveryCount << std::endl;
-
-                for (int ir = 0; ir < m_decoderSlot.m_recoveryCount; ir++) // recover lost blocks
-                {
-                    int recoveryIndex = nbOriginalBlocks - m_decoderSlot.m_recoveryCount + ir;
-                    int blockIndex = m_decoderSlot.m_cm256DescriptorBlocks[recoveryIndex].Index;
-                    ProtectedBlock *recoveredBlock = (ProtectedBlock *) m_decoderSlot.m_cm256DescriptorBlocks[recoveryIndex].Block;
-                    m_decoderSlot.m_frame.m_blocks[blockIndex] =  *recoveredBlock;
-
-//                    if (blockIndex == 0)
-//                    {
-//                        m_decoderSlots[decoderIndex].m_metaRetrieved = true;
-//                    }
-
-                    // debug print
-                    std::cerr << "SDRdaemonFECBuffer::writeAndRead:"
-                            << " recovered block #" << blockIndex
-                            << " i.q: ";
-
-                    for (int i = 0; i < 10; i++)
-                    {
-                        std::cerr << " " << recoveredBlock->samples[i].i
-                                << "." << recoveredBlock->samples[i].q;
-                    }
-
-                    std::cerr << std::endl;
-                    // end debug print
-                } // recover
-            } // success to decode
-        } // recovery data used
-
-        if (m_decoderSlot.m_metaRetrieved) // meta data retrieved
-        {
-            MetaDataFEC *metaData = (MetaDataFEC *) &m_decoderSlot.m_frame.m_blocks[0];
+    // output the oldest frame once a block of the frame a reordering window ahead has arrived.
+    // Frames of which no block was received at all are skipped. At most one frame is output
+    // per call: the next frames if any are due are output with the next blocks.
+    while (!dataAvailable && ((int16_t) (m_frameTail - m_frameHead) >= m_reorderWindow))
+    {
+        DecoderSlot& headSlot = decoderSlot(m_frameHead);
 
-            if (!(*metaData == m_currentMeta))
-            {
-                m_currentMeta = *metaData;
-                printMeta(metaData);
-            }
+        if (headSlot.m_blockCount > 0)
+        {
+            getSlotData(headSlot, data, dataLength); // copy slot data to output buffer
+            dataAvailable = true;
+            initDecodeSlot(headSlot); // re-initialize slot
         }
-    } // decode frame
+
+        m_frameHead = (m_frameHead + 1) & 0xFFFF;
+    }
 
     return dataAvailable;
 }
@@ -23,13 +23,26 @@
 #define GR_SDRDAEMONFEC_LIB_SDRDAEMONFECBUFFER_H_
 
 #include <stdint.h>
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
+#include <vector>
 #include "cm256.h"
 #include "MovingAverage.h"
 
-#define SDRDAEMONFEC_UDPSIZE 512            // UDP payload size
-#define SDRDAEMONFEC_NBORIGINALBLOCKS 128   // number of sample blocks per frame excluding FEC blocks
-#define SDRDAEMONFEC_NBDECODERSLOTS 4       // power of two sub multiple of int16_t size. A too large one is superfluous.
+#define SDRDAEMONFEC_UDPSIZE 512            // default UDP payload size
+#define SDRDAEMONFEC_UDPSIZEMAX 8972        // largest UDP payload size (9000 bytes jumbo frames MTU)
+#define SDRDAEMONFEC_NBORIGINALBLOCKS 128   // largest number of sample blocks per frame excluding FEC blocks (as sent by older senders)
+#define SDRDAEMONFEC_NBDECODERSLOTS 16      // largest number of decoder slots. Power of two sub multiple of the uint16_t frame index range
+#define SDRDAEMONFEC_REORDERWINDOWMAX 8     // largest number of frames kept open for late (reordered) blocks. Half the decoder slots.
+#define SDRDAEMONFEC_PACKED12 0x10          // sample bytes indicator: I/Q pairs of 12 bits packed in 3 bytes
+#define SDRDAEMONFEC_PACKED8 0x20           // sample bytes indicator: I/Q pairs of 8 bits in 2 bytes
+#define SDRDAEMONFEC_LZ4 0x40               // sample bytes indicator: the data blocks carry the LZ4 compressed samples
+#define SDRDAEMONFEC_LZ4RATIO 4             // largest size of the decompressed data in number of frame data sizes
+#define SDRDAEMONFEC_SQUELCH 0x80           // sample bytes indicator: keep-alive frame of the meta data block only standing for silent samples
+#define SDRDAEMONFEC_BLOCKCRC 0x01          // header filler indicator: the superblock ends with the CRC32C of the rest (meta data CRC is then CRC32C)
+#define SDRDAEMONFEC_BLOCKSSHIFT 1          // header filler bits 1 to 7: SDRDAEMONFEC_NBORIGINALBLOCKS minus the original blocks of the frame
+#define SDRDAEMONFEC_LARGEFRAME 127         // header filler bits 1 to 7 of large frames (more than 128 original or FEC blocks): not decoded here
 
 class SDRdaemonFECBuffer
 {
@@ -45,6 +58,21 @@ public:
         uint8_t  m_nbFECBlocks;       //!< 12 number of blocks carrying FEC
         uint32_t m_tv_sec;            //!< 16 seconds of timestamp at start time of super-frame processing
         uint32_t m_tv_usec;           //!< 20 microseconds of timestamp at start time of super-frame processing
+        uint32_t m_crc32;             //!< 24 CRC32 of the above
+        uint16_t m_udpSize;           //!< 26 size of the UDP datagrams in bytes (0 from older senders: 512)
+        uint16_t m_hopCount;          //!< 28 frequency scan retunes done (wraps around, 0 without scan)
+        uint32_t m_retuneOffset;      //!< 32 index in the frame of the first sample after a retune (0xFFFFFFFF: no retune)
+        uint32_t m_retuneFrequency;   //!< 36 center frequency in kHz after the retune
+        uint32_t m_settleSamples;     //!< 40 samples not yet settled from the retune (or from the frame start when still settling)
+        uint32_t m_compressedBytes;   //!< 44 length of the LZ4 compressed data in the data blocks (compressed frames)
+        uint32_t m_frameBytes;        //!< 48 length of the data once decompressed (compressed frames)
+        uint32_t m_squelchSamples;    //!< 52 number of silent samples the keep-alive frame stands for (squelched frames)
+        uint64_t m_sampleIndex;       //!< 60 index in the stream of the first sample of the frame (all samples since start)
+        uint64_t m_anchorIndex;       //!< 68 index in the stream of the sample captured at m_anchorTime
+        uint64_t m_anchorTime;        //!< 76 capture time of the anchor sample in nanoseconds since the Unix epoch (0: unknown)
+        uint8_t  m_fecCodec;          //!< 77 codec of the FEC blocks (0: CM256 also from older senders, 1: XOR parity, 2: LDPC)
+        uint16_t m_nbOriginalBlocksLarge; //!< 79 number of original blocks of large frames (0 otherwise)
+        uint16_t m_nbFECBlocksLarge;  //!< 81 number of FEC blocks of large frames (0 otherwise)
 
         bool operator==(const MetaDataFEC& rhs)
         {
@@ -71,79 +99,99 @@ public:
         uint8_t  filler;
     };
 
-    static const int samplesPerBlock = (SDRDAEMONFEC_UDPSIZE - sizeof(Header)) / sizeof(Sample);
-
-    struct ProtectedBlock
-    {
-        Sample samples[samplesPerBlock];
-    };
-
-    struct SuperBlock
-    {
-        Header         header;
-        ProtectedBlock protectedBlock;
-    };
-
-    struct ProtectedBlockZero
-    {
-        MetaDataFEC m_metaData;
-        uint8_t     m_filler[SDRDAEMONFEC_UDPSIZE - sizeof(Header) - sizeof(MetaDataFEC)]; // complete for a 512 byte block
-    };
-
 #pragma pack(pop)
 
+    // A SuperBlock is a Header followed by a protected block. Its size is the size of the
+    // received datagrams (SDRDAEMONFEC_UDPSIZE by default) so it is only known at run time.
+
 	SDRdaemonFECBuffer();
 	~SDRdaemonFECBuffer();
 
+	/**
+	 * Write a superblock to buffer and read a complete data block
+	 * \param  array      pointer the input superblock
+	 * \param  length     length of superblock. A change of length (datagram size) restarts the decoder
+	 * \param  data       pointer to the output data block. Room for 127 protected blocks of the largest datagram size (full frames)
+	 * \param  dataLength reference to the output data length. This length is 0
+	 * \return true if an output data block is available else false
+	 */
 	bool writeAndRead(uint8_t *array, std::size_t length, uint8_t *data, uint32_t& dataLength);
+
+	/**
+	 * Set the reordering window: number of frames that are decoded concurrently. A frame is output
+	 * (in frame order) when a block of the frame nbFrames after it arrives so blocks arriving up to
+	 * nbFrames-1 frames late still contribute to their frame. 1 (the default) outputs a frame as soon as a block
+	 * of the next frame arrives. Restarts the decoder. Limited to SDRDAEMONFEC_REORDERWINDOWMAX.
+	 */
+	void setReorderWindow(int nbFrames);
+	int getReorderWindow() const { return m_reorderWindow; }
 	const MetaDataFEC& getCurrentMeta() const { return m_currentMeta; }
     const MetaDataFEC& getOutputMeta() const { return m_outputMeta; }
 	int getCurNbBlocks() const { return m_curNbBlocks; }
 	int getCurNbRecovery() const { return m_curNbRecovery; }
+	int getCurNbOriginalBlocks() const { return m_curNbOriginalBlocks; } //!< original blocks of the frame output (frames may be shorter than 128 blocks)
 	float getAvgNbBlocks() const { return m_avgNbBlocks; }
 	float getAvgNbRecovery() const { return m_avgNbRecovery; }
+	int getUdpSize() const { return m_udpSize; }
+	uint32_t getNbLateBlocks() const { return m_nbLateBlocks; } //!< blocks dropped because their frame was already output
 
 private:
-	static const int udpSize = SDRDAEMONFEC_UDPSIZE;
 	static const int nbOriginalBlocks = SDRDAEMONFEC_NBORIGINALBLOCKS;
 	static const int nbDecoderSlots = SDRDAEMONFEC_NBDECODERSLOTS;
 
-#pragma pack(push, 1)
-	struct BufferFrame0
-	{
-	    ProtectedBlock  m_blocks[nbOriginalBlocks];
-	};
-    struct BufferFrame
-    {
-        ProtectedBlock  m_blocks[nbOriginalBlocks - 1];
-    };
-#pragma pack(pop)
-
 	struct DecoderSlot
     {
-        BufferFrame0         m_frame; //!< retrieved frames including block0 with meta data
-        ProtectedBlock*      m_originalBlockPtrs[nbOriginalBlocks];
-        ProtectedBlock       m_recoveryBlocks[nbOriginalBlocks]; // max size
-        cm256_block          m_cm256DescriptorBlocks[nbOriginalBlocks];
+        std::vector<uint8_t> m_frame; //!< retrieved frames including block0 with meta data: nbOriginalBlocks protected blocks
+        std::vector<uint8_t> m_recoveryBlocks; //!< nbOriginalBlocks protected blocks (max size)
+        uint8_t              m_recoveryIndexes[nbOriginalBlocks]; //!< block index of each recovery block stored
+        int                  m_nbOriginalBlocks; //!< original blocks of the frame as told by the headers of its blocks
         int                  m_blockCount; //!< total number of blocks received for this frame
         int                  m_recoveryCount; //!< number of recovery blocks received
-        bool                 m_decoded; //!< true if decoded
+        bool                 m_decoded; //!< true if complete (no decoding needed) or restored by CM256
         bool                 m_metaRetrieved;
+        uint64_t             m_received[4]; //!< bit map of the block indexes received
+
+        bool received(int blockIndex) const { return (m_received[blockIndex >> 6] >> (blockIndex & 63)) & 1; }
     };
 
-    void getSlotData(uint8_t *data, uint32_t& dataLength);
+    void getSlotData(DecoderSlot& slot, uint8_t *data, uint32_t& dataLength);
+    void getCompressedData(DecoderSlot& slot, uint8_t *data, uint32_t& dataLength);
+    static void unpackBlock(const uint8_t *block, Sample *samples, int nbSamples);
+    static void widenBlock(const uint8_t *block, Sample *samples, int nbSamples);
     void printMeta(MetaDataFEC *metaData);
-    void initDecodeSlot();
-
+    void initDecodeSlot(DecoderSlot& slot);
+    void storeBlock(DecoderSlot& slot, int blockIndex, uint8_t *protectedBlock);
+    bool decodeSlot(DecoderSlot& slot);
+    bool setUdpSize(std::size_t udpSize);
+    static bool checkBlockCRC(const uint8_t *array, std::size_t& length);
+
+    /** Number of original blocks of the frame of a superblock: full frames from older senders have a 0 filler */
+    static int headerNbOriginalBlocks(const Header *header)
+    {
+        return std::max(2, nbOriginalBlocks - (header->filler >> SDRDAEMONFEC_BLOCKSSHIFT));
+    }
+    DecoderSlot& decoderSlot(int frameIndex) { return m_decoderSlots[frameIndex & (m_nbDecoderSlots - 1)]; }
+    uint8_t *frameBlock(DecoderSlot& slot, int blockIndex) { return &slot.m_frame[blockIndex * m_blockSize]; }
+    uint8_t *recoveryBlock(DecoderSlot& slot, int recoveryIndex) { return &slot.m_recoveryBlocks[recoveryIndex * m_blockSize]; }
+
+	int                  m_udpSize;      //!< Size of the SuperBlocks (received datagrams)
+	int                  m_blockSize;    //!< Size of the protected blocks
 	MetaDataFEC          m_currentMeta;  //!< Stored current meta data from input
 	MetaDataFEC          m_outputMeta;   //!< Meta data corresponding to output frame
+	std::vector<uint8_t> m_decompressed; //!< data of the last compressed frame output
 	cm256_encoder_params m_paramsCM256;
-	DecoderSlot          m_decoderSlot;
-    //BufferFrame          m_frames[nbDecoderSlots]; in the most general case you would use it as the samples buffer
-	int                  m_decoderIndexHead;
-	int                  m_frameHead;
+	cm256_block          m_cm256DescriptorBlocks[nbOriginalBlocks]; //!< set up for each frame to restore
+	std::vector<DecoderSlot> m_decoderSlots; //!< ring of decoder slots indexed by frame index modulo its size
+	int                  m_nbDecoderSlots; //!< number of decoder slots: power of two at least twice the reordering window
+	int                  m_reorderWindow;  //!< number of frames decoded concurrently
+	int                  m_frameHead;      //!< oldest frame not yet output or -1 before the first block
+	int                  m_frameTail;      //!< most recent frame a block was received for
+	uint32_t             m_nbLateBlocks;   //!< (stats) blocks received for frames already output
+	int                  m_lateRun;        //!< number of consecutive late blocks
+	uint32_t             m_nbLargeBlocks;  //!< (stats) blocks of large frames dropped
 	int                  m_curNbBlocks;          //!< (stats) instantaneous number of blocks received
 	int                  m_curNbRecovery;        //!< (stats) instantaneous number of recovery blocks used
+	int                  m_curNbOriginalBlocks;  //!< (stats) original blocks of the frame output
 	MovingAverage<int, int, 10> m_avgNbBlocks;   //!< (stats) average number of blocks received
 	MovingAverage<int, int, 10> m_avgNbRecovery; //!< (stats) average number of recovery blocks used
 	bool                 m_cm256_OK;
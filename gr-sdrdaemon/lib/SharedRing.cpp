@@ -0,0 +1,289 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+
+#include "SharedRing.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit word");
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout)
+{
+    return syscall(SYS_futex, (uint32_t *) word, op, value, timeout, 0, 0);
+}
+
+SharedRing::SharedRing() :
+    m_base(0),
+    m_size(0),
+    m_header(0),
+    m_fd(-1),
+    m_producer(false),
+    m_nbSlots(0),
+    m_slotSamples(0),
+    m_slotBytes(0),
+    m_readCount(0),
+    m_readSeq(0),
+    m_nbLostFrames(0)
+{
+    static_assert(sizeof(Header) <= m_headerBytes, "SharedRing header too large");
+    static_assert(sizeof(Slot) <= m_slotHeaderBytes, "SharedRing slot header too large");
+}
+
+SharedRing::~SharedRing()
+{
+    close();
+}
+
+bool SharedRing::create(const std::string& name, unsigned int nbSlots, unsigned int slotSamples)
+{
+    close();
+    m_name = name.empty() || (name[0] != '/') ? "/" + name : name;
+
+    if ((nbSlots < 2) || (slotSamples == 0))
+    {
+        m_error = "SharedRing::create: at least 2 slots of 1 sample";
+        return false;
+    }
+
+    shm_unlink(m_name.c_str()); // left over by a producer that did not stop cleanly
+    m_fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    if (m_fd < 0)
+    {
+        m_error = "SharedRing::create: cannot create " + m_name + ": " + strerror(errno);
+        return false;
+    }
+
+    m_slotBytes = (m_slotHeaderBytes + slotSamples * 4 + 63) & ~63U;
+    m_size = m_headerBytes + nbSlots * (std::size_t) m_slotBytes;
+
+    if (ftruncate(m_fd, m_size) < 0)
+    {
+        m_error = "SharedRing::create: cannot size " + m_name + ": " + strerror(errno);
+        close();
+        return false;
+    }
+
+    void *base = mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        m_error = std::string("SharedRing::create: cannot map the ring: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+    // the new object is zero filled: all slots free, nothing published
+    m_base = (uint8_t *) base;
+    m_header = (Header *) m_base;
+    m_producer = true;
+    m_nbSlots = nbSlots;
+    m_slotSamples = slotSamples;
+    m_header->m_version = SHAREDRING_VERSION;
+    m_header->m_nbSlots = nbSlots;
+    m_header->m_slotSamples = slotSamples;
+    m_header->m_slotBytes = m_slotBytes;
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->m_magic = SHAREDRING_MAGIC; // last: consumers attaching before see no ring yet
+    return true;
+}
+
+bool SharedRing::attach(const std::string& name)
+{
+    close();
+    m_name = name.empty() || (name[0] != '/') ? "/" + name : name;
+    m_fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+
+    if (m_fd < 0)
+    {
+        m_error = "SharedRing::attach: cannot open " + m_name + ": " + strerror(errno);
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(m_fd, &st) < 0) || ((std::size_t) st.st_size < m_headerBytes))
+    {
+        m_error = "SharedRing::attach: " + m_name + " is not ready";
+        close();
+        return false;
+    }
+
+    void *base = mmap(0, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        m_error = std::string("SharedRing::attach: cannot map the ring: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+    m_base = (uint8_t *) base;
+    m_size = st.st_size;
+    const Header *header = (const Header *) m_base;
+
+    if ((header->m_magic != SHAREDRING_MAGIC) || (header->m_version != SHAREDRING_VERSION)
+        || (m_size != m_headerBytes + header->m_nbSlots * (std::size_t) header->m_slotBytes))
+    {
+        m_error = "SharedRing::attach: " + m_name + " is not a ring of this version";
+        munmap(m_base, m_size);
+        m_base = 0;
+        close();
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    m_header = (Header *) m_base;
+    m_nbSlots = header->m_nbSlots;
+    m_slotSamples = header->m_slotSamples;
+    m_slotBytes = header->m_slotBytes;
+    m_readCount = m_header->m_writeCount.load(std::memory_order_acquire); // from the next frame on
+    m_nbLostFrames = 0;
+    return true;
+}
+
+void SharedRing::close()
+{
+    if (m_header && m_producer)
+    {
+        m_header->m_closed.store(1, std::memory_order_release);
+        m_header->m_futex.fetch_add(1, std::memory_order_release);
+        futex(&m_header->m_futex, FUTEX_WAKE, INT_MAX, 0);
+    }
+
+    if (m_base) {
+        munmap(m_base, m_size);
+    }
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+
+        if (m_producer) {
+            shm_unlink(m_name.c_str());
+        }
+    }
+
+    m_base = 0;
+    m_size = 0;
+    m_header = 0;
+    m_fd = -1;
+    m_producer = false;
+}
+
+void SharedRing::write(const FrameMeta& meta, const void *samples, unsigned int nbSamples)
+{
+    uint64_t frame = m_header->m_writeCount.load(std::memory_order_relaxed);
+    Slot *s = slot(frame);
+    nbSamples = nbSamples > m_slotSamples ? m_slotSamples : nbSamples;
+
+    s->m_seq.store(2*frame + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // odd before any of the frame data
+    s->m_meta = meta;
+    s->m_meta.m_nbSamples = nbSamples;
+    memcpy((uint8_t *) s + m_slotHeaderBytes, samples, nbSamples * 4);
+    s->m_seq.store(2*frame + 2, std::memory_order_release);
+    m_header->m_writeCount.store(frame + 1, std::memory_order_release);
+    m_header->m_futex.fetch_add(1, std::memory_order_release);
+    futex(&m_header->m_futex, FUTEX_WAKE, INT_MAX, 0);
+}
+
+bool SharedRing::peek(FrameMeta& meta, const void *&samples)
+{
+    for (;;)
+    {
+        uint64_t written = m_header->m_writeCount.load(std::memory_order_acquire);
+
+        if (m_readCount >= written) {
+            return false;
+        }
+
+        if (written - m_readCount >= m_nbSlots) // the slot of the frame after the last one written may be in the writes
+        {
+            m_nbLostFrames += written - m_readCount - (m_nbSlots - 1);
+            m_readCount = written - (m_nbSlots - 1);
+        }
+
+        const Slot *s = slot(m_readCount);
+        uint64_t seq = s->m_seq.load(std::memory_order_acquire);
+
+        if (seq != 2*m_readCount + 2) { // taken by the producer meanwhile: look again where it is
+            continue;
+        }
+
+        meta = s->m_meta;
+        samples = (const uint8_t *) s + m_slotHeaderBytes;
+        m_readSeq = seq;
+        return true;
+    }
+}
+
+bool SharedRing::check() const
+{
+    std::atomic_thread_fence(std::memory_order_acquire); // the data taken before the sequence read again
+    return slot(m_readCount)->m_seq.load(std::memory_order_relaxed) == m_readSeq;
+}
+
+bool SharedRing::wait(int timeoutMs)
+{
+    uint32_t word = m_header->m_futex.load(std::memory_order_acquire);
+
+    if (m_header->m_writeCount.load(std::memory_order_acquire) > m_readCount) {
+        return true;
+    }
+
+    if (m_header->m_closed.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    futex(&m_header->m_futex, FUTEX_WAIT, word, &timeout); // returns at once if a frame came after word was read
+
+    return m_header->m_writeCount.load(std::memory_order_acquire) > m_readCount;
+}
+
+bool SharedRing::stale() const
+{
+    if (!m_header || m_header->m_closed.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    // a producer that did not stop cleanly leaves the ring open: see if the name is still ours
+    int fd = shm_open(m_name.c_str(), O_RDONLY, 0);
+
+    if (fd < 0) {
+        return true;
+    }
+
+    struct stat current, attached;
+    bool same = (fstat(fd, &current) == 0) && (fstat(m_fd, &attached) == 0) && (current.st_ino == attached.st_ino);
+    ::close(fd);
+    return !same;
+}
@@ -29,39 +29,134 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <boost/crc.hpp>
+#include "CRC32C.h"
+
+#if defined(USE_SSE4_1) || defined(USE_AVX2)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
 
 #include <iostream>
 
 namespace gr {
   namespace sdrdaemon {
 
-    const int sdrdaemonsource_impl::BUF_SIZE_PAYLOADS = 512;
+    const int sdrdaemonsource_impl::BUF_SIZE_PAYLOADS = 4096; // about 50 ms at 10 MS/s with 512 bytes datagrams
+    const int sdrdaemonsource_impl::RING_SIZE_PAYLOADS = 4096;
+    const int sdrdaemonsource_impl::RX_BATCH = 64;
+    static const int RX_CONTROL_SIZE = CMSG_SPACE(sizeof(struct scm_timestamping));
 
     sdrdaemonsource::sptr
-    sdrdaemonsource::make(std::size_t itemsize, const std::string &host, int port, int payload_size)
+    sdrdaemonsource::make(std::size_t itemsize, const std::string &host, int port, int payload_size, int reorder_window, bool complex_output)
     {
       return gnuradio::get_initial_sptr
-        (new sdrdaemonsource_impl(itemsize, host, port, payload_size));
+        (new sdrdaemonsource_impl(itemsize, host, port, payload_size, reorder_window, complex_output));
+    }
+
+    /*
+     * 16 bit I/Q to complex float. SDRdaemon normalizes the samples to 16 bits whatever their effective size
+     * (m_sampleBits) so the full scale is always 2^15.
+     */
+    static void convert_to_complex(const int16_t *in, float *out, std::size_t nb_values)
+    {
+        const float scale = 1.0f / 32768.0f;
+        std::size_t i = 0;
+#if defined(USE_AVX2)
+        const __m256 s = _mm256_set1_ps(scale);
+
+        for (; i + 8 <= nb_values; i += 8)
+        {
+            __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*) &in[i]));
+            _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(v), s));
+        }
+#elif defined(USE_SSE4_1)
+        const __m128 s = _mm_set1_ps(scale);
+
+        for (; i + 4 <= nb_values; i += 4)
+        {
+            __m128i v = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*) &in[i]));
+            _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(v), s));
+        }
+#elif defined(USE_NEON)
+        for (; i + 4 <= nb_values; i += 4) {
+            vst1q_f32(&out[i], vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vld1_s16(&in[i]))), scale));
+        }
+#endif
+        for (; i < nb_values; i++) {
+            out[i] = in[i] * scale;
+        }
     }
 
     /*
      * The private constructor
      */
-    sdrdaemonsource_impl::sdrdaemonsource_impl(std::size_t itemsize, const std::string &host, int port, int payload_size)
+    sdrdaemonsource_impl::sdrdaemonsource_impl(std::size_t itemsize, const std::string &host, int port, int payload_size, int reorder_window, bool complex_output)
       : gr::sync_block("sdrdaemonsource",
               gr::io_signature::make(0, 0, 0),
               gr::io_signature::make(1, 1, itemsize)),
               d_itemsize(itemsize),
+              d_complex_output(complex_output),
               d_payload_size(payload_size),
               d_connected(false),
               d_sdrdmnbuf(),
-              d_residual(0),
-              d_sent(0),
-              d_offset(0)
+              d_rx_write(0),
+              d_rx_read(0),
+              d_decode_waiting(0),
+              d_nb_dropped(0),
+              d_ring_write(0),
+              d_ring_read(0),
+              d_waiting(0),
+              d_room_waiting(0),
+              d_decode_stop(false),
+              d_nb_timed_frames(0),
+              d_latency(0.0),
+              d_avg_latency(0.0),
+              d_max_latency(0.0),
+              d_jitter(0.0),
+              d_shm_mode(false),
+              d_shm_frame(0),
+              d_shm_offset(0),
+              d_shm_timeouts(0),
+              d_ring_mode(false),
+              d_rx_stop(false)
     {
-        // Give us some more room to play.
+        if (complex_output && ((itemsize == 0) || (itemsize % sizeof(gr_complex) != 0))) {
+            throw std::invalid_argument("sdrdaemonsource: complex output needs an item size multiple of sizeof(gr_complex)");
+        }
+
+        // Give us some more room to play: the decoding of a frame does not hold the draining of the socket
         d_rxbuf = new char[BUF_SIZE_PAYLOADS * d_payload_size];
-        d_residbuf = new char[BUF_SIZE_PAYLOADS * d_payload_size];
+        d_rxlen.resize(BUF_SIZE_PAYLOADS);
+        d_dropbuf = new char[RX_BATCH * d_payload_size];
+        // a completed frame writes up to 127 blocks at once, twice that when 8 bit samples are widened
+        // and SDRDAEMONFEC_LZ4RATIO times more when decompressed
+        d_frame_max = (SDRDAEMONFEC_NBORIGINALBLOCKS - 1) * d_payload_size * 2 * SDRDAEMONFEC_LZ4RATIO;
+        d_ring_size = RING_SIZE_PAYLOADS * d_payload_size;
+        d_ring = new char[d_ring_size + d_frame_max];
+        d_sdrdmnbuf.setReorderWindow(reorder_window);
+
+        // one receive slot of payload size per datagram of a recvmmsg batch (set at each batch)
+        d_rxmsgs.resize(RX_BATCH);
+        d_rxiovecs.resize(RX_BATCH);
+        d_rxcontrol.resize(RX_BATCH * RX_CONTROL_SIZE);
+        d_ringpayloads.resize(RX_BATCH);
+        d_ringlengths.resize(RX_BATCH);
+        d_ringstamps.resize(RX_BATCH);
+
+        for (int i = 0; i < RX_BATCH; i++)
+        {
+            d_rxiovecs[i].iov_len = d_payload_size;
+            memset(&d_rxmsgs[i], 0, sizeof(struct mmsghdr));
+            d_rxmsgs[i].msg_hdr.msg_iov = &d_rxiovecs[i];
+            d_rxmsgs[i].msg_hdr.msg_iovlen = 1;
+        }
 
         connect(host, port);
     }
@@ -77,7 +172,8 @@ namespace gr {
         }
 
         delete[] d_rxbuf;
-        delete[] d_residbuf;
+        delete[] d_dropbuf;
+        delete[] d_ring;
     }
 
 
@@ -91,13 +187,39 @@ namespace gr {
         d_host = host;
         d_port = static_cast<unsigned short>(port);
 
+        if (host.compare(0, 4, "shm:") == 0)
+        {
+            d_shm_mode = true;
+            d_shm_name = host.substr(4);
+            memset(&d_shm_meta, 0, sizeof(d_shm_meta));
+            d_shm_offset = 0;
+
+            if (!d_shm.attach(d_shm_name)) {
+                std::cerr << "sdrdaemonsource_impl::connect: " << d_shm.error() << ": waiting for the producer" << std::endl;
+            }
+
+            d_connected = true;
+            return;
+        }
+
+        d_shm_mode = false;
+        d_ring_mode = false;
         std::string s_port;
         s_port = (boost::format("%d") % d_port).str();
+        std::string bind_host = host;
+        bool use_ring = false;
+
+        if (host.compare(0, 5, "ring:") == 0) // the packet ring takes the datagrams to the port on any address
+        {
+            d_ring_interface = host.substr(5);
+            bind_host = "0.0.0.0";
+            use_ring = true;
+        }
 
         if (host.size() > 0)
         {
             boost::asio::ip::udp::resolver resolver(d_io_service);
-            boost::asio::ip::udp::resolver::query query(d_host, s_port, boost::asio::ip::resolver_query_base::passive);
+            boost::asio::ip::udp::resolver::query query(bind_host, s_port, boost::asio::ip::resolver_query_base::passive);
             d_endpoint = *resolver.resolve(query);
 
             d_socket = new boost::asio::ip::udp::socket(d_io_service);
@@ -111,9 +233,34 @@ namespace gr {
 
             d_socket->bind(d_endpoint);
 
-            start_receive();
-            d_udp_thread = gr::thread::thread(
-                    boost::bind(&sdrdaemonsource_impl::run_io_service, this));
+            // kernel arrival timestamps for the latency statistics
+            int tsflags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+            if (setsockopt(d_socket->native_handle(), SOL_SOCKET, SO_TIMESTAMPING, &tsflags, sizeof(tsflags)) < 0) {
+                std::cerr << "sdrdaemonsource_impl::connect: cannot enable arrival timestamps: no latency statistics" << std::endl;
+            }
+
+            if (use_ring) {
+                open_packet_ring();
+            }
+
+            __atomic_store_n(&d_decode_stop, false, __ATOMIC_SEQ_CST);
+            d_decode_thread = gr::thread::thread(
+                    boost::bind(&sdrdaemonsource_impl::run_decoder, this));
+
+            if (d_ring_mode)
+            {
+                __atomic_store_n(&d_rx_stop, false, __ATOMIC_SEQ_CST);
+                d_udp_thread = gr::thread::thread(
+                        boost::bind(&sdrdaemonsource_impl::run_packet_ring, this));
+            }
+            else
+            {
+                start_receive();
+                d_udp_thread = gr::thread::thread(
+                        boost::bind(&sdrdaemonsource_impl::run_io_service, this));
+            }
+
             d_connected = true;
         }
     }
@@ -127,9 +274,35 @@ namespace gr {
             return;
         }
 
-        d_io_service.reset();
-        d_io_service.stop();
-        d_udp_thread.join();
+        if (d_shm_mode)
+        {
+            d_shm.close();
+            d_connected = false;
+            return;
+        }
+
+        if (d_ring_mode)
+        {
+            __atomic_store_n(&d_rx_stop, true, __ATOMIC_SEQ_CST);
+            d_udp_thread.join();
+            d_packet_ring.close();
+        }
+        else
+        {
+            d_io_service.reset();
+            d_io_service.stop();
+            d_udp_thread.join();
+        }
+
+        {
+            gr::thread::scoped_lock decode_lock(d_decode_mutex);
+            gr::thread::scoped_lock room_lock(d_room_mutex);
+            __atomic_store_n(&d_decode_stop, true, __ATOMIC_SEQ_CST);
+            d_decode_cond.notify_one();
+            d_room_cond.notify_one();
+        }
+
+        d_decode_thread.join();
 
         d_socket->close();
         delete d_socket;
@@ -137,28 +310,53 @@ namespace gr {
         d_connected = false;
     }
 
+    // open the packet ring on the port the socket is bound to, else keep receiving from the socket
+    void sdrdaemonsource_impl::open_packet_ring()
+    {
+        if (!d_packet_ring.open(d_ring_interface, d_socket->local_endpoint().port()))
+        {
+            std::cerr << "sdrdaemonsource_impl::connect: " << d_packet_ring.error() << ": using the socket" << std::endl;
+            return;
+        }
+
+        // the socket stays bound (no ICMP port unreachable to the sender) but must not queue the datagrams as well
+        struct sock_filter filter[] = { { BPF_RET | BPF_K, 0, 0, 0 } }; // keep 0 bytes: drop
+        struct sock_fprog fprog;
+        fprog.len = 1;
+        fprog.filter = filter;
+
+        if (setsockopt(d_socket->native_handle(), SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0)
+        {
+            std::cerr << "sdrdaemonsource_impl::connect: cannot attach the socket drop filter: using the socket" << std::endl;
+            d_packet_ring.close();
+            return;
+        }
+
+        d_ring_mode = true;
+    }
+
     // Return port number of d_socket
     int sdrdaemonsource_impl::get_port(void)
     {
         //return d_endpoint.port();
-        return d_socket->local_endpoint().port();
+        return d_shm_mode ? 0 : d_socket->local_endpoint().port();
     }
 
     int sdrdaemonsource_impl::get_center_freq_khz()
     {
-        int centerFreq = d_sdrdmnbuf.getOutputMeta().m_centerFrequency;
+        int centerFreq = d_shm_mode ? d_shm_meta.m_centerFrequency : d_sdrdmnbuf.getOutputMeta().m_centerFrequency;
         return centerFreq == 0 ? 100000 : centerFreq;
     }
 
     int sdrdaemonsource_impl::get_sample_rate_hz()
     {
-        int sampleRate = d_sdrdmnbuf.getOutputMeta().m_sampleRate;
+        int sampleRate = d_shm_mode ? d_shm_meta.m_sampleRate : d_sdrdmnbuf.getOutputMeta().m_sampleRate;
         return sampleRate == 0 ? 48000 : sampleRate;
     }
 
     int sdrdaemonsource_impl::get_sample_bits()
     {
-        int sampleBits = d_sdrdmnbuf.getOutputMeta().m_sampleBits;
+        int sampleBits = d_shm_mode ? d_shm_meta.m_sampleBits : d_sdrdmnbuf.getOutputMeta().m_sampleBits;
         return sampleBits == 0 ? 8 : sampleBits;
     }
 
@@ -182,13 +380,89 @@ namespace gr {
         return d_sdrdmnbuf.getAvgNbRecovery();
     }
 
+    float sdrdaemonsource_impl::get_latency_ms()
+    {
+        return d_avg_latency;
+    }
+
+    float sdrdaemonsource_impl::get_max_latency_ms()
+    {
+        float max_latency = d_max_latency;
+        d_max_latency = d_latency;
+        return max_latency;
+    }
+
+    float sdrdaemonsource_impl::get_jitter_ms()
+    {
+        return d_jitter;
+    }
+
+    // arrival time of a datagram from the kernel timestamp of its control messages
+    void sdrdaemonsource_impl::update_latency(const char *block, int length, const struct msghdr& msg_hdr)
+    {
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg_hdr); cmsg; cmsg = CMSG_NXTHDR((struct msghdr *) &msg_hdr, cmsg))
+        {
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPING))
+            {
+                const struct scm_timestamping *stamps = (const struct scm_timestamping *) CMSG_DATA(cmsg);
+                update_latency(block, length, stamps->ts[0]);
+            }
+        }
+    }
+
+    // the meta data block, the first block sent for a frame, gives the time the sender started the frame
+    void sdrdaemonsource_impl::update_latency(const char *block, int length, const struct timespec& arrival)
+    {
+        const SDRdaemonFECBuffer::Header *header = (const SDRdaemonFECBuffer::Header *) block;
+        const SDRdaemonFECBuffer::MetaDataFEC *meta = (const SDRdaemonFECBuffer::MetaDataFEC *) &header[1];
+
+        if ((header->blockIndex != 0) || (length < (int) (sizeof(SDRdaemonFECBuffer::Header) + sizeof(SDRdaemonFECBuffer::MetaDataFEC)))) {
+            return;
+        }
+
+        uint32_t crc;
+
+        if (header->filler & SDRDAEMONFEC_BLOCKCRC) // senders checking the blocks use CRC32C for the meta data as well
+        {
+            crc = CRC32C::calculate((const uint8_t *) meta, 20);
+        }
+        else
+        {
+            boost::crc_32_type crc32;
+            crc32.process_bytes(meta, 20);
+            crc = crc32.checksum();
+        }
+
+        if (crc != meta->m_crc32) {
+            return;
+        }
+
+        double latency = (arrival.tv_sec - (double) meta->m_tv_sec) * 1000.0
+                + (arrival.tv_nsec / 1.0e6) - (meta->m_tv_usec / 1.0e3);
+
+        if (d_nb_timed_frames > 0)
+        {
+            d_jitter += (fabs(latency - d_latency) - d_jitter) / 16.0; // RFC 3550
+            d_avg_latency += (latency - d_avg_latency) / 16.0;
+        }
+        else
+        {
+            d_avg_latency = latency;
+        }
+
+        if ((d_nb_timed_frames == 0) || (latency > d_max_latency)) {
+            d_max_latency = latency;
+        }
+
+        d_latency = latency;
+        d_nb_timed_frames++;
+    }
+
     void sdrdaemonsource_impl::start_receive()
     {
-        d_socket->async_receive_from(
-                boost::asio::buffer(
-                        (void*) d_rxbuf,
-                        d_payload_size),
-                d_endpoint_rcvd,
+        // only wait for readiness then drain the socket with recvmmsg in handle_read
+        d_socket->async_receive(
+                boost::asio::null_buffers(),
                 boost::bind(
                         &sdrdaemonsource_impl::handle_read,
                         this,
@@ -197,80 +471,337 @@ namespace gr {
         );
     }
 
-    void sdrdaemonsource_impl::handle_read(const boost::system::error_code& error, std::size_t bytes_transferred)
+    // only drains the socket into the datagram ring: the FEC decoding runs in run_decoder
+    void sdrdaemonsource_impl::handle_read(const boost::system::error_code& error, std::size_t bytes_transferred __attribute__((unused)))
     {
         if (!error)
         {
-            boost::lock_guard<gr::thread::mutex> lock(d_udp_mutex);
+            int nbMsgs, nbSlots;
+
+            do
+            {
+                uint64_t write = d_rx_write;
+                uint64_t read = __atomic_load_n(&d_rx_read, __ATOMIC_ACQUIRE);
+                nbSlots = std::min<uint64_t>(RX_BATCH, BUF_SIZE_PAYLOADS - (write - read));
+                bool drop = nbSlots == 0; // the decoding is behind: drain the socket all the same
+
+                if (drop) {
+                    nbSlots = RX_BATCH;
+                }
+
+                for (int i = 0; i < nbSlots; i++) // reset by each recvmmsg
+                {
+                    d_rxiovecs[i].iov_base = drop ? d_dropbuf + i * d_payload_size : d_rxbuf + ((write + i) % BUF_SIZE_PAYLOADS) * d_payload_size;
+                    d_rxmsgs[i].msg_hdr.msg_control = &d_rxcontrol[i * RX_CONTROL_SIZE];
+                    d_rxmsgs[i].msg_hdr.msg_controllen = RX_CONTROL_SIZE;
+                }
+
+                nbMsgs = recvmmsg(d_socket->native_handle(), &d_rxmsgs[0], nbSlots, MSG_DONTWAIT, 0);
+
+                if (nbMsgs <= 0) {
+                    break; // EAGAIN: socket drained
+                }
+
+                if (drop)
+                {
+                    if (d_nb_dropped == 0) {
+                        std::cerr << "sdrdaemonsource_impl::handle_read: FEC decoding too slow: dropping datagrams" << std::endl;
+                    }
+
+                    d_nb_dropped += nbMsgs;
+                    continue;
+                }
+
+                for (int i = 0; i < nbMsgs; i++)
+                {
+                    d_rxlen[(write + i) % BUF_SIZE_PAYLOADS] = d_rxmsgs[i].msg_len;
+                    update_latency((const char *) d_rxiovecs[i].iov_base, d_rxmsgs[i].msg_len, d_rxmsgs[i].msg_hdr);
+                }
+
+                // the datagrams are published once per batch: the decoder reads up to the release store of d_rx_write
+                __atomic_store_n(&d_rx_write, write + nbMsgs, __ATOMIC_SEQ_CST);
+
+                if (__atomic_load_n(&d_decode_waiting, __ATOMIC_SEQ_CST)) // the decoder is waiting on an empty ring
+                {
+                    gr::thread::scoped_lock lock(d_decode_mutex);
+                    d_decode_cond.notify_one();
+                }
+            } while (nbMsgs == nbSlots);
+        }
+
+        start_receive();
+    }
+
+    // receive thread of the packet ring: copies the payloads, used in place from the ring, into the datagram ring
+    void sdrdaemonsource_impl::run_packet_ring()
+    {
+        unsigned int nbRingDrops = 0;
+
+        while (!__atomic_load_n(&d_rx_stop, __ATOMIC_SEQ_CST))
+        {
+            uint64_t write = d_rx_write;
+            uint64_t read = __atomic_load_n(&d_rx_read, __ATOMIC_ACQUIRE);
+            int nbSlots = std::min<uint64_t>(RX_BATCH, BUF_SIZE_PAYLOADS - (write - read));
+            bool drop = nbSlots == 0; // the decoding is behind: drain the packet ring all the same
 
-            // Make sure we never go beyond the boundary of the
-            // residual buffer.  This will just drop the last bit of
-            // data in the buffer if we've run out of room.
-            if ((int) (d_residual + bytes_transferred) >= (BUF_SIZE_PAYLOADS * d_payload_size))
+            if (drop) {
+                nbSlots = RX_BATCH;
+            }
+
+            // short timeout so that the stop flag is seen
+            int nbMsgs = d_packet_ring.receive(&d_ringpayloads[0], &d_ringlengths[0], nbSlots, 10, 0, &d_ringstamps[0]);
+            unsigned int drops = d_packet_ring.getNbDrops();
+
+            if (drops > 0)
             {
-                //GR_LOG_WARN(d_logger, "Too much data; dropping packet.");
+                if (nbRingDrops == 0) {
+                    std::cerr << "sdrdaemonsource_impl::run_packet_ring: packet ring full: datagrams dropped by the kernel" << std::endl;
+                }
+
+                nbRingDrops += drops;
             }
-            else
+
+            if (nbMsgs <= 0) {
+                continue;
+            }
+
+            if (drop)
+            {
+                if (d_nb_dropped == 0) {
+                    std::cerr << "sdrdaemonsource_impl::run_packet_ring: FEC decoding too slow: dropping datagrams" << std::endl;
+                }
+
+                d_nb_dropped += nbMsgs;
+                continue;
+            }
+
+            for (int i = 0; i < nbMsgs; i++)
+            {
+                std::size_t slot = (write + i) % BUF_SIZE_PAYLOADS;
+                int length = std::min(d_ringlengths[i], d_payload_size); // truncated as recvmmsg would
+                memcpy(d_rxbuf + slot * d_payload_size, d_ringpayloads[i], length);
+                d_rxlen[slot] = length;
+                update_latency(d_rxbuf + slot * d_payload_size, length, d_ringstamps[i]);
+            }
+
+            __atomic_store_n(&d_rx_write, write + nbMsgs, __ATOMIC_SEQ_CST);
+
+            if (__atomic_load_n(&d_decode_waiting, __ATOMIC_SEQ_CST)) // the decoder is waiting on an empty ring
+            {
+                gr::thread::scoped_lock lock(d_decode_mutex);
+                d_decode_cond.notify_one();
+            }
+        }
+    }
+
+    // wait until work has made room for a frame after write. False when stopping.
+    bool sdrdaemonsource_impl::wait_room(uint64_t write)
+    {
+        while (d_ring_size - (write - __atomic_load_n(&d_ring_read, __ATOMIC_ACQUIRE)) < d_frame_max)
+        {
+            gr::thread::scoped_lock lock(d_room_mutex);
+
+            if (__atomic_load_n(&d_decode_stop, __ATOMIC_SEQ_CST)) {
+                return false;
+            }
+
+            __atomic_store_n(&d_room_waiting, 1, __ATOMIC_SEQ_CST);
+
+            if (d_ring_size - (write - __atomic_load_n(&d_ring_read, __ATOMIC_SEQ_CST)) < d_frame_max) {
+                d_room_cond.timed_wait(lock, boost::posix_time::milliseconds(10));
+            }
+
+            __atomic_store_n(&d_room_waiting, 0, __ATOMIC_RELAXED);
+        }
+
+        return true;
+    }
+
+    // decode thread: FEC decodes the datagrams received into the ring read by work. When work falls behind the
+    // datagrams queue up in d_rxbuf then are dropped by the receive thread.
+    void sdrdaemonsource_impl::run_decoder()
+    {
+        uint64_t rx_read = d_rx_read;
+
+        while (!__atomic_load_n(&d_decode_stop, __ATOMIC_ACQUIRE))
+        {
+            uint64_t rx_write = __atomic_load_n(&d_rx_write, __ATOMIC_ACQUIRE);
+
+            if (rx_write == rx_read)
             {
-                // otherwise, copy received data into local buffer for
-                // copying later.
+                // only an empty datagram ring waits and the receive thread notifies only then
+                gr::thread::scoped_lock lock(d_decode_mutex);
+                __atomic_store_n(&d_decode_waiting, 1, __ATOMIC_SEQ_CST);
+
+                if ((__atomic_load_n(&d_rx_write, __ATOMIC_SEQ_CST) == rx_read) && !__atomic_load_n(&d_decode_stop, __ATOMIC_SEQ_CST)) {
+                    d_decode_cond.timed_wait(lock, boost::posix_time::milliseconds(10));
+                }
+
+                __atomic_store_n(&d_decode_waiting, 0, __ATOMIC_RELAXED);
+                continue;
+            }
+
+            uint64_t write = d_ring_write;
+
+            for (; rx_read != rx_write; rx_read++)
+            {
+                if (!wait_room(write)) {
+                    break;
+                }
+
+                // decode into the ring: a frame is written at once when it completes
                 uint32_t dataRead;
-                d_sdrdmnbuf.writeAndRead((uint8_t *) d_rxbuf, bytes_transferred, (uint8_t *) d_residbuf + d_residual, dataRead);
-    //            std::cerr << "sdrdmnfec_source_impl::handle_read:"
-    //                    << " d_residual: " << d_residual
-    //                    << " dataRead: " << dataRead << std::endl;
-                d_residual += dataRead;
-
-                //memcpy(d_residbuf + d_residual, d_rxbuf, bytes_transferred);
-                //d_residual += bytes_transferred;
+                std::size_t pos = write % d_ring_size;
+                std::size_t slot = rx_read % BUF_SIZE_PAYLOADS;
+                d_sdrdmnbuf.writeAndRead((uint8_t *) d_rxbuf + slot * d_payload_size, d_rxlen[slot], (uint8_t *) d_ring + pos, dataRead);
+                __atomic_store_n(&d_rx_read, rx_read + 1, __ATOMIC_RELEASE); // the slot is free for the receive thread
+
+                if (pos + dataRead > d_ring_size) { // wrap the part written in the overhang
+                    memcpy(d_ring, d_ring + d_ring_size, pos + dataRead - d_ring_size);
+                }
+
+                if (dataRead == 0) {
+                    continue;
+                }
+
+                // each frame is published as it completes: work reads up to the release store of d_ring_write
+                write += dataRead;
+                __atomic_store_n(&d_ring_write, write, __ATOMIC_SEQ_CST);
+
+                if (__atomic_load_n(&d_waiting, __ATOMIC_SEQ_CST)) // work is waiting on an empty ring
+                {
+                    gr::thread::scoped_lock lock(d_wait_mutex);
+                    d_cond_wait.notify_one();
+                }
             }
+        }
+    }
+
 
-            d_cond_wait.notify_one();
+    // nbBytes of 16 bit I/Q samples copied or converted to the output stream
+    void sdrdaemonsource_impl::copy_out(char *out, const char *in, std::size_t nbBytes)
+    {
+        if (d_complex_output) {
+            convert_to_complex((const int16_t *) in, (float *) out, nbBytes / sizeof(int16_t));
+        } else {
+            memcpy(out, in, nbBytes);
         }
+    }
 
-        start_receive();
+    // nbBytes of the ring from position from, wrapped at the end
+    void sdrdaemonsource_impl::ring_read(char *out, uint64_t from, std::size_t nbBytes)
+    {
+        std::size_t pos = from % d_ring_size;
+        std::size_t first = std::min(nbBytes, d_ring_size - pos);
+        std::size_t out_first = d_complex_output ? first * 2 : first; // floats are twice the size of the shorts
+
+        copy_out(out, d_ring + pos, first);
+        copy_out(out + out_first, d_ring, nbBytes - first);
     }
 
+    // the output taken straight from the frames of the shared memory ring: a frame may span several calls
+    int sdrdaemonsource_impl::shm_work(int noutput_items, char *out)
+    {
+        if (!d_shm || !d_shm.wait(10))
+        {
+            if (++d_shm_timeouts >= 100) // about a second without frames: the producer may be gone or restarted
+            {
+                d_shm_timeouts = 0;
+
+                if ((!d_shm || d_shm.stale()) && d_shm.attach(d_shm_name))
+                {
+                    std::cerr << "sdrdaemonsource_impl::work: attached to " << d_shm.getName() << std::endl;
+                    d_shm_frame = d_shm.getReadPosition();
+                    d_shm_offset = 0;
+                }
+            }
+
+            if (!d_shm) {
+                usleep(10000);
+            }
+
+            return 0;
+        }
+
+        d_shm_timeouts = 0;
+        SharedRing::FrameMeta meta;
+        const void *samples;
+
+        if (!d_shm.peek(meta, samples)) {
+            return 0;
+        }
+
+        if (d_shm.getReadPosition() != d_shm_frame) // next frame or moved on after an overrun
+        {
+            d_shm_frame = d_shm.getReadPosition();
+            d_shm_offset = 0;
+        }
+
+        std::size_t item_bytes = d_complex_output ? d_itemsize / 2 : d_itemsize;
+        std::size_t frame_bytes = std::min(meta.m_nbSamples, d_shm.getSlotSamples()) * 4;
+        int nitems = std::min<std::size_t>(noutput_items, (frame_bytes - std::min(d_shm_offset, frame_bytes)) / item_bytes);
+
+        copy_out(out, (const char *) samples + d_shm_offset, nitems * item_bytes);
+
+        if (!d_shm.check()) // overwritten while copied: drop what was taken
+        {
+            d_shm.release();
+            return 0;
+        }
+
+        d_shm_meta = meta;
+        d_shm_offset += nitems * item_bytes;
+
+        if (frame_bytes - d_shm_offset < item_bytes) { // what is left does not make an item
+            d_shm.release();
+        }
+
+        return nitems;
+    }
 
     int sdrdaemonsource_impl::work(int noutput_items,
         gr_vector_const_void_star &input_items,
         gr_vector_void_star &output_items)
     {
-        gr::thread::scoped_lock l(d_setlock);
-
         char *out = (char*) output_items[0];
 
-        // Use async receive_from to get data from UDP buffer and wait
-        // on a conditional signal before proceeding. We use this
-        // because the conditional wait is interruptable while a
-        // synchronous receive_from is not.
-        boost::unique_lock<boost::mutex> lock(d_udp_mutex);
+        if (d_shm_mode) {
+            return shm_work(noutput_items, out);
+        }
 
-        //use timed_wait to avoid permanent blocking in the work function
-        d_cond_wait.timed_wait(lock, boost::posix_time::milliseconds(10));
+        uint64_t read = d_ring_read;
+        uint64_t write = __atomic_load_n(&d_ring_write, __ATOMIC_ACQUIRE);
 
-        if (d_residual < 0)
+        if (write == read)
         {
-            return d_residual;
+            // Wait on a conditional signal before proceeding as a synchronous receive is not interruptable.
+            // Only an empty ring waits and the receive thread notifies only then: no lock while samples flow.
+            gr::thread::scoped_lock lock(d_wait_mutex);
+            __atomic_store_n(&d_waiting, 1, __ATOMIC_SEQ_CST);
+            write = __atomic_load_n(&d_ring_write, __ATOMIC_SEQ_CST);
+
+            if (write == read)
+            {
+                //use timed_wait to avoid permanent blocking in the work function
+                d_cond_wait.timed_wait(lock, boost::posix_time::milliseconds(10));
+                write = __atomic_load_n(&d_ring_write, __ATOMIC_ACQUIRE);
+            }
+
+            __atomic_store_n(&d_waiting, 0, __ATOMIC_RELAXED);
         }
 
-        int bytes_left_in_buffer = (int) (d_residual - d_sent);
-        int bytes_to_send = std::min<int>(d_itemsize * noutput_items, bytes_left_in_buffer);
+        // ring bytes per output item: 16 bit I/Q pairs become pairs of floats when converted
+        std::size_t item_bytes = d_complex_output ? d_itemsize / 2 : d_itemsize;
+        int nitems = std::min<uint64_t>(noutput_items, (write - read) / item_bytes);
 
-        // Copy the received data in the residual buffer to the output stream
-        memcpy(out, d_residbuf + d_sent, bytes_to_send);
-        int nitems = bytes_to_send / d_itemsize;
+        // copy or convert the received data straight from the ring to the output stream
+        ring_read(out, read, nitems * item_bytes);
+        __atomic_store_n(&d_ring_read, read + nitems * item_bytes, __ATOMIC_SEQ_CST);
 
-        // Keep track of where we are if we don't have enough output
-        // space to send all the data in the residbuf.
-        if (bytes_to_send == bytes_left_in_buffer)
-        {
-            d_residual = 0;
-            d_sent = 0;
-        }
-        else
+        if (__atomic_load_n(&d_room_waiting, __ATOMIC_SEQ_CST)) // the decoder is waiting for room in the ring
         {
-            d_sent += bytes_to_send;
+            gr::thread::scoped_lock lock(d_room_mutex);
+            d_room_cond.notify_one();
         }
 
         return nitems;
@@ -24,8 +24,12 @@
 #include <boost/asio.hpp>
 #include <boost/format.hpp>
 #include <gnuradio/thread/thread.h>
+#include <sys/socket.h>
+#include <vector>
 
+#include "PacketRing.h"
 #include "SDRdaemonFECBuffer.h"
+#include "SharedRing.h"
 
 #include <sdrdaemon/sdrdaemonsource.h>
 
@@ -36,35 +40,97 @@ namespace gr {
     {
      private:
         std::size_t d_itemsize;
+        bool d_complex_output; // convert the 16 bit I/Q samples to complex float
         int d_payload_size; // maximum transmission unit (packet length)
         bool d_connected;    // are we connected?
-        char *d_rxbuf;        // get UDP buffer items
-        char *d_residbuf;     // hold buffer between calls
         SDRdaemonFECBuffer d_sdrdmnbuf;
-        ssize_t d_residual; // hold information about number of bytes stored in residbuf
-        ssize_t d_sent;         // track how much of d_residbuf we've outputted
-        std::size_t d_offset;       // point to residbuf location offset
 
-        static const int BUF_SIZE_PAYLOADS; //!< The d_residbuf size in multiples of d_payload_size
+        // single producer (receive thread) single consumer (decode thread) ring of the datagrams received: recvmmsg
+        // writes straight into its slots of d_payload_size so the receive thread only drains the socket
+        char *d_rxbuf;             // BUF_SIZE_PAYLOADS slots
+        std::vector<int> d_rxlen;  // length of the datagram of each slot
+        char *d_dropbuf;           // RX_BATCH slots the datagrams are drained into when the ring is full
+        uint64_t d_rx_write;       // datagrams received since start, set by the receive thread only
+        uint64_t d_rx_read;        // datagrams decoded since start, set by the decode thread only
+        int d_decode_waiting;      // the decode thread waits on d_decode_cond for an empty datagram ring
+        uint64_t d_nb_dropped;     // datagrams dropped with the datagram ring full
+
+        // single producer (decode thread) single consumer (work) ring of decoded sample bytes. Frames are decoded
+        // in place: a frame crossing the end is written on into the overhang then its tail is moved to the start.
+        char *d_ring;              // d_ring_size bytes followed by the overhang of a frame
+        std::size_t d_ring_size;
+        std::size_t d_frame_max;   // largest decoded frame: room needed before a datagram is taken
+        uint64_t d_ring_write;     // bytes written since start, set by the decode thread only
+        uint64_t d_ring_read;      // bytes read since start, set by work only
+        int d_waiting;             // work waits on d_cond_wait for an empty ring
+        int d_room_waiting;        // the decode thread waits on d_room_cond for room in the ring
+        bool d_decode_stop;
+
+        static const int BUF_SIZE_PAYLOADS; //!< The number of datagrams of d_rxbuf
+        static const int RING_SIZE_PAYLOADS; //!< The d_ring size in multiples of d_payload_size: room for decompressed frames
+        static const int RX_BATCH;          //!< Maximum number of datagrams fetched by one recvmmsg
+        std::vector<struct mmsghdr> d_rxmsgs;  // recvmmsg headers, one per d_rxbuf slot
+        std::vector<struct iovec> d_rxiovecs;  // d_rxbuf (or d_dropbuf) slots of d_payload_size
+        std::vector<char> d_rxcontrol;         // control messages with the kernel timestamps, one per d_rxbuf slot
+
+        // latency and jitter of the frames (time stamp of meta data to arrival)
+        uint64_t d_nb_timed_frames;
+        double d_latency;
+        double d_avg_latency;
+        double d_max_latency;
+        double d_jitter;
 
         std::string d_host;
         unsigned short d_port;
 
+        // shared memory ring of a sdrdaemonrx on the same host (host shm:name) read directly by work
+        SharedRing d_shm;
+        bool d_shm_mode;
+        std::string d_shm_name;
+        SharedRing::FrameMeta d_shm_meta;  // of the last frame read
+        uint64_t d_shm_frame;              // frame being read
+        std::size_t d_shm_offset;          // bytes of it already output
+        int d_shm_timeouts;                // waits without a frame since the ring was last checked
+
+        // memory mapped packet ring of the datagrams to the port (host ring:interface) read by the receive thread
+        // in place of recvmmsg. The socket stays bound with a filter dropping everything it would queue.
+        PacketRing d_packet_ring;
+        bool d_ring_mode;
+        std::string d_ring_interface;
+        bool d_rx_stop;                        // stops the packet ring receive thread
+        std::vector<uint8_t *> d_ringpayloads; // payloads of a PacketRing::receive batch
+        std::vector<int> d_ringlengths;
+        std::vector<struct timespec> d_ringstamps;
+
         boost::asio::ip::udp::socket *d_socket;
         boost::asio::ip::udp::endpoint d_endpoint;
         boost::asio::ip::udp::endpoint d_endpoint_rcvd;
         boost::asio::io_service d_io_service;
 
         gr::thread::condition_variable d_cond_wait;
-        gr::thread::mutex d_udp_mutex;
+        gr::thread::mutex d_wait_mutex;
         gr::thread::thread d_udp_thread;
+        gr::thread::condition_variable d_decode_cond;
+        gr::thread::mutex d_decode_mutex;
+        gr::thread::condition_variable d_room_cond;
+        gr::thread::mutex d_room_mutex;
+        gr::thread::thread d_decode_thread;
 
         void start_receive();
         void handle_read(const boost::system::error_code& error, std::size_t bytes_transferred);
         void run_io_service() { d_io_service.run(); }
+        void open_packet_ring();
+        void run_packet_ring();
+        void run_decoder();
+        bool wait_room(uint64_t write);
+        void update_latency(const char *block, int length, const struct msghdr& msg_hdr);
+        void update_latency(const char *block, int length, const struct timespec& arrival);
+        void ring_read(char *out, uint64_t from, std::size_t nbBytes);
+        void copy_out(char *out, const char *in, std::size_t nbBytes);
+        int shm_work(int noutput_items, char *out);
 
      public:
-      sdrdaemonsource_impl(std::size_t itemsize, const std::string &host, int port, int payload_size);
+      sdrdaemonsource_impl(std::size_t itemsize, const std::string &host, int port, int payload_size, int reorder_window, bool complex_output);
       ~sdrdaemonsource_impl();
 
       void connect(const std::string &host, int port);
@@ -79,6 +145,9 @@ namespace gr {
       int get_cur_nb_recovery();
       float get_avg_nb_blocks();
       float get_avg_nb_recovery();
+      float get_latency_ms();
+      float get_max_latency_ms();
+      float get_jitter_ms();
 
       // Where all the action really happens
       int work(int noutput_items,
@@ -25,15 +25,17 @@
 #include "libairspy/airspy.h"
 
 #include "DeviceSource.h"
+#include "ReadySignal.h"
 
 #define AIRSPY_MAX_DEVICE (32)
+#define AIRSPY_STARTTIMEOUT_MS (2000) // longest wait for the stream to start
 
 class AirspySource : public DeviceSource
 {
 public:
 
-    /** Open Airspy device. */
-    AirspySource(int dev_index);
+    /** Open Airspy device by index or, if serial is not empty, directly by its hexadecimal serial number */
+    AirspySource(int dev_index, const std::string& serial = std::string());
 
     /** Close Airspy device. */
     virtual ~AirspySource();
@@ -44,6 +46,10 @@ public:
     /** Return current sample frequency in Hz. */
     virtual std::uint32_t get_sample_rate();
 
+    /** Raw mode: the samples are pairs of real samples at twice the sample rate */
+    virtual bool get_raw_real() { return m_raw; }
+    virtual bool can_normalize() { return !m_raw; } // the raw samples go to the RealDDC
+
     /** Return device current center frequency in Hz. */
     virtual std::uint32_t get_frequency();
 
@@ -67,6 +73,9 @@ private:
     /** Configure Airspy tuner from a list of key=values */
     virtual bool configure(parsekv::pairs_type& m);
 
+    /** Retune from the reader thread for the frequency scan */
+    virtual bool retune(std::uint64_t frequency);
+
     /**
      * Configure Airspy tuner and prepare for streaming.
      *
@@ -93,9 +102,13 @@ private:
                    int mix_agc
     );
 
+    /** Set raw real samples (packed if the firmware can) or I/Q samples of the library, before start only */
+    bool setRaw(bool raw);
+
     void callback(const short* buf, int len);
+    void callbackRaw(const void* buf, int len);
     static int rx_callback(airspy_transfer_t* transfer);
-    static void run(airspy_device* dev, std::atomic_bool *stop_flag);
+    static void run(airspy_device* dev, std::atomic_bool *stop_flag, AirspySource *source);
 
     struct airspy_device* m_dev;
     uint32_t m_sampleRate;
@@ -107,9 +120,11 @@ private:
     bool m_biasAnt;
     bool m_lnaAGC;
     bool m_mixAGC;
+    bool m_raw;
+    bool m_packing;
     bool m_running;
     std::thread *m_thread;
-    static AirspySource *m_this;
+    ReadySignal m_ready;
     static const std::vector<int> m_lgains;
     static const std::vector<int> m_mgains;
     static const std::vector<int> m_vgains;
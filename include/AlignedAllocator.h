@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_ALIGNEDALLOCATOR_H_
+#define INCLUDE_ALIGNEDALLOCATOR_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#define ALIGNEDALLOCATOR_ALIGNMENT 64                    // cache line, also the width of AVX-512 loads
+#define ALIGNEDALLOCATOR_HUGEPAGESIZE (2 * 1024 * 1024)
+#define ALIGNEDALLOCATOR_HUGETHRESHOLD (1024 * 1024)     // allocations of this size and more are made of whole huge pages
+
+/**
+ * Memory of the sample vectors and of the UDP block rings.
+ *
+ * Small allocations are aligned on a cache line. Large ones (Tx ring, retransmission copies, big vectors)
+ * are mapped in whole 2 MB pages aligned on 2 MB: they are backed with reserved huge pages (hugetlbfs,
+ * vm.nr_hugepages) when enabled with setHugePages() and available, else transparent huge pages are
+ * requested. This cuts the TLB misses of the FEC encoder and decoder going through the whole ring.
+ */
+class AlignedMemory
+{
+public:
+    /** Use the reserved huge pages for the large allocations made from now on */
+    static void setHugePages(bool hugePages) { hugePagesFlag().store(hugePages); }
+    static bool hugePages() { return hugePagesFlag().load(); }
+
+    static void *allocate(std::size_t bytes)
+    {
+        void *p;
+
+        if (bytes < ALIGNEDALLOCATOR_HUGETHRESHOLD)
+        {
+            if (posix_memalign(&p, ALIGNEDALLOCATOR_ALIGNMENT, bytes ? bytes : 1) != 0) {
+                throw std::bad_alloc();
+            }
+
+            return p;
+        }
+
+        std::size_t length = hugeLength(bytes);
+
+        if (hugePages())
+        {
+            p = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+            if (p != MAP_FAILED) {
+                return p;
+            }
+
+            if (!hugePagesWarned().exchange(true)) {
+                std::cerr << "AlignedMemory::allocate: no reserved huge pages available (vm.nr_hugepages), using transparent huge pages" << std::endl;
+            }
+        }
+
+        // map one huge page more to cut a region aligned on a huge page
+        uint8_t *m = (uint8_t *) mmap(0, length + ALIGNEDALLOCATOR_HUGEPAGESIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (m == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        uint8_t *aligned = (uint8_t *) (((uintptr_t) m + ALIGNEDALLOCATOR_HUGEPAGESIZE - 1) & ~((uintptr_t) ALIGNEDALLOCATOR_HUGEPAGESIZE - 1));
+
+        if (aligned > m) {
+            munmap(m, aligned - m);
+        }
+
+        munmap(aligned + length, (m + ALIGNEDALLOCATOR_HUGEPAGESIZE) - aligned);
+        madvise(aligned, length, MADV_HUGEPAGE);
+        return aligned;
+    }
+
+    static void deallocate(void *p, std::size_t bytes)
+    {
+        if (bytes < ALIGNEDALLOCATOR_HUGETHRESHOLD) {
+            free(p);
+        } else {
+            munmap(p, hugeLength(bytes));
+        }
+    }
+
+private:
+    static std::size_t hugeLength(std::size_t bytes)
+    {
+        return (bytes + ALIGNEDALLOCATOR_HUGEPAGESIZE - 1) & ~((std::size_t) ALIGNEDALLOCATOR_HUGEPAGESIZE - 1);
+    }
+
+    static std::atomic_bool& hugePagesFlag()
+    {
+        static std::atomic_bool flag(false);
+        return flag;
+    }
+
+    static std::atomic_bool& hugePagesWarned()
+    {
+        static std::atomic_bool warned(false);
+        return warned;
+    }
+};
+
+/** Standard allocator on AlignedMemory */
+template<typename T>
+class AlignedAllocator
+{
+public:
+    typedef T value_type;
+
+    AlignedAllocator() {}
+    template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T *allocate(std::size_t n)
+    {
+        return (T *) AlignedMemory::allocate(n * sizeof(T));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+        AlignedMemory::deallocate((void *) p, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+inline bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return true; }
+
+template<typename T, typename U>
+inline bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return false; }
+
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+#endif /* INCLUDE_ALIGNEDALLOCATOR_H_ */
@@ -39,6 +39,7 @@ public:
 
     /** Return sample size in bits */
     virtual std::uint32_t get_sample_bits() { return 12; }
+    virtual bool can_normalize() { return true; }
 
     /** Return current sample frequency in Hz. */
     virtual std::uint32_t get_sample_rate();
@@ -66,6 +67,9 @@ private:
     /** Configure RTL-SDR tuner from a list of key=value pairs */
     virtual bool configure(parsekv::pairs_type& m);
 
+    /** Retune from the reader thread for the frequency scan */
+    virtual bool retune(std::uint64_t frequency);
+
     /**
      * Configure RTL-SDR tuner and prepare for streaming.
      *
@@ -93,9 +97,20 @@ private:
      * This function must be called regularly to maintain streaming.
      * Return true for success, false if an error occurred.
      */
-    static bool get_samples(IQSampleVector *samples);
+    static bool get_samples(BladeRFSource *source, IQSampleVector *samples);
+
+    static void run(BladeRFSource *source);
+
+    /** Streaming part of the asynchronous mode. Returns when the stream is shut down. */
+    static void runStream(BladeRFSource *source);
 
-    static void run();
+    /** Asynchronous stream callback. USB buffer is moved to the sample buffer and the next free buffer is returned. */
+    static void *streamCallback(struct bladerf *dev,
+            struct bladerf_stream *stream,
+            struct bladerf_metadata *meta,
+            void *samples,
+            size_t num_samples,
+            void *user_data);
 
     struct bladerf *m_dev;
     uint32_t m_sampleRate;
@@ -108,8 +123,14 @@ private:
     int m_vga1Gain;
     int m_vga2Gain;
     std::thread *m_thread;
+    bool m_async;                    //!< use asynchronous stream API instead of synchronous reads
+    unsigned int m_nbBuffers;        //!< number of USB buffers
+    unsigned int m_bufferSize;       //!< USB buffer size in samples (multiple of 1024)
+    unsigned int m_nbTransfers;      //!< number of USB transfers in flight
+    struct bladerf_stream *m_stream; //!< asynchronous stream handle
+    void **m_streamBuffers;          //!< buffers allocated by libbladeRF for the asynchronous stream
+    unsigned int m_streamBufferIndex;
     static const int m_blockSize = 1<<14;
-    static BladeRFSource *m_this;
     static const std::vector<int> m_lnaGains;
     static const std::vector<int> m_vga1Gains;
     static const std::vector<int> m_vga2Gains;
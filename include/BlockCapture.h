@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_BLOCKCAPTURE_H_
+#define INCLUDE_BLOCKCAPTURE_H_
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <time.h>
+
+#define BLOCKCAPTURE_MAGIC     "SDMNCAP1" // first 8 bytes of a capture file
+#define BLOCKCAPTURE_BUFSIZE   (1<<20)    // stdio buffer: the file is written in large chunks
+#define BLOCKCAPTURE_BLOCKMAX  65535      // largest datagram recorded
+
+/**
+ * Append-only record of the UDP blocks (SuperBlocks) received with their arrival time, to replay real
+ * loss and reordering patterns into the FEC decoder (see sdrdaemon_replay).
+ *
+ * The file starts with the 8 bytes magic BLOCKCAPTURE_MAGIC. Each datagram follows as a record of:
+ * - arrival time in nanoseconds since the epoch (int64, little endian as the rest of the protocol)
+ * - length of the datagram in bytes (uint16)
+ * - the datagram as received
+ *
+ * Records are appended to an existing capture so that successive runs go into the same file. Writes are
+ * buffered and made from the receiving thread; no system call is made for most blocks.
+ */
+class BlockCapture
+{
+public:
+    BlockCapture();
+    ~BlockCapture();
+
+    /** Open or create the capture file. Returns false on error (see error()). */
+    bool open(const std::string& filename);
+    void close();
+
+    /** Record a datagram received at the given time (CLOCK_REALTIME) */
+    void write(const uint8_t *block, int length, const timespec& arrival);
+
+    uint64_t getNbBlocks() const { return m_nbBlocks; }
+    operator bool() const { return m_file != 0; }
+    const std::string& error() const { return m_error; }
+
+private:
+    std::FILE *m_file;
+    std::vector<char> m_buffer;
+    uint64_t m_nbBlocks;
+    std::string m_error;
+};
+
+/** Read the records of a BlockCapture file in order */
+class BlockCaptureReader
+{
+public:
+    BlockCaptureReader();
+    ~BlockCaptureReader();
+
+    /** Open a capture file and check its magic. Returns false on error (see error()). */
+    bool open(const std::string& filename);
+    void close();
+
+    /**
+     * Next datagram of the capture with its arrival time in nanoseconds since the epoch.
+     * Returns false at the end of the file or if the last record is truncated (see error()).
+     */
+    bool next(std::vector<uint8_t>& block, int64_t& arrivalNs);
+
+    operator bool() const { return m_file != 0; }
+    const std::string& error() const { return m_error; }
+
+private:
+    std::FILE *m_file;
+    std::vector<char> m_buffer;
+    std::string m_error;
+};
+
+#endif /* INCLUDE_BLOCKCAPTURE_H_ */
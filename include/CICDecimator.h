@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_CICDECIMATOR_H_
+#define INCLUDE_CICDECIMATOR_H_
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "SDRDaemon.h"
+
+#define CICDECIMATOR_ORDER 5      //!< number of integrator and comb stages
+#define CICDECIMATOR_RATIOMAX 512 //!< largest ratio: the 16 + 5 * 9 bits of the registers fit in 64 bits
+#define CICDECIMATOR_TAPS 21      //!< taps of the compensating FIR
+
+/**
+ * Cascaded integrator comb decimator by any integer ratio R, a front-end for the half band cascade.
+ *
+ * The integrators run at the input rate and the combs (differential delay 1) at the output rate so
+ * it costs a few 64 bit adds per input sample whatever the ratio. The registers wrap around which
+ * is exact as long as the output fits in 64 bits. The sinc^5 droop of the pass band is corrected
+ * by a short FIR at the output rate, flat within 0.1 dB up to a quarter of the output rate: the band
+ * kept by a following half band stage. Aliases folding into that band are about 45 dB down (less below
+ * a ratio of 4).
+ * The output is normalized to 16 bits full scale.
+ */
+class CICDecimator
+{
+public:
+    CICDecimator();
+
+    /** 1 (inactive) or 2 to CICDECIMATOR_RATIOMAX. Returns false if out of range. */
+    bool setRatio(unsigned int ratio);
+    unsigned int getRatio() const { return m_ratio; }
+    bool active() const { return m_ratio > 1; }
+
+    /**
+     * Decimate n I/Q samples of sampleSize bits and append the outputs to out. The phase is carried over
+     * between calls so that the blocks need not be multiples of the ratio. sampleSize is updated to the
+     * effective bits of the output (one more per factor of 2 up to 16).
+     */
+    void process(unsigned int& sampleSize, const IQSample *in, std::size_t n, IQSampleVector& out);
+
+    /** Same from interleaved I/Q 32 bit samples (the fine tuning NCO output) */
+    void process(unsigned int& sampleSize, const int32_t *in, std::size_t n, IQSampleVector& out);
+
+private:
+    template <typename T>
+    void decimate(unsigned int& sampleSize, const T *in, std::size_t n, IQSampleVector& out);
+    void design();
+
+    unsigned int m_ratio;
+    unsigned int m_phase;                              //!< input samples integrated since the last output
+    uint64_t     m_integrators[2*CICDECIMATOR_ORDER];  //!< I and Q of each stage
+    uint64_t     m_combs[2*CICDECIMATOR_ORDER];        //!< previous input of each comb
+    double       m_gain;                               //!< 1 / R^5
+    float        m_taps[CICDECIMATOR_TAPS];            //!< compensating FIR
+    float        m_i[2*CICDECIMATOR_TAPS];             //!< FIR history written twice so that it reads in one run
+    float        m_q[2*CICDECIMATOR_TAPS];
+    unsigned int m_index;                              //!< next FIR history position
+};
+
+#endif /* INCLUDE_CICDECIMATOR_H_ */
@@ -21,17 +21,43 @@
 
 #include <stdint.h>
 
+/**
+ * CRC-64 (ECMA-182 polynomial, reflected, no initial value nor final xor)
+ *
+ * Three engines give the same result: the classic byte at a time table lookup, slicing-by-8 (eight
+ * bytes per step with eight tables) and carry-less multiply folding (PCLMULQDQ on x86 selected at
+ * run time, PMULL on ARMv8 with the crypto extension) for 16 bytes per step. The fastest one
+ * available is used by default.
+ */
 class CRC64
 {
 public:
+    typedef enum {
+        CRCTable = 0,
+        CRCSlicing8,
+        CRCCarryless
+    } engine_t;
+
     CRC64();
     ~CRC64();
-    uint64_t calculate_crc(uint8_t *stream, int length);
+    uint64_t calculate_crc(const uint8_t *stream, int length);
+
+    /** Force an engine (benchmarks). The carry-less engine falls back to slicing-by-8 if the CPU lacks it */
+    void setEngine(engine_t engine) { m_engine = ((engine == CRCCarryless) && (bestEngine() != CRCCarryless)) ? CRCSlicing8 : engine; }
+    engine_t getEngine() const { return m_engine; }
+
+    /** Best engine supported by the CPU */
+    static engine_t bestEngine();
 
 private:
     void build_crc_table();
+    uint64_t crcTable(const uint8_t *stream, int length, uint64_t crc) const;
+    uint64_t crcSlicing8(const uint8_t *stream, int length, uint64_t crc) const;
+    uint64_t crcCarryless(const uint8_t *stream, int length, uint64_t crc) const;
 
-    uint64_t m_crcTable[256];
+    uint64_t m_crcTable[8][256]; //!< [0] is the byte at a time table, [k] the CRC of the byte followed by k zero bytes
+    uint64_t m_foldK[4];         //!< x^191, x^127 (16 bytes fold) and x^575, x^511 (64 bytes fold) modulo the polynomial, reflected
+    engine_t m_engine;
     static const uint64_t m_poly;
 };
 
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_CHANNELIZER_H_
+#define INCLUDE_CHANNELIZER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "SDRDaemon.h"
+
+#define CHANNELIZER_NBCHANNELSMAX 1024 //!< largest number of channels (power of two)
+#define CHANNELIZER_TAPS          24   //!< default taps per channel of the prototype filter
+
+/**
+ * Polyphase filter bank splitting the device band into M adjacent channels of rate fs/M in one pass.
+ *
+ * Channel k is centered on k*fs/M (k > M/2 are the negative frequencies, given as k-M). The prototype
+ * low pass of M*taps coefficients is a Kaiser windowed sinc cut at the channel edges: each of the M
+ * polyphase branches filters the input commuted by M then an M point inverse FFT brings every channel
+ * to base band at once. The cost per input sample is 2*taps multiply-adds plus log2(M) FFT butterflies
+ * whatever the number of channels taken, instead of a complete decimation chain per channel.
+ * Channels are critically sampled: about 80% of each channel with 24 taps is free of aliasing from the
+ * neighbours, the edges are not.
+ *
+ * Processing is done in single precision float with the history in separate I and Q arrays so that
+ * the branch filters vectorize. Like the decimators the output is normalized to 16 bits and gains
+ * log2(M) effective bits up to 16 bits.
+ */
+class Channelizer
+{
+public:
+    Channelizer();
+
+    /** nbChannels is a power of two from 2 to CHANNELIZER_NBCHANNELSMAX, taps per channel from 4 to 64 */
+    bool configure(unsigned int nbChannels, unsigned int taps = CHANNELIZER_TAPS);
+
+    unsigned int getNbChannels() const { return m_nbChannels; }
+    bool active() const { return m_nbChannels > 0; }
+
+    /**
+     * Split a block. out[i] receives the samples of channel channels[i] (signed channel number: 0 is the
+     * center, -1 the channel just below). sampleSize is the number of bits of the input samples on input
+     * and the number of effective bits of the output samples normalized to 16 bits on output. The output gets in.size() / M samples depending on the phase
+     * carried over.
+     */
+    void process(unsigned int& sampleSize, const IQSampleVector& in, const std::vector<int>& channels, std::vector<IQSampleVector>& out);
+
+    /** Return the last error, or return an empty string if there is no error. */
+    std::string error()
+    {
+        std::string ret(m_error);
+        m_error.clear();
+        return ret;
+    }
+
+private:
+    void design();
+    void inverseFFT();
+
+    unsigned int m_nbChannels;     //!< M
+    unsigned int m_log2Channels;
+    unsigned int m_taps;           //!< taps per channel
+    unsigned int m_length;         //!< M * taps
+    unsigned int m_pos;            //!< newest sample in the history
+    unsigned int m_phase;          //!< samples entered since the last output (0..M-1)
+    std::vector<float> m_coeffs;   //!< prototype filter
+    std::vector<float> m_i;        //!< history, newest first, written twice m_length apart so that a window is contiguous
+    std::vector<float> m_q;
+    std::vector<float> m_re;       //!< branch outputs then channel samples (FFT in place)
+    std::vector<float> m_im;
+    std::vector<float> m_cos;      //!< FFT twiddles
+    std::vector<float> m_sin;
+    std::vector<unsigned int> m_bitReverse;
+    std::string m_error;
+};
+
+#endif /* INCLUDE_CHANNELIZER_H_ */
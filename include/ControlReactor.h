@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_CONTROLREACTOR_H_
+#define INCLUDE_CONTROLREACTOR_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * Control plane of a device: waits on the nanomsg configuration socket with nn_poll and hands each
+ * message to the handler as soon as it arrives. An optional timer runs the status publishing at a
+ * fixed period from the same thread. Nothing wakes up in between apart from a bounded check of the
+ * stop request so the device threads no longer poll the socket.
+ */
+class ControlReactor
+{
+public:
+    typedef std::function<void(std::string&)> MessageHandler;
+    typedef std::function<void()> TimerHandler;
+
+    /** nnSocket is the (bound) nanomsg socket. It is not closed by the reactor. */
+    ControlReactor(int nnSocket, MessageHandler messageHandler);
+    ~ControlReactor();
+
+    /** Run timerHandler every periodMs milliseconds. Set before start(). */
+    void setTimer(unsigned int periodMs, TimerHandler timerHandler);
+
+    void start();
+    void stop();
+
+    /** Number of messages dispatched */
+    unsigned int getNbMessages() const { return m_nbMessages; }
+
+private:
+    static const int m_maxWaitMs = 500; //!< longest wait without checking the stop request
+
+    void run();
+    void receive();
+
+    int m_socket;
+    MessageHandler m_messageHandler;
+    TimerHandler m_timerHandler;
+    unsigned int m_periodMs;
+    std::atomic_bool m_running;
+    std::atomic<unsigned int> m_nbMessages;
+    std::thread *m_thread;
+};
+
+#endif /* INCLUDE_CONTROLREACTOR_H_ */
@@ -19,9 +19,15 @@
 #ifndef _INCLUDE_DATABUFFER_H_
 #define _INCLUDE_DATABUFFER_H_
 
+#include <atomic>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
+
+#include "VectorPool.h"
+#include "LatencyHistogram.h"
+#include "Tracepoints.h"
 
 
 /** Buffer to move sample data between threads. */
@@ -29,42 +35,104 @@ template <class Element>
 class DataBuffer
 {
 public:
+    /** What to do when pushing in a full buffer */
+    enum DropPolicy
+    {
+        DropNewest, //!< discard the vector being pushed
+        DropOldest  //!< discard the oldest vectors in queue to make room
+    };
+
     /** Constructor. */
     DataBuffer()
         : m_qlen(0)
         , m_end_marked(false)
+        , m_pool(0)
+        , m_capacity(0)
+        , m_dropPolicy(DropOldest)
+        , m_droppedSamples(0)
+        , m_droppedBlocks(0)
+        , m_pushedSamples(0)
+        , m_pulledSamples(0)
+        , m_maxQlen(0)
+        , m_stamping(false)
+        , m_pulledStamp(0)
     { }
 
-    /** Add samples to the queue. */
-    void push(std::vector<Element>&& samples)
+    virtual ~DataBuffer()
+    { }
+
+    /** Limit the number of queued samples. 0 is unlimited. */
+    virtual void set_capacity(std::size_t capacity, DropPolicy dropPolicy)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_capacity = capacity;
+        m_dropPolicy = dropPolicy;
+    }
+
+    /** Add samples to the queue. They are stamped with the current time if stamping is on. */
+    void push(AlignedVector<Element>&& samples)
+    {
+        push(std::move(samples), m_stamping ? LatencyHistogram::now() : 0);
+    }
+
+    /** Add samples to the queue with the time they entered the pipeline (LatencyHistogram::now(), 0: none). */
+    virtual void push(AlignedVector<Element>&& samples, int64_t stamp)
     {
         if (!samples.empty()) {
             std::unique_lock<std::mutex> lock(m_mutex);
+            m_pushedSamples += samples.size();
+
+            if (m_capacity && (m_qlen + samples.size() > m_capacity))
+            {
+                if ((m_dropPolicy == DropNewest) || (samples.size() > m_capacity))
+                {
+                    drop(samples);
+                    return;
+                }
+
+                while (m_qlen + samples.size() > m_capacity)
+                {
+                    m_qlen -= m_queue.front().size();
+                    drop(m_queue.front());
+                    m_queue.pop();
+                    m_stamps.pop();
+                }
+            }
+
             m_qlen += samples.size();
+            SDMN_TRACE2(buffer_push, samples.size(), m_qlen);
             m_queue.push(move(samples));
+            m_stamps.push(stamp);
+
+            if (m_qlen > m_maxQlen) {
+                m_maxQlen = m_qlen;
+            }
+
             lock.unlock();
             m_cond.notify_all();
+            notify_consumer();
         }
     }
 
     /** Mark the end of the data stream. */
-    void push_end()
+    virtual void push_end()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         m_end_marked = true;
         lock.unlock();
         m_cond.notify_all();
+        notify_consumer();
     }
 
     /** Return number of samples in queue. */
-    std::size_t queued_samples()
+    virtual std::size_t queued_samples()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         return m_qlen;
     }
 
     /** Return number of vectors in queue. */
-    std::size_t queued_vectors()
+    virtual std::size_t queued_vectors()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         return m_queue.size();
@@ -76,44 +144,52 @@ public:
      * an empty vector. If the queue is empty, wait until more data is pushed
      * or until the end marker is pushed.
      */
-    std::vector<Element> pull()
+    virtual AlignedVector<Element> pull()
     {
-        std::vector<Element> ret;
+        AlignedVector<Element> ret;
         std::unique_lock<std::mutex> lock(m_mutex);
         while (m_queue.empty() && !m_end_marked)
             m_cond.wait(lock);
         if (!m_queue.empty()) {
             m_qlen -= m_queue.front().size();
+            m_pulledSamples += m_queue.front().size();
             swap(ret, m_queue.front());
             m_queue.pop();
+            m_pulledStamp = m_stamps.front();
+            m_stamps.pop();
+            SDMN_TRACE2(buffer_pull, ret.size(), m_qlen);
         }
         return ret;
     }
 
     /**
-     * Optimized version of std::vector<Element> pull()
+     * Optimized version of AlignedVector<Element> pull()
      */
-    void pull(std::vector<Element>& ret)
+    virtual void pull(AlignedVector<Element>& ret)
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         while (m_queue.empty() && !m_end_marked)
             m_cond.wait(lock);
         if (!m_queue.empty()) {
             m_qlen -= m_queue.front().size();
+            m_pulledSamples += m_queue.front().size();
             swap(ret, m_queue.front());
             m_queue.pop();
+            m_pulledStamp = m_stamps.front();
+            m_stamps.pop();
+            SDMN_TRACE2(buffer_pull, ret.size(), m_qlen);
         }
     }
 
     /** Return true if the end has been reached at the Pull side. */
-    bool pull_end_reached()
+    virtual bool pull_end_reached()
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         return m_qlen == 0 && m_end_marked;
     }
 
     /** Wait until the buffer contains minfill samples or an end marker. */
-    void wait_buffer_fill(std::size_t minfill)
+    virtual void wait_buffer_fill(std::size_t minfill)
     {
         std::unique_lock<std::mutex> lock(m_mutex);
         while (m_qlen < minfill && !m_end_marked)
@@ -121,17 +197,99 @@ public:
     }
 
     /** Test if the buffer has enough samples */
-    bool test_buffer_fill(std::size_t minfill)
+    virtual bool test_buffer_fill(std::size_t minfill)
     {
         return (m_qlen >= minfill) || m_end_marked;
     }
 
-private:
+    /** Number of samples dropped because the buffer was full */
+    std::size_t dropped_samples() const { return m_droppedSamples; }
+
+    /** Number of vectors dropped because the buffer was full */
+    std::size_t dropped_blocks() const { return m_droppedBlocks; }
+
+    /** Number of samples given to push since the start including those dropped */
+    std::size_t pushed_samples() const { return m_pushedSamples; }
+
+    /** Number of samples pulled since the start */
+    std::size_t pulled_samples() const { return m_pulledSamples; }
+
+    /** High-water mark of the number of queued samples */
+    std::size_t max_queued_samples() const { return m_maxQlen; }
+
+    /** Stamp the vectors pushed without a time stamp with the time of the push (to measure latencies) */
+    void set_stamping(bool stamping) { m_stamping = stamping; }
+    bool stamping() const { return m_stamping; }
+
+    /** Consumer side: time stamp of the last vector pulled (0: none) */
+    int64_t pulled_stamp() const { return m_pulledStamp; }
+
+    /** Recycle vectors through this pool (may be shared between buffers). Null to disable. */
+    void set_pool(VectorPool<Element> *pool)
+    {
+        m_pool = pool;
+    }
+
+    /** Get a vector of n elements to be pushed. Recycled from the pool if any. */
+    void get_vector(AlignedVector<Element>& v, std::size_t n)
+    {
+        if (m_pool) {
+            m_pool->get(v, n);
+        } else {
+            v.resize(n);
+        }
+    }
+
+    /** Give back a pulled vector once consumed. */
+    void recycle(AlignedVector<Element>&& v)
+    {
+        if (m_pool) {
+            m_pool->put(std::move(v));
+        }
+    }
+
+    /**
+     * Call this after each push and at the end mark (producer side) for a consumer serving several buffers
+     * that does not sleep in pull. Set before the producer starts. Empty to disable.
+     */
+    void set_notifier(const std::function<void()>& notifier)
+    {
+        m_notifier = notifier;
+    }
+
+protected:
+    void notify_consumer()
+    {
+        if (m_notifier) {
+            m_notifier();
+        }
+    }
+
+    /** Account for a dropped vector and give it back to the pool */
+    void drop(AlignedVector<Element>& v)
+    {
+        m_droppedSamples += v.size();
+        m_droppedBlocks++;
+        recycle(std::move(v));
+    }
+
     std::size_t              m_qlen;
     bool                     m_end_marked;
-    std::queue<std::vector<Element>> m_queue;
+    std::queue<AlignedVector<Element>> m_queue;
     std::mutex               m_mutex;
     std::condition_variable  m_cond;
+    VectorPool<Element>     *m_pool;
+    std::size_t              m_capacity;       //!< maximum number of queued samples (0: unlimited)
+    DropPolicy               m_dropPolicy;
+    std::atomic<std::size_t> m_droppedSamples;
+    std::atomic<std::size_t> m_droppedBlocks;
+    std::atomic<std::size_t> m_pushedSamples;
+    std::atomic<std::size_t> m_pulledSamples;
+    std::atomic<std::size_t> m_maxQlen;        //!< high-water mark of m_qlen
+    bool                     m_stamping;
+    std::queue<int64_t>      m_stamps;         //!< time stamps of the vectors in m_queue
+    int64_t                  m_pulledStamp;    //!< time stamp of the last vector pulled (consumer only)
+    std::function<void()>    m_notifier;       //!< wakes up the consumer of several buffers (producer only)
 };
 
 #endif
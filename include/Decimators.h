@@ -20,14 +20,19 @@
 #define INCLUDE_DECIMATORS_H_
 
 #include "SDRDaemon.h"
+#include "SIMDDispatch.h"
+#include "NCO.h"
 
-#if defined(USE_SSE4_1)
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
 #include "IntHalfbandFilterEO1.h"
+#include "IntHalfbandFilterPL.h"
+#include "IQPlanar.h"
 #else
 #include "IntHalfbandFilterDB.h"
 #endif
 
 #define DECIMATORS_HB_FILTER_ORDER 64
+#define DECIMATORS_BLOCK_SIZE 2048 // input samples processed by each stage at once in the block cascade
 
 class Decimators
 {
@@ -52,8 +57,67 @@ public:
 	void decimate64_sup(unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out);
 	void decimate64_cen(unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out);
 
+	/**
+	 * Block cascade alternative to decimate8..64. Input is taken in chunks of DECIMATORS_BLOCK_SIZE samples
+	 * and each half band stage runs over the whole chunk before the next one so that the intermediate
+	 * samples stay in cache. Same filters and same results as the sample by sample versions. With SIMD the
+	 * samples are kept planar (see IQPlanar.h) from the load of the first stage to the output.
+	 * fcPos is 0: infradyne, 1: supradyne, 2: centered
+	 * With an active nco the samples are frequency shifted as they are loaded for the first half band stage
+	 * and the cascade is centered whatever fcPos. Then log2Decim can also be 1 or 2.
+	 */
+	void decimateBlock(unsigned int log2Decim, int fcPos, unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out, NCO *nco = 0);
+
+	/** Decimation chain as selected by selectChain */
+	typedef void (Decimators::*Chain)(unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out);
+
+	/**
+	 * Select once the decimation chain specialised at compile time for log2Decim (1 to 6), fcPos (0: infradyne,
+	 * 1: supradyne, 2: centered) and an input of sampleSize bits. The half band stages are inlined and unrolled and
+	 * with 8, 10, 12, 14 or 16 bits the normalization shifts are constants. Other sample sizes get a chain with the
+	 * shifts computed at each call. Same results as decimate2..64. Returns 0 if log2Decim is out of range.
+	 */
+	static Chain selectChain(unsigned int log2Decim, int fcPos, unsigned int sampleSize);
+
 private:
-#if defined(USE_SSE4_1)
+	/** Chain behind selectChain. InBits is the input sample size or 0 to take it from sampleSize. */
+	template<unsigned int Log2Decim, int FcPos, unsigned int InBits>
+	void decimateChain(unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out);
+
+	template<unsigned int Log2Decim, int FcPos>
+	static Chain chainByBits(unsigned int sampleSize);
+
+	template<unsigned int Log2Decim>
+	static Chain chainByFcPos(int fcPos, unsigned int sampleSize);
+
+#if !defined(SIMD_X86_DISPATCH) && !defined(USE_NEON)
+	/** Run one half band stage in place over n interleaved I/Q samples of buf. Gives n/2 samples. */
+	template<class HBFilter>
+	static void halfbandStage(HBFilter& hb, int32_t *buf, unsigned int n)
+	{
+		for (unsigned int i = 0; i < n/2; i++)
+		{
+			int32_t x = buf[4*i+2];
+			int32_t y = buf[4*i+3];
+			hb.myDecimate(buf[4*i], buf[4*i+1], &x, &y);
+			buf[2*i]   = x; // never overwrites a sample still to be read
+			buf[2*i+1] = y;
+		}
+	}
+
+	int32_t m_blockBuf[2*DECIMATORS_BLOCK_SIZE]; //!< interleaved I/Q working buffer of block cascade
+#else
+	// the block cascade runs on planar samples with its own stages (maximum input halves at each stage)
+	IQPlanarBlock<DECIMATORS_BLOCK_SIZE> m_planarBlock; //!< planar I/Q working buffer of block cascade
+	IntHalfbandDecimatorPL<DECIMATORS_HB_FILTER_ORDER, DECIMATORS_BLOCK_SIZE>    m_planar2;
+	IntHalfbandDecimatorPL<DECIMATORS_HB_FILTER_ORDER, DECIMATORS_BLOCK_SIZE/2>  m_planar4;
+	IntHalfbandDecimatorPL<DECIMATORS_HB_FILTER_ORDER, DECIMATORS_BLOCK_SIZE/4>  m_planar8;
+	IntHalfbandDecimatorPL<DECIMATORS_HB_FILTER_ORDER, DECIMATORS_BLOCK_SIZE/8>  m_planar16;
+	IntHalfbandDecimatorPL<DECIMATORS_HB_FILTER_ORDER, DECIMATORS_BLOCK_SIZE/16> m_planar32;
+	IntHalfbandDecimatorPL<DECIMATORS_HB_FILTER_ORDER, DECIMATORS_BLOCK_SIZE/32> m_planar64;
+#endif
+
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
 	IntHalfbandFilterEO1<DECIMATORS_HB_FILTER_ORDER> m_decimator2;  // 1st stages
 	IntHalfbandFilterEO1<DECIMATORS_HB_FILTER_ORDER> m_decimator4;  // 2nd stages
 	IntHalfbandFilterEO1<DECIMATORS_HB_FILTER_ORDER> m_decimator8;  // 3rd stages
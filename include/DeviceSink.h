@@ -36,6 +36,8 @@
 
 class Upsampler;
 class UDPSource;
+class JitterBuffer;
+class ControlReactor;
 
 class DeviceSink
 {
@@ -46,13 +48,15 @@ public:
 		m_buf(0),
         m_stop_flag(0),
 		m_upsampler(0),
-		m_udpSource(0)
+		m_udpSource(0),
+		m_jitterBuffer(0),
+		m_controlReactor(0)
     {
         m_nnReceiver = nn_socket(AF_SP, NN_PAIR);
         assert(m_nnReceiver != -1);
     }
 
-    virtual ~DeviceSink() {}
+    virtual ~DeviceSink();
 
     /** Associate with a Downsampler. The Downsampler will be configured
      *  dynamically from the source
@@ -69,6 +73,13 @@ public:
         m_udpSource = udpSource;
     }
 
+    /** Associate with the jitter buffer controlling the queue fill to report underruns and wait for refill
+     */
+    void associateJitterBuffer(JitterBuffer *jitterBuffer)
+    {
+        m_jitterBuffer = jitterBuffer;
+    }
+
     /** set the TCP port used by nanomsg to receive configuration messages */
     void setConfigurationPort(std::uint32_t ctlPort)
     {
@@ -148,7 +159,18 @@ protected:
     std::atomic_bool     *m_stop_flag;
     Upsampler            *m_upsampler;
     UDPSource            *m_udpSource;
+    JitterBuffer         *m_jitterBuffer;
     int                   m_nnReceiver; //!< nanomsg socket handle
+    ControlReactor       *m_controlReactor; //!< dispatches the configuration messages and publishes the status
+
+    /** Start dispatching configuration messages to configure() and sending the status every second (at device start) */
+    void startControl();
+
+    /** Stop the control plane (at device stop) */
+    void stopControl();
+
+    /** Send the status: queued vectors followed by the UDP source and jitter buffer status if any */
+    void sendStatus();
 
 
     /** Configure device and prepare for streaming from parameters map */
@@ -25,15 +25,18 @@
 #include <iostream>
 #include <sstream>
 #include <cassert>
+#include <mutex>
 
 #include "nanomsg/nn.h"
 #include "nanomsg/pair.h"
 
 #include "parsekv.h"
 #include "DataBuffer.h"
+#include "ScanScheduler.h"
 #include "SDRDaemon.h"
 
 class Downsampler;
+class ControlReactor;
 
 class DeviceSource
 {
@@ -42,16 +45,28 @@ public:
 	    m_decim(0),
 	    m_nbFECBlocks(1),
         m_txDelay(0),
+        m_txBatch(0),
+        m_txPace(0),
+        m_fecAuto(0),
+        m_nack(false),
+        m_overload(true),
+        m_frameBlocks(128),
+        m_frameTarget(0),
+        m_interleave(1),
+        m_fecCodec(0),
+        m_normalize(false),
 		m_fcPos(2),
 		m_buf(0),
         m_stop_flag(0),
-		m_downsampler(0)
+		m_downsampler(0),
+		m_outBuf(0),
+		m_controlReactor(0)
     {
         m_nnReceiver = nn_socket(AF_SP, NN_PAIR);
         assert(m_nnReceiver != -1);
     }
 
-    virtual ~DeviceSource() {}
+    virtual ~DeviceSource();
 
     /** Associate with a Downsampler. The Downsampler will be configured
      *  dynamically from the source
@@ -61,6 +76,12 @@ public:
         m_downsampler = downsampler;
     }
 
+    /** Associate with the output buffer so that its state is reported in the status message */
+    void associateOutputBuffer(DataBuffer<IQSample> *outBuf)
+    {
+        m_outBuf = outBuf;
+    }
+
     /** set the TCP port used by 0MQ to receive configuration messages */
     void setConfigurationPort(std::uint32_t ctlPort)
     {
@@ -90,6 +111,34 @@ public:
     /** Return device current center frequency in Hz. */
     virtual std::uint32_t get_frequency() = 0;
 
+    /** True when the samples are pairs of real samples to convert with a RealDDC (Airspy raw mode) */
+    virtual bool get_raw_real()
+    {
+        return false;
+    }
+
+    /** True when the device conversion can give the samples at the 16 bits scale (see set_normalize) */
+    virtual bool can_normalize()
+    {
+        return false;
+    }
+
+    /**
+     * Ask for the samples at the 16 bits scale when the pipeline does not decimate so that the normalization
+     * of Decimators::decimate1 is done in the conversion pass of the device. Any thread, it takes effect from
+     * the next block converted. Ignored by devices that cannot do it.
+     */
+    void set_normalize(bool normalize)
+    {
+        m_normalize.store(normalize && can_normalize(), std::memory_order_relaxed);
+    }
+
+    /** True when the blocks are given at the 16 bits scale */
+    bool get_normalize() const
+    {
+        return m_normalize.load(std::memory_order_relaxed);
+    }
+
     /** Return current received center frequency in Hz.
      *  Actual device frequency depends on center frequency relative position
      *  configured in the downsampler */
@@ -108,6 +157,64 @@ public:
         return m_txDelay;
     }
 
+    unsigned int get_tx_batch() const
+    {
+        return m_txBatch;
+    }
+
+    unsigned int get_tx_pace() const
+    {
+        return m_txPace;
+    }
+
+    unsigned int get_fec_auto() const
+    {
+        return m_fecAuto;
+    }
+
+    bool get_nack() const
+    {
+        return m_nack;
+    }
+
+    bool get_overload() const
+    {
+        return m_overload;
+    }
+
+    unsigned int get_frame_blocks() const
+    {
+        return m_frameBlocks;
+    }
+
+    unsigned int get_frame_target() const
+    {
+        return m_frameTarget;
+    }
+
+    unsigned int get_interleave() const
+    {
+        return m_interleave;
+    }
+
+    /** Codec of the FEC blocks (FECCodec.h) */
+    int get_fec_codec() const
+    {
+        return m_fecCodec;
+    }
+
+    /** True while a frequency scan runs (the received frequency then follows the retunes) */
+    bool scanning() const
+    {
+        return m_scan.active();
+    }
+
+    /** Next retune of the scan taking effect before device sample index endIndex (see ScanScheduler) */
+    bool get_retune(std::uint64_t endIndex, ScanScheduler::Retune& retune)
+    {
+        return m_scan.getRetune(endIndex, retune);
+    }
+
     /** Print current parameters specific to device type */
     virtual void print_specific_parms() = 0;
 
@@ -142,11 +249,64 @@ protected:
     unsigned int          m_decim;
     unsigned int          m_nbFECBlocks;
     unsigned int          m_txDelay;
+    unsigned int          m_txBatch;
+    unsigned int          m_txPace;
+    unsigned int          m_fecAuto;
+    bool                  m_nack;
+    bool                  m_overload;
+    unsigned int          m_frameBlocks;
+    unsigned int          m_frameTarget;
+    unsigned int          m_interleave;
+    int                   m_fecCodec;
+    std::atomic_bool      m_normalize;  //!< blocks converted to the 16 bits scale (see set_normalize)
     int                   m_fcPos;
     DataBuffer<IQSample> *m_buf;
     std::atomic_bool     *m_stop_flag;
     Downsampler          *m_downsampler;
+    DataBuffer<IQSample> *m_outBuf;     //!< output buffer only used for status
     int                   m_nnReceiver; //!< nanomsg socket handle
+    ControlReactor       *m_controlReactor; //!< dispatches the configuration messages as they arrive
+    ScanScheduler         m_scan;       //!< frequency hops run from the reader thread
+    std::mutex            m_configMutex; //!< serializes configuration messages and scan retunes
+
+    /** Start dispatching configuration messages to configure() (at device start) */
+    void startControl();
+
+    /** Stop dispatching configuration messages (at device stop) */
+    void stopControl();
+
+    /**
+     * Run the scan from the reader thread: call after each block of nbSamples samples pushed. Retunes the
+     * device when the dwell time of the current hop is over.
+     */
+    void scan(std::size_t nbSamples);
+
+    /**
+     * Tune to the received center frequency in Hz without any other change and without logging, from the
+     * reader thread. The center frequency position is applied like the freq key does.
+     * Returns false if it fails or is not supported by the device (the default).
+     */
+    virtual bool retune(std::uint64_t frequency __attribute__((unused)))
+    {
+        m_error = "Retune not supported by the device";
+        return false;
+    }
+
+    /** Tuner frequency for a received center frequency depending on the center frequency position */
+    double get_tuner_frequency(std::uint64_t frequency, std::uint32_t sampleRate) const
+    {
+        if (m_fcPos == 0) { // Infradyne
+            return frequency + 0.25 * sampleRate;
+        } else if (m_fcPos == 1) { // Supradyne
+            return frequency - 0.25 * sampleRate;
+        } else { // Centered
+            return frequency;
+        }
+    }
+
+    /** Send buffers status on the configuration socket:
+     *  source queued samples:dropped blocks:dropped samples:output queued samples:dropped blocks:dropped samples */
+    void sendStatus();
 
 
     /** Configure device and prepare for streaming from parameters map */
@@ -19,7 +19,10 @@
 #ifndef INCLUDE_DOWNSAMPLER_H_
 #define INCLUDE_DOWNSAMPLER_H_
 
+#include "CICDecimator.h"
 #include "Decimators.h"
+#include "NCO.h"
+#include "RationalResampler.h"
 #include "SDRDaemon.h"
 #include "parsekv.h"
 
@@ -51,6 +54,24 @@ public:
 	/** Return log2 of decimation */
 	unsigned int getLog2Decimation() const { return m_decim; }
 
+	/** True if the CIC front-end decimates ahead of the half band cascade */
+	bool isCIC() const { return m_cic.active(); }
+
+	/** Whole decimation factor of the CIC front-end and the half band cascade (not the rational stage) */
+	unsigned int getDecimation() const { return m_cic.getRatio() << m_decim; }
+
+	/** Give the device sample rate so that the rational stage can resample to srate_out. Returns false on error. */
+	bool setSampleRate(uint32_t sampleRate);
+
+	/** Offset in Hz from the device frequency brought to DC by the NCO (the center of the output) */
+	int64_t getShift() const { return m_shift; }
+
+	/** True if the rational stage resamples after the decimators */
+	bool isResampling() const { return m_resampler.active(); }
+
+	/** Sample rate at the output given the device sample rate set with setSampleRate */
+	uint32_t getOutputRate() const { return isResampling() ? m_resampler.getOutputRate() : (m_sampleRate / m_cic.getRatio()) >> m_decim; }
+
     /**
      * Process samples.
      */
@@ -78,8 +99,22 @@ public:
 private:
     unsigned int m_decim;
     fcPos_t      m_fcPos;
+    bool         m_blockDecim; //!< use block cascade for decimation by 8 and more
     Decimators   m_decimators;
+    uint32_t     m_sampleRate; //!< device sample rate
+    uint32_t     m_srateOut;   //!< output rate of the rational stage (0: none)
+    int64_t      m_shift;      //!< configured frequency shift
+    Decimators::Chain m_chain; //!< decimation chain for m_decim, m_fcPos and m_chainBits (0: to select)
+    unsigned int m_chainBits;  //!< input sample size m_chain is specialised for
+    NCO          m_nco;        //!< fine tuning fused with the first half band stage
+    RationalResampler m_resampler;
+    IQSampleVector    m_resampled;
+    CICDecimator m_cic;        //!< front-end by an integer ratio ahead of the half band cascade
+    IQSampleVector m_cicOut;   //!< CIC output not yet taken by the half band cascade (less than its decimation)
+    int32_t      m_mixBuf[2*DECIMATORS_BLOCK_SIZE]; //!< NCO output feeding the CIC
     std::string  m_error;
+
+    void processCIC(unsigned int& sampleSize, const IQSampleVector& samples_in, IQSampleVector& samples_out);
 };
 
 #endif /* INCLUDE_DOWNSAMPLER_H_ */
@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_FECCODEC_H_
+#define INCLUDE_FECCODEC_H_
+
+#include <string>
+
+#include "cm256.h"
+
+#define FECCODEC_CM256    0 //!< Cauchy Reed-Solomon (CM256): any lost blocks up to the FEC blocks of the frame
+#define FECCODEC_XOR      1 //!< interleaved parity: at most one lost block of each class of original blocks
+#define FECCODEC_LDPC     2 //!< LDPC staircase: large frames, a few more blocks than the original blocks restore it
+#define FECCODEC_NBCODECS 3
+#define FECCODEC_NBBLOCKSMAX 1536 //!< largest number of blocks (original and FEC) of a frame of any codec
+
+/** Block of a frame as the CM256 descriptor with an index wide enough for the blocks of large frames */
+struct FECBlock
+{
+    void *Block;
+    int   Index;
+};
+
+/**
+ * Erasure code of the FEC blocks of a frame. The codec of each frame is given by its meta data so the
+ * receivers follow the sender. Whatever the codec the blocks are described with the CM256 parameters
+ * and FECBlock descriptors: OriginalCount original blocks of BlockBytes bytes followed by RecoveryCount
+ * FEC blocks, the FEC block j having the index OriginalCount + j in the frame.
+ *
+ * The codec objects are shared by the process and only read once built so the encode and decode
+ * calls may come from any thread.
+ */
+class FECCodec
+{
+public:
+    virtual ~FECCodec() {}
+
+    /** Name as given in the configuration */
+    virtual const char *getName() const = 0;
+
+    /** The codec tables could be built */
+    virtual bool isInitialized() const = 0;
+
+    /**
+     * Any OriginalCount blocks of the frame restore it (maximum distance separable code). Otherwise
+     * a frame may need more blocks than this so the decoder keeps collecting them.
+     */
+    virtual bool isMDS() const = 0;
+
+    /** Largest number of blocks of a frame, original and FEC blocks (256 for CM256) */
+    virtual int getMaxNbBlocks() const = 0;
+
+    /**
+     * Compute the params.RecoveryCount FEC blocks of the original blocks (descriptors in block index
+     * order) into recoveryBlocks one after the other. Return 0 on success as cm256_encode.
+     */
+    virtual int encode(CM256::cm256_encoder_params params, FECBlock *originals, void *recoveryBlocks) = 0;
+
+    /**
+     * Restore the lost original blocks of a frame from the nbBlocks blocks received: the original
+     * blocks first then the FEC blocks. params.RecoveryCount is the number of FEC blocks the frame was
+     * sent with. On success each FEC block used is overwritten with a restored original block and its
+     * descriptor takes the index of it. The descriptors of the FEC blocks not used keep their index
+     * (OriginalCount or more). Return 0 on success. On failure the blocks are not modified so the
+     * decoding may be tried again with more blocks.
+     */
+    virtual int decode(CM256::cm256_encoder_params params, FECBlock *blocks, int nbBlocks) = 0;
+
+    /** The codec of this identifier (meta data) or 0 if unknown */
+    static FECCodec *get(int codecId);
+
+    /** Identifier of the codec of this name or -1 if unknown */
+    static int find(const std::string& name);
+};
+
+#endif /* INCLUDE_FECCODEC_H_ */
@@ -0,0 +1,68 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_FECCONTROLLER_H_
+#define INCLUDE_FECCONTROLLER_H_
+
+#include "FECFeedback.h"
+
+/**
+ * Adapts the number of FEC blocks and the pacing of a UDPSinkFEC to the losses reported by
+ * the receiver so that no data is lost with the least redundancy.
+ *
+ * The number of FEC blocks follows the largest loss in a frame plus a margin. It is raised as
+ * soon as a report asks for more and lowered by small steps only after a series of reports with
+ * margin to spare. Losses are measured independently of the FEC setting so reports still
+ * describing frames sent before a change do not make it climb twice. When data is lost with the
+ * maximum number of FEC blocks already in use the losses are likely due to bursts so the blocks
+ * are spread more over the frame duration (pacing). Pacing goes back to the user setting once the
+ * link is clean again.
+ */
+class FECController
+{
+public:
+    FECController();
+
+    /** Maximum number of FEC blocks (up to 512 for large frames). 0 disables the controller. */
+    void setMaxNbBlocksFEC(int maxNbBlocksFEC);
+    int getMaxNbBlocksFEC() const { return m_maxNbBlocksFEC; }
+
+    /** Pacing percentage set by the user. The controller does not go below it. */
+    void setMinTxPace(int txPace) { m_minTxPace = txPace; }
+
+    /**
+     * Process a receiver report. nbBlocksFEC and txPace are the current settings and are
+     * updated in place. Returns true if any of them changed.
+     */
+    bool update(const FECFeedback& feedback, int& nbBlocksFEC, int& txPace);
+
+private:
+    static const int m_minMargin = 2;       //!< FEC blocks kept on top of the largest loss
+    static const int m_lowerReports = 10;   //!< reports with margin to spare before lowering FEC
+    static const int m_paceStart = 50;      //!< pacing in % when the controller enables it
+    static const int m_paceStep = 25;       //!< pacing increase in % on losses at maximum FEC
+    static const int m_paceHoldReports = 2; //!< reports to wait for a pacing change to take effect
+
+    int m_maxNbBlocksFEC;
+    int m_minTxPace;
+    int m_goodReports; //!< consecutive reports without loss since the last decrease
+    int m_paceHold;    //!< reports left before pacing may change again
+};
+
+#endif /* INCLUDE_FECCONTROLLER_H_ */
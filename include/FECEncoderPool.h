@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_FECENCODERPOOL_H_
+#define INCLUDE_FECENCODERPOOL_H_
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+class UDPSinkFEC;
+
+namespace std
+{
+    class thread;
+}
+
+/**
+ * FEC encoding threads shared by several pipelined UDP sinks (multi-device receiver) in place of
+ * their own encoders. The sinks queue their frames as they are completed and the first thread free
+ * encodes the frame with its own scratch buffers. Each sink still sends its frames in order from its
+ * own sending thread once they are encoded.
+ */
+class FECEncoderPool
+{
+public:
+    /** Start nbThreads encoding threads (1 to UDPSINKFEC_NBENCODERSMAX) */
+    FECEncoderPool(unsigned int nbThreads);
+    ~FECEncoderPool();
+
+    unsigned int getNbThreads() const { return m_threads.size(); }
+
+    /** Queue a completed frame of the sink (row of its Tx ring) for encoding */
+    void submit(UDPSinkFEC *sink, int txIndex);
+
+    /** Remove the frames of the sink still queued and wait for those being encoded. Called before the sink goes away. */
+    void cancel(UDPSinkFEC *sink);
+
+private:
+    struct Job
+    {
+        UDPSinkFEC *m_sink;
+        int m_txIndex;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobCond;   //!< Signals a new job or the stop
+    std::condition_variable m_doneCond;  //!< Signals the end of a job (cancel)
+    std::deque<Job> m_jobs;
+    std::vector<UDPSinkFEC*> m_busy;     //!< Sink of the frame being encoded by each thread (0: idle)
+    std::vector<std::thread*> m_threads;
+    bool m_running;
+
+    static void run(FECEncoderPool *pool, unsigned int index);
+};
+
+#endif /* INCLUDE_FECENCODERPOOL_H_ */
@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_FECFEEDBACK_H_
+#define INCLUDE_FECFEEDBACK_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define FECFEEDBACK_MAGIC 0x42464453 // "SDFB" in little endian
+#define FECNACK_MAGIC 0x4b4e4453     // "SDNK" in little endian
+
+#pragma pack(push, 1)
+/**
+ * Loss report sent back by the FEC receiver (sdrdaemontx) to the address and port the UDP blocks
+ * come from, about once per second. The sender uses it to adapt the number of FEC blocks.
+ * Counts are over the frames received since the previous report.
+ */
+struct FECFeedback
+{
+    uint32_t m_magic;         //!<  4 FECFEEDBACK_MAGIC
+    uint16_t m_nbFrames;      //!<  6 number of frames received
+    uint16_t m_nbLostFrames;  //!<  8 number of frames with less than the 128 blocks needed to restore them
+    uint16_t m_maxLostBlocks; //!< 10 largest number of blocks (original or FEC) lost in one frame
+    uint16_t m_nbFECBlocks;   //!< 12 smallest number of FEC blocks in the frames received
+
+    void init()
+    {
+        memset((void *) this, 0, sizeof(FECFeedback));
+        m_magic = FECFEEDBACK_MAGIC;
+    }
+};
+
+/**
+ * Retransmission request sent back by the FEC receiver (sdrdaemontx) to the address and port the UDP
+ * blocks come from for a frame it cannot restore yet. The sender resends blocks of the frame it did not
+ * receive, as many as are needed to reach the 128 blocks used to restore it.
+ */
+struct FECNack
+{
+    uint32_t m_magic;         //!<  4 FECNACK_MAGIC
+    uint16_t m_frameIndex;    //!<  6 frame index of the frame
+    uint16_t m_nbBlocks;      //!<  8 number of blocks (original or FEC) received
+    uint64_t m_received[4];   //!< 40 bit map of the blocks received: block i is bit i%64 of m_received[i/64]
+
+    void init(uint16_t frameIndex)
+    {
+        memset((void *) this, 0, sizeof(FECNack));
+        m_magic = FECNACK_MAGIC;
+        m_frameIndex = frameIndex;
+    }
+
+    bool received(int blockIndex) const { return (m_received[blockIndex >> 6] >> (blockIndex & 63)) & 1; }
+};
+#pragma pack(pop)
+
+#endif /* INCLUDE_FECFEEDBACK_H_ */
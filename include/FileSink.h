@@ -23,10 +23,15 @@
 #include <cstdint>
 #include <string>
 #include <vector>
-#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 #include "DeviceSink.h"
+#include "ReadySignal.h"
+
+#define FILESINK_BUFSIZE (4*1024*1024) //!< bytes gathered before a write to the file
+#define FILESINK_ALIGN   4096          //!< buffer and O_DIRECT write alignment
 
 class FileSink : public DeviceSink
 {
@@ -58,7 +63,7 @@ public:
     /** Return true if the device is OK, return false if there is an error. */
     virtual operator bool() const
     {
-        return true;
+        return m_error.empty();
     }
 
     /** Return a list of supported devices. */
@@ -85,15 +90,28 @@ private:
     );
 
     void closeAndOpen();
+    void closeFile();
+    /** Write the whole aligned part of the buffer and keep the remainder at its start. With final write all. */
+    bool flush(bool final);
     static void run(std::atomic_bool *stop_flag);
+    /** Drain the sample queue into the buffer as fast as the file can take it */
+    void write();
 
     uint32_t m_sampleRate;
     uint64_t m_frequency;
     std::string m_filename;
-    std::ofstream m_ofstream;
-    uint32_t m_delayUS;
+    int m_fd;
+    bool m_direct;           //!< open the file with O_DIRECT
+    bool m_isDirect;         //!< the file is actually open with O_DIRECT
+    uint32_t m_preallocMB;   //!< space reserved at open in MB (0: none)
+    char *m_fileBuf;         //!< FILESINK_ALIGN aligned write buffer
+    std::size_t m_fileBufFill;
+    uint64_t m_bytesWritten;
+    std::mutex m_fileMutex;  //!< file and buffer between the writer thread and reconfiguration
     bool m_running;
     std::thread *m_thread;
+    std::thread *m_writeThread;
+    ReadySignal m_ready;
     static FileSink *m_this;
     std::string m_vgainsStr;
     std::string m_bwfiltStr;
@@ -0,0 +1,100 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef SDRDAEMON_FILESOURCE_H
+#define SDRDAEMON_FILESOURCE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "DeviceSource.h"
+
+/**
+ * Replay of a .sdriq recording (as written by the Tx file sink) through the normal Rx chain.
+ *
+ * The file is memory mapped and read sequentially: each block is a single copy from the mapping
+ * into a vector recycled through the sample pool. Sample rate and center frequency come from the
+ * file header. Blocks are paced at the recorded sample rate or pushed as fast as the main loop
+ * takes them (the source queue is kept short rather than letting it drop samples).
+ */
+class FileSource : public DeviceSource
+{
+public:
+
+    static const int default_block_length = 65536;
+    static const int header_size = sizeof(int) + sizeof(uint64_t) + sizeof(int64_t); //!< rate, frequency, time stamp
+
+    /** Open file device. The file itself is mapped at configuration */
+    FileSource(int dev_index);
+
+    /** Unmap the file. */
+    virtual ~FileSource();
+
+    /** Return sample size in bits */
+    virtual std::uint32_t get_sample_bits() { return 16; }
+
+    /** Return current sample frequency in Hz. */
+    virtual std::uint32_t get_sample_rate();
+
+    /** Return device current center frequency in Hz. */
+    virtual std::uint32_t get_frequency();
+
+    /** Print current parameters specific to device type */
+    virtual void print_specific_parms();
+
+    virtual bool start(DataBuffer<IQSample>* samples, std::atomic_bool *stop_flag);
+    virtual bool stop();
+
+    /** Return true if the device is OK, return false if there is an error. */
+    virtual operator bool() const
+    {
+        return m_error.empty();
+    }
+
+    /** Return a list of supported devices. */
+    static void get_device_names(std::vector<std::string>& devices);
+
+private:
+
+    /** Configure file replay from a list of key=values */
+    virtual bool configure(parsekv::pairs_type& m);
+
+    /** Map the file and read its header. Return true for success. */
+    bool openFile(const std::string& filename);
+    void closeFile();
+
+    static void run(FileSource *source);
+
+    int               m_block_length; //!< number of samples
+    std::thread       *m_thread;
+    std::string       m_filename;
+    bool              m_realTime;     //!< pace at the recorded sample rate
+    bool              m_loop;         //!< restart at end of file
+    int               m_fd;
+    const uint8_t     *m_map;
+    std::size_t       m_mapSize;
+    std::size_t       m_nbSamples;    //!< samples in the file after the header
+    std::size_t       m_readIndex;    //!< next sample to replay
+    uint64_t          m_freq;
+    uint32_t          m_srate;
+};
+
+#endif // SDRDAEMON_FILESOURCE_H
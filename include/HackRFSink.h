@@ -23,9 +23,16 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <atomic>
+#include <thread>
 #include "libhackrf/hackrf.h"
 
 #include "DeviceSink.h"
+#include "ReadySignal.h"
+
+#define HACKRFSINK_TRANSFERSIZE 262144 //!< bytes in a libhackrf transfer buffer
+#define HACKRFSINK_RINGSIZE     4      //!< pre-converted transfers between the feed thread and the USB callback (power of two)
+#define HACKRFSINK_STARTTIMEOUT_MS 2000 //!< longest wait for the stream to start
 
 class HackRFSink : public DeviceSink
 {
@@ -33,8 +40,8 @@ public:
 
     //static const int default_block_length = 65536;
 
-    /** Open HackRF device. */
-    HackRFSink(int dev_index);
+    /** Open HackRF device by index or, if serial is not empty, directly by its serial number */
+    HackRFSink(int dev_index, const std::string& serial = std::string());
 
     /** Close HackRF device. */
     virtual ~HackRFSink();
@@ -91,6 +98,10 @@ private:
     void callback(char* buf, int len);
     static int tx_callback(hackrf_transfer* transfer);
     static void run(hackrf_device* dev, std::atomic_bool *stop_flag);
+    /** Pull upsampled samples and convert them to int8 transfer buffers ahead of the USB callback */
+    void feed();
+    /** Number of samples converted and not yet sent (USB callback side) */
+    std::size_t ring_queued_samples();
 
     struct hackrf_device* m_dev;
     uint32_t m_sampleRate;
@@ -103,6 +114,8 @@ private:
     float m_amplitude; //!< idle carrier amplitude
     bool m_running;
     std::thread *m_thread;
+    std::thread *m_feedThread;
+    ReadySignal m_ready;
     static HackRFSink *m_this;
     static const std::vector<int> m_vgains;
     static const std::vector<int> m_bwfilt;
@@ -110,6 +123,10 @@ private:
     std::string m_bwfiltStr;
     IQSampleVector m_iqSamples;
     uint32_t m_iqSamplesIndex;
+    std::vector<int8_t> m_ring[HACKRFSINK_RINGSIZE]; //!< transfer sized int8 buffers
+    std::atomic<uint32_t> m_ringHead;                //!< next slot read by the USB callback
+    std::atomic<uint32_t> m_ringTail;                //!< next slot written by the feed thread
+    uint32_t m_ringOffset;                           //!< bytes already sent from the head slot (USB callback only)
 };
 
 #endif /* INCLUDE_HACKRFDEVICESINK_H_ */
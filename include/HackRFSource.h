@@ -25,6 +25,10 @@
 #include "libhackrf/hackrf.h"
 
 #include "DeviceSource.h"
+#include "IQCorrector.h"
+#include "ReadySignal.h"
+
+#define HACKRF_STARTTIMEOUT_MS (2000) // longest wait for the stream to start
 
 class HackRFSource : public DeviceSource
 {
@@ -32,14 +36,15 @@ public:
 
     //static const int default_block_length = 65536;
 
-    /** Open HackRF device. */
-    HackRFSource(int dev_index);
+    /** Open HackRF device by index or, if serial is not empty, directly by its serial number */
+    HackRFSource(int dev_index, const std::string& serial = std::string());
 
     /** Close HackRF device. */
     virtual ~HackRFSource();
 
     /** Return sample size in bits */
-    virtual std::uint32_t get_sample_bits() { return 8; }
+    virtual std::uint32_t get_sample_bits() { return m_iqCorrector.getSampleBits(8); }
+    virtual bool can_normalize() { return true; }
 
     /** Return current sample frequency in Hz. */
     virtual std::uint32_t get_sample_rate();
@@ -66,6 +71,9 @@ private:
     /** Configure HackRF tuner from a list of key=value pairs */
     virtual bool configure(parsekv::pairs_type& m);
 
+    /** Retune from the reader thread for the frequency scan */
+    virtual bool retune(std::uint64_t frequency);
+
     /**
      * Configure HackRF tuner and prepare for streaming.
      *
@@ -91,7 +99,7 @@ private:
 
     void callback(const signed char* buf, int len);
     static int rx_callback(hackrf_transfer* transfer);
-    static void run(hackrf_device* dev, std::atomic_bool *stop_flag);
+    static void run(hackrf_device* dev, std::atomic_bool *stop_flag, HackRFSource *source);
 
     struct hackrf_device* m_dev;
     uint32_t m_sampleRate;
@@ -104,7 +112,8 @@ private:
     bool m_biasAnt;
     bool m_running;
     std::thread *m_thread;
-    static HackRFSource *m_this;
+    ReadySignal m_ready;
+    IQCorrector m_iqCorrector; //!< DC and IQ imbalance correction in the sample conversion
     static const std::vector<int> m_lgains;
     static const std::vector<int> m_vgains;
     static const std::vector<int> m_bwfilt;
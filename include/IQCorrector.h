@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_IQCORRECTOR_H_
+#define INCLUDE_IQCORRECTOR_H_
+
+#include <stdint.h>
+#include <atomic>
+
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+
+#define IQCORRECTOR_EXTRA_BITS 4       //!< fraction bits added to the 8 bit samples when correcting
+#define IQCORRECTOR_TAU        1048576 //!< time constant of the running means in samples
+#define IQCORRECTOR_CHUNK      256     //!< samples summed in single precision before the double totals
+
+/**
+ * DC offset removal and IQ imbalance correction of 8 bit devices done while the bytes are widened to IQSample.
+ *
+ * In the same pass each sample is converted, corrected with the estimates of the previous blocks and summed in
+ * the running mean estimators of I, Q, I^2, Q^2 and IQ. Sums use exact single precision arithmetic on the
+ * integer samples four lanes at a time (SSE2 or NEON) and are flushed into double totals every chunk.
+ * The image is suppressed by making Q orthogonal to I with the same power:
+ *   Q' = (Q - a*I) / b with a = E[IQ]/E[I^2] and b = sqrt(E[Q^2]/E[I^2] - a^2) on the DC free samples.
+ * The corrected samples get IQCORRECTOR_EXTRA_BITS more bits so that the residual DC is well below 1 LSB.
+ */
+class IQCorrector
+{
+public:
+    typedef enum {
+        CorrectionOff = 0,
+        CorrectionDC,    //!< DC offset only
+        CorrectionDCIQ   //!< DC offset and IQ imbalance
+    } mode_t;
+
+    IQCorrector();
+
+    /** Set the correction mode (any thread). The estimates start again when the mode changes. */
+    void setMode(mode_t mode) { m_mode.store(mode); }
+
+    mode_t getMode() const { return (mode_t) m_mode.load(); }
+
+    /** Bits of the samples given by the conversions for devices of sampleBits */
+    unsigned int getSampleBits(unsigned int sampleBits) const
+    {
+        return getMode() == CorrectionOff ? sampleBits : sampleBits + IQCORRECTOR_EXTRA_BITS;
+    }
+
+    /**
+     * Unsigned 8 bit with 128 offset (RTL-SDR). len is the number of bytes (2 per sample).
+     * With normalize the samples are given at the 16 bits scale whatever the mode.
+     */
+    void u8ToIQ(const uint8_t *buf, IQSample *out, unsigned int len, bool normalize = false);
+
+    /** Signed 8 bit (HackRF). len is the number of bytes (2 per sample). See u8ToIQ for normalize. */
+    void s8ToIQ(const int8_t *buf, IQSample *out, unsigned int len, bool normalize = false);
+
+private:
+    template<bool Offset>
+    void convert(const int8_t *in, IQSample *out, unsigned int len, unsigned int shift);
+    void start(mode_t mode);
+    void update(const double *sums, unsigned int n);
+
+    std::atomic<int> m_mode;
+    mode_t m_appliedMode; //!< mode of the estimates (reader thread)
+    bool   m_primed;      //!< first block taken as is
+    double m_mI, m_mQ, m_mII, m_mQQ, m_mIQ; //!< running means of the raw samples
+    float  m_dcI, m_dcQ;  //!< DC offset subtracted
+    float  m_c1, m_c2;    //!< Q' = c1*Q + c2*I after DC removal
+};
+
+#endif /* INCLUDE_IQCORRECTOR_H_ */
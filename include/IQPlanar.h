@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_IQPLANAR_H_
+#define INCLUDE_IQPLANAR_H_
+
+#include <stdint.h>
+
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+
+/**
+ * Planar I/Q samples used inside the block cascades: the I and the Q components are each kept in their own
+ * int32 array so that the vector kernels work on whole registers of one component and never shuffle I/Q
+ * pairs. Samples are interleaved only at the boundaries: as they come from the device buffer and as they
+ * go to UDPSinkFEC or to the device sink.
+ */
+class IQPlanar
+{
+public:
+	/** Split n interleaved 16 bit samples into the i and q arrays */
+	static void deinterleave(const IQSample *in, int32_t *i, int32_t *q, unsigned int n);
+
+	/**
+	 * Interleave n samples of the i and q arrays into 16 bit samples. Each component is shifted left by
+	 * normShift then right by trunkShift and truncated to 16 bits like setReal and setImag do.
+	 */
+	static void interleave(const int32_t *i, const int32_t *q, IQSample *out, unsigned int n,
+			unsigned int normShift = 0, unsigned int trunkShift = 0);
+};
+
+/**
+ * Planar I/Q block of up to Size samples with room for History samples before them. The room lets a
+ * filter put its history in front of the block so that its kernel reads one linear array.
+ */
+template<unsigned int Size, unsigned int History = 0>
+struct IQPlanarBlock
+{
+	int32_t *i() { return &m_i[History]; }
+	int32_t *q() { return &m_q[History]; }
+
+	int32_t m_i[History + Size];
+	int32_t m_q[History + Size];
+};
+
+#endif /* INCLUDE_IQPLANAR_H_ */
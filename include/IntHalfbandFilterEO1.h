@@ -64,6 +64,32 @@ public:
         doInterpolateFIR(x2, y2);
     }
 
+    /**
+     * Same as n calls of myInterpolate on the n interleaved I/Q samples of in giving 2n samples in out.
+     * The filter history is copied in front of the samples: in must have room for hbOrder/2 - 1 samples before it.
+     */
+    void myInterpolateBlock(int32_t *in, int32_t *out, unsigned int n)
+    {
+        const int N = HBFIRFilterTraits<HBFilterOrder>::hbOrder/2; // ring length
+        int32_t *lin = in - 2*(N-1);
+
+        for (int j = 1; j < N; j++) // last N-1 samples in time order
+        {
+            lin[2*(j-1)]   = m_samples[m_ptr + j][0];
+            lin[2*(j-1)+1] = m_samples[m_ptr + j][1];
+        }
+
+        IntHalfbandFilterEO1Intrisics<HBFilterOrder>::workInterpolateBlock(lin, out, n);
+
+        for (int j = 0; j < N; j++) // the ring restarts at 0 with the last N samples
+        {
+            m_samples[j][0] = m_samples[j + N][0] = lin[2*(n-1+j)];
+            m_samples[j][1] = m_samples[j + N][1] = lin[2*(n-1+j)+1];
+        }
+
+        m_ptr = 0;
+    }
+
 protected:
     int32_t m_even[2][HBFIRFilterTraits<HBFilterOrder>::hbOrder]; // double buffer technique
     int32_t m_odd[2][HBFIRFilterTraits<HBFilterOrder>::hbOrder]; // double buffer technique
@@ -102,7 +128,6 @@ protected:
         int32_t iAcc = 0;
         int32_t qAcc = 0;
 
-#ifdef USE_SSE4_1
         IntHalfbandFilterEO1Intrisics<HBFilterOrder>::work(
                 m_ptr,
                 m_even,
@@ -110,27 +135,7 @@ protected:
                 iAcc,
                 qAcc
         );
-#else
-        int a = m_ptr/2 + m_size; // tip pointer
-        int b = m_ptr/2 + 1; // tail pointer
 
-        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
-        {
-            if ((m_ptr % 2) == 0)
-            {
-                iAcc += (m_even[0][a] + m_even[0][b]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-                qAcc += (m_even[1][a] + m_even[1][b]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-            }
-            else
-            {
-                iAcc += (m_odd[0][a] + m_odd[0][b]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-                qAcc += (m_odd[1][a] + m_odd[1][b]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-            }
-
-            a -= 1;
-            b += 1;
-        }
-#endif
         if ((m_ptr % 2) == 0)
         {
             iAcc += ((int32_t)m_odd[0][m_ptr/2 + m_size/2]) << (HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
@@ -151,17 +156,12 @@ protected:
         int32_t iAcc = 0;
         int32_t qAcc = 0;
 
-        int a = m_ptr;
-        int b = m_ptr + (HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2) - 1;
-
-        // go through samples in buffer
-        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
-        {
-            iAcc += (m_samples[a][0] + m_samples[b][0]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-            qAcc += (m_samples[a][1] + m_samples[b][1]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-            a++;
-            b--;
-        }
+        IntHalfbandFilterEO1Intrisics<HBFilterOrder>::workInterpolate(
+                m_ptr,
+                m_samples,
+                iAcc,
+                qAcc
+        );
 
         *x = iAcc >> (HBFIRFilterTraits<HBFilterOrder>::hbShift -1);
         *y = qAcc >> (HBFIRFilterTraits<HBFilterOrder>::hbShift -1);
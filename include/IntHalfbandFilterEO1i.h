@@ -22,8 +22,12 @@
 #ifndef INCLUDE_INTHALFBANDFILTEREO1I_H_
 #define INCLUDE_INTHALFBANDFILTEREO1I_H_
 
-#if defined(USE_SSE4_1)
-#include <smmintrin.h>
+#include "SIMDDispatch.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
 #endif
 
 
@@ -31,43 +35,214 @@ template<uint32_t HBFilterOrder>
 class IntHalfbandFilterEO1Intrisics
 {
 public:
+    /** Decimation FIR over the even/odd double buffers. Kernel is selected from the CPU features. */
     static void work(
             int ptr,
             int32_t even[2][HBFilterOrder],
             int32_t odd[2][HBFilterOrder],
             int32_t& iAcc, int32_t& qAcc)
+    {
+        int32_t (*s)[HBFilterOrder] = ((ptr % 2) == 0) ? even : odd;
+#if defined(SIMD_X86_DISPATCH)
+        switch (SIMDDispatch::level())
+        {
+        case SIMDDispatch::SIMDAVX2:
+            workAVX2(ptr, s, iAcc, qAcc);
+            break;
+        case SIMDDispatch::SIMDSSE4_1:
+            workSSE4_1(ptr, s, iAcc, qAcc);
+            break;
+        default:
+            workScalar(ptr, s, iAcc, qAcc);
+            break;
+        }
+#elif defined(USE_NEON)
+        workNEON(ptr, s, iAcc, qAcc);
+#else
+        workScalar(ptr, s, iAcc, qAcc);
+#endif
+    }
+
+    /** Interpolation FIR over the [sample][I/Q] ring buffer. Kernel is selected from the CPU features. */
+    static void workInterpolate(
+            int ptr,
+            int32_t samples[HBFilterOrder][2],
+            int32_t& iAcc, int32_t& qAcc)
+    {
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() >= SIMDDispatch::SIMDSSE4_1) { // nothing to gain from AVX2 on so few taps
+            workInterpolateSSE4_1(ptr, samples, iAcc, qAcc);
+        } else {
+            workInterpolateScalar(ptr, samples, iAcc, qAcc);
+        }
+#elif defined(USE_NEON)
+        workInterpolateNEON(ptr, samples, iAcc, qAcc);
+#else
+        workInterpolateScalar(ptr, samples, iAcc, qAcc);
+#endif
+    }
+
+    /**
+     * Interpolation FIR over a block: n consecutive outputs of workInterpolate computed together. lin holds
+     * the interleaved I/Q input in time order: hbOrder/2 - 1 history samples followed by the n new ones.
+     * Gives in out, for each new sample, the delayed middle sample and the filtered one as myInterpolate does.
+     * The vector kernels compute several consecutive outputs at once with the same integer operations so
+     * results are identical to the sample by sample filter.
+     */
+    static void workInterpolateBlock(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        unsigned int t = 0;
+#if defined(SIMD_X86_DISPATCH)
+        switch (SIMDDispatch::level())
+        {
+        case SIMDDispatch::SIMDAVX2:
+            t = workInterpolateBlockAVX2(lin, out, n);
+            break;
+        case SIMDDispatch::SIMDSSE4_1:
+            t = workInterpolateBlockSSE4_1(lin, out, n);
+            break;
+        default:
+            break;
+        }
+#elif defined(USE_NEON)
+        t = workInterpolateBlockNEON(lin, out, n);
+#endif
+        workInterpolateBlockScalar(lin, out, t, n);
+    }
+
+private:
+    static void workScalar(int ptr, int32_t s[2][HBFilterOrder], int32_t& iAcc, int32_t& qAcc)
     {
         int a = ptr/2 + HBFIRFilterTraits<HBFilterOrder>::hbOrder/2; // tip pointer
         int b = ptr/2 + 1; // tail pointer
-#if defined(USE_SSE4_1)
+
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
+        {
+            iAcc += (s[0][a] + s[0][b]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            qAcc += (s[1][a] + s[1][b]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            a -= 1;
+            b += 1;
+        }
+    }
+
+    static void workInterpolateScalar(int ptr, int32_t samples[HBFilterOrder][2], int32_t& iAcc, int32_t& qAcc)
+    {
+        int a = ptr;
+        int b = ptr + (HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2) - 1;
+
+        // go through samples in buffer
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
+        {
+            iAcc += (samples[a][0] + samples[b][0]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            qAcc += (samples[a][1] + samples[b][1]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            a++;
+            b--;
+        }
+    }
+
+    static void workInterpolateBlockScalar(const int32_t *lin, int32_t *out, unsigned int t, unsigned int n)
+    {
+        const int N = HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2; // window length
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+
+        for (; t < n; t++)
+        {
+            const int32_t *w = &lin[2*t]; // window of this output
+            int32_t iAcc = 0;
+            int32_t qAcc = 0;
+
+            for (int i = 0; i < N/2; i++)
+            {
+                iAcc += (w[2*i]   + w[2*(N-1-i)])   * h[i];
+                qAcc += (w[2*i+1] + w[2*(N-1-i)+1]) * h[i];
+            }
+
+            out[4*t]   = w[2*(N/2-1)]; // middle peak
+            out[4*t+1] = w[2*(N/2-1)+1];
+            out[4*t+2] = iAcc >> (HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
+            out[4*t+3] = qAcc >> (HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
+        }
+    }
+
+#if defined(SIMD_X86_DISPATCH)
+    SIMD_TARGET("avx2")
+    static void workAVX2(int ptr, int32_t s[2][HBFilterOrder], int32_t& iAcc, int32_t& qAcc)
+    {
+        // eight taps per iteration then a last 128 bit step for orders that are not a multiple of 32
+        int a = ptr/2 + HBFIRFilterTraits<HBFilterOrder>::hbOrder/2 - 7; // tip pointer
+        int b = ptr/2 + 1; // tail pointer
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        const __m256i rev = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i sumI = _mm256_setzero_si256();
+        __m256i sumQ = _mm256_setzero_si256();
+        __m256i sa, sb, sh;
+
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 32; i++)
+        {
+            sh = _mm256_loadu_si256((const __m256i*) h);
+
+            sa = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i*) &(s[0][a])), rev);
+            sb = _mm256_loadu_si256((__m256i*) &(s[0][b]));
+            sumI = _mm256_add_epi32(sumI, _mm256_mullo_epi32(_mm256_add_epi32(sa, sb), sh));
+
+            sa = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i*) &(s[1][a])), rev);
+            sb = _mm256_loadu_si256((__m256i*) &(s[1][b]));
+            sumQ = _mm256_add_epi32(sumQ, _mm256_mullo_epi32(_mm256_add_epi32(sa, sb), sh));
+
+            a -= 8;
+            b += 8;
+            h += 8;
+        }
+
+        __m128i sI = _mm_add_epi32(_mm256_castsi256_si128(sumI), _mm256_extracti128_si256(sumI, 1));
+        __m128i sQ = _mm_add_epi32(_mm256_castsi256_si128(sumQ), _mm256_extracti128_si256(sumQ, 1));
+
+        if ((HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4) % 8)
+        {
+            __m128i sa4, sb4, sh4 = _mm_loadu_si128((const __m128i*) h);
+            a += 4;
+
+            sa4 = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(s[0][a])), _MM_SHUFFLE(0,1,2,3));
+            sb4 = _mm_loadu_si128((__m128i*) &(s[0][b]));
+            sI = _mm_add_epi32(sI, _mm_mullo_epi32(_mm_add_epi32(sa4, sb4), sh4));
+
+            sa4 = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(s[1][a])), _MM_SHUFFLE(0,1,2,3));
+            sb4 = _mm_loadu_si128((__m128i*) &(s[1][b]));
+            sQ = _mm_add_epi32(sQ, _mm_mullo_epi32(_mm_add_epi32(sa4, sb4), sh4));
+        }
+
+        // horizontal add of four 32 bit partial sums
+
+        sI = _mm_add_epi32(sI, _mm_srli_si128(sI, 8));
+        sI = _mm_add_epi32(sI, _mm_srli_si128(sI, 4));
+        iAcc = _mm_cvtsi128_si32(sI);
+
+        sQ = _mm_add_epi32(sQ, _mm_srli_si128(sQ, 8));
+        sQ = _mm_add_epi32(sQ, _mm_srli_si128(sQ, 4));
+        qAcc = _mm_cvtsi128_si32(sQ);
+    }
+
+    SIMD_TARGET("sse4.1")
+    static void workSSE4_1(int ptr, int32_t s[2][HBFilterOrder], int32_t& iAcc, int32_t& qAcc)
+    {
+        int a = ptr/2 + HBFIRFilterTraits<HBFilterOrder>::hbOrder/2 - 3; // tip pointer
+        int b = ptr/2 + 1; // tail pointer
         const __m128i* h = (const __m128i*) HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
         __m128i sumI = _mm_setzero_si128();
         __m128i sumQ = _mm_setzero_si128();
-        __m128i sa, sb;
-        a -= 3;
+        __m128i sa, sb, sh;
 
         for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 16; i++)
         {
-            if ((ptr % 2) == 0)
-            {
-                sa = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(even[0][a])), _MM_SHUFFLE(0,1,2,3));
-                sb = _mm_loadu_si128((__m128i*) &(even[0][b]));
-                sumI = _mm_add_epi32(sumI, _mm_mullo_epi32(_mm_add_epi32(sa, sb), *h));
+            sh = _mm_loadu_si128(h);
 
-                sa = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(even[1][a])), _MM_SHUFFLE(0,1,2,3));
-                sb = _mm_loadu_si128((__m128i*) &(even[1][b]));
-                sumQ = _mm_add_epi32(sumQ, _mm_mullo_epi32(_mm_add_epi32(sa, sb), *h));
-            }
-            else
-            {
-                sa = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(odd[0][a])), _MM_SHUFFLE(0,1,2,3));
-                sb = _mm_loadu_si128((__m128i*) &(odd[0][b]));
-                sumI = _mm_add_epi32(sumI, _mm_mullo_epi32(_mm_add_epi32(sa, sb), *h));
+            sa = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(s[0][a])), _MM_SHUFFLE(0,1,2,3));
+            sb = _mm_loadu_si128((__m128i*) &(s[0][b]));
+            sumI = _mm_add_epi32(sumI, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
 
-                sa = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(odd[1][a])), _MM_SHUFFLE(0,1,2,3));
-                sb = _mm_loadu_si128((__m128i*) &(odd[1][b]));
-                sumQ = _mm_add_epi32(sumQ, _mm_mullo_epi32(_mm_add_epi32(sa, sb), *h));
-            }
+            sa = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(s[1][a])), _MM_SHUFFLE(0,1,2,3));
+            sb = _mm_loadu_si128((__m128i*) &(s[1][b]));
+            sumQ = _mm_add_epi32(sumQ, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
 
             a -= 4;
             b += 4;
@@ -83,8 +258,189 @@ public:
         sumQ = _mm_add_epi32(sumQ, _mm_srli_si128(sumQ, 8));
         sumQ = _mm_add_epi32(sumQ, _mm_srli_si128(sumQ, 4));
         qAcc = _mm_cvtsi128_si32(sumQ);
+    }
+
+    /** Two taps i.e. two I/Q pairs per 128 bit vector */
+    SIMD_TARGET("sse4.1")
+    static void workInterpolateSSE4_1(int ptr, int32_t samples[HBFilterOrder][2], int32_t& iAcc, int32_t& qAcc)
+    {
+        int a = ptr; // first half, forward
+        int b = ptr + (HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2) - 2; // second half, backward by pairs of samples
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        __m128i sum = _mm_setzero_si128();
+        __m128i sa, sb, sh;
+
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 8; i++)
+        {
+            sh = _mm_loadl_epi64((const __m128i*) h);
+            sh = _mm_unpacklo_epi32(sh, sh); // c0 c0 c1 c1
+            sa = _mm_loadu_si128((__m128i*) &(samples[a][0]));
+            sb = _mm_shuffle_epi32(_mm_loadu_si128((__m128i*) &(samples[b][0])), _MM_SHUFFLE(1,0,3,2)); // swap samples
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
+            a += 2;
+            b -= 2;
+            h += 2;
+        }
+
+        sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+        iAcc = _mm_cvtsi128_si32(sum);
+        qAcc = _mm_extract_epi32(sum, 1);
+    }
+
+    /** Two consecutive outputs (two I/Q pairs) per 128 bit vector. Returns the number of outputs done. */
+    SIMD_TARGET("sse4.1")
+    static unsigned int workInterpolateBlockSSE4_1(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        const int N = HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2;
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int t = 0;
+
+        for (; t + 2 <= n; t += 2)
+        {
+            const int32_t *w = &lin[2*t];
+            __m128i sum = _mm_setzero_si128();
+
+            for (int i = 0; i < N/2; i++)
+            {
+                __m128i sa = _mm_loadu_si128((const __m128i*) &w[2*i]);
+                __m128i sb = _mm_loadu_si128((const __m128i*) &w[2*(N-1-i)]);
+                sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_add_epi32(sa, sb), _mm_set1_epi32(h[i])));
+            }
+
+            __m128i mid = _mm_loadu_si128((const __m128i*) &w[2*(N/2-1)]);
+            __m128i fir = _mm_srai_epi32(sum, HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
+            _mm_storeu_si128((__m128i*) &out[4*t],   _mm_unpacklo_epi64(mid, fir));
+            _mm_storeu_si128((__m128i*) &out[4*t+4], _mm_unpackhi_epi64(mid, fir));
+        }
+
+        return t;
+    }
+
+    /** Four consecutive outputs per 256 bit vector. Returns the number of outputs done. */
+    SIMD_TARGET("avx2")
+    static unsigned int workInterpolateBlockAVX2(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        const int N = HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2;
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int t = 0;
+
+        for (; t + 4 <= n; t += 4)
+        {
+            const int32_t *w = &lin[2*t];
+            __m256i sum = _mm256_setzero_si256();
+
+            for (int i = 0; i < N/2; i++)
+            {
+                __m256i sa = _mm256_loadu_si256((const __m256i*) &w[2*i]);
+                __m256i sb = _mm256_loadu_si256((const __m256i*) &w[2*(N-1-i)]);
+                sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(_mm256_add_epi32(sa, sb), _mm256_set1_epi32(h[i])));
+            }
+
+            __m256i mid = _mm256_loadu_si256((const __m256i*) &w[2*(N/2-1)]);
+            __m256i fir = _mm256_srai_epi32(sum, HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
+            __m256i lo = _mm256_unpacklo_epi64(mid, fir); // outputs 0 and 2
+            __m256i hi = _mm256_unpackhi_epi64(mid, fir); // outputs 1 and 3
+            _mm256_storeu_si256((__m256i*) &out[4*t],   _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i*) &out[4*t+8], _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        return t;
+    }
 #endif
+
+#if defined(USE_NEON) && !defined(SIMD_X86_DISPATCH)
+    static void workNEON(int ptr, int32_t s[2][HBFilterOrder], int32_t& iAcc, int32_t& qAcc)
+    {
+        int a = ptr/2 + HBFIRFilterTraits<HBFilterOrder>::hbOrder/2 - 3; // tip pointer
+        int b = ptr/2 + 1; // tail pointer
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        int32x4_t sumI = vdupq_n_s32(0);
+        int32x4_t sumQ = vdupq_n_s32(0);
+        int32x4_t sa, sb, sh;
+
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 16; i++)
+        {
+            sh = vld1q_s32(h);
+
+            sa = reverse(vld1q_s32(&(s[0][a])));
+            sb = vld1q_s32(&(s[0][b]));
+            sumI = vmlaq_s32(sumI, vaddq_s32(sa, sb), sh);
+
+            sa = reverse(vld1q_s32(&(s[1][a])));
+            sb = vld1q_s32(&(s[1][b]));
+            sumQ = vmlaq_s32(sumQ, vaddq_s32(sa, sb), sh);
+
+            a -= 4;
+            b += 4;
+            h += 4;
+        }
+
+        // horizontal add of four 32 bit partial sums: I in lane 0, Q in lane 1
+
+        int32x2_t sum = vpadd_s32(vpadd_s32(vget_low_s32(sumI), vget_high_s32(sumI)), vpadd_s32(vget_low_s32(sumQ), vget_high_s32(sumQ)));
+        iAcc = vget_lane_s32(sum, 0);
+        qAcc = vget_lane_s32(sum, 1);
     }
+
+    /** Two taps i.e. two I/Q pairs per 128 bit vector */
+    static void workInterpolateNEON(int ptr, int32_t samples[HBFilterOrder][2], int32_t& iAcc, int32_t& qAcc)
+    {
+        int a = ptr; // first half, forward
+        int b = ptr + (HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2) - 2; // second half, backward by pairs of samples
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        int32x4_t sum = vdupq_n_s32(0);
+        int32x4_t sa, sb;
+        int32x2x2_t sh;
+
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 8; i++)
+        {
+            int32x2_t c = vld1_s32(h);
+            sh = vzip_s32(c, c); // c0 c0 c1 c1
+            sa = vld1q_s32(&(samples[a][0]));
+            sb = vld1q_s32(&(samples[b][0]));
+            sb = vcombine_s32(vget_high_s32(sb), vget_low_s32(sb)); // swap samples
+            sum = vmlaq_s32(sum, vaddq_s32(sa, sb), vcombine_s32(sh.val[0], sh.val[1]));
+            a += 2;
+            b -= 2;
+            h += 2;
+        }
+
+        int32x2_t r = vadd_s32(vget_low_s32(sum), vget_high_s32(sum));
+        iAcc = vget_lane_s32(r, 0);
+        qAcc = vget_lane_s32(r, 1);
+    }
+
+    /** Two consecutive outputs (two I/Q pairs) per 128 bit vector. Returns the number of outputs done. */
+    static unsigned int workInterpolateBlockNEON(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        const int N = HBFIRFilterTraits<HBFilterOrder>::hbOrder / 2;
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int t = 0;
+
+        for (; t + 2 <= n; t += 2)
+        {
+            const int32_t *w = &lin[2*t];
+            int32x4_t sum = vdupq_n_s32(0);
+
+            for (int i = 0; i < N/2; i++) {
+                sum = vmlaq_n_s32(sum, vaddq_s32(vld1q_s32(&w[2*i]), vld1q_s32(&w[2*(N-1-i)])), h[i]);
+            }
+
+            int32x4_t mid = vld1q_s32(&w[2*(N/2-1)]);
+            int32x4_t fir = vshrq_n_s32(sum, HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
+            vst1q_s32(&out[4*t],   vcombine_s32(vget_low_s32(mid), vget_low_s32(fir)));
+            vst1q_s32(&out[4*t+4], vcombine_s32(vget_high_s32(mid), vget_high_s32(fir)));
+        }
+
+        return t;
+    }
+
+    static int32x4_t reverse(int32x4_t x)
+    {
+        int32x4_t r = vrev64q_s32(x);
+        return vcombine_s32(vget_high_s32(r), vget_low_s32(r));
+    }
+#endif
 };
 
 
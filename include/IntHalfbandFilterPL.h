@@ -0,0 +1,382 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_INTHALFBANDFILTERPL_H_
+#define INCLUDE_INTHALFBANDFILTERPL_H_
+
+#include <stdint.h>
+#include <cstring>
+
+#include "HBFilterTraits.h"
+#include "SIMDDispatch.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Half band FIR kernels over planar blocks (one component per array, see IQPlanar.h). Consecutive outputs
+ * are computed together, one per vector lane: 4 per SSE4.1 or NEON vector, 8 with AVX2, twice as many as
+ * with interleaved I/Q. They use the same integer operations as IntHalfbandFilterEO1 so results are identical.
+ */
+template<uint32_t HBFilterOrder>
+class IntHalfbandFilterPLIntrinsics
+{
+public:
+    static const int hbOrder = HBFIRFilterTraits<HBFilterOrder>::hbOrder;
+    static const int hbShift = HBFIRFilterTraits<HBFilterOrder>::hbShift;
+
+    /** Split n samples of x in time order into the ones at even and odd indexes */
+    static void split(const int32_t *x, int32_t *even, int32_t *odd, unsigned int n)
+    {
+        unsigned int m = 0;
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+        for (; m + 4 <= n; m += 4)
+        {
+            __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*) &x[2*m]));
+            __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*) &x[2*m+4]));
+            _mm_storeu_si128((__m128i*) &even[m], _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0))));
+            _mm_storeu_si128((__m128i*) &odd[m],  _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1))));
+        }
+#elif defined(USE_NEON)
+        for (; m + 4 <= n; m += 4)
+        {
+            int32x4x2_t v = vld2q_s32(&x[2*m]);
+            vst1q_s32(&even[m], v.val[0]);
+            vst1q_s32(&odd[m],  v.val[1]);
+        }
+#endif
+        for (; m < n; m++)
+        {
+            even[m] = x[2*m];
+            odd[m]  = x[2*m+1];
+        }
+    }
+
+    /**
+     * Decimation FIR giving n outputs. The odd samples (hbOrder/2 - 1 of history then n new ones) go through the
+     * symmetric taps and the even samples (hbOrder/4 - 1 of history then n new ones) give the middle peak:
+     * out[k] = (sum h[j] * (odd[k+j] + odd[k+hbOrder/2-1-j]) + even[k] * 2^(hbShift-1)) / 2^(hbShift-1)
+     */
+    static void decimate(const int32_t *odd, const int32_t *even, int32_t *out, unsigned int n)
+    {
+        unsigned int k = 0;
+#if defined(SIMD_X86_DISPATCH)
+        switch (SIMDDispatch::level())
+        {
+        case SIMDDispatch::SIMDAVX2:
+            k = decimateAVX2(odd, even, out, n);
+            break;
+        case SIMDDispatch::SIMDSSE4_1:
+            k = decimateSSE4_1(odd, even, out, n);
+            break;
+        default:
+            break;
+        }
+#elif defined(USE_NEON)
+        k = decimateNEON(odd, even, out, n);
+#endif
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+
+        for (; k < n; k++)
+        {
+            int32_t acc = 0;
+
+            for (int j = 0; j < hbOrder/4; j++) {
+                acc += (odd[k+j] + odd[k+hbOrder/2-1-j]) * h[j];
+            }
+
+            acc += even[k] << (hbShift - 1);
+            out[k] = acc >> (hbShift - 1);
+        }
+    }
+
+    /**
+     * Interpolation FIR over the samples of lin in time order (hbOrder/2 - 1 of history then the n new ones)
+     * giving 2n samples in out: for each new one the delayed middle sample then the filtered one.
+     */
+    static void interpolate(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        unsigned int t = 0;
+#if defined(SIMD_X86_DISPATCH)
+        switch (SIMDDispatch::level())
+        {
+        case SIMDDispatch::SIMDAVX2:
+            t = interpolateAVX2(lin, out, n);
+            break;
+        case SIMDDispatch::SIMDSSE4_1:
+            t = interpolateSSE4_1(lin, out, n);
+            break;
+        default:
+            break;
+        }
+#elif defined(USE_NEON)
+        t = interpolateNEON(lin, out, n);
+#endif
+        const int N = hbOrder/2; // window length
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+
+        for (; t < n; t++)
+        {
+            const int32_t *w = &lin[t];
+            int32_t acc = 0;
+
+            for (int j = 0; j < N/2; j++) {
+                acc += (w[j] + w[N-1-j]) * h[j];
+            }
+
+            out[2*t]   = w[N/2-1]; // middle peak
+            out[2*t+1] = acc >> (hbShift - 1);
+        }
+    }
+
+private:
+#if defined(SIMD_X86_DISPATCH)
+    SIMD_TARGET("sse4.1")
+    static unsigned int decimateSSE4_1(const int32_t *odd, const int32_t *even, int32_t *out, unsigned int n)
+    {
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int k = 0;
+
+        for (; k + 4 <= n; k += 4)
+        {
+            __m128i acc = _mm_slli_epi32(_mm_loadu_si128((const __m128i*) &even[k]), hbShift - 1);
+
+            for (int j = 0; j < hbOrder/4; j++)
+            {
+                __m128i sa = _mm_loadu_si128((const __m128i*) &odd[k+j]);
+                __m128i sb = _mm_loadu_si128((const __m128i*) &odd[k+hbOrder/2-1-j]);
+                acc = _mm_add_epi32(acc, _mm_mullo_epi32(_mm_add_epi32(sa, sb), _mm_set1_epi32(h[j])));
+            }
+
+            _mm_storeu_si128((__m128i*) &out[k], _mm_srai_epi32(acc, hbShift - 1));
+        }
+
+        return k;
+    }
+
+    SIMD_TARGET("avx2")
+    static unsigned int decimateAVX2(const int32_t *odd, const int32_t *even, int32_t *out, unsigned int n)
+    {
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int k = 0;
+
+        for (; k + 8 <= n; k += 8)
+        {
+            __m256i acc = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i*) &even[k]), hbShift - 1);
+
+            for (int j = 0; j < hbOrder/4; j++)
+            {
+                __m256i sa = _mm256_loadu_si256((const __m256i*) &odd[k+j]);
+                __m256i sb = _mm256_loadu_si256((const __m256i*) &odd[k+hbOrder/2-1-j]);
+                acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_add_epi32(sa, sb), _mm256_set1_epi32(h[j])));
+            }
+
+            _mm256_storeu_si256((__m256i*) &out[k], _mm256_srai_epi32(acc, hbShift - 1));
+        }
+
+        return k;
+    }
+
+    SIMD_TARGET("sse4.1")
+    static unsigned int interpolateSSE4_1(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        const int N = hbOrder/2;
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int t = 0;
+
+        for (; t + 4 <= n; t += 4)
+        {
+            const int32_t *w = &lin[t];
+            __m128i acc = _mm_setzero_si128();
+
+            for (int j = 0; j < N/2; j++)
+            {
+                __m128i sa = _mm_loadu_si128((const __m128i*) &w[j]);
+                __m128i sb = _mm_loadu_si128((const __m128i*) &w[N-1-j]);
+                acc = _mm_add_epi32(acc, _mm_mullo_epi32(_mm_add_epi32(sa, sb), _mm_set1_epi32(h[j])));
+            }
+
+            __m128i mid = _mm_loadu_si128((const __m128i*) &w[N/2-1]);
+            __m128i fir = _mm_srai_epi32(acc, hbShift - 1);
+            _mm_storeu_si128((__m128i*) &out[2*t],   _mm_unpacklo_epi32(mid, fir));
+            _mm_storeu_si128((__m128i*) &out[2*t+4], _mm_unpackhi_epi32(mid, fir));
+        }
+
+        return t;
+    }
+
+    SIMD_TARGET("avx2")
+    static unsigned int interpolateAVX2(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        const int N = hbOrder/2;
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int t = 0;
+
+        for (; t + 8 <= n; t += 8)
+        {
+            const int32_t *w = &lin[t];
+            __m256i acc = _mm256_setzero_si256();
+
+            for (int j = 0; j < N/2; j++)
+            {
+                __m256i sa = _mm256_loadu_si256((const __m256i*) &w[j]);
+                __m256i sb = _mm256_loadu_si256((const __m256i*) &w[N-1-j]);
+                acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(_mm256_add_epi32(sa, sb), _mm256_set1_epi32(h[j])));
+            }
+
+            __m256i mid = _mm256_loadu_si256((const __m256i*) &w[N/2-1]);
+            __m256i fir = _mm256_srai_epi32(acc, hbShift - 1);
+            // unpack works per 128 bit lane: outputs 0,1,4,5 and 2,3,6,7
+            __m256i lo = _mm256_unpacklo_epi32(mid, fir);
+            __m256i hi = _mm256_unpackhi_epi32(mid, fir);
+            _mm256_storeu_si256((__m256i*) &out[2*t],   _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i*) &out[2*t+8], _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        return t;
+    }
+#endif
+
+#if defined(USE_NEON) && !defined(SIMD_X86_DISPATCH)
+    static unsigned int decimateNEON(const int32_t *odd, const int32_t *even, int32_t *out, unsigned int n)
+    {
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int k = 0;
+
+        for (; k + 4 <= n; k += 4)
+        {
+            int32x4_t acc = vshlq_n_s32(vld1q_s32(&even[k]), hbShift - 1);
+
+            for (int j = 0; j < hbOrder/4; j++) {
+                acc = vmlaq_n_s32(acc, vaddq_s32(vld1q_s32(&odd[k+j]), vld1q_s32(&odd[k+hbOrder/2-1-j])), h[j]);
+            }
+
+            vst1q_s32(&out[k], vshrq_n_s32(acc, hbShift - 1));
+        }
+
+        return k;
+    }
+
+    static unsigned int interpolateNEON(const int32_t *lin, int32_t *out, unsigned int n)
+    {
+        const int N = hbOrder/2;
+        const int32_t *h = HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
+        unsigned int t = 0;
+
+        for (; t + 4 <= n; t += 4)
+        {
+            const int32_t *w = &lin[t];
+            int32x4_t acc = vdupq_n_s32(0);
+
+            for (int j = 0; j < N/2; j++) {
+                acc = vmlaq_n_s32(acc, vaddq_s32(vld1q_s32(&w[j]), vld1q_s32(&w[N-1-j])), h[j]);
+            }
+
+            int32x4x2_t v;
+            v.val[0] = vld1q_s32(&w[N/2-1]);
+            v.val[1] = vshrq_n_s32(acc, hbShift - 1);
+            vst2q_s32(&out[2*t], v);
+        }
+
+        return t;
+    }
+#endif
+};
+
+/**
+ * Half band decimator by 2 over planar blocks of at most MaxBlock samples. The history is kept split into
+ * the even and odd samples so that the kernel reads contiguous arrays only.
+ */
+template<uint32_t HBFilterOrder, unsigned int MaxBlock>
+class IntHalfbandDecimatorPL
+{
+public:
+    IntHalfbandDecimatorPL()
+    {
+        std::memset(m_even, 0, sizeof(m_even));
+        std::memset(m_odd, 0, sizeof(m_odd));
+    }
+
+    /**
+     * Decimate the n planar samples of i and q (n even, at most MaxBlock) giving n/2 samples in outI and outQ
+     * that may be i and q. Same results as n/2 calls of IntHalfbandFilterEO1::myDecimate.
+     */
+    void decimate(const int32_t *i, const int32_t *q, int32_t *outI, int32_t *outQ, unsigned int n)
+    {
+        unsigned int m = n/2;
+        Kernels::split(i, &m_even[0][evenHistory], &m_odd[0][oddHistory], m);
+        Kernels::split(q, &m_even[1][evenHistory], &m_odd[1][oddHistory], m);
+        Kernels::decimate(m_odd[0], m_even[0], outI, m);
+        Kernels::decimate(m_odd[1], m_even[1], outQ, m);
+
+        for (int c = 0; c < 2; c++) // the last samples are the history of the next block
+        {
+            std::memmove(&m_even[c][0], &m_even[c][m], evenHistory * sizeof(int32_t));
+            std::memmove(&m_odd[c][0], &m_odd[c][m], oddHistory * sizeof(int32_t));
+        }
+    }
+
+private:
+    typedef IntHalfbandFilterPLIntrinsics<HBFilterOrder> Kernels;
+    static const int evenHistory = HBFIRFilterTraits<HBFilterOrder>::hbOrder/4 - 1;
+    static const int oddHistory  = HBFIRFilterTraits<HBFilterOrder>::hbOrder/2 - 1;
+
+    int32_t m_even[2][evenHistory + MaxBlock/2]; //!< I and Q even samples after their history
+    int32_t m_odd[2][oddHistory + MaxBlock/2];   //!< I and Q odd samples after their history
+};
+
+/** Half band interpolator by 2 over planar blocks */
+template<uint32_t HBFilterOrder>
+class IntHalfbandInterpolatorPL
+{
+public:
+    static const int history = HBFIRFilterTraits<HBFilterOrder>::hbOrder/2 - 1; //!< samples needed before a block
+
+    IntHalfbandInterpolatorPL()
+    {
+        std::memset(m_history, 0, sizeof(m_history));
+    }
+
+    /**
+     * Interpolate the n planar samples of i and q giving 2n samples in outI and outQ. As with
+     * IntHalfbandFilterEO1::myInterpolateBlock the history is copied in front of the samples: i and q must
+     * have room for history samples before them. Same results as n calls of myInterpolate.
+     */
+    void interpolate(int32_t *i, int32_t *q, int32_t *outI, int32_t *outQ, unsigned int n)
+    {
+        int32_t *in[2] = {i, q};
+        int32_t *out[2] = {outI, outQ};
+
+        for (int c = 0; c < 2; c++)
+        {
+            std::memcpy(in[c] - history, m_history[c], history * sizeof(int32_t));
+            Kernels::interpolate(in[c] - history, out[c], n);
+            std::memcpy(m_history[c], in[c] + n - history, history * sizeof(int32_t));
+        }
+    }
+
+private:
+    typedef IntHalfbandFilterPLIntrinsics<HBFilterOrder> Kernels;
+
+    int32_t m_history[2][history];
+};
+
+#endif /* INCLUDE_INTHALFBANDFILTERPL_H_ */
@@ -100,7 +100,6 @@ protected:
             m_iOddAcc = 0;
             m_qOddAcc = 0;
 
-#if defined(USE_SSE4_1) || defined(USE_NEON)
             IntHalfbandFilterSTIntrinsics<HBFilterOrder>::workNA(
                     m_ptr + 1,
                     m_samplesDB,
@@ -108,20 +107,6 @@ protected:
 					m_qEvenAcc,
 					m_iOddAcc,
 					m_qOddAcc);
-#else
-            int a = m_ptr + m_size; // tip pointer - odd
-            int b = m_ptr + 1; // tail pointer - aven
-
-            for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
-            {
-                m_iEvenAcc += (m_samplesDB[a-1][0] + m_samplesDB[b][0])   * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-                m_iOddAcc  += (m_samplesDB[a][0]   + m_samplesDB[b+1][0]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-                m_qEvenAcc += (m_samplesDB[a-1][1] + m_samplesDB[b][1])   * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-                m_qOddAcc  += (m_samplesDB[a][1]   + m_samplesDB[b+1][1]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
-                a -= 2;
-                b += 2;
-            }
-#endif
             m_iEvenAcc += ((int32_t)m_samplesDB[m_ptr + m_size/2][0]) << (HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
             m_qEvenAcc += ((int32_t)m_samplesDB[m_ptr + m_size/2][1]) << (HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
             m_iOddAcc += ((int32_t)m_samplesDB[m_ptr + m_size/2 + 1][0]) << (HBFIRFilterTraits<HBFilterOrder>::hbShift - 1);
@@ -24,8 +24,10 @@
 
 #include <stdint.h>
 
-#if defined(USE_SSE4_1)
-#include <smmintrin.h>
+#include "SIMDDispatch.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
 #elif defined(USE_NEON)
 #include <arm_neon.h>
 #endif
@@ -36,12 +38,14 @@ template<uint32_t HBFilterOrder>
 class IntHalfbandFilterSTIntrinsics
 {
 public:
+#if defined(SIMD_X86_DISPATCH)
+    /** Aligned buffer version. SSE4.1 only: the caller checks SIMDDispatch::level() */
+    SIMD_TARGET("sse4.1")
     static void work(
             int32_t samples[HBFilterOrder][2],
             int32_t& iEvenAcc, int32_t& qEvenAcc,
 			int32_t& iOddAcc, int32_t& qOddAcc)
     {
-#if defined(USE_SSE4_1)
         int a = HBFIRFilterTraits<HBFilterOrder>::hbOrder - 2; // tip
         int b = 0; // tail
         const int* h = (const int*) HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
@@ -83,45 +87,68 @@ public:
         qEvenAcc = sums[1];
         iOddAcc = sums[2];
         qOddAcc = sums[3];
-#endif
     }
+#endif
 
-    // not aligned version
+    /** Not aligned version. Kernel is selected from the CPU features. */
     static void workNA(
             int ptr,
             int32_t samples[HBFilterOrder*2][2],
             int32_t& iEvenAcc, int32_t& qEvenAcc,
             int32_t& iOddAcc, int32_t& qOddAcc)
     {
-#if defined(USE_SSE4_1)
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() >= SIMDDispatch::SIMDSSE4_1) {
+            workNASSE4_1(ptr, samples, iEvenAcc, qEvenAcc, iOddAcc, qOddAcc);
+        } else {
+            workNAScalar(ptr, samples, iEvenAcc, qEvenAcc, iOddAcc, qOddAcc);
+        }
+#elif defined(USE_NEON)
+        workNANEON(ptr, samples, iEvenAcc, qEvenAcc, iOddAcc, qOddAcc);
+#else
+        workNAScalar(ptr, samples, iEvenAcc, qEvenAcc, iOddAcc, qOddAcc);
+#endif
+    }
+
+private:
+    static void workNAScalar(
+            int ptr,
+            int32_t samples[HBFilterOrder*2][2],
+            int32_t& iEvenAcc, int32_t& qEvenAcc,
+            int32_t& iOddAcc, int32_t& qOddAcc)
+    {
+        int a = ptr + HBFIRFilterTraits<HBFilterOrder>::hbOrder - 2; // tip
+        int b = ptr + 0; // tail
+
+        for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
+        {
+            iEvenAcc += (samples[a][0]   + samples[b][0])   * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            qEvenAcc += (samples[a][1]   + samples[b][1])   * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            iOddAcc  += (samples[a+1][0] + samples[b+1][0]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            qOddAcc  += (samples[a+1][1] + samples[b+1][1]) * HBFIRFilterTraits<HBFilterOrder>::hbCoeffs[i];
+            a -= 2;
+            b += 2;
+        }
+    }
+
+#if defined(SIMD_X86_DISPATCH)
+    /** One tap i.e. the even and odd I/Q pairs per 128 bit vector */
+    SIMD_TARGET("sse4.1")
+    static void workNASSE4_1(
+            int ptr,
+            int32_t samples[HBFilterOrder*2][2],
+            int32_t& iEvenAcc, int32_t& qEvenAcc,
+            int32_t& iOddAcc, int32_t& qOddAcc)
+    {
         int a = ptr + HBFIRFilterTraits<HBFilterOrder>::hbOrder - 2; // tip
         int b = ptr + 0; // tail
-        const int* h = (const int*) HBFIRFilterTraits<HBFilterOrder>::hbCoeffs;
         __m128i sum = _mm_setzero_si128();
         __m128i sh, sa, sb;
         int32_t sums[4] __attribute__ ((aligned (16)));
 
         for (int i = 0; i < HBFIRFilterTraits<HBFilterOrder>::hbOrder / 4; i++)
         {
-            sh = _mm_set_epi32(h[4*i], h[4*i], h[4*i], h[4*i]);
-            sa = _mm_loadu_si128((__m128i*) &(samples[a][0])); // Ei,Eq,Oi,Oq
-            sb = _mm_loadu_si128((__m128i*) &(samples[b][0]));
-            sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
-            a -= 2;
-            b += 2;
-            sh = _mm_set_epi32(h[4*i+1], h[4*i+1], h[4*i+1], h[4*i+1]);
-            sa = _mm_loadu_si128((__m128i*) &(samples[a][0])); // Ei,Eq,Oi,Oq
-            sb = _mm_loadu_si128((__m128i*) &(samples[b][0]));
-            sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
-            a -= 2;
-            b += 2;
-            sh = _mm_set_epi32(h[4*i+2], h[4*i+2], h[4*i+2], h[4*i+2]);
-            sa = _mm_loadu_si128((__m128i*) &(samples[a][0])); // Ei,Eq,Oi,Oq
-            sb = _mm_loadu_si128((__m128i*) &(samples[b][0]));
-            sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
-            a -= 2;
-            b += 2;
-            sh = _mm_set_epi32(h[4*i+3], h[4*i+3], h[4*i+3], h[4*i+3]);
+            sh = _mm_loadu_si128((const __m128i*) &(HBFIRFilterTraits<HBFilterOrder>::hbCoeffsX4[4*i]));
             sa = _mm_loadu_si128((__m128i*) &(samples[a][0])); // Ei,Eq,Oi,Oq
             sb = _mm_loadu_si128((__m128i*) &(samples[b][0]));
             sum = _mm_add_epi32(sum, _mm_mullo_epi32(_mm_add_epi32(sa, sb), sh));
@@ -135,7 +162,16 @@ public:
         qEvenAcc = sums[1];
         iOddAcc = sums[2];
         qOddAcc = sums[3];
-#elif defined(USE_NEON)
+    }
+#endif
+
+#if defined(USE_NEON) && !defined(SIMD_X86_DISPATCH)
+    static void workNANEON(
+            int ptr,
+            int32_t samples[HBFilterOrder*2][2],
+            int32_t& iEvenAcc, int32_t& qEvenAcc,
+            int32_t& iOddAcc, int32_t& qOddAcc)
+    {
         int a = ptr + HBFIRFilterTraits<HBFilterOrder>::hbOrder - 2; // tip
         int b = ptr + 0; // tail
         int32x4_t sum = vdupq_n_s32(0);
@@ -159,8 +195,8 @@ public:
         qEvenAcc = sums[1];
         iOddAcc = sums[2];
         qOddAcc = sums[3];
-#endif
     }
+#endif
 };
 
 
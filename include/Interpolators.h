@@ -21,9 +21,12 @@
 #define INCLUDE_INTERPOLATORS_H_
 
 #include "SDRDaemon.h"
+#include "SIMDDispatch.h"
 
-#if defined(USE_SSE4_1)
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
 #include "IntHalfbandFilterEO1.h"
+#include "IntHalfbandFilterPL.h"
+#include "IQPlanar.h"
 #else
 #include "IntHalfbandFilterDB.h"
 #endif
@@ -31,6 +34,8 @@
 #define INTERPOLATORS_HB_FILTER_ORDER_FIRST  64
 #define INTERPOLATORS_HB_FILTER_ORDER_SECOND 32
 #define INTERPOLATORS_HB_FILTER_ORDER_NEXT   16
+#define INTERPOLATORS_BLOCK_SIZE 4096 // output samples produced from each input chunk in the block cascade
+#define INTERPOLATORS_BLOCK_HISTORY (INTERPOLATORS_HB_FILTER_ORDER_FIRST/2) // room for the filter history before the samples of a stage
 
 class Interpolators
 {
@@ -42,8 +47,43 @@ public:
 	void interpolate32_cen(const IQSampleVector& in, IQSampleVector& out);
 	void interpolate64_cen(const IQSampleVector& in, IQSampleVector& out);
 
+	/**
+	 * Block cascade alternative to interpolate2..64_cen. Input is taken in chunks of INTERPOLATORS_BLOCK_SIZE
+	 * output samples divided by the interpolation factor and each half band stage runs over the whole chunk
+	 * before the next one so that the filter state and the intermediate samples stay in cache.
+	 * Same filters and same results as the sample by sample versions. With SIMD the samples are kept planar
+	 * (see IQPlanar.h) from the first stage to the output.
+	 */
+	void interpolateBlock(unsigned int log2Interp, const IQSampleVector& in, IQSampleVector& out);
+
 private:
-#if defined(USE_SSE4_1)
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
+	// the block cascade runs on planar samples with its own stages. Samples start after room for the filter history.
+	IQPlanarBlock<INTERPOLATORS_BLOCK_SIZE, INTERPOLATORS_BLOCK_HISTORY> m_planarBlock[2]; //!< stage input and output
+	IntHalfbandInterpolatorPL<INTERPOLATORS_HB_FILTER_ORDER_FIRST>  m_planar2;
+	IntHalfbandInterpolatorPL<INTERPOLATORS_HB_FILTER_ORDER_SECOND> m_planar4;
+	IntHalfbandInterpolatorPL<INTERPOLATORS_HB_FILTER_ORDER_NEXT>   m_planar8;
+	IntHalfbandInterpolatorPL<INTERPOLATORS_HB_FILTER_ORDER_NEXT>   m_planar16;
+	IntHalfbandInterpolatorPL<INTERPOLATORS_HB_FILTER_ORDER_NEXT>   m_planar32;
+	IntHalfbandInterpolatorPL<INTERPOLATORS_HB_FILTER_ORDER_NEXT>   m_planar64;
+#else
+	/** Run one half band stage over n interleaved I/Q samples of in. Gives 2n samples in out. */
+	template<class HBFilter>
+	static void halfbandStage(HBFilter& hb, int32_t *in, int32_t *out, unsigned int n)
+	{
+		for (unsigned int i = 0; i < n; i++)
+		{
+			out[4*i]   = in[2*i];
+			out[4*i+1] = in[2*i+1];
+			hb.myInterpolate(&out[4*i], &out[4*i+1], &out[4*i+2], &out[4*i+3]);
+		}
+	}
+
+	//! interleaved I/Q working buffers of block cascade (stage input and output). Samples start after room for the filter history.
+	int32_t m_blockBuf[2][2*(INTERPOLATORS_BLOCK_HISTORY + INTERPOLATORS_BLOCK_SIZE)];
+#endif
+
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
 	IntHalfbandFilterEO1<INTERPOLATORS_HB_FILTER_ORDER_FIRST> m_interpolator2;  // 1st stages
 	IntHalfbandFilterEO1<INTERPOLATORS_HB_FILTER_ORDER_SECOND> m_interpolator4;  // 2nd stages
 	IntHalfbandFilterEO1<INTERPOLATORS_HB_FILTER_ORDER_NEXT> m_interpolator8;  // 3rd stages
@@ -0,0 +1,98 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_JITTERBUFFER_H_
+#define INCLUDE_JITTERBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+#include "SDRDaemon.h"
+
+#define JITTERBUFFER_MAXCORRECTION 1000e-6 // largest rate correction (samples inserted or deleted per sample)
+#define JITTERBUFFER_AVERAGING 64          // number of frames over which the fill level is averaged
+#define JITTERBUFFER_OVERRUNFACTOR 3       // frames are dropped above this many times the target fill
+#define JITTERBUFFER_DRIFTTIME 30.0        // seconds for the drift estimate to integrate a full scale fill error
+
+/**
+ * Keep the samples queued between the main loop and the device near a latency target.
+ *
+ * The sender and the device clocks differ slightly so without control the queue slowly grows
+ * (latency drifts up) or empties (underruns). The main loop gives each frame to process() before
+ * pushing it to the device queue. The queue fill is averaged over the last frames and samples are
+ * inserted or deleted in the frame in proportion to the distance to the target plus a drift estimate
+ * integrating that distance over time so that the fill settles on the target whatever the drift.
+ * The correction is limited to JITTERBUFFER_MAXCORRECTION. This is well above the usual clock drift
+ * (tens of ppm) and fine enough not to be noticed on the signal. An inserted sample is the mean of its neighbours and a
+ * deleted one is merged with the next.
+ *
+ * Large departures are handled coarsely:
+ * - overrun: above JITTERBUFFER_OVERRUNFACTOR times the target a frame is dropped.
+ * - underrun: when the device finds the queue empty it calls underrun() and sends idle samples
+ *   until the queue is back to the target (see isPlaying()).
+ */
+class JitterBuffer
+{
+public:
+    JitterBuffer();
+
+    /** Set the latency target in milliseconds. 0 disables the control. */
+    void setLatency(unsigned int latencyMs) { m_latencyMs = latencyMs; }
+    unsigned int getLatency() const { return m_latencyMs; }
+
+    /**
+     * Adjust a frame about to be pushed to the device queue. queuedSamples is the current fill of the queue
+     * and sampleRate the device sample rate. Returns false if the frame should be dropped (overrun).
+     */
+    bool process(IQSampleVector& samples, std::size_t queuedSamples, uint32_t sampleRate);
+
+    /**
+     * Device side: return true if samples may be taken from the queue. After an underrun (and at start)
+     * this is only true once the queue holds the target fill.
+     */
+    bool isPlaying(std::size_t queuedSamples);
+
+    /** Device side: the queue was found empty */
+    void underrun();
+
+    /** Append ":<measured latency ms>:<underruns>:<overruns>" to the status message */
+    void getStatusMessage(char *messageBuffer);
+
+    double getMeasuredLatency() const { return m_latency; } //!< average latency in milliseconds
+    uint32_t getNbUnderruns() const { return m_nbUnderruns; }
+    uint32_t getNbOverruns() const { return m_nbOverruns; }
+
+private:
+    unsigned int m_latencyMs;
+    std::atomic<std::size_t> m_targetSamples; //!< target fill in samples at the current sample rate
+    std::atomic<double> m_latency;            //!< measured latency in milliseconds (average)
+    std::atomic_bool m_priming;               //!< waiting for the queue to reach the target
+    std::atomic<uint32_t> m_nbUnderruns;
+    std::atomic<uint32_t> m_nbOverruns;
+    double m_avgFill;                         //!< average fill in samples (only used by process())
+    double m_phase;                           //!< fraction of a sample to delete (>0) or insert (<0) carried over frames
+    double m_drift;                           //!< estimated clock drift: samples to delete (>0) or insert (<0) per sample
+    bool m_avgInit;
+
+    static void deleteSamples(IQSampleVector& samples, int nbSamples);
+    static void insertSamples(IQSampleVector& samples, int nbSamples);
+};
+
+#endif /* INCLUDE_JITTERBUFFER_H_ */
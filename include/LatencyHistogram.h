@@ -0,0 +1,117 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_LATENCYHISTOGRAM_H_
+#define INCLUDE_LATENCYHISTOGRAM_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+
+#define LATENCYHISTOGRAM_NBOCTAVES 26 // 1 microsecond to 67 seconds
+#define LATENCYHISTOGRAM_NBBUCKETS (2*LATENCYHISTOGRAM_NBOCTAVES + 2)
+
+/**
+ * Histogram of delays between two points of the pipeline with logarithmic buckets (HDR style).
+ *
+ * Each octave of microseconds [2^k, 2^(k+1)) is split in two buckets at 1.5 * 2^k so that the
+ * relative error is below 50% from 1 microsecond to about a minute with a fixed small array.
+ * Recording is a bucket lookup with a count leading zeros and three relaxed stores: there must
+ * be a single recording thread (each point of the pipeline is run by one thread). Readers
+ * (the metrics thread) may see a bucket a little ahead of the count, which does not matter.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() : m_count(0), m_sumNs(0)
+    {
+        for (int i = 0; i < LATENCYHISTOGRAM_NBBUCKETS; i++) {
+            m_buckets[i] = 0;
+        }
+    }
+
+    /** Monotonic time in nanoseconds used for all time stamps of the pipeline. Never 0. */
+    static int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count() | 1;
+    }
+
+    /** Single recording thread only */
+    void record(int64_t delayNs)
+    {
+        if (delayNs < 0) {
+            delayNs = 0;
+        }
+
+        int i = bucket(delayNs / 1000);
+        m_buckets[i].store(m_buckets[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        m_sumNs.store(m_sumNs.load(std::memory_order_relaxed) + delayNs, std::memory_order_relaxed);
+        m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /** Delay from sinceNs (a now() time stamp) to now. Nothing is recorded for a null time stamp. */
+    void recordSince(int64_t sinceNs)
+    {
+        if (sinceNs != 0) {
+            record(now() - sinceNs);
+        }
+    }
+
+    static int getNbBuckets() { return LATENCYHISTOGRAM_NBBUCKETS; }
+
+    /** Upper bound of a bucket in microseconds. The last bucket has no upper bound (returns 0). */
+    static double getUpperBound(int i)
+    {
+        if (i == 0) {
+            return 1.0;
+        } else if (i == LATENCYHISTOGRAM_NBBUCKETS - 1) {
+            return 0.0;
+        }
+
+        int k = (i - 1) / 2;
+        return ((i - 1) % 2 == 0) ? 1.5 * (1ULL << k) : (double) (2ULL << k);
+    }
+
+    uint64_t getBucket(int i) const { return m_buckets[i].load(std::memory_order_relaxed); }
+    uint64_t getCount() const { return m_count.load(std::memory_order_relaxed); }
+    double getSum() const { return m_sumNs.load(std::memory_order_relaxed) * 1e-9; } //!< in seconds
+
+private:
+    static int bucket(uint64_t us)
+    {
+        if (us == 0) {
+            return 0;
+        }
+
+        int k = 63 - __builtin_clzll(us);
+
+        if (k >= LATENCYHISTOGRAM_NBOCTAVES) {
+            return LATENCYHISTOGRAM_NBBUCKETS - 1;
+        }
+
+        int upperHalf = (k > 0) && ((us >> (k - 1)) & 1); // at or above 1.5 * 2^k
+        return 1 + 2*k + upperHalf;
+    }
+
+    std::atomic<uint64_t> m_buckets[LATENCYHISTOGRAM_NBBUCKETS];
+    std::atomic<uint64_t> m_count;
+    std::atomic<int64_t> m_sumNs;
+};
+
+#endif /* INCLUDE_LATENCYHISTOGRAM_H_ */
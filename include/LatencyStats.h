@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_LATENCYSTATS_H_
+#define INCLUDE_LATENCYSTATS_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <cmath>
+
+/**
+ * One-way latency and inter-arrival jitter of the frames of a stream.
+ *
+ * The latency of a frame is its arrival time (kernel or card timestamp of the datagram carrying its meta data)
+ * minus the time the sender started the frame (time stamp of the meta data). It is only meaningful if
+ * both clocks are synchronized (NTP or PTP). The jitter is the RFC 3550 estimator: a running average
+ * over 16 frames of the variation of the latency from one frame to the next. It does not depend on
+ * the clock offset between the hosts.
+ */
+class LatencyStats
+{
+public:
+    LatencyStats() { reset(); }
+
+    void reset()
+    {
+        m_nbFrames = 0;
+        m_latency = 0.0;
+        m_avgLatency = 0.0;
+        m_maxLatency = 0.0;
+        m_jitter = 0.0;
+    }
+
+    /** A frame was sent at sentSec, sentUsec (sender clock) and arrived at arrival (local clock) */
+    void update(uint32_t sentSec, uint32_t sentUsec, const timespec& arrival)
+    {
+        double latency = (arrival.tv_sec - (double) sentSec) * 1000.0 + (arrival.tv_nsec / 1.0e6) - (sentUsec / 1.0e3); // ms
+
+        if (m_nbFrames > 0)
+        {
+            m_jitter += (std::fabs(latency - m_latency) - m_jitter) / 16.0;
+            m_avgLatency += (latency - m_avgLatency) / 16.0;
+        }
+        else
+        {
+            m_avgLatency = latency;
+        }
+
+        if ((m_nbFrames == 0) || (latency > m_maxLatency)) {
+            m_maxLatency = latency;
+        }
+
+        m_latency = latency;
+        m_nbFrames++;
+    }
+
+    uint64_t getNbFrames() const { return m_nbFrames; }
+    double getLatency() const { return m_latency; }       //!< latency of the last frame in milliseconds
+    double getAvgLatency() const { return m_avgLatency; } //!< running average latency in milliseconds
+    double getJitter() const { return m_jitter; }         //!< inter-arrival jitter in milliseconds
+
+    /** Largest latency in milliseconds since the last call */
+    double getMaxLatency()
+    {
+        double maxLatency = m_maxLatency;
+        m_maxLatency = m_latency;
+        return maxLatency;
+    }
+
+private:
+    uint64_t m_nbFrames;
+    double m_latency;
+    double m_avgLatency;
+    double m_maxLatency;
+    double m_jitter;
+};
+
+#endif /* INCLUDE_LATENCYSTATS_H_ */
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_METRICS_H_
+#define INCLUDE_METRICS_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LatencyHistogram;
+
+/**
+ * Runtime counters of the pipeline in the Prometheus text format.
+ *
+ * The components keep their own counters and the program registers a getter for each of them
+ * under a metric name and a set of labels (ex: stage="device"). Nothing is computed in the data
+ * path: the getters are only called when the text is formatted. The CPU time of every thread of
+ * the process is added from /proc so that a saturated stage shows as a thread near one second per second.
+ *
+ * The text is published every period on a nanomsg PUB socket and/or served to HTTP GET requests
+ * (any path) so that Prometheus can scrape the daemon directly. Both run from one thread.
+ */
+class Metrics
+{
+public:
+    typedef std::function<double()> Getter;
+
+    Metrics();
+    ~Metrics();
+
+    /** Monotonic value. labels is a comma separated list of name="value" or empty. */
+    void addCounter(const std::string& name, const std::string& labels, const std::string& help, Getter getter);
+
+    /** Instantaneous value */
+    void addGauge(const std::string& name, const std::string& labels, const std::string& help, Getter getter);
+
+    /** Delays in seconds. The histogram must outlive the publication (see stop()). */
+    void addHistogram(const std::string& name, const std::string& labels, const std::string& help, const LatencyHistogram& histogram);
+
+    /** Publish on a nanomsg PUB socket bound to this TCP port on all interfaces. Call before start(). */
+    bool setPublishPort(unsigned int port);
+
+    /** Serve the text to HTTP requests on this TCP port. Call before start(). */
+    bool setHttpPort(unsigned int port);
+
+    /** Start publishing every periodMs milliseconds and serving. Does nothing if no port is set. */
+    void start(unsigned int periodMs = 1000);
+
+    /** Stop before the objects the getters refer to are destroyed */
+    void stop();
+
+    /** Format all the metrics */
+    void format(std::string& text);
+
+    /** Return the last error, or return an empty string if there is no error. */
+    std::string error()
+    {
+        std::string ret(m_error);
+        m_error.clear();
+        return ret;
+    }
+
+private:
+    struct Sample
+    {
+        std::string m_labels;
+        Getter m_getter;
+        const LatencyHistogram *m_histogram; //!< histogram instead of the getter
+    };
+
+    struct Family
+    {
+        std::string m_name;
+        std::string m_help;
+        std::string m_type;
+        std::vector<Sample> m_samples;
+    };
+
+    static const int m_maxWaitMs = 500; //!< longest wait without checking the stop request
+
+    void add(const std::string& name, const std::string& type, const std::string& labels, const std::string& help, Getter getter,
+            const LatencyHistogram *histogram = 0);
+    void formatHistogram(std::ostringstream& os, const std::string& name, const Sample& sample);
+    void formatThreads(std::ostringstream& os);
+    void publish();
+    void serve();
+    void run();
+
+    std::vector<Family> m_families;
+    std::mutex m_mutex;               //!< protects m_families
+    int m_nnPublisher;                //!< nanomsg PUB socket or -1
+    int m_httpSocket;                 //!< listening TCP socket or -1
+    unsigned int m_periodMs;
+    std::atomic_bool m_running;
+    std::thread *m_thread;
+    std::string m_error;
+};
+
+#endif /* INCLUDE_METRICS_H_ */
@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_MULTISTREAMRECEIVER_H_
+#define INCLUDE_MULTISTREAMRECEIVER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+
+#include "SDRdaemonFECBuffer.h"
+
+#define MULTISTREAMRECEIVER_RXBATCH 64     // largest number of UDP blocks received in one system call
+#define MULTISTREAMRECEIVER_RXTIMEOUT 100  // poll timeout in milliseconds so that the workers can be stopped
+#define MULTISTREAMRECEIVER_NBSTREAMSMAX 256 // streams beyond are ignored so that stray senders cannot exhaust memory
+#define MULTISTREAMRECEIVER_RCVBUF (4<<20)  // socket receive buffer: a socket takes the frame bursts of several streams (capped by net.core.rmem_max)
+
+class UDPSocket;
+
+namespace std
+{
+    class thread;
+}
+
+/**
+ * Receive many FEC protected streams (as sent by UDPSinkFEC) in one process.
+ *
+ * A stream is either a UDP port or, when demultiplexing by source, a source address and port sending
+ * to one of the ports. Each stream has its own SDRdaemonFECBuffer and the decoded frames are handed to
+ * a FrameHandler. The UDP blocks are received in batches (recvmmsg) by a few worker threads:
+ *
+ * - by port: each port has one socket and the ports are spread over the workers.
+ * - by source: each port has one socket per worker bound with SO_REUSEPORT. The kernel hashes the
+ *   source address and port to choose the socket so that all the blocks of a stream reach the same worker.
+ *
+ * A stream is thus only ever decoded by one worker and no lock is taken per block. The streams are
+ * created when their first block arrives.
+ */
+class MultiStreamReceiver
+{
+public:
+    struct StreamId
+    {
+        unsigned short m_port;  //!< local port the stream is sent to
+        sockaddr_in    m_source; //!< source address and port of the stream (family 0 when demultiplexing by port)
+    };
+
+    class FrameHandler
+    {
+    public:
+        virtual ~FrameHandler() {}
+
+        /**
+         * Called by a worker thread for each decoded frame. data is only valid during the call.
+         * Calls for one stream are never concurrent, calls for different streams may be.
+         * The buffer gives the meta data and statistics of the frame (getOutputMeta(), getCurNbBlocks()...).
+         */
+        virtual void frame(int streamIndex, const StreamId& streamId, const SDRdaemonFECBuffer& buffer,
+                const uint8_t *data, std::size_t dataLength) = 0;
+    };
+
+    /** Receive the streams sent to the given local address (0.0.0.0 for any) */
+    MultiStreamReceiver(const std::string& address, FrameHandler& frameHandler);
+    ~MultiStreamReceiver();
+
+    /** Add a port to receive from. Call before start(). */
+    void addPort(unsigned short port) { m_ports.push_back(port); }
+
+    /** Tell streams on the same port apart by their source address and port. Call before start(). */
+    void setDemuxBySource(bool demuxBySource) { m_demuxBySource = demuxBySource; }
+
+    /** Reorder window of the FEC decoders of the streams (see SDRdaemonFECBuffer). Call before start(). */
+    void setReorderWindow(int nbFrames) { m_reorderWindow = nbFrames; }
+
+    /** Open the sockets and start nbWorkers receive threads. Returns false on error (see error()). */
+    bool start(int nbWorkers);
+
+    /** Stop the receive threads and close the sockets. The streams and their statistics are kept and go on after start(). */
+    void stop();
+
+    int getNbStreams();
+    bool getStreamId(int streamIndex, StreamId& streamId);
+    uint64_t getNbFrames(int streamIndex); //!< number of frames decoded so far on the stream
+
+    /** True if no error occurred */
+    operator bool() const { return m_error.empty(); }
+
+    /** Return the last error, or return an empty string if there is no error */
+    std::string error()
+    {
+        std::string ret(m_error);
+        m_error.clear();
+        return ret;
+    }
+
+private:
+    struct Stream
+    {
+        StreamId m_id;
+        int m_index;
+        SDRdaemonFECBuffer m_buffer;
+        std::atomic<uint64_t> m_nbFrames;
+    };
+
+    struct Worker
+    {
+        MultiStreamReceiver *m_receiver;
+        std::vector<UDPSocket*> m_sockets;
+        std::vector<unsigned short> m_ports;     //!< port of each socket
+        std::map<uint64_t, Stream*> m_streams;   //!< streams received by this worker by demultiplexing key
+        std::vector<uint8_t> m_rxBlocks;         //!< UDP blocks of the last batch received
+        std::vector<int> m_rxLengths;
+        std::vector<sockaddr_in> m_rxAddrs;
+        std::thread *m_thread;
+    };
+
+    std::string m_address;
+    FrameHandler& m_frameHandler;
+    std::vector<unsigned short> m_ports;
+    bool m_demuxBySource;
+    int m_reorderWindow;
+    std::vector<Worker*> m_workers;
+    std::vector<Stream*> m_streams; //!< all streams by index. Owned here, shared with the worker receiving them
+    std::map<uint64_t, Stream*> m_streamKeys; //!< all streams by demultiplexing key: the streams of a receiver started again
+    std::mutex m_streamsMutex;      //!< protects m_streams and m_streamKeys. Only taken when a stream is created or looked up by index
+    std::atomic_bool m_running;
+    std::string m_error;
+
+    Stream *getStream(Worker *worker, unsigned short port, const sockaddr_in& source);
+    void receiveBatch(Worker *worker, int socketIndex);
+    static void run(Worker *worker);
+};
+
+#endif /* INCLUDE_MULTISTREAMRECEIVER_H_ */
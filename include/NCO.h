@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_NCO_H_
+#define INCLUDE_NCO_H_
+
+#include <stdint.h>
+
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+
+#define NCO_TABLE_BITS 12  //!< log2 of the number of phases of the sine table: spurs below -72 dBc
+#define NCO_BLOCK_SIZE 256 //!< samples whose phasors are looked up at once
+
+/**
+ * Fixed point numerically controlled oscillator mixer moving a frequency offset of the device band to DC.
+ *
+ * The phase is a 32 bit accumulator (sub Hz resolution up to 4 GS/s) indexing a Q15 cos/sin table. For a
+ * block of samples the phasors are first looked up into a small buffer that stays in L1, then the complex
+ * multiply is done with 16x16 bit multiply-adds: 4 samples per SSE2 or NEON instruction, 8 with AVX2.
+ * The phase is carried over between calls so that blocks are seamless.
+ */
+class NCO
+{
+public:
+    NCO();
+
+    /** Bring the signal at offset Hz from the center of a band sampled at sampleRate to DC. 0 stops mixing. */
+    void setFrequency(int64_t offset, uint32_t sampleRate);
+
+    bool active() const { return m_step != 0; }
+
+    /**
+     * Mix n samples into interleaved I/Q int32 (input of the first half band stage). The output is
+     * multiplied by 2^gain so that small samples keep their precision through the rotation.
+     */
+    void mix(const IQSample *in, int32_t *out, unsigned int n, unsigned int gain = 0);
+
+    /** Mix n samples in place, saturating to 16 bits */
+    void mix(IQSample *inout, unsigned int n);
+
+    /** Same as the interleaved mix with gain but into the planar i and q arrays of the planar block cascade */
+    void mixPlanar(const IQSample *in, int32_t *i, int32_t *q, unsigned int n, unsigned int gain = 0);
+
+private:
+    void lookup(unsigned int n);
+    void mixBlock(const IQSample *in, int32_t *out, unsigned int n, unsigned int gain);
+    void mixBlockPlanar(const IQSample *in, int32_t *i, int32_t *q, unsigned int n, unsigned int gain);
+#if defined(SIMD_X86_DISPATCH)
+    unsigned int mixBlockAVX2(const IQSample *in, int32_t *out, unsigned int n, unsigned int gain);
+    unsigned int mixBlockPlanarAVX2(const IQSample *in, int32_t *i, int32_t *q, unsigned int n, unsigned int gain);
+#endif
+
+    int64_t  m_offset;
+    uint32_t m_sampleRate;
+    uint32_t m_phase;
+    uint32_t m_step;     //!< phase increment per sample (0: inactive)
+    int16_t  m_re[2*NCO_BLOCK_SIZE];  //!< per sample (cos, sin) giving the real part by multiply-add with (x, y)
+    int16_t  m_im[2*NCO_BLOCK_SIZE];  //!< per sample (-sin, cos) giving the imaginary part
+    int32_t  m_buf[2*NCO_BLOCK_SIZE]; //!< 32 bit output of the in place mix
+
+    static const int16_t *table();    //!< (cos, sin) of the 2^NCO_TABLE_BITS phases
+};
+
+#endif /* INCLUDE_NCO_H_ */
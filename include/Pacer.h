@@ -0,0 +1,75 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _INCLUDE_PACER_H_
+#define _INCLUDE_PACER_H_
+
+#include <chrono>
+#include <thread>
+
+/**
+ * Spreads packets evenly in time on a monotonic clock.
+ *
+ * Each packet is given a send deadline one interval after the previous one. The caller sleeps
+ * only until that absolute deadline so a late wake up (the kernel rounds short sleeps to tens of
+ * microseconds) is absorbed by the next packets being sent without wait instead of accumulating
+ * like with a fixed usleep after each packet. The average rate is therefore exact. When the
+ * sender falls behind by more than the catch up limit the schedule restarts from now so that
+ * a stall is not followed by a long burst.
+ */
+class Pacer
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    Pacer() :
+        m_started(false),
+        m_maxLagUs(0)
+    { }
+
+    /** Lag in microseconds beyond which the schedule is reset instead of catching up */
+    void setMaxLag(double maxLagUs) { m_maxLagUs = maxLagUs; }
+
+    /** Forget the schedule: next packet is sent at once */
+    void reset() { m_started = false; }
+
+    /** Wait for the deadline of the next packet(s) then advance the deadline by intervalUs */
+    void pace(double intervalUs)
+    {
+        clock::time_point now = clock::now();
+
+        if (!m_started || (now - m_next > std::chrono::microseconds((long long) m_maxLagUs)))
+        {
+            m_next = now;
+            m_started = true;
+        }
+        else if (m_next > now)
+        {
+            std::this_thread::sleep_until(m_next);
+        }
+
+        m_next += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::micro>(intervalUs));
+    }
+
+private:
+    bool m_started;
+    double m_maxLagUs;
+    clock::time_point m_next; //!< deadline of the next packet
+};
+
+#endif
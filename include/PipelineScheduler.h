@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_PIPELINESCHEDULER_H_
+#define INCLUDE_PIPELINESCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class RxPipeline;
+
+/**
+ * DSP worker threads of the multi-device mode of sdrdaemonrx. Each worker takes in turn the devices with
+ * a block waiting and processes one block of each. A device is processed by one worker at a time so that
+ * its blocks stay in order. Idle workers sleep until a device pushes a block.
+ */
+class PipelineScheduler
+{
+public:
+    /** stopFlag is set on SIGINT / SIGTERM: the workers return */
+    PipelineScheduler(const std::vector<RxPipeline*>& pipelines, const std::atomic_bool *stopFlag);
+
+    /** Called by the devices after each block pushed */
+    void notify();
+
+    /** Worker loop until stopped or all the device streams ended. first spreads the workers on the devices. */
+    void run(unsigned int first);
+
+private:
+    void notifyAll();
+
+    std::vector<RxPipeline*> m_pipelines;
+    const std::atomic_bool *m_stopFlag;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    uint64_t m_generation;              //!< incremented at each push of any device (protected by m_mutex)
+    std::atomic<std::size_t> m_nbFinished;
+};
+
+#endif /* INCLUDE_PIPELINESCHEDULER_H_ */
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_RATIONALRESAMPLER_H_
+#define INCLUDE_RATIONALRESAMPLER_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "SDRDaemon.h"
+#include "SIMDDispatch.h"
+
+#define RATIONALRESAMPLER_MAXPHASES 1024 //!< largest interpolation factor L once the ratio is reduced
+#define RATIONALRESAMPLER_TAPS      32   //!< taps per phase when the rate is not reduced by more than 2
+
+/**
+ * Polyphase resampler by an arbitrary rational factor L/M for I/Q samples in 16 bit fixed point.
+ *
+ * It complements the power of two decimators and interpolators to reach any output rate.
+ * The prototype low pass is a Kaiser windowed sinc cut at the Nyquist frequency of the lower of the
+ * two rates. Each of the L phases is normalized to unity gain and quantized on Q14. The taps per
+ * phase grow with the decimation so that the filter spans the same number of output samples.
+ * The history is kept in separate I and Q arrays so that each output is two int16 dot products
+ * (SSE2, AVX2 or NEON multiply-add with 32 bit accumulation).
+ */
+class RationalResampler
+{
+public:
+    RationalResampler();
+
+    /** Set input and output rates in Hz. Returns false if the reduced ratio has too many phases. */
+    bool setRates(uint32_t inRate, uint32_t outRate);
+
+    /** True when the rates differ: nothing to do otherwise */
+    bool active() const { return m_L != m_M; }
+
+    uint32_t getInputRate() const { return m_inRate; }
+    uint32_t getOutputRate() const { return m_outRate; }
+    unsigned int getInterpolation() const { return m_L; }
+    unsigned int getDecimation() const { return m_M; }
+    unsigned int getTaps() const { return m_taps; }
+
+    /** Resample a block. The output gets about in.size() * L / M samples depending on the phase carried over. */
+    void process(const IQSampleVector& in, IQSampleVector& out);
+
+private:
+    void design();
+    unsigned int processScalar(IQSample *out, unsigned int n);
+#if defined(SIMD_X86_DISPATCH)
+    unsigned int processSSE2(IQSample *out, unsigned int n);
+    unsigned int processAVX2(IQSample *out, unsigned int n);
+#elif defined(USE_NEON)
+    unsigned int processNEON(IQSample *out, unsigned int n);
+#endif
+
+    uint32_t m_inRate;
+    uint32_t m_outRate;
+    unsigned int m_L;           //!< interpolation factor
+    unsigned int m_M;           //!< decimation factor
+    unsigned int m_taps;        //!< taps per phase, multiple of 16
+    unsigned int m_phase;       //!< phase (0..L-1) of the next output
+    unsigned int m_index;       //!< newest input sample of the next output relative to the block start
+    std::vector<int16_t> m_coeffs; //!< L phases of m_taps coefficients, time reversed
+    std::vector<int16_t> m_i;      //!< m_taps-1 history samples followed by the block (in phase)
+    std::vector<int16_t> m_q;      //!< same for quadrature
+};
+
+#endif /* INCLUDE_RATIONALRESAMPLER_H_ */
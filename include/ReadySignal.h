@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_READYSIGNAL_H_
+#define INCLUDE_READYSIGNAL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Start and stop handshake between a device start() and its streaming thread. The thread reports
+ * when the stream is running (or failed to start) so that start() returns as soon as the device is
+ * ready instead of after a fixed sleep. The thread's supervision loop waits on the same signal so
+ * that stop() ends it at once rather than at its next periodic check.
+ */
+class ReadySignal
+{
+public:
+    enum State
+    {
+        Pending,
+        Ready,
+        Failed
+    };
+
+    ReadySignal() : m_state(Pending), m_woken(false) {}
+
+    /** Back to pending before a new start */
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_state = Pending;
+        m_woken = false;
+    }
+
+    /** From the streaming thread: the stream is running (ok) or could not be started */
+    void notify(bool ok)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_state = ok ? Ready : Failed;
+        }
+
+        m_cond.notify_all();
+    }
+
+    /** Wait at most timeoutMs milliseconds for the streaming thread. Pending on timeout. */
+    State wait(unsigned int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]() { return m_state != Pending; });
+        return m_state;
+    }
+
+    /**
+     * From the streaming thread: wait periodMs milliseconds or until wake() is called.
+     * Returns true when the thread should stop.
+     */
+    bool waitStop(std::atomic_bool *stop_flag, unsigned int periodMs)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait_for(lock, std::chrono::milliseconds(periodMs), [this, stop_flag]() { return m_woken || stop_flag->load(); });
+        return m_woken || stop_flag->load();
+    }
+
+    /** From stop(): end the wait of the streaming thread (the stop flag is already set) */
+    void wake()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_woken = true;
+        }
+
+        m_cond.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    State m_state;
+    bool m_woken;
+};
+
+#endif /* INCLUDE_READYSIGNAL_H_ */
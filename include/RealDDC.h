@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_REALDDC_H_
+#define INCLUDE_REALDDC_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+
+#define REALDDC_DELAY    8 //!< delay of Q in samples to match the center of the I filter
+#define REALDDC_HISTORY 15 //!< even samples kept from one block to the next for the I filter
+#define REALDDC_DCSHIFT  4 //!< time constant of the DC estimate: 2^4 blocks
+
+/**
+ * Real to IQ conversion of the raw real samples of the Airspy at twice the IQ sample rate.
+ *
+ * The input vector holds pairs of successive real samples x[2m], x[2m+1] centered on 0 in the I and Q of
+ * each IQSample and is converted in place to IQ samples at the pair rate. The real stream is shifted by
+ * -fs/4 with the sign pattern -, -, +, + so that I is the even samples and Q the odd samples, then decimated
+ * by two with the 32 taps half band filter of the decimators (HBFIRFilterTraits<32>). Only the center tap is
+ * non zero on the odd samples so Q is just delayed to the center of the filter and I is filtered with the
+ * 8 symmetrical taps pairs in 16 bit fixed point: 8 samples per SSE2 or NEON instruction, 16 with AVX2.
+ * The DC of the ADC is removed before the shift. The samples keep their 12 bits.
+ */
+class RealDDC
+{
+public:
+    RealDDC();
+
+    /** Start again (new stream) */
+    void reset();
+
+    /** Convert in place a block of pairs of real samples to IQ samples */
+    void process(IQSampleVector& samples);
+
+private:
+    /** I samples of n pairs from the even samples with REALDDC_HISTORY samples before */
+    static void filter(const int16_t *even, int16_t *i, unsigned int n);
+#if defined(SIMD_X86_DISPATCH)
+    static unsigned int filterAVX2(const int16_t *even, int16_t *i, unsigned int n);
+#endif
+
+    std::vector<int16_t> m_even;  //!< I after the shift with REALDDC_HISTORY samples of history
+    std::vector<int16_t> m_odd;   //!< Q after the shift with REALDDC_DELAY samples of history
+    std::vector<int16_t> m_i;     //!< filtered I
+    unsigned int         m_phase; //!< parity of the next pair in the shift sign pattern
+    int32_t              m_dc;    //!< DC estimate with 8 fraction bits
+    bool                 m_primed; //!< DC estimate taken from a first block
+};
+
+#endif /* INCLUDE_REALDDC_H_ */
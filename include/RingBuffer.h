@@ -0,0 +1,231 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _INCLUDE_RINGBUFFER_H_
+#define _INCLUDE_RINGBUFFER_H_
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "DataBuffer.h"
+
+/**
+ * Bounded lock-free single producer / single consumer buffer to move sample data between threads.
+ *
+ * Drop-in replacement of DataBuffer when exactly one thread pushes (typically the device
+ * callback) and exactly one thread pulls. The producer never takes a lock unless the consumer
+ * is actually sleeping. The consumer spins then yields then sleeps on the condition variable.
+ * When the ring is full the pushed vector is dropped and counted. Only the producer may
+ * touch the slots so the DropOldest policy is not available and DropNewest is always applied.
+ */
+template <class Element>
+class RingBuffer : public DataBuffer<Element>
+{
+public:
+    /** Constructor. Capacity in number of vectors is rounded up to a power of two. */
+    RingBuffer(std::size_t capacity = 256)
+        : m_size(2)
+        , m_head(0)
+        , m_tail(0)
+        , m_rqlen(0)
+        , m_rend_marked(false)
+        , m_waiting(false)
+        , m_rcapacity(0)
+    {
+        while (m_size < capacity) {
+            m_size <<= 1;
+        }
+
+        m_mask = m_size - 1;
+        m_slots.resize(m_size);
+        m_stampSlots.resize(m_size);
+    }
+
+    virtual ~RingBuffer()
+    { }
+
+    /** Limit the number of queued samples. 0 is only limited by the number of slots. Drop policy is ignored. */
+    virtual void set_capacity(std::size_t capacity, typename DataBuffer<Element>::DropPolicy dropPolicy __attribute__((unused)))
+    {
+        m_rcapacity = capacity;
+    }
+
+    using DataBuffer<Element>::push;
+
+    /** Add samples to the ring. Samples are dropped if the ring is full. */
+    virtual void push(AlignedVector<Element>&& samples, int64_t stamp)
+    {
+        if (samples.empty()) {
+            return;
+        }
+
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        this->m_pushedSamples.fetch_add(samples.size(), std::memory_order_relaxed);
+
+        if ((tail - m_head.load(std::memory_order_acquire) == m_size)
+         || (m_rcapacity && (m_rqlen.load(std::memory_order_relaxed) + samples.size() > m_rcapacity)))
+        {
+            this->drop(samples);
+            return;
+        }
+
+        std::size_t n = samples.size();
+        m_slots[tail & m_mask] = std::move(samples);
+        m_stampSlots[tail & m_mask] = stamp;
+        std::size_t qlen = m_rqlen.fetch_add(n, std::memory_order_relaxed) + n;
+        SDMN_TRACE2(buffer_push, n, qlen);
+
+        if (qlen > this->m_maxQlen.load(std::memory_order_relaxed)) { // only the producer writes it
+            this->m_maxQlen.store(qlen, std::memory_order_relaxed);
+        }
+
+        m_tail.store(tail + 1, std::memory_order_seq_cst);
+        wake_consumer();
+        this->notify_consumer();
+    }
+
+    /** Mark the end of the data stream. */
+    virtual void push_end()
+    {
+        m_rend_marked.store(true, std::memory_order_seq_cst);
+        wake_consumer();
+        this->notify_consumer();
+    }
+
+    /** Return number of samples in ring. */
+    virtual std::size_t queued_samples()
+    {
+        return m_rqlen.load(std::memory_order_relaxed);
+    }
+
+    /** Return number of vectors in ring. */
+    virtual std::size_t queued_vectors()
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    /** Same as DataBuffer::pull() */
+    virtual AlignedVector<Element> pull()
+    {
+        AlignedVector<Element> ret;
+        pull(ret);
+        return ret;
+    }
+
+    /** Same as DataBuffer::pull(ret). On end of stream ret is left untouched. */
+    virtual void pull(AlignedVector<Element>& ret)
+    {
+        wait_for([this]() { return !empty(); });
+
+        if (!empty())
+        {
+            std::size_t head = m_head.load(std::memory_order_relaxed);
+            ret = std::move(m_slots[head & m_mask]);
+            this->m_pulledStamp = m_stampSlots[head & m_mask];
+            std::size_t qlen = m_rqlen.fetch_sub(ret.size(), std::memory_order_relaxed) - ret.size();
+            this->m_pulledSamples.fetch_add(ret.size(), std::memory_order_relaxed);
+            m_head.store(head + 1, std::memory_order_release);
+            SDMN_TRACE2(buffer_pull, ret.size(), qlen);
+        }
+    }
+
+    /** Return true if the end has been reached at the Pull side. */
+    virtual bool pull_end_reached()
+    {
+        return empty() && m_rend_marked.load(std::memory_order_acquire);
+    }
+
+    /** Wait until the ring contains minfill samples or an end marker. */
+    virtual void wait_buffer_fill(std::size_t minfill)
+    {
+        wait_for([this, minfill]() { return m_rqlen.load() >= minfill; });
+    }
+
+    /** Test if the ring has enough samples */
+    virtual bool test_buffer_fill(std::size_t minfill)
+    {
+        return (m_rqlen.load(std::memory_order_relaxed) >= minfill) || m_rend_marked.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const unsigned int m_spinCount  = 1000; //!< busy wait iterations before yielding
+    static const unsigned int m_yieldCount = 50;   //!< yields before blocking on condition variable
+
+    bool empty()
+    {
+        return m_head.load(std::memory_order_relaxed) == m_tail.load();
+    }
+
+    /** Only touches the lock when the consumer has announced it is going to sleep */
+    void wake_consumer()
+    {
+        if (m_waiting.load(std::memory_order_seq_cst))
+        {
+            std::unique_lock<std::mutex> lock(m_rmutex);
+            m_rcond.notify_one();
+        }
+    }
+
+    /** Adaptive wait: spin, then yield, then block until predicate is true or end is marked. */
+    template <typename Pred>
+    void wait_for(Pred pred)
+    {
+        for (unsigned int i = 0; i < m_spinCount; i++)
+        {
+            if (pred() || m_rend_marked.load(std::memory_order_acquire)) {
+                return;
+            }
+        }
+
+        for (unsigned int i = 0; i < m_yieldCount; i++)
+        {
+            if (pred() || m_rend_marked.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(m_rmutex);
+        m_waiting.store(true, std::memory_order_seq_cst);
+
+        while (!pred() && !m_rend_marked.load(std::memory_order_seq_cst)) {
+            // the timeout only bounds a missed wake up, it is not the normal exit path
+            m_rcond.wait_for(lock, std::chrono::milliseconds(10));
+        }
+
+        m_waiting.store(false, std::memory_order_relaxed);
+    }
+
+    std::size_t                  m_size;
+    std::size_t                  m_mask;
+    std::vector<AlignedVector<Element> > m_slots;
+    std::vector<int64_t>         m_stampSlots; //!< time stamps of the vectors in m_slots
+    std::atomic<std::size_t>     m_head;    //!< next slot to read (consumer owned)
+    std::atomic<std::size_t>     m_tail;    //!< next slot to write (producer owned)
+    std::atomic<std::size_t>     m_rqlen;   //!< number of samples in ring
+    std::atomic_bool             m_rend_marked;
+    std::atomic_bool             m_waiting; //!< consumer is about to block
+    std::size_t                  m_rcapacity;
+    std::mutex                   m_rmutex;
+    std::condition_variable      m_rcond;
+};
+
+#endif
@@ -25,19 +25,21 @@
 #include <thread>
 
 #include "DeviceSource.h"
+#include "IQCorrector.h"
 
 class RtlSdrSource : public DeviceSource
 {
 public:
 
-    /** Open RTL-SDR device. */
-    RtlSdrSource(int dev_index);
+    /** Open RTL-SDR device by index or, if serial is not empty, by its USB serial string */
+    RtlSdrSource(int dev_index, const std::string& serial = std::string());
 
     /** Close RTL-SDR device. */
     virtual ~RtlSdrSource();
 
     /** Return sample size in bits */
-    virtual std::uint32_t get_sample_bits() { return 8; }
+    virtual std::uint32_t get_sample_bits() { return m_iqCorrector.getSampleBits(8); }
+    virtual bool can_normalize() { return true; }
 
     /** Return current sample frequency in Hz. */
     virtual std::uint32_t get_sample_rate();
@@ -65,6 +67,9 @@ private:
     /** Configure RTL-SDR tuner from a list of key=values */
     virtual bool configure(parsekv::pairs_type& m);
 
+    /** Retune from the reader thread for the frequency scan */
+    virtual bool retune(std::uint64_t frequency);
+
     /**
      * Configure RTL-SDR tuner and prepare for streaming.
      *
@@ -97,15 +102,15 @@ private:
      */
     static bool get_samples(IQSampleVector *samples);
     static void rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx);
-    static void run();
-    static void readerThreadEntryPoint();
+    static void run(RtlSdrSource *source);
+    static void readerThreadEntryPoint(RtlSdrSource *source);
 
     struct rtlsdr_dev * m_dev;
     std::vector<int>    m_gains;
     std::string         m_gainsStr;
     bool                m_confAgc;
     std::thread         *m_thread;
-    static RtlSdrSource *m_this;
+    IQCorrector         m_iqCorrector; //!< DC and IQ imbalance correction in the sample conversion
 };
 
 #endif
@@ -0,0 +1,253 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_RXPIPELINE_H_
+#define INCLUDE_RXPIPELINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Channelizer.h"
+#include "DataBuffer.h"
+#include "DeviceSource.h"
+#include "Downsampler.h"
+#include "LatencyHistogram.h"
+#include "Metrics.h"
+#include "RealDDC.h"
+#include "SharedRing.h"
+#include "SHMSink.h"
+#include "UDPSinkFEC.h"
+#include "VectorPool.h"
+
+class FECEncoderPool;
+
+#define RXOUTPUTBUF_SAMPLES (48 * 512) // default output buffer: samples queued before the frames are written
+#define RXINLINE_BUDGET   50 // percentage of the block duration the inline processing of a block may take
+#define RXINLINE_OVERRUNS 8  // consecutive blocks over budget before the processing goes back to the main loop
+#ifdef SDRDAEMON_SMALL_FOOTPRINT
+#define RXQUEUE_SECONDS 1    // default capacity of the input and output buffers in seconds of device samples
+#else
+#define RXQUEUE_SECONDS 10   // default capacity of the input and output buffers in seconds of device samples
+#endif
+
+/** Settings of the sinks and buffers common to all the devices (command line) */
+struct RxOptions
+{
+    RxOptions() :
+        outputbuf_samples(RXOUTPUTBUF_SAMPLES),
+        latency(false),
+        lockfree_buffers(false),
+        queue_capacity(-1),
+        drop_policy(DataBuffer<IQSample>::DropOldest),
+        pipeline(false),
+        inline_dsp(false),
+        udp_connect(false),
+        multicast_ttl(-1),
+        udp_gso(false),
+        udp_size(UDPSINKFEC_UDPSIZE),
+        wire_bits(16),
+        compression(false),
+        block_crc(false),
+        squelch_db(0.0),
+        squelch_ms(500),
+        tx_ring(UDPSINKFEC_NBTXBLOCKS),
+        fec_max(UDPSINKFEC_NBFECBLOCKS),
+        frame_max(UDPSINKFEC_NBORIGINALBLOCKS),
+        fec_encoders(1),
+        nb_channels(0),
+        channel_taps(CHANNELIZER_TAPS)
+    {
+        std::fill(stage_cpus, stage_cpus + 4, -1);
+    }
+
+    unsigned int outputbuf_samples;
+    bool latency;
+    bool lockfree_buffers;
+    int queue_capacity;
+    DataBuffer<IQSample>::DropPolicy drop_policy;
+    bool pipeline;
+    bool inline_dsp;
+    bool udp_connect;
+    int multicast_ttl;
+    bool udp_gso;
+    unsigned int udp_size;
+    unsigned int wire_bits;
+    bool compression;
+    bool block_crc;
+    double squelch_db;
+    int squelch_ms;
+    unsigned int tx_ring;
+    unsigned int fec_max;
+    unsigned int frame_max; // largest original blocks per frame: large frames above UDPSINKFEC_NBORIGINALBLOCKS
+    unsigned int fec_encoders;
+    int stage_cpus[4]; // decimation, frame assembly, FEC encoding, sending
+    unsigned int nb_channels;
+    unsigned int channel_taps;
+    std::vector<std::string> channel_specs;
+};
+
+/** A device and where its samples go: from the command line or from a line of the multi-device file */
+struct DeviceSpec
+{
+    DeviceSpec() :
+        devidx(0),
+        dataaddress("127.0.0.1"),
+        dataport(9090),
+        cfgport(9091),
+        metricsport(0),
+        httpport(0),
+        shmslots(SHAREDRING_NBSLOTS)
+    {}
+
+    std::string devtype;
+    int devidx;
+    std::string serial; //!< open directly by serial number when not empty
+    std::string config;
+    std::string dataaddress;
+    unsigned int dataport;
+    unsigned int cfgport;
+    unsigned int metricsport;
+    unsigned int httpport;
+    std::string shmname;    //!< shared memory ring for the local consumers when not empty
+    unsigned int shmslots;
+};
+
+/**
+ * Device, decimation and UDP outputs of one device of sdrdaemonrx. The blocks are processed by the thread
+ * calling processBlock: the main thread with a single device or any of the DSP workers in multi-device mode.
+ * Errors while opening are reported on stderr and open returns false: they are fatal as they are at startup.
+ */
+class RxPipeline
+{
+public:
+    /** stopFlag is set on SIGINT / SIGTERM: it stops the device, the output thread and waitInline */
+    RxPipeline(const RxOptions& options, const DeviceSpec& spec, std::atomic_bool *stopFlag);
+
+    /**
+     * Create the outputs, configure the device opened from the spec and start streaming. The pipeline owns
+     * srcsdr from here. notifier is called by the device at each block pushed when not empty (multi-device
+     * mode or inline mode). encoderPool gives the FEC encoding threads shared by the sinks of all the
+     * devices (0: their own).
+     */
+    bool open(DeviceSource *srcsdr, const std::function<void()>& notifier, FECEncoderPool *encoderPool);
+
+    /** A block is waiting or the device reached its end: processBlock does not wait */
+    bool ready();
+
+    /** Take the next device block (waits for it) and send it out. Returns false at the end of the device stream. */
+    bool processBlock();
+
+    /** Stop the device and the output thread */
+    void stop();
+
+    /** Take the pipeline for processing (multi-device mode). False if another worker has it or it is finished. */
+    bool claim();
+
+    void release() { m_busy.store(false, std::memory_order_release); }
+    void finish() { m_finished.store(true); }
+
+    /**
+     * Inline mode (single device): the blocks are processed by the device thread as they are pushed,
+     * open() being given processInline as notifier. Call before open().
+     */
+    void setInline() { m_inline.store(true); }
+
+    /**
+     * Notifier of the inline mode. Processes the blocks queued from the device callback as long as each
+     * takes less than RXINLINE_BUDGET percent of its duration. After RXINLINE_OVERRUNS blocks in a row
+     * over budget the processing goes back to the main loop for good.
+     */
+    void processInline();
+
+    /**
+     * Main thread of the inline mode: wait while the blocks are processed inline. Returns true if the
+     * device stream ended and false when the main loop has to take over (or on stop).
+     */
+    bool waitInline();
+
+private:
+    /** Where the main stream is written: the shared memory ring (that writes to UDP after it) or UDP */
+    UDPSink *mainWriter();
+
+    /** From the device thread: no more inline processing */
+    void endInline(bool ended);
+
+    /** Follow the settings changed through the configuration port */
+    void applySettings();
+
+    const RxOptions& m_options;
+    DeviceSpec m_spec;
+    std::atomic_bool *m_stopFlag;
+    DeviceSource *m_srcsdr;                  //!< owned by m_upSrcsdr
+    UDPSinkFEC *m_udpOutputInstance;         //!< owned by m_udpOutput
+    std::vector<std::unique_ptr<UDPSinkFEC> > m_channelSinks;
+    std::unique_ptr<UDPSink> m_udpOutput;
+    std::unique_ptr<SHMSink> m_shmOutput;    //!< writes to m_udpOutput after the ring (destroyed before it)
+    Channelizer m_channelizer;
+    std::vector<int> m_channelNumbers;
+    std::vector<UDPSink*> m_channelOutputs;
+    std::vector<int64_t> m_channelOffsets;   //!< Hz from the device frequency
+    std::vector<IQSampleVector> m_channelSamples;
+    std::vector<UDPSink*> m_fecOutputs;      //!< those following the fecblk configuration
+    std::vector<UDPSink*> m_outputs;
+    unsigned int m_nbFECBlocks;
+    unsigned int m_txDelay;
+    unsigned int m_txBatch;
+    unsigned int m_txPace;
+    unsigned int m_fecAuto;
+    bool m_nack;
+    bool m_overload;
+    unsigned int m_frameBlocks;
+    unsigned int m_frameTarget;
+    unsigned int m_interleave;
+    int m_fecCodec;
+    RealDDC m_ddc;
+    Downsampler m_dn;
+    double m_ifrate;
+    VectorPool<IQSample> m_samplesPool;
+    std::unique_ptr<DataBuffer<IQSample> > m_sourceBuffer;
+    std::unique_ptr<DataBuffer<IQSample> > m_outputBuffer;
+    std::unique_ptr<DeviceSource> m_upSrcsdr;
+    std::thread m_outputThread;
+    IQSampleVector m_outsamples;             //!< decimator output, reused from block to block unless handed to the output thread
+    uint64_t m_outputSamples;                //!< samples handed to the UDP output (scan retune marks)
+    unsigned int m_block;
+    bool m_inbufLengthWarning;
+    std::vector<UDPSink*> m_mainOutput;
+    std::vector<int64_t> m_mainOffset;
+    std::atomic_bool m_busy;                 //!< a DSP worker has the pipeline
+    std::atomic_bool m_finished;             //!< the device stream ended
+    std::atomic_bool m_inline;               //!< the device thread processes the blocks (inline mode)
+    bool m_inlineEnded;                      //!< the device stream ended while processed inline
+    unsigned int m_inlineOverruns;           //!< consecutive blocks processed inline over budget
+    std::mutex m_inlineMutex;
+    std::condition_variable m_inlineCond;
+    std::size_t m_blockSamples;              //!< size of the last block pulled
+    // Declared last so that it stops before the objects it reads are destroyed
+    std::atomic<uint64_t> m_decimatedSamples;
+    LatencyHistogram m_inputLatency, m_decimationLatency;
+    Metrics m_metrics;
+};
+
+#endif /* INCLUDE_RXPIPELINE_H_ */
@@ -22,6 +22,8 @@
 #include <cstdint>
 #include <vector>
 
+#include "AlignedAllocator.h"
+
 typedef std::int16_t FixReal;
 
 /*
@@ -67,7 +69,7 @@ struct IQSample
 };
 #pragma pack(pop)
 
-typedef std::vector<IQSample> IQSampleVector;
-typedef std::vector<FixReal> SampleVector;
+typedef AlignedVector<IQSample> IQSampleVector; // cache line aligned for the SIMD kernels
+typedef AlignedVector<FixReal> SampleVector;
 
 #endif
@@ -23,13 +23,33 @@
 #define GR_SDRDAEMONFEC_LIB_SDRDAEMONFECBUFFER_H_
 
 #include <stdint.h>
+#include <algorithm>
 #include <cstddef>
-#include "cm256.h"
+#include <cstring>
+#include <vector>
+#include <chrono>
+#include "FECCodec.h"
+#include "AlignedAllocator.h"
 #include "MovingAverage.h"
+#include "FECFeedback.h"
 
-#define SDRDAEMONFEC_UDPSIZE 512            // UDP payload size
-#define SDRDAEMONFEC_NBORIGINALBLOCKS 128   // number of sample blocks per frame excluding FEC blocks
-#define SDRDAEMONFEC_NBDECODERSLOTS 4       // power of two sub multiple of int16_t size. A too large one is superfluous.
+#define SDRDAEMONFEC_UDPSIZE 512            // default UDP payload size
+#define SDRDAEMONFEC_UDPSIZEMAX 8972        // largest UDP payload size (9000 bytes jumbo frames MTU)
+#define SDRDAEMONFEC_NBORIGINALBLOCKS 128   // largest number of sample blocks per frame excluding FEC blocks (as sent by older senders)
+#define SDRDAEMONFEC_NBDECODERSLOTS 16      // largest number of decoder slots. Power of two sub multiple of the uint16_t frame index range
+#define SDRDAEMONFEC_REORDERWINDOWMAX 8     // largest number of frames kept open for late (reordered) blocks. Half the decoder slots.
+#define SDRDAEMONFEC_DEADLINECREEP 1000     // microseconds the arrival time reference may move later per frame (clock drift)
+#define SDRDAEMONFEC_NACKRETRIES 2          // largest number of retransmission requests for a frame
+#define SDRDAEMONFEC_PACKED12 0x10          // sample bytes indicator: I/Q pairs of 12 bits packed in 3 bytes
+#define SDRDAEMONFEC_PACKED8 0x20           // sample bytes indicator: I/Q pairs of 8 bits in 2 bytes
+#define SDRDAEMONFEC_LZ4 0x40               // sample bytes indicator: the data blocks carry the LZ4 compressed samples
+#define SDRDAEMONFEC_LZ4RATIO 4             // largest size of the decompressed data in number of frame data sizes
+#define SDRDAEMONFEC_SQUELCH 0x80           // sample bytes indicator: keep-alive frame of the meta data block only standing for silent samples
+#define SDRDAEMONFEC_BLOCKCRC 0x01          // header filler indicator: the superblock ends with the CRC32C of the rest (meta data CRC is then CRC32C)
+#define SDRDAEMONFEC_BLOCKSSHIFT 1          // header filler bits 1 to 7: SDRDAEMONFEC_NBORIGINALBLOCKS minus the original blocks of the frame
+#define SDRDAEMONFEC_LARGEFRAME 127         // header filler bits 1 to 7 of large frames: the superblock ends with a LargeTrailer
+#define SDRDAEMONFEC_NBORIGINALBLOCKSLARGE 1024 // largest number of original blocks of large frames
+#define SDRDAEMONFEC_NBFECBLOCKSLARGE 512   // largest number of FEC blocks of large frames
 
 class SDRdaemonFECBuffer
 {
@@ -45,6 +65,21 @@ public:
         uint8_t  m_nbFECBlocks;       //!< 12 number of blocks carrying FEC
         uint32_t m_tv_sec;            //!< 16 seconds of timestamp at start time of super-frame processing
         uint32_t m_tv_usec;           //!< 20 microseconds of timestamp at start time of super-frame processing
+        uint32_t m_crc32;             //!< 24 CRC32 of the above
+        uint16_t m_udpSize;           //!< 26 size of the UDP datagrams in bytes (0 from older senders: 512)
+        uint16_t m_hopCount;          //!< 28 frequency scan retunes done (wraps around, 0 without scan)
+        uint32_t m_retuneOffset;      //!< 32 index in the frame of the first sample after a retune (0xFFFFFFFF: no retune)
+        uint32_t m_retuneFrequency;   //!< 36 center frequency in kHz after the retune
+        uint32_t m_settleSamples;     //!< 40 samples not yet settled from the retune (or from the frame start when still settling)
+        uint32_t m_compressedBytes;   //!< 44 length of the LZ4 compressed data in the data blocks (compressed frames)
+        uint32_t m_frameBytes;        //!< 48 length of the data once decompressed (compressed frames)
+        uint32_t m_squelchSamples;    //!< 52 number of silent samples the keep-alive frame stands for (squelched frames)
+        uint64_t m_sampleIndex;       //!< 60 index in the stream of the first sample of the frame (all samples since start)
+        uint64_t m_anchorIndex;       //!< 68 index in the stream of the sample captured at m_anchorTime
+        uint64_t m_anchorTime;        //!< 76 capture time of the anchor sample in nanoseconds since the Unix epoch (0: unknown)
+        uint8_t  m_fecCodec;          //!< 77 codec of the FEC blocks (FECCodec.h, 0 from older senders: CM256)
+        uint16_t m_nbOriginalBlocksLarge; //!< 79 number of original blocks of large frames (0 otherwise: see m_nbOriginalBlocks)
+        uint16_t m_nbFECBlocksLarge;  //!< 81 number of FEC blocks of large frames (0 otherwise: see m_nbFECBlocks)
 
         bool operator==(const MetaDataFEC& rhs)
         {
@@ -71,45 +106,158 @@ public:
         uint8_t  filler;
     };
 
-    static const int samplesPerBlock = (SDRDAEMONFEC_UDPSIZE - sizeof(Header)) / sizeof(Sample);
-
-    struct ProtectedBlock
+    /** End of the superblocks of large frames (before the block CRC): the block index and frame size beyond the header 8 bits */
+    struct LargeTrailer
     {
-        Sample samples[samplesPerBlock];
-    };
-
-    struct SuperBlock
-    {
-        Header         header;
-        ProtectedBlock protectedBlock;
-    };
-
-    struct ProtectedBlockZero
-    {
-        MetaDataFEC m_metaData;
-        uint8_t     m_filler[SDRDAEMONFEC_UDPSIZE - sizeof(Header) - sizeof(MetaDataFEC)]; // complete for a 512 byte block
+        uint16_t blockIndex;
+        uint16_t nbOriginalBlocks;
     };
 
 #pragma pack(pop)
 
+    // A SuperBlock is a Header followed by a protected block. Its size is the size of the
+    // received datagrams (SDRDAEMONFEC_UDPSIZE by default) so it is only known at run time.
+
 	SDRdaemonFECBuffer();
 	~SDRdaemonFECBuffer();
 
 	/**
-	 * Write a superblock to buffer and read a complete data block
+	 * Write a superblock to buffer and copy out a complete data block. Same as write() followed by a copy of getFrameData()
 	 * \param  array      pointer the input superblock
-	 * \param  length     length of superblock
-	 * \param  data       pointer to the output data block
+	 * \param  length     length of superblock. A change of length (datagram size) restarts the decoder
+	 * \param  data       pointer to the output data block. Room for 127 protected blocks of the largest datagram size
+	 *                    (1023 with large frames) or up to twice that for 12 or 8 bit frames that are widened to 2x16 bits and
+	 *                    SDRDAEMONFEC_LZ4RATIO times more for compressed frames
 	 * \param  dataLength reference to the output data length. This length is 0
 	 * \return true if an output data block is available else false
 	 */
-	bool writeAndRead(uint8_t *array, uint8_t *data, std::size_t& dataLength);
+	bool writeAndRead(uint8_t *array, std::size_t length, uint8_t *data, std::size_t& dataLength);
+
+	/**
+	 * Write a superblock to buffer without copying out the data of a completed frame
+	 * \param  array      pointer the input superblock
+	 * \param  length     length of superblock. A change of length (datagram size) restarts the decoder
+	 * \return true if a frame is completed. Its data is then available in place with getFrameData()
+	 */
+	bool write(uint8_t *array, std::size_t length);
+
+	/**
+	 * Data of the frame completed by the last write() (its data blocks without the header: 127 for full frames) as 2x16 bit
+	 * I/Q samples. It stays valid until the next write().
+	 * \param  dataLength reference to the data length. 0 if no frame is available
+	 * \return pointer to the decoded data in the decoder slot or to the unpacked samples of a packed frame
+	 */
+	const uint8_t *getFrameData(std::size_t& dataLength)
+	{
+	    if (m_outputSlot)
+	    {
+	        if (slotConverted(*m_outputSlot)) {
+	            return unpackFrame(dataLength);
+	        }
+
+	        dataLength = (m_outputSlot->m_nbOriginalBlocks - 1) * m_blockSize;
+	        return frameBlock(*m_outputSlot, 1); // skip block 0
+	    }
+
+	    dataLength = 0;
+	    return 0;
+	}
+
+	/**
+	 * Number of samples of the frame completed by the last write(). 0 if no frame is available or for a compressed
+	 * frame without its meta data
+	 */
+	std::size_t getFrameNbSamples();
+
+	/** Copy the getFrameNbSamples() samples of the frame completed by the last write() decompressing and unpacking them if needed */
+	void getFrameSamples(Sample *samples);
+
+	/**
+	 * Meta data of the frame completed by the last write() with its own time stamp (getOutputMeta() is only
+	 * updated when the stream parameters change). 0 if no frame is available or its block 0 was not received.
+	 */
+	const MetaDataFEC *getFrameMeta() const
+	{
+	    if (m_outputSlot && m_outputSlot->m_metaRetrieved) {
+	        return (const MetaDataFEC *) &m_outputSlot->m_frame[0];
+	    }
+
+	    return 0;
+	}
+
+	/**
+	 * Set the reordering window: number of frames that are decoded concurrently. A frame is output
+	 * (in frame order) when a block of the frame nbFrames after it arrives so blocks arriving up to
+	 * nbFrames-1 frames late still contribute to their frame. 1 (the default) outputs a frame as soon as a block
+	 * of the next frame arrives. Restarts the decoder. Limited to SDRDAEMONFEC_REORDERWINDOWMAX.
+	 */
+	void setReorderWindow(int nbFrames);
+	int getReorderWindow() const { return m_reorderWindow; }
+
+	/**
+	 * Set the play-out deadline in milliseconds. 0 (the default) disables it. The arrival time of each frame
+	 * is predicted from the arrival of the previous frames and the frame duration (from the meta data).
+	 * Blocks of a frame arriving more than the deadline after its predicted time are dropped before any
+	 * copy or decoding (stale backlog released after a network outage). If blocks keep being late for
+	 * longer than the deadline the prediction is reset on the current frame (the sender was restarted or paused).
+	 * The first block after a silence longer than the deadline restarts the decoder at once instead of waiting
+	 * for late blocks of the frames in progress. Should be well above a frame duration and the reordering delay.
+	 */
+	void setDeadline(int deadlineMs) { m_deadline = std::chrono::milliseconds(deadlineMs); }
+
+	/**
+	 * Request the retransmission of missing blocks (NACK). When the first block of a new frame arrives, the
+	 * frames still open with less than the original blocks needed to restore them (none at all for a frame
+	 * entirely lost) are queued for a request, at most SDRDAEMONFEC_NACKRETRIES times per frame. Get the
+	 * requests with getNack() after each write(). FEC blocks still restore what is not resent in time. The
+	 * reordering window should be at least 3 frames so that resent blocks arrive before the frame is output.
+	 */
+	void setNack(bool nack) { m_nack = nack; m_nbNacks = 0; m_nackNext = 0; }
+
+	/**
+	 * Next retransmission request queued by write()
+	 * \param  nack  request for the frame with the bit map of the blocks received so far
+	 * \return false if there is no more request (the queue is then cleared)
+	 */
+	bool getNack(FECNack& nack);
+
+    /** Number of original blocks as given by meta data (0 from older senders) */
+    static int metaNbOriginalBlocks(const MetaDataFEC& metaData)
+    {
+        if ((metaData.m_nbOriginalBlocksLarge >= 2) && (metaData.m_nbOriginalBlocksLarge <= SDRDAEMONFEC_NBORIGINALBLOCKSLARGE)) {
+            return metaData.m_nbOriginalBlocksLarge;
+        }
+
+        return (metaData.m_nbOriginalBlocks < 2) || (metaData.m_nbOriginalBlocks > nbOriginalBlocks) ? nbOriginalBlocks : metaData.m_nbOriginalBlocks;
+    }
+
+    /** Number of FEC blocks as given by meta data */
+    static int metaNbFECBlocks(const MetaDataFEC& metaData)
+    {
+        return metaData.m_nbFECBlocksLarge != 0 ? std::min((int) metaData.m_nbFECBlocksLarge, SDRDAEMONFEC_NBFECBLOCKSLARGE) : metaData.m_nbFECBlocks;
+    }
+
 	const MetaDataFEC& getCurrentMeta() const { return m_currentMeta; }
     const MetaDataFEC& getOutputMeta() const { return m_outputMeta; }
 	int getCurNbBlocks() const { return m_curNbBlocks; }
 	int getCurNbRecovery() const { return m_curNbRecovery; }
+	int getCurNbOriginalBlocks() const { return m_curNbOriginalBlocks; } //!< original blocks of the frame output (frames may be shorter than 128 blocks)
 	float getAvgNbBlocks() const { return m_avgNbBlocks; }
 	float getAvgNbRecovery() const { return m_avgNbRecovery; }
+	int getUdpSize() const { return m_udpSize; }
+	uint32_t getNbLateBlocks() const { return m_nbLateBlocks; } //!< blocks dropped because their frame was already output
+	uint32_t getNbStaleBlocks() const { return m_nbStaleBlocks; } //!< blocks dropped because their frame was past the deadline
+	uint32_t getNbDuplicateBlocks() const { return m_nbDuplicateBlocks; } //!< blocks dropped because they were already received
+	uint32_t getNbCorruptBlocks() const { return m_nbCorruptBlocks; } //!< blocks dropped because their CRC32C did not match (block integrity check)
+	uint32_t getNbOverflowBlocks() const { return m_nbOverflowBlocks; } //!< FEC blocks dropped because the frame already had nbOriginalBlocks of them stored
+	uint32_t getNbNacks() const { return m_nbNacksSent; } //!< retransmission requests given by getNack()
+	uint64_t getNbBlocks() const { return m_nbBlocks; } //!< blocks written
+	uint64_t getNbFrames() const { return m_nbFrames; } //!< frames output
+	uint64_t getNbLostFrames() const { return m_nbLostFrames; } //!< frames output without enough blocks to restore them
+	uint64_t getNbRecoveredBlocks() const { return m_nbRecoveredBlocks; } //!< original blocks restored from FEC blocks
+
+	/** Memory held by the decoder slots and the output frame buffers. The recovery storage grows with the FEC blocks received. */
+	std::size_t getPreallocatedBytes() const;
 
 	int getMinNbBlocks()
 	{
@@ -126,52 +274,122 @@ public:
 	}
 
 private:
-	static const int udpSize = SDRDAEMONFEC_UDPSIZE;
 	static const int nbOriginalBlocks = SDRDAEMONFEC_NBORIGINALBLOCKS;
 	static const int nbDecoderSlots = SDRDAEMONFEC_NBDECODERSLOTS;
 
-#pragma pack(push, 1)
-	struct BufferFrame0
-	{
-	    ProtectedBlock  m_blocks[nbOriginalBlocks];
-	};
-    struct BufferFrame
-    {
-        ProtectedBlock  m_blocks[nbOriginalBlocks - 1];
-    };
-#pragma pack(pop)
-
 	struct DecoderSlot
     {
-        BufferFrame0         m_frame; //!< retrieved frames including block0 with meta data
-        ProtectedBlock*      m_originalBlockPtrs[nbOriginalBlocks];
-        ProtectedBlock       m_recoveryBlocks[nbOriginalBlocks]; // max size
-        CM256::cm256_block   m_cm256DescriptorBlocks[nbOriginalBlocks];
+        AlignedVector<uint8_t> m_frame; //!< retrieved frames including block0 with meta data: nbOriginalBlocks protected blocks
+        AlignedVector<uint8_t> m_recoveryBlocks; //!< FEC blocks received: as many protected blocks as the frames carry up to recoveryMax()
+        uint16_t             m_recoveryIndexes[SDRDAEMONFEC_NBFECBLOCKSLARGE]; //!< block index of each recovery block stored
+        int                  m_nbOriginalBlocks; //!< original blocks of the frame as told by the headers of its blocks
+        bool                 m_large;  //!< large frame: block indexes from the LargeTrailer of its superblocks
         int                  m_blockCount; //!< total number of blocks received for this frame
         int                  m_recoveryCount; //!< number of recovery blocks received
-        bool                 m_decoded; //!< true if decoded
+        bool                 m_decoded; //!< true if complete (no decoding needed) or restored by the FEC codec
+        bool                 m_givenUp; //!< the recovery blocks were spoiled by a wrong decoding (codec not MDS)
         bool                 m_metaRetrieved;
+        uint64_t             m_received[(SDRDAEMONFEC_NBORIGINALBLOCKSLARGE + SDRDAEMONFEC_NBFECBLOCKSLARGE) / 64]; //!< bit map of the block indexes received
+        int                  m_nackCount; //!< number of retransmission requests queued for this frame
+
+        bool received(int blockIndex) const { return (m_received[blockIndex >> 6] >> (blockIndex & 63)) & 1; }
     };
 
-    void getSlotData(uint8_t *data, std::size_t& dataLength);
+    void outputSlot(DecoderSlot& slot);
+    const uint8_t *unpackFrame(std::size_t& dataLength);
+
+    /** Bytes per I/Q pair on the network: 4, 3 when packed to 12 bits or 2 with 8 bits */
+    static int wireSampleBytes(uint8_t sampleBytes)
+    {
+        return sampleBytes & SDRDAEMONFEC_PACKED8 ? 2 : sampleBytes & SDRDAEMONFEC_PACKED12 ? 3 : sizeof(Sample);
+    }
+
+    /** As told by the meta data of the frame or by the last meta data received if its block 0 is lost */
+    const MetaDataFEC *slotMeta(DecoderSlot& slot)
+    {
+        return slot.m_metaRetrieved ? (const MetaDataFEC *) frameBlock(slot, 0) : &m_currentMeta;
+    }
+
+    /** The frame data is not the 2x16 bits I/Q samples given by getFrameData */
+    bool slotConverted(DecoderSlot& slot)
+    {
+        return (slotMeta(slot)->m_sampleBytes & (SDRDAEMONFEC_PACKED12 | SDRDAEMONFEC_PACKED8 | SDRDAEMONFEC_LZ4 | SDRDAEMONFEC_SQUELCH)) != 0;
+    }
+
+    static void widenSamples(const uint8_t *data, Sample *samples, int nbSamples, int sampleBytes);
+
     void printMeta(MetaDataFEC *metaData);
-    void initDecodeSlot();
+    void initDecodeSlot(DecoderSlot& slot);
+    void storeBlock(DecoderSlot& slot, int blockIndex, uint8_t *protectedBlock);
+    void growRecovery(DecoderSlot& slot, int nbRecoveryBlocks);
+    bool decodeSlot(DecoderSlot& slot);
+    bool setUdpSize(std::size_t udpSize);
+    static bool checkBlockCRC(const uint8_t *array, std::size_t& length);
+    static bool readLargeTrailer(const uint8_t *array, std::size_t& length, int& blockIndex, int& nbFrameBlocks);
+
+    /** Most FEC blocks stored for a frame: as many as its original blocks, those of large frames go up to SDRDAEMONFEC_NBFECBLOCKSLARGE */
+    static int recoveryMax(const DecoderSlot& slot)
+    {
+        return slot.m_large ? SDRDAEMONFEC_NBFECBLOCKSLARGE : nbOriginalBlocks;
+    }
+
+    /** Number of original blocks of the frame of a superblock: full frames from older senders have a 0 filler */
+    static int headerNbOriginalBlocks(const Header *header)
+    {
+        return std::max(2, nbOriginalBlocks - (header->filler >> SDRDAEMONFEC_BLOCKSSHIFT));
+    }
+
+    bool checkDeadline(int frameIndex, bool& resync);
+    void queueNacks(int frameIndex);
+    DecoderSlot& decoderSlot(int frameIndex) { return m_decoderSlots[frameIndex & (m_nbDecoderSlots - 1)]; }
+    uint8_t *frameBlock(DecoderSlot& slot, int blockIndex) { return &slot.m_frame[blockIndex * m_blockSize]; }
+    uint8_t *recoveryBlock(DecoderSlot& slot, int recoveryIndex) { return &slot.m_recoveryBlocks[recoveryIndex * m_blockSize]; }
 
+	int                  m_udpSize;      //!< Size of the SuperBlocks (received datagrams)
+	int                  m_blockSize;    //!< Size of the protected blocks
 	MetaDataFEC          m_currentMeta;  //!< Stored current meta data from input
 	MetaDataFEC          m_outputMeta;   //!< Meta data corresponding to output frame
 	CM256::cm256_encoder_params m_paramsCM256;
-	DecoderSlot          m_decoderSlot;
-    //BufferFrame          m_frames[nbDecoderSlots]; in the most general case you would use it as the samples buffer
-	int                  m_decoderIndexHead;
-	int                  m_frameHead;
+	FECBlock             m_cm256DescriptorBlocks[FECCODEC_NBBLOCKSMAX]; //!< set up for each frame to restore (all its blocks at most)
+	std::vector<DecoderSlot> m_decoderSlots; //!< ring of decoder slots indexed by frame index modulo its size
+	DecoderSlot         *m_outputSlot;     //!< slot of the frame output by the last write. Re-initialized on the next write
+	AlignedVector<uint8_t> m_unpacked;     //!< samples of the last packed frame given by getFrameData
+	AlignedVector<uint8_t> m_decompressed; //!< data of the last compressed frame output
+	int                  m_nbDecoderSlots; //!< number of decoder slots: power of two at least twice the reordering window
+	int                  m_reorderWindow;  //!< number of frames decoded concurrently
+	int                  m_frameHead;      //!< oldest frame not yet output or -1 before the first block
+	int                  m_frameTail;      //!< most recent frame a block was received for
+	uint32_t             m_nbLateBlocks;   //!< (stats) blocks received for frames already output
+	int                  m_lateRun;        //!< number of consecutive late blocks
+	typedef std::chrono::steady_clock clock;
+	clock::duration      m_deadline;       //!< play-out deadline (0: none)
+	clock::time_point    m_lastBlockTime;  //!< arrival of the last block accepted
+	clock::time_point    m_refTime;        //!< predicted arrival time of the first block of m_refFrame
+	int                  m_refFrame;       //!< frame the arrival prediction is based on or -1 if none
+	int                  m_checkedFrame;   //!< frame of the last deadline check (the check is made once per frame)
+	bool                 m_checkedFrameOK; //!< result of the last deadline check
+	clock::time_point    m_staleSince;     //!< arrival of the first stale block of the current stale run
+	bool                 m_stale;          //!< in a run of stale blocks
+	uint32_t             m_nbStaleBlocks;  //!< (stats) blocks dropped past the deadline
+	uint32_t             m_nbDuplicateBlocks; //!< (stats) blocks received twice (resent or duplicated by the network)
+	uint32_t             m_nbCorruptBlocks; //!< (stats) blocks failing their integrity check
+	uint32_t             m_nbOverflowBlocks; //!< (stats) FEC blocks beyond the recovery storage of their frame
+	bool                 m_nack;           //!< queue retransmission requests
+	int                  m_nackFrames[nbDecoderSlots]; //!< frames with a retransmission request queued
+	int                  m_nbNacks;        //!< number of requests queued
+	int                  m_nackNext;       //!< next request to give by getNack()
+	uint32_t             m_nbNacksSent;    //!< (stats) requests given by getNack()
+	uint64_t             m_nbBlocks;       //!< (stats) blocks written
+	uint64_t             m_nbFrames;       //!< (stats) frames output
+	uint64_t             m_nbLostFrames;   //!< (stats) frames output incomplete
+	uint64_t             m_nbRecoveredBlocks; //!< (stats) original blocks restored by the decoder
 	int                  m_curNbBlocks;          //!< (stats) instantaneous number of blocks received
 	int                  m_curNbRecovery;        //!< (stats) instantaneous number of recovery blocks used
+	int                  m_curNbOriginalBlocks;  //!< (stats) original blocks of the frame output
     int                  m_minNbBlocks;          //!< (stats) minimum number of blocks received since last call to corresponding getter
     int                  m_maxNbRecovery;        //!< (stats) maximum number of recovery blocks used since last call to corresponding getter
 	MovingAverage<int, int, 10> m_avgNbBlocks;   //!< (stats) average number of blocks received
 	MovingAverage<int, int, 10> m_avgNbRecovery; //!< (stats) average number of recovery blocks used
-	CM256                m_cm256;
-	bool                 m_cm256_OK;
 };
 
 #endif /* GR_SDRDAEMONFEC_LIB_SDRDAEMONFECBUFFER_H_ */
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_SHMSINK_H_
+#define INCLUDE_SHMSINK_H_
+
+#include <atomic>
+
+#include "UDPSink.h"
+#include "SharedRing.h"
+
+/**
+ * Sink publishing the samples in a shared memory ring (see SharedRing) for the consumers on the same host.
+ * Each write is one frame or more if it does not fit in a slot. There is no FEC, no packing and no datagram.
+ * With a UDP sink the same samples and meta data are then written to it so that remote consumers are
+ * served as before.
+ */
+class SHMSink : public UDPSink
+{
+public:
+    /**
+     * name    :: name of the shared memory object
+     * nbSlots :: number of frames kept in the ring
+     * udpSink :: also written to if not null (not owned)
+     */
+    SHMSink(const std::string& name, unsigned int nbSlots, UDPSink *udpSink);
+    virtual ~SHMSink();
+
+    virtual void write(const IQSampleVector& samples_in);
+
+    /** Frames published since start (any thread) */
+    uint64_t getNbFrames() const { return m_nbFrames.load(std::memory_order_relaxed); }
+
+    /** Bytes of the shared memory object */
+    std::size_t getSharedBytes() const;
+
+    const SharedRing& getRing() const { return m_ring; }
+
+private:
+    SharedRing m_ring;
+    UDPSink   *m_udpSink;
+    std::atomic<uint64_t> m_nbFrames;
+};
+
+#endif /* INCLUDE_SHMSINK_H_ */
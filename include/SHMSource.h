@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_SHMSOURCE_H_
+#define INCLUDE_SHMSOURCE_H_
+
+#include <atomic>
+
+#include "UDPSource.h"
+#include "SharedRing.h"
+
+/**
+ * Source taking the frames of a shared memory ring published on the same host (see SHMSink) instead of
+ * UDP datagrams. The ring is attached when it appears and again when its producer restarts.
+ */
+class SHMSource : public UDPSource
+{
+public:
+    /** name :: name of the shared memory object */
+    SHMSource(const std::string& name);
+    virtual ~SHMSource();
+
+    /** Next frame of the ring. Empty if none came within 100 ms. */
+    virtual void read(IQSampleVector& samples_out);
+
+    virtual void getStatusMessage(char *messageBuffer);
+
+    /** Frames read since start (any thread) */
+    uint64_t getNbFrames() const { return m_nbFrames.load(std::memory_order_relaxed); }
+
+    /** Frames overwritten by the producer before they could be read (any thread) */
+    uint64_t getNbLostFrames() const { return m_nbLostFrames.load(std::memory_order_relaxed); }
+
+private:
+    bool attach();
+
+    std::string m_name;
+    SharedRing  m_ring;
+    unsigned int m_nbTimeouts;       //!< waits without a frame since the last check of the ring
+    uint64_t    m_ringLostFrames;    //!< lost frames of the rings attached before
+    uint64_t    m_reportedLostFrames; //!< lost frames at the last status message
+    std::atomic<uint64_t> m_nbFrames;
+    std::atomic<uint64_t> m_nbLostFrames;
+};
+
+#endif /* INCLUDE_SHMSOURCE_H_ */
@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_SIMDDISPATCH_H_
+#define INCLUDE_SIMDDISPATCH_H_
+
+/**
+ * Run time selection of the SIMD kernels.
+ *
+ * On x86 every kernel variant is compiled in with a per function target attribute and the best one
+ * supported by the CPU running the program is used, so binaries do not depend on the build host.
+ * On ARM NEON is still a compile time choice (always there on aarch64).
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_X86_DISPATCH
+#define SIMD_TARGET(t) __attribute__((target(t)))
+#endif
+
+class SIMDDispatch
+{
+public:
+    typedef enum {
+        SIMDScalar = 0,
+        SIMDSSE4_1,
+        SIMDAVX2,
+        SIMDNEON
+    } level_t;
+
+    /** Best kernel level supported by the CPU, detected once at program start */
+    static level_t level() { return m_level; }
+
+    /** Name of the kernel level in use for the startup banner */
+    static const char *name();
+
+private:
+    static level_t detect();
+    static const level_t m_level;
+};
+
+#endif /* INCLUDE_SIMDDISPATCH_H_ */
@@ -0,0 +1,358 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_SAMPLECONVERSION_H_
+#define INCLUDE_SAMPLECONVERSION_H_
+
+#include <stdint.h>
+#include <algorithm>
+
+#include "SIMDDispatch.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "SDRDaemon.h"
+
+/**
+ * Widening of interleaved 8 bit I/Q device samples to IQSample and narrowing back for 8 bit sinks.
+ * IQSample is a packed pair of int16 so the output is just the widened input byte stream.
+ * Also the 12 bit packing of the network transport: the 12 most significant bits of an I/Q pair
+ * in 3 bytes as the little endian 24 bit word I(15:4) | Q(15:4) << 12.
+ * The device conversions take an optional left shift so that the normalization to the 16 bits scale
+ * (Decimators::decimate1) is done in the same pass when the samples are not decimated.
+ */
+class SampleConversion
+{
+public:
+    /** Unsigned 8 bit with 128 offset (RTL-SDR). len is the number of bytes (2 per sample). Output shifted left by shift bits. */
+    static void u8ToIQ(const uint8_t *buf, IQSample *out, unsigned int len, unsigned int shift = 0)
+    {
+        convert<true>((const int8_t *) buf, (int16_t *) out, len, shift);
+    }
+
+    /** Signed 8 bit (HackRF). len is the number of bytes (2 per sample). Output shifted left by shift bits. */
+    static void s8ToIQ(const int8_t *buf, IQSample *out, unsigned int len, unsigned int shift = 0)
+    {
+        convert<false>(buf, (int16_t *) out, len, shift);
+    }
+
+    /** Copy of n 16 bit interleaved I/Q samples (Airspy, BladeRF) shifted left by shift bits. in may be out. */
+    static void shiftS16(const IQSample *in, IQSample *out, unsigned int n, unsigned int shift)
+    {
+        const int16_t *x = (const int16_t *) in;
+        int16_t *y = (int16_t *) out;
+        unsigned int len = 2*n;
+        unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+            i = shiftAVX2(x, y, len, shift);
+        }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+        const __m128i count = _mm_cvtsi32_si128(shift);
+
+        for (; i + 8 <= len; i += 8)
+        {
+            _mm_storeu_si128((__m128i*) &y[i], _mm_sll_epi16(_mm_loadu_si128((const __m128i*) &x[i]), count));
+        }
+#elif defined(USE_NEON)
+        const int16x8_t count = vdupq_n_s16(shift);
+
+        for (; i + 8 <= len; i += 8)
+        {
+            vst1q_s16(&y[i], vshlq_s16(vld1q_s16(&x[i]), count));
+        }
+#endif
+        for (; i < len; i++)
+        {
+            y[i] = (int16_t) (x[i] << shift);
+        }
+    }
+
+    /** IQSample to signed 8 bit keeping the 8 most significant bits (HackRF Tx). len is the number of bytes (2 per sample). */
+    static void iqToS8(const IQSample *in, int8_t *out, unsigned int len)
+    {
+        const int16_t *x = (const int16_t *) in;
+        unsigned int i = 0;
+        len &= ~1U;
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+            i = narrowAVX2(x, out, len);
+        }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+        for (; i + 16 <= len; i += 16)
+        {
+            // after the shift values fit in a byte so the saturating pack is exact
+            __m128i lo = _mm_srai_epi16(_mm_loadu_si128((const __m128i*) &x[i]), 8);
+            __m128i hi = _mm_srai_epi16(_mm_loadu_si128((const __m128i*) &x[i+8]), 8);
+            _mm_storeu_si128((__m128i*) &out[i], _mm_packs_epi16(lo, hi));
+        }
+#elif defined(USE_NEON)
+        for (; i + 16 <= len; i += 16)
+        {
+            int8x8_t lo = vshrn_n_s16(vld1q_s16(&x[i]), 8);
+            int8x8_t hi = vshrn_n_s16(vld1q_s16(&x[i+8]), 8);
+            vst1q_s8(&out[i], vcombine_s8(lo, hi));
+        }
+#endif
+        for (; i < len; i++)
+        {
+            out[i] = x[i] >> 8;
+        }
+    }
+
+    /** Pack n samples rounded to their 12 most significant bits to 3n bytes. Writes exactly 3n bytes. */
+    static void pack12(const IQSample *in, uint8_t *out, unsigned int n)
+    {
+        const int16_t *x = (const int16_t *) in;
+        unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() >= SIMDDispatch::SIMDSSE4_1) {
+            i = pack12SSSE3(in, out, n);
+        }
+#elif defined(USE_NEON)
+        for (; i + 8 <= n; i += 8)
+        {
+            int16x8x2_t v = vld2q_s16(&x[2*i]);
+            uint16x8_t re = vreinterpretq_u16_s16(vshrq_n_s16(vqaddq_s16(v.val[0], vdupq_n_s16(8)), 4));
+            uint16x8_t im = vreinterpretq_u16_s16(vshrq_n_s16(vqaddq_s16(v.val[1], vdupq_n_s16(8)), 4));
+            uint8x8x3_t b;
+            b.val[0] = vmovn_u16(re);
+            b.val[1] = vmovn_u16(vorrq_u16(vandq_u16(vshrq_n_u16(re, 8), vdupq_n_u16(0x0F)), vshlq_n_u16(im, 4)));
+            b.val[2] = vmovn_u16(vshrq_n_u16(vandq_u16(im, vdupq_n_u16(0x0FFF)), 4));
+            vst3_u8(&out[3*i], b);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            unsigned int re = (std::min(x[2*i] + 8, 32767) >> 4) & 0xFFF;
+            unsigned int im = (std::min(x[2*i+1] + 8, 32767) >> 4) & 0xFFF;
+            out[3*i]   = re;
+            out[3*i+1] = (re >> 8) | (im << 4);
+            out[3*i+2] = im >> 4;
+        }
+    }
+
+    /** Unpack n samples from 3n bytes packed by pack12 back to the 16 bits scale. Reads exactly 3n bytes. */
+    static void unpack12(const uint8_t *in, IQSample *out, unsigned int n)
+    {
+        int16_t *x = (int16_t *) out;
+        unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() >= SIMDDispatch::SIMDSSE4_1) {
+            i = unpack12SSSE3(in, out, n);
+        }
+#elif defined(USE_NEON)
+        for (; i + 8 <= n; i += 8)
+        {
+            uint8x8x3_t b = vld3_u8(&in[3*i]);
+            int16x8x2_t v;
+            uint16x8_t b1 = vmovl_u8(b.val[1]);
+            int16x8_t lo = vreinterpretq_s16_u16(vorrq_u16(vmovl_u8(b.val[0]), vshlq_n_u16(b1, 8)));
+            int16x8_t hi = vreinterpretq_s16_u16(vorrq_u16(b1, vshlq_n_u16(vmovl_u8(b.val[2]), 8)));
+            v.val[0] = vshlq_n_s16(lo, 4);                       // bits 11:0 are I
+            v.val[1] = vandq_s16(hi, vdupq_n_s16((int16_t) 0xFFF0)); // bits 15:4 are Q
+            vst2q_s16(&x[2*i], v);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            x[2*i]   = (int16_t) ((in[3*i] | (in[3*i+1] << 8)) << 4);
+            x[2*i+1] = (int16_t) ((in[3*i+1] | (in[3*i+2] << 8)) & 0xFFF0);
+        }
+    }
+
+    /** Signed 8 bit to the 8 most significant bits of IQSample (unlike s8ToIQ). len is the number of bytes (2 per sample). */
+    static void unpack8(const int8_t *in, IQSample *out, unsigned int len)
+    {
+        int16_t *x = (int16_t *) out;
+        unsigned int i = 0;
+        len &= ~1U;
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) &in[i]);
+            _mm_storeu_si128((__m128i*) &x[i], _mm_unpacklo_epi8(zero, v)); // byte in the high half
+            _mm_storeu_si128((__m128i*) &x[i+8], _mm_unpackhi_epi8(zero, v));
+        }
+#elif defined(USE_NEON)
+        for (; i + 8 <= len; i += 8)
+        {
+            vst1q_s16(&x[i], vshll_n_s8(vld1_s8(&in[i]), 8));
+        }
+#endif
+        for (; i < len; i++)
+        {
+            x[i] = (int16_t) ((uint8_t) in[i] << 8);
+        }
+    }
+
+private:
+    template<bool Offset>
+    static void convert(const int8_t *in, int16_t *out, unsigned int len, unsigned int shift)
+    {
+        unsigned int i = 0;
+        len &= ~1U; // whole samples only
+#if defined(SIMD_X86_DISPATCH)
+        if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+            i = convertAVX2<Offset>(in, out, len, shift);
+        }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__) // SSE2 is baseline on x86_64
+        const __m128i bias = _mm_set1_epi8((char) 0x80);
+        const __m128i count = _mm_cvtsi32_si128(shift);
+
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+
+            if (Offset) {
+                x = _mm_xor_si128(x, bias); // u8 - 128 as s8
+            }
+
+            // sign extension: put byte in high half then arithmetic shift right
+            _mm_storeu_si128((__m128i*) &out[i],   _mm_sll_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8), count));
+            _mm_storeu_si128((__m128i*) &out[i+8], _mm_sll_epi16(_mm_srai_epi16(_mm_unpackhi_epi8(x, x), 8), count));
+        }
+#elif defined(USE_NEON)
+        const uint8x16_t bias = vdupq_n_u8(0x80);
+        const int16x8_t count = vdupq_n_s16(shift);
+
+        for (; i + 16 <= len; i += 16)
+        {
+            int8x16_t x = vld1q_s8(&in[i]);
+
+            if (Offset) {
+                x = vreinterpretq_s8_u8(veorq_u8(vreinterpretq_u8_s8(x), bias)); // u8 - 128 as s8
+            }
+
+            vst1q_s16(&out[i],   vshlq_s16(vmovl_s8(vget_low_s8(x)), count));
+            vst1q_s16(&out[i+8], vshlq_s16(vmovl_s8(vget_high_s8(x)), count));
+        }
+#endif
+        for (; i < len; i++)
+        {
+            out[i] = (Offset ? ((uint8_t) in[i]) - 128 : in[i]) << shift;
+        }
+    }
+
+#if defined(SIMD_X86_DISPATCH)
+    /** Returns the number of bytes converted, the rest is left to the 128 bit and scalar loops */
+    template<bool Offset>
+    SIMD_TARGET("avx2")
+    static unsigned int convertAVX2(const int8_t *in, int16_t *out, unsigned int len, unsigned int shift)
+    {
+        const __m128i bias = _mm_set1_epi8((char) 0x80);
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        unsigned int i = 0;
+
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+
+            if (Offset) {
+                x = _mm_xor_si128(x, bias); // u8 - 128 as s8
+            }
+
+            _mm256_storeu_si256((__m256i*) &out[i], _mm256_sll_epi16(_mm256_cvtepi8_epi16(x), count));
+        }
+
+        return i;
+    }
+
+    SIMD_TARGET("avx2")
+    static unsigned int shiftAVX2(const int16_t *in, int16_t *out, unsigned int len, unsigned int shift)
+    {
+        const __m128i count = _mm_cvtsi32_si128(shift);
+        unsigned int i = 0;
+
+        for (; i + 16 <= len; i += 16)
+        {
+            _mm256_storeu_si256((__m256i*) &out[i], _mm256_sll_epi16(_mm256_loadu_si256((const __m256i*) &in[i]), count));
+        }
+
+        return i;
+    }
+
+    SIMD_TARGET("avx2")
+    static unsigned int narrowAVX2(const int16_t *in, int8_t *out, unsigned int len)
+    {
+        unsigned int i = 0;
+
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i lo = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*) &in[i]), 8);
+            __m256i hi = _mm256_srai_epi16(_mm256_loadu_si256((const __m256i*) &in[i+16]), 8);
+            // the pack works per 128 bit lane: put the 64 bit quarters back in order
+            __m256i p  = _mm256_permute4x64_epi64(_mm256_packs_epi16(lo, hi), 0xd8);
+            _mm256_storeu_si256((__m256i*) &out[i], p);
+        }
+
+        return i;
+    }
+
+    /** Returns the number of samples packed. 16 bytes are stored for 12 so the last ones are left to the scalar loop. */
+    SIMD_TARGET("ssse3")
+    static unsigned int pack12SSSE3(const IQSample *in, uint8_t *out, unsigned int n)
+    {
+        const __m128i round = _mm_set1_epi16(8);
+        const __m128i maskI = _mm_set1_epi32(0x00000FFF);
+        const __m128i maskQ = _mm_set1_epi32(0x00FFF000);
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        unsigned int i = 0;
+
+        for (; 3*i + 16 <= 3*n; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) &in[i]); // I in the low, Q in the high half of each 32 bit lane
+            v = _mm_srai_epi16(_mm_adds_epi16(v, round), 4);
+            __m128i w = _mm_or_si128(_mm_and_si128(v, maskI), _mm_and_si128(_mm_srli_epi32(v, 4), maskQ));
+            _mm_storeu_si128((__m128i*) &out[3*i], _mm_shuffle_epi8(w, shuffle));
+        }
+
+        return i;
+    }
+
+    /** Returns the number of samples unpacked. 16 bytes are loaded for 12 so the last ones are left to the scalar loop. */
+    SIMD_TARGET("ssse3")
+    static unsigned int unpack12SSSE3(const uint8_t *in, IQSample *out, unsigned int n)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i maskQ = _mm_set1_epi32(0xFFF00000);
+        unsigned int i = 0;
+
+        for (; 3*i + 16 <= 3*n; i += 4)
+        {
+            __m128i w  = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) &in[3*i]), shuffle);
+            __m128i re = _mm_srli_epi32(_mm_slli_epi32(w, 20), 16);
+            __m128i im = _mm_and_si128(_mm_slli_epi32(w, 8), maskQ);
+            _mm_storeu_si128((__m128i*) &out[i], _mm_or_si128(re, im));
+        }
+
+        return i;
+    }
+#endif
+};
+
+#endif /* INCLUDE_SAMPLECONVERSION_H_ */
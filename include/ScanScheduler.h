@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_SCANSCHEDULER_H_
+#define INCLUDE_SCANSCHEDULER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define SCANSCHEDULER_NBHOPSMAX 1024   // largest number of frequencies in a scan
+#define SCANSCHEDULER_NBRETUNESMAX 256 // retunes queued for the main loop before the oldest are forgotten
+
+/**
+ * Frequency hopping schedule run from the device reader thread.
+ *
+ * A scan is a list of hops freq:dwell[:settle] separated by '/' with the frequency in Hz (k and M
+ * suffixes accepted) and the dwell and settle times in milliseconds. The dwell time is counted in
+ * samples delivered by the device so the schedule follows the sample clock. The device is retuned
+ * between two blocks of samples so a hop always starts with a block. The settle time is the start of
+ * the hop where the samples are not valid yet (tuner settling and samples already in the USB buffers
+ * when retuning). Samples are not dropped: the retunes are queued with the index of the first sample of
+ * the hop for the sender to mark them in the meta data so that receivers can discard the settling samples.
+ */
+class ScanScheduler
+{
+public:
+    struct Retune
+    {
+        uint64_t sampleIndex;   //!< device samples delivered before the first sample of the hop
+        uint64_t frequency;     //!< center frequency of the hop in Hz
+        uint32_t settleSamples; //!< device samples at the start of the hop that are settling
+        uint16_t hopCount;      //!< retunes done by the scheduler (wraps around)
+    };
+
+    ScanScheduler();
+
+    /** Set the hop list. "off" or "0" stops the scan. A new list starts with a retune to its first hop. */
+    bool configure(const std::string& hops);
+
+    bool active() const { return m_active.load(std::memory_order_relaxed); }
+
+    /**
+     * Reader thread: count a block of samples just delivered by the device. Returns true with the frequency
+     * of the next hop when the dwell time on the current one is over and at the start of a scan.
+     */
+    bool advance(std::size_t nbSamples, uint32_t sampleRate, uint64_t& frequency);
+
+    /** Reader thread: the device is tuned to the frequency given by advance(). Queues the retune for the main loop. */
+    void retuned();
+
+    /** Main loop: get the next queued retune taking effect before device sample index endIndex */
+    bool getRetune(uint64_t endIndex, Retune& retune);
+
+    const std::string& error() const { return m_error; }
+
+private:
+    struct Hop
+    {
+        uint64_t frequency; //!< Hz
+        uint32_t dwellMs;
+        uint32_t settleMs;
+    };
+
+    static bool parseFrequency(const std::string& s, uint64_t& frequency);
+    static bool parseMs(const std::string& s, uint32_t& ms);
+
+    std::mutex m_mutex;
+    std::atomic_bool m_active;   //!< a scan is running (read without the lock for the reader fast path)
+    std::vector<Hop> m_hops;
+    std::size_t m_hopIndex;      //!< current hop
+    bool m_started;              //!< the device was tuned to the first hop of the list
+    uint64_t m_sampleIndex;      //!< device samples delivered so far
+    uint64_t m_hopSamples;       //!< samples delivered since the start of the current hop
+    uint32_t m_settleSamples;    //!< settling samples of the hop just given by advance()
+    uint16_t m_hopCount;
+    std::deque<Retune> m_retunes;
+    std::string m_error;
+};
+
+#endif /* INCLUDE_SCANSCHEDULER_H_ */
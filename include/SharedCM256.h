@@ -0,0 +1,36 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_SHAREDCM256_H_
+#define INCLUDE_SHAREDCM256_H_
+
+#include "cm256.h"
+
+/**
+ * The CM256 object of the process. Its Galois field tables are built on first use only instead of for
+ * every UDP sink and FEC buffer opened. The tables are read only afterwards so the encode and decode
+ * calls may come from any thread.
+ */
+inline CM256& sharedCM256()
+{
+    static CM256 cm256; // initialized once, thread safe (C++11)
+    return cm256;
+}
+
+#endif /* INCLUDE_SHAREDCM256_H_ */
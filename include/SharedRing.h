@@ -0,0 +1,159 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_SHAREDRING_H_
+#define INCLUDE_SHAREDRING_H_
+
+#include <stdint.h>
+#include <cstddef>
+#include <atomic>
+#include <string>
+
+#ifdef SDRDAEMON_SMALL_FOOTPRINT
+#define SHAREDRING_NBSLOTS     16    //!< default number of frames kept in the ring
+#define SHAREDRING_SLOTSAMPLES 8192  //!< default maximum number of samples of a frame
+#else
+#define SHAREDRING_NBSLOTS     32
+#define SHAREDRING_SLOTSAMPLES 32768
+#endif
+#define SHAREDRING_MAGIC       0x53444d52 // "SDMR"
+#define SHAREDRING_VERSION     1
+
+/**
+ * Frames of samples in a POSIX shared memory object for the consumers on the same host (see SHMSink).
+ *
+ * One producer writes the frames in a ring of fixed size slots and never waits for the consumers.
+ * Each consumer attaches read only and follows the ring with its own read position so there can be
+ * any number of them. A slot is guarded by a sequence number (seqlock): odd while the producer writes
+ * it, even when published. A consumer copies the frame then checks the sequence again: if the producer
+ * came round meanwhile the copy is thrown away and the consumer goes on with the oldest frame left.
+ * Consumers wait for the next frame on a futex of the shared header that the producer bumps at each
+ * frame, so a frame costs one copy in and one copy out and no per packet work at all.
+ *
+ * The samples are 16 bit I/Q pairs (4 bytes per sample) with the meta data of the UDP frames.
+ */
+class SharedRing
+{
+public:
+    struct FrameMeta
+    {
+        uint32_t m_centerFrequency;   //!< center frequency in kHz
+        uint32_t m_sampleRate;        //!< sample rate in Hz
+        uint8_t  m_sampleBytes;       //!< MSB(4): indicators, LSB(4) number of bytes per sample
+        uint8_t  m_sampleBits;        //!< number of effective bits per sample
+        uint16_t m_filler;
+        uint32_t m_nbSamples;         //!< number of samples in the frame
+        uint32_t m_tv_sec;            //!< seconds of timestamp at start time of frame processing
+        uint32_t m_tv_usec;           //!< microseconds of timestamp at start time of frame processing
+    };
+
+    SharedRing();
+    ~SharedRing();
+
+    /**
+     * Producer: create the ring under name (a leading / is added if missing) replacing any previous one.
+     * Returns false on error (see error()).
+     */
+    bool create(const std::string& name, unsigned int nbSlots, unsigned int slotSamples);
+
+    /** Consumer: attach to the ring created under name. Following frames only. Returns false on error (see error()). */
+    bool attach(const std::string& name);
+
+    /** Detach. The producer marks the ring closed for its consumers and removes the name. */
+    void close();
+
+    /** Producer: publish nbSamples (at most getSlotSamples()) 16 bit I/Q samples as the next frame */
+    void write(const FrameMeta& meta, const void *samples, unsigned int nbSamples);
+
+    /**
+     * Consumer: the frame at the read position. False if there is none yet. After an overrun the frames
+     * overwritten are counted as lost and the read position goes to the oldest one still in the ring.
+     * The samples are only good if check() is true after they have been taken.
+     */
+    bool peek(FrameMeta& meta, const void *&samples);
+
+    /** Consumer: true if the frame given by peek has not been overwritten since (the data taken is good) */
+    bool check() const;
+
+    /** Consumer: go to the next frame */
+    void release() { m_readCount++; }
+
+    /** Consumer: index of the frame at the read position (it moves on after an overrun) */
+    uint64_t getReadPosition() const { return m_readCount; }
+
+    /** Consumer: wait at most timeoutMs for a frame to be published. True if there is one at the read position. */
+    bool wait(int timeoutMs);
+
+    /** Consumer: true if the producer closed the ring or a new ring was created under the name since attach */
+    bool stale() const;
+
+    /** Consumer: number of frames overwritten before they were read */
+    uint64_t getNbLostFrames() const { return m_nbLostFrames; }
+
+    unsigned int getNbSlots() const { return m_nbSlots; }
+    unsigned int getSlotSamples() const { return m_slotSamples; }
+    const std::string& getName() const { return m_name; }
+
+    operator bool() const { return m_header != 0; }
+    const std::string& error() const { return m_error; }
+
+private:
+    struct Header
+    {
+        uint32_t m_magic;
+        uint32_t m_version;
+        uint32_t m_nbSlots;
+        uint32_t m_slotSamples;
+        uint32_t m_slotBytes;         //!< stride of the slots
+        std::atomic<uint32_t> m_closed;
+        std::atomic<uint32_t> m_futex; //!< bumped at each frame and at close
+        uint32_t m_filler;
+        std::atomic<uint64_t> m_writeCount; //!< frames published
+    };
+
+    struct Slot
+    {
+        std::atomic<uint64_t> m_seq;  //!< 2*frame+1 while written, 2*frame+2 once published
+        FrameMeta m_meta;
+    };
+
+    static const std::size_t m_headerBytes = 64;
+    static const std::size_t m_slotHeaderBytes = 64;
+
+    Slot *slot(uint64_t frame) const
+    {
+        return (Slot *) (m_base + m_headerBytes + (frame % m_nbSlots) * (std::size_t) m_slotBytes);
+    }
+
+    std::string  m_name;
+    std::string  m_error;
+    uint8_t     *m_base;
+    std::size_t  m_size;
+    Header      *m_header;
+    int          m_fd;
+    bool         m_producer;
+    unsigned int m_nbSlots;
+    unsigned int m_slotSamples;
+    unsigned int m_slotBytes;
+    uint64_t     m_readCount;    //!< consumer: next frame to read
+    uint64_t     m_readSeq;      //!< consumer: sequence of the slot at peek
+    uint64_t     m_nbLostFrames;
+};
+
+#endif /* INCLUDE_SHAREDRING_H_ */
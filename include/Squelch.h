@@ -0,0 +1,64 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_SQUELCH_H_
+#define INCLUDE_SQUELCH_H_
+
+#include <stdint.h>
+
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+
+/**
+ * Activity gate of a sample stream so that idle channels are not sent around the clock.
+ *
+ * The mean power of each block of 16 bit full scale samples is compared to a threshold in dB relative to
+ * a full scale complex tone. The gate opens as soon as a block is above the threshold and closes when the
+ * blocks stayed below for the hangover time. The power is a sum of I^2 + Q^2 done with 16x16 bit
+ * multiply-adds: 4 samples per SSE2 or NEON instruction, 8 with AVX2.
+ */
+class Squelch
+{
+public:
+    Squelch();
+
+    /** Threshold in dB full scale (0 or more: no gate) and time in milliseconds the gate stays open after the last active block */
+    void configure(float thresholdDb, unsigned int hangoverMs);
+
+    bool active() const { return m_threshold > 0.0; }
+
+    /** Gate state after a block of n samples at sampleRate: true when the samples are to be sent */
+    bool process(const IQSample *samples, unsigned int n, uint32_t sampleRate);
+
+    bool isOpen() const { return m_open; }
+
+    /** Sum of I^2 + Q^2 of n samples */
+    static uint64_t energy(const IQSample *samples, unsigned int n);
+
+private:
+#if defined(SIMD_X86_DISPATCH)
+    static unsigned int energyAVX2(const IQSample *samples, unsigned int n, uint64_t& sum);
+#endif
+
+    double       m_threshold;   //!< power threshold in squared 16 bit units (0: no gate)
+    unsigned int m_hangoverMs;
+    uint64_t     m_idleSamples; //!< samples below the threshold since the last active block
+    bool         m_open;
+};
+
+#endif /* INCLUDE_SQUELCH_H_ */
@@ -20,11 +20,14 @@
 #define SDRDAEMON_TESTSOURCE_H
 
 #include <cstdint>
+#include <chrono>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <thread>
 
 #include "DeviceSource.h"
+#include "NCO.h"
 
 class TestSource : public DeviceSource
 {
@@ -32,6 +35,14 @@ public:
 
     static const int default_block_length = 65536;
 
+    typedef enum {
+        GenFloat = 0, //!< single carrier computed with float cos and sin (original generator)
+        GenTone,      //!< single carrier from the fixed point NCO (default)
+        GenTones,     //!< several carriers from their own NCO added up
+        GenNoise,     //!< gaussian noise only
+        GenBurst      //!< carriers switched on and off periodically over the noise
+    } generator_t;
+
     /** Open test device. */
     TestSource(int dev_index);
 
@@ -67,6 +78,9 @@ private:
     /** Configure RTL-SDR tuner from a list of key=values */
     virtual bool configure(parsekv::pairs_type& m);
 
+    /** Retune from the reader thread for the frequency scan */
+    virtual bool retune(std::uint64_t frequency);
+
     /**
      * Configure RTL-SDR tuner and prepare for streaming.
      *
@@ -92,23 +106,44 @@ private:
      * This function must be called regularly to maintain streaming.
      * Return true for success, false if an error occurred.
      */
-    static bool get_samples(IQSampleVector *samples);
+    static bool get_samples(TestSource *source, IQSampleVector *samples);
 
-    static void run();
+    static void run(TestSource *source);
     static int read_samples(int16_t *data, int wantSize, int& getSize, float& phasor, int sampleRate, float deltaPhase, float amplitude);
 
+    /** Fill the block with the signal of the generator (reader thread) */
+    void generate(IQSample *samples, int nbSamples);
+    void addCarriers(int32_t *acc, int nbSamples);
+    void addNoise(int32_t *acc, int nbSamples);
+    /** Set up the NCOs and levels after a change of the generator parameters (m_genMutex held) */
+    void setupGenerator();
+
     float getDeltaPhase(int32_t deltaFrequency, uint32_t sample_rate) const { return 2.0 * M_PI * ((float) deltaFrequency / sample_rate); }
 
     int               m_dev;
     int               m_block_length; //!< number of samples
     std::thread       *m_thread;
-    static TestSource *m_this;
     int32_t           m_carrierOffset;
     float             m_phase;
     float             m_deltaPhase;
     uint64_t          m_freq;
     uint32_t          m_srate;
     float             m_amplitude;
+    generator_t       m_generator;
+    std::vector<int32_t> m_toneOffsets; //!< carrier offsets in Hz of the tones and burst profiles (the dfp/dfn carrier if empty)
+    int               m_noiseDb;        //!< noise power in negative dB full scale (-1: no noise)
+    uint32_t          m_burstOn;        //!< milliseconds of carriers on in each burst period
+    uint32_t          m_burstPeriod;    //!< milliseconds of the burst period
+    bool              m_realTime;       //!< pace the blocks at the sample rate else as fast as the daemon takes them
+    std::mutex        m_genMutex;       //!< protects the generator parameters changed by configure while generating
+    std::vector<NCO>  m_ncos;           //!< one per carrier (reader thread)
+    IQSampleVector    m_carrier;        //!< constant input of the carrier level rotated by the NCOs
+    std::vector<int32_t> m_mixBuf;      //!< output of one NCO before it is added
+    std::vector<int32_t> m_accBuf;      //!< sum of the carriers and noise before saturation to 16 bits
+    int32_t           m_noiseScale;     //!< Q16 gain from the unit Irwin-Hall sums to the noise level
+    uint64_t          m_noiseState;     //!< xorshift64* state
+    uint64_t          m_burstPos;       //!< samples since the start of the burst period
+    uint64_t          m_nbLate;         //!< times the generator was more than a second late on the real time pace
 
     static const uint32_t m_sampleBits;
     static const uint32_t m_sampleWidth;
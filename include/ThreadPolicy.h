@@ -0,0 +1,241 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef INCLUDE_THREADPOLICY_H_
+#define INCLUDE_THREADPOLICY_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+
+/**
+ * CPU set and scheduling policy of the daemon threads by name, applied when a thread is named
+ * (set_thread_name) so that the threads started deep in the device and sink classes are covered.
+ *
+ * The specification is a comma separated list of name=cpus[:policy[:priority]] where name is the
+ * thread name without the "sdmn-" prefix, cpus a CPU number, a range 2-3 or a list 1+3, "-" for not
+ * pinned, policy fifo, rr or other and priority 1 to 99 (default 50). "rt" gives the real-time
+ * defaults: FIFO 50 for the device threads (USB transfers) and 40 for the UDP threads.
+ * Real time scheduling needs CAP_SYS_NICE (or a rtprio limit): on failure a warning is given and
+ * the thread keeps the default scheduler.
+ */
+class ThreadPolicy
+{
+public:
+    struct Policy
+    {
+        cpu_set_t cpus;
+        bool pinned;
+        int sched;    //!< SCHED_OTHER, SCHED_FIFO or SCHED_RR
+        int priority; //!< real time priority
+    };
+
+    static bool configure(const std::string& spec, std::string& error)
+    {
+        std::istringstream is(spec);
+        std::string item;
+
+        while (std::getline(is, item, ','))
+        {
+            if (item == "rt")
+            {
+                static const char *deviceThreads[] = {"device", "usb", "feed", 0};
+                static const char *udpThreads[] = {"udpsend", "udptx", "udprx", 0};
+
+                for (int i = 0; deviceThreads[i]; i++) {
+                    setDefault(deviceThreads[i], SCHED_FIFO, 50);
+                }
+
+                for (int i = 0; udpThreads[i]; i++) {
+                    setDefault(udpThreads[i], SCHED_FIFO, 40);
+                }
+
+                continue;
+            }
+
+            std::size_t eq = item.find('=');
+            Policy policy;
+
+            if ((eq == std::string::npos) || (eq == 0) || !parsePolicy(item.substr(eq + 1), policy))
+            {
+                error = "invalid thread policy " + item + " (name=cpus[:fifo|rr|other[:priority]])";
+                return false;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex());
+            policies()[item.substr(0, eq)] = policy;
+        }
+
+        return true;
+    }
+
+    /** Apply the policy given for this thread name if any. The "sdmn-" prefix is not part of the policy names. */
+    static void apply(pthread_t thread, const char *name)
+    {
+        std::string key(name);
+
+        if (key.compare(0, 5, "sdmn-") == 0) {
+            key.erase(0, 5);
+        }
+
+        Policy policy;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            std::map<std::string, Policy>::const_iterator it = policies().find(key);
+
+            if (it == policies().end()) {
+                return;
+            }
+
+            policy = it->second;
+        }
+
+        if (policy.pinned && (pthread_setaffinity_np(thread, sizeof(cpu_set_t), &policy.cpus) != 0)) {
+            std::cerr << "ThreadPolicy::apply: " << key << ": cannot set the CPU affinity" << std::endl;
+        }
+
+        if (policy.sched != SCHED_OTHER)
+        {
+            struct sched_param param;
+            param.sched_priority = policy.priority;
+            int rc = pthread_setschedparam(thread, policy.sched, &param);
+
+            if (rc != 0) {
+                std::cerr << "ThreadPolicy::apply: " << key << ": cannot set real time scheduling: " << strerror(rc) << std::endl;
+            }
+        }
+    }
+
+private:
+    static std::mutex& mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::map<std::string, Policy>& policies()
+    {
+        static std::map<std::string, Policy> p;
+        return p;
+    }
+
+    /** Real time default that does not replace a policy given explicitly */
+    static void setDefault(const char *name, int sched, int priority)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+
+        if (policies().find(name) != policies().end()) {
+            return;
+        }
+
+        Policy& policy = policies()[name];
+        CPU_ZERO(&policy.cpus);
+        policy.pinned = false;
+        policy.sched = sched;
+        policy.priority = priority;
+    }
+
+    static bool parsePolicy(const std::string& s, Policy& policy)
+    {
+        std::istringstream is(s);
+        std::string cpus, sched, priority;
+
+        std::getline(is, cpus, ':');
+        std::getline(is, sched, ':');
+        std::getline(is, priority, ':');
+
+        CPU_ZERO(&policy.cpus);
+        policy.pinned = (cpus != "-");
+        policy.sched = SCHED_OTHER;
+        policy.priority = 0;
+
+        if (policy.pinned && !parseCpus(cpus, policy.cpus)) {
+            return false;
+        }
+
+        if (sched == "fifo") {
+            policy.sched = SCHED_FIFO;
+        } else if (sched == "rr") {
+            policy.sched = SCHED_RR;
+        } else if (!sched.empty() && (sched != "other")) {
+            return false;
+        }
+
+        if (policy.sched != SCHED_OTHER)
+        {
+            char *endp;
+            policy.priority = priority.empty() ? 50 : strtol(priority.c_str(), &endp, 10);
+
+            if ((!priority.empty() && (*endp != '\0')) || (policy.priority < 1) || (policy.priority > 99)) {
+                return false;
+            }
+        }
+
+        return is.eof() || (is.peek() == EOF);
+    }
+
+    /** CPU numbers or ranges separated by '+' */
+    static bool parseCpus(const std::string& s, cpu_set_t& cpus)
+    {
+        std::istringstream is(s);
+        std::string item;
+        bool any = false;
+
+        while (std::getline(is, item, '+'))
+        {
+            char *endp;
+            long first = strtol(item.c_str(), &endp, 10);
+            long last = first;
+
+            if (endp == item.c_str()) {
+                return false;
+            }
+
+            if (*endp == '-')
+            {
+                const char *s2 = endp + 1;
+                last = strtol(s2, &endp, 10);
+
+                if (endp == s2) {
+                    return false;
+                }
+            }
+
+            if ((*endp != '\0') || (first < 0) || (last < first) || (last >= CPU_SETSIZE)) {
+                return false;
+            }
+
+            for (long cpu = first; cpu <= last; cpu++) {
+                CPU_SET(cpu, &cpus);
+            }
+
+            any = true;
+        }
+
+        return any;
+    }
+};
+
+#endif /* INCLUDE_THREADPOLICY_H_ */
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef INCLUDE_TRACEPOINTS_H_
+#define INCLUDE_TRACEPOINTS_H_
+
+/**
+ * USDT (SystemTap SDT) static tracepoints of the provider "sdrdaemon" on the hot path. A disabled probe is a
+ * single nop instruction with its arguments left in registers, so nothing is paid until perf or bpftrace
+ * attaches to it, for example:
+ *
+ *   bpftrace -e 'usdt:./sdrdaemonrx:sdrdaemon:frame_complete { @[arg1] = count(); }'
+ *
+ * The arguments are values already at hand at the probe site. Without <sys/sdt.h> (systemtap-sdt-dev) at build
+ * time or with the USDT cmake option off the probes compile to nothing.
+ *
+ * Probes and arguments:
+ *   device_callback_entry  (samples)                 device block handed over by the driver
+ *   device_callback_exit   (samples)                 converted and pushed
+ *   buffer_push            (samples, queued samples) DataBuffer and RingBuffer
+ *   buffer_pull            (samples, queued samples)
+ *   downsample_begin       (input samples)           Downsampler::process
+ *   downsample_end         (output samples)
+ *   frame_complete         (frame index, Tx slot, frame samples)  UDPSinkFEC frame assembled
+ *   fec_encode_begin       (frame index, FEC blocks)              CM256 encode
+ *   fec_encode_end         (frame index, FEC blocks)
+ *   udp_send               (frame index, first block, datagrams)  each send system call
+ *   fec_decode_begin       (original blocks, recovery blocks)     SDRdaemonFECBuffer CM256 decode
+ *   fec_decode_end         (recovery blocks, success)
+ */
+
+#ifdef HAS_USDT
+#include <sys/sdt.h>
+
+#define SDMN_TRACE1(name, a)          DTRACE_PROBE1(sdrdaemon, name, a)
+#define SDMN_TRACE2(name, a, b)       DTRACE_PROBE2(sdrdaemon, name, a, b)
+#define SDMN_TRACE3(name, a, b, c)    DTRACE_PROBE3(sdrdaemon, name, a, b, c)
+#else
+// the arguments are not evaluated but still compiled so that both builds see the same code
+#define SDMN_TRACE1(name, a)          do { (void) sizeof(a); } while (0)
+#define SDMN_TRACE2(name, a, b)       do { (void) sizeof(a); (void) sizeof(b); } while (0)
+#define SDMN_TRACE3(name, a, b, c)    do { (void) sizeof(a); (void) sizeof(b); (void) sizeof(c); } while (0)
+#endif
+
+#endif /* INCLUDE_TRACEPOINTS_H_ */
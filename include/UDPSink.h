@@ -81,6 +81,18 @@ public:
      */
 	virtual void write(const IQSampleVector& samples_in) = 0;
 
+    /** Connect the socket to the destination so that datagrams are sent without address. Single destination only. */
+    bool connect();
+
+    /** Send the same datagrams to another destination (unicast or multicast group) */
+    bool addDestination(const std::string& address, unsigned int port);
+
+    /** Time to live of the datagrams sent to multicast groups */
+    bool setMulticastTTL(unsigned char ttl);
+
+    /** Let the kernel or NIC split batches of datagrams (UDP segmentation offload) */
+    void setSegmentationOffload(bool gso) { m_socket.SetSegmentationOffload(gso); }
+
     /** Return the last error, or return an empty string if there is no error. */
     std::string error()
     {
@@ -98,8 +110,29 @@ public:
     void setSampleBytes(uint8_t sampleBytes) { m_sampleBytes = (sampleBytes & 0x0F) + (m_sampleBytes & 0xF0); }
     void setSampleBits(uint8_t sampleBits) { m_sampleBits = sampleBits; }
 
+    /** Time the next samples written entered the pipeline (LatencyHistogram::now(), 0: not measured) */
+    void setSampleStamp(int64_t sampleStamp) { m_sampleStamp = sampleStamp; }
+
     virtual void setNbBlocksFEC(int nbBlocksFEC __attribute__((unused))) {};
     virtual void setTxDelay(int txDelay __attribute__((unused))) {};
+    virtual void setTxBatch(int txBatch __attribute__((unused))) {};
+    virtual void setTxPace(int txPace __attribute__((unused))) {};
+    virtual void setFECAuto(int maxNbBlocksFEC __attribute__((unused))) {};
+    virtual void setNack(bool nack __attribute__((unused))) {};
+    virtual void setOverload(bool overload __attribute__((unused))) {};
+    virtual void setFrameBlocks(int nbOriginalBlocks __attribute__((unused))) {};
+    virtual void setFrameTarget(int frameMs __attribute__((unused))) {};
+    virtual void setInterleave(int nbFrames __attribute__((unused))) {};
+    virtual void setFECCodec(int codecId __attribute__((unused))) {};
+
+    /**
+     * The samples from output sample index sampleIndex (counted in samples written) are received on centerFrequency
+     * in Hz after a retune of a frequency scan, the first settleSamples of them are not settled yet. Any thread.
+     */
+    virtual void markRetune(uint64_t sampleIndex __attribute__((unused)),
+            uint64_t centerFrequency __attribute__((unused)),
+            uint32_t settleSamples __attribute__((unused)),
+            uint16_t hopCount __attribute__((unused))) {};
 
     /** Return true if the stream is OK, return false if there is an error. */
     operator bool() const
@@ -108,6 +141,9 @@ public:
     }
 
 protected:
+    /** For the sinks that do not send datagrams themselves (see SHMSink): name is only kept as the address */
+    explicit UDPSink(const std::string& name);
+
     std::string  m_address; //!< UDP foreign address
 	unsigned int m_port;    //!< UDP foreign port
 	unsigned int m_udpSize; //!< Size of UDP block in number of samples
@@ -118,6 +154,7 @@ protected:
     uint8_t      m_sampleBytes;       //!< number of bytes per sample
     uint8_t      m_sampleBits;        //!< number of effective bits per sample
     uint32_t     m_nbSamples;         //!< total number of samples sent int the last frame
+    int64_t      m_sampleStamp;       //!< time stamp of the samples being written
 
     UDPSocket    m_socket;
     MetaData     m_currentMeta;
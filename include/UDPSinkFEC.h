@@ -34,6 +34,9 @@
  *
  * |OB|OB|OB|...|OB|FB|...|FB| : 128 OBs and 1 to 128 FBs
  *
+ * Large frames (up to 1024 OBs and 512 FBs) end each SuperBlock with a LargeTrailer giving the block index
+ * and the number of OBs of the frame in 16 bits. The header filler then says so.
+ *
  * 128 Original blocks are protected with 1 to 128 redundancy (FEC) blocks. This constitutes a transmission frame
  * A transmission frame transmits a data super-frame carried by original blocks
  * A transmission frame is composed of SuperBlocks that have a frame index. The block index is repeated in the SuperBlock as it is used by the decoder.
@@ -48,31 +51,241 @@
 #ifndef INCLUDE_UDPSINKFEC_H_
 #define INCLUDE_UDPSINKFEC_H_
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <string>
-#include "cm256.h"
+#include "FECCodec.h"
 #include "UDPSink.h"
+#include "Pacer.h"
+#include "FECController.h"
+#include "LatencyHistogram.h"
+#include "Squelch.h"
 
-#define UDPSINKFEC_UDPSIZE 512
-#define UDPSINKFEC_NBORIGINALBLOCKS 128
-#define UDPSINKFEC_NBTXBLOCKS 8
+#define UDPSINKFEC_UDPSIZE 512     // default UDP datagram size
+#define UDPSINKFEC_UDPSIZEMIN 96   // smallest UDP datagram size (header, meta data and block CRC)
+#define UDPSINKFEC_UDPSIZEMAX 8972 // largest UDP datagram size (9000 bytes jumbo frames MTU)
+#define UDPSINKFEC_NBORIGINALBLOCKS 128  // largest (and default) number of original blocks per frame including the meta data block
+#define UDPSINKFEC_NBORIGINALBLOCKSMIN 2 // smallest number of original blocks per frame: the meta data and one data block
+#ifdef SDRDAEMON_SMALL_FOOTPRINT
+#define UDPSINKFEC_NBTXBLOCKS 4     // default number of frames in the Tx ring
+#define UDPSINKFEC_NBFECBLOCKS 32   // default largest number of FEC blocks per frame (sizes the Tx ring rows)
+#else
+#define UDPSINKFEC_NBTXBLOCKS 8     // default number of frames in the Tx ring
+#define UDPSINKFEC_NBFECBLOCKS 128  // default largest number of FEC blocks per frame (sizes the Tx ring rows)
+#endif
+#define UDPSINKFEC_NBFECBLOCKSMAX 128 // largest number of FEC blocks per frame
+#define UDPSINKFEC_NBORIGINALBLOCKSLARGE 1024 // largest number of original blocks per large frame
+#define UDPSINKFEC_NBFECBLOCKSLARGE 512 // largest number of FEC blocks per large frame
+#define UDPSINKFEC_NBTXBLOCKSMAX 64 // largest number of frames in the Tx ring
+#define UDPSINKFEC_NBENCODERSMAX 16 // largest number of FEC encoding threads when pipelined
+#define UDPSINKFEC_NACKFRAMES 4     // number of frames sent kept for retransmission
+#define UDPSINKFEC_INTERLEAVEMAX 8  // largest number of frames sent interleaved (reordering window of the receivers)
+#define UDPSINKFEC_PACKED12 0x10    // sample bytes indicator: I/Q pairs of 12 bits packed in 3 bytes
+#define UDPSINKFEC_PACKED8 0x20     // sample bytes indicator: I/Q pairs of 8 bits in 2 bytes
+#define UDPSINKFEC_LZ4 0x40         // sample bytes indicator: the data blocks carry the LZ4 compressed samples
+#define UDPSINKFEC_LZ4RATIO 4       // compressed frames take up to this number of frames worth of samples
+#define UDPSINKFEC_SQUELCH 0x80     // sample bytes indicator: keep-alive frame of the meta data block only standing for silent samples
+#define UDPSINKFEC_BLOCKCRC 0x01    // header filler indicator: the superblock ends with the CRC32C of the rest
+#define UDPSINKFEC_BLOCKSSHIFT 1    // header filler bits 1 to 7: UDPSINKFEC_NBORIGINALBLOCKS minus the original blocks of the frame
+#define UDPSINKFEC_LARGEFRAME 127   // header filler bits 1 to 7 of large frames: the superblock ends with a LargeTrailer
+#define UDPSINKFEC_OVERLOADPACE 25  // percentage of the Tx ring queued behind a frame sent above which its pacing stops
+#define UDPSINKFEC_OVERLOADSHED 50  // percentage of the Tx ring queued ahead of a frame above which more FEC blocks are shed
+#define UDPSINKFEC_ENCODEBUDGET 80  // percentage of the frame duration the FEC encoding threads may spend on a frame
+#define UDPSINKFEC_ANCHORDRIFT 50000000 // nanoseconds the capture times may move away from the anchor before it is taken again
 
 namespace std
 {
     class thread;
 }
 
+class FECEncoderPool;
+
 class UDPSinkFEC : public UDPSink
 {
 public:
-    UDPSinkFEC(const std::string& address, unsigned int port);
+    /**
+     * Construct UDP sink with FEC
+     *
+     * address          :: Address where the samples are sent
+     * port             :: UDP port where the samples are sent
+     * pipelined        :: FEC encoding and sending of frames run in two separate threads
+     * udpSize          :: Size of the UDP datagrams in bytes. Multiple of 4 up to UDPSINKFEC_UDPSIZEMAX
+     * nbTxBlocks       :: Number of frames in the ring between write and the transmit side (2 to UDPSINKFEC_NBTXBLOCKSMAX)
+     * nbEncoders       :: Number of FEC encoding threads when pipelined (1 to UDPSINKFEC_NBENCODERSMAX)
+     * encoderPool      :: FEC encoding threads shared with other sinks used in place of nbEncoders own threads when pipelined (0: own threads)
+     * maxNbBlocksFEC   :: Largest number of FEC blocks per frame (0 to UDPSINKFEC_NBFECBLOCKSMAX, UDPSINKFEC_NBFECBLOCKSLARGE
+     *                     with large frames). The Tx ring rows and the FEC scratch buffers are sized for it and the FEC blocks
+     *                     asked for are capped to it.
+     * maxNbOriginalBlocks :: Largest number of original blocks per frame (UDPSINKFEC_NBORIGINALBLOCKSMIN to
+     *                     UDPSINKFEC_NBORIGINALBLOCKSLARGE). Sizes the Tx ring rows and caps setFrameBlocks. Above
+     *                     UDPSINKFEC_NBORIGINALBLOCKS or with more than UDPSINKFEC_NBFECBLOCKSMAX FEC blocks the sink sends
+     *                     large frames: each superblock ends with a LargeTrailer (4 bytes less samples per block). Frames
+     *                     beyond the 256 blocks of CM256 need the LDPC codec (setFECCodec). No retransmissions (setNack).
+     */
+    UDPSinkFEC(const std::string& address,
+            unsigned int port,
+            bool pipelined = false,
+            unsigned int udpSize = UDPSINKFEC_UDPSIZE,
+            unsigned int nbTxBlocks = UDPSINKFEC_NBTXBLOCKS,
+            unsigned int nbEncoders = 1,
+            FECEncoderPool *encoderPool = 0,
+            unsigned int maxNbBlocksFEC = UDPSINKFEC_NBFECBLOCKS,
+            unsigned int maxNbOriginalBlocks = UDPSINKFEC_NBORIGINALBLOCKS);
     virtual ~UDPSinkFEC();
     virtual void write(const IQSampleVector& samples_in);
     virtual void setNbBlocksFEC(int nbBlocksFEC);
     virtual void setTxDelay(int txDelay);
+    virtual void setTxBatch(int txBatch);
+    virtual void setTxPace(int txPace);
+
+    /**
+     * Adapt the number of FEC blocks (up to maxNbBlocksFEC) and the pacing to the loss reports
+     * sent back by the receiver. 0 stops adapting and leaves the settings as they are.
+     */
+    virtual void setFECAuto(int maxNbBlocksFEC);
+
+    /**
+     * Keep the last UDPSINKFEC_NACKFRAMES frames sent and resend the blocks asked for by the retransmission
+     * requests (FECNack) of the receiver: only as many of the blocks it misses as it needs to restore the frame.
+     * The FEC blocks still restore the frames when resent blocks are lost or come too late. Not available with large frames.
+     */
+    virtual void setNack(bool nack);
+
+    /**
+     * Overload policy (on by default): when the sending side falls behind, the redundancy and the pacing go before
+     * any sample. The rest of a frame being sent goes without pacing or delay as soon as UDPSINKFEC_OVERLOADPACE percent
+     * of the Tx ring is queued behind it. A frame completed with more than UDPSINKFEC_OVERLOADSHED percent of the ring
+     * queued ahead of it has its number of FEC blocks halved, again at each frame, and restored step by step once
+     * the ring is drained. The FEC blocks are also
+     * limited to what the encoding threads can encode in UDPSINKFEC_ENCODEBUDGET percent of the frame duration
+     * at the measured encoding cost. The meta data of each frame gives the FEC blocks it was sent with.
+     */
+    virtual void setOverload(bool overload);
+
+    /**
+     * Number of original blocks per frame including the meta data block: UDPSINKFEC_NBORIGINALBLOCKSMIN to
+     * UDPSINKFEC_NBORIGINALBLOCKS (the default) or the maxNbOriginalBlocks of the constructor. Each frame is also cut
+     * to the blocks its codec can protect with the FEC blocks asked for. Shorter frames take less time to fill: lower latency at low
+     * sample rates for more meta data and FEC overhead. Each frame gives its count in the meta data and in the
+     * filler of all its block headers so that the receivers decode it without its meta data block.
+     * Takes effect at the next frame.
+     */
+    virtual void setFrameBlocks(int nbOriginalBlocks);
+
+    /**
+     * Latency target: frames are cut to the number of blocks that fill in about frameMs milliseconds at the current
+     * sample rate, at most the number of blocks set by setFrameBlocks. 0 (the default) keeps the frames full.
+     */
+    virtual void setFrameTarget(int frameMs);
+
+    /**
+     * Interleave the datagrams of nbFrames consecutive frames (1 to UDPSINKFEC_INTERLEAVEMAX, at most half the Tx ring):
+     * a block of each frame in turn so that a burst of lost datagrams takes only a share of the burst from each frame
+     * and fewer FEC blocks restore it. The sender waits for nbFrames frames which adds nbFrames - 1 frames of latency and
+     * the receivers need a reordering window of at least nbFrames frames. 1 (the default) sends the frames one after
+     * the other. Not used with retransmissions (setNack) that expect the blocks of a frame together.
+     */
+    virtual void setInterleave(int nbFrames);
+
+    /**
+     * Codec of the FEC blocks (FECCODEC_CM256 default, FECCODEC_XOR or FECCODEC_LDPC) given in the meta data of each
+     * frame so the receivers follow. The XOR parity restores bursts of up to the number of FEC blocks in a frame at a
+     * small part of the CPU of CM256 but not scattered losses. The LDPC staircase code protects large frames beyond the
+     * 256 blocks of CM256 for a few more blocks received than the original blocks. Takes effect at the next frame.
+     * A codec that cannot be initialized is not taken.
+     */
+    virtual void setFECCodec(int codecId);
+
+    /**
+     * Largest number of bits per I or Q sample on the network: 16 (default), 12 or 8. The 12 most significant
+     * bits of samples of 12 bits or less are packed in 3 bytes per I/Q pair instead of 4 (25% less bandwidth)
+     * and the 8 most significant bits of samples of 8 bits or less in 2 bytes (50% less bandwidth).
+     * Decided for each frame from the sample bits in effect when it starts: frames of wider samples are
+     * sent in the next wider format. Narrow frames are flagged with UDPSINKFEC_PACKED12 or UDPSINKFEC_PACKED8
+     * in the sample bytes of the meta data.
+     */
+    void setWireBits(unsigned int wireBits) { m_wireBits = wireBits; }
+
+    /**
+     * LZ4 compress the samples of the frames. The frames keep their 128 blocks and carry as many samples as
+     * compress in their data blocks: fewer frames are sent for the same samples. Up to UDPSINKFEC_LZ4RATIO
+     * frames worth of samples are held before compression. Frames end at retunes. Compressed frames are
+     * flagged with UDPSINKFEC_LZ4 in the sample bytes of the meta data.
+     * \return false if not built with LZ4
+     */
+    bool setCompression(bool compression);
+
+    /**
+     * Activity gate: while the mean power of the blocks written stays below thresholdDb (dB full scale, 0: no gate)
+     * for longer than hangoverMs only keep-alive frames are sent: their meta data block alone, flagged with
+     * UDPSINKFEC_SQUELCH, standing for as many silent samples as a frame would carry. The receivers then insert
+     * silence. Frames under way are completed with their samples. Set before the first write.
+     */
+    void setSquelch(float thresholdDb, unsigned int hangoverMs) { m_squelch.configure(thresholdDb, hangoverMs); }
+
+    /**
+     * Block integrity check: each superblock (datagram) ends with the CRC32C of the rest and is flagged with
+     * UDPSINKFEC_BLOCKCRC in its header. The receivers drop the corrupt ones and restore them with the FEC
+     * blocks as if they were lost. The meta data CRC is then a CRC32C too. Costs 4 bytes per datagram.
+     * Set before the first write.
+     */
+    void setBlockCRC(bool blockCRC);
+
+    /** Retunes are marked in the meta data of the frame where they take effect (queued for write) */
+    virtual void markRetune(uint64_t sampleIndex, uint64_t centerFrequency, uint32_t settleSamples, uint16_t hopCount);
+    uint32_t getNbResentBlocks() const { return m_nbResentBlocks; }
+    uint64_t getNbSamplesWritten() const { return m_nbSamplesWritten; } //!< samples given to write()
+    uint64_t getNbFramesEncoded() const { return m_nbFramesEncoded; }   //!< frames FEC encoded (none without FEC blocks)
+    uint64_t getNbFramesSent() const { return m_nbFramesSent; }
+    uint64_t getNbBlocksSent() const { return m_nbBlocksSent; }         //!< UDP datagrams sent not counting the resent ones
+    uint64_t getNbSendErrors() const { return m_nbSendErrors; }         //!< frames not completely sent because of a socket error
+    uint64_t getNbTxWaits() const { return m_nbTxWaits; }               //!< times write() waited for the transmit side (too slow)
+    uint64_t getNbSquelchedFrames() const { return m_nbSquelchedFrames; } //!< keep-alive frames sent in place of idle samples
+    uint64_t getNbShedFrames() const { return m_nbShedFrames; }         //!< frames sent with less FEC blocks because of an overload
+    uint64_t getNbShedBlocks() const { return m_nbShedBlocks; }         //!< FEC blocks not sent because of an overload
+    uint64_t getNbUnpacedFrames() const { return m_nbUnpacedFrames; }   //!< frames sent without their pacing because of an overload
+    int getNbBlocksFEC() const { return m_nbBlocksFEC; }
+    int getFrameBlocks() const { return m_frameBlocks; }                //!< original blocks of the last frame started
+    int getMaxNbBlocksFEC() const { return m_maxNbBlocksFEC; }
+    int getMaxNbOriginalBlocks() const { return m_maxNbOriginalBlocks; }
+    bool isLargeFrames() const { return m_largeFrames; }                //!< superblocks end with a LargeTrailer
+    std::size_t getFECScratchBytes() const { return std::max(m_maxNbBlocksFEC, 1) * m_udpSize; } //!< FEC data of a frame at most
+
+    /**
+     * Memory reserved for the frames: the Tx ring, the frames kept for retransmission and
+     * the FEC scratch buffers of the own encoding threads (a shared pool sizes its buffers at the first frames)
+     */
+    std::size_t getPreallocatedBytes() const;
+
+    /**
+     * Latencies measured when the samples written are stamped (see setSampleStamp):
+     * - frame: from the stamp of the first samples of a frame to the frame completion (includes the frame fill time)
+     * - ring: from the frame completion to the start of its transmission (Tx ring queueing and FEC encoding)
+     * - send: transmission of the frame including pacing
+     * - end to end: from the stamp of the first samples of a frame to its last datagram sent
+     */
+    const LatencyHistogram& getFrameLatency() const { return m_frameLatency; }
+    const LatencyHistogram& getRingLatency() const { return m_ringLatency; }
+    const LatencyHistogram& getSendLatency() const { return m_sendLatency; }
+    const LatencyHistogram& getEndToEndLatency() const { return m_endToEndLatency; }
+
+    /**
+     * Capture time anchor of the stream: the sample stamp of the first write is taken as the capture time of the
+     * sample following the samples written. The meta data of each frame carries the index in the stream of its first
+     * sample with the anchor so that a receiver gets the capture time of any sample from the sample rate without
+     * reading a clock. The anchor is taken again when the sample rate changes or when the stamps drift away from
+     * it by more than UDPSINKFEC_ANCHORDRIFT (dropped device samples or clock drift).
+     */
+    uint64_t getNbAnchors() const { return m_nbAnchors; }
     void reset();
 
+    /** Pin the FEC encoding (all of them) and the sending threads to a CPU each (negative: not pinned). Same thread if not pipelined. */
+    bool setAffinity(int fecCpu, int sendCpu);
+
 private:
 #pragma pack(push, 1)
     struct MetaDataFEC
@@ -86,6 +299,20 @@ private:
         uint32_t m_tv_sec;            //!< 16 seconds of timestamp at start time of super-frame processing
         uint32_t m_tv_usec;           //!< 20 microseconds of timestamp at start time of super-frame processing
         uint32_t m_crc32;             //!< 24 CRC32 of the above
+        uint16_t m_udpSize;           //!< 26 size of the UDP datagrams in bytes (0 from older senders: 512)
+        uint16_t m_hopCount;          //!< 28 frequency scan retunes done (wraps around, 0 without scan)
+        uint32_t m_retuneOffset;      //!< 32 index in the frame of the first sample after a retune (0xFFFFFFFF: no retune)
+        uint32_t m_retuneFrequency;   //!< 36 center frequency in kHz after the retune
+        uint32_t m_settleSamples;     //!< 40 samples not yet settled from the retune (or from the frame start when still settling)
+        uint32_t m_compressedBytes;   //!< 44 length of the LZ4 compressed data in the data blocks (compressed frames)
+        uint32_t m_frameBytes;        //!< 48 length of the data once decompressed (compressed frames)
+        uint32_t m_squelchSamples;    //!< 52 number of silent samples the keep-alive frame stands for (squelched frames)
+        uint64_t m_sampleIndex;       //!< 60 index in the stream of the first sample of the frame (all samples since start)
+        uint64_t m_anchorIndex;       //!< 68 index in the stream of the sample captured at m_anchorTime
+        uint64_t m_anchorTime;        //!< 76 capture time of the anchor sample in nanoseconds since the Unix epoch (0: unknown)
+        uint8_t  m_fecCodec;          //!< 77 codec of the FEC blocks (FECCodec.h, 0 from older senders: CM256)
+        uint16_t m_nbOriginalBlocksLarge; //!< 79 number of original blocks of large frames (0 otherwise: see m_nbOriginalBlocks)
+        uint16_t m_nbFECBlocksLarge;  //!< 81 number of FEC blocks of large frames (0 otherwise: see m_nbFECBlocks)
 
         bool operator==(const MetaDataFEC& rhs)
         {
@@ -106,50 +333,206 @@ private:
         uint8_t  filler;
     };
 
-    static const int samplesPerBlock = (UDPSINKFEC_UDPSIZE - sizeof(Header)) / sizeof(IQSample);
-
-    struct ProtectedBlock
+    /** End of the superblocks of large frames (before the block CRC): the block index and frame size beyond the header 8 bits */
+    struct LargeTrailer
     {
-        IQSample m_samples[samplesPerBlock];
+        uint16_t blockIndex;
+        uint16_t nbOriginalBlocks;
     };
 
-    struct SuperBlock
+#pragma pack(pop)
+
+    /**
+     * A SuperBlock is m_udpSize bytes: the Header followed by the protected block of samples (or FEC)
+     * Its size is only known at run time so blocks are addressed in byte arrays.
+     */
+    uint8_t *txBlock(int txIndex, int blockIndex)
     {
-        Header         header;
-        ProtectedBlock protectedBlock;
+        return &m_txBlocks[(txIndex * m_frameStride + blockIndex) * m_udpSize];
+    }
+
+    /** SuperBlock of a frame kept for retransmission */
+    uint8_t *nackBlock(int nackIndex, int blockIndex)
+    {
+        return &m_nackBlocks[(nackIndex * m_frameStride + blockIndex) * m_udpSize];
+    }
+
+    struct NackFrame
+    {
+        bool m_valid;
+        uint16_t m_frameIndex;
+        int m_nbBlocks;     //!< number of blocks sent (original and FEC)
+        int m_nbOriginalBlocks;
+        bool m_mds;         //!< any original blocks count of the frame restore it (see FECCodec::isMDS)
     };
-#pragma pack(pop)
 
     struct TxControlBlock
     {
-        bool m_processed;
+        bool m_processed;   //!< sent and free for write to fill again (protected by m_txMutex)
+        bool m_encoded;     //!< FEC encoding is done and the frame can be sent (pipelined, protected by m_txMutex)
         uint16_t m_frameIndex;
+        int m_nbOriginalBlocks;  //!< original blocks of the frame including the meta data block
         int m_nbBlocksFEC;
+        FECCodec *m_fecCodec;    //!< codec of the FEC blocks (0: not available, sent without FEC blocks)
         int m_txDelay;
+        int m_txBatch;
+        int m_txPace;
+        uint32_t m_sampleRate;
+        int m_frameSamples;      //!< samples carried by the frame (depends on packing and compression)
+        bool m_squelched;        //!< keep-alive frame: only the meta data block is sent
+        int64_t m_sampleStamp;   //!< time stamp of the first samples of the frame (0: not measured)
+        int64_t m_completeStamp; //!< time the frame was completed by write
+    };
+
+    struct RetuneMark
+    {
+        uint64_t m_sampleIndex;
+        uint64_t m_centerFrequency; //!< Hz
+        uint32_t m_settleSamples;
+        uint16_t m_hopCount;
     };
 
-    CM256 m_cm256;                       //!< CM256 library object
+    std::atomic_int m_fecCodec;          //!< Codec of the FEC blocks of the next frames (FECCodec.h)
     MetaDataFEC m_currentMetaFEC;        //!< Meta data for current frame
     std::atomic_int m_nbBlocksFEC;       //!< Variable number of FEC blocks
     std::atomic_int m_txDelay;           //!< Delay in microseconds (usleep) between each sending of an UDP datagram
-    SuperBlock m_txBlocks[UDPSINKFEC_NBTXBLOCKS][256]; //!< UDP blocks to send with original data + FEC
-    std::thread *m_txThread;             //!< Thread to transmit UDP blocks
-    SuperBlock m_superBlock;             //!< current super block being built
+    std::atomic_int m_txBatch;           //!< Number of UDP datagrams sent per system call (0: whole frame if no delay else 1)
+    std::atomic_int m_txPace;            //!< Percentage of the frame duration over which its datagrams are spread (0: use m_txDelay)
+    Pacer m_pacer;                       //!< Send schedule (used by the sending thread only)
+    std::atomic_int m_txPaceMin;         //!< Pacing set by the user, the FEC controller paces at least that much
+    std::atomic_int m_fecAuto;           //!< Maximum number of FEC blocks used by the FEC controller (0: no control)
+    FECController m_fecController;       //!< Adapts FEC and pacing to the receiver reports (used by the sending thread only)
+    std::atomic_bool m_nack;             //!< Resend blocks on the receiver requests
+    std::atomic_bool m_overload;         //!< Shed FEC blocks and pacing when the sending side falls behind
+    std::atomic_int m_nbOriginalBlocks;  //!< Original blocks per frame set
+    std::atomic_int m_frameTarget;       //!< Frame fill time target in milliseconds (0: none)
+    std::atomic_int m_interleave;        //!< Number of frames sent interleaved (1: none)
+    AlignedVector<uint8_t> m_nackBlocks;   //!< Copies of the last frames sent: UDPSINKFEC_NACKFRAMES rows of m_frameStride SuperBlocks (sending thread only)
+    NackFrame m_nackFrames[UDPSINKFEC_NACKFRAMES]; //!< Frames in m_nackBlocks indexed by frame index modulo UDPSINKFEC_NACKFRAMES
+    uint32_t m_nbResentBlocks;           //!< Number of blocks resent
+    std::atomic<uint64_t> m_nbSamplesWritten; //!< (stats) samples given to write()
+    std::atomic<uint64_t> m_nbFramesEncoded;  //!< (stats) frames FEC encoded
+    std::atomic<uint64_t> m_nbFramesSent;     //!< (stats) frames sent
+    std::atomic<uint64_t> m_nbBlocksSent;     //!< (stats) datagrams sent
+    std::atomic<uint64_t> m_nbSendErrors;     //!< (stats) frames aborted on a send error
+    std::atomic<uint64_t> m_nbTxWaits;        //!< (stats) write() blocked by a full Tx ring
+    std::atomic<uint64_t> m_nbSquelchedFrames; //!< (stats) keep-alive frames
+    std::atomic<uint64_t> m_nbShedFrames;     //!< (stats) frames with FEC blocks shed
+    std::atomic<uint64_t> m_nbShedBlocks;     //!< (stats) FEC blocks shed
+    std::atomic<uint64_t> m_nbUnpacedFrames;  //!< (stats) frames sent without pacing
+    AlignedVector<uint8_t> m_txBlocks;     //!< UDP blocks to send with original data + FEC: m_nbTxBlocks rows of m_frameStride SuperBlocks
+    int m_nbTxBlocks;                    //!< Number of rows (frames) in the Tx ring
+    int m_maxNbBlocksFEC;                //!< Largest number of FEC blocks per frame
+    int m_maxNbOriginalBlocks;           //!< Largest number of original blocks per frame
+    bool m_largeFrames;                  //!< superblocks end with a LargeTrailer (more than 256 blocks per frame possible)
+    int m_frameStride;                   //!< SuperBlocks per row of the Tx ring: m_maxNbOriginalBlocks and m_maxNbBlocksFEC
+    std::vector<const void*> m_interleaveBlocks; //!< datagrams of a group of interleaved frames in sending order (sending thread only)
+    int m_samplesPerBlock;               //!< Number of samples in a protected block of the frame being built
+    int m_protectedBlockSize;            //!< Size in bytes of a protected block (FEC block size)
+    std::thread *m_txThread;             //!< Thread to transmit UDP blocks when not pipelined
+    std::vector<std::thread*> m_encodeThreads; //!< FEC encoding threads when pipelined
+    std::thread *m_sendThread;           //!< Thread to send UDP blocks when pipelined
+    FECEncoderPool *m_encoderPool;       //!< Shared FEC encoding threads used in place of m_encodeThreads (0: none)
+    bool m_pipelined;
     //ProtectedBlock m_fecBlocks[256];     //!< FEC data
     int m_txBlockIndex;                  //!< Current index in blocks to transmit in the Tx row
     int m_txBlocksIndex;                 //!< Current index of Tx blocks row
     uint16_t m_frameCount;               //!< transmission frame count
     int m_sampleIndex;                   //!< Current sample index in protected block data
+    std::atomic_int m_frameBlocks;       //!< Original blocks of the frame being built including the meta data block
     //cm256_encoder_params m_cm256Params;  //!< Main interface with CM256 encoder
     //cm256_block m_descriptorBlocks[256]; //!< Pointers to data for CM256 encoder
-    bool m_cm256Valid;
     std::atomic_bool m_udpSent;          //!< True when UDP sending thread has finished (Frame transmission complete)
     std::atomic_bool m_running;
-    TxControlBlock m_txControlBlocks[UDPSINKFEC_NBTXBLOCKS];
+    std::vector<TxControlBlock> m_txControlBlocks;
     std::atomic_int m_txIndexCurrent;
     std::atomic_int m_txIndexProcessing;
+    std::atomic_int m_txIndexEncoding;   //!< Next Tx blocks row to be taken by a FEC encoding thread when pipelined (changed under m_txMutex)
+    std::mutex m_txMutex;                //!< Protects the sleep on m_txCond, the publication of the rows and m_processed
+    std::condition_variable m_txCond;    //!< Signals any change of the Tx ring indexes
+    time_t m_txSlowTime;                 //!< Time of the last "transmit too slow" warning
+    unsigned int m_txSlowCount;          //!< Number of times write had to wait for the transmit side since the last warning
+    int m_shedLevel;                     //!< FEC blocks of the frames are divided by 2 to this power (write only)
+    time_t m_overloadTime;               //!< Time of the last overload warning (write only)
+    std::atomic<int64_t> m_encodeBlockNs; //!< running average of the FEC encoding time per FEC block in nanoseconds (0: not measured)
+    time_t m_sendErrorTime;              //!< Time of the last send error message
+    int64_t m_frameStamp;                //!< Time stamp of the first samples of the frame being built
+    LatencyHistogram m_frameLatency;     //!< recorded by write
+    LatencyHistogram m_ringLatency;      //!< recorded by the sending thread
+    LatencyHistogram m_sendLatency;      //!< recorded by the sending thread
+    LatencyHistogram m_endToEndLatency;  //!< recorded by the sending thread
+    std::mutex m_retuneMutex;            //!< protects m_retuneMarks
+    std::deque<RetuneMark> m_retuneMarks;     //!< retunes given by markRetune not yet taken by write
+    std::atomic_bool m_retunePending;    //!< m_retuneMarks is not empty
+    std::deque<RetuneMark> m_retunesWrite;    //!< retunes taken by write in sample index order (write only)
+    uint16_t m_hopCount;                 //!< hop count of the last retune (write only)
+    uint64_t m_settleEnd;                //!< sample index where the samples of the last retune are settled (write only)
+    bool m_frameRetune;                  //!< a retune takes effect at the first sample of the frame to build (write only)
+    std::atomic<unsigned int> m_wireBits; //!< largest number of bits per I or Q sample on the network
+    int m_frameSampleBytes;              //!< bytes per I/Q pair in the frame being built: 4, 3 or 2 (write only)
+    std::atomic_bool m_compression;      //!< LZ4 compress the frames
+    bool m_blockCRC;                     //!< superblocks end with their CRC32C
+    bool m_frameCompressed;              //!< the frame being built is compressed (write only)
+    AlignedVector<uint8_t> m_compressInput;  //!< samples in the frame format waiting for compression (write only)
+    AlignedVector<uint8_t> m_compressOutput; //!< compressed data of a frame before it is split in its data blocks (write only)
+    Squelch m_squelch;                   //!< activity gate (write only)
+    bool m_frameSquelched;               //!< the frame being built is a keep-alive frame counting silent samples in m_sampleIndex (write only)
+    uint64_t m_anchorIndex;              //!< index in the stream of the anchor sample (write only)
+    int64_t m_anchorStamp;               //!< sample stamp of the anchor sample (0: no anchor, write only)
+    int64_t m_anchorClock;               //!< Unix time minus sample stamp time at the anchor in nanoseconds (write only)
+    uint32_t m_anchorRate;               //!< sample rate when the anchor was taken (write only)
+    std::atomic<uint64_t> m_nbAnchors;   //!< (stats) anchors taken
 
+    /** Block until pred is true or the sink is stopped */
+    template<typename Pred>
+    void waitTx(Pred pred)
+    {
+        std::unique_lock<std::mutex> lock(m_txMutex);
+        m_txCond.wait(lock, [&]() { return pred() || !m_running.load(); });
+    }
+
+    /** Wake up the threads waiting after a change of the Tx ring indexes */
+    void notifyTx()
+    {
+        std::unique_lock<std::mutex> lock(m_txMutex);
+        m_txCond.notify_all();
+    }
+
+    void sealBlocks(int txIndex, int nbBlocks);
+    bool encodeFrame(int txIndex, CM256::cm256_encoder_params& cm256Params, FECBlock *descriptorBlocks, uint8_t *fecBlocks);
+    void encodePooled(int txIndex, CM256::cm256_encoder_params& cm256Params, FECBlock *descriptorBlocks, uint8_t *fecBlocks);
+    void sendFrames(int txIndex, int nbFrames);
+    void sendBlocks(int txIndex);
+    void sendInterleaved(int txIndex, int nbFrames);
+    int frameBlocks(int txIndex) const;
+
+    /** Frames sent at a time from the Tx ring: more than 1 when interleaving */
+    int interleaveFrames() const { return m_nack.load() ? 1 : std::min<int>(m_interleave.load(), m_nbTxBlocks / 2); }
+    void pollFeedback();
+    void keepFrame(int txIndex);
+    void resendBlocks(const FECNack& nack);
+    void applyRetune(const RetuneMark& mark, uint64_t sampleIndex);
+    void copySamples(uint8_t *out, const IQSample *samples, int nbSamples);
+    int wireSampleBytes() const;
+    int nextFrameBlocks() const;
+
+    void writeHeader(uint8_t *block, uint16_t frameIndex, int blockIndex, int nbOriginalBlocks);
+    void setMetaBlocks(MetaDataFEC& metaData, int nbOriginalBlocks, int nbBlocksFEC);
+    int codecMaxBlocks() const;
+    void anchorStamp(uint64_t sampleIndex, int64_t sampleStamp);
+    void startFrame(uint64_t sampleIndex);
+    void sealMeta(MetaDataFEC& metaData);
+    void applyOverload(int frameSamples, int& nbBlocksFEC);
+    void completeFrame(int frameSamples);
+    void completeSquelched();
+    void compressFrame();
+    void flushCompressed(uint64_t sampleIndex);
+    int compressPending() const { return m_frameCompressed ? m_compressInput.size() / m_frameSampleBytes : 0; }
     static void transmitUDP(UDPSinkFEC *udpSinkFEC);
+    static void encodeUDP(UDPSinkFEC *udpSinkFEC);
+    static void sendUDP(UDPSinkFEC *udpSinkFEC);
+
+    friend class FECEncoderPool;
 };
 
 
@@ -24,6 +24,7 @@
 #include <cstring>            // For string
 #include <exception>         // For exception class
 #include <string>
+#include <vector>
 #include <sys/types.h>       // For data types
 #include <sys/socket.h>      // For socket(), connect(), send(), and recv()
 #include <netdb.h>           // For gethostbyname()
@@ -157,6 +158,37 @@ public:
     */
     void SetReadBufferSize(unsigned int nSize) throw(CSocketException);
 
+    /**
+    *   Sets a timeout on receive calls. They then return no data after the timeout.
+    *   @param timeout in milliseconds. 0 waits indefinitely.
+    */
+    void SetReadTimeout(unsigned int timeoutMs) throw(CSocketException);
+
+    /**
+    *   Attach (true) or detach (false) a filter dropping all incoming data in the kernel before it is queued.
+    *   Used when the data is received by other means (packet ring) but the socket must stay bound.
+    */
+    void SetDropFilter(bool drop) throw(CSocketException);
+
+    /**
+    *   Allow (true) several sockets to bind the same address and port (SO_REUSEPORT). Call before binding.
+    *   The kernel then spreads the incoming datagrams over the sockets by a hash of the source address and port.
+    */
+    void SetReusePort(bool reusePort) throw(CSocketException);
+
+    /**
+    *   Have the kernel timestamp the arrival of the datagrams (SO_TIMESTAMPING). The timestamps are
+    *   taken by the network stack or, with hardware true, by the network card if it supports it
+    *   (the card must also be told to timestamp with the SIOCSHWTSTAMP ioctl, for example with hwstamp_ctl).
+    *   Hardware timestamps are in the clock of the card which must be synchronized to the system clock (phc2sys).
+    */
+    void SetTimestamping(bool hardware) throw(CSocketException);
+
+    /**
+    *   Returns the socket descriptor, for example to wait on several sockets with poll().
+    */
+    int GetSocketDescriptor() const { return m_sockDesc; }
+
     /**
     *   Sets the socket to Blocking/Non blocking state.
     *   @param Bool flag for Non blocking status.
@@ -283,6 +315,31 @@ public:
    */
     void DisconnectFromHost() throw(CSocketException);
 
+  /**
+   *   Resolve the foreign address and port once for the sends without address.
+   *   Can be called again when the destination changes.
+   *   @param foreignAddress address (IP address or name) to send to
+   *   @param foreignPort port number to send to
+   *   @param connectSocket also connect() the socket so that the kernel does not look up the route for each datagram
+   *   @exception SocketException thrown if unable to resolve the address or to connect
+   */
+    void SetForeignAddress(const string &foreignAddress, unsigned short foreignPort, bool connectSocket = false) throw(CSocketException);
+
+  /**
+   *   Add a destination to the one given to SetForeignAddress. The sends without address
+   *   then send each datagram to all destinations in the order they were given.
+   *   Not possible on a connected socket.
+   *   @param foreignAddress address (IP address or name) to send to
+   *   @param foreignPort port number to send to
+   *   @exception SocketException thrown if unable to resolve the address or if the socket is connected
+   */
+    void AddForeignAddress(const string &foreignAddress, unsigned short foreignPort) throw(CSocketException);
+
+  /**
+   *   @return number of destinations of the sends without address
+   */
+    unsigned int GetForeignAddressCount() const { return m_foreignAddrs.size(); }
+
   /**
    *   Send the given buffer as a UDP datagram to the
    *   specified address/port
@@ -296,6 +353,54 @@ public:
     void SendDataGram(const void *buffer, int bufferLen, const string &foreignAddress,
         unsigned short foreignPort) throw(CSocketException);
 
+  /**
+   *   Send count datagrams of bufferLen bytes laid out contiguously in buffer
+   *   to the specified address/port with as few system calls as possible (sendmmsg)
+   *   @param buffer first datagram to be written
+   *   @param bufferLen number of bytes of each datagram (also the stride in buffer)
+   *   @param count number of datagrams
+   *   @param foreignAddress address (IP address or name) to send to
+   *   @param foreignPort port number to send to
+   *   @exception SocketException thrown if unable to send all datagrams
+   */
+    void SendDataGrams(const void *buffer, int bufferLen, int count, const string &foreignAddress,
+        unsigned short foreignPort) throw(CSocketException);
+
+  /**
+   *   Send the given buffer as a UDP datagram to the address given to SetForeignAddress (and AddForeignAddress)
+   *   @param buffer buffer to be written
+   *   @param bufferLen number of bytes to write
+   *   @exception SocketException thrown if unable to send datagram
+   */
+    void SendDataGram(const void *buffer, int bufferLen) throw(CSocketException);
+
+  /**
+   *   Send count contiguous datagrams to the address given to SetForeignAddress (and AddForeignAddress) with sendmmsg
+   *   @param buffer first datagram to be written
+   *   @param bufferLen number of bytes of each datagram (also the stride in buffer)
+   *   @param count number of datagrams
+   *   @exception SocketException thrown if unable to send all datagrams
+   */
+    void SendDataGrams(const void *buffer, int bufferLen, int count) throw(CSocketException);
+
+  /**
+   *   Send count datagrams of bufferLen bytes found at the given addresses to the address given to SetForeignAddress
+   *   (and AddForeignAddress) with sendmmsg. Same as SendDataGrams for datagrams that are not contiguous.
+   *   @param buffers address of each datagram
+   *   @param bufferLen number of bytes of each datagram
+   *   @param count number of datagrams
+   *   @exception SocketException thrown if unable to send all datagrams
+   */
+    void SendDataGramList(const void * const *buffers, int bufferLen, int count) throw(CSocketException);
+
+  /**
+   *   Use UDP generic segmentation offload (Linux UDP_SEGMENT) in SendDataGrams without address.
+   *   Up to 64 contiguous datagrams are passed in one buffer and split by the kernel or the NIC.
+   *   Datagrams on the wire are the same. If the kernel refuses it SendDataGrams falls back to sendmmsg.
+   *   @param gso true to use segmentation offload
+   */
+    void SetSegmentationOffload(bool gso) { m_gso = gso; }
+
     /**
      *   Read read up to bufferLen bytes data from this socket.  The given buffer
      *   is where the data will be placed
@@ -309,6 +414,33 @@ public:
     int RecvDataGram(void *buffer, int bufferLen, string &sourceAddress,
                unsigned short &sourcePort) throw(CSocketException);
 
+    /**
+     *   Read a datagram if one is pending without blocking and without changing the
+     *   blocking mode of the socket (so it can be used on a socket sending from another thread)
+     *   @param buffer buffer to receive data
+     *   @param bufferLen maximum number of bytes to receive
+     *   @return number of bytes received and 0 if no datagram is pending
+     *   @exception SocketException thrown if unable to receive datagram
+     */
+    int RecvDataGramNoWait(void *buffer, int bufferLen) throw(CSocketException);
+
+    /**
+     *   Receive up to count datagrams with one system call (recvmmsg). Blocks until at least one
+     *   datagram is available then returns all those already queued without waiting more.
+     *   Datagrams are placed contiguously in buffer with a stride of bufferLen.
+     *   The source addresses are not formatted, they are only copied if sourceAddrs is given.
+     *   @param buffer room for count datagrams of bufferLen bytes
+     *   @param bufferLen maximum number of bytes of each datagram (also the stride in buffer)
+     *   @param count maximum number of datagrams (at most 64 are received at once)
+     *   @param lengths receives the length of each datagram
+     *   @param sourceAddrs if not null receives the source address of each datagram
+     *   @param timestamps if not null receives the arrival time of each datagram (see SetTimestamping, 0 if none)
+     *   @return number of datagrams received, 0 if none arrived before the read timeout (see SetReadTimeout)
+     *   @exception SocketException thrown if unable to receive datagrams
+     */
+    int RecvDataGrams(void *buffer, int bufferLen, int count, int *lengths, sockaddr_in *sourceAddrs = 0,
+            timespec *timestamps = 0) throw(CSocketException);
+
     /**
     *   Set the multicast TTL
     *   @param multicastTTL multicast TTL
@@ -332,6 +464,13 @@ public:
 
 private:
     void SetBroadcast();
+    void SendDataGrams(const void *buffer, int bufferLen, int count, sockaddr_in *destAddr) throw(CSocketException);
+    void SendDataGramList(const void * const *buffers, int bufferLen, int count, sockaddr_in *destAddr) throw(CSocketException);
+    bool SendSegmented(const void *buffer, int bufferLen, int count, sockaddr_in *destAddr) throw(CSocketException);
+
+    std::vector<sockaddr_in> m_foreignAddrs; //!< destinations resolved by SetForeignAddress and AddForeignAddress
+    bool m_connected;          //!< socket is connected to the only destination: send without address
+    bool m_gso;                //!< use UDP segmentation offload
 
 };
 
@@ -22,6 +22,7 @@
 
 #include <string.h>
 #include <cstddef>
+#include <atomic>
 
 #include "SDRDaemon.h"
 #include "UDPSocket.h"
@@ -87,6 +88,46 @@ public:
 	 */
 	virtual void getStatusMessage(char *messageBuffer) = 0;
 
+	/**
+	 * Send loss reports back to the sender of the samples
+	 */
+	virtual void setFeedback(bool feedback __attribute__((unused))) {}
+
+	/**
+	 * Request the retransmission of the blocks missing to restore a frame from the sender of the samples
+	 */
+	virtual void setNack(bool nack __attribute__((unused))) {}
+
+	/**
+	 * Number of frames decoded concurrently so that reordered blocks still make it to their frame
+	 */
+	virtual void setReorderWindow(int nbFrames __attribute__((unused))) {}
+
+	/**
+	 * Drop the blocks of frames arriving more than deadlineMs milliseconds late (0: never)
+	 */
+	virtual void setDeadline(int deadlineMs __attribute__((unused))) {}
+
+	/**
+	 * Timestamp the arrival of the datagrams to measure the latency and jitter of the frames (false: none)
+	 */
+	virtual void setTimestamping(bool timestamping __attribute__((unused)), bool hardware __attribute__((unused))) {}
+
+	/**
+	 * Receive in a separate thread and only hand over the received samples in read()
+	 */
+	virtual void setReceiveThread(bool receiveThread __attribute__((unused))) {}
+
+	/**
+	 * Receive through a memory mapped packet ring on the given network interface. Returns false if not possible
+	 */
+	virtual bool setPacketRing(const std::string& interface __attribute__((unused))) { return false; }
+
+	/**
+	 * Record the datagrams received with their arrival time to this file (see BlockCapture). Returns false if not possible
+	 */
+	virtual bool setCapture(const std::string& filename __attribute__((unused))) { return false; }
+
     /** Return the last error, or return an empty string if there is no error. */
     std::string error()
     {
@@ -97,6 +138,8 @@ public:
 
     uint8_t getSampleBytes() const { return m_sampleBytes; }
     uint8_t getSampleBits() { return m_sampleBits; }
+    /** Sample rate of the stream from the meta data of the last frame read (0: none yet) */
+    uint32_t getSampleRate() const { return m_sampleRate.load(); }
 
     /** Return true if the stream is OK, return false if there is an error. */
     operator bool() const
@@ -113,6 +156,7 @@ protected:
     uint8_t      m_sampleBytes;       //!< number of bytes per sample
     uint8_t      m_sampleBits;        //!< number of effective bits per sample
     uint32_t     m_nbSamples;         //!< total number of samples sent int the last frame
+    std::atomic<uint32_t> m_sampleRate; //!< stream sample rate in Hz
 
     UDPSocket    m_socket;
     MetaData     m_currentMeta;
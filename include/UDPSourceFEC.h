@@ -54,9 +54,19 @@
 #include <string>
 #include "UDPSource.h"
 #include "SDRdaemonFECBuffer.h"
-
-#define UDPSOURCEFEC_UDPSIZE 512
+#include "FECFeedback.h"
+#include "RingBuffer.h"
+#include "VectorPool.h"
+#include "PacketRing.h"
+#include "LatencyStats.h"
+#include "BlockCapture.h"
+
+#define UDPSOURCEFEC_UDPSIZE 512     // default UDP datagram size
+#define UDPSOURCEFEC_UDPSIZEMAX 8972 // largest UDP datagram size (9000 bytes jumbo frames MTU)
 #define UDPSOURCEFEC_NBORIGINALBLOCKS 128
+#define UDPSOURCEFEC_RXBATCH 64        // largest number of UDP blocks received in one system call
+#define UDPSOURCEFEC_NBRXFRAMES 64     // frames queued between the receive thread and read()
+#define UDPSOURCEFEC_RXTIMEOUT 100     // receive timeout in milliseconds of the receive thread so that it can be stopped
 
 namespace std
 {
@@ -70,7 +80,9 @@ public:
     virtual ~UDPSourceFEC();
 
     /**
-     * Read IQ samples from UDP port. Returns a complete protected frame of 127*127 samples
+     * Read IQ samples from UDP port. Returns a complete protected frame of 127 blocks of samples
+     * (127*127 samples with the default 512 bytes datagrams) or of the fewer blocks of the frames of the sender.
+     * The datagram size is taken from the received datagrams.
      */
     virtual void read(IQSampleVector& samples_in);
 
@@ -79,6 +91,66 @@ public:
      */
     virtual void getStatusMessage(char *messageBuffer);
 
+    /**
+     * Send a FECFeedback report about once per second to the address and port the UDP blocks come from
+     */
+    virtual void setFeedback(bool feedback) { m_feedback = feedback; }
+
+    /**
+     * Send a FECNack retransmission request to the address and port the UDP blocks come from for each frame
+     * that cannot be restored when the blocks of the next frame start arriving (see SDRdaemonFECBuffer::setNack).
+     * Needs a reordering window. Call before reading.
+     */
+    virtual void setNack(bool nack);
+
+    /**
+     * Keep nbFrames frames open in the FEC decoder for blocks arriving out of order. Call before reading.
+     */
+    virtual void setReorderWindow(int nbFrames) { m_sdmnFECBuffer.setReorderWindow(nbFrames); }
+
+    /**
+     * Drop the blocks of frames arriving more than deadlineMs after their expected time and restart at once
+     * after an outage (see SDRdaemonFECBuffer::setDeadline). Call before reading.
+     */
+    virtual void setDeadline(int deadlineMs) { m_sdmnFECBuffer.setDeadline(deadlineMs); }
+
+    /**
+     * Start (true) or stop (false) a thread that receives and decodes frames continuously. read() then
+     * only takes the next decoded frame from a lock-free queue so that the socket is drained while the
+     * caller is busy. Frames are dropped if the queue of UDPSOURCEFEC_NBRXFRAMES frames is full.
+     */
+    virtual void setReceiveThread(bool receiveThread);
+
+    /**
+     * Receive through a memory mapped packet ring on the given network interface instead of the
+     * socket (see PacketRing). Needs CAP_NET_RAW. Call before reading. Returns false and keeps
+     * using the socket on error.
+     */
+    virtual bool setPacketRing(const std::string& interface);
+
+    /**
+     * Record the datagrams received with their arrival time (kernel time stamps if timestamping) to this
+     * file for sdrdaemon_replay. Records are appended to an existing capture. Returns false if the file
+     * cannot be opened.
+     */
+    virtual bool setCapture(const std::string& filename);
+
+    /**
+     * Timestamp the arrival of the datagrams in the kernel (or in the network card with hardware true) and
+     * compute the one-way latency and jitter of the frames from the time stamp of their meta data block.
+     * The status message then ends with :<average latency>/<largest latency>/<jitter> in milliseconds.
+     * Call before reading.
+     */
+    virtual void setTimestamping(bool timestamping, bool hardware);
+
+    const LatencyStats& getLatencyStats() const { return m_latencyStats; }
+
+    /** FEC decoder with its block and frame counters */
+    const SDRdaemonFECBuffer& getFECBuffer() const { return m_sdmnFECBuffer; }
+
+    /** Number of decoded frames dropped because read() did not take them in time (receive thread only) */
+    std::size_t getNbDroppedFrames() const { return m_rxFrames.dropped_blocks(); }
+
 private:
 #pragma pack(push, 1)
     struct MetaDataFEC
@@ -92,6 +164,20 @@ private:
         uint32_t m_tv_sec;            //!< 16 seconds of timestamp at start time of super-frame processing
         uint32_t m_tv_usec;           //!< 20 microseconds of timestamp at start time of super-frame processing
         uint32_t m_crc32;             //!< 24 CRC32 of the above
+        uint16_t m_udpSize;           //!< 26 size of the UDP datagrams in bytes (0 from older senders: 512)
+        uint16_t m_hopCount;          //!< 28 frequency scan retunes done (wraps around, 0 without scan)
+        uint32_t m_retuneOffset;      //!< 32 index in the frame of the first sample after a retune (0xFFFFFFFF: no retune)
+        uint32_t m_retuneFrequency;   //!< 36 center frequency in kHz after the retune
+        uint32_t m_settleSamples;     //!< 40 samples not yet settled from the retune (or from the frame start when still settling)
+        uint32_t m_compressedBytes;   //!< 44 length of the LZ4 compressed data in the data blocks (compressed frames)
+        uint32_t m_frameBytes;        //!< 48 length of the data once decompressed (compressed frames)
+        uint32_t m_squelchSamples;    //!< 52 number of silent samples the keep-alive frame stands for (squelched frames)
+        uint64_t m_sampleIndex;       //!< 60 index in the stream of the first sample of the frame (all samples since start)
+        uint64_t m_anchorIndex;       //!< 68 index in the stream of the sample captured at m_anchorTime
+        uint64_t m_anchorTime;        //!< 76 capture time of the anchor sample in nanoseconds since the Unix epoch (0: unknown)
+        uint8_t  m_fecCodec;          //!< 77 codec of the FEC blocks (FECCodec.h, 0 from older senders: CM256)
+        uint16_t m_nbOriginalBlocksLarge; //!< 79 number of original blocks of large frames (0 otherwise: see m_nbOriginalBlocks)
+        uint16_t m_nbFECBlocksLarge;  //!< 81 number of FEC blocks of large frames (0 otherwise: see m_nbFECBlocks)
 
         bool operator==(const MetaDataFEC& rhs)
         {
@@ -111,34 +197,39 @@ private:
         uint8_t  blockIndex;
         uint8_t  filler;
     };
-
-    static const int samplesPerBlock = (UDPSOURCEFEC_UDPSIZE - sizeof(Header)) / sizeof(IQSample);
-
-    struct ProtectedBlock
-    {
-        IQSample m_samples[samplesPerBlock];
-    };
-
-    struct SuperBlock
-    {
-        Header         header;
-        ProtectedBlock protectedBlock;
-    };
 #pragma pack(pop)
 
     SDRdaemonFECBuffer m_sdmnFECBuffer;  //!< FEC handling buffer
     MetaDataFEC m_currentMetaFEC;        //!< Meta data for current frame
-    SuperBlock m_rxBlocks[4][256];       //!< UDP blocks received with original data + FEC
-    std::thread *m_rxThread;             //!< Thread to transmit UDP blocks
-    SuperBlock m_superBlock;             //!< current super block being built
+    AlignedVector<uint8_t> m_rxBlocks;     //!< UDP blocks (SuperBlocks) of the last batch received, m_udpSize apart
+    std::vector<uint8_t*> m_rxPtrs;      //!< UDP blocks of the last batch: in m_rxBlocks or in the packet ring
+    PacketRing m_packetRing;             //!< Packet ring used instead of the socket when open
+    std::vector<int> m_rxLengths;        //!< Lengths of the UDP blocks of the last batch
+    std::vector<sockaddr_in> m_rxAddrs;  //!< Source addresses of the UDP blocks of the last batch
+    std::vector<timespec> m_rxStamps;    //!< Arrival times of the UDP blocks of the last batch when timestamping
+    bool m_timestamping;                 //!< Arrival times are taken
+    BlockCapture m_capture;              //!< Record of the datagrams received (closed: none)
+    LatencyStats m_latencyStats;         //!< Latency and jitter of the frames
+    int m_rxCount;                       //!< Number of UDP blocks in the last batch
+    int m_rxNext;                        //!< Next UDP block of the last batch to process
+    std::thread *m_rxThread;             //!< Thread to receive and decode UDP blocks (0 if read() does it)
     //ProtectedBlock m_fecBlocks[256];     //!< FEC data
-    int m_rxBlockIndex;                  //!< Current index in blocks to transmit in the Tx row
-    int m_rxBlocksIndex;                 //!< Current index of Tx blocks row
-    uint16_t m_frameCount;               //!< transmission frame count
-    int m_sampleIndex;                   //!< Current sample index in protected block data
-    std::atomic_bool m_udpReceived;      //!< True when UDP receiving thread has finished (Frame reception complete)
-
-    static int receiveUDP(UDPSourceFEC *udpSourceFEC, SuperBlock *superBlock);
+    std::atomic_bool m_rxRunning;        //!< Receive thread keeps running while true
+    RingBuffer<IQSample> m_rxFrames;     //!< Decoded frames from the receive thread to read()
+    VectorPool<IQSample> m_rxFramesPool; //!< Frame vectors given back by read() to the receive thread
+    time_t m_rxDropTime;                 //!< Time of the last frame dropped warning
+    bool m_feedback;                     //!< Send loss reports to the sender
+    FECFeedback m_feedbackReport;        //!< Loss report being accumulated
+    time_t m_feedbackTime;               //!< Time the last report was sent
+    bool m_nack;                         //!< Send retransmission requests to the sender
+    sockaddr_in m_senderAddr;            //!< Source address of the last UDP block received (family 0 if none)
+
+    bool readFrame(IQSampleVector& samples_out);
+    void updateFeedback();
+    void sendNacks();
+    void updateLatency(uint8_t *rxBlock, int length, const timespec& arrival);
+    static int receiveUDP(UDPSourceFEC *udpSourceFEC);
+    static void receiveFrames(UDPSourceFEC *udpSourceFEC);
 };
 
 
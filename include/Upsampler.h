@@ -21,6 +21,7 @@
 #define INCLUDE_UPSAMPLER_H_
 
 #include "Interpolators.h"
+#include "RationalResampler.h"
 #include "SDRDaemon.h"
 #include "parsekv.h"
 
@@ -44,6 +45,12 @@ public:
     /** Return log2 of interpolation */
     unsigned int getLog2Interpolation() const { return m_interp; }
 
+    /** Give the rate of the incoming stream so that the rational stage can resample it to srate_out. Returns false on error. */
+    bool setSampleRate(uint32_t sampleRate);
+
+    /** True if the rational stage resamples before the interpolators */
+    bool isResampling() const { return m_resampler.active(); }
+
     /**
      * Process samples.
      */
@@ -64,8 +71,15 @@ public:
     }
 
 private:
+    /** Power of two interpolation stage */
+    void interpolate(const IQSampleVector& samples_in, IQSampleVector& samples_out);
+
     unsigned int  m_interp;
+    bool          m_blockInterp; //!< use block cascade for interpolation
     Interpolators m_interpolators;
+    uint32_t      m_srateOut;    //!< output rate of the rational stage (0: none)
+    RationalResampler m_resampler;
+    IQSampleVector    m_resampled;
     std::string   m_error;
 };
 
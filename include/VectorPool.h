@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#ifndef _INCLUDE_VECTORPOOL_H_
+#define _INCLUDE_VECTORPOOL_H_
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+
+#include "AlignedAllocator.h"
+
+/**
+ * Free list of sample vectors recycled between the consumers and the producer of a DataBuffer.
+ *
+ * Recycled vectors keep their size so that getting a vector of the same length again
+ * (the usual case with fixed size device transfers) does neither allocate nor initialize.
+ * Device blocks and decimated blocks of very different lengths share the pool so a free
+ * vector is only reused for a length it fits closely (between half and all of its capacity).
+ * Each kind of block thus circulates its own storage and growing a small vector for a large
+ * block, which would then be missing for the next small block, never happens. When the pool
+ * is full the oldest free vector is released so that sizes no longer in use age out.
+ * The lock is only held for a short scan and a vector swap and is practically never contended.
+ */
+template <class Element>
+class VectorPool
+{
+public:
+    /** Constructor. At most maxVectors are kept, extra returned vectors are freed. */
+    VectorPool(std::size_t maxVectors = 64)
+        : m_maxVectors(maxVectors)
+        , m_allocated(0)
+    {
+        m_free.reserve(maxVectors);
+    }
+
+    /** Give a vector of size n in v. Previous content of v is lost. */
+    void get(AlignedVector<Element>& v, std::size_t n)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            // most recently returned first: it is the most likely to be still in cache
+            for (std::size_t i = m_free.size(); i > 0; i--)
+            {
+                std::size_t capacity = m_free[i-1].capacity();
+
+                if ((capacity >= n) && (capacity <= 2*n))
+                {
+                    v.swap(m_free[i-1]);
+                    m_free.erase(m_free.begin() + (i-1));
+                    break;
+                }
+            }
+        }
+
+        if (v.capacity() < n) {
+            m_allocated++;
+        }
+
+        v.resize(n);
+    }
+
+    /** Return a vector to the pool */
+    void put(AlignedVector<Element>&& v)
+    {
+        if (v.capacity() == 0) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_free.size() == m_maxVectors) {
+            m_free.erase(m_free.begin());
+        }
+
+        m_free.push_back(std::move(v));
+    }
+
+    /** Number of times a vector had to be (re)allocated. Stops growing in steady state. */
+    std::size_t allocated() const { return m_allocated; }
+
+private:
+    std::size_t m_maxVectors;
+    std::atomic<std::size_t> m_allocated;
+    std::vector<AlignedVector<Element> > m_free;
+    std::mutex m_mutex;
+};
+
+#endif
@@ -40,7 +40,7 @@ namespace parsekv
             query =  pair >> *((qi::lit(',') | '&') >> pair);
             pair  =  key >> -('=' >> value);
             key   =  qi::char_("a-zA-Z_") >> *qi::char_("a-zA-Z_0-9");
-            value = +qi::char_("a-zA-Z_0-9.");
+            value = +qi::char_("a-zA-Z_0-9./:-"); // / and : for lists (scan hops), - for negative offsets (shift, tones)
         }
 
         qi::rule<Iterator, pairs_type()> query;
@@ -20,6 +20,11 @@
 #define INCLUDE_UTIL_H_
 
 #include <cmath>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+#include "ThreadPolicy.h"
 
 inline bool parse_dbl(const char *s, double& v)
 {
@@ -51,6 +56,45 @@ inline bool parse_dbl(const char *s, double& v)
     return (*endp == '\0');
 }
 
+/** Pin a thread to one CPU. Negative cpu leaves the thread free to run anywhere. */
+inline bool set_thread_affinity(pthread_t thread, int cpu)
+{
+    if (cpu < 0) {
+        return true;
+    }
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+
+    return pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset) == 0;
+}
+
+/**
+ * Name a thread as shown by top -H and in the metrics. At most 15 characters are kept.
+ * The CPU set and scheduling given for this name (see ThreadPolicy) are applied.
+ */
+inline void set_thread_name(pthread_t thread, const char *name)
+{
+    char shortName[16];
+    strncpy(shortName, name, sizeof(shortName) - 1);
+    shortName[sizeof(shortName) - 1] = '\0';
+    pthread_setname_np(thread, shortName);
+    ThreadPolicy::apply(thread, name);
+}
+
+/** Name the calling thread the first time it calls (threads of the device libraries calling back) */
+inline void set_current_thread_name_once(const char *name)
+{
+    static thread_local bool named = false;
+
+    if (!named)
+    {
+        set_thread_name(pthread_self(), name);
+        named = true;
+    }
+}
+
 inline float db2P(int db)
 {
 	return pow(10.0, (db / 10.0));
@@ -25,16 +25,17 @@
 #include <cerrno>
 
 #include "AirspySource.h"
+#include "Tracepoints.h"
+#include "SampleConversion.h"
 #include "util.h"
 #include "parsekv.h"
 
-AirspySource *AirspySource::m_this = 0;
 const std::vector<int> AirspySource::m_lgains({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14});
 const std::vector<int> AirspySource::m_mgains({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15});
 const std::vector<int> AirspySource::m_vgains({0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15});
 
 // Open Airspy device.
-AirspySource::AirspySource(int dev_index) :
+AirspySource::AirspySource(int dev_index, const std::string& serial) :
     m_dev(0),
     m_sampleRate(10000000),
     m_frequency(100000000),
@@ -45,6 +46,8 @@ AirspySource::AirspySource(int dev_index) :
     m_biasAnt(false),
     m_lnaAGC(false),
     m_mixAGC(false),
+    m_raw(false),
+    m_packing(false),
     m_running(false),
     m_thread(0)
 {
@@ -57,6 +60,20 @@ AirspySource::AirspySource(int dev_index) :
         m_error = err_ostr.str();
         m_dev = 0;
     }
+    else if (!serial.empty())
+    {
+        // straight to the device without opening the others
+        uint64_t serialNumber = strtoull(serial.c_str(), 0, 16);
+        rc = (airspy_error) airspy_open_sn(&m_dev, serialNumber);
+
+        if (rc != AIRSPY_SUCCESS)
+        {
+            std::ostringstream err_ostr;
+            err_ostr << "Failed to open Airspy device with serial " << serial << " (" << rc << ": " << airspy_error_name(rc) << ")";
+            m_error = err_ostr.str();
+            m_dev = 0;
+        }
+    }
     else
     {
         for (int i = 0; i < AIRSPY_MAX_DEVICE; i++)
@@ -69,6 +86,9 @@ AirspySource::AirspySource(int dev_index) :
                 {
                     break;
                 }
+
+                airspy_close(m_dev); // the library opens the next free device each time
+                m_dev = 0;
             }
             else
             {
@@ -76,6 +96,7 @@ AirspySource::AirspySource(int dev_index) :
                 err_ostr << "Failed to open Airspy device at sequence " << i;
                 m_error = err_ostr.str();
                 m_dev = 0;
+                break;
             }
         }
     }
@@ -149,8 +170,6 @@ AirspySource::AirspySource(int dev_index) :
 
     std::ostringstream bwfilt_ostr;
     bwfilt_ostr << std::fixed << std::setprecision(2);
-
-    m_this = this;
 }
 
 AirspySource::~AirspySource()
@@ -161,8 +180,6 @@ AirspySource::~AirspySource()
 
     airspy_error rc = (airspy_error) airspy_exit();
     std::cerr << "AirspySource::~AirspySource: Airspy library exit: " << rc << ": " << airspy_error_name(rc) << std::endl;
-
-    m_this = 0;
 }
 
 void AirspySource::get_device_names(std::vector<std::string>& devices)
@@ -238,6 +255,22 @@ void AirspySource::print_specific_parms()
     fprintf(stderr, "Antenna bias       %s\n", m_biasAnt ? "enabled" : "disabled");
     fprintf(stderr, "LNA AGC            %s\n", m_lnaAGC ? "enabled" : "disabled");
     fprintf(stderr, "Mixer AGC          %s\n", m_mixAGC ? "enabled" : "disabled");
+    fprintf(stderr, "Raw samples        %s\n", m_raw ? (m_packing ? "enabled (packed)" : "enabled") : "disabled");
+}
+
+bool AirspySource::retune(std::uint64_t frequency)
+{
+    double tuner_freq = get_tuner_frequency(frequency, m_sampleRate);
+    tuner_freq += tuner_freq * m_ppm * 1e-6;
+
+    if ((airspy_error) airspy_set_freq(m_dev, (uint32_t) tuner_freq) != AIRSPY_SUCCESS)
+    {
+        m_error = "airspy_set_freq failed";
+        return false;
+    }
+
+    m_frequency = tuner_freq;
+    return true;
 }
 
 bool AirspySource::configure(std::uint32_t changeFlags,
@@ -622,6 +655,18 @@ bool AirspySource::configure(parsekv::pairs_type& m)
         changeFlags |= 0x1; // need to adjust actual center frequency if not centered
 	}
 
+	if (m.find("raw") != m.end())
+	{
+		std::cerr << "AirspySource::configure: raw: " << m["raw"] << std::endl;
+		bool raw = atoi(m["raw"].c_str()) != 0;
+
+		if ((raw != m_raw) && !setRaw(raw))
+		{
+            std::cerr << "AirspySource::configure: " << m_error << std::endl;
+			return false;
+		}
+	}
+
 	if (m.find("decim") != m.end())
 	{
 		std::cerr << "HackRFSource::configure: decim: " << m["decim"] << std::endl;
@@ -664,8 +709,17 @@ bool AirspySource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
     {
         std::cerr << "AirspySource::start: starting" << std::endl;
         m_running = true;
-        m_thread = new std::thread(run, m_dev, stop_flag);
-        sleep(1);
+        m_ready.reset();
+        m_thread = new std::thread(run, m_dev, stop_flag, this);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
+
+        if (m_ready.wait(AIRSPY_STARTTIMEOUT_MS) == ReadySignal::Failed)
+        {
+            m_error = "Cannot start Airspy Rx";
+            return false;
+        }
+
         return *this;
     }
     else
@@ -676,28 +730,20 @@ bool AirspySource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
     }
 }
 
-void AirspySource::run(airspy_device* dev, std::atomic_bool *stop_flag)
+void AirspySource::run(airspy_device* dev, std::atomic_bool *stop_flag, AirspySource *source)
 {
     std::cerr << "AirspySource::run" << std::endl;
-    void *msgBuf = 0;
 
-    airspy_error rc = (airspy_error) airspy_start_rx(dev, rx_callback, 0);
+    airspy_error rc = (airspy_error) airspy_start_rx(dev, rx_callback, (void *) source);
+
+    source->m_ready.notify(rc == AIRSPY_SUCCESS);
 
     if (rc == AIRSPY_SUCCESS)
     {
-        while (!stop_flag->load() && (airspy_is_streaming(dev) == AIRSPY_TRUE))
+        while (airspy_is_streaming(dev) == AIRSPY_TRUE)
         {
-            sleep(1);
-
-            int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
-
-            if ((len > 0) && msgBuf)
-            {
-                std::string msg((char *) msgBuf, len);
-                std::cerr << "AirspySource::run: received: " << msg << std::endl;
-                m_this->DeviceSource::configure(msg);
-                nn_freemsg(msgBuf);
-                msgBuf = 0;
+            if (source->m_ready.waitStop(stop_flag, 1000)) {
+                break;
             }
         }
 
@@ -718,18 +764,56 @@ bool AirspySource::stop()
 {
     std::cerr << "AirspySource::stop" << std::endl;
 
+    stopControl();
+    m_ready.wake();
+
     m_thread->join();
     delete m_thread;
     return true;
 }
 
+bool AirspySource::setRaw(bool raw)
+{
+    if (m_running)
+    {
+        m_error = "Raw samples can only be set at start";
+        return false;
+    }
+
+    airspy_error rc = (airspy_error) airspy_set_sample_type(m_dev, raw ? AIRSPY_SAMPLE_RAW : AIRSPY_SAMPLE_INT16_IQ);
+
+    if (rc != AIRSPY_SUCCESS)
+    {
+        std::ostringstream err_ostr;
+        err_ostr << "Could not set sample type (" << rc << ": " << airspy_error_name(rc) << ")";
+        m_error = err_ostr.str();
+        return false;
+    }
+
+    // the packing is a firmware option: raw samples are sent unpacked when it is not there
+    rc = (airspy_error) airspy_set_packing(m_dev, raw ? 1 : 0);
+    m_packing = raw && (rc == AIRSPY_SUCCESS);
+
+    if (raw && !m_packing) {
+        std::cerr << "AirspySource::setRaw: packing not supported: " << rc << ": " << airspy_error_name(rc) << std::endl;
+    }
+
+    m_raw = raw;
+    return true;
+}
+
 int AirspySource::rx_callback(airspy_transfer_t* transfer)
 {
-    int len = transfer->sample_count * 2; // interleaved I/Q samples
+    set_current_thread_name_once("sdmn-usb"); // transfer thread of the library
+    AirspySource *source = (AirspySource *) transfer->ctx;
 
-    if (m_this)
+    if (source)
     {
-        m_this->callback((short *) transfer->samples, len);
+        if (source->m_raw) {
+            source->callbackRaw(transfer->samples, transfer->sample_count); // real samples
+        } else {
+            source->callback((short *) transfer->samples, transfer->sample_count * 2); // interleaved I/Q samples
+        }
     }
 
     return 0;
@@ -738,15 +822,53 @@ int AirspySource::rx_callback(airspy_transfer_t* transfer)
 void AirspySource::callback(const short* buf, int len)
 {
     IQSampleVector iqsamples;
+    SDMN_TRACE1(device_callback_entry, len/2);
+
+    m_buf->get_vector(iqsamples, len/2);
+    // interleaved I/Q int16 is the IQSample layout: copy with the normalization shift if any
+    SampleConversion::shiftS16((const IQSample *) buf, iqsamples.data(), len/2, get_normalize() ? 16 - get_sample_bits() : 0);
+
+    m_buf->push(move(iqsamples));
+    scan(len/2);
+    SDMN_TRACE1(device_callback_exit, len/2);
+}
+
+void AirspySource::callbackRaw(const void* buf, int len)
+{
+    IQSampleVector iqsamples;
+    SDMN_TRACE1(device_callback_entry, len/2);
 
-    iqsamples.resize(len/2);
+    m_buf->get_vector(iqsamples, len/2);
+    int16_t *x = (int16_t *) iqsamples.data(); // pairs of real samples converted by the RealDDC of the pipeline
 
-    for (int i = 0, j = 0; i < len; i+=2, j++)
+    if (m_packing)
     {
-        int16_t re = buf[i];
-        int16_t im = buf[i+1];
-        iqsamples[j] = IQSample(re, im);
+        // 8 samples of 12 bits in 3 words
+        const uint32_t *w = (const uint32_t *) buf;
+        int i = 0;
+
+        for (; i + 8 <= len; i += 8, w += 3)
+        {
+            x[i]   = (int16_t) ((w[0] >> 20) & 0xfff) - 2048;
+            x[i+1] = (int16_t) ((w[0] >> 8) & 0xfff) - 2048;
+            x[i+2] = (int16_t) (((w[0] & 0xff) << 4) | (w[1] >> 28)) - 2048;
+            x[i+3] = (int16_t) ((w[1] >> 16) & 0xfff) - 2048;
+            x[i+4] = (int16_t) ((w[1] >> 4) & 0xfff) - 2048;
+            x[i+5] = (int16_t) (((w[1] & 0xf) << 8) | (w[2] >> 24)) - 2048;
+            x[i+6] = (int16_t) ((w[2] >> 12) & 0xfff) - 2048;
+            x[i+7] = (int16_t) (w[2] & 0xfff) - 2048;
+        }
+    }
+    else
+    {
+        const uint16_t *u = (const uint16_t *) buf;
+
+        for (int i = 0; i < len; i++) {
+            x[i] = (int16_t) (u[i] & 0xfff) - 2048;
+        }
     }
 
     m_buf->push(move(iqsamples));
+    scan(len/2);
+    SDMN_TRACE1(device_callback_exit, len/2);
 }
@@ -22,12 +22,14 @@
 #include <iomanip>
 #include <sstream>
 #include <thread>
+#include <unistd.h>
 
 #include "BladeRFSource.h"
+#include "Tracepoints.h"
+#include "SampleConversion.h"
 #include "util.h"
 #include "parsekv.h"
 
-BladeRFSource *BladeRFSource::m_this = 0;
 const std::vector<int> BladeRFSource::m_lnaGains({0, 3, 6});
 const std::vector<int> BladeRFSource::m_vga1Gains({5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30});
 const std::vector<int> BladeRFSource::m_vga2Gains({0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30});
@@ -45,7 +47,14 @@ BladeRFSource::BladeRFSource(const char *serial) :
     m_lnaGain(3),
     m_vga1Gain(6),
     m_vga2Gain(5),
-    m_thread(0)
+    m_thread(0),
+    m_async(false),
+    m_nbBuffers(64),
+    m_bufferSize(8192),
+    m_nbTransfers(32),
+    m_stream(0),
+    m_streamBuffers(0),
+    m_streamBufferIndex(0)
 {
     int status;
     struct bladerf_devinfo info;
@@ -92,44 +101,24 @@ BladeRFSource::BladeRFSource(const char *serial) :
         }
         else
         {
-            if ((status = bladerf_sync_config(m_dev, BLADERF_MODULE_RX, BLADERF_FORMAT_SC16_Q11, 64, 8192, 32, 10000)) < 0)
+            if (bladerf_expansion_attach(m_dev, BLADERF_XB_200) == 0)
             {
-                std::ostringstream err_ostr;
-                err_ostr << "bladerf_sync_config failed with return code " << status;
-                m_error = err_ostr.str();
-                m_dev = 0;
-            }
-            else
-            {
-                if ((status = bladerf_enable_module(m_dev, BLADERF_MODULE_RX, true)) < 0)
+                std::cerr << "BladeRFSource::BladeRFSource: Attached XB200 extension" << std::endl;
+
+                if ((status = bladerf_xb200_set_path(m_dev, BLADERF_MODULE_RX, BLADERF_XB200_MIX)) != 0)
                 {
-                    std::ostringstream err_ostr;
-                    err_ostr << "bladerf_enable_module failed with return code " << status;
-                    m_error = err_ostr.str();
-                    m_dev = 0;
+                    std::cerr << "BladeRFSource::BladeRFSource: bladerf_xb200_set_path failed with return code " << status << std::endl;
                 }
                 else
                 {
-                    if (bladerf_expansion_attach(m_dev, BLADERF_XB_200) == 0)
+                    if ((status = bladerf_xb200_set_filterbank(m_dev, BLADERF_MODULE_RX, BLADERF_XB200_AUTO_1DB)) != 0)
                     {
-                        std::cerr << "BladeRFSource::BladeRFSource: Attached XB200 extension" << std::endl;
-
-                        if ((status = bladerf_xb200_set_path(m_dev, BLADERF_MODULE_RX, BLADERF_XB200_MIX)) != 0)
-                        {
-                            std::cerr << "BladeRFSource::BladeRFSource: bladerf_xb200_set_path failed with return code " << status << std::endl;
-                        }
-                        else
-                        {
-                            if ((status = bladerf_xb200_set_filterbank(m_dev, BLADERF_MODULE_RX, BLADERF_XB200_AUTO_1DB)) != 0)
-                            {
-                                std::cerr << "BladeRFSource::BladeRFSource: bladerf_xb200_set_filterbank failed with return code " << status << std::endl;
-                            }
-                            else
-                            {
-                                std::cerr << "BladeRFSource::BladeRFSource: XB200 configured. Min freq set to 100kHz" << std::endl;
-                                m_minFrequency = 100000;
-                            }
-                        }
+                        std::cerr << "BladeRFSource::BladeRFSource: bladerf_xb200_set_filterbank failed with return code " << status << std::endl;
+                    }
+                    else
+                    {
+                        std::cerr << "BladeRFSource::BladeRFSource: XB200 configured. Min freq set to 100kHz" << std::endl;
+                        m_minFrequency = 100000;
                     }
                 }
             }
@@ -167,8 +156,6 @@ BladeRFSource::BladeRFSource(const char *serial) :
     }
 
     m_bwfiltStr = bw_ostr.str();
-
-    m_this = this;
 }
 
 
@@ -178,8 +165,6 @@ BladeRFSource::~BladeRFSource()
     if (m_dev) {
         bladerf_close(m_dev);
     }
-
-    m_this = 0;
 }
 
 bool BladeRFSource::configure(parsekv::pairs_type& m)
@@ -366,6 +351,74 @@ bool BladeRFSource::configure(parsekv::pairs_type& m)
 		}
 	}
 
+	if ((m.find("async") != m.end()) || (m.find("nbuf") != m.end()) || (m.find("bufsize") != m.end()) || (m.find("nxfer") != m.end()))
+	{
+		if (m_thread)
+		{
+			std::cerr << "BladeRFSource::configure: streaming options ignored while streaming" << std::endl;
+		}
+		else
+		{
+			if (m.find("async") != m.end())
+			{
+				std::cerr << "BladeRFSource::configure: async: " << m["async"] << std::endl;
+				m_async = atoi(m["async"].c_str()) != 0;
+			}
+
+			if (m.find("nbuf") != m.end())
+			{
+				std::cerr << "BladeRFSource::configure: nbuf: " << m["nbuf"] << std::endl;
+				int nbBuffers = atoi(m["nbuf"].c_str());
+
+				if ((nbBuffers < 2) || (nbBuffers > 256))
+				{
+					m_error = "Invalid number of buffers";
+					std::cerr << "BladeRFSource::configure: " << m_error << std::endl;
+					return false;
+				}
+
+				m_nbBuffers = nbBuffers;
+			}
+
+			if (m.find("bufsize") != m.end())
+			{
+				std::cerr << "BladeRFSource::configure: bufsize: " << m["bufsize"] << std::endl;
+				int bufferSize = atoi(m["bufsize"].c_str());
+
+				if ((bufferSize < 1024) || (bufferSize > (1<<20)) || (bufferSize % 1024 != 0))
+				{
+					m_error = "Invalid buffer size. Must be a multiple of 1024 up to 1048576";
+					std::cerr << "BladeRFSource::configure: " << m_error << std::endl;
+					return false;
+				}
+
+				m_bufferSize = bufferSize;
+			}
+
+			if (m.find("nxfer") != m.end())
+			{
+				std::cerr << "BladeRFSource::configure: nxfer: " << m["nxfer"] << std::endl;
+				int nbTransfers = atoi(m["nxfer"].c_str());
+
+				if (nbTransfers < 1)
+				{
+					m_error = "Invalid number of transfers";
+					std::cerr << "BladeRFSource::configure: " << m_error << std::endl;
+					return false;
+				}
+
+				m_nbTransfers = nbTransfers;
+			}
+
+			if (m_nbTransfers >= m_nbBuffers)
+			{
+				m_error = "Number of transfers must be less than number of buffers";
+				std::cerr << "BladeRFSource::configure: " << m_error << std::endl;
+				return false;
+			}
+		}
+	}
+
 	// Intentionally tune at a higher frequency to avoid DC offset.
 	m_confFreq = frequency;
 	double tuner_freq;
@@ -381,6 +434,20 @@ bool BladeRFSource::configure(parsekv::pairs_type& m)
 	return configure(changeFlags, sample_rate, tuner_freq, bandwidth, lnaGainIndex, vga1Gain, vga2Gain);
 }
 
+bool BladeRFSource::retune(std::uint64_t frequency)
+{
+    uint32_t tuner_freq = get_tuner_frequency(frequency, m_actualSampleRate);
+
+    if (bladerf_set_frequency(m_dev, BLADERF_MODULE_RX, tuner_freq) != 0)
+    {
+        m_error = "bladerf_set_frequency failed";
+        return false;
+    }
+
+    m_frequency = tuner_freq;
+    return true;
+}
+
 // Configure RTL-SDR tuner and prepare for streaming.
 bool BladeRFSource::configure(uint32_t changeFlags,
         uint32_t sample_rate,
@@ -522,7 +589,44 @@ bool BladeRFSource::start(DataBuffer<IQSample>* buf, std::atomic_bool *stop_flag
 
     if (m_thread == 0)
     {
-        m_thread = new std::thread(run);
+        int status;
+
+        if (m_async)
+        {
+            m_streamBufferIndex = m_nbTransfers; // the first m_nbTransfers buffers are submitted by libbladeRF at stream start
+
+            if ((status = bladerf_init_stream(&m_stream, m_dev, streamCallback, &m_streamBuffers,
+                    m_nbBuffers, BLADERF_FORMAT_SC16_Q11, m_bufferSize, m_nbTransfers, this)) < 0)
+            {
+                std::ostringstream err_ostr;
+                err_ostr << "bladerf_init_stream failed with return code " << status;
+                m_error = err_ostr.str();
+                m_stream = 0;
+                return false;
+            }
+        }
+        else
+        {
+            if ((status = bladerf_sync_config(m_dev, BLADERF_MODULE_RX, BLADERF_FORMAT_SC16_Q11, m_nbBuffers, m_bufferSize, m_nbTransfers, 10000)) < 0)
+            {
+                std::ostringstream err_ostr;
+                err_ostr << "bladerf_sync_config failed with return code " << status;
+                m_error = err_ostr.str();
+                return false;
+            }
+        }
+
+        if ((status = bladerf_enable_module(m_dev, BLADERF_MODULE_RX, true)) < 0)
+        {
+            std::ostringstream err_ostr;
+            err_ostr << "bladerf_enable_module failed with return code " << status;
+            m_error = err_ostr.str();
+            return false;
+        }
+
+        m_thread = new std::thread(run, this);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
         return true;
     }
     else
@@ -534,6 +638,8 @@ bool BladeRFSource::start(DataBuffer<IQSample>* buf, std::atomic_bool *stop_flag
 
 bool BladeRFSource::stop()
 {
+    stopControl();
+
     if (m_thread)
     {
         m_thread->join();
@@ -544,47 +650,97 @@ bool BladeRFSource::stop()
     return true;
 }
 
-void BladeRFSource::run()
+void BladeRFSource::run(BladeRFSource *source)
 {
     IQSampleVector iqsamples;
-    void *msgBuf = 0;
 
-    while (!m_this->m_stop_flag->load() && get_samples(&iqsamples))
+    if (source->m_async)
     {
-        m_this->m_buf->push(move(iqsamples));
-
-        int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
+        std::thread *streamThread = new std::thread(runStream, source);
+        set_thread_name(streamThread->native_handle(), "sdmn-usb");
 
-        if ((len > 0) && msgBuf)
+        while (!source->m_stop_flag->load())
         {
-            std::string msg((char *) msgBuf, len);
-            std::cerr << "BladeRFSource::run: received: " << msg << std::endl;
-            m_this->DeviceSource::configure(msg);
-            nn_freemsg(msgBuf);
-            msgBuf = 0;
+            usleep(100000);
         }
+
+        streamThread->join(); // callback returns shutdown as soon as stop flag is seen
+        delete streamThread;
+        bladerf_deinit_stream(source->m_stream);
+        source->m_stream = 0;
+        return;
+    }
+
+    while (!source->m_stop_flag->load() && get_samples(source, &iqsamples))
+    {
+        std::size_t nbSamples = iqsamples.size();
+        SDMN_TRACE1(device_callback_entry, nbSamples);
+
+        if (source->get_normalize()) {
+            SampleConversion::shiftS16(iqsamples.data(), iqsamples.data(), nbSamples, 16 - source->get_sample_bits());
+        }
+
+        source->m_buf->push(move(iqsamples));
+        source->scan(nbSamples);
+        SDMN_TRACE1(device_callback_exit, nbSamples);
     }
 }
 
-// Fetch a bunch of samples from the device.
-bool BladeRFSource::get_samples(IQSampleVector *samples)
+void BladeRFSource::runStream(BladeRFSource *source)
 {
-    int res;
-    std::vector<int16_t> buf(2*m_blockSize);
+    int status = bladerf_stream(source->m_stream, BLADERF_MODULE_RX);
 
-    if ((res = bladerf_sync_rx(m_this->m_dev, buf.data(), m_blockSize, 0, 10000)) < 0)
+    if (status < 0)
     {
-        m_this->m_error = "bladerf_sync_rx failed";
-        return false;
+        std::cerr << "BladeRFSource::runStream: bladerf_stream failed: " << bladerf_strerror(status) << std::endl;
+    }
+}
+
+void *BladeRFSource::streamCallback(struct bladerf *dev __attribute__((unused)),
+        struct bladerf_stream *stream __attribute__((unused)),
+        struct bladerf_metadata *meta __attribute__((unused)),
+        void *samples,
+        size_t num_samples,
+        void *user_data)
+{
+    BladeRFSource *source = (BladeRFSource *) user_data;
+
+    if (source->m_stop_flag->load()) {
+        return BLADERF_STREAM_SHUTDOWN;
     }
 
-    samples->resize(m_blockSize);
+    // SC16Q11 interleaved I/Q is the IQSample layout so a single copy is done
+    IQSampleVector iqsamples;
+    SDMN_TRACE1(device_callback_entry, num_samples);
+    source->m_buf->get_vector(iqsamples, num_samples);
+
+    if (source->get_normalize()) {
+        SampleConversion::shiftS16((const IQSample *) samples, iqsamples.data(), num_samples, 16 - source->get_sample_bits());
+    } else {
+        memcpy(iqsamples.data(), samples, num_samples * sizeof(IQSample));
+    }
+
+    source->m_buf->push(move(iqsamples));
+    source->scan(num_samples);
+    SDMN_TRACE1(device_callback_exit, num_samples);
+
+    void *next = source->m_streamBuffers[source->m_streamBufferIndex];
+    source->m_streamBufferIndex = (source->m_streamBufferIndex + 1) % source->m_nbBuffers;
+    return next;
+}
 
-    for (int i = 0; i < m_blockSize; i++)
+// Fetch a bunch of samples from the device.
+bool BladeRFSource::get_samples(BladeRFSource *source, IQSampleVector *samples)
+{
+    int res;
+
+    // SC16Q11 interleaved I/Q is the IQSample layout so read directly in the sample vector
+    source->m_buf->get_vector(*samples, m_blockSize);
+
+    if ((res = bladerf_sync_rx(source->m_dev, samples->data(), m_blockSize, 0, 10000)) < 0)
     {
-        int16_t re = buf[2*i];
-        int16_t im = buf[2*i+1];
-        (*samples)[i] = IQSample(re, im);
+        source->m_error = "bladerf_sync_rx failed";
+        return false;
     }
 
     return true;
@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+#include <cerrno>
+
+#include "BlockCapture.h"
+
+BlockCapture::BlockCapture() :
+    m_file(0),
+    m_nbBlocks(0)
+{
+}
+
+BlockCapture::~BlockCapture()
+{
+    close();
+}
+
+bool BlockCapture::open(const std::string& filename)
+{
+    close();
+    m_file = std::fopen(filename.c_str(), "ab");
+
+    if (!m_file)
+    {
+        m_error = "BlockCapture::open: cannot open " + filename + ": " + strerror(errno);
+        return false;
+    }
+
+    m_buffer.resize(BLOCKCAPTURE_BUFSIZE);
+    std::setvbuf(m_file, &m_buffer[0], _IOFBF, m_buffer.size());
+
+    if (std::ftell(m_file) == 0) { // new file
+        std::fwrite(BLOCKCAPTURE_MAGIC, 1, 8, m_file);
+    }
+
+    m_nbBlocks = 0;
+    return true;
+}
+
+void BlockCapture::close()
+{
+    if (m_file)
+    {
+        std::fclose(m_file);
+        m_file = 0;
+    }
+}
+
+void BlockCapture::write(const uint8_t *block, int length, const timespec& arrival)
+{
+    if (!m_file || (length <= 0) || (length > BLOCKCAPTURE_BLOCKMAX)) {
+        return;
+    }
+
+    int64_t arrivalNs = (int64_t) arrival.tv_sec * 1000000000LL + arrival.tv_nsec;
+    uint16_t blockLength = length;
+    std::fwrite(&arrivalNs, sizeof(arrivalNs), 1, m_file);
+    std::fwrite(&blockLength, sizeof(blockLength), 1, m_file);
+    std::fwrite(block, 1, length, m_file);
+    m_nbBlocks++;
+}
+
+BlockCaptureReader::BlockCaptureReader() :
+    m_file(0)
+{
+}
+
+BlockCaptureReader::~BlockCaptureReader()
+{
+    close();
+}
+
+bool BlockCaptureReader::open(const std::string& filename)
+{
+    close();
+    m_file = std::fopen(filename.c_str(), "rb");
+
+    if (!m_file)
+    {
+        m_error = "BlockCaptureReader::open: cannot open " + filename + ": " + strerror(errno);
+        return false;
+    }
+
+    m_buffer.resize(BLOCKCAPTURE_BUFSIZE);
+    std::setvbuf(m_file, &m_buffer[0], _IOFBF, m_buffer.size());
+    char magic[8];
+
+    if ((std::fread(magic, 1, 8, m_file) != 8) || (memcmp(magic, BLOCKCAPTURE_MAGIC, 8) != 0))
+    {
+        m_error = "BlockCaptureReader::open: " + filename + " is not a block capture";
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void BlockCaptureReader::close()
+{
+    if (m_file)
+    {
+        std::fclose(m_file);
+        m_file = 0;
+    }
+}
+
+bool BlockCaptureReader::next(std::vector<uint8_t>& block, int64_t& arrivalNs)
+{
+    uint16_t blockLength;
+
+    if (!m_file || (std::fread(&arrivalNs, sizeof(arrivalNs), 1, m_file) != 1)) {
+        return false; // end of file
+    }
+
+    if (std::fread(&blockLength, sizeof(blockLength), 1, m_file) != 1)
+    {
+        m_error = "BlockCaptureReader::next: truncated record";
+        return false;
+    }
+
+    block.resize(blockLength);
+
+    if (std::fread(&block[0], 1, blockLength, m_file) != blockLength)
+    {
+        m_error = "BlockCaptureReader::next: truncated record";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "CICDecimator.h"
+
+CICDecimator::CICDecimator() :
+    m_ratio(1),
+    m_phase(0),
+    m_gain(1.0),
+    m_index(0)
+{
+    memset(m_integrators, 0, sizeof(m_integrators));
+    memset(m_combs, 0, sizeof(m_combs));
+    memset(m_taps, 0, sizeof(m_taps));
+    memset(m_i, 0, sizeof(m_i));
+    memset(m_q, 0, sizeof(m_q));
+}
+
+bool CICDecimator::setRatio(unsigned int ratio)
+{
+    if ((ratio < 1) || (ratio > CICDECIMATOR_RATIOMAX)) {
+        return false;
+    }
+
+    if (ratio == m_ratio) {
+        return true;
+    }
+
+    m_ratio = ratio;
+    m_phase = 0;
+    m_gain = 1.0 / std::pow((double) ratio, CICDECIMATOR_ORDER);
+    memset(m_integrators, 0, sizeof(m_integrators));
+    memset(m_combs, 0, sizeof(m_combs));
+    memset(m_i, 0, sizeof(m_i));
+    memset(m_q, 0, sizeof(m_q));
+    m_index = 0;
+
+    if (ratio > 1) {
+        design();
+    }
+
+    return true;
+}
+
+/**
+ * Windowed frequency sampling of the inverse of the CIC response up to a quarter of the output rate,
+ * with a raised cosine roll-off to 0.45 where the following half band rejects anyway.
+ */
+void CICDecimator::design()
+{
+    const int half = CICDECIMATOR_TAPS / 2;
+    const int grid = 2048;
+    const double pass = 0.25;
+    const double stop = 0.45;
+    std::vector<double> d(grid + 1);
+
+    for (int k = 0; k <= grid; k++)
+    {
+        double f = (0.5 * k) / grid; // relative to the output rate
+        double cic = (k == 0) ? 1.0 : std::pow(std::sin(M_PI * f) / (m_ratio * std::sin(M_PI * f / m_ratio)), CICDECIMATOR_ORDER);
+        double w = f <= pass ? 1.0 : f >= stop ? 0.0 : 0.5 * (1.0 + std::cos(M_PI * (f - pass) / (stop - pass)));
+        d[k] = (w / cic) * ((k == 0) || (k == grid) ? 0.5 : 1.0); // trapezoidal rule
+    }
+
+    double sum = 0.0;
+    std::vector<double> h(CICDECIMATOR_TAPS);
+
+    for (int n = -half; n <= half; n++)
+    {
+        double a = 0.0;
+
+        for (int k = 0; k <= grid; k++) {
+            a += d[k] * std::cos(2.0 * M_PI * n * (0.5 * k) / grid);
+        }
+
+        double window = 0.54 + 0.46 * std::cos(M_PI * n / (half + 1)); // Hamming
+        h[n + half] = a * window;
+        sum += h[n + half];
+    }
+
+    for (int j = 0; j < CICDECIMATOR_TAPS; j++) {
+        m_taps[j] = (float) (h[j] / sum); // unity gain at DC
+    }
+}
+
+void CICDecimator::process(unsigned int& sampleSize, const IQSample *in, std::size_t n, IQSampleVector& out)
+{
+    decimate(sampleSize, (const int16_t *) in, n, out);
+}
+
+void CICDecimator::process(unsigned int& sampleSize, const int32_t *in, std::size_t n, IQSampleVector& out)
+{
+    decimate(sampleSize, in, n, out);
+}
+
+template <typename T>
+void CICDecimator::decimate(unsigned int& sampleSize, const T *in, std::size_t n, IQSampleVector& out)
+{
+    const int order = CICDECIMATOR_ORDER;
+    uint64_t a[2*CICDECIMATOR_ORDER];
+    memcpy(a, m_integrators, sizeof(a));
+    float scale = (float) (m_gain * (sampleSize < 16 ? 1 << (16 - sampleSize) : 1.0 / (1 << (sampleSize - 16))));
+    unsigned int phase = m_phase;
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+        // modulo 2^64 arithmetic: the wrap arounds of the integrators cancel in the combs
+        a[0] += (uint64_t) (int64_t) in[2*i];
+        a[1] += (uint64_t) (int64_t) in[2*i+1];
+
+        for (int s = 1; s < order; s++)
+        {
+            a[2*s]   += a[2*s-2];
+            a[2*s+1] += a[2*s-1];
+        }
+
+        if (++phase < m_ratio) {
+            continue;
+        }
+
+        phase = 0;
+        uint64_t x = a[2*order-2];
+        uint64_t y = a[2*order-1];
+
+        for (int s = 0; s < order; s++)
+        {
+            uint64_t cx = x - m_combs[2*s];
+            uint64_t cy = y - m_combs[2*s+1];
+            m_combs[2*s]   = x;
+            m_combs[2*s+1] = y;
+            x = cx;
+            y = cy;
+        }
+
+        m_i[m_index] = m_i[m_index + CICDECIMATOR_TAPS] = (float) (int64_t) x * scale;
+        m_q[m_index] = m_q[m_index + CICDECIMATOR_TAPS] = (float) (int64_t) y * scale;
+        m_index = (m_index + 1) % CICDECIMATOR_TAPS;
+
+        // the filter is symmetric so the history is read from the oldest sample in any direction
+        float fi = 0.0f, fq = 0.0f;
+
+        for (int j = 0; j < CICDECIMATOR_TAPS; j++)
+        {
+            fi += m_taps[j] * m_i[m_index + j];
+            fq += m_taps[j] * m_q[m_index + j];
+        }
+
+        long ri = lrintf(fi);
+        long rq = lrintf(fq);
+        out.push_back(IQSample(ri > 32767 ? 32767 : ri < -32768 ? -32768 : ri, rq > 32767 ? 32767 : rq < -32768 ? -32768 : rq));
+    }
+
+    memcpy(m_integrators, a, sizeof(a));
+    m_phase = phase;
+    unsigned int gain = 0;
+
+    for (unsigned int r = m_ratio; r > 1; r >>= 1) {
+        gain++;
+    }
+
+    sampleSize = sampleSize + gain < 16 ? sampleSize + gain : 16;
+}
@@ -0,0 +1,148 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cstring>
+#include "CRC32C.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_SSE42
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARMV8
+#endif
+
+static const uint32_t CRC32C_POLY = 0x82F63B78; // reflected 0x1EDC6F41
+
+const CRC32C::Tables CRC32C::m_tables;
+const bool CRC32C::m_hardware = CRC32C::detect();
+
+CRC32C::Tables::Tables()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        uint32_t crc = i;
+
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+
+        m_table[0][i] = crc;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        for (int k = 1; k < 8; k++) {
+            m_table[k][i] = (m_table[k-1][i] >> 8) ^ m_table[0][m_table[k-1][i] & 0xFF];
+        }
+    }
+}
+
+bool CRC32C::detect()
+{
+#if defined(CRC32C_SSE42)
+    __builtin_cpu_init(); // may run before the libgcc constructor
+    return __builtin_cpu_supports("sse4.2");
+#elif defined(CRC32C_ARMV8)
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint32_t CRC32C::calculate(const uint8_t *stream, std::size_t length, uint32_t crc)
+{
+    if (m_hardware) {
+        return ~crcHardware(stream, length, ~crc);
+    } else {
+        return ~crcSlicing8(stream, length, ~crc);
+    }
+}
+
+uint32_t CRC32C::crcSlicing8(const uint8_t *stream, std::size_t length, uint32_t crc)
+{
+    const uint32_t (*t)[256] = m_tables.m_table;
+
+    for (; length >= 8; length -= 8, stream += 8)
+    {
+        uint32_t lo, hi;
+        memcpy(&lo, stream, sizeof(lo));
+        memcpy(&hi, stream + 4, sizeof(hi));
+        lo ^= crc;
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+            ^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+
+    for (; length > 0; length--, stream++) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *stream) & 0xFF];
+    }
+
+    return crc;
+}
+
+#if defined(CRC32C_SSE42)
+__attribute__((target("sse4.2")))
+uint32_t CRC32C::crcHardware(const uint8_t *stream, std::size_t length, uint32_t crc)
+{
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+
+    for (; length >= 8; length -= 8, stream += 8)
+    {
+        uint64_t word;
+        memcpy(&word, stream, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t) crc64;
+#endif
+    for (; length >= 4; length -= 4, stream += 4)
+    {
+        uint32_t word;
+        memcpy(&word, stream, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+
+    for (; length > 0; length--, stream++) {
+        crc = _mm_crc32_u8(crc, *stream);
+    }
+
+    return crc;
+}
+#elif defined(CRC32C_ARMV8)
+uint32_t CRC32C::crcHardware(const uint8_t *stream, std::size_t length, uint32_t crc)
+{
+    for (; length >= 8; length -= 8, stream += 8)
+    {
+        uint64_t word;
+        memcpy(&word, stream, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+
+    for (; length > 0; length--, stream++) {
+        crc = __crc32cb(crc, *stream);
+    }
+
+    return crc;
+}
+#else
+uint32_t CRC32C::crcHardware(const uint8_t *stream, std::size_t length, uint32_t crc)
+{
+    return crcSlicing8(stream, length, crc);
+}
+#endif
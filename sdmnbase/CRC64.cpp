@@ -16,7 +16,16 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.          //
 ///////////////////////////////////////////////////////////////////////////////////
 
+#include <cstring>
 #include "CRC64.h"
+#include "SIMDDispatch.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON) && defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#include <arm_neon.h>
+#define CRC64_PMULL
+#endif
 
 /**
 * poly is: x^64 + x^62 + x^57 + x^55 + x^54 + x^53 + x^52 + x^47 + x^46 + x^45 + x^40 + x^39 +
@@ -38,7 +47,8 @@
 */
 const uint64_t CRC64::m_poly = 0xC96C5795D7870F42ull;
 
-CRC64::CRC64()
+CRC64::CRC64() :
+    m_engine(bestEngine())
 {
 	build_crc_table();
 }
@@ -76,8 +86,37 @@ void CRC64::build_crc_table()
             }
     	}
 
-        m_crcTable[i] = crc;
+        m_crcTable[0][i] = crc;
+    }
+
+    // slicing-by-8: table[k][XX] is the CRC of XX followed by k zero bytes
+    for (int i = 0; i < 256; ++i)
+    {
+        for (int k = 1; k < 8; ++k) {
+            m_crcTable[k][i] = (m_crcTable[k-1][i] >> 8) ^ m_crcTable[0][m_crcTable[k-1][i] & 0xFF];
+        }
     }
+
+    // folding constants: the CRC of a byte 01 followed by n-1 zero bytes is x^(8n+63) modulo the polynomial
+    uint8_t one[64];
+    memset(one, 0, sizeof(one));
+    one[0] = 1;
+    m_foldK[0] = crcSlicing8(one, 16, 0); // x^191
+    m_foldK[1] = crcSlicing8(one, 8, 0);  // x^127
+    m_foldK[2] = crcSlicing8(one, 64, 0); // x^575
+    m_foldK[3] = crcSlicing8(one, 56, 0); // x^511
+}
+
+CRC64::engine_t CRC64::bestEngine()
+{
+#if defined(SIMD_X86_DISPATCH)
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") ? CRCCarryless : CRCSlicing8;
+#elif defined(CRC64_PMULL)
+    return CRCCarryless;
+#else
+    return CRCSlicing8;
+#endif
 }
 
 /**
@@ -142,14 +181,25 @@ void CRC64::build_crc_table()
 *    44 27 7F 18 41 7C 45 A5
 *
 */
-uint64_t CRC64::calculate_crc(uint8_t *stream, int length)
+uint64_t CRC64::calculate_crc(const uint8_t *stream, int length)
 {
-    uint64_t crc = 0;
+    switch (m_engine)
+    {
+    case CRCCarryless:
+        return crcCarryless(stream, length, 0);
+    case CRCSlicing8:
+        return crcSlicing8(stream, length, 0);
+    default:
+        return crcTable(stream, length, 0);
+    }
+}
 
+uint64_t CRC64::crcTable(const uint8_t *stream, int length, uint64_t crc) const
+{
     for (int i = 0 ; i < length; ++i)
     {
         uint8_t index = stream[i] ^ crc;
-        uint64_t lookup = m_crcTable[index];
+        uint64_t lookup = m_crcTable[0][index];
 
         crc >>= 8;
         crc ^= lookup;
@@ -158,4 +208,123 @@ uint64_t CRC64::calculate_crc(uint8_t *stream, int length)
     return crc;
 }
 
+/**
+ * Eight bytes at a time: the CRC is xored with the next 8 bytes (little endian) and each byte of
+ * the result is looked up in the table accounting for the number of bytes that follow it
+ */
+uint64_t CRC64::crcSlicing8(const uint8_t *stream, int length, uint64_t crc) const
+{
+    for (; length >= 8; length -= 8, stream += 8)
+    {
+        uint64_t word;
+        memcpy(&word, stream, sizeof(word));
+        crc ^= word;
+        crc = m_crcTable[7][crc & 0xFF]
+            ^ m_crcTable[6][(crc >> 8) & 0xFF]
+            ^ m_crcTable[5][(crc >> 16) & 0xFF]
+            ^ m_crcTable[4][(crc >> 24) & 0xFF]
+            ^ m_crcTable[3][(crc >> 32) & 0xFF]
+            ^ m_crcTable[2][(crc >> 40) & 0xFF]
+            ^ m_crcTable[1][(crc >> 48) & 0xFF]
+            ^ m_crcTable[0][crc >> 56];
+    }
+
+    return crcTable(stream, length, crc);
+}
+
+/**
+ * Carry-less multiply folding. The data is kept as a 128 bit remainder R congruent to the data read
+ * so far modulo the polynomial. With R = r0.x^64 + r1 (r0 the first 8 bytes in the reflected order)
+ * the next 16 bytes D give R' = r0.(x^191 mod P).x + r1.(x^127 mod P).x + D, the extra x coming from
+ * the product of two reflected 64 bit values. Four remainders are folded 64 bytes apart in parallel
+ * then merged. The CRC of the data is the CRC of the final 16 byte remainder.
+ */
+#if defined(SIMD_X86_DISPATCH)
+SIMD_TARGET("pclmul")
+static inline __m128i crc64Fold(__m128i x, __m128i k)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11));
+}
+
+SIMD_TARGET("pclmul")
+uint64_t CRC64::crcCarryless(const uint8_t *stream, int length, uint64_t crc) const
+{
+    if (length < 64) {
+        return crcSlicing8(stream, length, crc);
+    }
 
+    const __m128i k16 = _mm_set_epi64x(m_foldK[1], m_foldK[0]);
+    const __m128i k64 = _mm_set_epi64x(m_foldK[3], m_foldK[2]);
+    const __m128i *p = (const __m128i *) stream;
+    __m128i x0 = _mm_xor_si128(_mm_loadu_si128(p), _mm_set_epi64x(0, crc));
+    __m128i x1 = _mm_loadu_si128(p + 1);
+    __m128i x2 = _mm_loadu_si128(p + 2);
+    __m128i x3 = _mm_loadu_si128(p + 3);
+
+    for (p += 4, length -= 64; length >= 64; p += 4, length -= 64)
+    {
+        x0 = _mm_xor_si128(crc64Fold(x0, k64), _mm_loadu_si128(p));
+        x1 = _mm_xor_si128(crc64Fold(x1, k64), _mm_loadu_si128(p + 1));
+        x2 = _mm_xor_si128(crc64Fold(x2, k64), _mm_loadu_si128(p + 2));
+        x3 = _mm_xor_si128(crc64Fold(x3, k64), _mm_loadu_si128(p + 3));
+    }
+
+    x0 = _mm_xor_si128(crc64Fold(x0, k16), x1);
+    x0 = _mm_xor_si128(crc64Fold(x0, k16), x2);
+    x0 = _mm_xor_si128(crc64Fold(x0, k16), x3);
+
+    for (; length >= 16; p++, length -= 16) {
+        x0 = _mm_xor_si128(crc64Fold(x0, k16), _mm_loadu_si128(p));
+    }
+
+    uint8_t remainder[16];
+    _mm_storeu_si128((__m128i *) remainder, x0);
+    return crcSlicing8((const uint8_t *) p, length, crcSlicing8(remainder, 16, 0));
+}
+#elif defined(CRC64_PMULL)
+static inline uint64x2_t crc64Fold(uint64x2_t x, poly64_t kLo, poly64_t kHi)
+{
+    return veorq_u64(vreinterpretq_u64_p128(vmull_p64((poly64_t) vgetq_lane_u64(x, 0), kLo)),
+            vreinterpretq_u64_p128(vmull_p64((poly64_t) vgetq_lane_u64(x, 1), kHi)));
+}
+
+uint64_t CRC64::crcCarryless(const uint8_t *stream, int length, uint64_t crc) const
+{
+    if (length < 64) {
+        return crcSlicing8(stream, length, crc);
+    }
+
+    const poly64_t k16Lo = m_foldK[0], k16Hi = m_foldK[1];
+    const poly64_t k64Lo = m_foldK[2], k64Hi = m_foldK[3];
+    const uint64_t *p = (const uint64_t *) stream;
+    uint64x2_t x0 = veorq_u64(vld1q_u64(p), vcombine_u64(vcreate_u64(crc), vcreate_u64(0)));
+    uint64x2_t x1 = vld1q_u64(p + 2);
+    uint64x2_t x2 = vld1q_u64(p + 4);
+    uint64x2_t x3 = vld1q_u64(p + 6);
+
+    for (p += 8, length -= 64; length >= 64; p += 8, length -= 64)
+    {
+        x0 = veorq_u64(crc64Fold(x0, k64Lo, k64Hi), vld1q_u64(p));
+        x1 = veorq_u64(crc64Fold(x1, k64Lo, k64Hi), vld1q_u64(p + 2));
+        x2 = veorq_u64(crc64Fold(x2, k64Lo, k64Hi), vld1q_u64(p + 4));
+        x3 = veorq_u64(crc64Fold(x3, k64Lo, k64Hi), vld1q_u64(p + 6));
+    }
+
+    x0 = veorq_u64(crc64Fold(x0, k16Lo, k16Hi), x1);
+    x0 = veorq_u64(crc64Fold(x0, k16Lo, k16Hi), x2);
+    x0 = veorq_u64(crc64Fold(x0, k16Lo, k16Hi), x3);
+
+    for (; length >= 16; p += 2, length -= 16) {
+        x0 = veorq_u64(crc64Fold(x0, k16Lo, k16Hi), vld1q_u64(p));
+    }
+
+    uint8_t remainder[16];
+    vst1q_u64((uint64_t *) remainder, x0);
+    return crcSlicing8((const uint8_t *) p, length, crcSlicing8(remainder, 16, 0));
+}
+#else
+uint64_t CRC64::crcCarryless(const uint8_t *stream, int length, uint64_t crc) const
+{
+    return crcSlicing8(stream, length, crc);
+}
+#endif
@@ -0,0 +1,234 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "Channelizer.h"
+
+/** Zeroth order modified Bessel function of the first kind for the Kaiser window */
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2*k)) * (x / (2*k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+static inline int16_t roundSample(float v)
+{
+    v = v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v;
+    return (int16_t) lrintf(v);
+}
+
+Channelizer::Channelizer() :
+    m_nbChannels(0),
+    m_log2Channels(0),
+    m_taps(0),
+    m_length(0),
+    m_pos(0),
+    m_phase(0)
+{
+}
+
+bool Channelizer::configure(unsigned int nbChannels, unsigned int taps)
+{
+    unsigned int log2Channels = 0;
+
+    while ((1U << log2Channels) < nbChannels) {
+        log2Channels++;
+    }
+
+    if ((nbChannels < 2) || (nbChannels > CHANNELIZER_NBCHANNELSMAX) || ((1U << log2Channels) != nbChannels))
+    {
+        std::ostringstream os;
+        os << "invalid number of channels " << nbChannels << " (power of two from 2 to " << CHANNELIZER_NBCHANNELSMAX << ")";
+        m_error = os.str();
+        return false;
+    }
+
+    if ((taps < 4) || (taps > 64))
+    {
+        m_error = "invalid number of taps per channel (4 to 64)";
+        return false;
+    }
+
+    m_nbChannels = nbChannels;
+    m_log2Channels = log2Channels;
+    m_taps = taps;
+    m_length = nbChannels * taps;
+    m_pos = 0;
+    m_phase = 0;
+    m_i.assign(2 * m_length, 0.0f);
+    m_q.assign(2 * m_length, 0.0f);
+    m_re.assign(m_nbChannels, 0.0f);
+    m_im.assign(m_nbChannels, 0.0f);
+    m_cos.resize(m_nbChannels / 2);
+    m_sin.resize(m_nbChannels / 2);
+    m_bitReverse.resize(m_nbChannels);
+
+    for (unsigned int j = 0; j < m_nbChannels / 2; j++)
+    {
+        m_cos[j] = cos(2.0 * M_PI * j / m_nbChannels);
+        m_sin[j] = sin(2.0 * M_PI * j / m_nbChannels);
+    }
+
+    for (unsigned int j = 0; j < m_nbChannels; j++)
+    {
+        unsigned int r = 0;
+
+        for (unsigned int b = 0; b < m_log2Channels; b++) {
+            r |= ((j >> b) & 1) << (m_log2Channels - 1 - b);
+        }
+
+        m_bitReverse[j] = r;
+    }
+
+    design();
+    return true;
+}
+
+void Channelizer::design()
+{
+    const double beta = 7.0; // about 70 dB stop band
+    const double fc = 0.5 / m_nbChannels; // channel edge in cycles per sample
+    double center = (m_length - 1) / 2.0;
+    double sum = 0.0;
+
+    m_coeffs.resize(m_length);
+
+    for (unsigned int n = 0; n < m_length; n++)
+    {
+        double t = n - center;
+        double sinc = (t == 0.0) ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+        double r = 2.0 * n / (m_length - 1) - 1.0;
+        double window = besselI0(beta * sqrt(std::max(0.0, 1.0 - r*r))) / besselI0(beta);
+        m_coeffs[n] = sinc * window;
+        sum += m_coeffs[n];
+    }
+
+    for (unsigned int n = 0; n < m_length; n++) {
+        m_coeffs[n] /= sum; // unity gain in each channel
+    }
+}
+
+/** In place inverse FFT of m_re, m_im (positive exponent, not normalized) */
+void Channelizer::inverseFFT()
+{
+    for (unsigned int j = 0; j < m_nbChannels; j++)
+    {
+        unsigned int r = m_bitReverse[j];
+
+        if (r > j)
+        {
+            std::swap(m_re[j], m_re[r]);
+            std::swap(m_im[j], m_im[r]);
+        }
+    }
+
+    for (unsigned int size = 2; size <= m_nbChannels; size *= 2)
+    {
+        unsigned int half = size / 2;
+        unsigned int step = m_nbChannels / size;
+
+        for (unsigned int k = 0; k < m_nbChannels; k += size)
+        {
+            for (unsigned int j = 0; j < half; j++)
+            {
+                float wr = m_cos[j * step];
+                float wi = m_sin[j * step];
+                float *ar = &m_re[k + j], *ai = &m_im[k + j];
+                float *br = &m_re[k + j + half], *bi = &m_im[k + j + half];
+                float tr = wr * *br - wi * *bi;
+                float ti = wr * *bi + wi * *br;
+                *br = *ar - tr;
+                *bi = *ai - ti;
+                *ar += tr;
+                *ai += ti;
+            }
+        }
+    }
+}
+
+void Channelizer::process(unsigned int& sampleSize, const IQSampleVector& in, const std::vector<int>& channels, std::vector<IQSampleVector>& out)
+{
+    unsigned int outBits = std::min(16U, sampleSize + m_log2Channels);
+    float gain = (float) (1 << (16 - std::min(sampleSize, 16U))); // normalize to 16 bits
+    std::size_t nbOut = (m_phase + in.size()) / m_nbChannels;
+    std::size_t o = 0;
+
+    out.resize(channels.size());
+
+    for (std::size_t c = 0; c < channels.size(); c++) {
+        out[c].resize(nbOut);
+    }
+
+    for (std::size_t s = 0; s < in.size(); s++)
+    {
+        m_pos = (m_pos == 0) ? m_length - 1 : m_pos - 1;
+        m_i[m_pos] = m_i[m_pos + m_length] = in[s].real();
+        m_q[m_pos] = m_q[m_pos + m_length] = in[s].imag();
+
+        if (++m_phase < m_nbChannels) {
+            continue;
+        }
+
+        m_phase = 0;
+
+        // polyphase branches: branch p sums the window samples p modulo M
+        const float *wi = &m_i[m_pos];
+        const float *wq = &m_q[m_pos];
+        const float *h = &m_coeffs[0];
+        float *re = &m_re[0];
+        float *im = &m_im[0];
+
+        for (unsigned int p = 0; p < m_nbChannels; p++)
+        {
+            re[p] = h[p] * wi[p];
+            im[p] = h[p] * wq[p];
+        }
+
+        for (unsigned int n = m_nbChannels; n < m_length; n += m_nbChannels)
+        {
+            for (unsigned int p = 0; p < m_nbChannels; p++)
+            {
+                re[p] += h[n + p] * wi[n + p];
+                im[p] += h[n + p] * wq[n + p];
+            }
+        }
+
+        inverseFFT();
+
+        for (std::size_t c = 0; c < channels.size(); c++)
+        {
+            unsigned int k = channels[c] & (m_nbChannels - 1);
+            out[c][o].setReal(roundSample(m_re[k] * gain));
+            out[c][o].setImag(roundSample(m_im[k] * gain));
+        }
+
+        o++;
+    }
+
+    sampleSize = outBits;
+}
@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <chrono>
+#include <iostream>
+
+#include "nanomsg/nn.h"
+
+#include "ControlReactor.h"
+#include "util.h"
+
+ControlReactor::ControlReactor(int nnSocket, MessageHandler messageHandler) :
+    m_socket(nnSocket),
+    m_messageHandler(messageHandler),
+    m_periodMs(0),
+    m_running(false),
+    m_nbMessages(0),
+    m_thread(0)
+{
+}
+
+ControlReactor::~ControlReactor()
+{
+    stop();
+}
+
+void ControlReactor::setTimer(unsigned int periodMs, TimerHandler timerHandler)
+{
+    m_periodMs = periodMs;
+    m_timerHandler = timerHandler;
+}
+
+void ControlReactor::start()
+{
+    if (m_thread) {
+        return;
+    }
+
+    m_running = true;
+    m_thread = new std::thread(&ControlReactor::run, this);
+    set_thread_name(m_thread->native_handle(), "sdmn-control");
+}
+
+void ControlReactor::stop()
+{
+    if (!m_thread) {
+        return;
+    }
+
+    m_running = false;
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+}
+
+void ControlReactor::run()
+{
+    std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_periodMs);
+
+    while (m_running.load())
+    {
+        int waitMs = m_maxWaitMs;
+
+        if (m_periodMs > 0)
+        {
+            int untilTick = std::chrono::duration_cast<std::chrono::milliseconds>(nextTick - std::chrono::steady_clock::now()).count();
+            waitMs = untilTick < 0 ? 0 : untilTick < waitMs ? untilTick : waitMs;
+        }
+
+        struct nn_pollfd pfd;
+        pfd.fd = m_socket;
+        pfd.events = NN_POLLIN;
+        pfd.revents = 0;
+
+        int rc = nn_poll(&pfd, 1, waitMs);
+
+        if (rc < 0)
+        {
+            std::cerr << "ControlReactor::run: nn_poll: " << nn_strerror(nn_errno()) << std::endl;
+            break;
+        }
+
+        if ((rc > 0) && (pfd.revents & NN_POLLIN)) {
+            receive();
+        }
+
+        if ((m_periodMs > 0) && (std::chrono::steady_clock::now() >= nextTick))
+        {
+            m_timerHandler();
+            nextTick += std::chrono::milliseconds(m_periodMs);
+
+            if (nextTick < std::chrono::steady_clock::now()) { // late by more than a period: do not burst
+                nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_periodMs);
+            }
+        }
+    }
+}
+
+void ControlReactor::receive()
+{
+    void *msgBuf = 0;
+
+    // all the messages queued meanwhile
+    for (int len; (len = nn_recv(m_socket, &msgBuf, NN_MSG, NN_DONTWAIT)) >= 0; )
+    {
+        if (msgBuf)
+        {
+            std::string msg((char *) msgBuf, len);
+            nn_freemsg(msgBuf);
+            msgBuf = 0;
+            std::cerr << "ControlReactor::receive: " << msg << std::endl;
+            m_messageHandler(msg);
+            m_nbMessages++;
+        }
+    }
+}
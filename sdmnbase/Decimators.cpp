@@ -17,6 +17,7 @@
 ///////////////////////////////////////////////////////////////////////////////////
 
 #include "Decimators.h"
+#include "IQPlanar.h"
 
 /** Just do a rescaling to 16 bits */
 void Decimators::decimate1(unsigned int& sampleSize, IQSampleVector& inout)
@@ -1303,3 +1304,347 @@ void Decimators::decimate64_cen(unsigned int& sampleSize, const IQSampleVector&
 
 	sampleSize += (6 - trunk_shift);
 }
+
+/** double byte samples to double byte samples block cascade decimation by 8 to 64 */
+void Decimators::decimateBlock(unsigned int log2Decim, int fcPos, unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out, NCO *nco)
+{
+	unsigned int ncoGain = 0;
+
+	if (nco && nco->active())
+	{
+		fcPos = 2;
+		ncoGain = (sampleSize < 15 ? 15 - sampleSize : 0); // keep the precision of small samples through the rotation
+		sampleSize += ncoGain;
+	}
+	else
+	{
+		nco = 0;
+	}
+
+	unsigned int decim = 1<<log2Decim;
+	std::size_t len = (in.size() / decim) * decim;
+	out.resize(len/decim);
+	IQSampleVector::iterator it = out.begin();
+	unsigned int outBits = 16 - log2Decim;
+	unsigned int trunk_shift = (sampleSize < outBits ? 0 : sampleSize - outBits); // trunk to keep 16 bits (shift right)
+	unsigned int norm_shift  = (sampleSize < outBits ? outBits - sampleSize : 0); // shift to normalize to 16 bits (shift left)
+	unsigned int nbStages = (fcPos == 2 ? log2Decim : log2Decim - 2); // inf and sup start with a fs/4 shift and decimation by 4
+
+	for (std::size_t chunk = 0; chunk < len; chunk += DECIMATORS_BLOCK_SIZE)
+	{
+		unsigned int chunkLen = (len - chunk < DECIMATORS_BLOCK_SIZE ? len - chunk : DECIMATORS_BLOCK_SIZE);
+		const IQSample *s = &in[chunk];
+		unsigned int n;
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
+		int32_t *bi = m_planarBlock.i();
+		int32_t *bq = m_planarBlock.q();
+
+		if (fcPos == 0) // infra
+		{
+			n = chunkLen/4;
+
+			for (unsigned int i = 0; i < n; i++, s += 4)
+			{
+				bi[i] = s[0].real() - s[1].imag() + s[3].imag() - s[2].real();
+				bq[i] = s[0].imag() - s[2].imag() + s[1].real() - s[3].real();
+			}
+		}
+		else if (fcPos == 1) // supra
+		{
+			n = chunkLen/4;
+
+			for (unsigned int i = 0; i < n; i++, s += 4)
+			{
+				bi[i] =  s[0].imag() - s[1].real() - s[2].imag() + s[3].real();
+				bq[i] = -s[0].real() - s[1].imag() + s[2].real() + s[3].imag();
+			}
+		}
+		else if (nco) // centered after frequency shift
+		{
+			n = chunkLen;
+			nco->mixPlanar(s, bi, bq, n, ncoGain);
+		}
+		else // centered
+		{
+			n = chunkLen;
+			IQPlanar::deinterleave(s, bi, bq, n);
+		}
+
+		for (unsigned int stage = 0; stage < nbStages; stage++, n /= 2)
+		{
+			switch (stage)
+			{
+			case 0:
+				m_planar2.decimate(bi, bq, bi, bq, n);
+				break;
+			case 1:
+				m_planar4.decimate(bi, bq, bi, bq, n);
+				break;
+			case 2:
+				m_planar8.decimate(bi, bq, bi, bq, n);
+				break;
+			case 3:
+				m_planar16.decimate(bi, bq, bi, bq, n);
+				break;
+			case 4:
+				m_planar32.decimate(bi, bq, bi, bq, n);
+				break;
+			default:
+				m_planar64.decimate(bi, bq, bi, bq, n);
+				break;
+			}
+		}
+
+		IQPlanar::interleave(bi, bq, &(*it), n, norm_shift, trunk_shift); // back to interleaved for the sink
+		it += n;
+#else
+		if (fcPos == 0) // infra
+		{
+			n = chunkLen/4;
+
+			for (unsigned int i = 0; i < n; i++, s += 4)
+			{
+				m_blockBuf[2*i]   = s[0].real() - s[1].imag() + s[3].imag() - s[2].real();
+				m_blockBuf[2*i+1] = s[0].imag() - s[2].imag() + s[1].real() - s[3].real();
+			}
+		}
+		else if (fcPos == 1) // supra
+		{
+			n = chunkLen/4;
+
+			for (unsigned int i = 0; i < n; i++, s += 4)
+			{
+				m_blockBuf[2*i]   =  s[0].imag() - s[1].real() - s[2].imag() + s[3].real();
+				m_blockBuf[2*i+1] = -s[0].real() - s[1].imag() + s[2].real() + s[3].imag();
+			}
+		}
+		else if (nco) // centered after frequency shift
+		{
+			n = chunkLen;
+			nco->mix(s, m_blockBuf, n, ncoGain);
+		}
+		else // centered
+		{
+			n = chunkLen;
+
+			for (unsigned int i = 0; i < n; i++)
+			{
+				m_blockBuf[2*i]   = s[i].real();
+				m_blockBuf[2*i+1] = s[i].imag();
+			}
+		}
+
+		for (unsigned int stage = 0; stage < nbStages; stage++, n /= 2)
+		{
+			switch (stage)
+			{
+			case 0:
+				halfbandStage(m_decimator2, m_blockBuf, n);
+				break;
+			case 1:
+				halfbandStage(m_decimator4, m_blockBuf, n);
+				break;
+			case 2:
+				halfbandStage(m_decimator8, m_blockBuf, n);
+				break;
+			case 3:
+				halfbandStage(m_decimator16, m_blockBuf, n);
+				break;
+			case 4:
+				halfbandStage(m_decimator32, m_blockBuf, n);
+				break;
+			default:
+				halfbandStage(m_decimator64, m_blockBuf, n);
+				break;
+			}
+		}
+
+		for (unsigned int i = 0; i < n; i++)
+		{
+			it->setReal(m_blockBuf[2*i]   << norm_shift >> trunk_shift);
+			it->setImag(m_blockBuf[2*i+1] << norm_shift >> trunk_shift);
+			++it;
+		}
+#endif
+	}
+
+	sampleSize += (log2Decim - trunk_shift);
+}
+
+namespace
+{
+
+/**
+ * Output of half band stage Stage of a decimation chain (1 is the first stage) computed from the input at s.
+ * Stage 0 gives the leaves: the input samples when centered or for infradyne (FcPos 0) and supradyne (FcPos 1)
+ * the fs/4 shift and decimation by 4 of decimate4_inf and decimate4_sup. Each stage filter takes its samples
+ * in the same order as in the sample by sample cascades.
+ */
+template<unsigned int Stage, int FcPos>
+struct DecimatorsChainStage
+{
+	static const unsigned int span = (FcPos == 2 ? 1 : 4) << Stage; //!< input samples per output sample
+
+	template<class HBFilter>
+	static inline void run(HBFilter *const *hb, const IQSample *s, int32_t& x, int32_t& y)
+	{
+		int32_t x0, y0;
+		DecimatorsChainStage<Stage-1, FcPos>::run(hb, s, x0, y0);
+		DecimatorsChainStage<Stage-1, FcPos>::run(hb, s + span/2, x, y);
+		hb[Stage-1]->myDecimate(x0, y0, &x, &y);
+	}
+};
+
+template<int FcPos>
+struct DecimatorsChainStage<0, FcPos>
+{
+	static const unsigned int span = (FcPos == 2 ? 1 : 4);
+
+	template<class HBFilter>
+	static inline void run(HBFilter *const *, const IQSample *s, int32_t& x, int32_t& y)
+	{
+		if (FcPos == 0) // infra
+		{
+			x = s[0].real() - s[1].imag() + s[3].imag() - s[2].real();
+			y = s[0].imag() - s[2].imag() + s[1].real() - s[3].real();
+		}
+		else if (FcPos == 1) // supra
+		{
+			x =  s[0].imag() - s[1].real() - s[2].imag() + s[3].real();
+			y = -s[0].real() - s[1].imag() + s[2].real() + s[3].imag();
+		}
+		else // centered
+		{
+			x = s[0].real();
+			y = s[0].imag();
+		}
+	}
+};
+
+} // namespace
+
+template<unsigned int Log2Decim, int FcPos, unsigned int InBits>
+void Decimators::decimateChain(unsigned int& sampleSize, const IQSampleVector& in, IQSampleVector& out)
+{
+	const unsigned int bits = InBits ? InBits : sampleSize;
+	const unsigned int outBits = 16 - Log2Decim;
+	const unsigned int trunk_shift = (bits < outBits ? 0 : bits - outBits); // trunk to keep 16 bits (shift right)
+	const unsigned int norm_shift  = (bits < outBits ? outBits - bits : 0); // shift to normalize to 16 bits (shift left)
+	static const unsigned int decim = 1 << Log2Decim;
+	std::size_t n = in.size() / decim;
+
+	if ((FcPos != 2) && (Log2Decim == 1)) // fs/4 shift with alternate signs, two samples out of four
+	{
+		n = (in.size() / 4) * 2;
+	}
+
+	out.resize(n);
+	IQSampleVector::iterator it = out.begin();
+	const IQSample *s = in.empty() ? 0 : &in[0];
+
+	if ((FcPos != 2) && (Log2Decim == 1))
+	{
+		for (std::size_t i = 0; i < n; i += 2, s += 4)
+		{
+			int32_t x0, y0, x1, y1;
+
+			if (FcPos == 0) // infra
+			{
+				x0 =  s[0].real() - s[1].imag();
+				y0 =  s[0].imag() + s[1].real();
+				x1 =  s[3].imag() - s[2].real();
+				y1 = -s[2].imag() - s[3].real();
+			}
+			else // supra
+			{
+				x0 =  s[0].imag() - s[1].real();
+				y0 = -s[0].real() - s[1].imag();
+				x1 =  s[3].real() - s[2].imag();
+				y1 =  s[2].real() + s[3].imag();
+			}
+
+			it->setReal(x0 << norm_shift >> trunk_shift);
+			it->setImag(y0 << norm_shift >> trunk_shift);
+			++it;
+			it->setReal(x1 << norm_shift >> trunk_shift);
+			it->setImag(y1 << norm_shift >> trunk_shift);
+			++it;
+		}
+	}
+	else
+	{
+		// inf and sup start with a fs/4 shift and decimation by 4 at the leaves
+		static const unsigned int nbStages = (FcPos == 2 ? Log2Decim : Log2Decim < 2 ? 0 : Log2Decim - 2);
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
+		IntHalfbandFilterEO1<DECIMATORS_HB_FILTER_ORDER> *const hb[6] = {
+#else
+		IntHalfbandFilterDB<DECIMATORS_HB_FILTER_ORDER> *const hb[6] = {
+#endif
+			&m_decimator2, &m_decimator4, &m_decimator8, &m_decimator16, &m_decimator32, &m_decimator64
+		};
+
+		for (std::size_t i = 0; i < n; i++, s += decim)
+		{
+			int32_t x, y;
+			DecimatorsChainStage<nbStages, FcPos>::run(hb, s, x, y);
+			it->setReal(x << norm_shift >> trunk_shift);
+			it->setImag(y << norm_shift >> trunk_shift);
+			++it;
+		}
+	}
+
+	sampleSize = bits + Log2Decim - trunk_shift;
+}
+
+template<unsigned int Log2Decim, int FcPos>
+Decimators::Chain Decimators::chainByBits(unsigned int sampleSize)
+{
+	switch (sampleSize)
+	{
+	case 8:
+		return &Decimators::decimateChain<Log2Decim, FcPos, 8>;
+	case 10:
+		return &Decimators::decimateChain<Log2Decim, FcPos, 10>;
+	case 12:
+		return &Decimators::decimateChain<Log2Decim, FcPos, 12>;
+	case 14:
+		return &Decimators::decimateChain<Log2Decim, FcPos, 14>;
+	case 16:
+		return &Decimators::decimateChain<Log2Decim, FcPos, 16>;
+	default:
+		return &Decimators::decimateChain<Log2Decim, FcPos, 0>;
+	}
+}
+
+template<unsigned int Log2Decim>
+Decimators::Chain Decimators::chainByFcPos(int fcPos, unsigned int sampleSize)
+{
+	if (fcPos == 0) {
+		return chainByBits<Log2Decim, 0>(sampleSize);
+	} else if (fcPos == 1) {
+		return chainByBits<Log2Decim, 1>(sampleSize);
+	} else {
+		return chainByBits<Log2Decim, 2>(sampleSize);
+	}
+}
+
+Decimators::Chain Decimators::selectChain(unsigned int log2Decim, int fcPos, unsigned int sampleSize)
+{
+	switch (log2Decim)
+	{
+	case 1:
+		return chainByFcPos<1>(fcPos, sampleSize);
+	case 2:
+		return chainByFcPos<2>(fcPos, sampleSize);
+	case 3:
+		return chainByFcPos<3>(fcPos, sampleSize);
+	case 4:
+		return chainByFcPos<4>(fcPos, sampleSize);
+	case 5:
+		return chainByFcPos<5>(fcPos, sampleSize);
+	case 6:
+		return chainByFcPos<6>(fcPos, sampleSize);
+	default:
+		return 0;
+	}
+}
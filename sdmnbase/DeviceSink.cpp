@@ -20,9 +20,76 @@
 #include "DeviceSink.h"
 
 #include "Upsampler.h"
+#include "UDPSource.h"
+#include "JitterBuffer.h"
+#include "ControlReactor.h"
 
+#include <cerrno>
+#include <cstring>
 #include <iostream>
 
+DeviceSink::~DeviceSink()
+{
+    stopControl();
+}
+
+void DeviceSink::startControl()
+{
+    if (m_controlReactor) {
+        return;
+    }
+
+    m_controlReactor = new ControlReactor(m_nnReceiver, [this](std::string& msg)
+    {
+        if (!configure(msg)) {
+            std::cerr << "DeviceSink::startControl: config error: " << error() << std::endl;
+        }
+    });
+
+    m_controlReactor->setTimer(1000, [this]() { sendStatus(); });
+    m_controlReactor->start();
+}
+
+void DeviceSink::stopControl()
+{
+    if (m_controlReactor)
+    {
+        m_controlReactor->stop();
+        delete m_controlReactor;
+        m_controlReactor = 0;
+    }
+}
+
+void DeviceSink::sendStatus()
+{
+    char msgBufSend[256];
+
+    uint32_t queuedVectors = m_buf ? m_buf->queued_vectors() : 0;
+    sprintf(msgBufSend, "%u", queuedVectors);
+
+    if (m_udpSource)
+    {
+        m_udpSource->getStatusMessage(msgBufSend);
+    }
+
+    if (m_jitterBuffer)
+    {
+        m_jitterBuffer->getStatusMessage(msgBufSend);
+    }
+
+    int bufSize = strlen(msgBufSend);
+    int rc = nn_send(m_nnReceiver, (void *) msgBufSend, bufSize, NN_DONTWAIT);
+
+    if ((rc < 0) && (nn_errno() == EAGAIN)) { // no controller connected
+        return;
+    }
+
+    if (rc != bufSize)
+    {
+        std::cerr << "DeviceSink::sendStatus: Cannot send message: " << msgBufSend << std::endl;
+    }
+}
+
 bool DeviceSink::configure(std::string& configureStr)
 {
     namespace qi = boost::spirit::qi;
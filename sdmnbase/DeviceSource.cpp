@@ -19,14 +19,49 @@
 #include "DeviceSource.h"
 
 #include "Downsampler.h"
+#include "ControlReactor.h"
+#include "FECCodec.h"
 
+#include <cstdio>
 #include <iostream>
 
+DeviceSource::~DeviceSource()
+{
+    stopControl();
+}
+
+void DeviceSource::startControl()
+{
+    if (m_controlReactor) {
+        return;
+    }
+
+    m_controlReactor = new ControlReactor(m_nnReceiver, [this](std::string& msg)
+    {
+        if (!configure(msg)) {
+            std::cerr << "DeviceSource::startControl: config error: " << error() << std::endl;
+        }
+    });
+
+    m_controlReactor->start();
+}
+
+void DeviceSource::stopControl()
+{
+    if (m_controlReactor)
+    {
+        m_controlReactor->stop();
+        delete m_controlReactor;
+        m_controlReactor = 0;
+    }
+}
+
 bool DeviceSource::configure(std::string& configureStr)
 {
     namespace qi = boost::spirit::qi;
     parsekv::key_value_sequence<std::string::iterator> p;
     parsekv::pairs_type m;
+    std::lock_guard<std::mutex> lock(m_configMutex); // the reader thread may be retuning
 
     if (!qi::parse(configureStr.begin(), configureStr.end(), p, m))
     {
@@ -65,8 +100,141 @@ bool DeviceSource::configure(std::string& configureStr)
             fprintf(stderr, "DeviceSource::configure: txdelay: %u us\n", m_txDelay);
         }
 
+        if (m.find("txbatch") != m.end())
+        {
+            int txBatch = atoi(m["txbatch"].c_str());
+            m_txBatch = (txBatch < 0 ? 0 : txBatch > 256 ? 256 : txBatch);
+            fprintf(stderr, "DeviceSource::configure: txbatch: %u\n", m_txBatch);
+        }
+
+        if (m.find("txpace") != m.end())
+        {
+            int txPace = atoi(m["txpace"].c_str());
+            m_txPace = (txPace < 0 ? 0 : txPace > 100 ? 100 : txPace);
+            fprintf(stderr, "DeviceSource::configure: txpace: %u %%\n", m_txPace);
+        }
+
+        if (m.find("fecauto") != m.end())
+        {
+            int fecAuto = atoi(m["fecauto"].c_str());
+            m_fecAuto = (fecAuto < 0 ? 0 : fecAuto > 512 ? 512 : fecAuto);
+            fprintf(stderr, "DeviceSource::configure: fecauto: %u\n", m_fecAuto);
+        }
+
+        if (m.find("nack") != m.end())
+        {
+            m_nack = (atoi(m["nack"].c_str()) != 0);
+            fprintf(stderr, "DeviceSource::configure: nack: %s\n", m_nack ? "on" : "off");
+        }
+
+        if (m.find("overload") != m.end())
+        {
+            m_overload = (atoi(m["overload"].c_str()) != 0);
+            fprintf(stderr, "DeviceSource::configure: overload: %s\n", m_overload ? "on" : "off");
+        }
+
+        if (m.find("frameblk") != m.end())
+        {
+            int frameBlocks = atoi(m["frameblk"].c_str());
+            m_frameBlocks = (frameBlocks < 2 ? 2 : frameBlocks > 1024 ? 1024 : frameBlocks);
+            fprintf(stderr, "DeviceSource::configure: frameblk: %u\n", m_frameBlocks);
+        }
+
+        if (m.find("framems") != m.end())
+        {
+            int frameTarget = atoi(m["framems"].c_str());
+            m_frameTarget = (frameTarget < 0 ? 0 : frameTarget);
+            fprintf(stderr, "DeviceSource::configure: framems: %u ms\n", m_frameTarget);
+        }
+
+        if (m.find("interleave") != m.end())
+        {
+            int interleave = atoi(m["interleave"].c_str());
+            m_interleave = (interleave < 1 ? 1 : interleave > 8 ? 8 : interleave);
+            fprintf(stderr, "DeviceSource::configure: interleave: %u frames\n", m_interleave);
+        }
+
+        if (m.find("feccodec") != m.end())
+        {
+            int fecCodec = FECCodec::find(m["feccodec"]);
+
+            if (fecCodec < 0)
+            {
+                m_error = "Invalid FEC codec: " + m["feccodec"];
+                return false;
+            }
+
+            m_fecCodec = fecCodec;
+            fprintf(stderr, "DeviceSource::configure: feccodec: %s\n", m["feccodec"].c_str());
+        }
+
+        // frequency scan
+
+        if (m.find("scan") != m.end())
+        {
+            if (!m_scan.configure(m["scan"]))
+            {
+                m_error = m_scan.error();
+                return false;
+            }
+
+            m.erase("scan");
+        }
+
+        // status request
+
+        if (m.find("status") != m.end())
+        {
+            sendStatus();
+        }
+
         // configuration for the source itself
 
         return configure(m);
     }
 }
+
+void DeviceSource::scan(std::size_t nbSamples)
+{
+    std::uint64_t frequency;
+
+    if (!m_scan.advance(nbSamples, get_sample_rate(), frequency)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_configMutex);
+
+    if (retune(frequency))
+    {
+        m_confFreq = frequency;
+        m_scan.retuned();
+    }
+    else
+    {
+        std::cerr << "DeviceSource::scan: cannot retune to " << frequency << " Hz: " << m_error << ". Scan stopped" << std::endl;
+        m_scan.configure("off");
+    }
+}
+
+void DeviceSource::sendStatus()
+{
+    char msgBufSend[256];
+    DataBuffer<IQSample> *bufs[2] = {m_buf, m_outBuf};
+    int msgLen = 0;
+
+    for (int i = 0; i < 2; i++)
+    {
+        msgLen += snprintf(&msgBufSend[msgLen], sizeof(msgBufSend) - msgLen, "%s%lu:%lu:%lu",
+                i == 0 ? "" : ":",
+                bufs[i] ? (unsigned long) bufs[i]->queued_samples() : 0UL,
+                bufs[i] ? (unsigned long) bufs[i]->dropped_blocks() : 0UL,
+                bufs[i] ? (unsigned long) bufs[i]->dropped_samples() : 0UL);
+    }
+
+    int rc = nn_send(m_nnReceiver, (void *) msgBufSend, msgLen, NN_DONTWAIT);
+
+    if (rc != msgLen)
+    {
+        std::cerr << "DeviceSource::sendStatus: Cannot send message: " << msgBufSend << std::endl;
+    }
+}
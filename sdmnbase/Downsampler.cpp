@@ -17,11 +17,18 @@
 ///////////////////////////////////////////////////////////////////////////////////
 
 #include "Downsampler.h"
+#include "Tracepoints.h"
 
 Downsampler::Downsampler(unsigned int decim,
 		fcPos_t fcPos) :
 	m_decim(decim),
-	m_fcPos(fcPos)
+	m_fcPos(fcPos),
+	m_blockDecim(false),
+	m_sampleRate(0),
+	m_srateOut(0),
+	m_shift(0),
+	m_chain(0),
+	m_chainBits(0)
 {
 }
 
@@ -31,6 +38,8 @@ Downsampler::~Downsampler()
 
 bool Downsampler::configure(parsekv::pairs_type& m)
 {
+	m_chain = 0; // selected again for the new decim and fcpos
+
 	if (m.find("decim") != m.end())
 	{
 		std::cerr << "Downsampler::configure: decim: " << m["decim"] << std::endl;
@@ -47,6 +56,20 @@ bool Downsampler::configure(parsekv::pairs_type& m)
 		}
 	}
 
+	if (m.find("cic") != m.end())
+	{
+		std::cerr << "Downsampler::configure: cic: " << m["cic"] << std::endl;
+		int ratio = atoi(m["cic"].c_str());
+
+		if (!m_cic.setRatio(ratio < 1 ? 1 : ratio))
+		{
+			m_error = "Invalid CIC decimation ratio";
+			return false;
+		}
+
+		m_cicOut.clear();
+	}
+
 	if (m.find("fcpos") != m.end())
 	{
 		std::cerr << "Downsampler::configure: fcpos: " << m["fcpos"] << std::endl;
@@ -63,100 +86,167 @@ bool Downsampler::configure(parsekv::pairs_type& m)
 		}
 	}
 
+	if (m.find("decblk") != m.end())
+	{
+		std::cerr << "Downsampler::configure: decblk: " << m["decblk"] << std::endl;
+		m_blockDecim = atoi(m["decblk"].c_str()) != 0;
+	}
+
+	if (m.find("shift") != m.end())
+	{
+		std::cerr << "Downsampler::configure: shift: " << m["shift"] << std::endl;
+		m_shift = atoll(m["shift"].c_str()); // NCO set at the next setSampleRate
+	}
+
+	if (m.find("srate_out") != m.end())
+	{
+		std::cerr << "Downsampler::configure: srate_out: " << m["srate_out"] << std::endl;
+		int srateOut = atoi(m["srate_out"].c_str());
+
+		if (srateOut < 0)
+		{
+			m_error = "Invalid output sample rate";
+			return false;
+		}
+		else
+		{
+			m_srateOut = srateOut;
+		}
+	}
+
+	return true;
+}
+
+bool Downsampler::setSampleRate(uint32_t sampleRate)
+{
+	m_sampleRate = sampleRate;
+
+	if ((m_shift != 0) && (sampleRate != 0) && (2 * (m_shift < 0 ? -m_shift : m_shift) >= sampleRate))
+	{
+		std::cerr << "Downsampler::setSampleRate: shift " << m_shift << " Hz is out of the " << sampleRate << " S/s band" << std::endl;
+		m_error = "Frequency shift out of the device band";
+		m_shift = 0;
+	}
+
+	// the NCO moves the quarter band of fcpos too as the decimators are then all centered. The CIC
+	// front-end is a low pass so the NCO also brings the quarter band of fcpos to DC without a shift.
+	int64_t quarter = m_fcPos == FC_POS_INFRA ? -(int64_t) sampleRate / 4 : m_fcPos == FC_POS_SUPRA ? sampleRate / 4 : 0;
+	m_nco.setFrequency((m_shift == 0) && !m_cic.active() ? 0 : m_shift + quarter, sampleRate);
+
+	if (m_cic.active() && (sampleRate % m_cic.getRatio() != 0)) {
+		std::cerr << "Downsampler::setSampleRate: warning: " << sampleRate << " S/s is not a multiple of the CIC ratio " << m_cic.getRatio() << std::endl;
+	}
+
+	uint32_t inRate = m_srateOut ? (sampleRate / m_cic.getRatio()) >> m_decim : 0;
+
+	if (!m_resampler.setRates(inRate, m_srateOut))
+	{
+		std::cerr << "Downsampler::setSampleRate: cannot resample " << inRate << " to " << m_srateOut << " S/s: ratio too complex" << std::endl;
+		m_error = "Output sample rate ratio too complex";
+		m_srateOut = 0;
+		m_resampler.setRates(0, 0);
+		return false;
+	}
+
 	return true;
 }
 
 void Downsampler::rescale(unsigned int& sampleSize, IQSampleVector& samples_inout)
 {
 	Decimators::decimate1(sampleSize, samples_inout); // rescale
+
+	if (m_nco.active() && !samples_inout.empty()) {
+		m_nco.mix(&samples_inout[0], samples_inout.size()); // in place at 16 bits
+	}
 }
 
 void Downsampler::process(unsigned int& sampleSize, const IQSampleVector& samples_in, IQSampleVector& samples_out)
 {
-	if (m_decim == 0)
+	SDMN_TRACE1(downsample_begin, samples_in.size());
+
+	if (m_cic.active())
+	{
+		processCIC(sampleSize, samples_in, samples_out);
+	}
+	else if (m_decim == 0)
 	{
 		samples_out = samples_in;
-		Decimators::decimate1(sampleSize, samples_out); // rescale
+		rescale(sampleSize, samples_out);
+	}
+	else if (m_nco.active())
+	{
+		m_decimators.decimateBlock(m_decim, (int) m_fcPos, sampleSize, samples_in, samples_out, &m_nco);
+	}
+	else if (m_blockDecim && (m_decim > 2))
+	{
+		m_decimators.decimateBlock(m_decim, (int) m_fcPos, sampleSize, samples_in, samples_out);
 	}
 	else
 	{
-		if (m_fcPos == 0) // infra
-		{
-			switch (m_decim)
-			{
-			case 1:
-				Decimators::decimate2_inf(sampleSize, samples_in, samples_out);
-				break;
-			case 2:
-				Decimators::decimate4_inf(sampleSize, samples_in, samples_out);
-				break;
-			case 3:
-				m_decimators.decimate8_inf(sampleSize, samples_in, samples_out);
-				break;
-			case 4:
-				m_decimators.decimate16_inf(sampleSize, samples_in, samples_out);
-				break;
-			case 5:
-				m_decimators.decimate32_inf(sampleSize, samples_in, samples_out);
-				break;
-			case 6:
-				m_decimators.decimate64_inf(sampleSize, samples_in, samples_out);
-				break;
-			default:
-				break;
-			}
-		}
-		else if (m_fcPos == 1) // supra
+		if (!m_chain || (sampleSize != m_chainBits)) // selected again only when the device sample size changes
 		{
-			switch (m_decim)
-			{
-			case 1:
-				Decimators::decimate2_sup(sampleSize, samples_in, samples_out);
-				break;
-			case 2:
-				Decimators::decimate4_sup(sampleSize, samples_in, samples_out);
-				break;
-			case 3:
-				m_decimators.decimate8_sup(sampleSize, samples_in, samples_out);
-				break;
-			case 4:
-				m_decimators.decimate16_sup(sampleSize, samples_in, samples_out);
-				break;
-			case 5:
-				m_decimators.decimate32_sup(sampleSize, samples_in, samples_out);
-				break;
-			case 6:
-				m_decimators.decimate64_sup(sampleSize, samples_in, samples_out);
-				break;
-			default:
-				break;
-			}
+			m_chain = Decimators::selectChain(m_decim, (int) m_fcPos, sampleSize);
+			m_chainBits = sampleSize;
 		}
-		else // centered
+
+		(m_decimators.*m_chain)(sampleSize, samples_in, samples_out);
+	}
+
+	if (m_resampler.active())
+	{
+		m_resampler.process(samples_out, m_resampled);
+		samples_out.swap(m_resampled);
+	}
+
+	SDMN_TRACE1(downsample_end, samples_out.size());
+}
+
+/**
+ * CIC front-end then the centered half band cascade. The CIC output is kept until there is a multiple of the
+ * half band decimation so that the cascade does not drop samples.
+ */
+void Downsampler::processCIC(unsigned int& sampleSize, const IQSampleVector& samples_in, IQSampleVector& samples_out)
+{
+	m_cicOut.reserve(m_cicOut.size() + samples_in.size() / m_cic.getRatio() + 1);
+
+	if (m_nco.active())
+	{
+		unsigned int ncoGain = (sampleSize < 15 ? 15 - sampleSize : 0); // keep the precision of small samples through the rotation
+		unsigned int cicSize = sampleSize;
+
+		for (std::size_t chunk = 0; chunk < samples_in.size(); chunk += DECIMATORS_BLOCK_SIZE)
 		{
-			switch (m_decim)
-			{
-			case 1:
-				m_decimators.decimate2_cen(sampleSize, samples_in, samples_out);
-				break;
-			case 2:
-				m_decimators.decimate4_cen(sampleSize, samples_in, samples_out);
-				break;
-			case 3:
-				m_decimators.decimate8_cen(sampleSize, samples_in, samples_out);
-				break;
-			case 4:
-				m_decimators.decimate16_cen(sampleSize, samples_in, samples_out);
-				break;
-			case 5:
-				m_decimators.decimate32_cen(sampleSize, samples_in, samples_out);
-				break;
-			case 6:
-				m_decimators.decimate64_cen(sampleSize, samples_in, samples_out);
-				break;
-			default:
-				break;
-			}
+			unsigned int n = (samples_in.size() - chunk < DECIMATORS_BLOCK_SIZE ? samples_in.size() - chunk : DECIMATORS_BLOCK_SIZE);
+			m_nco.mix(&samples_in[chunk], m_mixBuf, n, ncoGain);
+			cicSize = sampleSize + ncoGain;
+			m_cic.process(cicSize, m_mixBuf, n, m_cicOut);
 		}
+
+		sampleSize = cicSize;
+	}
+	else if (!samples_in.empty())
+	{
+		m_cic.process(sampleSize, &samples_in[0], samples_in.size(), m_cicOut);
+	}
+
+	if (m_decim == 0)
+	{
+		samples_out.swap(m_cicOut);
+		m_cicOut.clear();
+	}
+	else
+	{
+		unsigned int cicBits = sampleSize;
+		unsigned int fullScale = 16; // the CIC output is normalized
+		std::size_t len = (m_cicOut.size() >> m_decim) << m_decim;
+		m_decimators.decimateBlock(m_decim, (int) FC_POS_CENTER, fullScale, m_cicOut, samples_out);
+		m_cicOut.erase(m_cicOut.begin(), m_cicOut.begin() + len);
+		sampleSize = cicBits + m_decim < 16 ? cicBits + m_decim : 16;
+	}
+
+	if (m_resampler.active())
+	{
+		m_resampler.process(samples_out, m_resampled);
+		samples_out.swap(m_resampled);
 	}
 }
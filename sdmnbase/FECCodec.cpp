@@ -0,0 +1,648 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "FECCodec.h"
+#include "AlignedAllocator.h"
+#include "SharedCM256.h"
+
+namespace
+{
+
+/** dst ^= src by 64 bit words (vectorized by the compiler) then the remaining bytes */
+void xorBlock(uint8_t *dst, const uint8_t *src, int bytes)
+{
+    int i = 0;
+
+    for (; i + 8 <= bytes; i += 8)
+    {
+        uint64_t a, b;
+        memcpy(&a, &dst[i], 8);
+        memcpy(&b, &src[i], 8);
+        a ^= b;
+        memcpy(&dst[i], &a, 8);
+    }
+
+    for (; i < bytes; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+/** CM256 library object of the process */
+class CM256Codec : public FECCodec
+{
+public:
+    CM256Codec() : m_cm256(sharedCM256()) {}
+
+    virtual const char *getName() const { return "cm256"; }
+    virtual bool isInitialized() const { return m_cm256.isInitialized(); }
+    virtual bool isMDS() const { return true; }
+    virtual int getMaxNbBlocks() const { return 256; }
+
+    virtual int encode(CM256::cm256_encoder_params params, FECBlock *originals, void *recoveryBlocks)
+    {
+        CM256::cm256_block cm256Blocks[256];
+
+        if ((params.OriginalCount <= 0) || (params.OriginalCount + params.RecoveryCount > 256)) {
+            return -1;
+        }
+
+        for (int i = 0; i < params.OriginalCount; i++)
+        {
+            cm256Blocks[i].Block = originals[i].Block;
+            cm256Blocks[i].Index = originals[i].Index;
+        }
+
+        return m_cm256.cm256_encode(params, cm256Blocks, recoveryBlocks);
+    }
+
+    virtual int decode(CM256::cm256_encoder_params params, FECBlock *blocks, int nbBlocks)
+    {
+        CM256::cm256_block cm256Blocks[256];
+
+        if ((nbBlocks < params.OriginalCount) || (params.OriginalCount + params.RecoveryCount > 256)) {
+            return -1;
+        }
+
+        for (int i = 0; i < params.OriginalCount; i++) // the first OriginalCount blocks
+        {
+            cm256Blocks[i].Block = blocks[i].Block;
+            cm256Blocks[i].Index = blocks[i].Index;
+        }
+
+        int result = m_cm256.cm256_decode(params, cm256Blocks);
+
+        if (result == 0)
+        {
+            for (int i = 0; i < params.OriginalCount; i++) {
+                blocks[i].Index = cm256Blocks[i].Index;
+            }
+        }
+
+        return result;
+    }
+
+private:
+    CM256& m_cm256;
+};
+
+/**
+ * Interleaved parity: the FEC block j is the XOR of the original blocks i with i modulo RecoveryCount
+ * equal to j. Each FEC block restores one lost block of its class so any burst of up to RecoveryCount
+ * consecutive original blocks is restored, at the cost of a few XOR passes over the frame. Scattered
+ * losses hitting a class twice are not: combine it with the interleaving of frames where the link
+ * loses datagrams in bursts.
+ */
+class XORCodec : public FECCodec
+{
+public:
+    virtual const char *getName() const { return "xor"; }
+    virtual bool isInitialized() const { return true; }
+    virtual bool isMDS() const { return false; }
+    virtual int getMaxNbBlocks() const { return 256; }
+
+    virtual int encode(CM256::cm256_encoder_params params, FECBlock *originals, void *recoveryBlocks)
+    {
+        if (!validParams(params)) {
+            return -1;
+        }
+
+        for (int j = 0; j < params.RecoveryCount; j++)
+        {
+            uint8_t *recovery = (uint8_t *) recoveryBlocks + j * params.BlockBytes;
+
+            if (j >= params.OriginalCount) // empty class
+            {
+                memset((void *) recovery, 0, params.BlockBytes);
+                continue;
+            }
+
+            memcpy((void *) recovery, originals[j].Block, params.BlockBytes);
+
+            for (int i = j + params.RecoveryCount; i < params.OriginalCount; i += params.RecoveryCount) {
+                xorBlock(recovery, (const uint8_t *) originals[i].Block, params.BlockBytes);
+            }
+        }
+
+        return 0;
+    }
+
+    virtual int decode(CM256::cm256_encoder_params params, FECBlock *blocks, int nbBlocks)
+    {
+        if (!validParams(params)) {
+            return -1;
+        }
+
+        const uint8_t *originals[256];
+        int recovery[256]; // descriptor of the FEC block of each class
+        int nbLost[256];
+        int lostIndex[256];
+
+        memset((void *) originals, 0, params.OriginalCount * sizeof(originals[0]));
+
+        for (int j = 0; j < params.RecoveryCount; j++)
+        {
+            recovery[j] = -1;
+            nbLost[j] = 0;
+        }
+
+        for (int k = 0; k < nbBlocks; k++)
+        {
+            int index = blocks[k].Index;
+
+            if (index < params.OriginalCount) {
+                originals[index] = (const uint8_t *) blocks[k].Block;
+            } else if (index - params.OriginalCount < params.RecoveryCount) {
+                recovery[index - params.OriginalCount] = k;
+            } else {
+                return -2; // not a block of this code: the FEC blocks of the frame are not as given
+            }
+        }
+
+        for (int i = 0; i < params.OriginalCount; i++)
+        {
+            if (!originals[i])
+            {
+                nbLost[i % params.RecoveryCount]++;
+                lostIndex[i % params.RecoveryCount] = i;
+            }
+        }
+
+        for (int j = 0; j < params.RecoveryCount; j++) // check all can be restored before touching the blocks
+        {
+            if ((nbLost[j] > 1) || ((nbLost[j] == 1) && (recovery[j] < 0))) {
+                return 1;
+            }
+        }
+
+        for (int j = 0; j < params.RecoveryCount; j++)
+        {
+            if (nbLost[j] == 0) {
+                continue;
+            }
+
+            uint8_t *restored = (uint8_t *) blocks[recovery[j]].Block;
+
+            for (int i = j; i < params.OriginalCount; i += params.RecoveryCount)
+            {
+                if (originals[i]) {
+                    xorBlock(restored, originals[i], params.BlockBytes);
+                }
+            }
+
+            blocks[recovery[j]].Index = lostIndex[j];
+        }
+
+        return 0;
+    }
+
+private:
+    static bool validParams(const CM256::cm256_encoder_params& params)
+    {
+        return (params.OriginalCount > 0) && (params.RecoveryCount > 0) && (params.BlockBytes > 0)
+            && (params.OriginalCount + params.RecoveryCount <= 256);
+    }
+};
+
+/**
+ * LDPC staircase code (the construction of RFC 5170) for the frames beyond the 256 blocks of CM256.
+ * The FEC block j closes the parity equation j of the original blocks of the row j of a sparse matrix
+ * and of the FEC block j - 1 (staircase). Each original block is in 3 equations (fewer with less FEC
+ * blocks) drawn with a fixed seed so that both ends build the same matrix from the block counts of the
+ * frame. Encoding costs about 3 XOR passes over the frame whatever the number of FEC blocks. Decoding
+ * combines the equations around the lost FEC blocks then solves those of the lost original blocks by
+ * Gaussian elimination taking the sparsest equation first, which peels them one by one for light losses. It is not MDS: a frame needs a few more
+ * blocks than its original blocks to be restored.
+ */
+class LDPCCodec : public FECCodec
+{
+public:
+    virtual const char *getName() const { return "ldpc"; }
+    virtual bool isInitialized() const { return true; }
+    virtual bool isMDS() const { return false; }
+    virtual int getMaxNbBlocks() const { return FECCODEC_NBBLOCKSMAX; }
+
+    virtual int encode(CM256::cm256_encoder_params params, FECBlock *originals, void *recoveryBlocks)
+    {
+        if (!validParams(params)) {
+            return -1;
+        }
+
+        const Matrix& matrix = getMatrix(params.OriginalCount, params.RecoveryCount);
+        const std::vector<int>& rowStart = matrix.rowStart;
+        const std::vector<int>& rowColumns = matrix.rowColumns;
+
+        for (int j = 0; j < params.RecoveryCount; j++)
+        {
+            uint8_t *recovery = (uint8_t *) recoveryBlocks + j * params.BlockBytes;
+
+            if (j == 0) {
+                memset((void *) recovery, 0, params.BlockBytes);
+            } else {
+                memcpy((void *) recovery, (const void *) (recovery - params.BlockBytes), params.BlockBytes);
+            }
+
+            for (int e = rowStart[j]; e < rowStart[j+1]; e++) {
+                xorBlock(recovery, (const uint8_t *) originals[rowColumns[e]].Block, params.BlockBytes);
+            }
+        }
+
+        return 0;
+    }
+
+    virtual int decode(CM256::cm256_encoder_params params, FECBlock *blocks, int nbBlocks)
+    {
+        if (!validParams(params)) {
+            return -1;
+        }
+
+        int nbOriginal = params.OriginalCount;
+        int nbTotal = nbOriginal + params.RecoveryCount;
+        std::vector<const uint8_t *> received(nbTotal, (const uint8_t *) 0);
+        std::vector<int> recovery; // descriptors of the FEC blocks received that take the restored blocks
+
+        for (int k = 0; k < nbBlocks; k++)
+        {
+            int index = blocks[k].Index;
+
+            if ((index < 0) || (index >= nbTotal)) {
+                return -2; // not a block of this code: the FEC blocks of the frame are not as given
+            }
+
+            received[index] = (const uint8_t *) blocks[k].Block;
+
+            if (index >= nbOriginal) {
+                recovery.push_back(k);
+            }
+        }
+
+        std::vector<int> unknown(nbOriginal, -1); // unknown of each lost original block
+        std::vector<int> lost; // original block of each unknown
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            if (!received[i])
+            {
+                unknown[i] = lost.size();
+                lost.push_back(i);
+            }
+        }
+
+        int nbLostOriginal = lost.size();
+
+        if (nbLostOriginal > (int) recovery.size()) {
+            return 1; // less blocks than the original blocks
+        } else if (nbLostOriginal == 0) {
+            return 0;
+        }
+
+        const Matrix& matrix = getMatrix(nbOriginal, params.RecoveryCount);
+        const std::vector<int>& rowStart = matrix.rowStart;
+        const std::vector<int>& rowColumns = matrix.rowColumns;
+
+        // the FEC block j is only in the equations j and j + 1: with the FEC blocks j to k lost the XOR of the
+        // equations j to k + 1 is an equation of original blocks only. The equations from a lost FEC block to
+        // the end have no such combination and are of no use. The equations are then bit maps of their lost
+        // original blocks, each one from the equation first to equation last.
+        int nbWords = (nbLostOriginal + 63) / 64;
+        std::vector<int> equationFirst, equationLast;
+        std::vector<uint64_t> bits;
+        std::vector<uint64_t> row(nbWords, 0);
+        int first = 0;
+
+        for (int j = 0; j < params.RecoveryCount; j++)
+        {
+            for (int e = rowStart[j]; e < rowStart[j+1]; e++)
+            {
+                int u = unknown[rowColumns[e]];
+
+                if (u >= 0) {
+                    row[u / 64] ^= (uint64_t) 1 << (u % 64);
+                }
+            }
+
+            if (!received[nbOriginal + j]) {
+                continue; // combined with the next equation
+            }
+
+            if (weight(&row[0], nbWords) > 0)
+            {
+                equationFirst.push_back(first);
+                equationLast.push_back(j);
+                bits.insert(bits.end(), row.begin(), row.end());
+            }
+
+            std::fill(row.begin(), row.end(), 0);
+            first = j + 1;
+        }
+
+        // elimination on the bit maps only, the XOR of the blocks is replayed once the frame is known to be restored
+        int nbEquations = equationFirst.size();
+        std::vector<int> weights(nbEquations);
+        std::vector<bool> pivoted(nbEquations, false);
+        std::vector<int> pivotEquation(nbLostOriginal, -1);
+        std::vector<std::pair<int, int> > operations; // equation first ^= equation second
+
+        for (int e = 0; e < nbEquations; e++) {
+            weights[e] = weight(&bits[e * nbWords], nbWords);
+        }
+
+        while (true)
+        {
+            int pivot = -1;
+
+            for (int e = 0; e < nbEquations; e++)
+            {
+                if (!pivoted[e] && (weights[e] > 0) && ((pivot < 0) || (weights[e] < weights[pivot])))
+                {
+                    pivot = e;
+
+                    if (weights[e] == 1) {
+                        break;
+                    }
+                }
+            }
+
+            if (pivot < 0) {
+                break;
+            }
+
+            const uint64_t *pivotBits = &bits[pivot * nbWords];
+            int column = 0;
+
+            while (!((pivotBits[column / 64] >> (column % 64)) & 1)) {
+                column++;
+            }
+
+            pivoted[pivot] = true;
+            pivotEquation[column] = pivot;
+
+            for (int e = 0; e < nbEquations; e++)
+            {
+                uint64_t *equationBits = &bits[e * nbWords];
+
+                if ((e == pivot) || !((equationBits[column / 64] >> (column % 64)) & 1)) {
+                    continue;
+                }
+
+                for (int w = 0; w < nbWords; w++) {
+                    equationBits[w] ^= pivotBits[w];
+                }
+
+                weights[e] = weight(equationBits, nbWords);
+                operations.push_back(std::make_pair(e, pivot));
+            }
+        }
+
+        for (int u = 0; u < nbLostOriginal; u++) // check all can be restored before touching the blocks
+        {
+            if ((pivotEquation[u] < 0) || (weights[pivotEquation[u]] != 1)) {
+                return 1;
+            }
+        }
+
+        // value of each equation: XOR of its blocks received then the operations of the elimination
+        AlignedVector<uint8_t> values(nbEquations * params.BlockBytes);
+
+        for (int e = 0; e < nbEquations; e++)
+        {
+            uint8_t *value = &values[e * params.BlockBytes];
+
+            for (int j = equationFirst[e]; j <= equationLast[e]; j++)
+            {
+                forEachBlock(j, nbOriginal, rowStart, rowColumns, [&](int i)
+                {
+                    if (received[i]) {
+                        xorBlock(value, received[i], params.BlockBytes); // the FEC blocks inside the combination cancel out
+                    }
+                });
+            }
+        }
+
+        for (size_t o = 0; o < operations.size(); o++)
+        {
+            xorBlock(&values[operations[o].first * params.BlockBytes],
+                    &values[operations[o].second * params.BlockBytes],
+                    params.BlockBytes);
+        }
+
+        for (int u = 0; u < nbLostOriginal; u++)
+        {
+            FECBlock& restored = blocks[recovery[u]];
+            memcpy(restored.Block, (const void *) &values[pivotEquation[u] * params.BlockBytes], params.BlockBytes);
+            restored.Index = lost[u];
+        }
+
+        return 0;
+    }
+
+private:
+    static bool validParams(const CM256::cm256_encoder_params& params)
+    {
+        return (params.OriginalCount > 0) && (params.RecoveryCount > 0) && (params.BlockBytes > 0)
+            && (params.OriginalCount + params.RecoveryCount <= FECCODEC_NBBLOCKSMAX);
+    }
+
+    struct Matrix
+    {
+        int nbOriginal;
+        int nbRecovery;
+        std::vector<int> rowStart;
+        std::vector<int> rowColumns;
+    };
+
+    /** Matrix of these block counts, built again only when they change: the frames of a stream mostly have the same */
+    static const Matrix& getMatrix(int nbOriginal, int nbRecovery)
+    {
+        static thread_local Matrix matrix = {0, 0, std::vector<int>(), std::vector<int>()}; // the codec is shared by the threads
+
+        if ((matrix.nbOriginal != nbOriginal) || (matrix.nbRecovery != nbRecovery))
+        {
+            buildMatrix(nbOriginal, nbRecovery, matrix.rowStart, matrix.rowColumns);
+            matrix.nbOriginal = nbOriginal;
+            matrix.nbRecovery = nbRecovery;
+        }
+
+        return matrix;
+    }
+
+    /** Blocks of the equation j: the original blocks of the row j of the matrix, the FEC blocks j and j - 1 */
+    template<typename Function>
+    static void forEachBlock(int j, int nbOriginal, const std::vector<int>& rowStart, const std::vector<int>& rowColumns, Function f)
+    {
+        for (int e = rowStart[j]; e < rowStart[j+1]; e++) {
+            f(rowColumns[e]);
+        }
+
+        f(nbOriginal + j);
+
+        if (j > 0) {
+            f(nbOriginal + j - 1);
+        }
+    }
+
+    static int weight(const uint64_t *bits, int nbWords)
+    {
+        int count = 0;
+
+        for (int w = 0; w < nbWords; w++) {
+            count += __builtin_popcountll(bits[w]);
+        }
+
+        return count;
+    }
+
+    static bool inColumn(const int *columnRows, int nbRows, int row)
+    {
+        return std::find(columnRows, columnRows + nbRows, row) != columnRows + nbRows;
+    }
+
+    /**
+     * Sparse matrix of the original blocks of each equation (H1 of RFC 5170) as the columns of each row
+     * from rowColumns[rowStart[j]] to rowColumns[rowStart[j+1]] excluded. Each column draws its rows from
+     * a pool holding each row the same number of times, which evens the row degrees, then each row is
+     * given at least two columns.
+     */
+    static void buildMatrix(int nbOriginal, int nbRecovery, std::vector<int>& rowStart, std::vector<int>& rowColumns)
+    {
+        int nbColumnRows = std::min(3, nbRecovery);
+        std::minstd_rand0 random; // Park and Miller generator with its default seed: the same matrix at both ends
+        std::vector<int> pool(nbColumnRows * nbOriginal);
+        std::vector<std::pair<int, int> > entries; // row, column
+        int poolStart = 0;
+
+        for (size_t h = 0; h < pool.size(); h++) {
+            pool[h] = h % nbRecovery;
+        }
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            int columnRows[3];
+
+            for (int h = 0; h < nbColumnRows; h++)
+            {
+                int poolSize = pool.size();
+                int p = poolStart;
+
+                while ((p < poolSize) && inColumn(columnRows, h, pool[p])) {
+                    p++;
+                }
+
+                if (p < poolSize) // a row of the pool not in the column yet
+                {
+                    do {
+                        p = poolStart + random() % (poolSize - poolStart);
+                    } while (inColumn(columnRows, h, pool[p]));
+
+                    columnRows[h] = pool[p];
+                    pool[p] = pool[poolStart++];
+                }
+                else
+                {
+                    do {
+                        columnRows[h] = random() % nbRecovery;
+                    } while (inColumn(columnRows, h, columnRows[h]));
+                }
+
+                entries.push_back(std::make_pair(columnRows[h], i));
+            }
+        }
+
+        std::vector<int> degrees(nbRecovery, 0);
+        std::vector<int> rowColumn(nbRecovery, -1); // a column of each row
+
+        for (size_t e = 0; e < entries.size(); e++)
+        {
+            degrees[entries[e].first]++;
+            rowColumn[entries[e].first] = entries[e].second;
+        }
+
+        for (int j = 0; j < nbRecovery; j++)
+        {
+            while ((degrees[j] < 2) && (degrees[j] < nbOriginal))
+            {
+                int column;
+
+                do {
+                    column = random() % nbOriginal;
+                } while (column == rowColumn[j]);
+
+                entries.push_back(std::make_pair(j, column));
+                degrees[j]++;
+                rowColumn[j] = column;
+            }
+        }
+
+        rowStart.assign(nbRecovery + 1, 0);
+        rowColumns.resize(entries.size());
+
+        for (int j = 0; j < nbRecovery; j++) {
+            rowStart[j+1] = rowStart[j] + degrees[j];
+        }
+
+        std::vector<int> fill(rowStart.begin(), rowStart.end() - 1);
+
+        for (size_t e = 0; e < entries.size(); e++) {
+            rowColumns[fill[entries[e].first]++] = entries[e].second;
+        }
+    }
+};
+
+} // namespace
+
+FECCodec *FECCodec::get(int codecId)
+{
+    switch (codecId)
+    {
+    case FECCODEC_CM256:
+    {
+        static CM256Codec cm256Codec; // the CM256 tables are built on first use only
+        return &cm256Codec;
+    }
+    case FECCODEC_XOR:
+    {
+        static XORCodec xorCodec;
+        return &xorCodec;
+    }
+    case FECCODEC_LDPC:
+    {
+        static LDPCCodec ldpcCodec;
+        return &ldpcCodec;
+    }
+    default:
+        return 0;
+    }
+}
+
+int FECCodec::find(const std::string& name)
+{
+    for (int codecId = 0; codecId < FECCODEC_NBCODECS; codecId++)
+    {
+        if (name == get(codecId)->getName()) {
+            return codecId;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include "FECController.h"
+
+FECController::FECController() :
+    m_maxNbBlocksFEC(0),
+    m_minTxPace(0),
+    m_goodReports(0),
+    m_paceHold(0)
+{
+}
+
+void FECController::setMaxNbBlocksFEC(int maxNbBlocksFEC)
+{
+    m_maxNbBlocksFEC = (maxNbBlocksFEC < 0 ? 0 : maxNbBlocksFEC > 512 ? 512 : maxNbBlocksFEC);
+    m_goodReports = 0;
+    m_paceHold = 0;
+}
+
+bool FECController::update(const FECFeedback& feedback, int& nbBlocksFEC, int& txPace)
+{
+    if ((m_maxNbBlocksFEC == 0) || (feedback.m_nbFrames == 0)) {
+        return false;
+    }
+
+    int maxLost = feedback.m_maxLostBlocks;
+    int target = maxLost + (maxLost / 2 > m_minMargin ? maxLost / 2 : m_minMargin);
+    int newNbBlocksFEC = nbBlocksFEC;
+    int newTxPace = txPace;
+
+    if (target > m_maxNbBlocksFEC) {
+        target = m_maxNbBlocksFEC;
+    }
+
+    if (m_paceHold > 0) {
+        m_paceHold--;
+    }
+
+    if (target > nbBlocksFEC) // not enough margin: raise at once
+    {
+        newNbBlocksFEC = target;
+        m_goodReports = 0;
+    }
+    else if (feedback.m_nbFECBlocks != nbBlocksFEC) // some frames were sent before the last change
+    {
+        m_goodReports = 0;
+    }
+    else if (feedback.m_nbLostFrames > 0) // data lost with the maximum FEC: spread the blocks more
+    {
+        m_goodReports = 0;
+
+        if ((m_paceHold == 0) && (txPace < 100))
+        {
+            newTxPace = (txPace < m_paceStart ? m_paceStart : txPace + m_paceStep > 100 ? 100 : txPace + m_paceStep);
+            m_paceHold = m_paceHoldReports;
+        }
+    }
+    else if (++m_goodReports >= m_lowerReports) // margin to spare for a while: lower by small steps
+    {
+        m_goodReports = 0;
+
+        if (target < nbBlocksFEC)
+        {
+            int step = (nbBlocksFEC - target) / 4;
+            newNbBlocksFEC = nbBlocksFEC - (step < 1 ? 1 : step);
+        }
+        else if ((maxLost == 0) && (txPace > m_minTxPace))
+        {
+            newTxPace = (txPace - m_paceStep < m_minTxPace ? m_minTxPace : txPace - m_paceStep);
+        }
+    }
+
+    bool changed = (newNbBlocksFEC != nbBlocksFEC) || (newTxPace != txPace);
+    nbBlocksFEC = newNbBlocksFEC;
+    txPace = newTxPace;
+    return changed;
+}
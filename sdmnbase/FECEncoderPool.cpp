@@ -0,0 +1,124 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <thread>
+
+#include "FECEncoderPool.h"
+#include "UDPSinkFEC.h"
+#include "util.h"
+
+FECEncoderPool::FECEncoderPool(unsigned int nbThreads) :
+    m_running(true)
+{
+    nbThreads = std::min(std::max(nbThreads, 1U), (unsigned int) UDPSINKFEC_NBENCODERSMAX);
+    m_busy.resize(nbThreads, 0);
+
+    for (unsigned int i = 0; i < nbThreads; i++)
+    {
+        m_threads.push_back(new std::thread(run, this, i));
+        set_thread_name(m_threads.back()->native_handle(), "sdmn-fecenc");
+    }
+}
+
+FECEncoderPool::~FECEncoderPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_running = false;
+        m_jobs.clear();
+    }
+
+    m_jobCond.notify_all();
+
+    for (std::vector<std::thread*>::iterator it = m_threads.begin(); it != m_threads.end(); ++it)
+    {
+        (*it)->join();
+        delete *it;
+    }
+}
+
+void FECEncoderPool::submit(UDPSinkFEC *sink, int txIndex)
+{
+    Job job;
+    job.m_sink = sink;
+    job.m_txIndex = txIndex;
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+
+    m_jobCond.notify_one();
+}
+
+void FECEncoderPool::cancel(UDPSinkFEC *sink)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (std::deque<Job>::iterator it = m_jobs.begin(); it != m_jobs.end();)
+    {
+        if (it->m_sink == sink) {
+            it = m_jobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    m_doneCond.wait(lock, [this, sink]() { return std::find(m_busy.begin(), m_busy.end(), sink) == m_busy.end(); });
+}
+
+void FECEncoderPool::run(FECEncoderPool *pool, unsigned int index)
+{
+    CM256::cm256_encoder_params cm256Params;  //!< Main interface with CM256 encoder
+    FECBlock descriptorBlocks[FECCODEC_NBBLOCKSMAX]; //!< Pointers to data for the FEC encoder
+    AlignedVector<uint8_t> fecBlocks; //!< FEC data sized for the sink with the most FEC bytes per frame so far
+
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(pool->m_mutex);
+            pool->m_jobCond.wait(lock, [pool]() { return !pool->m_jobs.empty() || !pool->m_running; });
+
+            if (!pool->m_running) {
+                break;
+            }
+
+            job = pool->m_jobs.front();
+            pool->m_jobs.pop_front();
+            pool->m_busy[index] = job.m_sink;
+        }
+
+        std::size_t fecBytes = job.m_sink->getFECScratchBytes();
+
+        if (fecBytes > fecBlocks.size()) {
+            fecBlocks.resize(fecBytes);
+        }
+
+        job.m_sink->encodePooled(job.m_txIndex, cm256Params, descriptorBlocks, &fecBlocks[0]);
+
+        {
+            std::unique_lock<std::mutex> lock(pool->m_mutex);
+            pool->m_busy[index] = 0;
+        }
+
+        pool->m_doneCond.notify_all();
+    }
+}
@@ -17,6 +17,7 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.          //
 ///////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <iostream>
@@ -24,12 +25,15 @@
 #include <thread>
 #include <cstdlib>
 #include <ctime>
+#include <cerrno>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "FileSink.h"
 #include "util.h"
 #include "parsekv.h"
 #include "UDPSource.h"
+#include "JitterBuffer.h"
 
 FileSink *FileSink::m_this = 0;
 
@@ -37,21 +41,33 @@ FileSink::FileSink() :
     m_sampleRate(192000),
     m_frequency(435000000),
     m_filename("test.sdriq"),
-    m_delayUS(1000000),
+    m_fd(-1),
+    m_direct(false),
+    m_isDirect(false),
+    m_preallocMB(0),
+    m_fileBuf(0),
+    m_fileBufFill(0),
+    m_bytesWritten(0),
     m_running(false),
     m_thread(0),
+    m_writeThread(0),
     m_iqSamplesIndex(0)
 {
     m_devname = "FileSink";
+
+    if (posix_memalign((void **) &m_fileBuf, FILESINK_ALIGN, FILESINK_BUFSIZE) != 0)
+    {
+        m_error = "FileSink::FileSink: cannot allocate write buffer";
+        m_fileBuf = 0;
+    }
+
     m_this = this;
 }
 
 FileSink::~FileSink()
 {
-//    if (m_dev) {
-//        hackrf_close(m_dev);
-//    }
-
+    closeFile();
+    free(m_fileBuf);
     m_this = 0;
 }
 
@@ -73,6 +89,8 @@ std::uint32_t FileSink::get_frequency()
 void FileSink::print_specific_parms()
 {
     fprintf(stderr, "File name:         %s\n", m_filename.c_str());
+    fprintf(stderr, "Direct I/O         %s\n", m_direct ? "enabled" : "disabled");
+    fprintf(stderr, "Preallocation:     %u MB\n", m_preallocMB);
 }
 
 bool FileSink::configure(uint32_t changeFlags,
@@ -91,8 +109,6 @@ bool FileSink::configure(uint32_t changeFlags,
     if (changeFlags & 0x2)
     {
         m_sampleRate = sample_rate;
-        double delayF = (127*127*750000.0) / m_sampleRate; // 0.75 factor
-        m_delayUS = (uint32_t) delayF;
         closeAndOpenFlag = true;
     }
 
@@ -170,6 +186,29 @@ bool FileSink::configure(parsekv::pairs_type& m)
         }
     }
 
+    if (m.find("direct") != m.end())
+    {
+        std::cerr << "FileSink::configure: direct: " << m["direct"] << std::endl;
+        m_direct = m["direct"] == "1";
+        changeFlags |= 0x4;
+    }
+
+    if (m.find("prealloc") != m.end())
+    {
+        std::cerr << "FileSink::configure: prealloc: " << m["prealloc"] << std::endl;
+        int preallocMB = atoi(m["prealloc"].c_str());
+
+        if (preallocMB < 0)
+        {
+            std::cerr << "FileSink::configure: Invalid preallocation size" << std::endl;
+        }
+        else
+        {
+            m_preallocMB = preallocMB;
+            changeFlags |= 0x4;
+        }
+    }
+
     m_confFreq = frequency;
 	double tuner_freq = frequency;
 
@@ -178,20 +217,110 @@ bool FileSink::configure(parsekv::pairs_type& m)
 
 void FileSink::closeAndOpen()
 {
-    if (m_ofstream.is_open()) {
-        m_ofstream.close();
+    std::unique_lock<std::mutex> lock(m_fileMutex);
+
+    closeFile();
+
+    if (!m_fileBuf) {
+        return;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    m_fd = open(m_filename.c_str(), flags | (m_direct ? O_DIRECT : 0), 0644);
+    m_isDirect = m_direct && (m_fd >= 0);
+
+    if ((m_fd < 0) && m_direct && (errno == EINVAL)) // file system without direct I/O (tmpfs...)
+    {
+        std::cerr << "FileSink::closeAndOpen: direct I/O not supported for " << m_filename << " using buffered writes" << std::endl;
+        m_fd = open(m_filename.c_str(), flags, 0644);
     }
 
-    m_ofstream.open(m_filename.c_str(),  std::ios::binary);
+    if (m_fd < 0)
+    {
+        std::ostringstream err_ostr;
+        err_ostr << "FileSink::closeAndOpen: cannot open " << m_filename << ": " << strerror(errno);
+        m_error = err_ostr.str();
+        std::cerr << m_error << std::endl;
+        return;
+    }
 
-    m_ofstream.write((const char *) &m_sampleRate, sizeof(int));
-    m_ofstream.write((const char *) &m_frequency, sizeof(uint64_t));
+    if (m_preallocMB > 0)
+    {
+        // keep size: the file only grows with the data actually written
+        if (fallocate(m_fd, FALLOC_FL_KEEP_SIZE, 0, ((off_t) m_preallocMB) << 20) < 0) {
+            std::cerr << "FileSink::closeAndOpen: cannot preallocate " << m_preallocMB << " MB: " << strerror(errno) << std::endl;
+        }
+    }
+
+    // the header goes through the buffer so that all writes stay aligned
     std::time_t startingTimeStamp = time(0);
-    m_ofstream.write((const char *) &startingTimeStamp, sizeof(std::time_t));
+    std::memcpy(&m_fileBuf[0], &m_sampleRate, sizeof(int));
+    std::memcpy(&m_fileBuf[sizeof(int)], &m_frequency, sizeof(uint64_t));
+    std::memcpy(&m_fileBuf[sizeof(int) + sizeof(uint64_t)], &startingTimeStamp, sizeof(std::time_t));
+    m_fileBufFill = sizeof(int) + sizeof(uint64_t) + sizeof(std::time_t);
+    m_bytesWritten = 0;
+    m_error.clear();
 
     fprintf(stderr, "FileSink::closeAndOpen: %s %u %lu\n", m_filename.c_str(), m_sampleRate, m_frequency);
 }
 
+void FileSink::closeFile()
+{
+    if (m_fd < 0) {
+        return;
+    }
+
+    flush(true);
+    close(m_fd);
+    m_fd = -1;
+
+    fprintf(stderr, "FileSink::closeFile: %s: %lu bytes written\n", m_filename.c_str(), m_bytesWritten);
+}
+
+bool FileSink::flush(bool final)
+{
+    std::size_t len = final ? m_fileBufFill : m_fileBufFill & ~((std::size_t) FILESINK_ALIGN - 1);
+
+    if (final && m_isDirect && (len % FILESINK_ALIGN))
+    {
+        // the tail is not a whole block: finish without direct I/O
+        fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) & ~O_DIRECT);
+        m_isDirect = false;
+    }
+
+    std::size_t done = 0;
+
+    while (done < len)
+    {
+        ssize_t rc = ::write(m_fd, &m_fileBuf[done], len - done);
+
+        if (rc < 0)
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            std::ostringstream err_ostr;
+            err_ostr << "FileSink::flush: write error on " << m_filename << ": " << strerror(errno);
+            m_error = err_ostr.str();
+            std::cerr << m_error << std::endl;
+            m_fileBufFill = 0;
+            return false;
+        }
+
+        done += rc;
+    }
+
+    m_bytesWritten += len;
+    m_fileBufFill -= len;
+
+    if (m_fileBufFill) {
+        std::memmove(m_fileBuf, &m_fileBuf[len], m_fileBufFill);
+    }
+
+    return true;
+}
+
 bool FileSink::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
 {
     m_buf = buf;
@@ -201,8 +330,11 @@ bool FileSink::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
     {
         std::cerr << "FileSink::start: starting" << std::endl;
         m_running = true;
+        m_ready.reset();
         m_thread = new std::thread(run, stop_flag);
-        sleep(1);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
+        m_ready.wait(1000); // the file is open and the writer runs
         return *this;
     }
     else
@@ -216,70 +348,79 @@ bool FileSink::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
 void FileSink::run(std::atomic_bool *stop_flag)
 {
     std::cerr << "FileSink::run" << std::endl;
-    void *msgBuf = 0;
-    unsigned int count = 0;
-    char msgBufSend[128];
 
-    if (!m_this->m_ofstream.is_open()) m_this->closeAndOpen();
+    if (m_this->m_fd < 0) m_this->closeAndOpen();
 
-    while (!stop_flag->load())
+    m_this->m_writeThread = new std::thread(&FileSink::write, m_this);
+    set_thread_name(m_this->m_writeThread->native_handle(), "sdmn-write");
+    m_this->m_ready.notify(true);
+
+    // the samples are written by the writer thread, configuration and status by the control reactor
+    while (!m_this->m_ready.waitStop(stop_flag, 100)) {}
+
+    m_this->m_buf->push_end(); // release the writer if it waits for samples
+    m_this->m_writeThread->join();
+    delete m_this->m_writeThread;
+    m_this->m_writeThread = 0;
+
+    std::unique_lock<std::mutex> lock(m_this->m_fileMutex);
+    m_this->closeFile();
+}
+
+void FileSink::write()
+{
+    while (!m_stop_flag->load())
     {
-        int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
+        std::size_t queuedSamples = m_buf->queued_samples();
 
-        if ((len > 0) && msgBuf)
+        if (m_jitterBuffer && !m_jitterBuffer->isPlaying(queuedSamples))
         {
-            std::string msg((char *) msgBuf, len);
-            std::cerr << "FileSink::run: received message: " << msg << std::endl;
-            bool success = m_this->DeviceSink::configure(msg);
-            nn_freemsg(msgBuf);
-            msgBuf = 0;
-            if (!success) {
-                std::cerr << "FileSink::run: config error: " << m_this->DeviceSink::error() << std::endl;
-            }
+            usleep(1000);
+            continue;
         }
 
-        if (m_this->m_buf->queued_samples() > 0)
-        {
-            fprintf(stderr, "FileSink::run: %lu samples left in queue\n", m_this->m_buf->queued_samples());
-            m_this->m_iqSamples = m_this->m_buf->pull();
-            m_this->m_ofstream.write(reinterpret_cast<char*>(&(m_this->m_iqSamples[0])), m_this->m_iqSamples.size()*2*sizeof(int16_t));
-        }
+        m_buf->pull(m_iqSamples);
 
-        if (count < 1000000 / m_this->m_delayUS)
-        {
-            count++;
+        if (m_buf->pull_end_reached() && m_iqSamples.empty()) {
+            break;
         }
-        else
-        {
-            uint32_t queuedVectors = m_this->m_buf->queued_vectors();
-            sprintf(msgBufSend, "%u", queuedVectors);
 
-            if (m_this->m_udpSource)
-            {
-                m_this->m_udpSource->getStatusMessage(msgBufSend);
-            }
+        std::unique_lock<std::mutex> lock(m_fileMutex);
 
-            int bufSize = strlen(msgBufSend);
-            int rc = nn_send(m_this->m_nnReceiver, (void *) msgBufSend, bufSize, 0);
+        if (m_fd < 0) {
+            continue;
+        }
 
-            if (rc != bufSize)
-            {
-                std::cerr << "HackRFSink::run: Cannot send message: " << msgBufSend << std::endl;
-            }
+        const char *p = reinterpret_cast<const char*>(m_iqSamples.data());
+        std::size_t len = m_iqSamples.size() * 2 * sizeof(int16_t);
 
-            count = 0;
+        while (len > 0)
+        {
+            std::size_t n = std::min(len, (std::size_t) FILESINK_BUFSIZE - m_fileBufFill);
+            std::memcpy(&m_fileBuf[m_fileBufFill], p, n);
+            m_fileBufFill += n;
+            p += n;
+            len -= n;
+
+            if ((m_fileBufFill == FILESINK_BUFSIZE) && !flush(false)) {
+                break;
+            }
         }
 
-        usleep(m_this->m_delayUS);
+        m_buf->recycle(std::move(m_iqSamples));
+        m_iqSamples.clear(); // without a pool the vector is not moved
     }
 
-    m_this->m_ofstream.close();
+    std::cerr << "FileSink::write: finished" << std::endl;
 }
 
 bool FileSink::stop()
 {
     std::cerr << "FileSink::stop" << std::endl;
 
+    stopControl();
+    m_ready.wake();
+
     m_thread->join();
     delete m_thread;
     return true;
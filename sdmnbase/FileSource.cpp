@@ -0,0 +1,319 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "FileSource.h"
+#include "Tracepoints.h"
+#include "util.h"
+#include "parsekv.h"
+
+
+// Open file device.
+FileSource::FileSource(int dev_index __attribute__((unused))) :
+    m_block_length(default_block_length),
+    m_thread(0),
+    m_realTime(true),
+    m_loop(false),
+    m_fd(-1),
+    m_map(0),
+    m_mapSize(0),
+    m_nbSamples(0),
+    m_readIndex(0),
+    m_freq(435000000),
+    m_srate(48000)
+{
+    m_devname = "FileSource";
+}
+
+// Close file device.
+FileSource::~FileSource()
+{
+    closeFile();
+}
+
+bool FileSource::configure(parsekv::pairs_type& m)
+{
+	if (m.find("file") != m.end())
+	{
+		std::cerr << "FileSource::configure(m): file: " << m["file"] << std::endl;
+
+		if (m_thread)
+		{
+			m_error = "File cannot be changed while replaying";
+			return false;
+		}
+
+		if (!openFile(m["file"])) {
+			return false;
+		}
+	}
+
+	if (m.find("realtime") != m.end())
+	{
+		std::cerr << "FileSource::configure(m): realtime: " << m["realtime"] << std::endl;
+		m_realTime = m["realtime"] != "0";
+	}
+
+	if (m.find("loop") != m.end())
+	{
+		std::cerr << "FileSource::configure(m): loop: " << m["loop"] << std::endl;
+		m_loop = m["loop"] == "1";
+	}
+
+	if (m.find("blklen") != m.end())
+	{
+		std::cerr << "FileSource::configure(m): blklen: " << m["blklen"] << std::endl;
+		int block_length = atoi(m["blklen"].c_str());
+		m_block_length = (block_length < 4096) ? 4096 :
+						 (block_length > 1024 * 1024) ? 1024 * 1024 :
+						 block_length;
+	}
+
+	if (m.find("decim") != m.end())
+	{
+		std::cerr << "FileSource::configure(m): decim: " << m["decim"] << std::endl;
+		int log2Decim = atoi(m["decim"].c_str());
+
+		if ((log2Decim < 0) || (log2Decim > 6))
+		{
+			m_error = "Invalid log2 decimation factor";
+			return false;
+		}
+		else
+		{
+			m_decim = log2Decim;
+		}
+	}
+
+	if (!m_map)
+	{
+		m_error = "No file given (file=<name>)";
+		return false;
+	}
+
+	return true;
+}
+
+bool FileSource::openFile(const std::string& filename)
+{
+    closeFile();
+    m_fd = open(filename.c_str(), O_RDONLY);
+
+    if (m_fd < 0)
+    {
+        std::ostringstream err_ostr;
+        err_ostr << "Cannot open " << filename << ": " << strerror(errno);
+        m_error = err_ostr.str();
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(m_fd, &st) < 0) || (st.st_size < header_size))
+    {
+        m_error = "Not a .sdriq file: " + filename;
+        closeFile();
+        return false;
+    }
+
+    m_mapSize = st.st_size;
+    void *map = mmap(0, m_mapSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+    if (map == MAP_FAILED)
+    {
+        std::ostringstream err_ostr;
+        err_ostr << "Cannot map " << filename << ": " << strerror(errno);
+        m_error = err_ostr.str();
+        m_mapSize = 0;
+        closeFile();
+        return false;
+    }
+
+    m_map = (const uint8_t *) map;
+    madvise(map, m_mapSize, MADV_SEQUENTIAL | MADV_WILLNEED); // read ahead aggressively and drop behind
+
+    int sampleRate;
+    std::memcpy(&sampleRate, &m_map[0], sizeof(int));
+    std::memcpy(&m_freq, &m_map[sizeof(int)], sizeof(uint64_t));
+
+    if (sampleRate <= 0)
+    {
+        m_error = "Invalid sample rate in header of " + filename;
+        closeFile();
+        return false;
+    }
+
+    m_srate = sampleRate;
+    m_confFreq = m_freq;
+    m_nbSamples = (m_mapSize - header_size) / (2 * sizeof(int16_t));
+    m_readIndex = 0;
+    m_filename = filename;
+
+    std::cerr << "FileSource::openFile: " << filename << ": " << m_nbSamples << " samples at " << m_srate << " S/s, " << m_freq << " Hz" << std::endl;
+    return true;
+}
+
+void FileSource::closeFile()
+{
+    if (m_map)
+    {
+        munmap((void *) m_map, m_mapSize);
+        m_map = 0;
+        m_mapSize = 0;
+    }
+
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// Return current sample frequency in Hz.
+uint32_t FileSource::get_sample_rate()
+{
+    return m_srate;
+}
+
+// Return device current center frequency in Hz.
+uint32_t FileSource::get_frequency()
+{
+    return m_freq;
+}
+
+void FileSource::print_specific_parms()
+{
+	std::cerr << "File:              " << m_filename << std::endl;
+	std::cerr << "Samples:           " << m_nbSamples << std::endl;
+	std::cerr << "Pacing:            " << (m_realTime ? "real time" : "as fast as possible") << std::endl;
+	std::cerr << "Loop:              " << (m_loop ? "yes" : "no") << std::endl;
+}
+
+bool FileSource::start(DataBuffer<IQSample>* buf, std::atomic_bool *stop_flag)
+{
+	std::cerr << "FileSource::start" << std::endl;
+
+    m_buf = buf;
+    m_stop_flag = stop_flag;
+
+    if (!m_map)
+    {
+        m_error = "No file mapped";
+        return false;
+    }
+
+    if (m_thread == 0)
+    {
+        m_thread = new std::thread(run, this);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
+        return true;
+    }
+    else
+    {
+        m_error = "Source thread already started";
+        return false;
+    }
+}
+
+bool FileSource::stop()
+{
+	std::cerr << "FileSource::stop" << std::endl;
+
+    stopControl();
+
+	if (m_thread)
+    {
+        m_thread->join();
+        delete m_thread;
+        m_thread = 0;
+    }
+
+    return true;
+}
+
+void FileSource::run(FileSource *source)
+{
+	std::cerr << "FileSource::run" << std::endl;
+
+    IQSampleVector iqsamples;
+    uint64_t nbSent = 0; // since start for real time pacing
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    while (!source->m_stop_flag->load())
+    {
+        if (source->m_readIndex == source->m_nbSamples)
+        {
+            if (!source->m_loop || (source->m_nbSamples == 0))
+            {
+                std::cerr << "FileSource::run: end of file" << std::endl;
+                source->m_buf->push_end();
+                break;
+            }
+
+            source->m_readIndex = 0;
+        }
+
+        std::size_t n = std::min<std::size_t>(source->m_block_length, source->m_nbSamples - source->m_readIndex);
+        source->m_buf->get_vector(iqsamples, n);
+        std::memcpy(iqsamples.data(), &source->m_map[header_size + source->m_readIndex * 2 * sizeof(int16_t)], n * 2 * sizeof(int16_t));
+        source->m_readIndex += n;
+
+        if (source->m_realTime)
+        {
+            // the block is delivered when it would have been fully received
+            nbSent += n;
+            std::this_thread::sleep_until(startTime + std::chrono::microseconds((nbSent * 1000000) / source->m_srate));
+        }
+        else
+        {
+            // as fast as possible but do not let the queue drop samples
+            nbSent = 0;
+            startTime = std::chrono::steady_clock::now();
+
+            while ((source->m_buf->queued_samples() > 4 * (std::size_t) source->m_block_length) && !source->m_stop_flag->load()) {
+                usleep(100);
+            }
+        }
+
+        SDMN_TRACE1(device_callback_entry, n);
+        source->m_buf->push(move(iqsamples));
+        SDMN_TRACE1(device_callback_exit, n);
+    }
+}
+
+// Return a list of supported devices.
+void FileSource::get_device_names(std::vector<std::string>& devices)
+{
+    devices.clear();
+    devices.push_back("File .sdriq replay");
+}
+
+/* end */
@@ -17,17 +17,21 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.          //
 ///////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
 #include <thread>
 #include <cstdlib>
+#include <unistd.h>
 
 #include "HackRFSink.h"
 #include "util.h"
 #include "parsekv.h"
 #include "UDPSource.h"
+#include "JitterBuffer.h"
+#include "SampleConversion.h"
 
 #define FLAG_FREQ     0x01
 #define FLAG_SRATE    0x02
@@ -42,7 +46,7 @@ const std::vector<int> HackRFSink::m_vgains({0, 2, 4, 6, 8, 10, 12, 14, 16, 18,
 const std::vector<int> HackRFSink::m_bwfilt({1750000, 2500000, 3500000, 5000000, 5500000, 6000000, 7000000,  8000000, 9000000, 10000000, 12000000, 14000000, 15000000, 20000000, 24000000, 28000000});
 
 // Open HackRF device.
-HackRFSink::HackRFSink(int dev_index) :
+HackRFSink::HackRFSink(int dev_index, const std::string& serial) :
     m_dev(0),
     m_sampleRate(5000000),
     m_frequency(100000000),
@@ -54,7 +58,11 @@ HackRFSink::HackRFSink(int dev_index) :
     m_amplitude(0.0),
     m_running(false),
     m_thread(0),
-    m_iqSamplesIndex(0)
+    m_feedThread(0),
+    m_iqSamplesIndex(0),
+    m_ringHead(0),
+    m_ringTail(0),
+    m_ringOffset(0)
 {
     m_devname = "HackRFSink";
 
@@ -67,6 +75,19 @@ HackRFSink::HackRFSink(int dev_index) :
         m_error = err_ostr.str();
         m_dev = 0;
     }
+    else if (!serial.empty())
+    {
+        // straight to the device without listing them all
+        rc = (hackrf_error) hackrf_open_by_serial(serial.c_str(), &m_dev);
+
+        if (rc != HACKRF_SUCCESS)
+        {
+            std::ostringstream err_ostr;
+            err_ostr << "HackRFSink::HackRFSink: failed to open HackRF device with serial " << serial << " (" << rc << ": " << hackrf_error_name(rc) << ")";
+            m_error = err_ostr.str();
+            m_dev = 0;
+        }
+    }
     else
     {
         hackrf_device_list_t *hackrf_devices = hackrf_device_list();
@@ -531,9 +552,25 @@ bool HackRFSink::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
     if (m_thread == 0)
     {
         std::cerr << "HackRFSink::start: starting" << std::endl;
+
+        for (int i = 0; i < HACKRFSINK_RINGSIZE; i++) {
+            m_ring[i].resize(HACKRFSINK_TRANSFERSIZE);
+        }
+
         m_running = true;
+        m_feedThread = new std::thread(&HackRFSink::feed, this);
+        set_thread_name(m_feedThread->native_handle(), "sdmn-feed");
+        m_ready.reset();
         m_thread = new std::thread(run, m_dev, stop_flag);
-        sleep(1);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
+
+        if (m_ready.wait(HACKRFSINK_STARTTIMEOUT_MS) == ReadySignal::Failed)
+        {
+            m_error = "Cannot start HackRF Tx";
+            return false;
+        }
+
         return *this;
     }
     else
@@ -547,66 +584,18 @@ bool HackRFSink::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
 void HackRFSink::run(hackrf_device* dev, std::atomic_bool *stop_flag)
 {
     std::cerr << "HackRFSink::run" << std::endl;
-    void *msgBuf = 0;
-    char msgBufSend[128];
-
-//    while (!stop_flag->load())
-//    {
-//        sleep(1);
-//
-//        int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
-//
-//        if ((len > 0) && msgBuf)
-//        {
-//            std::string msg((char *) msgBuf, len);
-//            std::cerr << "HackRFSink::run: received message: " << msg << std::endl;
-//            bool success = m_this->Sink::configure(msg);
-//            nn_freemsg(msgBuf);
-//            msgBuf = 0;
-//            if (!success) {
-//                std::cerr << "HackRFSink::run: config error: " << m_this->Sink::error() << std::endl;
-//            }
-//        }
-//    }
-//
-//    std::cerr << "HackRFSink::run: finished" << std::endl;
 
     hackrf_error rc = (hackrf_error) hackrf_start_tx(dev, tx_callback, 0);
 
+    m_this->m_ready.notify(rc == HACKRF_SUCCESS);
+
     if (rc == HACKRF_SUCCESS)
     {
-        while (!stop_flag->load() && (hackrf_is_streaming(dev) == HACKRF_TRUE))
+        // configuration and status are handled by the control reactor
+        while (hackrf_is_streaming(dev) == HACKRF_TRUE)
         {
-            sleep(1);
-
-            int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
-
-            if ((len > 0) && msgBuf)
-            {
-                std::string msg((char *) msgBuf, len);
-                std::cerr << "HackRFSink::run: received message: " << msg << std::endl;
-                bool success = m_this->DeviceSink::configure(msg);
-                nn_freemsg(msgBuf);
-                msgBuf = 0;
-                if (!success) {
-                    std::cerr << "HackRFSink::run: config error: " << m_this->DeviceSink::error() << std::endl;
-                }
-            }
-
-            uint32_t queuedVectors = m_this->m_buf->queued_vectors();
-            sprintf(msgBufSend, "%u", queuedVectors);
-
-            if (m_this->m_udpSource)
-            {
-                m_this->m_udpSource->getStatusMessage(msgBufSend);
-            }
-
-            int bufSize = strlen(msgBufSend);
-            int rc = nn_send(m_this->m_nnReceiver, (void *) msgBufSend, bufSize, 0);
-
-            if (rc != bufSize)
-            {
-                std::cerr << "HackRFSink::run: Cannot send message: " << msgBufSend << std::endl;
+            if (m_this->m_ready.waitStop(stop_flag, 1000)) {
+                break;
             }
         }
 
@@ -629,13 +618,68 @@ bool HackRFSink::stop()
 {
     std::cerr << "HackRFSink::stop" << std::endl;
 
+    stopControl();
+    m_ready.wake();
+
     m_thread->join();
     delete m_thread;
+
+    m_buf->push_end(); // release the feed thread if it waits for samples
+    m_feedThread->join();
+    delete m_feedThread;
+
     return true;
 }
 
+void HackRFSink::feed()
+{
+    uint32_t fill = 0; // bytes already written in the tail slot
+
+    while (!m_stop_flag->load())
+    {
+        m_buf->pull(m_iqSamples);
+
+        if (m_buf->pull_end_reached()) {
+            break;
+        }
+
+        m_iqSamplesIndex = 0;
+
+        while ((m_iqSamplesIndex < m_iqSamples.size()) && !m_stop_flag->load())
+        {
+            uint32_t tail = m_ringTail.load(std::memory_order_relaxed);
+
+            if (tail - m_ringHead.load(std::memory_order_acquire) == HACKRFSINK_RINGSIZE)
+            {
+                usleep(1000); // all transfers are ready: the USB side has at least a full transfer worth of time
+                continue;
+            }
+
+            uint32_t n = std::min<uint32_t>((HACKRFSINK_TRANSFERSIZE - fill) / 2, m_iqSamples.size() - m_iqSamplesIndex);
+            SampleConversion::iqToS8(&m_iqSamples[m_iqSamplesIndex], &m_ring[tail % HACKRFSINK_RINGSIZE][fill], 2*n);
+            m_iqSamplesIndex += n;
+            fill += 2*n;
+
+            if (fill == HACKRFSINK_TRANSFERSIZE)
+            {
+                m_ringTail.store(tail + 1, std::memory_order_release);
+                fill = 0;
+            }
+        }
+    }
+
+    std::cerr << "HackRFSink::feed: finished" << std::endl;
+}
+
+std::size_t HackRFSink::ring_queued_samples()
+{
+    uint32_t slots = m_ringTail.load(std::memory_order_acquire) - m_ringHead.load(std::memory_order_relaxed);
+    return slots ? (slots * HACKRFSINK_TRANSFERSIZE - m_ringOffset) / 2 : 0;
+}
+
 int HackRFSink::tx_callback(hackrf_transfer* transfer)
 {
+    set_current_thread_name_once("sdmn-usb"); // transfer thread of the library
     int bytes_to_read = transfer->valid_length; // bytes to read from FIFO as expected by the Tx
 
     if (m_this)
@@ -650,30 +694,38 @@ void HackRFSink::callback(char* buf, int len)
 {
     int i = 0;
 
-    for (; i < len/2; i++)
+    // after an underrun and at start send idle until the jitter buffer is refilled
+    if (m_jitterBuffer && !m_jitterBuffer->isPlaying(m_buf->queued_samples() + ring_queued_samples())) {
+        i = len;
+    }
+
+    // only copies: the samples were converted by the feed thread and no lock is taken
+    while (i < len)
     {
-        if (m_iqSamplesIndex == m_iqSamples.size())
+        uint32_t head = m_ringHead.load(std::memory_order_relaxed);
+
+        if (head == m_ringTail.load(std::memory_order_acquire))
         {
-            if (m_buf->test_buffer_fill((len/2) - i))
-            {
-                m_iqSamples = m_buf->pull();
-//                fprintf(stderr, "HackRFSink::callback: len: %d, pull size: %lu, queue size: %lu\n", len, m_iqSamples.size(), m_buf->queued_vectors());
-                m_iqSamplesIndex = 0;
-            }
-            else
-            {
-                m_iqSamples.clear();
-                m_iqSamplesIndex = 0;
-                break;
+            if (m_jitterBuffer) {
+                m_jitterBuffer->underrun();
             }
+
+            break;
         }
 
-        buf[2*i]     = m_iqSamples[m_iqSamplesIndex].real() >> 8;
-        buf[2*i+1]   = m_iqSamples[m_iqSamplesIndex].imag() >> 8;
-        m_iqSamplesIndex++;
+        int n = std::min(len - i, (int) (HACKRFSINK_TRANSFERSIZE - m_ringOffset));
+        std::memcpy(&buf[i], &m_ring[head % HACKRFSINK_RINGSIZE][m_ringOffset], n);
+        i += n;
+        m_ringOffset += n;
+
+        if (m_ringOffset == HACKRFSINK_TRANSFERSIZE)
+        {
+            m_ringOffset = 0;
+            m_ringHead.store(head + 1, std::memory_order_release);
+        }
     }
 
-    for (; i < len/2; i++)
+    for (i /= 2; i < len/2; i++)
     {
         buf[2*i]     = (int) (128 * m_amplitude);
         buf[2*i+1]   = 0;
@@ -24,16 +24,16 @@
 #include <cstdlib>
 
 #include "HackRFSource.h"
+#include "Tracepoints.h"
 #include "util.h"
 #include "parsekv.h"
 
-HackRFSource *HackRFSource::m_this = 0;
 const std::vector<int> HackRFSource::m_lgains({0, 8, 16, 24, 32, 40});
 const std::vector<int> HackRFSource::m_vgains({0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62});
 const std::vector<int> HackRFSource::m_bwfilt({1750000, 2500000, 3500000, 5000000, 5500000, 6000000, 7000000,  8000000, 9000000, 10000000, 12000000, 14000000, 15000000, 20000000, 24000000, 28000000});
 
 // Open HackRF device.
-HackRFSource::HackRFSource(int dev_index) :
+HackRFSource::HackRFSource(int dev_index, const std::string& serial) :
     m_dev(0),
     m_sampleRate(5000000),
     m_frequency(100000000),
@@ -55,6 +55,19 @@ HackRFSource::HackRFSource(int dev_index) :
         m_error = err_ostr.str();
         m_dev = 0;
     }
+    else if (!serial.empty())
+    {
+        // straight to the device without listing them all
+        rc = (hackrf_error) hackrf_open_by_serial(serial.c_str(), &m_dev);
+
+        if (rc != HACKRF_SUCCESS)
+        {
+            std::ostringstream err_ostr;
+            err_ostr << "Failed to open HackRF device with serial " << serial << " (" << rc << ": " << hackrf_error_name(rc) << ")";
+            m_error = err_ostr.str();
+            m_dev = 0;
+        }
+    }
     else
     {
         hackrf_device_list_t *hackrf_devices = hackrf_device_list();
@@ -94,8 +107,6 @@ HackRFSource::HackRFSource(int dev_index) :
     }
 
     m_bwfiltStr = bwfilt_ostr.str();
-
-    m_this = this;
 }
 
 HackRFSource::~HackRFSource()
@@ -106,8 +117,6 @@ HackRFSource::~HackRFSource()
 
     hackrf_error rc = (hackrf_error) hackrf_exit();
     std::cerr << "HackRFSource::~HackRFSource: HackRF library exit: " << rc << ": " << hackrf_error_name(rc) << std::endl;
-
-    m_this = 0;
 }
 
 void HackRFSource::get_device_names(std::vector<std::string>& devices)
@@ -188,6 +197,21 @@ void HackRFSource::print_specific_parms()
     fprintf(stderr, "Bias ant           %s\n", m_biasAnt ? "enabled" : "disabled");
 }
 
+bool HackRFSource::retune(std::uint64_t frequency)
+{
+    double tuner_freq = get_tuner_frequency(frequency, m_sampleRate);
+    tuner_freq += tuner_freq * m_ppm * 1e-6;
+
+    if ((hackrf_error) hackrf_set_freq(m_dev, (uint64_t) tuner_freq) != HACKRF_SUCCESS)
+    {
+        m_error = "hackrf_set_freq failed";
+        return false;
+    }
+
+    m_frequency = tuner_freq;
+    return true;
+}
+
 bool HackRFSource::configure(uint32_t changeFlags,
         uint32_t sample_rate,
 		uint64_t frequency,
@@ -526,6 +550,23 @@ bool HackRFSource::configure(parsekv::pairs_type& m)
 		}
 	}
 
+	if (m.find("iqcorr") != m.end())
+	{
+		std::cerr << "HackRFSource::configure: iqcorr: " << m["iqcorr"] << std::endl;
+		int iqcorr = atoi(m["iqcorr"].c_str());
+
+		if ((iqcorr < (int) IQCorrector::CorrectionOff) || (iqcorr > (int) IQCorrector::CorrectionDCIQ))
+		{
+			m_error = "Invalid IQ correction mode";
+            std::cerr << "HackRFSource::configure: " + m_error << std::endl;
+			return false;
+		}
+		else
+		{
+			m_iqCorrector.setMode((IQCorrector::mode_t) iqcorr);
+		}
+	}
+
 	if (m.find("fcpos") != m.end())
 	{
 		std::cerr << "HackRFSource::configure: fcpos: " << m["fcpos"] << std::endl;
@@ -587,8 +628,17 @@ bool HackRFSource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
     {
         std::cerr << "HackRFSource::start: starting" << std::endl;
         m_running = true;
-        m_thread = new std::thread(run, m_dev, stop_flag);
-        sleep(1);
+        m_ready.reset();
+        m_thread = new std::thread(run, m_dev, stop_flag, this);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
+
+        if (m_ready.wait(HACKRF_STARTTIMEOUT_MS) == ReadySignal::Failed)
+        {
+            m_error = "Cannot start HackRF Rx";
+            return false;
+        }
+
         return *this;
     }
     else
@@ -599,28 +649,20 @@ bool HackRFSource::start(DataBuffer<IQSample> *buf, std::atomic_bool *stop_flag)
     }
 }
 
-void HackRFSource::run(hackrf_device* dev, std::atomic_bool *stop_flag)
+void HackRFSource::run(hackrf_device* dev, std::atomic_bool *stop_flag, HackRFSource *source)
 {
     std::cerr << "HackRFSource::run" << std::endl;
-    void *msgBuf = 0;
 
-    hackrf_error rc = (hackrf_error) hackrf_start_rx(dev, rx_callback, 0);
+    hackrf_error rc = (hackrf_error) hackrf_start_rx(dev, rx_callback, (void *) source);
+
+    source->m_ready.notify(rc == HACKRF_SUCCESS);
 
     if (rc == HACKRF_SUCCESS)
     {
-        while (!stop_flag->load() && (hackrf_is_streaming(dev) == HACKRF_TRUE))
+        while (hackrf_is_streaming(dev) == HACKRF_TRUE)
         {
-            sleep(1);
-
-            int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
-
-            if ((len > 0) && msgBuf)
-            {
-                std::string msg((char *) msgBuf, len);
-                std::cerr << "HackRFSource::run: received: " << msg << std::endl;
-                m_this->DeviceSource::configure(msg);
-                nn_freemsg(msgBuf);
-                msgBuf = 0;
+            if (source->m_ready.waitStop(stop_flag, 1000)) {
+                break;
             }
         }
 
@@ -641,6 +683,9 @@ bool HackRFSource::stop()
 {
     std::cerr << "HackRFSource::stop" << std::endl;
 
+    stopControl();
+    m_ready.wake();
+
     m_thread->join();
     delete m_thread;
     return true;
@@ -648,11 +693,14 @@ bool HackRFSource::stop()
 
 int HackRFSource::rx_callback(hackrf_transfer* transfer)
 {
+    set_current_thread_name_once("sdmn-usb"); // transfer thread of the library
     int bytes_to_write = transfer->valid_length;
 
-    if (m_this)
+    HackRFSource *source = (HackRFSource *) transfer->rx_ctx;
+
+    if (source)
     {
-        m_this->callback((signed char *) transfer->buffer, bytes_to_write);
+        source->callback((signed char *) transfer->buffer, bytes_to_write);
     }
 
     return 0;
@@ -661,14 +709,12 @@ int HackRFSource::rx_callback(hackrf_transfer* transfer)
 void HackRFSource::callback(const signed char* buf, int len)
 {
     IQSampleVector iqsamples;
+    SDMN_TRACE1(device_callback_entry, len/2);
 
-    iqsamples.resize(len/2);
-
-    for (int i = 0; i < len/2; i++)
-    {
-        iqsamples[i]   = IQSample(buf[2*i],   buf[2*i+1]);
-//        iqsamples[2*i+1] = IQSample(buf[4*i+2], buf[4*i+3]);
-    }
+    m_buf->get_vector(iqsamples, len/2);
+    m_iqCorrector.s8ToIQ((const int8_t *) buf, iqsamples.data(), len, get_normalize());
 
     m_buf->push(move(iqsamples));
+    scan(len/2);
+    SDMN_TRACE1(device_callback_exit, len/2);
 }
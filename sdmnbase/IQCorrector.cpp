@@ -0,0 +1,247 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+
+#include "IQCorrector.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "SampleConversion.h"
+
+#if defined(USE_NEON) && !defined(SIMD_X86_DISPATCH)
+/** Round to nearest (ARMv7 has no rounding conversion) */
+static inline int32x4_t roundNEON(float32x4_t v)
+{
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(v), vdupq_n_u32(0x80000000));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+}
+#endif
+
+IQCorrector::IQCorrector() :
+    m_mode(CorrectionOff),
+    m_appliedMode(CorrectionOff),
+    m_primed(false),
+    m_mI(0), m_mQ(0), m_mII(0), m_mQQ(0), m_mIQ(0),
+    m_dcI(0), m_dcQ(0),
+    m_c1(1), m_c2(0)
+{
+}
+
+void IQCorrector::u8ToIQ(const uint8_t *buf, IQSample *out, unsigned int len, bool normalize)
+{
+    if (getMode() == CorrectionOff) {
+        SampleConversion::u8ToIQ(buf, out, len, normalize ? 8 : 0);
+    } else {
+        convert<true>((const int8_t *) buf, out, len, normalize ? 8 - IQCORRECTOR_EXTRA_BITS : 0);
+    }
+}
+
+void IQCorrector::s8ToIQ(const int8_t *buf, IQSample *out, unsigned int len, bool normalize)
+{
+    if (getMode() == CorrectionOff) {
+        SampleConversion::s8ToIQ(buf, out, len, normalize ? 8 : 0);
+    } else {
+        convert<false>(buf, out, len, normalize ? 8 - IQCORRECTOR_EXTRA_BITS : 0);
+    }
+}
+
+void IQCorrector::start(mode_t mode)
+{
+    m_appliedMode = mode;
+    m_primed = false;
+    m_dcI = 0;
+    m_dcQ = 0;
+    m_c1 = 1;
+    m_c2 = 0;
+}
+
+void IQCorrector::update(const double *sums, unsigned int n)
+{
+    double a = m_primed ? (double) n / IQCORRECTOR_TAU : 1.0;
+    a = a > 1.0 ? 1.0 : a;
+    m_primed = true;
+
+    m_mI  += a * (sums[0] / n - m_mI);
+    m_mQ  += a * (sums[1] / n - m_mQ);
+    m_mII += a * (sums[2] / n - m_mII);
+    m_mQQ += a * (sums[3] / n - m_mQQ);
+    m_mIQ += a * (sums[4] / n - m_mIQ);
+
+    m_dcI = m_mI;
+    m_dcQ = m_mQ;
+
+    if (m_appliedMode != CorrectionDCIQ) {
+        return;
+    }
+
+    double vI  = m_mII - m_mI * m_mI;
+    double vQ  = m_mQQ - m_mQ * m_mQ;
+    double cIQ = m_mIQ - m_mI * m_mQ;
+
+    if (vI < 1e-3) { // no signal
+        return;
+    }
+
+    double alpha = cIQ / vI;
+    double beta2 = vQ / vI - alpha * alpha;
+
+    if ((beta2 > 0.25) && (beta2 < 4.0)) // else not an imbalance that can be real
+    {
+        double beta = sqrt(beta2);
+        m_c1 = 1.0 / beta;
+        m_c2 = -alpha / beta;
+    }
+}
+
+template<bool Offset>
+void IQCorrector::convert(const int8_t *in, IQSample *out, unsigned int len, unsigned int shift)
+{
+    mode_t mode = getMode();
+
+    if (mode != m_appliedMode) {
+        start(mode);
+    }
+
+    const float g = 1 << (IQCORRECTOR_EXTRA_BITS + shift); // the normalization shift is folded in the gain
+    int16_t *x = (int16_t *) out;
+    unsigned int n = len / 2;
+    double sums[5] = {0, 0, 0, 0, 0}; // I, Q, I^2, Q^2, IQ
+    unsigned int i = 0;
+
+    while (i < n)
+    {
+        unsigned int end = (n - i < IQCORRECTOR_CHUNK ? n : i + IQCORRECTOR_CHUNK);
+        // integers summed in float are exact while below 2^24: 128 values of at most 2^14 per lane
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+        const __m128i bias = _mm_set1_epi8((char) 0x80);
+        const __m128 dc = _mm_setr_ps(m_dcI, m_dcQ, m_dcI, m_dcQ);
+        const __m128 k1 = _mm_setr_ps(g, m_c1 * g, g, m_c1 * g);
+        const __m128 k2 = _mm_setr_ps(0, m_c2 * g, 0, m_c2 * g);
+        __m128 s1 = _mm_setzero_ps(), s2 = _mm_setzero_ps(), s3 = _mm_setzero_ps();
+
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128i b = _mm_loadl_epi64((const __m128i*) &in[2*i]);
+
+            if (Offset) {
+                b = _mm_xor_si128(b, bias); // u8 - 128 as s8
+            }
+
+            __m128i v = _mm_srai_epi16(_mm_unpacklo_epi8(b, b), 8);
+            __m128 f0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)); // I0 Q0 I1 Q1
+            __m128 f1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)); // I2 Q2 I3 Q3
+            __m128 i0 = _mm_shuffle_ps(f0, f0, _MM_SHUFFLE(2,2,0,0));
+            __m128 i1 = _mm_shuffle_ps(f1, f1, _MM_SHUFFLE(2,2,0,0));
+
+            s1 = _mm_add_ps(s1, _mm_add_ps(f0, f1));
+            s2 = _mm_add_ps(s2, _mm_add_ps(_mm_mul_ps(f0, f0), _mm_mul_ps(f1, f1)));
+            s3 = _mm_add_ps(s3, _mm_add_ps(_mm_mul_ps(f0, i0), _mm_mul_ps(f1, i1)));
+
+            __m128 d0 = _mm_sub_ps(f0, dc);
+            __m128 d1 = _mm_sub_ps(f1, dc);
+            __m128 o0 = _mm_add_ps(_mm_mul_ps(d0, k1), _mm_mul_ps(_mm_shuffle_ps(d0, d0, _MM_SHUFFLE(2,2,0,0)), k2));
+            __m128 o1 = _mm_add_ps(_mm_mul_ps(d1, k1), _mm_mul_ps(_mm_shuffle_ps(d1, d1, _MM_SHUFFLE(2,2,0,0)), k2));
+            _mm_storeu_si128((__m128i*) &x[2*i], _mm_packs_epi32(_mm_cvtps_epi32(o0), _mm_cvtps_epi32(o1)));
+        }
+
+        float a1[4], a2[4], a3[4];
+        _mm_storeu_ps(a1, s1);
+        _mm_storeu_ps(a2, s2);
+        _mm_storeu_ps(a3, s3);
+        sums[0] += a1[0] + a1[2];
+        sums[1] += a1[1] + a1[3];
+        sums[2] += a2[0] + a2[2];
+        sums[3] += a2[1] + a2[3];
+        sums[4] += a3[1] + a3[3];
+#elif defined(USE_NEON)
+        const float32x2_t k = {m_c1 * g, m_c2 * g};
+        float32x4_t s1i = vdupq_n_f32(0), s1q = vdupq_n_f32(0), s2i = vdupq_n_f32(0), s2q = vdupq_n_f32(0), s3 = vdupq_n_f32(0);
+
+        for (; i + 8 <= end; i += 8)
+        {
+            int8x8x2_t b = vld2_s8(&in[2*i]); // I in val[0], Q in val[1]
+
+            if (Offset)
+            {
+                b.val[0] = veor_s8(b.val[0], vdup_n_s8((int8_t) 0x80));
+                b.val[1] = veor_s8(b.val[1], vdup_n_s8((int8_t) 0x80));
+            }
+
+            int16x8_t vi = vmovl_s8(b.val[0]);
+            int16x8_t vq = vmovl_s8(b.val[1]);
+
+            for (int h = 0; h < 2; h++)
+            {
+                float32x4_t fi = vcvtq_f32_s32(vmovl_s16(h == 0 ? vget_low_s16(vi) : vget_high_s16(vi)));
+                float32x4_t fq = vcvtq_f32_s32(vmovl_s16(h == 0 ? vget_low_s16(vq) : vget_high_s16(vq)));
+
+                s1i = vaddq_f32(s1i, fi);
+                s1q = vaddq_f32(s1q, fq);
+                s2i = vmlaq_f32(s2i, fi, fi);
+                s2q = vmlaq_f32(s2q, fq, fq);
+                s3  = vmlaq_f32(s3, fi, fq);
+
+                float32x4_t di = vsubq_f32(fi, vdupq_n_f32(m_dcI));
+                float32x4_t dq = vsubq_f32(fq, vdupq_n_f32(m_dcQ));
+                int16x4x2_t o;
+                o.val[0] = vqmovn_s32(roundNEON(vmulq_n_f32(di, g)));
+                o.val[1] = vqmovn_s32(roundNEON(vmlaq_lane_f32(vmulq_lane_f32(dq, k, 0), di, k, 1)));
+                vst2_s16(&x[2*i + 8*h], o);
+            }
+        }
+
+        float a[5][4];
+        vst1q_f32(a[0], s1i);
+        vst1q_f32(a[1], s1q);
+        vst1q_f32(a[2], s2i);
+        vst1q_f32(a[3], s2q);
+        vst1q_f32(a[4], s3);
+
+        for (int j = 0; j < 5; j++) {
+            sums[j] += a[j][0] + a[j][1] + a[j][2] + a[j][3];
+        }
+#endif
+        for (; i < end; i++)
+        {
+            int sI = Offset ? ((uint8_t) in[2*i])   - 128 : in[2*i];
+            int sQ = Offset ? ((uint8_t) in[2*i+1]) - 128 : in[2*i+1];
+            float dI = sI - m_dcI;
+            float dQ = sQ - m_dcQ;
+            long oI = lrintf(dI * g);
+            long oQ = lrintf(dQ * m_c1 * g + dI * m_c2 * g);
+
+            sums[0] += sI;
+            sums[1] += sQ;
+            sums[2] += sI * sI;
+            sums[3] += sQ * sQ;
+            sums[4] += sI * sQ;
+            x[2*i]   = oI > 32767 ? 32767 : oI < -32768 ? -32768 : oI;
+            x[2*i+1] = oQ > 32767 ? 32767 : oQ < -32768 ? -32768 : oQ;
+        }
+    }
+
+    if (n > 0) {
+        update(sums, n);
+    }
+}
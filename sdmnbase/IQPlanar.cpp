@@ -0,0 +1,96 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "IQPlanar.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+void IQPlanar::deinterleave(const IQSample *in, int32_t *i, int32_t *q, unsigned int n)
+{
+	const int16_t *x = (const int16_t *) in;
+	unsigned int j = 0;
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+	for (; j + 4 <= n; j += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*) &x[2*j]);
+		_mm_storeu_si128((__m128i*) &i[j], _mm_srai_epi32(_mm_slli_epi32(v, 16), 16)); // sign extended low halves
+		_mm_storeu_si128((__m128i*) &q[j], _mm_srai_epi32(v, 16));
+	}
+#elif defined(USE_NEON)
+	for (; j + 8 <= n; j += 8)
+	{
+		int16x8x2_t v = vld2q_s16(&x[2*j]);
+		vst1q_s32(&i[j],   vmovl_s16(vget_low_s16(v.val[0])));
+		vst1q_s32(&i[j+4], vmovl_s16(vget_high_s16(v.val[0])));
+		vst1q_s32(&q[j],   vmovl_s16(vget_low_s16(v.val[1])));
+		vst1q_s32(&q[j+4], vmovl_s16(vget_high_s16(v.val[1])));
+	}
+#endif
+	for (; j < n; j++)
+	{
+		i[j] = in[j].real();
+		q[j] = in[j].imag();
+	}
+}
+
+void IQPlanar::interleave(const int32_t *i, const int32_t *q, IQSample *out, unsigned int n,
+		unsigned int normShift, unsigned int trunkShift)
+{
+	unsigned int j = 0;
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+	const __m128i norm = _mm_cvtsi32_si128(normShift);
+	const __m128i trunk = _mm_cvtsi32_si128(trunkShift);
+	int16_t *x = (int16_t *) out;
+
+	for (; j + 8 <= n; j += 8)
+	{
+		// low 16 bits sign extended first so that the saturating pack truncates
+		__m128i i0 = _mm_srai_epi32(_mm_slli_epi32(_mm_sra_epi32(_mm_sll_epi32(_mm_loadu_si128((const __m128i*) &i[j]), norm), trunk), 16), 16);
+		__m128i i1 = _mm_srai_epi32(_mm_slli_epi32(_mm_sra_epi32(_mm_sll_epi32(_mm_loadu_si128((const __m128i*) &i[j+4]), norm), trunk), 16), 16);
+		__m128i q0 = _mm_srai_epi32(_mm_slli_epi32(_mm_sra_epi32(_mm_sll_epi32(_mm_loadu_si128((const __m128i*) &q[j]), norm), trunk), 16), 16);
+		__m128i q1 = _mm_srai_epi32(_mm_slli_epi32(_mm_sra_epi32(_mm_sll_epi32(_mm_loadu_si128((const __m128i*) &q[j+4]), norm), trunk), 16), 16);
+		__m128i vi = _mm_packs_epi32(i0, i1);
+		__m128i vq = _mm_packs_epi32(q0, q1);
+		_mm_storeu_si128((__m128i*) &x[2*j],   _mm_unpacklo_epi16(vi, vq));
+		_mm_storeu_si128((__m128i*) &x[2*j+8], _mm_unpackhi_epi16(vi, vq));
+	}
+#elif defined(USE_NEON)
+	const int32x4_t norm = vdupq_n_s32((int32_t) normShift);
+	const int32x4_t trunk = vdupq_n_s32(-(int32_t) trunkShift); // shift right
+	int16_t *x = (int16_t *) out;
+
+	for (; j + 8 <= n; j += 8)
+	{
+		int16x8x2_t v;
+		v.val[0] = vcombine_s16(vmovn_s32(vshlq_s32(vshlq_s32(vld1q_s32(&i[j]), norm), trunk)),
+				vmovn_s32(vshlq_s32(vshlq_s32(vld1q_s32(&i[j+4]), norm), trunk)));
+		v.val[1] = vcombine_s16(vmovn_s32(vshlq_s32(vshlq_s32(vld1q_s32(&q[j]), norm), trunk)),
+				vmovn_s32(vshlq_s32(vshlq_s32(vld1q_s32(&q[j+4]), norm), trunk)));
+		vst2q_s16(&x[2*j], v);
+	}
+#endif
+	for (; j < n; j++)
+	{
+		out[j].setReal(i[j] << normShift >> trunkShift);
+		out[j].setImag(q[j] << normShift >> trunkShift);
+	}
+}
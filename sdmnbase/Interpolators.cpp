@@ -604,3 +604,101 @@ void Interpolators::interpolate64_cen(const IQSampleVector& in, IQSampleVector&
         ++itOut;
     }
 }
+
+/** double byte samples to double byte samples block cascade interpolation by 2 to 64 */
+void Interpolators::interpolateBlock(unsigned int log2Interp, const IQSampleVector& in, IQSampleVector& out)
+{
+	std::size_t len = in.size();
+	std::size_t chunkSize = INTERPOLATORS_BLOCK_SIZE >> log2Interp;
+	out.resize(len << log2Interp);
+	IQSampleVector::iterator it = out.begin();
+
+	for (std::size_t chunk = 0; chunk < len; chunk += chunkSize)
+	{
+		unsigned int n = (len - chunk < chunkSize ? len - chunk : chunkSize);
+		const IQSample *s = &in[chunk];
+#if defined(SIMD_X86_DISPATCH) || defined(USE_NEON)
+		int32_t *bi = m_planarBlock[0].i();
+		int32_t *bq = m_planarBlock[0].q();
+		IQPlanar::deinterleave(s, bi, bq, n);
+
+		for (unsigned int stage = 0; stage < log2Interp; stage++, n *= 2)
+		{
+			int32_t *ni = m_planarBlock[(stage + 1) % 2].i();
+			int32_t *nq = m_planarBlock[(stage + 1) % 2].q();
+
+			switch (stage)
+			{
+			case 0:
+				m_planar2.interpolate(bi, bq, ni, nq, n);
+				break;
+			case 1:
+				m_planar4.interpolate(bi, bq, ni, nq, n);
+				break;
+			case 2:
+				m_planar8.interpolate(bi, bq, ni, nq, n);
+				break;
+			case 3:
+				m_planar16.interpolate(bi, bq, ni, nq, n);
+				break;
+			case 4:
+				m_planar32.interpolate(bi, bq, ni, nq, n);
+				break;
+			default:
+				m_planar64.interpolate(bi, bq, ni, nq, n);
+				break;
+			}
+
+			bi = ni;
+			bq = nq;
+		}
+
+		IQPlanar::interleave(bi, bq, &(*it), n); // back to interleaved for the device sink
+		it += n;
+#else
+		int32_t *buf = &m_blockBuf[0][2*INTERPOLATORS_BLOCK_HISTORY];
+
+		for (unsigned int i = 0; i < n; i++)
+		{
+			buf[2*i]   = s[i].real();
+			buf[2*i+1] = s[i].imag();
+		}
+
+		for (unsigned int stage = 0; stage < log2Interp; stage++, n *= 2)
+		{
+			int32_t *next = &m_blockBuf[(stage + 1) % 2][2*INTERPOLATORS_BLOCK_HISTORY];
+
+			switch (stage)
+			{
+			case 0:
+				halfbandStage(m_interpolator2, buf, next, n);
+				break;
+			case 1:
+				halfbandStage(m_interpolator4, buf, next, n);
+				break;
+			case 2:
+				halfbandStage(m_interpolator8, buf, next, n);
+				break;
+			case 3:
+				halfbandStage(m_interpolator16, buf, next, n);
+				break;
+			case 4:
+				halfbandStage(m_interpolator32, buf, next, n);
+				break;
+			default:
+				halfbandStage(m_interpolator64, buf, next, n);
+				break;
+			}
+
+			buf = next;
+		}
+
+		for (unsigned int i = 0; i < n; i++)
+		{
+			it->setReal(buf[2*i]);
+			it->setImag(buf[2*i+1]);
+			++it;
+		}
+#endif
+	}
+}
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "JitterBuffer.h"
+
+JitterBuffer::JitterBuffer() :
+    m_latencyMs(0),
+    m_targetSamples(0),
+    m_latency(0.0),
+    m_priming(true),
+    m_nbUnderruns(0),
+    m_nbOverruns(0),
+    m_avgFill(0.0),
+    m_phase(0.0),
+    m_drift(0.0),
+    m_avgInit(false)
+{
+}
+
+bool JitterBuffer::process(IQSampleVector& samples, std::size_t queuedSamples, uint32_t sampleRate)
+{
+    if ((m_latencyMs == 0) || (sampleRate == 0) || samples.empty()) {
+        return true;
+    }
+
+    std::size_t targetSamples = ((uint64_t) sampleRate * m_latencyMs) / 1000;
+    m_targetSamples.store(targetSamples); // follows sample rate changes
+
+    if (m_avgInit) {
+        m_avgFill += ((double) queuedSamples - m_avgFill) / JITTERBUFFER_AVERAGING;
+    } else {
+        m_avgFill = queuedSamples;
+        m_avgInit = true;
+    }
+
+    m_latency.store((m_avgFill * 1000.0) / sampleRate);
+
+    // small targets: leave room for the frame granularity
+    if (queuedSamples > std::max(JITTERBUFFER_OVERRUNFACTOR * targetSamples, targetSamples + 2*samples.size()))
+    {
+        m_nbOverruns++;
+        return false;
+    }
+
+    if (m_priming.load() || (targetSamples == 0)) { // filling up: no correction
+        return true;
+    }
+
+    // proportional correction of the fill error plus the integrated error that converges to the clock drift
+    double error = (m_avgFill - targetSamples) / targetSamples;
+    error = std::min(1.0, std::max(-1.0, error));
+    m_drift += (error * JITTERBUFFER_MAXCORRECTION * samples.size()) / (JITTERBUFFER_DRIFTTIME * sampleRate);
+    m_drift = std::min(JITTERBUFFER_MAXCORRECTION, std::max(-JITTERBUFFER_MAXCORRECTION, m_drift));
+    double correction = error * JITTERBUFFER_MAXCORRECTION + m_drift;
+    correction = std::min(JITTERBUFFER_MAXCORRECTION, std::max(-JITTERBUFFER_MAXCORRECTION, correction));
+    m_phase += correction * samples.size();
+    int nbSamples = (int) m_phase; // whole samples to delete (>0) or insert (<0)
+    int nbSamplesMax = samples.size() / 8;
+    nbSamples = std::min(nbSamplesMax, std::max(-nbSamplesMax, nbSamples));
+
+    if (nbSamples > 0) {
+        deleteSamples(samples, nbSamples);
+    } else if (nbSamples < 0) {
+        insertSamples(samples, -nbSamples);
+    }
+
+    m_phase -= nbSamples;
+    return true;
+}
+
+bool JitterBuffer::isPlaying(std::size_t queuedSamples)
+{
+    if (m_priming.load() && (queuedSamples >= m_targetSamples.load())) {
+        m_priming.store(false);
+    }
+
+    return !m_priming.load();
+}
+
+void JitterBuffer::underrun()
+{
+    if (!m_priming.load())
+    {
+        m_nbUnderruns++;
+        m_priming.store(true);
+    }
+}
+
+void JitterBuffer::getStatusMessage(char *messageBuffer)
+{
+    int msgLen = strlen(messageBuffer);
+    sprintf(&messageBuffer[msgLen], ":%.1f:%u:%u", m_latency.load(), m_nbUnderruns.load(), m_nbOverruns.load());
+}
+
+/** Delete nbSamples evenly spaced samples, each one merged with the next */
+void JitterBuffer::deleteSamples(IQSampleVector& samples, int nbSamples)
+{
+    std::size_t size = samples.size();
+    std::size_t step = size / (nbSamples + 1);
+    std::size_t w = 0;
+    int deleted = 0;
+
+    for (std::size_t r = 0; r < size; r++, w++)
+    {
+        if ((deleted < nbSamples) && (r == (deleted + 1) * step))
+        {
+            samples[w].m_real = (samples[r].m_real + samples[r+1].m_real) / 2;
+            samples[w].m_imag = (samples[r].m_imag + samples[r+1].m_imag) / 2;
+            deleted++;
+            r++;
+        }
+        else
+        {
+            samples[w] = samples[r];
+        }
+    }
+
+    samples.resize(w);
+}
+
+/** Insert nbSamples evenly spaced samples, each one the mean of its neighbours */
+void JitterBuffer::insertSamples(IQSampleVector& samples, int nbSamples)
+{
+    std::size_t size = samples.size();
+    std::size_t step = size / (nbSamples + 1);
+    samples.resize(size + nbSamples);
+    std::size_t w = size + nbSamples;
+    int inserted = nbSamples;
+
+    // from the end so that the samples not moved yet are not overwritten (w - r is the number left to insert)
+    for (std::size_t r = size; (r > 0) && (inserted > 0);)
+    {
+        r--;
+        IQSample sample = samples[r];
+        samples[--w] = sample;
+
+        if (r == inserted * step)
+        {
+            samples[--w] = IQSample((samples[r-1].m_real + sample.m_real) / 2, (samples[r-1].m_imag + sample.m_imag) / 2);
+            inserted--;
+        }
+    }
+}
@@ -0,0 +1,405 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "nanomsg/nn.h"
+#include "nanomsg/pubsub.h"
+
+#include "Metrics.h"
+#include "LatencyHistogram.h"
+#include "util.h"
+
+Metrics::Metrics() :
+    m_nnPublisher(-1),
+    m_httpSocket(-1),
+    m_periodMs(1000),
+    m_running(false),
+    m_thread(0)
+{
+}
+
+Metrics::~Metrics()
+{
+    stop();
+
+    if (m_nnPublisher >= 0) {
+        nn_close(m_nnPublisher);
+    }
+
+    if (m_httpSocket >= 0) {
+        close(m_httpSocket);
+    }
+}
+
+void Metrics::addCounter(const std::string& name, const std::string& labels, const std::string& help, Getter getter)
+{
+    add(name, "counter", labels, help, getter);
+}
+
+void Metrics::addGauge(const std::string& name, const std::string& labels, const std::string& help, Getter getter)
+{
+    add(name, "gauge", labels, help, getter);
+}
+
+void Metrics::addHistogram(const std::string& name, const std::string& labels, const std::string& help, const LatencyHistogram& histogram)
+{
+    add(name, "histogram", labels, help, Getter(), &histogram);
+}
+
+void Metrics::add(const std::string& name, const std::string& type, const std::string& labels, const std::string& help, Getter getter,
+        const LatencyHistogram *histogram)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Sample sample;
+    sample.m_labels = labels;
+    sample.m_getter = getter;
+    sample.m_histogram = histogram;
+
+    // samples of the same metric must be listed together
+    for (std::vector<Family>::iterator it = m_families.begin(); it != m_families.end(); ++it)
+    {
+        if (it->m_name == name)
+        {
+            it->m_samples.push_back(sample);
+            return;
+        }
+    }
+
+    Family family;
+    family.m_name = name;
+    family.m_help = help;
+    family.m_type = type;
+    family.m_samples.push_back(sample);
+    m_families.push_back(family);
+}
+
+bool Metrics::setPublishPort(unsigned int port)
+{
+    std::ostringstream os;
+    os << "tcp://*:" << port;
+
+    m_nnPublisher = nn_socket(AF_SP, NN_PUB);
+
+    if (m_nnPublisher < 0)
+    {
+        m_error = std::string("Metrics::setPublishPort: nn_socket: ") + nn_strerror(nn_errno());
+        return false;
+    }
+
+    if (nn_bind(m_nnPublisher, os.str().c_str()) < 0)
+    {
+        m_error = std::string("Metrics::setPublishPort: nn_bind: ") + os.str() + ": " + nn_strerror(nn_errno());
+        nn_close(m_nnPublisher);
+        m_nnPublisher = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool Metrics::setHttpPort(unsigned int port)
+{
+    m_httpSocket = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (m_httpSocket < 0)
+    {
+        m_error = std::string("Metrics::setHttpPort: socket: ") + strerror(errno);
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(m_httpSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    if ((bind(m_httpSocket, (sockaddr *) &addr, sizeof(addr)) < 0) || (listen(m_httpSocket, 8) < 0))
+    {
+        std::ostringstream os;
+        os << "Metrics::setHttpPort: port " << port << ": " << strerror(errno);
+        m_error = os.str();
+        close(m_httpSocket);
+        m_httpSocket = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void Metrics::start(unsigned int periodMs)
+{
+    if (m_thread || ((m_nnPublisher < 0) && (m_httpSocket < 0))) {
+        return;
+    }
+
+    m_periodMs = periodMs ? periodMs : 1000;
+    m_running = true;
+    m_thread = new std::thread(&Metrics::run, this);
+    set_thread_name(m_thread->native_handle(), "sdmn-metrics");
+}
+
+void Metrics::stop()
+{
+    if (!m_thread) {
+        return;
+    }
+
+    m_running = false;
+    m_thread->join();
+    delete m_thread;
+    m_thread = 0;
+}
+
+void Metrics::format(std::string& text)
+{
+    std::ostringstream os;
+    char value[32];
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        for (std::vector<Family>::const_iterator it = m_families.begin(); it != m_families.end(); ++it)
+        {
+            os << "# HELP " << it->m_name << " " << it->m_help << "\n";
+            os << "# TYPE " << it->m_name << " " << it->m_type << "\n";
+
+            for (std::vector<Sample>::const_iterator is = it->m_samples.begin(); is != it->m_samples.end(); ++is)
+            {
+                if (is->m_histogram)
+                {
+                    formatHistogram(os, it->m_name, *is);
+                    continue;
+                }
+
+                snprintf(value, sizeof(value), "%.15g", is->m_getter());
+                os << it->m_name;
+
+                if (!is->m_labels.empty()) {
+                    os << "{" << is->m_labels << "}";
+                }
+
+                os << " " << value << "\n";
+            }
+        }
+    }
+
+    formatThreads(os);
+    text = os.str();
+}
+
+/** Cumulative buckets with the upper bound in seconds then the sum and count */
+void Metrics::formatHistogram(std::ostringstream& os, const std::string& name, const Sample& sample)
+{
+    std::string labels = sample.m_labels.empty() ? "" : sample.m_labels + ",";
+    uint64_t cumulated = 0;
+    char value[32];
+
+    for (int i = 0; i < LatencyHistogram::getNbBuckets(); i++)
+    {
+        cumulated += sample.m_histogram->getBucket(i);
+
+        if (i == LatencyHistogram::getNbBuckets() - 1) {
+            snprintf(value, sizeof(value), "+Inf");
+        } else {
+            snprintf(value, sizeof(value), "%g", LatencyHistogram::getUpperBound(i) * 1e-6);
+        }
+
+        os << name << "_bucket{" << labels << "le=\"" << value << "\"} " << cumulated << "\n";
+    }
+
+    snprintf(value, sizeof(value), "%.15g", sample.m_histogram->getSum());
+    os << name << "_sum";
+
+    if (!sample.m_labels.empty()) {
+        os << "{" << sample.m_labels << "}";
+    }
+
+    os << " " << value << "\n" << name << "_count";
+
+    if (!sample.m_labels.empty()) {
+        os << "{" << sample.m_labels << "}";
+    }
+
+    os << " " << cumulated << "\n";
+}
+
+/** User and system CPU time of each thread of the process from /proc/self/task/<tid>/stat */
+void Metrics::formatThreads(std::ostringstream& os)
+{
+    DIR *dir = opendir("/proc/self/task");
+
+    if (!dir) {
+        return;
+    }
+
+    double tick = 1.0 / sysconf(_SC_CLK_TCK);
+    struct dirent *entry;
+
+    os << "# HELP sdrdaemon_thread_cpu_seconds_total CPU time used by the thread\n";
+    os << "# TYPE sdrdaemon_thread_cpu_seconds_total counter\n";
+
+    while ((entry = readdir(dir)) != 0)
+    {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        std::string path = std::string("/proc/self/task/") + entry->d_name + "/stat";
+        char stat[512];
+        FILE *file = fopen(path.c_str(), "r");
+
+        if (!file) {
+            continue; // the thread just ended
+        }
+
+        std::size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+        fclose(file);
+        stat[len] = '\0';
+
+        // tid (comm) state ppid ... utime stime: comm may contain spaces and parentheses
+        char *open = strchr(stat, '(');
+        char *close = strrchr(stat, ')');
+        unsigned long utime, stime;
+
+        if (!open || !close || (close < open)
+         || (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)) {
+            continue;
+        }
+
+        std::string comm(open + 1, close - open - 1);
+        char value[32];
+        snprintf(value, sizeof(value), "%.15g", (utime + stime) * tick);
+        os << "sdrdaemon_thread_cpu_seconds_total{thread=\"" << comm << "\",tid=\"" << entry->d_name << "\"} " << value << "\n";
+    }
+
+    closedir(dir);
+}
+
+void Metrics::publish()
+{
+    std::string text;
+    format(text);
+
+    // nobody subscribed or a slow subscriber: this period is skipped
+    if (nn_send(m_nnPublisher, text.data(), text.size(), NN_DONTWAIT) < 0 && (nn_errno() != EAGAIN)) {
+        std::cerr << "Metrics::publish: nn_send: " << nn_strerror(nn_errno()) << std::endl;
+    }
+}
+
+/** Answer one HTTP request with the metrics whatever the request is */
+void Metrics::serve()
+{
+    int fd = accept(m_httpSocket, 0, 0);
+
+    if (fd < 0) {
+        return;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 200000; // a stalled client must not block the publishing
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    char request[1024];
+
+    if (recv(fd, request, sizeof(request), 0) > 0)
+    {
+        std::string text;
+        format(text);
+
+        std::ostringstream os;
+        os << "HTTP/1.0 200 OK\r\n"
+           << "Content-Type: text/plain; version=0.0.4\r\n"
+           << "Content-Length: " << text.size() << "\r\n"
+           << "Connection: close\r\n\r\n"
+           << text;
+
+        std::string response = os.str();
+        const char *p = response.data();
+        std::size_t remaining = response.size();
+
+        while (remaining > 0)
+        {
+            ssize_t sent = send(fd, p, remaining, MSG_NOSIGNAL);
+
+            if (sent <= 0) {
+                break;
+            }
+
+            p += sent;
+            remaining -= sent;
+        }
+    }
+
+    close(fd);
+}
+
+void Metrics::run()
+{
+    std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_periodMs);
+
+    while (m_running.load())
+    {
+        int untilTick = std::chrono::duration_cast<std::chrono::milliseconds>(nextTick - std::chrono::steady_clock::now()).count();
+        int waitMs = untilTick < 0 ? 0 : untilTick < m_maxWaitMs ? untilTick : m_maxWaitMs;
+
+        if (m_httpSocket >= 0)
+        {
+            struct pollfd pfd;
+            pfd.fd = m_httpSocket;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            if ((poll(&pfd, 1, waitMs) > 0) && (pfd.revents & POLLIN)) {
+                serve();
+            }
+        }
+        else
+        {
+            usleep(waitMs * 1000);
+        }
+
+        if (std::chrono::steady_clock::now() >= nextTick)
+        {
+            if (m_nnPublisher >= 0) {
+                publish();
+            }
+
+            nextTick += std::chrono::milliseconds(m_periodMs);
+
+            if (nextTick < std::chrono::steady_clock::now()) { // late by more than a period: do not burst
+                nextTick = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_periodMs);
+            }
+        }
+    }
+}
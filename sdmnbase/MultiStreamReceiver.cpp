@@ -0,0 +1,293 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <poll.h>
+#include <string.h>
+#include <iostream>
+#include <thread>
+
+#include "MultiStreamReceiver.h"
+#include "UDPSocket.h"
+
+MultiStreamReceiver::MultiStreamReceiver(const std::string& address, FrameHandler& frameHandler) :
+    m_address(address),
+    m_frameHandler(frameHandler),
+    m_demuxBySource(false),
+    m_reorderWindow(1),
+    m_running(false)
+{
+}
+
+MultiStreamReceiver::~MultiStreamReceiver()
+{
+    stop();
+
+    for (std::vector<Stream*>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+        delete *it;
+    }
+}
+
+bool MultiStreamReceiver::start(int nbWorkers)
+{
+    if (m_running.load()) {
+        return true;
+    }
+
+    if (m_ports.empty())
+    {
+        m_error = "MultiStreamReceiver::start: no port to receive from";
+        return false;
+    }
+
+    if (nbWorkers < 1) {
+        nbWorkers = 1;
+    }
+
+    if (!m_demuxBySource && (nbWorkers > (int) m_ports.size())) {
+        nbWorkers = m_ports.size(); // one socket per port: more workers would have nothing to do
+    }
+
+    for (int i = 0; i < nbWorkers; i++)
+    {
+        Worker *worker = new Worker();
+        worker->m_receiver = this;
+        worker->m_rxBlocks.resize(MULTISTREAMRECEIVER_RXBATCH * SDRDAEMONFEC_UDPSIZEMAX);
+        worker->m_rxLengths.resize(MULTISTREAMRECEIVER_RXBATCH);
+        worker->m_rxAddrs.resize(MULTISTREAMRECEIVER_RXBATCH);
+        worker->m_thread = 0;
+        m_workers.push_back(worker);
+    }
+
+    try
+    {
+        for (unsigned int p = 0; p < m_ports.size(); p++)
+        {
+            for (int i = 0; i < nbWorkers; i++)
+            {
+                if (!m_demuxBySource && (i != (int) (p % nbWorkers))) {
+                    continue;
+                }
+
+                UDPSocket *socket = new UDPSocket();
+                m_workers[i]->m_sockets.push_back(socket);
+                m_workers[i]->m_ports.push_back(m_ports[p]);
+
+                if (m_demuxBySource) {
+                    socket->SetReusePort(true);
+                }
+
+                socket->BindLocalAddressAndPort(m_address, m_ports[p]);
+                socket->SetReadBufferSize(MULTISTREAMRECEIVER_RCVBUF);
+            }
+        }
+    }
+    catch (CSocketException& e)
+    {
+        m_error = std::string("MultiStreamReceiver::start: ") + e.what();
+        stop();
+        return false;
+    }
+
+    m_running.store(true);
+
+    for (std::vector<Worker*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it) {
+        (*it)->m_thread = new std::thread(run, *it);
+    }
+
+    std::cerr << "MultiStreamReceiver::start: " << m_ports.size() << " ports by "
+            << (m_demuxBySource ? "source" : "port") << " on " << nbWorkers << " workers" << std::endl;
+    return true;
+}
+
+void MultiStreamReceiver::stop()
+{
+    m_running.store(false);
+
+    for (std::vector<Worker*>::iterator it = m_workers.begin(); it != m_workers.end(); ++it)
+    {
+        if ((*it)->m_thread)
+        {
+            (*it)->m_thread->join();
+            delete (*it)->m_thread;
+        }
+
+        for (std::vector<UDPSocket*>::iterator sit = (*it)->m_sockets.begin(); sit != (*it)->m_sockets.end(); ++sit) {
+            delete *sit;
+        }
+
+        delete *it;
+    }
+
+    m_workers.clear();
+}
+
+int MultiStreamReceiver::getNbStreams()
+{
+    std::unique_lock<std::mutex> lock(m_streamsMutex);
+    return m_streams.size();
+}
+
+bool MultiStreamReceiver::getStreamId(int streamIndex, StreamId& streamId)
+{
+    std::unique_lock<std::mutex> lock(m_streamsMutex);
+
+    if ((streamIndex < 0) || (streamIndex >= (int) m_streams.size())) {
+        return false;
+    }
+
+    streamId = m_streams[streamIndex]->m_id;
+    return true;
+}
+
+uint64_t MultiStreamReceiver::getNbFrames(int streamIndex)
+{
+    std::unique_lock<std::mutex> lock(m_streamsMutex);
+
+    if ((streamIndex < 0) || (streamIndex >= (int) m_streams.size())) {
+        return 0;
+    }
+
+    return m_streams[streamIndex]->m_nbFrames.load();
+}
+
+/** Find the stream of a block in the worker's streams or create it. Returns 0 if there are too many streams */
+MultiStreamReceiver::Stream *MultiStreamReceiver::getStream(Worker *worker, unsigned short port, const sockaddr_in& source)
+{
+    uint64_t key = port;
+
+    if (m_demuxBySource) {
+        key |= (((uint64_t) source.sin_addr.s_addr) << 32) | (((uint64_t) source.sin_port) << 16);
+    }
+
+    std::map<uint64_t, Stream*>::iterator it = worker->m_streams.find(key);
+
+    if (it != worker->m_streams.end()) {
+        return it->second;
+    }
+
+    std::unique_lock<std::mutex> lock(m_streamsMutex);
+    std::map<uint64_t, Stream*>::iterator kit = m_streamKeys.find(key);
+
+    if (kit != m_streamKeys.end()) // received before the receiver was stopped: the workers are new
+    {
+        worker->m_streams[key] = kit->second;
+        return kit->second;
+    }
+
+    if (m_streams.size() >= MULTISTREAMRECEIVER_NBSTREAMSMAX)
+    {
+        worker->m_streams[key] = 0; // ignored from now on
+        std::cerr << "MultiStreamReceiver::getStream: too many streams: stream ignored" << std::endl;
+        return 0;
+    }
+
+    Stream *stream = new Stream();
+    stream->m_id.m_port = port;
+
+    if (m_demuxBySource) {
+        stream->m_id.m_source = source;
+    } else {
+        memset(&stream->m_id.m_source, 0, sizeof(sockaddr_in));
+    }
+
+    stream->m_index = m_streams.size();
+    stream->m_buffer.setReorderWindow(m_reorderWindow);
+    stream->m_nbFrames.store(0);
+    m_streams.push_back(stream);
+    m_streamKeys[key] = stream;
+    worker->m_streams[key] = stream;
+    return stream;
+}
+
+void MultiStreamReceiver::receiveBatch(Worker *worker, int socketIndex)
+{
+    unsigned short port = worker->m_ports[socketIndex];
+    int nbRead = worker->m_sockets[socketIndex]->RecvDataGrams((void *) &worker->m_rxBlocks[0], SDRDAEMONFEC_UDPSIZEMAX,
+            MULTISTREAMRECEIVER_RXBATCH, &worker->m_rxLengths[0], &worker->m_rxAddrs[0]);
+    Stream *stream = 0;
+    uint64_t lastSource = 0;
+
+    for (int i = 0; i < nbRead; i++)
+    {
+        if (worker->m_rxLengths[i] <= 0) {
+            continue;
+        }
+
+        // consecutive blocks of a batch usually come from the same source
+        uint64_t source = (((uint64_t) worker->m_rxAddrs[i].sin_addr.s_addr) << 16) | worker->m_rxAddrs[i].sin_port;
+
+        if ((i == 0) || (source != lastSource))
+        {
+            stream = getStream(worker, port, worker->m_rxAddrs[i]);
+            lastSource = source;
+        }
+
+        if (!stream) {
+            continue;
+        }
+
+        if (stream->m_buffer.write(&worker->m_rxBlocks[i * SDRDAEMONFEC_UDPSIZEMAX], worker->m_rxLengths[i]))
+        {
+            std::size_t dataLength;
+            const uint8_t *frameData = stream->m_buffer.getFrameData(dataLength);
+
+            if (dataLength > 0)
+            {
+                stream->m_nbFrames++;
+                m_frameHandler.frame(stream->m_index, stream->m_id, stream->m_buffer, frameData, dataLength);
+            }
+        }
+    }
+}
+
+void MultiStreamReceiver::run(Worker *worker)
+{
+    MultiStreamReceiver *receiver = worker->m_receiver;
+    std::vector<pollfd> fds(worker->m_sockets.size());
+
+    for (unsigned int i = 0; i < fds.size(); i++)
+    {
+        fds[i].fd = worker->m_sockets[i]->GetSocketDescriptor();
+        fds[i].events = POLLIN;
+    }
+
+    while (receiver->m_running.load())
+    {
+        int nbReady = poll(&fds[0], fds.size(), MULTISTREAMRECEIVER_RXTIMEOUT);
+
+        if (nbReady <= 0) {
+            continue; // timeout or interrupted
+        }
+
+        for (unsigned int i = 0; i < fds.size(); i++)
+        {
+            if (fds[i].revents & POLLIN)
+            {
+                try
+                {
+                    receiver->receiveBatch(worker, i);
+                }
+                catch (CSocketException& e)
+                {
+                    std::cerr << "MultiStreamReceiver::run: " << e.what() << std::endl;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,272 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "NCO.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+NCO::NCO() :
+    m_offset(0),
+    m_sampleRate(0),
+    m_phase(0),
+    m_step(0)
+{
+}
+
+const int16_t *NCO::table()
+{
+    static std::vector<int16_t> t;
+
+    if (t.empty()) // first NCO is created before any thread runs
+    {
+        unsigned int size = 1U << NCO_TABLE_BITS;
+        t.resize(2*size);
+
+        for (unsigned int i = 0; i < size; i++)
+        {
+            double phi = (2.0 * M_PI * i) / size;
+            // Q15 scaled to 32767 so that the negated values fit
+            t[2*i]   = (int16_t) lrint(32767.0 * cos(phi));
+            t[2*i+1] = (int16_t) lrint(32767.0 * sin(phi));
+        }
+    }
+
+    return &t[0];
+}
+
+void NCO::setFrequency(int64_t offset, uint32_t sampleRate)
+{
+    if ((offset == m_offset) && (sampleRate == m_sampleRate)) {
+        return;
+    }
+
+    m_offset = offset;
+    m_sampleRate = sampleRate;
+
+    if ((offset == 0) || (sampleRate == 0))
+    {
+        m_step = 0;
+        return;
+    }
+
+    table();
+    // rotation by exp(-j*phase): the phase advances by the offset, the table gives the conjugate
+    m_step = (uint32_t) llrint((double) offset * 4294967296.0 / sampleRate);
+}
+
+void NCO::lookup(unsigned int n)
+{
+    const int16_t *t = table();
+    uint32_t phase = m_phase;
+
+    for (unsigned int i = 0; i < n; i++, phase += m_step)
+    {
+        unsigned int k = ((phase + (1U << (31 - NCO_TABLE_BITS))) >> (32 - NCO_TABLE_BITS)) * 2; // nearest phase
+        int16_t c = t[k];
+        int16_t s = t[k+1];
+        // (x + jy)(c - js) = (xc + ys) + j(yc - xs)
+        m_re[2*i]   = c;
+        m_re[2*i+1] = s;
+        m_im[2*i]   = -s;
+        m_im[2*i+1] = c;
+    }
+
+    m_phase = phase;
+}
+
+void NCO::mix(const IQSample *in, int32_t *out, unsigned int n, unsigned int gain)
+{
+    for (unsigned int done = 0; done < n; done += NCO_BLOCK_SIZE)
+    {
+        unsigned int len = (n - done < NCO_BLOCK_SIZE ? n - done : NCO_BLOCK_SIZE);
+        lookup(len);
+        mixBlock(&in[done], &out[2*done], len, gain);
+    }
+}
+
+void NCO::mix(IQSample *inout, unsigned int n)
+{
+    for (unsigned int done = 0; done < n; done += NCO_BLOCK_SIZE)
+    {
+        unsigned int len = (n - done < NCO_BLOCK_SIZE ? n - done : NCO_BLOCK_SIZE);
+        lookup(len);
+        mixBlock(&inout[done], m_buf, len, 0);
+        int16_t *x = (int16_t *) &inout[done];
+        unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+        for (; i + 8 <= 2*len; i += 8) {
+            _mm_storeu_si128((__m128i*) &x[i], _mm_packs_epi32(_mm_loadu_si128((const __m128i*) &m_buf[i]), _mm_loadu_si128((const __m128i*) &m_buf[i+4])));
+        }
+#elif defined(USE_NEON)
+        for (; i + 8 <= 2*len; i += 8) {
+            vst1q_s16(&x[i], vcombine_s16(vqmovn_s32(vld1q_s32(&m_buf[i])), vqmovn_s32(vld1q_s32(&m_buf[i+4]))));
+        }
+#endif
+        for (; i < 2*len; i++) {
+            x[i] = m_buf[i] > 32767 ? 32767 : m_buf[i] < -32768 ? -32768 : m_buf[i];
+        }
+    }
+}
+
+void NCO::mixPlanar(const IQSample *in, int32_t *i, int32_t *q, unsigned int n, unsigned int gain)
+{
+    for (unsigned int done = 0; done < n; done += NCO_BLOCK_SIZE)
+    {
+        unsigned int len = (n - done < NCO_BLOCK_SIZE ? n - done : NCO_BLOCK_SIZE);
+        lookup(len);
+        mixBlockPlanar(&in[done], &i[done], &q[done], len, gain);
+    }
+}
+
+void NCO::mixBlock(const IQSample *in, int32_t *out, unsigned int n, unsigned int gain)
+{
+    const int16_t *x = (const int16_t *) in;
+    unsigned int shift = 15 - gain;
+    int32_t round = 1 << (shift - 1);
+    unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH)
+    if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+        i = mixBlockAVX2(in, out, n, gain);
+    }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+    const __m128i r = _mm_set1_epi32(round);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v  = _mm_loadu_si128((const __m128i*) &x[2*i]);
+        __m128i re = _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(v, _mm_loadu_si128((const __m128i*) &m_re[2*i])), r), count);
+        __m128i im = _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(v, _mm_loadu_si128((const __m128i*) &m_im[2*i])), r), count);
+        _mm_storeu_si128((__m128i*) &out[2*i],   _mm_unpacklo_epi32(re, im));
+        _mm_storeu_si128((__m128i*) &out[2*i+4], _mm_unpackhi_epi32(re, im));
+    }
+#elif defined(USE_NEON)
+    const int32x4_t s = vdupq_n_s32(-(int32_t) shift); // rounding shift right
+
+    for (; i + 4 <= n; i += 4)
+    {
+        int16x4x2_t v  = vld2_s16(&x[2*i]);
+        int16x4x2_t cr = vld2_s16(&m_re[2*i]);
+        int16x4x2_t ci = vld2_s16(&m_im[2*i]);
+        int32x4x2_t o;
+        o.val[0] = vrshlq_s32(vmlal_s16(vmull_s16(v.val[0], cr.val[0]), v.val[1], cr.val[1]), s);
+        o.val[1] = vrshlq_s32(vmlal_s16(vmull_s16(v.val[0], ci.val[0]), v.val[1], ci.val[1]), s);
+        vst2q_s32(&out[2*i], o);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        out[2*i]   = (x[2*i] * m_re[2*i] + x[2*i+1] * m_re[2*i+1] + round) >> shift;
+        out[2*i+1] = (x[2*i] * m_im[2*i] + x[2*i+1] * m_im[2*i+1] + round) >> shift;
+    }
+}
+
+/** Same as mixBlock without the final interleaving: the real and imaginary vectors are stored as they are */
+void NCO::mixBlockPlanar(const IQSample *in, int32_t *outI, int32_t *outQ, unsigned int n, unsigned int gain)
+{
+    const int16_t *x = (const int16_t *) in;
+    unsigned int shift = 15 - gain;
+    int32_t round = 1 << (shift - 1);
+    unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH)
+    if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+        i = mixBlockPlanarAVX2(in, outI, outQ, n, gain);
+    }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+    const __m128i r = _mm_set1_epi32(round);
+    const __m128i count = _mm_cvtsi32_si128(shift);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) &x[2*i]);
+        _mm_storeu_si128((__m128i*) &outI[i], _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(v, _mm_loadu_si128((const __m128i*) &m_re[2*i])), r), count));
+        _mm_storeu_si128((__m128i*) &outQ[i], _mm_sra_epi32(_mm_add_epi32(_mm_madd_epi16(v, _mm_loadu_si128((const __m128i*) &m_im[2*i])), r), count));
+    }
+#elif defined(USE_NEON)
+    const int32x4_t s = vdupq_n_s32(-(int32_t) shift); // rounding shift right
+
+    for (; i + 4 <= n; i += 4)
+    {
+        int16x4x2_t v  = vld2_s16(&x[2*i]);
+        int16x4x2_t cr = vld2_s16(&m_re[2*i]);
+        int16x4x2_t ci = vld2_s16(&m_im[2*i]);
+        vst1q_s32(&outI[i], vrshlq_s32(vmlal_s16(vmull_s16(v.val[0], cr.val[0]), v.val[1], cr.val[1]), s));
+        vst1q_s32(&outQ[i], vrshlq_s32(vmlal_s16(vmull_s16(v.val[0], ci.val[0]), v.val[1], ci.val[1]), s));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        outI[i] = (x[2*i] * m_re[2*i] + x[2*i+1] * m_re[2*i+1] + round) >> shift;
+        outQ[i] = (x[2*i] * m_im[2*i] + x[2*i+1] * m_im[2*i+1] + round) >> shift;
+    }
+}
+
+#if defined(SIMD_X86_DISPATCH)
+SIMD_TARGET("avx2")
+unsigned int NCO::mixBlockAVX2(const IQSample *in, int32_t *out, unsigned int n, unsigned int gain)
+{
+    const int16_t *x = (const int16_t *) in;
+    unsigned int shift = 15 - gain;
+    const __m256i r = _mm256_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    unsigned int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v  = _mm256_loadu_si256((const __m256i*) &x[2*i]);
+        __m256i re = _mm256_sra_epi32(_mm256_add_epi32(_mm256_madd_epi16(v, _mm256_loadu_si256((const __m256i*) &m_re[2*i])), r), count);
+        __m256i im = _mm256_sra_epi32(_mm256_add_epi32(_mm256_madd_epi16(v, _mm256_loadu_si256((const __m256i*) &m_im[2*i])), r), count);
+        // unpack works per 128 bit lane: samples 0,1,4,5 and 2,3,6,7
+        __m256i lo = _mm256_unpacklo_epi32(re, im);
+        __m256i hi = _mm256_unpackhi_epi32(re, im);
+        _mm256_storeu_si256((__m256i*) &out[2*i],   _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i*) &out[2*i+8], _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    return i;
+}
+
+SIMD_TARGET("avx2")
+unsigned int NCO::mixBlockPlanarAVX2(const IQSample *in, int32_t *outI, int32_t *outQ, unsigned int n, unsigned int gain)
+{
+    const int16_t *x = (const int16_t *) in;
+    unsigned int shift = 15 - gain;
+    const __m256i r = _mm256_set1_epi32(1 << (shift - 1));
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    unsigned int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*) &x[2*i]);
+        _mm256_storeu_si256((__m256i*) &outI[i], _mm256_sra_epi32(_mm256_add_epi32(_mm256_madd_epi16(v, _mm256_loadu_si256((const __m256i*) &m_re[2*i])), r), count));
+        _mm256_storeu_si256((__m256i*) &outQ[i], _mm256_sra_epi32(_mm256_add_epi32(_mm256_madd_epi16(v, _mm256_loadu_si256((const __m256i*) &m_im[2*i])), r), count));
+    }
+
+    return i;
+}
+#endif
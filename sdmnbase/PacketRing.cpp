@@ -0,0 +1,279 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <cerrno>
+#include <cstring>
+
+#include "PacketRing.h"
+
+PacketRing::PacketRing() :
+    m_fd(-1),
+    m_ring(0),
+    m_blockIndex(0),
+    m_nbPackets(-1),
+    m_packet(0)
+{
+}
+
+PacketRing::~PacketRing()
+{
+    close();
+}
+
+bool PacketRing::open(const std::string& interface, unsigned short port)
+{
+    close();
+
+    unsigned int ifindex = if_nametoindex(interface.c_str());
+
+    if (ifindex == 0)
+    {
+        m_error = "PacketRing::open: unknown interface " + interface;
+        return false;
+    }
+
+    // cooked (SOCK_DGRAM) socket: packets start at the IP header whatever the link layer
+    m_fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_IP));
+
+    if (m_fd < 0)
+    {
+        m_error = std::string("PacketRing::open: cannot open packet socket: ") + strerror(errno);
+        return false;
+    }
+
+    // UDP to port, not a fragment. Offsets are from the IP header
+    struct sock_filter filter[] = {
+        { BPF_LD  | BPF_B   | BPF_ABS, 0, 0, 9 },           // IP protocol
+        { BPF_JMP | BPF_JEQ | BPF_K,   0, 6, IPPROTO_UDP },
+        { BPF_LD  | BPF_H   | BPF_ABS, 0, 0, 6 },           // flags and fragment offset
+        { BPF_JMP | BPF_JSET| BPF_K,   4, 0, 0x3fff },      // more fragments or offset: drop
+        { BPF_LDX | BPF_B   | BPF_MSH, 0, 0, 0 },           // X = IP header length
+        { BPF_LD  | BPF_H   | BPF_IND, 0, 0, 2 },           // UDP destination port
+        { BPF_JMP | BPF_JEQ | BPF_K,   0, 1, port },
+        { BPF_RET | BPF_K,             0, 0, 0x40000 },     // accept whole packet
+        { BPF_RET | BPF_K,             0, 0, 0 }            // drop
+    };
+    struct sock_fprog fprog;
+    fprog.len = sizeof(filter) / sizeof(filter[0]);
+    fprog.filter = filter;
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = PACKETRING_BLOCKSIZE;
+    req.tp_block_nr = PACKETRING_NBBLOCKS;
+    req.tp_frame_size = 2048; // only used to check the layout, V3 packs packets of any size in blocks
+    req.tp_frame_nr = (PACKETRING_BLOCKSIZE / 2048) * PACKETRING_NBBLOCKS;
+    req.tp_retire_blk_tov = PACKETRING_RETIRETIME;
+
+    if (setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0)
+    {
+        m_error = std::string("PacketRing::open: cannot attach filter: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+    if (setsockopt(m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+    {
+        m_error = std::string("PacketRing::open: TPACKET_V3 not supported: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+    if (setsockopt(m_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+    {
+        m_error = std::string("PacketRing::open: cannot create ring: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+    m_ring = (uint8_t *) mmap(0, PACKETRING_BLOCKSIZE * PACKETRING_NBBLOCKS, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+
+    if (m_ring == MAP_FAILED)
+    {
+        m_ring = 0;
+        m_error = std::string("PacketRing::open: cannot map ring: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex = ifindex;
+
+    if (bind(m_fd, (struct sockaddr *) &sll, sizeof(sll)) < 0)
+    {
+        m_error = std::string("PacketRing::open: cannot bind to ") + interface + ": " + strerror(errno);
+        close();
+        return false;
+    }
+
+    m_blockIndex = 0;
+    m_nbPackets = -1;
+    m_error.clear();
+    return true;
+}
+
+void PacketRing::close()
+{
+    if (m_ring)
+    {
+        munmap(m_ring, PACKETRING_BLOCKSIZE * PACKETRING_NBBLOCKS);
+        m_ring = 0;
+    }
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    m_nbPackets = -1;
+}
+
+bool PacketRing::nextBlock(int timeoutMs)
+{
+    struct tpacket_block_desc *block = (struct tpacket_block_desc *) (m_ring + m_blockIndex * PACKETRING_BLOCKSIZE);
+
+    if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+    {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN | POLLERR;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, timeoutMs) <= 0) {
+            return false; // timeout or signal
+        }
+
+        if ((__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            return false;
+        }
+    }
+
+    m_nbPackets = block->hdr.bh1.num_pkts;
+    m_packet = (uint8_t *) block + block->hdr.bh1.offset_to_first_pkt;
+    return true;
+}
+
+void PacketRing::releaseBlock()
+{
+    struct tpacket_block_desc *block = (struct tpacket_block_desc *) (m_ring + m_blockIndex * PACKETRING_BLOCKSIZE);
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    m_blockIndex = (m_blockIndex + 1) % PACKETRING_NBBLOCKS;
+    m_nbPackets = -1;
+}
+
+int PacketRing::receive(uint8_t **payloads, int *lengths, int count, int timeoutMs, sockaddr_in *sourceAddrs, timespec *timestamps)
+{
+    if (m_fd < 0) {
+        return 0;
+    }
+
+    int n = 0;
+
+    while (n == 0) // a block may only hold packets that are skipped
+    {
+        if (m_nbPackets == 0) { // all the packets of the block were returned by the previous call
+            releaseBlock();
+        }
+
+        if ((m_nbPackets < 0) && !nextBlock(timeoutMs)) {
+            return 0;
+        }
+
+        n = collect(payloads, lengths, count, sourceAddrs, timestamps);
+    }
+
+    return n;
+}
+
+int PacketRing::collect(uint8_t **payloads, int *lengths, int count, sockaddr_in *sourceAddrs, timespec *timestamps)
+{
+    int n = 0;
+
+    while ((m_nbPackets > 0) && (n < count))
+    {
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) m_packet;
+        struct sockaddr_ll *sll = (struct sockaddr_ll *) (m_packet + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        uint8_t *ip = m_packet + hdr->tp_net;
+        m_packet += hdr->tp_next_offset;
+        m_nbPackets--;
+
+        if (sll->sll_pkttype == PACKET_OUTGOING) { // sent by this host on loopback
+            continue;
+        }
+
+        unsigned int ipHeaderLength = (ip[0] & 0x0f) * 4;
+        uint8_t *udp = ip + ipHeaderLength;
+
+        if (hdr->tp_snaplen < ipHeaderLength + 8) {
+            continue;
+        }
+
+        unsigned int udpLength = (udp[4] << 8) | udp[5];
+
+        if ((udpLength < 8) || (ipHeaderLength + udpLength > hdr->tp_snaplen)) { // truncated
+            continue;
+        }
+
+        payloads[n] = udp + 8;
+        lengths[n] = udpLength - 8;
+
+        if (sourceAddrs)
+        {
+            memset(&sourceAddrs[n], 0, sizeof(sockaddr_in));
+            sourceAddrs[n].sin_family = AF_INET;
+            memcpy(&sourceAddrs[n].sin_addr, ip + 12, 4);
+            memcpy(&sourceAddrs[n].sin_port, udp, 2);
+        }
+
+        if (timestamps)
+        {
+            timestamps[n].tv_sec = hdr->tp_sec;
+            timestamps[n].tv_nsec = hdr->tp_nsec;
+        }
+
+        n++;
+    }
+
+    return n;
+}
+
+unsigned int PacketRing::getNbDrops()
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t len = sizeof(stats);
+
+    if ((m_fd < 0) || (getsockopt(m_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) < 0)) {
+        return 0;
+    }
+
+    return stats.tp_drops; // the kernel resets the statistics on each read
+}
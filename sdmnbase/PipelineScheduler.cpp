@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+
+#include "PipelineScheduler.h"
+#include "RxPipeline.h"
+
+PipelineScheduler::PipelineScheduler(const std::vector<RxPipeline*>& pipelines, const std::atomic_bool *stopFlag) :
+    m_pipelines(pipelines),
+    m_stopFlag(stopFlag),
+    m_generation(0),
+    m_nbFinished(0)
+{
+}
+
+void PipelineScheduler::notify()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_generation++;
+    }
+
+    m_cond.notify_one();
+}
+
+void PipelineScheduler::run(unsigned int first)
+{
+    std::size_t next = first;
+
+    while (!m_stopFlag->load() && (m_nbFinished.load() < m_pipelines.size()))
+    {
+        uint64_t generation;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            generation = m_generation;
+        }
+
+        bool processed = false;
+
+        for (std::size_t i = 0; i < m_pipelines.size(); i++)
+        {
+            RxPipeline *pipeline = m_pipelines[(next + i) % m_pipelines.size()];
+
+            if (!pipeline->claim()) {
+                continue;
+            }
+
+            if (pipeline->ready())
+            {
+                if (!pipeline->processBlock())
+                {
+                    pipeline->finish();
+                    m_nbFinished++;
+                    notifyAll();
+                }
+
+                processed = true;
+            }
+
+            pipeline->release();
+        }
+
+        next++; // every device is served first in turn
+
+        if (!processed)
+        {
+            // woken up after each push, the timeout only catches the stop
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_for(lock, std::chrono::milliseconds(100), [this, generation]() { return m_generation != generation; });
+        }
+    }
+}
+
+void PipelineScheduler::notifyAll()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_generation++;
+    }
+
+    m_cond.notify_all();
+}
@@ -0,0 +1,311 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cmath>
+#include <cstring>
+
+#include "RationalResampler.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+    while (b)
+    {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/** Zeroth order modified Bessel function of the first kind for the Kaiser window */
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2*k)) * (x / (2*k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+static inline int16_t roundQ14(int32_t acc)
+{
+    acc = (acc + (1<<13)) >> 14;
+    return acc > 32767 ? 32767 : acc < -32768 ? -32768 : acc;
+}
+
+RationalResampler::RationalResampler() :
+    m_inRate(0),
+    m_outRate(0),
+    m_L(1),
+    m_M(1),
+    m_taps(RATIONALRESAMPLER_TAPS),
+    m_phase(0),
+    m_index(0)
+{
+}
+
+bool RationalResampler::setRates(uint32_t inRate, uint32_t outRate)
+{
+    if ((inRate == m_inRate) && (outRate == m_outRate)) {
+        return true;
+    }
+
+    if ((inRate == 0) || (outRate == 0))
+    {
+        m_inRate = inRate;
+        m_outRate = outRate;
+        m_L = m_M = 1;
+        return true;
+    }
+
+    unsigned int g = gcd(inRate, outRate);
+
+    if (outRate / g > RATIONALRESAMPLER_MAXPHASES) {
+        return false;
+    }
+
+    m_inRate = inRate;
+    m_outRate = outRate;
+    m_L = outRate / g;
+    m_M = inRate / g;
+
+    // the filter must span as many output periods when decimating more than by 2
+    m_taps = RATIONALRESAMPLER_TAPS * (m_M > 2*m_L ? (m_M + 2*m_L - 1) / (2*m_L) : 1);
+    design();
+
+    m_phase = 0;
+    m_index = 0;
+    m_i.assign(m_taps - 1, 0);
+    m_q.assign(m_taps - 1, 0);
+
+    return true;
+}
+
+void RationalResampler::design()
+{
+    unsigned int n = m_L * m_taps;
+    double fc = 0.45 / (m_L > m_M ? m_L : m_M); // -6 dB at 90% of the lower Nyquist frequency, relative to L * input rate
+    double beta = 7.0;                           // about 70 dB stop band
+    double center = (n - 1) / 2.0;
+    std::vector<double> h(n);
+
+    for (unsigned int k = 0; k < n; k++)
+    {
+        double t = k - center;
+        double x = 2.0 * fc * t;
+        double sinc = (t == 0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+        double r = t / (center + 0.5);
+        h[k] = 2.0 * fc * sinc * besselI0(beta * std::sqrt(1.0 - r*r)) / besselI0(beta);
+    }
+
+    m_coeffs.resize(n);
+
+    for (unsigned int p = 0; p < m_L; p++)
+    {
+        double sum = 0.0;
+
+        for (unsigned int j = 0; j < m_taps; j++) {
+            sum += h[p + j*m_L];
+        }
+
+        // time reversed so that the dot product runs forward over the history
+        for (unsigned int j = 0; j < m_taps; j++) {
+            m_coeffs[p*m_taps + m_taps-1-j] = (int16_t) std::lrint(h[p + j*m_L] * 16384.0 / sum);
+        }
+    }
+}
+
+void RationalResampler::process(const IQSampleVector& in, IQSampleVector& out)
+{
+    unsigned int n = in.size();
+    unsigned int hist = m_taps - 1;
+
+    m_i.resize(hist + n);
+    m_q.resize(hist + n);
+    const int16_t *x = (const int16_t *) in.data();
+
+    for (unsigned int k = 0; k < n; k++)
+    {
+        m_i[hist + k] = x[2*k];
+        m_q[hist + k] = x[2*k+1];
+    }
+
+    out.resize(((uint64_t) n * m_L) / m_M + 2);
+    unsigned int nbOut;
+
+#if defined(SIMD_X86_DISPATCH)
+    if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+        nbOut = processAVX2(out.data(), n);
+    } else {
+        nbOut = processSSE2(out.data(), n);
+    }
+#elif defined(USE_NEON)
+    nbOut = processNEON(out.data(), n);
+#else
+    nbOut = processScalar(out.data(), n);
+#endif
+
+    out.resize(nbOut);
+    std::memmove(m_i.data(), &m_i[n], hist * sizeof(int16_t));
+    std::memmove(m_q.data(), &m_q[n], hist * sizeof(int16_t));
+}
+
+unsigned int RationalResampler::processScalar(IQSample *out, unsigned int n)
+{
+    unsigned int k = 0;
+
+    for (; m_index < n; k++)
+    {
+        const int16_t *c = &m_coeffs[m_phase * m_taps];
+        const int16_t *xi = &m_i[m_index];
+        const int16_t *xq = &m_q[m_index];
+        int32_t ai = 0, aq = 0;
+
+        for (unsigned int j = 0; j < m_taps; j++)
+        {
+            ai += c[j] * xi[j];
+            aq += c[j] * xq[j];
+        }
+
+        out[k] = IQSample(roundQ14(ai), roundQ14(aq));
+        m_phase += m_M;
+        m_index += m_phase / m_L;
+        m_phase %= m_L;
+    }
+
+    m_index -= n;
+    return k;
+}
+
+#if defined(SIMD_X86_DISPATCH)
+unsigned int RationalResampler::processSSE2(IQSample *out, unsigned int n)
+{
+    unsigned int k = 0;
+
+    for (; m_index < n; k++)
+    {
+        const int16_t *c = &m_coeffs[m_phase * m_taps];
+        const int16_t *xi = &m_i[m_index];
+        const int16_t *xq = &m_q[m_index];
+        __m128i ai = _mm_setzero_si128();
+        __m128i aq = _mm_setzero_si128();
+
+        for (unsigned int j = 0; j < m_taps; j += 8)
+        {
+            __m128i cv = _mm_loadu_si128((const __m128i*) &c[j]);
+            ai = _mm_add_epi32(ai, _mm_madd_epi16(cv, _mm_loadu_si128((const __m128i*) &xi[j])));
+            aq = _mm_add_epi32(aq, _mm_madd_epi16(cv, _mm_loadu_si128((const __m128i*) &xq[j])));
+        }
+
+        // horizontal sums of I in lane 0 and Q in lane 1
+        __m128i s = _mm_add_epi32(_mm_unpacklo_epi32(ai, aq), _mm_unpackhi_epi32(ai, aq));
+        s = _mm_add_epi32(s, _mm_unpackhi_epi64(s, s));
+        out[k] = IQSample(roundQ14(_mm_cvtsi128_si32(s)), roundQ14(_mm_cvtsi128_si32(_mm_srli_si128(s, 4))));
+
+        m_phase += m_M;
+        m_index += m_phase / m_L;
+        m_phase %= m_L;
+    }
+
+    m_index -= n;
+    return k;
+}
+
+SIMD_TARGET("avx2")
+unsigned int RationalResampler::processAVX2(IQSample *out, unsigned int n)
+{
+    unsigned int k = 0;
+
+    for (; m_index < n; k++)
+    {
+        const int16_t *c = &m_coeffs[m_phase * m_taps];
+        const int16_t *xi = &m_i[m_index];
+        const int16_t *xq = &m_q[m_index];
+        __m256i ai = _mm256_setzero_si256();
+        __m256i aq = _mm256_setzero_si256();
+
+        for (unsigned int j = 0; j < m_taps; j += 16)
+        {
+            __m256i cv = _mm256_loadu_si256((const __m256i*) &c[j]);
+            ai = _mm256_add_epi32(ai, _mm256_madd_epi16(cv, _mm256_loadu_si256((const __m256i*) &xi[j])));
+            aq = _mm256_add_epi32(aq, _mm256_madd_epi16(cv, _mm256_loadu_si256((const __m256i*) &xq[j])));
+        }
+
+        __m128i si = _mm_add_epi32(_mm256_castsi256_si128(ai), _mm256_extracti128_si256(ai, 1));
+        __m128i sq = _mm_add_epi32(_mm256_castsi256_si128(aq), _mm256_extracti128_si256(aq, 1));
+        __m128i s = _mm_add_epi32(_mm_unpacklo_epi32(si, sq), _mm_unpackhi_epi32(si, sq));
+        s = _mm_add_epi32(s, _mm_unpackhi_epi64(s, s));
+        out[k] = IQSample(roundQ14(_mm_cvtsi128_si32(s)), roundQ14(_mm_cvtsi128_si32(_mm_srli_si128(s, 4))));
+
+        m_phase += m_M;
+        m_index += m_phase / m_L;
+        m_phase %= m_L;
+    }
+
+    m_index -= n;
+    return k;
+}
+#elif defined(USE_NEON)
+unsigned int RationalResampler::processNEON(IQSample *out, unsigned int n)
+{
+    unsigned int k = 0;
+
+    for (; m_index < n; k++)
+    {
+        const int16_t *c = &m_coeffs[m_phase * m_taps];
+        const int16_t *xi = &m_i[m_index];
+        const int16_t *xq = &m_q[m_index];
+        int32x4_t ai = vdupq_n_s32(0);
+        int32x4_t aq = vdupq_n_s32(0);
+
+        for (unsigned int j = 0; j < m_taps; j += 8)
+        {
+            int16x8_t cv = vld1q_s16(&c[j]);
+            int16x8_t vi = vld1q_s16(&xi[j]);
+            int16x8_t vq = vld1q_s16(&xq[j]);
+            ai = vmlal_s16(ai, vget_low_s16(cv), vget_low_s16(vi));
+            ai = vmlal_s16(ai, vget_high_s16(cv), vget_high_s16(vi));
+            aq = vmlal_s16(aq, vget_low_s16(cv), vget_low_s16(vq));
+            aq = vmlal_s16(aq, vget_high_s16(cv), vget_high_s16(vq));
+        }
+
+        int32x2_t si = vadd_s32(vget_low_s32(ai), vget_high_s32(ai));
+        int32x2_t sq = vadd_s32(vget_low_s32(aq), vget_high_s32(aq));
+        out[k] = IQSample(roundQ14(vget_lane_s32(vpadd_s32(si, si), 0)), roundQ14(vget_lane_s32(vpadd_s32(sq, sq), 0)));
+
+        m_phase += m_M;
+        m_index += m_phase / m_L;
+        m_phase %= m_L;
+    }
+
+    m_index -= n;
+    return k;
+}
+#endif
@@ -0,0 +1,212 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+
+#include "RealDDC.h"
+#include "HBFilterTraits.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    /** Taps of the I filter from the innermost: twice the odd taps of the half band filter (gain 2 of the decimation) */
+    inline void qTaps(int16_t *taps)
+    {
+        for (int k = 0; k < 8; k++) {
+            taps[k] = (int16_t) (2 * HBFIRFilterTraits<32>::hbCoeffs[7-k]);
+        }
+    }
+}
+
+RealDDC::RealDDC() :
+    m_even(REALDDC_HISTORY, 0),
+    m_odd(REALDDC_DELAY, 0),
+    m_phase(0),
+    m_dc(0),
+    m_primed(false)
+{
+}
+
+void RealDDC::reset()
+{
+    m_even.assign(REALDDC_HISTORY, 0);
+    m_odd.assign(REALDDC_DELAY, 0);
+    m_phase = 0;
+    m_dc = 0;
+    m_primed = false;
+}
+
+void RealDDC::process(IQSampleVector& samples)
+{
+    unsigned int n = samples.size();
+
+    if (n == 0) {
+        return;
+    }
+
+    m_even.resize(REALDDC_HISTORY + n);
+    m_odd.resize(REALDDC_DELAY + n);
+    m_i.resize(n);
+
+    // the first block gives the DC estimate, then it follows the block means
+    const int16_t *x = (const int16_t *) samples.data();
+    int64_t sum = 0;
+
+    for (unsigned int i = 0; i < 2*n; i++) {
+        sum += x[i];
+    }
+
+    int32_t mean = (int32_t) ((sum << 8) / (int64_t) (2*n));
+
+    if (!m_primed)
+    {
+        m_dc = mean;
+        m_primed = true;
+    }
+
+    int16_t dc = (int16_t) ((m_dc + 128) >> 8);
+    int16_t *even = &m_even[REALDDC_HISTORY];
+    int16_t *odd = &m_odd[REALDDC_DELAY];
+
+    // -fs/4 shift: pairs alternately negated starting with the parity of the stream
+    for (unsigned int j = 0; j < n; j++)
+    {
+        int16_t s = ((m_phase + j) & 1) ? 1 : -1;
+        even[j] = s * (x[2*j] - dc);
+        odd[j] = s * (x[2*j+1] - dc);
+    }
+
+    m_dc += (mean - m_dc) >> REALDDC_DCSHIFT;
+    m_phase = (m_phase + n) & 1;
+
+    filter(m_even.data(), m_i.data(), n);
+
+    for (unsigned int j = 0; j < n; j++) {
+        samples[j] = IQSample(m_i[j], m_odd[j]); // Q delayed to the center of the I filter
+    }
+
+    memmove(m_even.data(), &m_even[n], REALDDC_HISTORY * sizeof(int16_t));
+    memmove(m_odd.data(), &m_odd[n], REALDDC_DELAY * sizeof(int16_t));
+}
+
+void RealDDC::filter(const int16_t *even, int16_t *i, unsigned int n)
+{
+    // Q[j] = sum of c[k] * (even[j+7-k] + even[j+8+k]) for k = 0..7 then back to 12 bits with rounding
+    int16_t c[8];
+    qTaps(c);
+    unsigned int j = 0;
+#if defined(SIMD_X86_DISPATCH)
+    if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+        j = filterAVX2(even, i, n);
+    }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+    // the sums of two 12 bit samples fit in 16 bits: 16x16 bit products widened to 32 bits
+    const __m128i round = _mm_set1_epi32(1 << (HBFIRFilterTraits<32>::hbShift - 1));
+
+    for (; j + 8 <= n; j += 8)
+    {
+        __m128i accLo = round;
+        __m128i accHi = round;
+
+        for (int k = 0; k < 8; k++)
+        {
+            __m128i ck = _mm_set1_epi16(c[k]);
+            __m128i s = _mm_add_epi16(_mm_loadu_si128((const __m128i*) &even[j+7-k]),
+                                      _mm_loadu_si128((const __m128i*) &even[j+8+k]));
+            __m128i lo = _mm_mullo_epi16(s, ck);
+            __m128i hi = _mm_mulhi_epi16(s, ck);
+            accLo = _mm_add_epi32(accLo, _mm_unpacklo_epi16(lo, hi));
+            accHi = _mm_add_epi32(accHi, _mm_unpackhi_epi16(lo, hi));
+        }
+
+        accLo = _mm_srai_epi32(accLo, HBFIRFilterTraits<32>::hbShift);
+        accHi = _mm_srai_epi32(accHi, HBFIRFilterTraits<32>::hbShift);
+        _mm_storeu_si128((__m128i*) &i[j], _mm_packs_epi32(accLo, accHi));
+    }
+#elif defined(USE_NEON)
+    const int32x4_t round = vdupq_n_s32(1 << (HBFIRFilterTraits<32>::hbShift - 1));
+
+    for (; j + 8 <= n; j += 8)
+    {
+        int32x4_t accLo = round;
+        int32x4_t accHi = round;
+
+        for (int k = 0; k < 8; k++)
+        {
+            int16x8_t s = vaddq_s16(vld1q_s16(&even[j+7-k]), vld1q_s16(&even[j+8+k]));
+            accLo = vmlal_n_s16(accLo, vget_low_s16(s), c[k]);
+            accHi = vmlal_n_s16(accHi, vget_high_s16(s), c[k]);
+        }
+
+        vst1q_s16(&i[j], vcombine_s16(vshrn_n_s32(accLo, HBFIRFilterTraits<32>::hbShift),
+                                      vshrn_n_s32(accHi, HBFIRFilterTraits<32>::hbShift)));
+    }
+#endif
+    for (; j < n; j++)
+    {
+        int32_t acc = 1 << (HBFIRFilterTraits<32>::hbShift - 1);
+
+        for (int k = 0; k < 8; k++) {
+            acc += c[k] * (even[j+7-k] + even[j+8+k]);
+        }
+
+        i[j] = (int16_t) (acc >> HBFIRFilterTraits<32>::hbShift);
+    }
+}
+
+#if defined(SIMD_X86_DISPATCH)
+SIMD_TARGET("avx2")
+unsigned int RealDDC::filterAVX2(const int16_t *even, int16_t *i, unsigned int n)
+{
+    int16_t c[8];
+    qTaps(c);
+    const __m256i round = _mm256_set1_epi32(1 << (HBFIRFilterTraits<32>::hbShift - 1));
+    unsigned int j = 0;
+
+    for (; j + 16 <= n; j += 16)
+    {
+        __m256i accLo = round;
+        __m256i accHi = round;
+
+        for (int k = 0; k < 8; k++)
+        {
+            __m256i ck = _mm256_set1_epi16(c[k]);
+            __m256i s = _mm256_add_epi16(_mm256_loadu_si256((const __m256i*) &even[j+7-k]),
+                                         _mm256_loadu_si256((const __m256i*) &even[j+8+k]));
+            __m256i lo = _mm256_mullo_epi16(s, ck);
+            __m256i hi = _mm256_mulhi_epi16(s, ck);
+            // unpack and pack both work within the 128 bit lanes so the order is kept
+            accLo = _mm256_add_epi32(accLo, _mm256_unpacklo_epi16(lo, hi));
+            accHi = _mm256_add_epi32(accHi, _mm256_unpackhi_epi16(lo, hi));
+        }
+
+        accLo = _mm256_srai_epi32(accLo, HBFIRFilterTraits<32>::hbShift);
+        accHi = _mm256_srai_epi32(accHi, HBFIRFilterTraits<32>::hbShift);
+        _mm256_storeu_si256((__m256i*) &i[j], _mm256_packs_epi32(accLo, accHi));
+    }
+
+    return j;
+}
+#endif
@@ -25,21 +25,32 @@
 #include <rtl-sdr.h>
 
 #include "RtlSdrSource.h"
+#include "Tracepoints.h"
 #include "util.h"
 #include "parsekv.h"
 
 #define RTLSDR_ASYNC_BUF_NUMBER 12
 #define RTLSDR_DATA_LEN         (16*16384)   /* 256k */
 
-RtlSdrSource *RtlSdrSource::m_this = 0;
 
 // Open RTL-SDR device.
-RtlSdrSource::RtlSdrSource(int dev_index) :
+RtlSdrSource::RtlSdrSource(int dev_index, const std::string& serial) :
     m_dev(0),
     m_thread(0)
 {
     int r;
 
+    if (!serial.empty())
+    {
+        dev_index = rtlsdr_get_index_by_serial(serial.c_str());
+
+        if (dev_index < 0)
+        {
+            m_error = "Failed to find RTL-SDR device with serial " + serial;
+            return;
+        }
+    }
+
     const char *devname = rtlsdr_get_device_name(dev_index);
     if (devname != NULL)
         m_devname = devname;
@@ -66,8 +77,6 @@ RtlSdrSource::RtlSdrSource(int dev_index) :
 
         m_gainsStr = gains_ostr.str();
     }
-
-    m_this = this;
 }
 
 
@@ -76,8 +85,6 @@ RtlSdrSource::~RtlSdrSource()
 {
     if (m_dev)
         rtlsdr_close(m_dev);
-
-    m_this = 0;
 }
 
 bool RtlSdrSource::configure(parsekv::pairs_type& m)
@@ -204,6 +211,23 @@ bool RtlSdrSource::configure(parsekv::pairs_type& m)
 		changeFlags |= 0x10;
 	}
 
+	if (m.find("iqcorr") != m.end())
+	{
+		std::cerr << "RtlSdrSource::configure(m): iqcorr: " << m["iqcorr"] << std::endl;
+		int iqcorr = atoi(m["iqcorr"].c_str());
+
+		if ((iqcorr < (int) IQCorrector::CorrectionOff) || (iqcorr > (int) IQCorrector::CorrectionDCIQ))
+		{
+			m_error = "Invalid IQ correction mode";
+            std::cerr << "RtlSdrSource::configure: " << m_error << std::endl;
+			return false;
+		}
+		else
+		{
+			m_iqCorrector.setMode((IQCorrector::mode_t) iqcorr);
+		}
+	}
+
 	if (m.find("fcpos") != m.end())
 	{
 		std::cerr << "RtlSdrSource::configure(m): fcpos: " << m["fcpos"] << std::endl;
@@ -256,6 +280,19 @@ bool RtlSdrSource::configure(parsekv::pairs_type& m)
 	return configure(changeFlags, sample_rate, tuner_freq, ppm, tuner_gain, agcmode);
 }
 
+bool RtlSdrSource::retune(std::uint64_t frequency)
+{
+    uint32_t tuner_freq = get_tuner_frequency(frequency, rtlsdr_get_sample_rate(m_dev));
+
+    if (rtlsdr_set_center_freq(m_dev, tuner_freq) < 0)
+    {
+        m_error = "rtlsdr_set_center_freq failed";
+        return false;
+    }
+
+    return true;
+}
+
 // Configure RTL-SDR tuner and prepare for streaming.
 bool RtlSdrSource::configure(std::uint32_t changeFlags,
 		std::uint32_t sample_rate,
@@ -450,7 +487,9 @@ bool RtlSdrSource::start(DataBuffer<IQSample>* buf, std::atomic_bool *stop_flag)
 
     if (m_thread == 0)
     {
-        m_thread = new std::thread(run);
+        m_thread = new std::thread(run, this);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
         return true;
     }
     else
@@ -462,6 +501,8 @@ bool RtlSdrSource::start(DataBuffer<IQSample>* buf, std::atomic_bool *stop_flag)
 
 bool RtlSdrSource::stop()
 {
+    stopControl();
+
     if (m_thread)
     {
         m_thread->join();
@@ -472,30 +513,19 @@ bool RtlSdrSource::stop()
     return true;
 }
 
-void RtlSdrSource::run()
+void RtlSdrSource::run(RtlSdrSource *source)
 {
     IQSampleVector iqsamples;
-    void *msgBuf = 0;
 
-    std::thread *readerTrhead = new std::thread(readerThreadEntryPoint);
+    std::thread *readerTrhead = new std::thread(readerThreadEntryPoint, source);
+    set_thread_name(readerTrhead->native_handle(), "sdmn-usb");
 
-    while (!m_this->m_stop_flag->load())
+    while (!source->m_stop_flag->load())
     {
-        int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
-
-        if ((len > 0) && msgBuf)
-        {
-            std::string msg((char *) msgBuf, len);
-            std::cerr << "RtlSdrSource::run: received: " << msg << std::endl;
-            m_this->DeviceSource::configure(msg);
-            nn_freemsg(msgBuf);
-            msgBuf = 0;
-        }
-
         usleep(200000);
     }
 
-    rtlsdr_cancel_async(m_this->m_dev);
+    rtlsdr_cancel_async(source->m_dev);
 
     readerTrhead->join();
     delete readerTrhead;
@@ -525,31 +555,31 @@ void RtlSdrSource::get_device_names(std::vector<std::string>& devices)
     }
 }
 
-void RtlSdrSource::readerThreadEntryPoint()
+void RtlSdrSource::readerThreadEntryPoint(RtlSdrSource *source)
 {
     // reset buffer to start streaming
-    if (rtlsdr_reset_buffer(m_this->m_dev) < 0)
+    if (rtlsdr_reset_buffer(source->m_dev) < 0)
     {
         std::cerr << "RtlSdrSource::readerThreadEntryPoint: rtlsdr_reset_buffer failed" << std::endl;
         return;
     }
 
-    rtlsdr_read_async(m_this->m_dev, rtlsdrCallback, 0,
+    rtlsdr_read_async(source->m_dev, rtlsdrCallback, (void *) source,
                           RTLSDR_ASYNC_BUF_NUMBER,
                           RTLSDR_DATA_LEN);
 }
 
-void RtlSdrSource::rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx __attribute__((unused)))
+void RtlSdrSource::rtlsdrCallback(unsigned char *buf, uint32_t len, void *ctx)
 {
+    RtlSdrSource *source = (RtlSdrSource *) ctx;
     IQSampleVector samples;
-    samples.resize(len/2);
-
-    for (unsigned int i = 0; i < len/2; i++)
-    {
-        samples[i] = IQSample(buf[2*i] - 128, buf[2*i+1] - 128);
-    }
+    SDMN_TRACE1(device_callback_entry, len/2);
+    source->m_buf->get_vector(samples, len/2);
+    source->m_iqCorrector.u8ToIQ(buf, samples.data(), len, source->get_normalize());
 
-    m_this->m_buf->push(move(samples));
+    source->m_buf->push(move(samples));
+    source->scan(len/2);
+    SDMN_TRACE1(device_callback_exit, len/2);
 }
 
 /* end */
@@ -0,0 +1,938 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+
+#include "RxPipeline.h"
+#include "RingBuffer.h"
+#include "ScanScheduler.h"
+#include "util.h"
+
+/**
+ * Get data from output buffer and write to output stream.
+ *
+ * This code runs in a separate thread.
+ */
+static void write_output_data(UDPSink *output,
+        DataBuffer<IQSample> *buf,
+        std::size_t buf_minfill,
+        const std::atomic_bool *stop_flag)
+{
+    while (!stop_flag->load())
+    {
+        if (buf->queued_samples() == 0)
+        {
+            // The buffer is empty. Perhaps the output stream is consuming
+            // samples faster than we can produce them. Wait until the buffer
+            // is back at its nominal level to make sure this does not happen
+            // too often.
+            buf->wait_buffer_fill(buf_minfill);
+        }
+
+        if (buf->pull_end_reached())
+        {
+            // Reached end of stream.
+            break;
+        }
+
+        // Get samples from buffer and write to output.
+        IQSampleVector samples = buf->pull();
+        output->setSampleStamp(buf->pulled_stamp());
+        output->write(samples);
+        buf->recycle(move(samples));
+
+        if (!(*output))
+        {
+            fprintf(stderr, "ERROR: Output: %s\n", output->error().c_str());
+        }
+    }
+}
+
+static bool parse_int(const char *s, int& v)
+{
+    char *endp;
+    long t = strtol(s, &endp, 10);
+    if (endp == s)
+        return false;
+    if (*endp != '\0' || t < INT_MIN || t > INT_MAX)
+        return false;
+    v = t;
+    return true;
+}
+
+/** Parse a comma separated list of address[:port] destinations */
+static bool parse_destinations(const std::string& str, unsigned int defaultPort, std::vector<std::pair<std::string, unsigned int> >& destinations)
+{
+    std::size_t start = 0;
+
+    while (true)
+    {
+        std::size_t end = str.find(',', start);
+        std::string item = str.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        std::size_t colon = item.find(':');
+        int port = defaultPort;
+
+        if (colon != std::string::npos)
+        {
+            if (!parse_int(item.substr(colon + 1).c_str(), port) || (port <= 0) || (port > 65535)) {
+                return false;
+            }
+
+            item.erase(colon);
+        }
+
+        if (item.empty()) {
+            return false;
+        }
+
+        destinations.push_back(std::make_pair(item, (unsigned int) port));
+
+        if (end == std::string::npos) {
+            return true;
+        }
+
+        start = end + 1;
+    }
+}
+
+/** Register the counters of the pipeline stages, buffers and UDP sink */
+static void add_metrics(Metrics& metrics,
+        DataBuffer<IQSample>& source_buffer,
+        DataBuffer<IQSample>& output_buffer,
+        bool buffered_output,
+        const std::atomic<uint64_t>& decimated_samples,
+        const UDPSinkFEC& udp_output,
+        const VectorPool<IQSample>& samples_pool)
+{
+    DataBuffer<IQSample> *input = &source_buffer;
+    DataBuffer<IQSample> *output = &output_buffer;
+    const std::atomic<uint64_t> *decimated = &decimated_samples;
+    const UDPSinkFEC *sink = &udp_output;
+    const VectorPool<IQSample> *pool = &samples_pool;
+
+    metrics.addCounter("sdrdaemon_samples_total", "stage=\"device\"", "Samples output by the stage",
+            [input]() { return input->pushed_samples(); });
+    metrics.addCounter("sdrdaemon_samples_total", "stage=\"decimator\"", "",
+            [decimated]() { return decimated->load(); });
+    metrics.addCounter("sdrdaemon_samples_total", "stage=\"udp\"", "",
+            [sink]() { return sink->getNbSamplesWritten(); });
+
+    std::vector<std::pair<std::string, DataBuffer<IQSample>*> > buffers;
+    buffers.push_back(std::make_pair(std::string("buffer=\"input\""), input));
+
+    if (buffered_output) {
+        buffers.push_back(std::make_pair(std::string("buffer=\"output\""), output));
+    }
+
+    for (std::vector<std::pair<std::string, DataBuffer<IQSample>*> >::iterator it = buffers.begin(); it != buffers.end(); ++it)
+    {
+        DataBuffer<IQSample> *buf = it->second;
+        metrics.addGauge("sdrdaemon_buffer_queued_samples", it->first, "Samples queued in the buffer",
+                [buf]() { return buf->queued_samples(); });
+        metrics.addGauge("sdrdaemon_buffer_max_queued_samples", it->first, "High-water mark of the samples queued in the buffer",
+                [buf]() { return buf->max_queued_samples(); });
+        metrics.addCounter("sdrdaemon_buffer_dropped_blocks_total", it->first, "Blocks dropped because the buffer was full",
+                [buf]() { return buf->dropped_blocks(); });
+        metrics.addCounter("sdrdaemon_buffer_dropped_samples_total", it->first, "Samples dropped because the buffer was full",
+                [buf]() { return buf->dropped_samples(); });
+    }
+
+    metrics.addCounter("sdrdaemon_pool_allocations_total", "", "Sample vectors allocated because none could be recycled",
+            [pool]() { return pool->allocated(); });
+    metrics.addCounter("sdrdaemon_fec_frames_encoded_total", "", "Frames FEC encoded",
+            [sink]() { return sink->getNbFramesEncoded(); });
+    metrics.addGauge("sdrdaemon_fec_blocks", "", "Number of FEC blocks per frame",
+            [sink]() { return sink->getNbBlocksFEC(); });
+    metrics.addCounter("sdrdaemon_udp_frames_sent_total", "", "Frames sent",
+            [sink]() { return sink->getNbFramesSent(); });
+    metrics.addCounter("sdrdaemon_udp_blocks_sent_total", "", "UDP blocks sent",
+            [sink]() { return sink->getNbBlocksSent(); });
+    metrics.addCounter("sdrdaemon_udp_blocks_resent_total", "", "UDP blocks resent on retransmission requests",
+            [sink]() { return sink->getNbResentBlocks(); });
+    metrics.addCounter("sdrdaemon_udp_send_errors_total", "", "Frames not completely sent because of a socket error",
+            [sink]() { return sink->getNbSendErrors(); });
+    metrics.addCounter("sdrdaemon_udp_tx_waits_total", "", "Times the frame assembly waited for the UDP transmission (too slow)",
+            [sink]() { return sink->getNbTxWaits(); });
+    metrics.addCounter("sdrdaemon_udp_squelched_frames_total", "", "Keep-alive frames sent in place of squelched samples",
+            [sink]() { return sink->getNbSquelchedFrames(); });
+    metrics.addCounter("sdrdaemon_fec_shed_frames_total", "", "Frames sent with less FEC blocks because the transmission fell behind",
+            [sink]() { return sink->getNbShedFrames(); });
+    metrics.addCounter("sdrdaemon_fec_shed_blocks_total", "", "FEC blocks not sent because the transmission fell behind",
+            [sink]() { return sink->getNbShedBlocks(); });
+    metrics.addCounter("sdrdaemon_udp_unpaced_frames_total", "", "Frames sent without pacing because the transmission fell behind",
+            [sink]() { return sink->getNbUnpacedFrames(); });
+    metrics.addCounter("sdrdaemon_udp_time_anchors_total", "", "Capture time anchors taken (start, sample rate changes and drift)",
+            [sink]() { return sink->getNbAnchors(); });
+}
+
+/** Register the latency histograms of the stages from the device callback to the last datagram sent */
+static void add_latency_metrics(Metrics& metrics,
+        const LatencyHistogram& input_latency,
+        const LatencyHistogram& decimation_latency,
+        const UDPSinkFEC& udp_output)
+{
+    const std::string help("Delay added by the stage");
+    metrics.addHistogram("sdrdaemon_latency_seconds", "stage=\"input_queue\"", help, input_latency);
+    metrics.addHistogram("sdrdaemon_latency_seconds", "stage=\"decimation\"", help, decimation_latency);
+    metrics.addHistogram("sdrdaemon_latency_seconds", "stage=\"frame\"", help, udp_output.getFrameLatency());
+    metrics.addHistogram("sdrdaemon_latency_seconds", "stage=\"tx_ring\"", help, udp_output.getRingLatency());
+    metrics.addHistogram("sdrdaemon_latency_seconds", "stage=\"send\"", help, udp_output.getSendLatency());
+    metrics.addHistogram("sdrdaemon_end_to_end_latency_seconds", "", "Delay from the device callback to the last datagram of the frame sent",
+            udp_output.getEndToEndLatency());
+}
+
+/**
+ * Mark the frequency scan retunes taking effect in a block of nbIn device samples starting at device sample index
+ * blockStart and written as nbOut samples from output sample index outIndex to each output. The center
+ * frequency of an output is the device frequency plus its offset (channelizer).
+ */
+static void mark_retunes(DeviceSource& src,
+        const std::vector<UDPSink*>& outputs,
+        const std::vector<int64_t>& offsets,
+        uint64_t blockStart,
+        std::size_t nbIn,
+        uint64_t outIndex,
+        std::size_t nbOut)
+{
+    ScanScheduler::Retune retune;
+
+    while ((nbIn > 0) && src.get_retune(blockStart + nbIn, retune))
+    {
+        uint64_t offset = retune.sampleIndex > blockStart ? retune.sampleIndex - blockStart : 0;
+
+        for (std::size_t i = 0; i < outputs.size(); i++)
+        {
+            outputs[i]->markRetune(outIndex + (offset * nbOut) / nbIn,
+                    retune.frequency + offsets[i],
+                    ((uint64_t) retune.settleSamples * nbOut) / nbIn,
+                    retune.hopCount);
+        }
+    }
+}
+
+/** Parse a channel given as channel:address:port[:fec blocks]. The channel number is signed (negative: below the center). */
+static bool parse_channel(const std::string& str, unsigned int nbChannels, int& channel, std::string& address, unsigned int& port, int& nbFECBlocks)
+{
+    std::vector<std::string> fields;
+    std::size_t start = 0;
+
+    while (true)
+    {
+        std::size_t end = str.find(':', start);
+        fields.push_back(str.substr(start, end == std::string::npos ? std::string::npos : end - start));
+
+        if (end == std::string::npos) {
+            break;
+        }
+
+        start = end + 1;
+    }
+
+    int value;
+
+    if ((fields.size() < 3) || (fields.size() > 4) || fields[1].empty()) {
+        return false;
+    }
+
+    if (!parse_int(fields[0].c_str(), channel) || (channel < -((int) nbChannels / 2)) || (channel >= (int) nbChannels / 2)) {
+        return false;
+    }
+
+    if (!parse_int(fields[2].c_str(), value) || (value <= 0) || (value > 65535)) {
+        return false;
+    }
+
+    address = fields[1];
+    port = value;
+    nbFECBlocks = -1; // follows the fecblk configuration
+
+    if ((fields.size() == 4) && (!parse_int(fields[3].c_str(), nbFECBlocks) || (nbFECBlocks < 0) || (nbFECBlocks > 128))) {
+        return false;
+    }
+
+    return true;
+}
+
+RxPipeline::RxPipeline(const RxOptions& options, const DeviceSpec& spec, std::atomic_bool *stopFlag) :
+    m_options(options),
+    m_spec(spec),
+    m_stopFlag(stopFlag),
+    m_srcsdr(0),
+    m_udpOutputInstance(0),
+    m_nbFECBlocks(0),
+    m_txDelay(0),
+    m_txBatch(0),
+    m_txPace(0),
+    m_fecAuto(0),
+    m_nack(false),
+    m_overload(true),
+    m_frameBlocks(128),
+    m_frameTarget(0),
+    m_interleave(1),
+    m_fecCodec(0),
+    m_ifrate(0),
+    m_outputSamples(0),
+    m_block(0),
+    m_inbufLengthWarning(false),
+    m_mainOffset(1, 0),
+    m_busy(false),
+    m_finished(false),
+    m_inline(false),
+    m_inlineEnded(false),
+    m_inlineOverruns(0),
+    m_blockSamples(0),
+    m_decimatedSamples(0)
+{
+}
+
+bool RxPipeline::open(DeviceSource *srcsdr, const std::function<void()>& notifier, FECEncoderPool *encoderPool)
+{
+    std::vector<std::pair<std::string, unsigned int> > destinations;
+
+    // the device is owned from here
+    m_srcsdr = srcsdr;
+    m_upSrcsdr.reset(m_srcsdr);
+
+    if (!parse_destinations(m_spec.dataaddress, m_spec.dataport, destinations))
+    {
+        fprintf(stderr, "ERROR: Invalid data address %s\n", m_spec.dataaddress.c_str());
+        return false;
+    }
+
+    bool pipelined = m_options.pipeline || encoderPool;
+
+    // Prepare output writer. Frames are built and FEC encoded once for all destinations.
+    m_udpOutputInstance = new UDPSinkFEC(destinations[0].first, destinations[0].second, pipelined, m_options.udp_size, m_options.tx_ring, m_options.fec_encoders, encoderPool, m_options.fec_max, m_options.frame_max);
+    m_udpOutput.reset(m_udpOutputInstance);
+
+    for (unsigned int i = 1; i < destinations.size(); i++) {
+        m_udpOutputInstance->addDestination(destinations[i].first, destinations[i].second);
+    }
+
+    if (m_options.multicast_ttl >= 0) {
+        m_udpOutputInstance->setMulticastTTL(m_options.multicast_ttl);
+    }
+
+    m_udpOutputInstance->setWireBits(m_options.wire_bits);
+
+    if (!m_udpOutputInstance->setCompression(m_options.compression))
+    {
+        fprintf(stderr, "ERROR: -z: built without LZ4\n");
+        return false;
+    }
+
+    m_udpOutputInstance->setSquelch(m_options.squelch_db, m_options.squelch_ms);
+    m_udpOutputInstance->setBlockCRC(m_options.block_crc);
+
+    if (!m_udpOutputInstance->setAffinity(m_options.stage_cpus[2], m_options.stage_cpus[3]))
+    {
+        fprintf(stderr, "WARNING: can not set FEC encoding or sending thread CPU affinity\n");
+    }
+
+    m_fecOutputs.push_back(m_udpOutputInstance); // those following the fecblk configuration
+    m_outputs.push_back(m_udpOutputInstance);
+    m_mainOutput.push_back(m_udpOutputInstance);
+
+    // Channelizer: one sink per channel taken from the device band instead of the decimator output
+    if (m_options.nb_channels > 0)
+    {
+        if (!m_channelizer.configure(m_options.nb_channels, m_options.channel_taps))
+        {
+            fprintf(stderr, "ERROR: channelizer: %s\n", m_channelizer.error().c_str());
+            return false;
+        }
+
+        if (m_options.channel_specs.empty())
+        {
+            fprintf(stderr, "ERROR: channelizer: no channel given with -k\n");
+            return false;
+        }
+
+        for (unsigned int i = 0; i < m_options.channel_specs.size(); i++)
+        {
+            int channel = 0, channelFECBlocks = -1;
+            std::string address;
+            unsigned int port = 0;
+
+            if (!parse_channel(m_options.channel_specs[i], m_options.nb_channels, channel, address, port, channelFECBlocks))
+            {
+                fprintf(stderr, "ERROR: Invalid channel %s\n", m_options.channel_specs[i].c_str());
+                return false;
+            }
+
+            UDPSinkFEC *sink = new UDPSinkFEC(address, port, pipelined, m_options.udp_size, m_options.tx_ring, m_options.fec_encoders, encoderPool, m_options.fec_max, m_options.frame_max);
+            m_channelSinks.push_back(std::unique_ptr<UDPSinkFEC>(sink));
+
+            if (m_options.multicast_ttl >= 0) {
+                sink->setMulticastTTL(m_options.multicast_ttl);
+            }
+
+            if (m_options.udp_connect && (*sink)) {
+                sink->connect();
+            }
+
+            sink->setSegmentationOffload(m_options.udp_gso);
+            sink->setWireBits(m_options.wire_bits);
+            sink->setCompression(m_options.compression);
+            sink->setSquelch(m_options.squelch_db, m_options.squelch_ms);
+            sink->setBlockCRC(m_options.block_crc);
+
+            if (!(*sink))
+            {
+                fprintf(stderr, "ERROR: UDP Output of channel %d: %s\n", channel, sink->error().c_str());
+                return false;
+            }
+
+            if (channelFECBlocks < 0) {
+                m_fecOutputs.push_back(sink);
+            } else {
+                sink->setNbBlocksFEC(channelFECBlocks);
+            }
+
+            m_outputs.push_back(sink);
+            m_channelOutputs.push_back(sink);
+            m_channelNumbers.push_back(channel);
+            m_channelOffsets.push_back(0);
+            fprintf(stderr, "Channel %d of %u to %s:%u\n", channel, m_options.nb_channels, address.c_str(), port);
+        }
+    }
+
+    if (m_options.udp_connect && (*m_udpOutput)) {
+        m_udpOutput->connect();
+    }
+
+    m_udpOutput->setSegmentationOffload(m_options.udp_gso);
+
+    if (!(*m_udpOutput))
+    {
+        fprintf(stderr, "ERROR: UDP Output: %s\n", m_udpOutput->error().c_str());
+        return false;
+    }
+
+    // Local consumers: the main stream goes into the shared memory ring then to UDP unless the data port is 0
+    if (!m_spec.shmname.empty())
+    {
+        m_shmOutput.reset(new SHMSink(m_spec.shmname, m_spec.shmslots, m_spec.dataport > 0 ? m_udpOutput.get() : 0));
+
+        if (!(*m_shmOutput))
+        {
+            fprintf(stderr, "ERROR: shared memory output: %s\n", m_shmOutput->error().c_str());
+            return false;
+        }
+
+        fprintf(stderr, "Shared memory:     %s: %lu kB (%u frames of %u samples)%s\n", m_shmOutput->getRing().getName().c_str(),
+                (unsigned long) (m_shmOutput->getSharedBytes() / 1024), m_shmOutput->getRing().getNbSlots(),
+                m_shmOutput->getRing().getSlotSamples(), m_spec.dataport > 0 ? "" : ", no UDP output");
+    }
+
+    // Configure device and start streaming.
+
+    m_srcsdr->setConfigurationPort(m_spec.cfgport);
+
+    // Prepare downsampler.
+    m_srcsdr->associateDownsampler(&m_dn);
+
+    if (!m_srcsdr->configure(m_spec.config))
+    {
+        fprintf(stderr, "ERROR: source configuration: %s\n", m_srcsdr->error().c_str());
+        return false;
+    }
+
+    double freq = m_srcsdr->get_received_frequency();
+    fprintf(stderr, "tuned for:         %.6f MHz\n", freq * 1.0e-6);
+
+    double tuner_freq = m_srcsdr->get_frequency();
+    fprintf(stderr, "device tuned for:  %.6f MHz\n", tuner_freq * 1.0e-6);
+
+    m_ifrate = m_srcsdr->get_sample_rate();
+    fprintf(stderr, "IF sample rate:    %.0f Hz\n", m_ifrate);
+
+    m_srcsdr->print_specific_parms();
+
+    // Create source data queue.
+    m_sourceBuffer.reset(m_options.lockfree_buffers ? new RingBuffer<IQSample>() : new DataBuffer<IQSample>());
+
+    // Vectors are recycled from the consumers back to the device callback
+    m_sourceBuffer->set_pool(&m_samplesPool);
+
+    int queue_capacity = m_options.queue_capacity < 0 ? RXQUEUE_SECONDS * m_ifrate : m_options.queue_capacity;
+
+    m_sourceBuffer->set_capacity(queue_capacity, m_options.drop_policy);
+    m_sourceBuffer->set_stamping(true); // capture time from the device callback: frame time anchors and latencies
+    m_sourceBuffer->set_notifier(notifier);
+
+    // Create output data queue.
+    m_outputBuffer.reset(m_options.lockfree_buffers ? new RingBuffer<IQSample>() : new DataBuffer<IQSample>());
+    m_outputBuffer->set_pool(&m_samplesPool);
+    m_outputBuffer->set_capacity(queue_capacity, m_options.drop_policy);
+    m_srcsdr->associateOutputBuffer(m_outputBuffer.get());
+
+    // Start reading from device in separate thread.
+    m_upSrcsdr->start(m_sourceBuffer.get(), m_stopFlag);
+
+    if (!(*m_upSrcsdr))
+    {
+        fprintf(stderr, "ERROR: source: %s\n", m_upSrcsdr->error().c_str());
+        return false;
+    }
+
+    // If buffering enabled, start background output thread.
+    if (m_options.outputbuf_samples > 0)
+    {
+        m_outputThread = std::thread(write_output_data,
+                               mainWriter(),
+                               m_outputBuffer.get(),
+                               m_options.outputbuf_samples,
+                               m_stopFlag);
+
+        set_thread_name(m_outputThread.native_handle(), "sdmn-frame");
+
+        if (!set_thread_affinity(m_outputThread.native_handle(), m_options.stage_cpus[1]))
+        {
+            fprintf(stderr, "WARNING: can not set frame assembly thread CPU affinity\n");
+        }
+    }
+
+    if ((m_spec.metricsport > 0) || (m_spec.httpport > 0))
+    {
+        add_metrics(m_metrics, *m_sourceBuffer, *m_outputBuffer, m_options.outputbuf_samples > 0, m_decimatedSamples, *m_udpOutputInstance, m_samplesPool);
+
+        if (m_shmOutput)
+        {
+            const SHMSink *shm = m_shmOutput.get();
+            m_metrics.addCounter("sdrdaemon_shm_frames_total", "", "Frames published in the shared memory ring",
+                    [shm]() { return shm->getNbFrames(); });
+        }
+
+        if (m_options.latency) {
+            add_latency_metrics(m_metrics, m_inputLatency, m_decimationLatency, *m_udpOutputInstance);
+        }
+
+        if ((m_spec.metricsport > 0) && !m_metrics.setPublishPort(m_spec.metricsport)) {
+            fprintf(stderr, "WARNING: metrics: %s\n", m_metrics.error().c_str());
+        }
+
+        if ((m_spec.httpport > 0) && !m_metrics.setHttpPort(m_spec.httpport)) {
+            fprintf(stderr, "WARNING: metrics: %s\n", m_metrics.error().c_str());
+        }
+
+        m_metrics.start();
+    }
+
+    // Memory reserved for the frames and how far the sample queues may grow
+    std::size_t frameBytes = m_udpOutputInstance->getPreallocatedBytes();
+
+    for (std::size_t i = 0; i < m_channelSinks.size(); i++) {
+        frameBytes += m_channelSinks[i]->getPreallocatedBytes();
+    }
+
+    fprintf(stderr, "Preallocated:      %lu kB (Tx ring of %u frames, up to %d FEC blocks)\n",
+            (unsigned long) (frameBytes / 1024), m_options.tx_ring, m_udpOutputInstance->getMaxNbBlocksFEC());
+
+    if (queue_capacity > 0) {
+        fprintf(stderr, "Sample queues:     %lu kB each at most\n", (unsigned long) (queue_capacity * sizeof(IQSample) / 1024));
+    } else {
+        fprintf(stderr, "Sample queues:     unbounded\n");
+    }
+
+    return true;
+}
+
+UDPSink *RxPipeline::mainWriter()
+{
+    return m_shmOutput ? (UDPSink *) m_shmOutput.get() : m_udpOutput.get();
+}
+
+bool RxPipeline::ready()
+{
+    return (m_sourceBuffer->queued_vectors() > 0) || m_sourceBuffer->pull_end_reached();
+}
+
+bool RxPipeline::processBlock()
+{
+    DataBuffer<IQSample>& source_buffer = *m_sourceBuffer;
+    DataBuffer<IQSample>& output_buffer = *m_outputBuffer;
+    DeviceSource *srcsdr = m_srcsdr;
+    UDPSink *udp_output = mainWriter();
+    unsigned int outputbuf_samples = m_options.outputbuf_samples;
+    unsigned int wire_bits = m_options.wire_bits;
+
+    // Check for overflow of source buffer.
+    if (!m_inbufLengthWarning && source_buffer.dropped_blocks() > 0)
+    {
+        fprintf(stderr, "\nWARNING: Input buffer is full and samples are dropped (system too slow)\n");
+        m_inbufLengthWarning = true;
+    }
+    else if (!m_inbufLengthWarning && source_buffer.queued_samples() > 10 * m_ifrate)
+    {
+        fprintf(stderr, "\nWARNING: Input buffer is growing (system too slow)\n");
+        m_inbufLengthWarning = true;
+    }
+
+    // Pull next block from source buffer.
+    IQSampleVector iqsamples = source_buffer.pull();
+
+    if (iqsamples.empty())
+    {
+        return false;
+    }
+
+    m_blockSamples = iqsamples.size();
+    int64_t stamp = source_buffer.pulled_stamp(); // capture time
+    int64_t pulled = m_options.latency ? LatencyHistogram::now() : 0;
+
+    if (m_options.latency) {
+        m_inputLatency.recordSince(stamp);
+    }
+
+    if (srcsdr->get_raw_real()) {
+        m_ddc.process(iqsamples); // real samples of the Airspy raw mode to I/Q in place
+    }
+
+    // device sample index of the block start (the scan counts the samples dropped by the buffer)
+    uint64_t block_start = source_buffer.pulled_samples() + source_buffer.dropped_samples() - iqsamples.size();
+    uint64_t output_index = m_outputSamples - (outputbuf_samples > 0 ? output_buffer.dropped_samples() : 0);
+
+    if (!srcsdr->scanning()) { // else the retunes give the frequency
+        udp_output->setCenterFrequency(srcsdr->get_received_frequency() + m_dn.getShift());
+    }
+
+    m_mainOffset[0] = m_dn.getShift();
+
+    applySettings();
+
+    // Possible downsampling and write to UDP
+    m_dn.setSampleRate(srcsdr->get_sample_rate()); // only acts when the rates change
+    bool rescale_only = !m_channelizer.active() && (m_dn.getLog2Decimation() == 0) && !m_dn.isCIC() && !m_dn.isResampling();
+    // without decimation the device converts to the 16 bits scale itself, blocks already in the
+    // buffer when this changes go through with the previous scale
+    srcsdr->set_normalize(rescale_only && !srcsdr->get_raw_real());
+
+    if (m_channelizer.active())
+    {
+        // channels straight from the device samples, written directly (the decimator is not used)
+        unsigned int sampleSize = srcsdr->get_sample_bits();
+        uint32_t channel_rate = srcsdr->get_sample_rate() / m_channelizer.getNbChannels();
+        std::size_t block_in = iqsamples.size();
+
+        m_channelizer.process(sampleSize, iqsamples, m_channelNumbers, m_channelSamples);
+        source_buffer.recycle(move(iqsamples));
+        m_decimatedSamples.fetch_add(m_channelSamples[0].size(), std::memory_order_relaxed);
+        m_decimationLatency.recordSince(pulled);
+
+        for (unsigned int i = 0; i < m_channelOutputs.size(); i++)
+        {
+            UDPSink *output = m_channelOutputs[i];
+            m_channelOffsets[i] = (int64_t) m_channelNumbers[i] * channel_rate;
+
+            if (!srcsdr->scanning()) {
+                output->setCenterFrequency(srcsdr->get_received_frequency() + m_channelOffsets[i]);
+            }
+
+            output->setSampleBits(sampleSize);
+            output->setSampleBytes((sampleSize - 1)/8 + 1);
+            output->setSampleRate(channel_rate);
+        }
+
+        mark_retunes(*srcsdr, m_channelOutputs, m_channelOffsets, block_start, block_in, output_index, m_channelSamples[0].size());
+        m_outputSamples += m_channelSamples[0].size();
+
+        for (unsigned int i = 0; i < m_channelOutputs.size(); i++)
+        {
+            m_channelOutputs[i]->setSampleStamp(stamp);
+            m_channelOutputs[i]->write(m_channelSamples[i]);
+        }
+    }
+    else if (rescale_only)
+    {
+        unsigned int sampleSize = srcsdr->get_normalize() ? 16 : srcsdr->get_sample_bits(); // 16: only the NCO if any
+    	m_dn.rescale(sampleSize, iqsamples);
+        m_decimatedSamples.fetch_add(iqsamples.size(), std::memory_order_relaxed);
+
+        udp_output->setSampleBits(srcsdr->get_sample_bits());
+        udp_output->setSampleBytes((srcsdr->get_sample_bits()-1)/8 + 1);
+        udp_output->setSampleRate(srcsdr->get_sample_rate());
+        m_udpOutputInstance->setWireBits(m_dn.getShift() == 0 ? wire_bits : std::max(wire_bits, 12U)); // the NCO adds bits
+        mark_retunes(*srcsdr, m_mainOutput, m_mainOffset, block_start, iqsamples.size(), output_index, iqsamples.size());
+        m_outputSamples += iqsamples.size();
+
+        if (outputbuf_samples > 0)
+        {
+            // Buffered write.
+            output_buffer.push(move(iqsamples), stamp);
+        }
+        else
+        {
+            // Direct write.
+            udp_output->setSampleStamp(stamp);
+            udp_output->write(iqsamples);
+            source_buffer.recycle(move(iqsamples));
+        }
+    }
+    else
+    {
+        unsigned int sampleSize = srcsdr->get_sample_bits();
+        if (m_outsamples.capacity() == 0) {
+            // previous block went to the output thread, take storage back from the pool
+            output_buffer.get_vector(m_outsamples, iqsamples.size() / m_dn.getDecimation());
+        }
+
+        std::size_t block_in = iqsamples.size();
+        m_dn.process(sampleSize, iqsamples, m_outsamples);
+        source_buffer.recycle(move(iqsamples));
+        m_decimatedSamples.fetch_add(m_outsamples.size(), std::memory_order_relaxed);
+        m_decimationLatency.recordSince(pulled);
+
+        udp_output->setSampleBits(sampleSize);
+        udp_output->setSampleBytes((sampleSize -1)/8 + 1);
+        udp_output->setSampleRate(m_dn.getOutputRate());
+        m_udpOutputInstance->setWireBits(std::max(wire_bits, 12U)); // decimation gains more than 8 bits
+        mark_retunes(*srcsdr, m_mainOutput, m_mainOffset, block_start, block_in, output_index, m_outsamples.size());
+
+        // Throw away first block. It is noisy because IF filters
+        // are still starting up.
+        if (m_block > 0)
+        {
+            m_outputSamples += m_outsamples.size();
+
+            // Write samples to output.
+            if (outputbuf_samples > 0)
+            {
+                // Buffered write.
+                output_buffer.push(move(m_outsamples), stamp);
+            }
+            else
+            {
+                // Direct write. The vector is kept and written over by the next block.
+                udp_output->setSampleStamp(stamp);
+                udp_output->write(m_outsamples);
+            }
+        }
+    }
+
+    m_block++;
+    return true;
+}
+
+void RxPipeline::stop()
+{
+    m_metrics.stop();
+    m_upSrcsdr->stop();
+
+    if (m_options.outputbuf_samples > 0)
+    {
+        m_outputBuffer->push_end();
+        m_outputThread.join();
+    }
+}
+
+bool RxPipeline::claim()
+{
+    if (m_busy.exchange(true, std::memory_order_acquire)) {
+        return false;
+    }
+
+    if (m_finished.load())
+    {
+        m_busy.store(false, std::memory_order_release);
+        return false;
+    }
+
+    return true;
+}
+
+void RxPipeline::processInline()
+{
+    if (!m_inline.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    while (ready())
+    {
+        int64_t start = LatencyHistogram::now();
+
+        if (!processBlock())
+        {
+            endInline(true);
+            return;
+        }
+
+        int64_t elapsed = LatencyHistogram::now() - start;
+        int64_t budget = (int64_t) ((m_blockSamples * 1e9 * RXINLINE_BUDGET) / (100.0 * m_srcsdr->get_sample_rate()));
+
+        m_inlineOverruns = elapsed > budget ? m_inlineOverruns + 1 : 0;
+
+        if (m_inlineOverruns >= RXINLINE_OVERRUNS)
+        {
+            fprintf(stderr, "\nWARNING: inline processing over budget (%ld us for %ld us blocks): back to the main loop\n",
+                    (long) (elapsed / 1000), (long) (budget * 100 / (RXINLINE_BUDGET * 1000)));
+            endInline(false);
+            return;
+        }
+    }
+}
+
+bool RxPipeline::waitInline()
+{
+    std::unique_lock<std::mutex> lock(m_inlineMutex);
+
+    while (m_inline.load() && !m_stopFlag->load()) {
+        m_inlineCond.wait_for(lock, std::chrono::milliseconds(100)); // the stop flag is set from a signal handler
+    }
+
+    return m_inlineEnded;
+}
+
+void RxPipeline::endInline(bool ended)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_inlineMutex);
+        m_inlineEnded = ended;
+        m_inline.store(false, std::memory_order_release);
+    }
+
+    m_inlineCond.notify_all();
+}
+
+void RxPipeline::applySettings()
+{
+    unsigned int confNbFECBlocks = m_srcsdr->get_nb_fec_blocks();
+
+    if (confNbFECBlocks != m_nbFECBlocks)
+    {
+        m_nbFECBlocks = confNbFECBlocks;
+
+        for (UDPSink *output : m_fecOutputs) {
+            output->setNbBlocksFEC(m_nbFECBlocks);
+        }
+    }
+
+    unsigned int confTxDelay = m_srcsdr->get_tx_delay();
+
+    if (confTxDelay != m_txDelay)
+    {
+        m_txDelay = confTxDelay;
+
+        for (UDPSink *output : m_outputs) {
+            output->setTxDelay(m_txDelay);
+        }
+    }
+
+    unsigned int confTxBatch = m_srcsdr->get_tx_batch();
+
+    if (confTxBatch != m_txBatch)
+    {
+        m_txBatch = confTxBatch;
+
+        for (UDPSink *output : m_outputs) {
+            output->setTxBatch(m_txBatch);
+        }
+    }
+
+    unsigned int confTxPace = m_srcsdr->get_tx_pace();
+
+    if (confTxPace != m_txPace)
+    {
+        m_txPace = confTxPace;
+
+        for (UDPSink *output : m_outputs) {
+            output->setTxPace(m_txPace);
+        }
+    }
+
+    unsigned int confFecAuto = m_srcsdr->get_fec_auto();
+
+    if (confFecAuto != m_fecAuto)
+    {
+        m_fecAuto = confFecAuto;
+
+        for (UDPSink *output : m_outputs) {
+            output->setFECAuto(m_fecAuto);
+        }
+    }
+
+    bool confNack = m_srcsdr->get_nack();
+
+    if (confNack != m_nack)
+    {
+        m_nack = confNack;
+
+        for (UDPSink *output : m_outputs) {
+            output->setNack(m_nack);
+        }
+    }
+
+    bool confOverload = m_srcsdr->get_overload();
+
+    if (confOverload != m_overload)
+    {
+        m_overload = confOverload;
+
+        for (UDPSink *output : m_outputs) {
+            output->setOverload(m_overload);
+        }
+    }
+
+    unsigned int confFrameBlocks = m_srcsdr->get_frame_blocks();
+
+    if (confFrameBlocks != m_frameBlocks)
+    {
+        m_frameBlocks = confFrameBlocks;
+
+        for (UDPSink *output : m_outputs) {
+            output->setFrameBlocks(m_frameBlocks);
+        }
+    }
+
+    unsigned int confFrameTarget = m_srcsdr->get_frame_target();
+
+    if (confFrameTarget != m_frameTarget)
+    {
+        m_frameTarget = confFrameTarget;
+
+        for (UDPSink *output : m_outputs) {
+            output->setFrameTarget(m_frameTarget);
+        }
+    }
+
+    unsigned int confInterleave = m_srcsdr->get_interleave();
+
+    if (confInterleave != m_interleave)
+    {
+        m_interleave = confInterleave;
+
+        for (UDPSink *output : m_outputs) {
+            output->setInterleave(m_interleave);
+        }
+    }
+
+    int confFECCodec = m_srcsdr->get_fec_codec();
+
+    if (confFECCodec != m_fecCodec)
+    {
+        m_fecCodec = confFECCodec;
+
+        for (UDPSink *output : m_outputs) {
+            output->setFECCodec(m_fecCodec);
+        }
+    }
+}
@@ -19,34 +19,62 @@
 // along with this program. If not, see <http://www.gnu.org/licenses/>.          //
 ///////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
 
+#ifdef HAS_LZ4
+#include <lz4.h>
+#endif
+
 #include "SDRdaemonFECBuffer.h"
+#include "SampleConversion.h"
+#include "CRC32C.h"
+#include "Tracepoints.h"
 
-SDRdaemonFECBuffer::SDRdaemonFECBuffer()
+SDRdaemonFECBuffer::SDRdaemonFECBuffer() :
+    m_udpSize(0),
+    m_blockSize(0),
+    m_outputSlot(0),
+    m_nbDecoderSlots(2),
+    m_reorderWindow(1),
+    m_frameHead(-1),
+    m_frameTail(-1),
+    m_nbLateBlocks(0),
+    m_lateRun(0),
+    m_deadline(0),
+    m_refFrame(-1),
+    m_checkedFrame(-1),
+    m_checkedFrameOK(true),
+    m_stale(false),
+    m_nbStaleBlocks(0),
+    m_nbDuplicateBlocks(0),
+    m_nbCorruptBlocks(0),
+    m_nbOverflowBlocks(0),
+    m_nack(false),
+    m_nbNacks(0),
+    m_nackNext(0),
+    m_nbNacksSent(0),
+    m_nbBlocks(0),
+    m_nbFrames(0),
+    m_nbLostFrames(0),
+    m_nbRecoveredBlocks(0)
 {
     m_currentMeta.init();
     m_outputMeta.init();
-    m_paramsCM256.BlockBytes = sizeof(ProtectedBlock);
+    setUdpSize(SDRDAEMONFEC_UDPSIZE);
     m_paramsCM256.OriginalCount = nbOriginalBlocks;
     m_paramsCM256.RecoveryCount = -1;
-    m_decoderIndexHead = nbDecoderSlots / 2;
-    m_frameHead = -1;
     m_curNbBlocks = 0;
     m_curNbRecovery = 0;
+    m_curNbOriginalBlocks = nbOriginalBlocks;
     m_minNbBlocks = 256;
     m_maxNbRecovery = 0;
 
-    if (m_cm256.isInitialized())
-    {
-        m_cm256_OK = true;
+    if (FECCodec::get(FECCODEC_CM256)->isInitialized()) {
         std::cerr << "SDRdaemonFECBuffer::SDRdaemonFECBuffer: CM256 library initialized" << std::endl;
-    }
-    else
-    {
-        m_cm256_OK = false;
+    } else {
         std::cerr << "SDRdaemonFECBuffer::SDRdaemonFECBuffer: cannot initialize CM256 library" << std::endl;
     }
 }
@@ -66,17 +94,108 @@ void SDRdaemonFECBuffer::printMeta(MetaDataFEC *metaData)
             << ":" << (int) metaData->m_nbFECBlocks
             << "|" << metaData->m_tv_sec
             << ":" << metaData->m_tv_usec
+            << "|" << (metaData->m_udpSize == 0 ? SDRDAEMONFEC_UDPSIZE : metaData->m_udpSize)
             << "|" << std::endl;
 }
 
-void SDRdaemonFECBuffer::getSlotData(uint8_t *data, std::size_t& dataLength)
+/**
+ * Check the CRC32C ending a superblock flagged with SDRDAEMONFEC_BLOCKCRC and strip it from the length.
+ * Superblocks without the flag always pass.
+ */
+bool SDRdaemonFECBuffer::checkBlockCRC(const uint8_t *array, std::size_t& length)
+{
+    if ((length < sizeof(Header) + sizeof(uint32_t)) || !(((const Header *) array)->filler & SDRDAEMONFEC_BLOCKCRC)) {
+        return true;
+    }
+
+    uint32_t crc;
+    length -= sizeof(uint32_t);
+    memcpy(&crc, &array[length], sizeof(crc));
+    return CRC32C::calculate(array, length) == crc;
+}
+
+/**
+ * Take the block index and number of original blocks of a superblock of a large frame from its LargeTrailer and
+ * strip it from the length. False if they are out of range.
+ */
+bool SDRdaemonFECBuffer::readLargeTrailer(const uint8_t *array, std::size_t& length, int& blockIndex, int& nbFrameBlocks)
+{
+    LargeTrailer trailer;
+
+    if (length < sizeof(Header) + sizeof(LargeTrailer)) {
+        return false;
+    }
+
+    length -= sizeof(LargeTrailer);
+    memcpy(&trailer, &array[length], sizeof(trailer));
+    blockIndex = trailer.blockIndex;
+    nbFrameBlocks = trailer.nbOriginalBlocks;
+
+    return (nbFrameBlocks >= 2) && (nbFrameBlocks <= SDRDAEMONFEC_NBORIGINALBLOCKSLARGE)
+        && (blockIndex < nbFrameBlocks + SDRDAEMONFEC_NBFECBLOCKSLARGE);
+}
+
+bool SDRdaemonFECBuffer::setUdpSize(std::size_t udpSize)
+{
+    if ((udpSize < sizeof(Header) + sizeof(MetaDataFEC)) || (udpSize > SDRDAEMONFEC_UDPSIZEMAX)
+        || ((udpSize - sizeof(Header)) % sizeof(Sample) != 0))
+    {
+        return false;
+    }
+
+    m_udpSize = udpSize;
+    m_blockSize = udpSize - sizeof(Header);
+    m_paramsCM256.BlockBytes = m_blockSize;
+    m_outputSlot = 0;
+    m_decoderSlots.resize(m_nbDecoderSlots);
+
+    for (std::vector<DecoderSlot>::iterator it = m_decoderSlots.begin(); it != m_decoderSlots.end(); ++it)
+    {
+        it->m_frame.assign(nbOriginalBlocks * m_blockSize, 0);
+        it->m_recoveryBlocks.clear(); // grown by the first recovery blocks (see growRecovery)
+        it->m_nbOriginalBlocks = nbOriginalBlocks;
+        it->m_large = false;
+        it->m_blockCount = 0;
+        it->m_recoveryCount = 0;
+        it->m_decoded = false;
+        it->m_givenUp = false;
+        it->m_metaRetrieved = false;
+        memset(it->m_received, 0, sizeof(it->m_received));
+        it->m_nackCount = 0;
+    }
+
+    m_nbNacks = 0;
+    m_nackNext = 0;
+    return true;
+}
+
+void SDRdaemonFECBuffer::setReorderWindow(int nbFrames)
+{
+    if (nbFrames < 1) {
+        nbFrames = 1;
+    } else if (nbFrames > SDRDAEMONFEC_REORDERWINDOWMAX) {
+        nbFrames = SDRDAEMONFEC_REORDERWINDOWMAX;
+    }
+
+    int nbDecoderSlots = 2;
+
+    while (nbDecoderSlots < 2*nbFrames) {
+        nbDecoderSlots *= 2;
+    }
+
+    m_reorderWindow = nbFrames;
+    m_nbDecoderSlots = nbDecoderSlots;
+    setUdpSize(m_udpSize); // re-initialize all slots
+    m_frameHead = -1;
+}
+
+void SDRdaemonFECBuffer::outputSlot(DecoderSlot& slot)
 {
-    dataLength = (nbOriginalBlocks - 1) * samplesPerBlock * sizeof(Sample);
-    memcpy((void *) data, (const void *) &m_decoderSlot.m_frame.m_blocks[1], dataLength); // skip block 0
+    m_outputSlot = &slot;
 
-    if (m_decoderSlot.m_metaRetrieved)
+    if (slot.m_metaRetrieved)
     {
-        MetaDataFEC *metaData = (MetaDataFEC *) &m_decoderSlot.m_frame.m_blocks[0];
+        MetaDataFEC *metaData = (MetaDataFEC *) frameBlock(slot, 0);
 
         if (!(*metaData == m_outputMeta))
         {
@@ -84,37 +203,508 @@ void SDRdaemonFECBuffer::getSlotData(uint8_t *data, std::size_t& dataLength)
         }
     }
 
-    if (!m_decoderSlot.m_decoded)
+    m_nbFrames++;
+
+    if (!slot.m_decoded)
     {
-        std::cerr << "SDRdaemonFECBuffer::getSlotData: incomplete frame:"
-                << " m_blockCount: " << m_decoderSlot.m_blockCount
-                << " m_recoveryCount: " << m_decoderSlot.m_recoveryCount << std::endl;
+        for (int blockIndex = 0; blockIndex < slot.m_nbOriginalBlocks; blockIndex++) // the slot is not cleared between frames
+        {
+            if (!slot.received(blockIndex)) {
+                memset((void *) frameBlock(slot, blockIndex), 0, m_blockSize);
+            }
+        }
+
+        m_nbLostFrames++;
+        std::cerr << "SDRdaemonFECBuffer::outputSlot: incomplete frame:"
+                << " m_blockCount: " << slot.m_blockCount
+                << " m_recoveryCount: " << slot.m_recoveryCount << std::endl;
     }
-}
 
-void SDRdaemonFECBuffer::initDecodeSlot()
-{
-    // collect stats before voiding the slot
-    m_curNbBlocks = m_decoderSlot.m_blockCount;
-    m_curNbRecovery = m_decoderSlot.m_recoveryCount;
+    // collect stats of the output frame
+    m_curNbBlocks = slot.m_blockCount;
+    m_curNbRecovery = slot.m_recoveryCount;
+    m_curNbOriginalBlocks = slot.m_nbOriginalBlocks;
     if (m_curNbBlocks < m_minNbBlocks) m_minNbBlocks = m_curNbBlocks;
     if (m_curNbRecovery > m_maxNbRecovery) m_maxNbRecovery = m_curNbRecovery;
     m_avgNbBlocks(m_curNbBlocks);
     m_avgNbRecovery(m_curNbRecovery);
+}
+
+void SDRdaemonFECBuffer::initDecodeSlot(DecoderSlot& slot)
+{
     // void the slot
-    m_decoderSlot.m_blockCount = 0;
-    m_decoderSlot.m_recoveryCount = 0;
-    m_decoderSlot.m_decoded = false;
-    m_decoderSlot.m_metaRetrieved = false;
-    memset((void *) &m_decoderSlot.m_frame, 0, sizeof(BufferFrame0));
+    slot.m_nbOriginalBlocks = nbOriginalBlocks;
+    slot.m_large = false;
+    slot.m_blockCount = 0;
+    slot.m_recoveryCount = 0;
+    slot.m_decoded = false;
+    slot.m_givenUp = false;
+    slot.m_metaRetrieved = false;
+    memset(slot.m_received, 0, sizeof(slot.m_received));
+    slot.m_nackCount = 0;
 }
 
-bool SDRdaemonFECBuffer::writeAndRead(uint8_t *array, uint8_t *data, std::size_t& dataLength)
+/**
+ * The recovery storage of a slot is sized to the FEC blocks the frames actually carry: the number given by the
+ * meta data (up to the original blocks of the frame, the most that can be used) or, if more arrive, to the blocks
+ * received. Up to recoveryMax() of them.
+ */
+void SDRdaemonFECBuffer::growRecovery(DecoderSlot& slot, int nbRecoveryBlocks)
 {
-    bool dataAvailable = false;
+    int nbFECBlocks = std::min(metaNbFECBlocks(*slotMeta(slot)), slot.m_nbOriginalBlocks);
+    nbRecoveryBlocks = std::min(std::max(nbRecoveryBlocks, nbFECBlocks), recoveryMax(slot));
+    slot.m_recoveryBlocks.resize(nbRecoveryBlocks * m_blockSize);
+}
+
+std::size_t SDRdaemonFECBuffer::getPreallocatedBytes() const
+{
+    std::size_t bytes = m_unpacked.size() + m_decompressed.size();
+
+    for (std::vector<DecoderSlot>::const_iterator it = m_decoderSlots.begin(); it != m_decoderSlots.end(); ++it) {
+        bytes += sizeof(DecoderSlot) + it->m_frame.size() + it->m_recoveryBlocks.size();
+    }
+
+    return bytes;
+}
+
+void SDRdaemonFECBuffer::storeBlock(DecoderSlot& slot, int blockIndex, uint8_t *protectedBlock)
+{
+    slot.m_received[blockIndex >> 6] |= 1ULL << (blockIndex & 63);
+    slot.m_blockCount++;
+
+    FECCodec *codec = FECCodec::get(slotMeta(slot)->m_fecCodec);
+    bool mds = !codec || codec->isMDS();
+
+    // complete, restored or given up: the blocks arriving later are only counted. Frames of a codec that is not MDS
+    // may need more blocks than the original blocks: they are stored until the frame is restored.
+    if (slot.m_decoded || slot.m_givenUp || ((slot.m_blockCount > slot.m_nbOriginalBlocks) && mds)) {
+        return;
+    }
+
+    if (blockIndex < slot.m_nbOriginalBlocks) // data block
+    {
+        memcpy((void *) frameBlock(slot, blockIndex), (const void *) protectedBlock, m_blockSize);
+
+        if (blockIndex == 0) // first block with meta
+        {
+            slot.m_metaRetrieved = true;
+        }
+    }
+    else // redundancy block
+    {
+        if (slot.m_recoveryCount >= recoveryMax(slot)) // more than the recovery storage (malformed stream with a codec that is not MDS)
+        {
+            m_nbOverflowBlocks++;
+            return;
+        }
+
+        if ((slot.m_recoveryCount + 1) * m_blockSize > (int) slot.m_recoveryBlocks.size()) {
+            growRecovery(slot, slot.m_recoveryCount + 1);
+        }
+
+        memcpy((void *) recoveryBlock(slot, slot.m_recoveryCount), (const void *) protectedBlock, m_blockSize);
+        slot.m_recoveryIndexes[slot.m_recoveryCount] = blockIndex;
+        slot.m_recoveryCount++;
+    }
+
+    if ((blockIndex == 0) && (((MetaDataFEC *) frameBlock(slot, 0))->m_sampleBytes & SDRDAEMONFEC_SQUELCH))
+    {
+        slot.m_decoded = true; // keep-alive frame: the meta data is the whole frame
+        MetaDataFEC *metaData = (MetaDataFEC *) frameBlock(slot, 0);
+
+        if (!(*metaData == m_currentMeta))
+        {
+            m_currentMeta = *metaData;
+            printMeta(metaData);
+        }
+    }
+    else if (slot.m_blockCount >= slot.m_nbOriginalBlocks) // ready to decode
+    {
+        slot.m_decoded = true; // lossless frame (no recovery block): the original blocks are in place already
+
+        if (slot.m_recoveryCount > 0) {
+            slot.m_decoded = decodeSlot(slot);
+        }
+
+        if (slot.m_metaRetrieved) // meta data retrieved
+        {
+            MetaDataFEC *metaData = (MetaDataFEC *) frameBlock(slot, 0);
+
+            if (!(*metaData == m_currentMeta))
+            {
+                m_currentMeta = *metaData;
+                printMeta(metaData);
+            }
+        }
+    } // decode frame
+}
+
+/**
+ * Restore the lost original blocks of a frame from its recovery blocks with the codec given by its meta data (or the
+ * last meta data when its meta data block is lost). The descriptors are only set up here: the original blocks received
+ * first then the recovery blocks that the codec decodes in place.
+ */
+bool SDRdaemonFECBuffer::decodeSlot(DecoderSlot& slot)
+{
+    const MetaDataFEC *metaData = slotMeta(slot);
+    int fecCodec = metaData->m_fecCodec;
+    int nbFECBlocks = metaNbFECBlocks(*metaData);
+    FECCodec *codec = FECCodec::get(fecCodec);
+
+    if (!codec || !codec->isInitialized()) { // decoder not available
+        return false;
+    }
+
+    int nbDescriptors = 0;
+
+    for (int blockIndex = 0; blockIndex < slot.m_nbOriginalBlocks; blockIndex++)
+    {
+        if (slot.received(blockIndex))
+        {
+            m_cm256DescriptorBlocks[nbDescriptors].Block = (void *) frameBlock(slot, blockIndex);
+            m_cm256DescriptorBlocks[nbDescriptors].Index = blockIndex;
+            nbDescriptors++;
+        }
+    }
+
+    for (int ir = 0; ir < slot.m_recoveryCount; ir++)
+    {
+        m_cm256DescriptorBlocks[nbDescriptors + ir].Block = (void *) recoveryBlock(slot, ir);
+        m_cm256DescriptorBlocks[nbDescriptors + ir].Index = slot.m_recoveryIndexes[ir];
+    }
+
+    m_paramsCM256.OriginalCount = slot.m_nbOriginalBlocks;
+    m_paramsCM256.RecoveryCount = codec->isMDS() ? slot.m_recoveryCount : nbFECBlocks; // the parity classes depend on the FEC blocks sent
+    SDMN_TRACE2(fec_decode_begin, slot.m_nbOriginalBlocks, slot.m_recoveryCount);
+
+    if (codec->decode(m_paramsCM256, m_cm256DescriptorBlocks, nbDescriptors + slot.m_recoveryCount)) // failure to decode
+    {
+        SDMN_TRACE2(fec_decode_end, slot.m_recoveryCount, 0);
+
+        if (codec->isMDS()) { // a codec that is not MDS is tried again with the next blocks
+            std::cerr << "SDRdaemonFECBuffer::writeAndRead: " << codec->getName() << " decode error" << std::endl;
+        }
+
+        return false;
+    }
+
+    SDMN_TRACE2(fec_decode_end, slot.m_recoveryCount, 1);
+
+    // without its meta data block the number of FEC blocks of the frame was taken from the previous frame: a parity
+    // decoded with a wrong number restores garbage, seen in the restored meta data
+    for (int ir = 0; !codec->isMDS() && !slot.m_metaRetrieved && (ir < slot.m_recoveryCount); ir++)
+    {
+        const FECBlock& recovered = m_cm256DescriptorBlocks[nbDescriptors + ir];
+        const MetaDataFEC *restoredMeta = (const MetaDataFEC *) recovered.Block;
+
+        if ((recovered.Index == 0) && ((restoredMeta->m_fecCodec != fecCodec) || (metaNbFECBlocks(*restoredMeta) != nbFECBlocks)))
+        {
+            std::cerr << "SDRdaemonFECBuffer::writeAndRead: " << codec->getName() << " decode error: FEC blocks changed" << std::endl;
+            slot.m_givenUp = true;
+            return false;
+        }
+    }
+
+    int nbRecovered = 0;
+
+    for (int ir = 0; ir < slot.m_recoveryCount; ir++) // recover lost blocks: the decoder gives their index in the recovery descriptors
+    {
+        const FECBlock& recovered = m_cm256DescriptorBlocks[nbDescriptors + ir];
+
+        if (recovered.Index < slot.m_nbOriginalBlocks) // recovery blocks not used keep their index
+        {
+            memcpy((void *) frameBlock(slot, recovered.Index), (const void *) recovered.Block, m_blockSize);
+            nbRecovered++;
+        }
+    }
+
+    m_nbRecoveredBlocks += nbRecovered;
+    std::cerr << "SDRdaemonFECBuffer::writeAndRead: " << codec->getName() << " decode success:"
+            << " nb recovery blocks: " << nbRecovered << std::endl;
+
+    return true;
+}
+
+std::size_t SDRdaemonFECBuffer::getFrameNbSamples()
+{
+    if (!m_outputSlot) {
+        return 0;
+    }
+
+    const MetaDataFEC *metaData = slotMeta(*m_outputSlot);
+    int sampleBytes = wireSampleBytes(metaData->m_sampleBytes);
+    int frameBlocks = m_outputSlot->m_nbOriginalBlocks;
+
+    if (metaData->m_sampleBytes & SDRDAEMONFEC_SQUELCH) // as many samples of silence as the keep-alive frame stands for
+    {
+        bool valid = m_outputSlot->m_metaRetrieved && (metaData->m_squelchSamples <= (uint32_t) (frameBlocks - 1) * (m_blockSize / 2));
+        return valid ? metaData->m_squelchSamples : 0;
+    }
+    else if (metaData->m_sampleBytes & SDRDAEMONFEC_LZ4) // the length is only known from the meta data of the frame
+    {
+        bool valid = m_outputSlot->m_metaRetrieved && (metaData->m_frameBytes <= (uint32_t) SDRDAEMONFEC_LZ4RATIO * (frameBlocks - 1) * m_blockSize);
+        return valid ? metaData->m_frameBytes / sampleBytes : 0;
+    }
+    else
+    {
+        return (frameBlocks - 1) * (m_blockSize / sampleBytes);
+    }
+}
+
+void SDRdaemonFECBuffer::getFrameSamples(Sample *samples)
+{
+    if (!m_outputSlot) {
+        return;
+    }
+
+    const MetaDataFEC *metaData = slotMeta(*m_outputSlot);
+    int sampleBytes = wireSampleBytes(metaData->m_sampleBytes);
+    int frameBlocks = m_outputSlot->m_nbOriginalBlocks;
+
+    if (metaData->m_sampleBytes & SDRDAEMONFEC_SQUELCH)
+    {
+        memset((void *) samples, 0, getFrameNbSamples() * sizeof(Sample));
+        return;
+    }
+
+    if (metaData->m_sampleBytes & SDRDAEMONFEC_LZ4)
+    {
+        int nbSamples = getFrameNbSamples();
+
+        if (nbSamples == 0) {
+            return; // no meta data
+        }
+#ifdef HAS_LZ4
+        m_decompressed.resize(metaData->m_frameBytes);
+        int frameBytes = LZ4_decompress_safe((const char *) frameBlock(*m_outputSlot, 1), (char *) &m_decompressed[0],
+                std::min((int) metaData->m_compressedBytes, (frameBlocks - 1) * m_blockSize), metaData->m_frameBytes);
+
+        if (frameBytes != (int) metaData->m_frameBytes)
+        {
+            std::cerr << "SDRdaemonFECBuffer::getFrameSamples: LZ4 decompression error" << std::endl;
+            memset((void *) samples, 0, nbSamples * sizeof(Sample));
+            return;
+        }
+
+        widenSamples(&m_decompressed[0], samples, nbSamples, sampleBytes);
+#else
+        std::cerr << "SDRdaemonFECBuffer::getFrameSamples: compressed frame: not built with LZ4" << std::endl;
+        memset((void *) samples, 0, nbSamples * sizeof(Sample));
+#endif
+        return;
+    }
+
+    if (sampleBytes == sizeof(Sample))
+    {
+        memcpy((void *) samples, (const void *) frameBlock(*m_outputSlot, 1), (frameBlocks - 1) * m_blockSize);
+        return;
+    }
+
+    int nbSamples = m_blockSize / sampleBytes; // the bytes left at the end of each block are padding
+
+    for (int blockIndex = 1; blockIndex < frameBlocks; blockIndex++) {
+        widenSamples(frameBlock(*m_outputSlot, blockIndex), &samples[(blockIndex - 1) * nbSamples], nbSamples, sampleBytes);
+    }
+}
+
+/** Samples of the network format to 2x16 bits I/Q */
+void SDRdaemonFECBuffer::widenSamples(const uint8_t *data, Sample *samples, int nbSamples, int sampleBytes)
+{
+    switch (sampleBytes)
+    {
+    case 2:
+        SampleConversion::unpack8((const int8_t *) data, (IQSample *) samples, 2 * nbSamples);
+        break;
+    case 3:
+        SampleConversion::unpack12(data, (IQSample *) samples, nbSamples);
+        break;
+    default:
+        memcpy((void *) samples, (const void *) data, nbSamples * sizeof(Sample));
+    }
+}
+
+const uint8_t *SDRdaemonFECBuffer::unpackFrame(std::size_t& dataLength)
+{
+    dataLength = getFrameNbSamples() * sizeof(Sample);
+
+    if (dataLength == 0) {
+        return 0;
+    }
+
+    m_unpacked.resize(dataLength);
+    getFrameSamples((Sample *) &m_unpacked[0]);
+    return &m_unpacked[0];
+}
+
+bool SDRdaemonFECBuffer::writeAndRead(uint8_t *array, std::size_t length, uint8_t *data, std::size_t& dataLength)
+{
+    if (write(array, length))
+    {
+        dataLength = getFrameNbSamples() * sizeof(Sample);
+        getFrameSamples((Sample *) data);
+        return true;
+    }
+
     dataLength = 0;
-    SuperBlock *superBlock = (SuperBlock *) array;
-    int frameIndex = superBlock->header.frameIndex;
+    return false;
+}
+
+/**
+ * Tell if a block of the frame is still in time. Sets resync if the decoder should restart on this block:
+ * after a silence longer than the deadline or when the blocks have been stale for longer than the deadline.
+ */
+bool SDRdaemonFECBuffer::checkDeadline(int frameIndex, bool& resync)
+{
+    clock::time_point now = clock::now();
+    resync = (m_lastBlockTime != clock::time_point()) && (now - m_lastBlockTime > m_deadline);
+
+    if (frameIndex != m_checkedFrame) // first block of another frame: predict its arrival
+    {
+        m_checkedFrame = frameIndex;
+        m_checkedFrameOK = true;
+
+        // frame duration known from the meta data. Compressed and keep-alive frames carry a variable number of samples.
+        if ((m_currentMeta.m_sampleRate > 0) && !(m_currentMeta.m_sampleBytes & (SDRDAEMONFEC_LZ4 | SDRDAEMONFEC_SQUELCH)))
+        {
+            // transported as 2x16 bits I/Q whatever the device, 2x12 bits when packed or 2x8 bits
+            long long frameSamples = (metaNbOriginalBlocks(m_currentMeta) - 1) * (m_blockSize / wireSampleBytes(m_currentMeta.m_sampleBytes));
+            clock::duration framePeriod = std::chrono::microseconds((frameSamples * 1000000LL) / m_currentMeta.m_sampleRate);
+
+            if (m_refFrame < 0)
+            {
+                m_refFrame = frameIndex;
+                m_refTime = now;
+            }
+
+            int frameDelta = (int16_t) (frameIndex - m_refFrame);
+            clock::time_point expected = m_refTime + frameDelta * framePeriod;
+
+            if (now - expected > m_deadline) // stale
+            {
+                if (!m_stale)
+                {
+                    m_stale = true;
+                    m_staleSince = now;
+                }
+
+                if (now - m_staleSince > m_deadline) // late for too long: the prediction is wrong
+                {
+                    std::cerr << "SDRdaemonFECBuffer::checkDeadline: stale blocks for too long: restart timing on frame " << frameIndex << std::endl;
+                    m_refFrame = frameIndex;
+                    m_refTime = now;
+                    m_stale = false;
+                    resync = true;
+                }
+                else
+                {
+                    m_checkedFrameOK = false;
+                }
+            }
+            else
+            {
+                m_stale = false;
+
+                if (frameDelta > 0) // follow the frames: early arrivals move the reference earlier, late ones slowly later (drift)
+                {
+                    clock::duration creep = std::min(now - expected, clock::duration(std::chrono::microseconds(SDRDAEMONFEC_DEADLINECREEP)));
+                    m_refFrame = frameIndex;
+                    m_refTime = expected + creep;
+                }
+            }
+        }
+    }
+
+    if (m_checkedFrameOK) {
+        m_lastBlockTime = now;
+    } else {
+        resync = false;
+    }
+
+    return m_checkedFrameOK;
+}
+
+/**
+ * A block of the new frame frameIndex arrived: the sender is done with the previous frames. Queue a
+ * retransmission request for those that cannot be restored yet.
+ */
+void SDRdaemonFECBuffer::queueNacks(int frameIndex)
+{
+    for (int f = m_frameHead; (int16_t) (frameIndex - f) > 0; f = (f + 1) & 0xFFFF)
+    {
+        DecoderSlot& slot = decoderSlot(f);
+
+        if (slot.m_decoded || (slot.m_nackCount >= SDRDAEMONFEC_NACKRETRIES) || (m_nbNacks == nbDecoderSlots)) {
+            continue;
+        }
+
+        slot.m_nackCount++;
+        m_nackFrames[m_nbNacks++] = f;
+    }
+}
+
+bool SDRdaemonFECBuffer::getNack(FECNack& nack)
+{
+    while (m_nackNext < m_nbNacks)
+    {
+        int frameIndex = m_nackFrames[m_nackNext++];
+        DecoderSlot& slot = decoderSlot(frameIndex);
+
+        if (((int16_t) (frameIndex - m_frameHead) < 0) || slot.m_decoded) {
+            continue; // output or completed meanwhile
+        }
+
+        nack.init(frameIndex);
+        nack.m_nbBlocks = slot.m_blockCount;
+        memcpy(nack.m_received, slot.m_received, sizeof(nack.m_received));
+        m_nbNacksSent++;
+        return true;
+    }
+
+    m_nbNacks = 0;
+    m_nackNext = 0;
+    return false;
+}
+
+bool SDRdaemonFECBuffer::write(uint8_t *array, std::size_t length)
+{
+    bool dataAvailable = false;
+
+    if (m_outputSlot) // the previous frame has been read: its slot can be reused
+    {
+        initDecodeSlot(*m_outputSlot);
+        m_outputSlot = 0;
+    }
+
+    Header *header = (Header *) array;
+    uint8_t *protectedBlock = array + sizeof(Header);
+    int frameIndex = header->frameIndex;
+    int blockIndex = header->blockIndex;
+    int nbFrameBlocks = headerNbOriginalBlocks(header);
+    bool large = (header->filler >> SDRDAEMONFEC_BLOCKSSHIFT) == SDRDAEMONFEC_LARGEFRAME;
+    m_nbBlocks++;
+
+    if (!checkBlockCRC(array, length)) // dropped: FEC restores it as a lost block
+    {
+        m_nbCorruptBlocks++;
+        return false;
+    }
+
+    if (large && !readLargeTrailer(array, length, blockIndex, nbFrameBlocks))
+    {
+        m_nbCorruptBlocks++;
+        return false;
+    }
+
+    if ((int) length != m_udpSize) // the sender changed the datagram size: restart on the current frame
+    {
+        if (!setUdpSize(length)) {
+            return false; // not a SuperBlock
+        }
+
+        std::cerr << "SDRdaemonFECBuffer::writeAndRead: UDP datagram size: " << length << std::endl;
+        m_frameHead = frameIndex;
+        m_frameTail = frameIndex;
+    }
 
 //    std::cerr << "SDRdaemonFECBuffer::writeAndRead:"
 //            << " frameIndex: " << frameIndex
@@ -130,121 +720,112 @@ bool SDRdaemonFECBuffer::writeAndRead(uint8_t *array, uint8_t *data, std::size_t
 //
 //    std::cerr << std::endl;
 
-    if ( m_frameHead != frameIndex)
+    if (m_frameHead < 0) // first block
     {
-        getSlotData(data, dataLength); // copy slot data to output buffer
-        dataAvailable = true;
-        initDecodeSlot(); // re-initialize slot
         m_frameHead = frameIndex;
+        m_frameTail = frameIndex;
     }
 
-    // decoderIndex should now be correctly set
+    bool resync = false;
 
-    if (m_decoderSlot.m_blockCount < nbOriginalBlocks) // not enough blocks to decode -> store data
+    if ((m_deadline.count() > 0) && !checkDeadline(frameIndex, resync)) // past its play-out time: no copy nor decoding
     {
-        int blockCount = m_decoderSlot.m_blockCount;
-        int recoveryCount = m_decoderSlot.m_recoveryCount;
-        int blockIndex = superBlock->header.blockIndex;
-        m_decoderSlot.m_cm256DescriptorBlocks[blockCount].Index = blockIndex;
+        m_nbStaleBlocks++;
+        return false;
+    }
 
-        if (blockIndex == 0) // first block with meta
+    int frameDelta = (int16_t) (frameIndex - m_frameHead); // frame index wraps around at 65536
+
+    if (resync) {
+        m_lateRun = nbOriginalBlocks; // forces the restart below
+    }
+
+    if ((frameDelta < 0) && (m_lateRun < nbOriginalBlocks)) // block of a frame already output
+    {
+        m_nbLateBlocks++;
+        m_lateRun++;
+        return false;
+    }
+
+    m_lateRun = 0;
+
+    if (resync || (frameDelta < 0) || (frameDelta >= m_nbDecoderSlots)) // sender restarted (only late blocks for a whole frame) or whole frames lost: resync on this frame
+    {
+        DecoderSlot& headSlot = decoderSlot(m_frameHead);
+
+        if (headSlot.m_blockCount > 0)
         {
-            m_decoderSlot.m_metaRetrieved = true;
+            outputSlot(headSlot);
+            dataAvailable = true;
         }
 
-        if (blockIndex < nbOriginalBlocks) // data block
+        for (std::vector<DecoderSlot>::iterator it = m_decoderSlots.begin(); it != m_decoderSlots.end(); ++it)
         {
-            m_decoderSlot.m_frame.m_blocks[blockIndex] = superBlock->protectedBlock;
-            m_decoderSlot.m_cm256DescriptorBlocks[blockCount].Block = (void *) &m_decoderSlot.m_frame.m_blocks[blockIndex];
+            if ((&(*it) != m_outputSlot) && (it->m_blockCount > 0)) {
+                initDecodeSlot(*it);
+            }
+
+            it->m_nackCount = 0;
         }
-        else // redundancy block
-        {
-            m_decoderSlot.m_recoveryBlocks[recoveryCount] = superBlock->protectedBlock;
-            m_decoderSlot.m_cm256DescriptorBlocks[blockCount].Block = (void *) &m_decoderSlot.m_recoveryBlocks[recoveryCount];
-            m_decoderSlot.m_recoveryCount++;
+
+        m_nbNacks = 0;
+        m_nackNext = 0;
+
+        m_frameHead = frameIndex;
+        m_frameTail = frameIndex;
+
+        if (m_outputSlot == &decoderSlot(frameIndex)) {
+            return dataAvailable; // the block would overwrite the frame being output: only this first block is lost
+        }
+    }
+    else if ((int16_t) (frameIndex - m_frameTail) > 0)
+    {
+        if (m_nack && !large) { // the requests only map the blocks of frames up to 256 blocks
+            queueNacks(frameIndex);
         }
+
+        m_frameTail = frameIndex;
     }
 
-    m_decoderSlot.m_blockCount++;
+    DecoderSlot& slot = decoderSlot(frameIndex);
 
-    if (m_decoderSlot.m_blockCount == nbOriginalBlocks) // ready to decode
+    if (slot.m_blockCount == 0)
     {
-        m_decoderSlot.m_decoded = true;
+        slot.m_nbOriginalBlocks = nbFrameBlocks;
+        slot.m_large = large;
 
-        if (m_cm256_OK && (m_decoderSlot.m_recoveryCount > 0)) // recovery data used and CM256 decoder available
-        {
-            m_paramsCM256.RecoveryCount = m_decoderSlot.m_recoveryCount;
-//            // debug print
-//            for (int ir = 0; ir < m_decoderSlots[decoderIndex].m_recoveryCount; ir++) // recovery blocks
-//            {
-//                int blockIndex = m_decoderSlots[decoderIndex].m_cm256DescriptorBlocks[nbRxOriginalBlocks+ir].Index;
-//                ProtectedBlock *recoveryBlock = (ProtectedBlock *) m_decoderSlots[decoderIndex].m_cm256DescriptorBlocks[nbRxOriginalBlocks+ir].Block;
-//
-//                std::cerr << "SDRdaemonFECBuffer::writeAndRead:"
-//                        << " recovery block #" << blockIndex
-//                        << " i.q: ";
-//
-//                for (int i = 0; i < 10; i++)
-//                {
-//                    std::cerr << " " << recoveryBlock->samples[i].i
-//                            << "." << recoveryBlock->samples[i].q;
-//                }
-//
-//                std::cerr << std::endl;
-//            }
-//            // end debug print
+        if (slot.m_frame.size() < (std::size_t) nbFrameBlocks * m_blockSize) { // large frame
+            slot.m_frame.resize(nbFrameBlocks * m_blockSize);
+        }
+    }
 
-            if (m_cm256.cm256_decode(m_paramsCM256, m_decoderSlot.m_cm256DescriptorBlocks)) // failure to decode
-            {
-                std::cerr << "SDRdaemonFECBuffer::writeAndRead: CM256 decode error" << std::endl;
-            }
-            else // success to decode
-            {
-                //int nbRxOriginalBlocks = nbOriginalBlocks - m_decoderSlot.m_recoveryCount;
+    if (slot.received(blockIndex)) // resent block that was not lost after all or network duplicate
+    {
+        m_nbDuplicateBlocks++;
+        return dataAvailable;
+    }
 
-                std::cerr << "SDRdaemonFECBuffer::writeAndRead: CM256 decode success:"
-                        << " nb recovery blocks: " << m_decoderSlot.m_recoveryCount << std::endl;
+    storeBlock(slot, blockIndex, protectedBlock);
 
-                for (int ir = 0; ir < m_decoderSlot.m_recoveryCount; ir++) // recover lost blocks
-                {
-                    int recoveryIndex = nbOriginalBlocks - m_decoderSlot.m_recoveryCount + ir;
-                    int blockIndex = m_decoderSlot.m_cm256DescriptorBlocks[recoveryIndex].Index;
-                    ProtectedBlock *recoveredBlock = (ProtectedBlock *) m_decoderSlot.m_cm256DescriptorBlocks[recoveryIndex].Block;
-                    m_decoderSlot.m_frame.m_blocks[blockIndex] =  *recoveredBlock;
-
-//                    if (blockIndex == 0)
-//                    {
-//                        m_decoderSlots[decoderIndex].m_metaRetrieved = true;
-//                    }
-
-                    // debug print
-//                    std::cerr << "SDRdaemonFECBuffer::writeAndRead:"
-//                            << " recovered block #" << blockIndex
-//                            << " i.q: ";
-//
-//                    for (int i = 0; i < 10; i++)
-//                    {
-//                        std::cerr << " " << recoveredBlock->samples[i].i
-//                                << "." << recoveredBlock->samples[i].q;
-//                    }
-//
-//                    std::cerr << std::endl;
-                    // end debug print
-                } // recover
-            } // success to decode
-        } // recovery data used
+    // output the oldest frame once a block of the frame a reordering window ahead has arrived.
+    // Frames of which no block was received at all are skipped. At most one frame is output
+    // per call: the next frames if any are due are output with the next blocks.
+    while (!dataAvailable && ((int16_t) (m_frameTail - m_frameHead) >= m_reorderWindow))
+    {
+        DecoderSlot& headSlot = decoderSlot(m_frameHead);
 
-        if (m_decoderSlot.m_metaRetrieved) // meta data retrieved
+        if (headSlot.m_blockCount > 0)
         {
-            MetaDataFEC *metaData = (MetaDataFEC *) &m_decoderSlot.m_frame.m_blocks[0];
-
-            if (!(*metaData == m_currentMeta))
-            {
-                m_currentMeta = *metaData;
-                printMeta(metaData);
-            }
+            outputSlot(headSlot); // slot is re-initialized on next write
+            dataAvailable = true;
         }
-    } // decode frame
+        else
+        {
+            headSlot.m_nackCount = 0; // frame entirely lost: the slot is not re-initialized
+        }
+
+        m_frameHead = (m_frameHead + 1) & 0xFFFF;
+    }
 
     return dataAvailable;
 }
@@ -0,0 +1,78 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <sys/time.h>
+#include <algorithm>
+
+#include "SHMSink.h"
+
+SHMSink::SHMSink(const std::string& name, unsigned int nbSlots, UDPSink *udpSink) :
+        UDPSink(name),
+        m_udpSink(udpSink),
+        m_nbFrames(0)
+{
+    if (!m_ring.create(name, nbSlots, SHAREDRING_SLOTSAMPLES)) {
+        m_error = m_ring.error();
+    }
+}
+
+SHMSink::~SHMSink()
+{
+}
+
+std::size_t SHMSink::getSharedBytes() const
+{
+    return m_ring.getNbSlots() * (std::size_t) (m_ring.getSlotSamples() * sizeof(IQSample));
+}
+
+void SHMSink::write(const IQSampleVector& samples_in)
+{
+    if (m_ring)
+    {
+        SharedRing::FrameMeta meta;
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+
+        meta.m_centerFrequency = m_centerFrequency;
+        meta.m_sampleRate = m_sampleRate;
+        meta.m_sampleBytes = (m_sampleBytes & 0xF0) + sizeof(int16_t); // I/Q are always given at the 16 bits scale
+        meta.m_sampleBits = m_sampleBits;
+        meta.m_filler = 0;
+        meta.m_tv_sec = tv.tv_sec;
+        meta.m_tv_usec = tv.tv_usec;
+
+        for (std::size_t i = 0; i < samples_in.size(); i += m_ring.getSlotSamples())
+        {
+            unsigned int nbSamples = std::min<std::size_t>(samples_in.size() - i, m_ring.getSlotSamples());
+            meta.m_nbSamples = nbSamples;
+            m_ring.write(meta, &samples_in[i], nbSamples);
+            m_nbFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (m_udpSink)
+    {
+        m_udpSink->setCenterFrequency(m_centerFrequency * 1000ULL);
+        m_udpSink->setSampleRate(m_sampleRate);
+        m_udpSink->setSampleBytes(m_sampleBytes);
+        m_udpSink->setSampleBits(m_sampleBits);
+        m_udpSink->setSampleStamp(m_sampleStamp);
+        m_udpSink->write(samples_in);
+    }
+}
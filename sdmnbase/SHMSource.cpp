@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+
+#include "SHMSource.h"
+
+#define SHMSOURCE_WAIT      100 //!< milliseconds waited for a frame in read()
+#define SHMSOURCE_REATTACH  10  //!< waits without a frame before the ring is checked (producer gone or restarted)
+
+SHMSource::SHMSource(const std::string& name) :
+    UDPSource(name, 0, 0),
+    m_name(name),
+    m_nbTimeouts(0),
+    m_ringLostFrames(0),
+    m_reportedLostFrames(0),
+    m_nbFrames(0),
+    m_nbLostFrames(0)
+{
+    if (!attach()) {
+        std::cerr << "SHMSource::SHMSource: " << m_ring.error() << ": waiting for the producer" << std::endl;
+    }
+}
+
+SHMSource::~SHMSource()
+{
+}
+
+bool SHMSource::attach()
+{
+    m_ringLostFrames += m_ring ? m_ring.getNbLostFrames() : 0;
+    return m_ring.attach(m_name);
+}
+
+void SHMSource::read(IQSampleVector& samples_out)
+{
+    samples_out.clear();
+
+    if (!m_ring || !m_ring.wait(SHMSOURCE_WAIT))
+    {
+        if (++m_nbTimeouts >= SHMSOURCE_REATTACH)
+        {
+            m_nbTimeouts = 0;
+
+            if ((!m_ring || m_ring.stale()) && attach()) {
+                std::cerr << "SHMSource::read: attached to " << m_ring.getName() << std::endl;
+            }
+        }
+
+        if (!m_ring) {
+            usleep(SHMSOURCE_WAIT * 1000);
+        }
+
+        return;
+    }
+
+    m_nbTimeouts = 0;
+    SharedRing::FrameMeta meta;
+    const void *samples;
+
+    while (m_ring.peek(meta, samples))
+    {
+        // the meta data may be torn as well until check() so the size is bounded by the slot
+        samples_out.resize(std::min(meta.m_nbSamples, m_ring.getSlotSamples()));
+        std::copy((const IQSample *) samples, (const IQSample *) samples + samples_out.size(), samples_out.begin());
+        bool good = m_ring.check();
+        m_ring.release();
+        m_nbLostFrames.store(m_ringLostFrames + m_ring.getNbLostFrames(), std::memory_order_relaxed);
+
+        if (good)
+        {
+            m_sampleBytes = meta.m_sampleBytes & 0x0F;
+            m_sampleBits = meta.m_sampleBits;
+            m_sampleRate.store(meta.m_sampleRate);
+            m_nbFrames.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        m_nbLostFrames.fetch_add(1, std::memory_order_relaxed); // overwritten while being copied
+        m_ringLostFrames++;
+    }
+
+    samples_out.clear();
+}
+
+void SHMSource::getStatusMessage(char *messageBuffer)
+{
+    // no blocks through the ring: status 2 (all OK) unless frames were lost since the last message
+    int msgLen = strlen(messageBuffer);
+    uint64_t lostFrames = getNbLostFrames();
+    int statusCode = lostFrames == m_reportedLostFrames ? 2 : 1;
+    m_reportedLostFrames = lostFrames;
+    sprintf(&messageBuffer[msgLen], ":%d:000/000", statusCode);
+}
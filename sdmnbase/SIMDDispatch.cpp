@@ -0,0 +1,55 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include "SIMDDispatch.h"
+
+const SIMDDispatch::level_t SIMDDispatch::m_level = SIMDDispatch::detect();
+
+SIMDDispatch::level_t SIMDDispatch::detect()
+{
+#if defined(SIMD_X86_DISPATCH)
+    __builtin_cpu_init(); // may run before the libgcc constructor
+
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMDAVX2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        return SIMDSSE4_1;
+    } else {
+        return SIMDScalar;
+    }
+#elif defined(USE_NEON)
+    return SIMDNEON;
+#else
+    return SIMDScalar;
+#endif
+}
+
+const char *SIMDDispatch::name()
+{
+    switch (m_level)
+    {
+    case SIMDAVX2:
+        return "AVX2";
+    case SIMDSSE4_1:
+        return "SSE4.1";
+    case SIMDNEON:
+        return "NEON";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "ScanScheduler.h"
+
+ScanScheduler::ScanScheduler() :
+    m_active(false),
+    m_hopIndex(0),
+    m_started(false),
+    m_sampleIndex(0),
+    m_hopSamples(0),
+    m_settleSamples(0),
+    m_hopCount(0)
+{
+}
+
+bool ScanScheduler::configure(const std::string& hops)
+{
+    std::vector<Hop> hopList;
+
+    if ((hops != "off") && (hops != "0"))
+    {
+        std::istringstream is(hops);
+        std::string item;
+
+        while (std::getline(is, item, '/'))
+        {
+            std::istringstream fields(item);
+            std::string frequency, dwell, settle;
+            Hop hop;
+            hop.settleMs = 0;
+
+            std::getline(fields, frequency, ':');
+            std::getline(fields, dwell, ':');
+
+            if (!parseFrequency(frequency, hop.frequency) || !parseMs(dwell, hop.dwellMs) || (hop.dwellMs == 0)
+                || (std::getline(fields, settle, ':') && (!parseMs(settle, hop.settleMs) || (hop.settleMs >= hop.dwellMs)))
+                || std::getline(fields, settle))
+            {
+                m_error = "Invalid scan hop " + item + " (freq:dwell[:settle] with settle less than dwell)";
+                return false;
+            }
+
+            hopList.push_back(hop);
+        }
+
+        if (hopList.empty() || (hopList.size() > SCANSCHEDULER_NBHOPSMAX))
+        {
+            m_error = "Invalid number of scan hops";
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hops = hopList;
+    m_hopIndex = 0;
+    m_started = false;
+    m_hopSamples = 0;
+    m_active.store(!m_hops.empty());
+
+    std::cerr << "ScanScheduler::configure: " << m_hops.size() << " hops" << std::endl;
+    return true;
+}
+
+bool ScanScheduler::advance(std::size_t nbSamples, uint32_t sampleRate, uint64_t& frequency)
+{
+    if (!m_active.load(std::memory_order_relaxed))
+    {
+        m_sampleIndex += nbSamples; // only the reader thread writes it
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sampleIndex += nbSamples;
+
+    if (m_hops.empty()) {
+        return false;
+    }
+
+    if (m_started)
+    {
+        m_hopSamples += nbSamples;
+
+        if ((m_hopSamples < (uint64_t) sampleRate * m_hops[m_hopIndex].dwellMs / 1000) || (m_hops.size() == 1)) {
+            return false;
+        }
+
+        m_hopIndex = (m_hopIndex + 1) % m_hops.size();
+    }
+
+    m_started = true;
+    m_hopSamples = 0;
+    m_settleSamples = (uint64_t) sampleRate * m_hops[m_hopIndex].settleMs / 1000;
+    frequency = m_hops[m_hopIndex].frequency;
+    return true;
+}
+
+void ScanScheduler::retuned()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Retune retune;
+
+    m_hopCount++;
+    retune.sampleIndex = m_sampleIndex;
+    retune.frequency = m_hops[m_hopIndex].frequency;
+    retune.settleSamples = m_settleSamples;
+    retune.hopCount = m_hopCount;
+    m_retunes.push_back(retune);
+
+    if (m_retunes.size() > SCANSCHEDULER_NBRETUNESMAX) { // main loop not taking them
+        m_retunes.pop_front();
+    }
+}
+
+bool ScanScheduler::getRetune(uint64_t endIndex, Retune& retune)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_retunes.empty() || (m_retunes.front().sampleIndex >= endIndex)) {
+        return false;
+    }
+
+    retune = m_retunes.front();
+    m_retunes.pop_front();
+    return true;
+}
+
+bool ScanScheduler::parseFrequency(const std::string& s, uint64_t& frequency)
+{
+    char *endp;
+    double f = strtod(s.c_str(), &endp);
+
+    if (endp == s.c_str()) {
+        return false;
+    }
+
+    if (*endp == 'k') {
+        f *= 1e3;
+        endp++;
+    } else if (*endp == 'M') {
+        f *= 1e6;
+        endp++;
+    }
+
+    if ((*endp != '\0') || (f < 1e3) || (f > 1e10)) {
+        return false;
+    }
+
+    frequency = (uint64_t) f;
+    return true;
+}
+
+bool ScanScheduler::parseMs(const std::string& s, uint32_t& ms)
+{
+    char *endp;
+    long t = strtol(s.c_str(), &endp, 10);
+
+    if ((endp == s.c_str()) || (*endp != '\0') || (t < 0) || (t > 3600000)) {
+        return false;
+    }
+
+    ms = t;
+    return true;
+}
@@ -0,0 +1,133 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cmath>
+
+#include "Squelch.h"
+
+#if defined(SIMD_X86_DISPATCH)
+#include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
+#endif
+
+Squelch::Squelch() :
+    m_threshold(0.0),
+    m_hangoverMs(0),
+    m_idleSamples(0),
+    m_open(true)
+{
+}
+
+void Squelch::configure(float thresholdDb, unsigned int hangoverMs)
+{
+    // 0 dB is a complex tone of 32768 amplitude
+    m_threshold = thresholdDb < 0.0f ? 1073741824.0 * pow(10.0, thresholdDb / 10.0) : 0.0;
+    m_hangoverMs = hangoverMs;
+    m_idleSamples = 0;
+    m_open = true;
+}
+
+bool Squelch::process(const IQSample *samples, unsigned int n, uint32_t sampleRate)
+{
+    if (!active() || (n == 0)) {
+        return m_open;
+    }
+
+    if ((double) energy(samples, n) >= m_threshold * n)
+    {
+        m_idleSamples = 0;
+        m_open = true;
+    }
+    else if (m_open)
+    {
+        m_idleSamples += n;
+        m_open = m_idleSamples * 1000 < (uint64_t) m_hangoverMs * sampleRate;
+    }
+
+    return m_open;
+}
+
+uint64_t Squelch::energy(const IQSample *samples, unsigned int n)
+{
+    const int16_t *x = (const int16_t *) samples;
+    uint64_t sum = 0;
+    unsigned int i = 0;
+#if defined(SIMD_X86_DISPATCH)
+    if (SIMDDispatch::level() == SIMDDispatch::SIMDAVX2) {
+        i = energyAVX2(samples, n, sum);
+    }
+#endif
+#if defined(SIMD_X86_DISPATCH) && defined(__SSE2__)
+    // I^2 + Q^2 is at most 2^31: unsigned 32 bits widened to 64 bit accumulators
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) &x[2*i]);
+        __m128i p = _mm_madd_epi16(v, v);
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, zero));
+    }
+
+    uint64_t a[2];
+    _mm_storeu_si128((__m128i*) a, acc);
+    sum += a[0] + a[1];
+#elif defined(USE_NEON)
+    uint64x2_t acc = vdupq_n_u64(0);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        int16x4x2_t v = vld2_s16(&x[2*i]);
+        int32x4_t p = vmlal_s16(vmull_s16(v.val[0], v.val[0]), v.val[1], v.val[1]);
+        acc = vpadalq_u32(acc, vreinterpretq_u32_s32(p));
+    }
+
+    sum += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+    for (; i < n; i++) {
+        sum += (uint32_t) (x[2*i] * x[2*i]) + (uint32_t) (x[2*i+1] * x[2*i+1]);
+    }
+
+    return sum;
+}
+
+#if defined(SIMD_X86_DISPATCH)
+SIMD_TARGET("avx2")
+unsigned int Squelch::energyAVX2(const IQSample *samples, unsigned int n, uint64_t& sum)
+{
+    const int16_t *x = (const int16_t *) samples;
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    unsigned int i = 0;
+
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*) &x[2*i]);
+        __m256i p = _mm256_madd_epi16(v, v);
+        acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(p, zero));
+        acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(p, zero));
+    }
+
+    uint64_t a[4];
+    _mm256_storeu_si256((__m256i*) a, acc);
+    sum += a[0] + a[1] + a[2] + a[3];
+    return i;
+}
+#endif
@@ -17,6 +17,7 @@
 ///////////////////////////////////////////////////////////////////////////////////
 
 #include <climits>
+#include <cmath>
 #include <cstring>
 #include <iostream>
 #include <iomanip>
@@ -25,10 +26,10 @@
 #include <unistd.h>
 
 #include "TestSource.h"
+#include "Tracepoints.h"
 #include "util.h"
 #include "parsekv.h"
 
-TestSource *TestSource::m_this = 0;
 const uint32_t TestSource::m_sampleBits = 16;
 const uint32_t TestSource::m_sampleWidth = 1<<TestSource::m_sampleBits;
 const uint32_t TestSource::m_sampleHalfWidth = 1<<(TestSource::m_sampleBits-1);
@@ -42,18 +43,26 @@ TestSource::TestSource(int dev_index) :
 	m_phase(0.0),
 	m_freq(435000000),
 	m_srate(64000),
-	m_amplitude(0.1)
+	m_amplitude(0.1),
+	m_generator(GenTone),
+	m_noiseDb(-1),
+	m_burstOn(10),
+	m_burstPeriod(100),
+	m_realTime(true),
+	m_noiseScale(0),
+	m_noiseState(0x9E3779B97F4A7C15ULL),
+	m_burstPos(0),
+	m_nbLate(0)
 {
-    m_this = this;
     m_confFreq = 435000000; // default frequency center position in Source.h is centered
     m_deltaPhase = getDeltaPhase(m_carrierOffset, m_srate);
+    setupGenerator();
 }
 
 
 // Close test device.
 TestSource::~TestSource()
 {
-    m_this = 0;
 }
 
 bool TestSource::configure(parsekv::pairs_type& m)
@@ -73,7 +82,7 @@ bool TestSource::configure(parsekv::pairs_type& m)
 		std::cerr << "TestSource::configure(m): srate: " << m["srate"] << std::endl;
 		sample_rate = atoi(m["srate"].c_str());
 
-		if ((sample_rate < 8000) || (sample_rate > 10000000))
+		if ((sample_rate < 8000) || (sample_rate > 61440000))
 		{
 			m_error = "Invalid sample rate";
 			return false;
@@ -106,7 +115,7 @@ bool TestSource::configure(parsekv::pairs_type& m)
 	if (m.find("dfp") != m.end())
 	{
 		std::cerr << "TestSource::configure(m): dfp: " << m["dfp"] << std::endl;
-		int32_t carrierOffset = atoi(m["dfp"].c_str());
+		carrierOffset = atoi(m["dfp"].c_str());
 
 		if ((carrierOffset > (int32_t) sample_rate/2) || (carrierOffset < 0))
 		{
@@ -125,16 +134,16 @@ bool TestSource::configure(parsekv::pairs_type& m)
 	if ((m.find("dfn") != m.end()) && !dfp)
 	{
 		std::cerr << "TestSource::configure(m): dfn: " << m["dfn"] << std::endl;
-		int32_t carrierOffset = atoi(m["dfn"].c_str());
+		carrierOffset = -atoi(m["dfn"].c_str());
 
-		if ((carrierOffset > (int32_t) sample_rate/2) || (carrierOffset < 0))
+		if ((carrierOffset < -(int32_t) sample_rate/2) || (carrierOffset > 0))
 		{
 			m_error = "Invalid negative carrier offset";
 			return false;
 		}
 		else
 		{
-			deltaPhase = getDeltaPhase(-carrierOffset, sample_rate);
+			deltaPhase = getDeltaPhase(carrierOffset, sample_rate);
 		}
 
 		changeFlags |= 0x4;
@@ -157,6 +166,92 @@ bool TestSource::configure(parsekv::pairs_type& m)
 		changeFlags |= 0x8;
 	} // gain
 
+	if (m.find("gen") != m.end())
+	{
+		std::cerr << "TestSource::configure(m): gen: " << m["gen"] << std::endl;
+		static const char *generators[] = {"float", "tone", "tones", "noise", "burst"};
+		int i = 0;
+
+		while ((i < 5) && (m["gen"] != generators[i])) {
+			i++;
+		}
+
+		if (i == 5)
+		{
+			m_error = "Invalid generator (float, tone, tones, noise or burst)";
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_genMutex);
+		m_generator = (generator_t) i;
+		changeFlags |= 0x40;
+	}
+
+	if (m.find("tones") != m.end())
+	{
+		std::cerr << "TestSource::configure(m): tones: " << m["tones"] << std::endl;
+		std::vector<int32_t> toneOffsets;
+		std::istringstream is(m["tones"]);
+		std::string tone;
+
+		while (std::getline(is, tone, ':'))
+		{
+			char *endp;
+			long offset = strtol(tone.c_str(), &endp, 10);
+
+			if (tone.empty() || (*endp != '\0') || (offset > (long) sample_rate/2) || (offset < -(long) sample_rate/2))
+			{
+				m_error = "Invalid tone offsets (colon separated Hz within the sample rate)";
+				return false;
+			}
+
+			toneOffsets.push_back(offset);
+		}
+
+		std::lock_guard<std::mutex> lock(m_genMutex);
+		m_toneOffsets = toneOffsets;
+		changeFlags |= 0x40;
+	}
+
+	if (m.find("noise") != m.end())
+	{
+		std::cerr << "TestSource::configure(m): noise: " << m["noise"] << std::endl;
+		int dbn = atoi(m["noise"].c_str());
+
+		if (dbn < 0)
+		{
+			m_error = "Invalid noise power";
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_genMutex);
+		m_noiseDb = dbn;
+		changeFlags |= 0x40;
+	}
+
+	if (m.find("burst") != m.end())
+	{
+		std::cerr << "TestSource::configure(m): burst: " << m["burst"] << std::endl;
+		unsigned int burstOn, burstPeriod;
+
+		if ((sscanf(m["burst"].c_str(), "%u:%u", &burstOn, &burstPeriod) != 2) || (burstOn == 0) || (burstPeriod < burstOn))
+		{
+			m_error = "Invalid burst (on_ms:period_ms)";
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(m_genMutex);
+		m_burstOn = burstOn;
+		m_burstPeriod = burstPeriod;
+		changeFlags |= 0x40;
+	}
+
+	if (m.find("realtime") != m.end())
+	{
+		std::cerr << "TestSource::configure(m): realtime: " << m["realtime"] << std::endl;
+		m_realTime = m["realtime"] != "0";
+	}
+
 	if (m.find("blklen") != m.end())
 	{
 		std::cerr << "TestSource::configure(m): blklen: " << m["blklen"] << std::endl;
@@ -214,6 +309,12 @@ bool TestSource::configure(parsekv::pairs_type& m)
 	return configure(changeFlags, sample_rate, tuner_freq, carrierOffset, deltaPhase, amplitude, block_length);
 }
 
+bool TestSource::retune(std::uint64_t frequency)
+{
+    m_freq = get_tuner_frequency(frequency, m_srate);
+    return true;
+}
+
 // Configure test generator.
 bool TestSource::configure(std::uint32_t changeFlags,
 		std::uint32_t sample_rate,
@@ -252,9 +353,43 @@ bool TestSource::configure(std::uint32_t changeFlags,
 						 block_length;
     }
 
+    if (changeFlags & 0x6D) // sample rate, carrier, power, block length or generator
+    {
+        std::lock_guard<std::mutex> lock(m_genMutex);
+        setupGenerator();
+    }
+
     return true;
 }
 
+void TestSource::setupGenerator()
+{
+    std::vector<int32_t> offsets = m_toneOffsets;
+
+    if (offsets.empty() || (m_generator == GenTone)) {
+        offsets.assign(1, m_carrierOffset);
+    }
+
+    // the NCO brings an offset to DC: rotating a constant by the opposite offset gives the carrier
+    m_ncos.resize(m_generator == GenNoise ? 0 : offsets.size());
+
+    for (std::size_t i = 0; i < m_ncos.size(); i++) {
+        m_ncos[i].setFrequency(-(int64_t) offsets[i], m_srate);
+    }
+
+    int16_t level = (int16_t) lrintf(m_amplitude * (m_sampleHalfWidth - 1));
+    m_carrier.assign(m_block_length, IQSample(level, 0));
+    m_mixBuf.resize(2 * m_block_length);
+    m_accBuf.resize(2 * m_block_length);
+
+    // the sum of four uniform 16 bit values less their mean has a standard deviation of 65536/sqrt(3).
+    // The noise power is shared by I and Q.
+    int noiseDb = (m_noiseDb < 0) && (m_generator == GenNoise) ? 20 : m_noiseDb;
+    double sigma = noiseDb < 0 ? 0.0 : db2A(-noiseDb) * m_sampleHalfWidth / sqrt(2.0);
+    m_noiseScale = (int32_t) lrint(sigma * sqrt(3.0)); // Q16 of sigma / (65536/sqrt(3))
+    m_burstPos = 0;
+}
+
 
 // Return current sample frequency in Hz.
 uint32_t TestSource::get_sample_rate()
@@ -270,6 +405,8 @@ uint32_t TestSource::get_frequency()
 
 void TestSource::print_specific_parms()
 {
+	static const char *generators[] = {"float", "tone", "tones", "noise", "burst"};
+	std::cerr << "Generator:         " << generators[m_generator] << (m_realTime ? "" : " (not paced)") << std::endl;
 	std::cerr << "Delta phase:       " << m_deltaPhase << " radians" << std::endl;
 	std::cerr << "Amplitude:         " << m_amplitude << std::endl;
 }
@@ -283,7 +420,9 @@ bool TestSource::start(DataBuffer<IQSample>* buf, std::atomic_bool *stop_flag)
 
     if (m_thread == 0)
     {
-        m_thread = new std::thread(run);
+        m_thread = new std::thread(run, this);
+        set_thread_name(m_thread->native_handle(), "sdmn-device");
+        startControl();
         return true;
     }
     else
@@ -297,6 +436,8 @@ bool TestSource::stop()
 {
 	std::cerr << "TestSource::stop" << std::endl;
 
+    stopControl();
+
 	if (m_thread)
     {
         m_thread->join();
@@ -307,63 +448,171 @@ bool TestSource::stop()
     return true;
 }
 
-void TestSource::run()
+void TestSource::run(TestSource *source)
 {
 	std::cerr << "TestSource::run" << std::endl;
 
     IQSampleVector iqsamples;
-    void *msgBuf = 0;
+    uint64_t nbSent = 0; // since the pace reference
+    uint32_t paceRate = 0;
+    std::chrono::steady_clock::time_point startTime;
 
-    while (!m_this->m_stop_flag->load() && get_samples(&iqsamples))
+    while (!source->m_stop_flag->load() && get_samples(source, &iqsamples))
     {
-        m_this->m_buf->push(move(iqsamples));
-
-        int len = nn_recv(m_this->m_nnReceiver, &msgBuf, NN_MSG, NN_DONTWAIT);
+        std::size_t nbSamples = iqsamples.size();
 
-        if ((len > 0) && msgBuf)
+        if (source->m_realTime)
+        {
+            // deadline of each block from the samples sent since the reference so that the rate does not drift
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            uint32_t rate = source->m_srate;
+
+            if (rate != paceRate)
+            {
+                paceRate = rate;
+                nbSent = 0;
+                startTime = now;
+            }
+
+            nbSent += nbSamples;
+            std::chrono::steady_clock::time_point deadline = startTime + std::chrono::seconds(nbSent / rate)
+                    + std::chrono::nanoseconds(((nbSent % rate) * 1000000000ULL) / rate);
+
+            if (now > deadline + std::chrono::seconds(1)) // the generator or its consumer can not keep up: no catching up
+            {
+                source->m_nbLate++;
+                std::cerr << "TestSource::run: more than one second late on the sample rate (" << source->m_nbLate << " times)" << std::endl;
+                nbSent = 0;
+                startTime = now;
+            }
+            else
+            {
+                std::this_thread::sleep_until(deadline); // the block is delivered when it would have been fully received
+            }
+        }
+        else
         {
-            std::string msg((char *) msgBuf, len);
-            std::cerr << "TestSource::run: received: " << msg << std::endl;
-            m_this->DeviceSource::configure(msg);
-            nn_freemsg(msgBuf);
-            msgBuf = 0;
+            // as fast as possible but do not let the queue drop samples
+            paceRate = 0;
+
+            while ((source->m_buf->queued_samples() > 4 * (std::size_t) source->m_block_length) && !source->m_stop_flag->load()) {
+                usleep(100);
+            }
         }
+
+        SDMN_TRACE1(device_callback_entry, nbSamples);
+        source->m_buf->push(move(iqsamples));
+        source->scan(nbSamples);
+        SDMN_TRACE1(device_callback_exit, nbSamples);
     }
 }
 
 // Fetch a bunch of samples from the device.
-bool TestSource::get_samples(IQSampleVector *samples)
+bool TestSource::get_samples(TestSource *source, IQSampleVector *samples)
 {
-    int r, n_read;
-
     if (!samples) {
         return false;
     }
 
-    std::vector<int16_t> buf(2 * m_this->m_block_length); // one sample for I, one sample for Q
+    int nbSamples = source->m_block_length;
+    source->m_buf->get_vector(*samples, nbSamples);
+    source->generate(samples->data(), nbSamples);
+    return true;
+}
 
-    r = read_samples(buf.data(), 4 * m_this->m_block_length, n_read, m_this->m_phase, m_this->m_srate, m_this->m_deltaPhase, m_this->m_amplitude);
+void TestSource::generate(IQSample *samples, int nbSamples)
+{
+    std::lock_guard<std::mutex> lock(m_genMutex);
 
-    if (r < 0)
+    if (m_generator == GenFloat)
     {
-        m_this->m_error = "TestSource::get_samples: read_samples failed";
-        return false;
+        int n_read;
+        read_samples((int16_t *) samples, 4 * nbSamples, n_read, m_phase, m_srate, m_deltaPhase, m_amplitude);
+        return;
     }
 
-    if (n_read != 4 * m_this-> m_block_length)
+    int blockSize = m_carrier.size(); // the block length may have changed since the samples were taken
+
+    for (int done = 0; done < nbSamples; done += blockSize)
     {
-        m_this->m_error = "TestSource::get_samples: short read, samples lost";
-        return false;
+        int n = std::min(blockSize, nbSamples - done);
+        IQSample *out = &samples[done];
+
+        if ((m_generator == GenTone) && (m_noiseScale == 0)) // rotated in place
+        {
+            memcpy((void *) out, (const void *) m_carrier.data(), n * sizeof(IQSample));
+            m_ncos[0].mix(out, n);
+            continue;
+        }
+
+        int32_t *acc = m_accBuf.data();
+        memset((void *) acc, 0, 2 * n * sizeof(int32_t));
+
+        if (m_generator == GenBurst)
+        {
+            // carriers only during the first burstOn milliseconds of each period
+            uint64_t onSamples = ((uint64_t) m_burstOn * m_srate) / 1000;
+            uint64_t periodSamples = std::max<uint64_t>(((uint64_t) m_burstPeriod * m_srate) / 1000, 1);
+
+            for (int i = 0; i < n;)
+            {
+                uint64_t pos = m_burstPos % periodSamples;
+                int len = (int) std::min<uint64_t>(n - i, pos < onSamples ? onSamples - pos : periodSamples - pos);
+
+                if (pos < onSamples) {
+                    addCarriers(&acc[2*i], len);
+                }
+
+                m_burstPos += len;
+                i += len;
+            }
+        }
+        else
+        {
+            addCarriers(acc, n);
+        }
+
+        addNoise(acc, n);
+        int16_t *x = (int16_t *) out;
+
+        for (int i = 0; i < 2*n; i++) {
+            x[i] = acc[i] > 32767 ? 32767 : acc[i] < -32768 ? -32768 : acc[i];
+        }
+    }
+}
+
+void TestSource::addCarriers(int32_t *acc, int nbSamples)
+{
+    for (std::size_t k = 0; k < m_ncos.size(); k++)
+    {
+        m_ncos[k].mix(m_carrier.data(), m_mixBuf.data(), nbSamples);
+
+        for (int i = 0; i < 2*nbSamples; i++) {
+            acc[i] += m_mixBuf[i];
+        }
+    }
+}
+
+/** Gaussian noise approximated by the sum of the four 16 bit parts of a xorshift64* output (Irwin-Hall) */
+void TestSource::addNoise(int32_t *acc, int nbSamples)
+{
+    if (m_noiseScale == 0) {
+        return;
     }
 
-    samples->resize(m_this->m_block_length);
+    uint64_t state = m_noiseState;
 
-    for (int i = 0; i < m_this->m_block_length; i++)
+    for (int i = 0; i < 2*nbSamples; i++)
     {
-        (*samples)[i] = IQSample(buf[2*i], buf[2*i+1]);
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        uint64_t r = state * 2685821657736338717ULL;
+        int32_t sum = (int32_t) (r & 0xFFFF) + (int32_t) ((r >> 16) & 0xFFFF) + (int32_t) ((r >> 32) & 0xFFFF) + (int32_t) (r >> 48) - 131070;
+        acc[i] += (int32_t) (((int64_t) sum * m_noiseScale) >> 16);
     }
 
-    return true;
+    m_noiseState = state;
 }
 
 
@@ -392,12 +641,9 @@ void TestSource::get_device_names(std::vector<std::string>& devices)
     }
 }
 
-int TestSource::read_samples(int16_t* data, int iqBlockSize, int& getSize, float& phasor, int sampleRate, float deltaPhase, float amplitude)
+int TestSource::read_samples(int16_t* data, int iqBlockSize, int& getSize, float& phasor, int sampleRate __attribute__((unused)), float deltaPhase, float amplitude)
 {
 	int nbSamples = iqBlockSize / 4; // 16 bit samples
-	float dt = (float) nbSamples / (float) sampleRate;
-	int dtMicroseconds = (int) (dt * 1e6);
-
 	int i = 0;
 
 	for (; i < nbSamples * 2; i += 2)
@@ -410,13 +656,11 @@ int TestSource::read_samples(int16_t* data, int iqBlockSize, int& getSize, float
 
 		if (phasor > 2.0 * M_PI) {
 			phasor -= 2.0 * M_PI;
-		} else if (phasor < 2.0 * M_PI) {
+		} else if (phasor < 0.0) {
 			phasor += 2.0 * M_PI;
 		}
 	}
 
-	usleep(dtMicroseconds);
-
 	getSize = i * 2;
 	return 0;
 }
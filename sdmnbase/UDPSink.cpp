@@ -26,11 +26,85 @@ UDPSink::UDPSink(const std::string& address, unsigned int port, unsigned int udp
 		m_sampleRate(48000),
 		m_sampleBytes(1),
 		m_sampleBits(8),
-		m_nbSamples(0)
+		m_nbSamples(0),
+		m_sampleStamp(0)
 {
 	m_currentMeta.init();
 	m_bufMeta = new uint8_t[m_udpSize];
 	m_buf = new uint8_t[m_udpSize];
+
+	try
+	{
+	    m_socket.SetForeignAddress(m_address, m_port); // resolve once, not for every datagram
+	}
+	catch (CSocketException& e)
+	{
+	    m_error = e.what();
+	}
+}
+
+UDPSink::UDPSink(const std::string& name) :
+        m_address(name),
+		m_port(0),
+		m_udpSize(0),
+		m_centerFrequency(100000),
+		m_sampleRate(48000),
+		m_sampleBytes(1),
+		m_sampleBits(8),
+		m_nbSamples(0),
+		m_sampleStamp(0)
+{
+	m_currentMeta.init();
+	m_bufMeta = new uint8_t[0];
+	m_buf = new uint8_t[0];
+}
+
+bool UDPSink::connect()
+{
+    if (m_socket.GetForeignAddressCount() > 1)
+    {
+        m_error = "cannot connect the socket to several destinations";
+        return false;
+    }
+
+    try
+    {
+        m_socket.SetForeignAddress(m_address, m_port, true);
+        return true;
+    }
+    catch (CSocketException& e)
+    {
+        m_error = e.what();
+        return false;
+    }
+}
+
+bool UDPSink::addDestination(const std::string& address, unsigned int port)
+{
+    try
+    {
+        m_socket.AddForeignAddress(address, port);
+        return true;
+    }
+    catch (CSocketException& e)
+    {
+        m_error = e.what();
+        return false;
+    }
+}
+
+bool UDPSink::setMulticastTTL(unsigned char ttl)
+{
+    try
+    {
+        m_socket.SetMulticastTTL(ttl);
+        return true;
+    }
+    catch (CSocketException& e)
+    {
+        m_error = e.what();
+        return false;
+    }
 }
 
 UDPSink::~UDPSink()
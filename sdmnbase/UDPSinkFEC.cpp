@@ -18,39 +18,207 @@
 
 #include <sys/time.h>
 #include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <thread>
+#include <sstream>
 #include <boost/crc.hpp>
 #include <boost/cstdint.hpp>
+#ifdef HAS_LZ4
+#include <lz4.h>
+#endif
 #include "UDPSinkFEC.h"
+#include "FECEncoderPool.h"
+#include "SampleConversion.h"
+#include "CRC32C.h"
+#include "Tracepoints.h"
+#include "util.h"
 
 //#define SDRDAEMON_PUNCTURE 101 // debug: test FEC
 
-UDPSinkFEC::UDPSinkFEC(const std::string& address, unsigned int port) :
-    UDPSink::UDPSink(address, port, UDPSINKFEC_UDPSIZE),
+UDPSinkFEC::UDPSinkFEC(const std::string& address, unsigned int port, bool pipelined, unsigned int udpSize, unsigned int nbTxBlocks, unsigned int nbEncoders, FECEncoderPool *encoderPool, unsigned int maxNbBlocksFEC, unsigned int maxNbOriginalBlocks) :
+    UDPSink::UDPSink(address, port, udpSize),
+    m_fecCodec(FECCODEC_CM256),
     m_nbBlocksFEC(0),
+    m_txDelay(0),
+    m_txBatch(0),
+    m_txPace(0),
+    m_txPaceMin(0),
+    m_fecAuto(0),
+    m_nack(false),
+    m_overload(true),
+    m_nbOriginalBlocks(UDPSINKFEC_NBORIGINALBLOCKS),
+    m_frameTarget(0),
+    m_interleave(1),
+    m_nbResentBlocks(0),
+    m_nbSamplesWritten(0),
+    m_nbFramesEncoded(0),
+    m_nbFramesSent(0),
+    m_nbBlocksSent(0),
+    m_nbSendErrors(0),
+    m_nbTxWaits(0),
+    m_nbSquelchedFrames(0),
+    m_nbShedFrames(0),
+    m_nbShedBlocks(0),
+    m_nbUnpacedFrames(0),
     m_txThread(0),
+    m_sendThread(0),
+    m_encoderPool(pipelined ? encoderPool : 0),
+    m_pipelined(pipelined),
 	m_txBlockIndex(0),
 	m_txBlocksIndex(0),
 	m_frameCount(0),
-	m_sampleIndex(0)
+	m_sampleIndex(0),
+	m_frameBlocks(UDPSINKFEC_NBORIGINALBLOCKS),
+	m_txSlowTime(0),
+	m_txSlowCount(0),
+	m_shedLevel(0),
+	m_overloadTime(0),
+	m_encodeBlockNs(0),
+	m_sendErrorTime(0),
+	m_frameStamp(0),
+	m_retunePending(false),
+	m_hopCount(0),
+	m_settleEnd(0),
+	m_frameRetune(false),
+	m_wireBits(16),
+	m_frameSampleBytes(sizeof(IQSample)),
+	m_compression(false),
+	m_blockCRC(false),
+	m_frameCompressed(false),
+	m_frameSquelched(false),
+	m_anchorIndex(0),
+	m_anchorStamp(0),
+	m_anchorClock(0),
+	m_anchorRate(0),
+	m_nbAnchors(0)
 {
-    m_cm256Valid = m_cm256.isInitialized();
+    if ((m_udpSize < UDPSINKFEC_UDPSIZEMIN) || (m_udpSize > UDPSINKFEC_UDPSIZEMAX) || (m_udpSize % sizeof(IQSample) != 0))
+    {
+        std::ostringstream os;
+        os << "invalid UDP datagram size " << m_udpSize << " (multiple of 4 between " << UDPSINKFEC_UDPSIZEMIN << " and " << UDPSINKFEC_UDPSIZEMAX << ")";
+        m_error = os.str();
+        m_udpSize = UDPSINKFEC_UDPSIZE;
+    }
+
+    if ((nbTxBlocks < 2) || (nbTxBlocks > UDPSINKFEC_NBTXBLOCKSMAX))
+    {
+        std::ostringstream os;
+        os << "invalid Tx ring depth " << nbTxBlocks << " (2 to " << UDPSINKFEC_NBTXBLOCKSMAX << ")";
+        m_error = os.str();
+        nbTxBlocks = UDPSINKFEC_NBTXBLOCKS;
+    }
+
+    m_nbTxBlocks = nbTxBlocks;
+
+    if (maxNbBlocksFEC > UDPSINKFEC_NBFECBLOCKSLARGE)
+    {
+        std::ostringstream os;
+        os << "invalid largest number of FEC blocks " << maxNbBlocksFEC << " (0 to " << UDPSINKFEC_NBFECBLOCKSLARGE << ")";
+        m_error = os.str();
+        maxNbBlocksFEC = UDPSINKFEC_NBFECBLOCKS;
+    }
+
+    if ((maxNbOriginalBlocks < UDPSINKFEC_NBORIGINALBLOCKSMIN) || (maxNbOriginalBlocks > UDPSINKFEC_NBORIGINALBLOCKSLARGE))
+    {
+        std::ostringstream os;
+        os << "invalid largest number of original blocks " << maxNbOriginalBlocks << " (" << UDPSINKFEC_NBORIGINALBLOCKSMIN
+                << " to " << UDPSINKFEC_NBORIGINALBLOCKSLARGE << ")";
+        m_error = os.str();
+        maxNbOriginalBlocks = UDPSINKFEC_NBORIGINALBLOCKS;
+    }
+
+    m_maxNbBlocksFEC = maxNbBlocksFEC;
+    m_maxNbOriginalBlocks = maxNbOriginalBlocks;
+    m_largeFrames = (m_maxNbOriginalBlocks > UDPSINKFEC_NBORIGINALBLOCKS) || (m_maxNbBlocksFEC > UDPSINKFEC_NBFECBLOCKSMAX);
+    m_frameStride = m_maxNbOriginalBlocks + m_maxNbBlocksFEC;
+    m_nbOriginalBlocks = std::min(UDPSINKFEC_NBORIGINALBLOCKS, m_maxNbOriginalBlocks); // larger frames are asked for with setFrameBlocks
+    m_frameBlocks = m_nbOriginalBlocks.load();
+    m_protectedBlockSize = m_udpSize - sizeof(Header) - (m_largeFrames ? sizeof(LargeTrailer) : 0);
+    m_samplesPerBlock = m_protectedBlockSize / sizeof(IQSample);
+
+    if ((nbEncoders < 1) || (nbEncoders > UDPSINKFEC_NBENCODERSMAX))
+    {
+        std::ostringstream os;
+        os << "invalid number of FEC encoders " << nbEncoders << " (1 to " << UDPSINKFEC_NBENCODERSMAX << ")";
+        m_error = os.str();
+        nbEncoders = 1;
+    }
+
+    m_txBlocks.resize(m_nbTxBlocks * m_frameStride * m_udpSize);
+    m_interleaveBlocks.resize(UDPSINKFEC_INTERLEAVEMAX * m_frameStride);
+    m_txControlBlocks.resize(m_nbTxBlocks);
     m_currentMetaFEC.init();
+    memset(m_nackFrames, 0, sizeof(m_nackFrames));
     m_udpSent.store(true);
     reset();
-    m_txThread = new std::thread(transmitUDP, this);
     m_running.store(true);
+
+    if (m_pipelined)
+    {
+        for (unsigned int i = 0; !m_encoderPool && (i < nbEncoders); i++)
+        {
+            m_encodeThreads.push_back(new std::thread(encodeUDP, this));
+            set_thread_name(m_encodeThreads.back()->native_handle(), "sdmn-fecenc");
+        }
+
+        m_sendThread = new std::thread(sendUDP, this);
+        set_thread_name(m_sendThread->native_handle(), "sdmn-udpsend");
+    }
+    else
+    {
+        m_txThread = new std::thread(transmitUDP, this);
+        set_thread_name(m_txThread->native_handle(), "sdmn-udptx");
+    }
 }
 
 UDPSinkFEC::~UDPSinkFEC()
 {
+    m_running.store(false);
+    notifyTx();
+
+    if (m_encoderPool) {
+        m_encoderPool->cancel(this);
+    }
+
 	if (m_txThread)
 	{
-	    m_running.store(false);
 		m_txThread->join();
 		delete m_txThread;
 	}
+
+	for (std::vector<std::thread*>::iterator it = m_encodeThreads.begin(); it != m_encodeThreads.end(); ++it)
+	{
+		(*it)->join();
+		delete *it;
+	}
+
+	if (m_sendThread)
+	{
+		m_sendThread->join();
+		delete m_sendThread;
+	}
+}
+
+bool UDPSinkFEC::setAffinity(int fecCpu, int sendCpu)
+{
+    bool ok = true;
+
+    if (m_txThread) {
+        ok = set_thread_affinity(m_txThread->native_handle(), fecCpu);
+    }
+
+    for (std::vector<std::thread*>::iterator it = m_encodeThreads.begin(); it != m_encodeThreads.end(); ++it) {
+        ok = set_thread_affinity((*it)->native_handle(), fecCpu) && ok;
+    }
+
+    if (m_sendThread) {
+        ok = set_thread_affinity(m_sendThread->native_handle(), sendCpu) && ok;
+    }
+
+    return ok;
 }
 
 void UDPSinkFEC::setTxDelay(int txDelay)
@@ -59,230 +227,1279 @@ void UDPSinkFEC::setTxDelay(int txDelay)
     m_txDelay = txDelay;
 }
 
+void UDPSinkFEC::setTxBatch(int txBatch)
+{
+    std::cerr << "UDPSinkFEC::setTxBatch: txBatch: " << txBatch << std::endl;
+    m_txBatch = txBatch;
+}
+
+void UDPSinkFEC::setTxPace(int txPace)
+{
+    std::cerr << "UDPSinkFEC::setTxPace: txPace: " << txPace << "%" << std::endl;
+    m_txPace = txPace;
+    m_txPaceMin = txPace;
+}
+
+void UDPSinkFEC::setFECAuto(int maxNbBlocksFEC)
+{
+    std::cerr << "UDPSinkFEC::setFECAuto: maxNbBlocksFEC: " << maxNbBlocksFEC << std::endl;
+    m_fecAuto = std::min(maxNbBlocksFEC, m_maxNbBlocksFEC);
+}
+
+void UDPSinkFEC::setNack(bool nack)
+{
+    if (nack && m_largeFrames) // the requests only map 256 blocks
+    {
+        std::cerr << "UDPSinkFEC::setNack: not available with large frames" << std::endl;
+        return;
+    }
+
+    std::cerr << "UDPSinkFEC::setNack: " << (nack ? "on" : "off") << std::endl;
+    m_nack = nack;
+}
+
+void UDPSinkFEC::setOverload(bool overload)
+{
+    std::cerr << "UDPSinkFEC::setOverload: " << (overload ? "on" : "off") << std::endl;
+    m_overload = overload;
+}
+
+void UDPSinkFEC::setFrameBlocks(int nbOriginalBlocks)
+{
+    std::cerr << "UDPSinkFEC::setFrameBlocks: nbOriginalBlocks: " << nbOriginalBlocks << std::endl;
+    m_nbOriginalBlocks = std::max(UDPSINKFEC_NBORIGINALBLOCKSMIN, std::min(nbOriginalBlocks, m_maxNbOriginalBlocks));
+}
+
+void UDPSinkFEC::setFrameTarget(int frameMs)
+{
+    std::cerr << "UDPSinkFEC::setFrameTarget: frameMs: " << frameMs << std::endl;
+    m_frameTarget = std::max(frameMs, 0);
+}
+
+void UDPSinkFEC::setInterleave(int nbFrames)
+{
+    std::cerr << "UDPSinkFEC::setInterleave: nbFrames: " << nbFrames << std::endl;
+    m_interleave = std::max(1, std::min(nbFrames, UDPSINKFEC_INTERLEAVEMAX));
+    notifyTx();
+}
+
+void UDPSinkFEC::setFECCodec(int codecId)
+{
+    FECCodec *codec = FECCodec::get(codecId);
+
+    if (!codec || !codec->isInitialized())
+    {
+        std::cerr << "UDPSinkFEC::setFECCodec: codec " << codecId << " not available" << std::endl;
+        return;
+    }
+
+    std::cerr << "UDPSinkFEC::setFECCodec: " << codec->getName() << std::endl;
+    m_fecCodec = codecId;
+}
+
 void UDPSinkFEC::reset()
 {
-    for (int i = 0; i < UDPSINKFEC_NBTXBLOCKS; i++)
+    std::unique_lock<std::mutex> lock(m_txMutex);
+
+    for (int i = 0; i < m_nbTxBlocks; i++)
     {
         m_txControlBlocks[i].m_processed = true;
+        m_txControlBlocks[i].m_encoded = false;
     }
 
     m_txIndexCurrent.store(0);
     m_txIndexProcessing.store(0);
+    m_txIndexEncoding.store(0);
 }
 
 void UDPSinkFEC::setNbBlocksFEC(int nbBlocksFEC)
 {
     std::cerr << "UDPSinkFEC::setNbBlocksFEC: nbBlocksFEC: " << nbBlocksFEC << std::endl;
+
+    if (nbBlocksFEC > m_maxNbBlocksFEC)
+    {
+        std::cerr << "UDPSinkFEC::setNbBlocksFEC: capped to the largest number of FEC blocks: " << m_maxNbBlocksFEC << std::endl;
+        nbBlocksFEC = m_maxNbBlocksFEC;
+    }
+
     m_nbBlocksFEC = nbBlocksFEC;
 }
 
+std::size_t UDPSinkFEC::getPreallocatedBytes() const
+{
+    std::size_t fecBytes = getFECScratchBytes(); // of each encoding thread
+    std::size_t bytes = m_txBlocks.size() + m_nackBlocks.size();
+
+    if (!m_pipelined) {
+        bytes += fecBytes; // transmit thread
+    } else if (!m_encoderPool) {
+        bytes += m_encodeThreads.size() * fecBytes;
+    }
+
+    return bytes;
+}
+
 void UDPSinkFEC::write(const IQSampleVector& samples_in)
 {
 	IQSampleVector::const_iterator it = samples_in.begin();
 	//std::cerr << "UDPSinkFEC::write: samples_in.size() = " << samples_in.size() << std::endl;
+	uint64_t firstSampleIndex = m_nbSamplesWritten.fetch_add(samples_in.size(), std::memory_order_relaxed);
+	bool gateOpen = m_squelch.process(samples_in.data(), samples_in.size(), m_sampleRate);
+
+	if (m_sampleStamp != 0) {
+	    anchorStamp(firstSampleIndex + samples_in.size(), m_sampleStamp);
+	}
+
+	if (m_retunePending.load())
+	{
+	    std::lock_guard<std::mutex> lock(m_retuneMutex);
+	    m_retunesWrite.insert(m_retunesWrite.end(), m_retuneMarks.begin(), m_retuneMarks.end());
+	    m_retuneMarks.clear();
+	    m_retunePending = false;
+	}
 
 	while (it != samples_in.end())
 	{
         int inSamplesIndex = it - samples_in.begin();
         int inRemainingSamples = samples_in.end() - it;
+        uint64_t sampleIndex = firstSampleIndex + inSamplesIndex;
 
-	    if (m_txBlockIndex == 0) // Tx block index 0 is a block with only meta data
-	    {
-            struct timeval tv;
-            MetaDataFEC metaData;
+        // retunes take effect at their sample, the copy stops at the next one
+        while (!m_retunesWrite.empty() && (m_retunesWrite.front().m_sampleIndex <= sampleIndex))
+        {
+            flushCompressed(sampleIndex); // compressed frames end before the retune
+            applyRetune(m_retunesWrite.front(), sampleIndex);
+            m_retunesWrite.pop_front();
+        }
+
+        if (!m_retunesWrite.empty() && (m_retunesWrite.front().m_sampleIndex < sampleIndex + inRemainingSamples)) {
+            inRemainingSamples = m_retunesWrite.front().m_sampleIndex - sampleIndex;
+        }
 
-            gettimeofday(&tv, 0);
+        if ((m_txBlockIndex != 0) && m_frameSquelched && gateOpen) {
+            completeSquelched(); // the samples start a new frame
+        }
+
+        if ((m_txBlockIndex == 0) && m_frameCompressed && (!m_compression.load() || (wireSampleBytes() != m_frameSampleBytes) || !gateOpen)) {
+            flushCompressed(sampleIndex); // the samples held are sent in their format
+        }
 
-            // create meta data TODO: semaphore
-            metaData.m_centerFrequency = m_centerFrequency;
-            metaData.m_sampleRate = m_sampleRate;
-            metaData.m_sampleBytes = m_sampleBytes;
-            metaData.m_sampleBits = m_sampleBits;
-            metaData.m_nbOriginalBlocks = UDPSINKFEC_NBORIGINALBLOCKS;
-            metaData.m_nbFECBlocks = m_nbBlocksFEC;
-            metaData.m_tv_sec = tv.tv_sec;
-            metaData.m_tv_usec = tv.tv_usec;
+	    if (m_txBlockIndex == 0) { // Tx block index 0 is a block with only meta data
+            startFrame(sampleIndex - compressPending());
+	    }
 
-            boost::crc_32_type crc32;
-            crc32.process_bytes(&metaData, 20);
+        if (m_frameSquelched)
+        {
+            // silent samples are only counted, up to the samples of a frame
+            int frameSamples = (m_frameBlocks - 1) * m_samplesPerBlock;
+            int nbSamples = std::min(inRemainingSamples, frameSamples - m_sampleIndex);
+            m_sampleIndex += nbSamples;
+            it += nbSamples;
 
-            metaData.m_crc32 = crc32.checksum();
+            if (m_sampleIndex == frameSamples) {
+                completeSquelched();
+            }
 
-            memset((void *) &m_superBlock, 0, UDPSINKFEC_UDPSIZE);
+            continue;
+        }
 
-            m_superBlock.header.frameIndex = m_frameCount;
-            m_superBlock.header.blockIndex = m_txBlockIndex;
-            memcpy((void *) &m_superBlock.protectedBlock, (const void *) &metaData, sizeof(MetaDataFEC));
+        if (m_frameCompressed)
+        {
+            // samples are held in the frame format until there are enough to fill a compressed frame
+            std::size_t size = m_compressInput.size();
+            m_compressInput.resize(size + inRemainingSamples * m_frameSampleBytes);
+            copySamples(&m_compressInput[size], &samples_in[inSamplesIndex], inRemainingSamples);
+            it += inRemainingSamples;
 
-            if (!(metaData == m_currentMetaFEC))
+            while (m_compressInput.size() >= (std::size_t) UDPSINKFEC_LZ4RATIO * (m_frameBlocks - 1) * m_protectedBlockSize)
             {
-                std::cerr << "UDPSinkFEC::write: meta: "
-                        << "|" << metaData.m_centerFrequency
-                        << ":" << metaData.m_sampleRate
-                        << ":" << (int) (metaData.m_sampleBytes & 0xF)
-                        << ":" << (int) metaData.m_sampleBits
-                        << "|" << (int) metaData.m_nbOriginalBlocks
-                        << ":" << (int) metaData.m_nbFECBlocks
-                        << "|" << metaData.m_tv_sec
-                        << ":" << metaData.m_tv_usec
-                        << "|" << std::endl;
-
-                m_currentMetaFEC = metaData;
+                if (m_txBlockIndex == 0) {
+                    startFrame(sampleIndex + inRemainingSamples - compressPending());
+                }
+
+                compressFrame();
             }
 
-            m_txBlocks[m_txBlocksIndex][0] = m_superBlock;
-            m_txBlockIndex = 1; // next Tx block with data
-	    }
+            continue;
+        }
 
-        if (m_sampleIndex + inRemainingSamples < samplesPerBlock) // there is still room in the current super block
+        // blocks are built in place in the Tx row of the current frame. The row is only read by
+        // the FEC and sending side once the next frame is complete.
+        Header *header = (Header *) txBlock(m_txBlocksIndex, m_txBlockIndex);
+        uint8_t *samples = &((uint8_t *) &header[1])[m_frameSampleBytes * m_sampleIndex];
+
+        if (m_sampleIndex + inRemainingSamples < m_samplesPerBlock) // there is still room in the current super block
         {
-            memcpy((void *) &m_superBlock.protectedBlock.m_samples[m_sampleIndex],
-                    (const void *) &samples_in[inSamplesIndex],
-                    inRemainingSamples * sizeof(IQSample));
+            copySamples(samples, &samples_in[inSamplesIndex], inRemainingSamples);
             m_sampleIndex += inRemainingSamples;
-            it = samples_in.end(); // all input samples are consumed
+            it += inRemainingSamples; // all input samples are consumed up to the next retune
         }
         else // complete super block and initiate the next if not end of frame
         {
-            memcpy((void *) &m_superBlock.protectedBlock.m_samples[m_sampleIndex],
-                    (const void *) &samples_in[inSamplesIndex],
-                    (samplesPerBlock - m_sampleIndex) * sizeof(IQSample));
-            it += samplesPerBlock - m_sampleIndex;
+            copySamples(samples, &samples_in[inSamplesIndex], m_samplesPerBlock - m_sampleIndex);
+            it += m_samplesPerBlock - m_sampleIndex;
             m_sampleIndex = 0;
 
-            m_superBlock.header.frameIndex = m_frameCount;
-            m_superBlock.header.blockIndex = m_txBlockIndex;
-            m_txBlocks[m_txBlocksIndex][m_txBlockIndex] =  m_superBlock;
+            writeHeader((uint8_t *) header, m_frameCount, m_txBlockIndex, m_frameBlocks);
+
+            if (m_txBlockIndex == m_frameBlocks - 1) { // frame complete
+                completeFrame((m_frameBlocks - 1) * m_samplesPerBlock);
+            } else {
+                m_txBlockIndex++;
+            }
+        }
+	}
+}
+
+/** Number of bytes per I/Q pair of the next frame from the sample bits in effect */
+int UDPSinkFEC::wireSampleBytes() const
+{
+    unsigned int wireBits = m_wireBits.load();
+
+    if ((wireBits <= 8) && (m_sampleBits <= 8)) {
+        return 2;
+    } else if ((wireBits <= 12) && (m_sampleBits <= 12)) {
+        return 3;
+    } else {
+        return sizeof(IQSample);
+    }
+}
+
+/**
+ * Number of original blocks of the next frame: as set or less to fill in the target time, and no more than
+ * its codec protects with the FEC blocks set
+ */
+int UDPSinkFEC::nextFrameBlocks() const
+{
+    int nbOriginalBlocks = m_nbOriginalBlocks.load();
+    int frameTarget = m_frameTarget.load();
+    int nbBlocksFEC = m_nbBlocksFEC.load();
+
+    if ((frameTarget > 0) && (m_sampleRate > 0))
+    {
+        uint64_t targetSamples = ((uint64_t) frameTarget * m_sampleRate) / 1000;
+        int nbBlocks = 1 + (int) std::min(targetSamples / m_samplesPerBlock, (uint64_t) m_maxNbOriginalBlocks);
+        nbOriginalBlocks = std::min(nbBlocks, nbOriginalBlocks);
+    }
+
+    if (nbBlocksFEC > 0) {
+        nbOriginalBlocks = std::min(nbOriginalBlocks, codecMaxBlocks() - nbBlocksFEC);
+    }
+
+    return std::max(UDPSINKFEC_NBORIGINALBLOCKSMIN, nbOriginalBlocks);
+}
+
+/** Largest number of blocks of the frames with the codec set, original and FEC blocks */
+int UDPSinkFEC::codecMaxBlocks() const
+{
+    FECCodec *codec = FECCodec::get(m_fecCodec.load());
+    return codec ? codec->getMaxNbBlocks() : FECCODEC_NBBLOCKSMAX;
+}
+
+/**
+ * Header of a superblock: its filler tells the number of original blocks of the frame (0 for full frames as from older
+ * senders). Large frames give it with the block index in the LargeTrailer after the protected block.
+ */
+void UDPSinkFEC::writeHeader(uint8_t *block, uint16_t frameIndex, int blockIndex, int nbOriginalBlocks)
+{
+    Header *header = (Header *) block;
+    header->frameIndex = frameIndex;
+    header->blockIndex = blockIndex; // low 8 bits for large frames
+
+    if (m_largeFrames)
+    {
+        LargeTrailer trailer;
+        trailer.blockIndex = blockIndex;
+        trailer.nbOriginalBlocks = nbOriginalBlocks;
+        header->filler = UDPSINKFEC_LARGEFRAME << UDPSINKFEC_BLOCKSSHIFT;
+        memcpy((void *) &block[sizeof(Header) + m_protectedBlockSize], (const void *) &trailer, sizeof(trailer));
+    }
+    else
+    {
+        header->filler = (UDPSINKFEC_NBORIGINALBLOCKS - nbOriginalBlocks) << UDPSINKFEC_BLOCKSSHIFT;
+    }
+}
+
+/** Block counts of the meta data: the 8 bit fields saturate, the 16 bit fields give them in full for large frames */
+void UDPSinkFEC::setMetaBlocks(MetaDataFEC& metaData, int nbOriginalBlocks, int nbBlocksFEC)
+{
+    metaData.m_nbOriginalBlocks = std::min(nbOriginalBlocks, 255);
+    metaData.m_nbFECBlocks = std::min(nbBlocksFEC, 255);
+    metaData.m_nbOriginalBlocksLarge = m_largeFrames ? nbOriginalBlocks : 0;
+    metaData.m_nbFECBlocksLarge = m_largeFrames ? nbBlocksFEC : 0;
+}
+
+/** Take the sample stamp as the capture time of the sample with this index if there is no valid anchor */
+void UDPSinkFEC::anchorStamp(uint64_t sampleIndex, int64_t sampleStamp)
+{
+    if ((m_anchorStamp != 0) && (m_anchorRate == m_sampleRate) && (m_sampleRate != 0))
+    {
+        int64_t expected = m_anchorStamp + (int64_t) ((sampleIndex - m_anchorIndex) * (1e9 / m_sampleRate));
+
+        if (std::abs(sampleStamp - expected) <= UDPSINKFEC_ANCHORDRIFT) {
+            return;
+        }
+    }
+
+    int64_t unixTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    m_anchorClock = unixTime - LatencyHistogram::now();
+    m_anchorIndex = sampleIndex;
+    m_anchorStamp = sampleStamp;
+    m_anchorRate = m_sampleRate;
+    m_nbAnchors++;
+}
+
+/** Build the meta data block of a new frame whose first sample has this index */
+void UDPSinkFEC::startFrame(uint64_t sampleIndex)
+{
+    Header *header = (Header *) txBlock(m_txBlocksIndex, 0);
+    uint8_t *samples = (uint8_t *) &header[1];
+    struct timeval tv;
+    m_frameStamp = m_sampleStamp;
+    MetaDataFEC metaData;
+
+    gettimeofday(&tv, 0);
+
+    // the sample format is fixed for the whole frame. Samples held for compression keep theirs.
+    if (m_compressInput.empty())
+    {
+        m_frameSampleBytes = wireSampleBytes();
+        m_frameSquelched = !m_squelch.isOpen();
+        m_frameCompressed = m_compression.load() && !m_frameSquelched;
+    }
+
+    uint8_t sampleBytes = m_sampleBytes & ~(UDPSINKFEC_PACKED12 | UDPSINKFEC_PACKED8 | UDPSINKFEC_LZ4 | UDPSINKFEC_SQUELCH);
+
+    if (m_frameSampleBytes == 2) {
+        sampleBytes |= UDPSINKFEC_PACKED8;
+    } else if (m_frameSampleBytes == 3) {
+        sampleBytes |= UDPSINKFEC_PACKED12;
+    }
+
+    if (m_frameCompressed) {
+        sampleBytes |= UDPSINKFEC_LZ4;
+    }
+
+    if (m_frameSquelched) {
+        sampleBytes |= UDPSINKFEC_SQUELCH;
+    }
+
+    m_samplesPerBlock = m_protectedBlockSize / m_frameSampleBytes;
+
+    // compressed frames keep the blocks they were started with while the samples held are sent
+    if (m_compressInput.empty()) {
+        m_frameBlocks = nextFrameBlocks();
+    }
+
+    // create meta data TODO: semaphore
+    metaData.m_centerFrequency = m_centerFrequency;
+    metaData.m_sampleRate = m_sampleRate;
+    metaData.m_sampleBytes = sampleBytes;
+    metaData.m_sampleBits = m_sampleBits;
+    setMetaBlocks(metaData, m_frameBlocks, m_nbBlocksFEC);
+    metaData.m_tv_sec = tv.tv_sec;
+    metaData.m_tv_usec = tv.tv_usec;
+    sealMeta(metaData);
+    metaData.m_udpSize = m_udpSize;
+    metaData.m_hopCount = m_hopCount;
+    metaData.m_retuneOffset = m_frameRetune ? 0 : 0xFFFFFFFF;
+    metaData.m_retuneFrequency = m_centerFrequency;
+    metaData.m_settleSamples = m_settleEnd > sampleIndex ? std::min(m_settleEnd - sampleIndex, (uint64_t) 0xFFFFFFFF) : 0;
+    metaData.m_compressedBytes = 0; // set when the frame is compressed
+    metaData.m_frameBytes = 0;
+    metaData.m_squelchSamples = 0; // set when the keep-alive frame is complete
+    metaData.m_sampleIndex = sampleIndex;
+    metaData.m_anchorIndex = m_anchorIndex;
+    metaData.m_anchorTime = m_anchorStamp != 0 ? m_anchorStamp + m_anchorClock : 0;
+    metaData.m_fecCodec = m_fecCodec;
+    m_frameRetune = false;
+
+    writeHeader((uint8_t *) header, m_frameCount, 0, m_frameBlocks);
+    memcpy((void *) samples, (const void *) &metaData, sizeof(MetaDataFEC));
+    memset((void *) (samples + sizeof(MetaDataFEC)), 0, m_protectedBlockSize - sizeof(MetaDataFEC));
+
+    if (!(metaData == m_currentMetaFEC))
+    {
+        std::cerr << "UDPSinkFEC::write: meta: "
+                << "|" << metaData.m_centerFrequency
+                << ":" << metaData.m_sampleRate
+                << ":" << (int) (metaData.m_sampleBytes & 0xF)
+                << ":" << (int) metaData.m_sampleBits
+                << "|" << (int) metaData.m_nbOriginalBlocks
+                << ":" << (int) metaData.m_nbFECBlocks
+                << "|" << metaData.m_tv_sec
+                << ":" << metaData.m_tv_usec
+                << "|" << metaData.m_udpSize
+                << "|" << std::endl;
+
+        m_currentMetaFEC = metaData;
+    }
+
+    m_txBlockIndex = 1; // next Tx block with data
+}
+
+/** CRC of the first 20 bytes of the meta data */
+void UDPSinkFEC::sealMeta(MetaDataFEC& metaData)
+{
+    if (m_blockCRC)
+    {
+        metaData.m_crc32 = CRC32C::calculate((const uint8_t *) &metaData, 20);
+    }
+    else
+    {
+        boost::crc_32_type crc32;
+        crc32.process_bytes(&metaData, 20);
+        metaData.m_crc32 = crc32.checksum();
+    }
+}
+
+/** Shed the FEC blocks of the frame completed if the sending side falls behind (see setOverload) */
+void UDPSinkFEC::applyOverload(int frameSamples, int& nbBlocksFEC)
+{
+    int queued = (m_txBlocksIndex - m_txIndexProcessing.load() + m_nbTxBlocks) % m_nbTxBlocks; // frames ahead still to send
+    queued = std::max(0, queued - (interleaveFrames() - 1)); // not those held to be interleaved
+    int queuedPercent = (100 * queued) / (m_nbTxBlocks - 1);
+
+    if (queuedPercent >= UDPSINKFEC_OVERLOADSHED) {
+        m_shedLevel = std::min(m_shedLevel + 1, 7);
+    } else if ((queuedPercent < UDPSINKFEC_OVERLOADPACE) && (m_shedLevel > 0)) {
+        m_shedLevel--;
+    }
+
+    int shedBlocksFEC = nbBlocksFEC >> m_shedLevel;
+    int64_t encodeBlockNs = m_encodeBlockNs.load(std::memory_order_relaxed);
+
+    if ((encodeBlockNs > 0) && (m_sampleRate > 0))
+    {
+        // the encoders of a pool are shared with other sinks: they are at least as busy as that
+        int nbEncoders = m_encoderPool ? m_encoderPool->getNbThreads() : m_pipelined ? m_encodeThreads.size() : 1;
+        double budgetNs = (frameSamples * 1e9 / m_sampleRate) * nbEncoders * UDPSINKFEC_ENCODEBUDGET / 100.0;
+        shedBlocksFEC = std::min(shedBlocksFEC, (int) std::min(budgetNs / encodeBlockNs, (double) m_maxNbBlocksFEC));
+    }
+
+    if (shedBlocksFEC < nbBlocksFEC)
+    {
+        time_t now = time(0);
+        m_nbShedFrames++;
+        m_nbShedBlocks += nbBlocksFEC - shedBlocksFEC;
+
+        if (now != m_overloadTime) // at most one warning per second
+        {
+            std::cerr << "UDPSinkFEC::write: warning: overload: " << queued << " frames queued, FEC blocks "
+                    << nbBlocksFEC << " -> " << shedBlocksFEC << std::endl;
+            m_overloadTime = now;
+        }
+
+        nbBlocksFEC = shedBlocksFEC;
+    }
+}
+
+/** Hand the frame built to the FEC and sending side and move to the next row of the Tx ring */
+void UDPSinkFEC::completeFrame(int frameSamples)
+{
+    int nbBlocksFEC = m_nbBlocksFEC;
+    MetaDataFEC *metaData = (MetaDataFEC *) &((Header *) txBlock(m_txBlocksIndex, 0))[1];
+    FECCodec *codec = FECCodec::get(metaData->m_fecCodec);
+
+    if (!m_frameSquelched)
+    {
+        if (codec) { // the FEC blocks set may have changed since the frame was cut to its codec
+            nbBlocksFEC = std::min(nbBlocksFEC, std::max(0, codec->getMaxNbBlocks() - m_frameBlocks));
+        }
+
+        if (m_overload.load()) {
+            applyOverload(frameSamples, nbBlocksFEC);
+        }
+
+        setMetaBlocks(*metaData, m_frameBlocks, nbBlocksFEC); // the receivers count the blocks lost from it
+        sealMeta(*metaData);
+    }
+
+    m_txControlBlocks[m_txBlocksIndex].m_frameIndex = m_frameCount;
+    m_txControlBlocks[m_txBlocksIndex].m_nbOriginalBlocks = m_frameBlocks;
+    m_txControlBlocks[m_txBlocksIndex].m_nbBlocksFEC = nbBlocksFEC;
+    m_txControlBlocks[m_txBlocksIndex].m_fecCodec = codec && codec->isInitialized() ? codec : 0;
+    m_txControlBlocks[m_txBlocksIndex].m_txDelay = m_txDelay;
+    m_txControlBlocks[m_txBlocksIndex].m_txBatch = m_txBatch;
+    m_txControlBlocks[m_txBlocksIndex].m_txPace = m_txPace;
+    m_txControlBlocks[m_txBlocksIndex].m_sampleRate = m_sampleRate;
+    m_txControlBlocks[m_txBlocksIndex].m_frameSamples = frameSamples;
+    m_txControlBlocks[m_txBlocksIndex].m_squelched = m_frameSquelched;
+    m_txControlBlocks[m_txBlocksIndex].m_sampleStamp = m_frameStamp;
+    SDMN_TRACE3(frame_complete, m_frameCount, m_txBlocksIndex, frameSamples);
+
+    if (m_frameStamp != 0)
+    {
+        int64_t now = LatencyHistogram::now();
+        m_txControlBlocks[m_txBlocksIndex].m_completeStamp = now;
+        m_frameLatency.record(now - m_frameStamp);
+    }
+
+    // publish the row once its control block is filled: the FEC and sending threads take it from the index
+    {
+        std::unique_lock<std::mutex> lock(m_txMutex);
+        m_txControlBlocks[m_txBlocksIndex].m_processed = false;
+        m_txIndexCurrent.store(m_txBlocksIndex);
+        m_txCond.notify_all();
+    }
+
+    if (m_encoderPool) {
+        m_encoderPool->submit(this, m_txBlocksIndex);
+    }
+
+    int txBlocksIndexNext = (m_txBlocksIndex + 1) % m_nbTxBlocks;
+
+    // The ring is full when the next row is still to be sent. With a shared encoder pool the frames are encoded
+    // as soon as completed so the sender may have caught up with this one and is then waiting at the next row.
+    bool ringFull;
+
+    {
+        std::unique_lock<std::mutex> lock(m_txMutex);
+        ringFull = (txBlocksIndexNext == m_txIndexProcessing.load()) && !m_txControlBlocks[txBlocksIndexNext].m_processed;
+    }
+
+    if (ringFull)
+    {
+        time_t now = time(0);
+        m_txSlowCount++;
+        m_nbTxWaits++;
+
+        if (now != m_txSlowTime) // at most one warning per second
+        {
+            std::cerr << "UDPSinkFEC::write: warning: UDP transmit too slow (" << m_txSlowCount << " times)" << std::endl;
+            m_txSlowTime = now;
+            m_txSlowCount = 0;
+        }
+
+        waitTx([this, txBlocksIndexNext]() { return (txBlocksIndexNext != m_txIndexProcessing.load()) || m_txControlBlocks[txBlocksIndexNext].m_processed; });
+    }
+
+    m_txBlocksIndex = txBlocksIndexNext;
+    m_txBlockIndex = 0;
+    m_frameCount++;
+}
+
+/** Complete the keep-alive frame with the number of silent samples counted */
+void UDPSinkFEC::completeSquelched()
+{
+    MetaDataFEC *metaData = (MetaDataFEC *) &((Header *) txBlock(m_txBlocksIndex, 0))[1];
+    metaData->m_squelchSamples = m_sampleIndex;
+    memcpy((void *) txBlock(m_txBlocksIndex, 1), (const void *) txBlock(m_txBlocksIndex, 0), m_udpSize); // sent twice with FEC as nothing protects it
+    int frameSamples = m_sampleIndex;
+    m_sampleIndex = 0;
+    m_nbSquelchedFrames++;
+    completeFrame(frameSamples);
+}
+
+void UDPSinkFEC::setBlockCRC(bool blockCRC)
+{
+    m_blockCRC = blockCRC;
+    m_protectedBlockSize = m_udpSize - sizeof(Header) - (m_largeFrames ? sizeof(LargeTrailer) : 0) - (blockCRC ? sizeof(uint32_t) : 0);
+    m_samplesPerBlock = m_protectedBlockSize / m_frameSampleBytes;
+}
+
+bool UDPSinkFEC::setCompression(bool compression)
+{
+#ifdef HAS_LZ4
+    m_compression = compression;
+    return true;
+#else
+    return !compression;
+#endif
+}
+
+/** Compress as many of the samples held as fit in the data blocks of the frame started and complete it */
+void UDPSinkFEC::compressFrame()
+{
+#ifdef HAS_LZ4
+    int capacity = (m_frameBlocks - 1) * m_protectedBlockSize;
+    int frameBytes = std::min((int) m_compressInput.size(), UDPSINKFEC_LZ4RATIO * capacity); // bounds the receivers output
+    m_compressOutput.resize(capacity);
+    int compressedBytes = LZ4_compress_destSize((const char *) &m_compressInput[0], (char *) &m_compressOutput[0], &frameBytes, capacity);
+    int nbSamples = frameBytes / m_frameSampleBytes; // a sample cut at the end is sent again in the next frame
+
+    if ((compressedBytes <= 0) || (nbSamples == 0))
+    {
+        std::cerr << "UDPSinkFEC::compressFrame: LZ4 compression error" << std::endl;
+        m_compressInput.clear();
+        return;
+    }
+
+    for (int blockIndex = 1; blockIndex < m_frameBlocks; blockIndex++)
+    {
+        Header *header = (Header *) txBlock(m_txBlocksIndex, blockIndex);
+        uint8_t *data = (uint8_t *) &header[1];
+        int offset = (blockIndex - 1) * m_protectedBlockSize;
+        int length = std::max(0, std::min(m_protectedBlockSize, compressedBytes - offset));
+
+        writeHeader((uint8_t *) header, m_frameCount, blockIndex, m_frameBlocks);
+        memcpy((void *) data, (const void *) &m_compressOutput[offset], length);
+        memset((void *) &data[length], 0, m_protectedBlockSize - length);
+    }
 
-            if (m_txBlockIndex == UDPSINKFEC_NBORIGINALBLOCKS - 1) // frame complete
+    MetaDataFEC *metaData = (MetaDataFEC *) &((Header *) txBlock(m_txBlocksIndex, 0))[1];
+    metaData->m_compressedBytes = compressedBytes;
+    metaData->m_frameBytes = frameBytes;
+    m_compressInput.erase(m_compressInput.begin(), m_compressInput.begin() + nbSamples * m_frameSampleBytes);
+    completeFrame(nbSamples);
+#else
+    m_compressInput.clear(); // not reached: compression can not be set
+#endif
+}
+
+/** Send all the samples held for compression: before a retune or a change of format */
+void UDPSinkFEC::flushCompressed(uint64_t sampleIndex)
+{
+    while (m_frameCompressed && !m_compressInput.empty())
+    {
+        if (m_txBlockIndex == 0) {
+            startFrame(sampleIndex - compressPending());
+        }
+
+        compressFrame();
+    }
+}
+
+/** Copy samples in the frame format: packed, narrowed or as is */
+void UDPSinkFEC::copySamples(uint8_t *out, const IQSample *samples, int nbSamples)
+{
+    switch (m_frameSampleBytes)
+    {
+    case 2:
+        SampleConversion::iqToS8(samples, (int8_t *) out, 2 * nbSamples);
+        break;
+    case 3:
+        SampleConversion::pack12(samples, out, nbSamples);
+        break;
+    default:
+        memcpy((void *) out, (const void *) samples, nbSamples * sizeof(IQSample));
+    }
+}
+
+void UDPSinkFEC::markRetune(uint64_t sampleIndex, uint64_t centerFrequency, uint32_t settleSamples, uint16_t hopCount)
+{
+    std::lock_guard<std::mutex> lock(m_retuneMutex);
+    RetuneMark mark;
+
+    mark.m_sampleIndex = sampleIndex;
+    mark.m_centerFrequency = centerFrequency;
+    mark.m_settleSamples = settleSamples;
+    mark.m_hopCount = hopCount;
+    m_retuneMarks.push_back(mark);
+    m_retunePending = true;
+}
+
+/** The frame being built is only read by the FEC and sending side once complete so its meta data can be updated */
+void UDPSinkFEC::applyRetune(const RetuneMark& mark, uint64_t sampleIndex)
+{
+    setCenterFrequency(mark.m_centerFrequency);
+    m_hopCount = mark.m_hopCount;
+    m_settleEnd = sampleIndex + mark.m_settleSamples;
+
+    if (m_txBlockIndex == 0) // meta data not built yet: the frame starts with the retune
+    {
+        m_frameRetune = true;
+        return;
+    }
+
+    MetaDataFEC *metaData = (MetaDataFEC *) &((Header *) txBlock(m_txBlocksIndex, 0))[1];
+    metaData->m_hopCount = m_hopCount;
+    metaData->m_retuneOffset = m_frameSquelched ? m_sampleIndex : (m_txBlockIndex - 1) * m_samplesPerBlock + m_sampleIndex;
+    metaData->m_retuneFrequency = m_centerFrequency;
+    metaData->m_settleSamples = mark.m_settleSamples;
+}
+
+bool UDPSinkFEC::encodeFrame(int txIndex, CM256::cm256_encoder_params& cm256Params, FECBlock *descriptorBlocks, uint8_t *fecBlocks)
+{
+    uint16_t frameIndex = m_txControlBlocks[txIndex].m_frameIndex;
+    int nbOriginalBlocks = m_txControlBlocks[txIndex].m_nbOriginalBlocks;
+    int nbBlocksFEC = m_txControlBlocks[txIndex].m_nbBlocksFEC;
+    FECCodec *codec = m_txControlBlocks[txIndex].m_fecCodec;
+
+    if ((nbBlocksFEC == 0) || !codec || m_txControlBlocks[txIndex].m_squelched) // original blocks only
+    {
+        if (m_blockCRC) {
+            sealBlocks(txIndex, m_txControlBlocks[txIndex].m_squelched ? 2 : nbOriginalBlocks);
+        }
+
+        return true;
+    }
+
+    cm256Params.BlockBytes = m_protectedBlockSize;
+    cm256Params.OriginalCount = nbOriginalBlocks;
+    cm256Params.RecoveryCount = nbBlocksFEC;
+
+    // Fill pointers to data
+    for (int i = 0; i < cm256Params.OriginalCount + cm256Params.RecoveryCount; ++i)
+    {
+        Header *header = (Header *) txBlock(txIndex, i);
+
+        if (i >= cm256Params.OriginalCount) {
+            memset((void *) &header[1], 0, m_protectedBlockSize);
+        }
+
+        writeHeader((uint8_t *) header, frameIndex, i, nbOriginalBlocks);
+        descriptorBlocks[i].Block = (void *) &header[1];
+        descriptorBlocks[i].Index = i;
+    }
+
+    // Encode FEC blocks
+    int64_t start = LatencyHistogram::now();
+    SDMN_TRACE2(fec_encode_begin, frameIndex, nbBlocksFEC);
+
+    if (codec->encode(cm256Params, descriptorBlocks, fecBlocks))
+    {
+        std::cerr << "UDPSinkFEC::encodeFrame: " << codec->getName() << " encode failed. No transmission." << std::endl;
+        return false;
+    }
+
+    SDMN_TRACE2(fec_encode_end, frameIndex, nbBlocksFEC);
+
+    // running average over about 8 frames, the encoders may race on it
+    int64_t blockNs = (LatencyHistogram::now() - start) / nbBlocksFEC;
+    int64_t encodeBlockNs = m_encodeBlockNs.load(std::memory_order_relaxed);
+    m_encodeBlockNs.store(encodeBlockNs == 0 ? blockNs : encodeBlockNs + (blockNs - encodeBlockNs) / 8, std::memory_order_relaxed);
+    m_nbFramesEncoded++;
+
+    // Merge FEC with data to transmit
+    for (int i = 0; i < cm256Params.RecoveryCount; i++)
+    {
+        memcpy((void *) (txBlock(txIndex, i + cm256Params.OriginalCount) + sizeof(Header)),
+                (const void *) &fecBlocks[i * m_protectedBlockSize],
+                m_protectedBlockSize);
+    }
+
+    if (m_blockCRC) {
+        sealBlocks(txIndex, cm256Params.OriginalCount + cm256Params.RecoveryCount);
+    }
+
+    return true;
+}
+
+/** Flag the superblocks of a frame ready to send and end them with the CRC32C of the rest (block integrity check) */
+void UDPSinkFEC::sealBlocks(int txIndex, int nbBlocks)
+{
+    for (int i = 0; i < nbBlocks; i++)
+    {
+        uint8_t *block = txBlock(txIndex, i);
+        ((Header *) block)->filler |= UDPSINKFEC_BLOCKCRC;
+        uint32_t crc = CRC32C::calculate(block, m_udpSize - sizeof(uint32_t));
+        memcpy((void *) &block[m_udpSize - sizeof(uint32_t)], (const void *) &crc, sizeof(crc));
+    }
+}
+
+/** Send nbFrames frames from the Tx ring row txIndex on, interleaved if more than one */
+void UDPSinkFEC::sendFrames(int txIndex, int nbFrames)
+{
+    bool stamped = m_txControlBlocks[txIndex].m_sampleStamp != 0;
+    int64_t start = stamped ? LatencyHistogram::now() : 0;
+
+    try
+    {
+        if (nbFrames == 1) {
+            sendBlocks(txIndex);
+        } else {
+            sendInterleaved(txIndex, nbFrames);
+        }
+
+        m_nbFramesSent += nbFrames;
+
+        if (stamped)
+        {
+            int64_t end = LatencyHistogram::now();
+
+            for (int k = 0; k < nbFrames; k++)
             {
-                bool countsEqual = false;
-                m_txIndexCurrent.store(m_txBlocksIndex);
-                m_txControlBlocks[m_txBlocksIndex].m_frameIndex = m_frameCount;
-                m_txControlBlocks[m_txBlocksIndex].m_processed = false;
-                m_txControlBlocks[m_txBlocksIndex].m_nbBlocksFEC = m_nbBlocksFEC;
-                m_txControlBlocks[m_txBlocksIndex].m_txDelay = m_txDelay;
-
-//                m_txThread = new std::thread(transmitUDP, this, m_txBlocks[m_txBlocksIndex], m_frameCount, nbBlocksFEC, txDelay, m_cm256Valid);
-//                m_txThread = new std::thread(transmitUDP, this);
-
-                while ((((m_txBlocksIndex + 1) % UDPSINKFEC_NBTXBLOCKS) == m_txIndexProcessing.load())
-                    && m_running.load())
-                {
-                    if (!countsEqual)
-                    {
-                        std::cerr << "UDPSinkFEC::write: warning: UDP transmit too slow" << std::endl;
-                        countsEqual = true;
-                    }
+                const TxControlBlock& control = m_txControlBlocks[(txIndex + k) % m_nbTxBlocks];
 
-                    usleep(100);
+                if (control.m_sampleStamp != 0)
+                {
+                    m_ringLatency.record(start - control.m_completeStamp);
+                    m_sendLatency.record(end - start);
+                    m_endToEndLatency.record(end - control.m_sampleStamp);
                 }
+            }
+        }
+    }
+    catch (CSocketException& e)
+    {
+        // the rest of the frame is lost, the next frames are tried again
+        time_t now = time(0);
+        m_nbSendErrors++;
 
-                m_txBlocksIndex = (m_txBlocksIndex + 1) % UDPSINKFEC_NBTXBLOCKS;
-                m_txBlockIndex = 0;
-                m_frameCount++;
+        if (now != m_sendErrorTime) // at most one message per second
+        {
+            std::cerr << "UDPSinkFEC::sendFrames: " << e.what() << " (" << m_nbSendErrors.load() << " errors)" << std::endl;
+            m_sendErrorTime = now;
+        }
+    }
+}
+
+void UDPSinkFEC::sendBlocks(int txIndex)
+{
+    int txDelay = m_txControlBlocks[txIndex].m_txDelay;
+    int txBatch = m_txControlBlocks[txIndex].m_txBatch;
+    int txPace = m_txControlBlocks[txIndex].m_txPace;
+    uint32_t sampleRate = m_txControlBlocks[txIndex].m_sampleRate;
+    int frameSamples = m_txControlBlocks[txIndex].m_frameSamples;
+#ifdef SDRDAEMON_PUNCTURE
+    int nbOriginalBlocks = m_txControlBlocks[txIndex].m_nbOriginalBlocks;
+#endif
+    int nbBlocks = frameBlocks(txIndex);
+    double intervalUs = 0.0; // pacing interval between datagrams
+
+    if ((txPace > 0) && (sampleRate > 0))
+    {
+        // the frame carries this duration of samples, the first original block is meta data
+        double frameUs = (frameSamples * 1e6) / sampleRate;
+        intervalUs = (frameUs * txPace) / (100.0 * nbBlocks);
+        m_pacer.setMaxLag(frameUs);
+        txDelay = 0;
+    }
+    else
+    {
+        m_pacer.reset();
+    }
+
+    if (txBatch == 0) { // default: the whole frame in one go unless paced
+        txBatch = ((txDelay == 0) && (intervalUs == 0.0)) ? nbBlocks : 1;
+    }
+
+    // overload: the rest of the frame goes at once when too many frames are queued behind it
+    bool shedPacing = m_overload.load() && ((txDelay > 0) || (intervalUs > 0.0));
+    int paceQueued = std::max(1, (UDPSINKFEC_OVERLOADPACE * (m_nbTxBlocks - 1)) / 100);
+    auto behind = [this, txIndex, paceQueued, &shedPacing, &txDelay, &intervalUs]()
+    {
+        if (shedPacing && ((m_txIndexCurrent.load() - txIndex + m_nbTxBlocks) % m_nbTxBlocks >= paceQueued))
+        {
+            shedPacing = false;
+            txDelay = 0;
+            intervalUs = 0.0;
+            m_nbUnpacedFrames++;
+        }
+    };
+
+    if (txBatch > 1)
+    {
+        // Transmit slices of blocks with one system call each. Pacing is done per slice.
+        for (int i = 0; i < nbBlocks; i += txBatch)
+        {
+            int n = (nbBlocks - i < txBatch) ? nbBlocks - i : txBatch;
+            behind();
+
+            if (intervalUs > 0.0) {
+                m_pacer.pace(intervalUs * n);
             }
-            else
+#ifdef SDRDAEMON_PUNCTURE
+            if ((nbBlocks > nbOriginalBlocks) && (i <= SDRDAEMON_PUNCTURE) && (SDRDAEMON_PUNCTURE < i + n))
             {
-                m_txBlockIndex++;
+                m_socket.SendDataGrams((const void *) txBlock(txIndex, i), (int) m_udpSize, SDRDAEMON_PUNCTURE - i);
+                m_socket.SendDataGrams((const void *) txBlock(txIndex, SDRDAEMON_PUNCTURE + 1), (int) m_udpSize, i + n - SDRDAEMON_PUNCTURE - 1);
+            }
+            else
+#endif
+            m_socket.SendDataGrams((const void *) txBlock(txIndex, i), (int) m_udpSize, n);
+            SDMN_TRACE3(udp_send, m_txControlBlocks[txIndex].m_frameIndex, i, n);
+            m_nbBlocksSent += n;
+
+            if (txDelay > 0) {
+                usleep(txDelay * n);
             }
         }
-	}
+
+        return;
+    }
+
+    // Transmit all blocks
+    for (int i = 0; i < nbBlocks; i++)
+    {
+#ifdef SDRDAEMON_PUNCTURE
+        if ((nbBlocks > nbOriginalBlocks) && (i == SDRDAEMON_PUNCTURE)) {
+            continue;
+        }
+#endif
+        behind();
+
+        if (intervalUs > 0.0) {
+            m_pacer.pace(intervalUs);
+        }
+
+        m_socket.SendDataGram((const void *) txBlock(txIndex, i), (int) m_udpSize);
+        SDMN_TRACE3(udp_send, m_txControlBlocks[txIndex].m_frameIndex, i, 1);
+        m_nbBlocksSent++;
+
+        if (txDelay > 0) {
+            usleep(txDelay);
+        }
+    }
 }
 
-void UDPSinkFEC::transmitUDP(UDPSinkFEC *udpSinkFEC)
+/**
+ * Send the frames of nbFrames rows of the Tx ring from txIndex on with their blocks interleaved: block 0 of each
+ * frame, then block 1 of each frame and so on. Consecutive datagrams lost on the link then take at most one block
+ * in nbFrames from each frame. The pacing spreads the datagrams over the duration of all the frames. The settings
+ * of the first frame apply to the whole group.
+ */
+void UDPSinkFEC::sendInterleaved(int txIndex, int nbFrames)
 {
-	CM256::cm256_encoder_params cm256Params;  //!< Main interface with CM256 encoder
-	CM256::cm256_block descriptorBlocks[256]; //!< Pointers to data for CM256 encoder
-	ProtectedBlock fecBlocks[256];   //!< FEC data
-    bool cm256Valid = udpSinkFEC->m_cm256Valid;
+    const TxControlBlock& first = m_txControlBlocks[txIndex];
+    int txDelay = first.m_txDelay;
+    int txBatch = first.m_txBatch;
+    int txPace = first.m_txPace;
+    const void **blocks = &m_interleaveBlocks[0];
+    int nbFrameBlocks[UDPSINKFEC_INTERLEAVEMAX];
+    int maxFrameBlocks = 0;
+    int nbBlocks = 0;
+    double groupUs = 0.0; // duration of the samples carried by the frames
 
-//    std::cerr << "UDPSinkFEC::transmitUDP:"
-//            << " nbBlocksFEC: " << nbBlocksFEC
-//            << " txDelay: " << txDelay << std::endl;
+    for (int k = 0; k < nbFrames; k++)
+    {
+        const TxControlBlock& control = m_txControlBlocks[(txIndex + k) % m_nbTxBlocks];
+        nbFrameBlocks[k] = frameBlocks((txIndex + k) % m_nbTxBlocks);
+        maxFrameBlocks = std::max(maxFrameBlocks, nbFrameBlocks[k]);
 
-	while (udpSinkFEC->m_running.load())
-	{
-        int txIndexProcessing = udpSinkFEC->m_txIndexProcessing.load();
+        if (control.m_sampleRate > 0) {
+            groupUs += (control.m_frameSamples * 1e6) / control.m_sampleRate;
+        }
+    }
 
-        while ((udpSinkFEC->m_txIndexCurrent.load() == txIndexProcessing) && (udpSinkFEC->m_running.load()))
+    for (int i = 0; i < maxFrameBlocks; i++)
+    {
+        for (int k = 0; k < nbFrames; k++)
         {
-            usleep(100);
+            if (i >= nbFrameBlocks[k]) {
+                continue;
+            }
+#ifdef SDRDAEMON_PUNCTURE
+            if ((nbFrameBlocks[k] > m_txControlBlocks[(txIndex + k) % m_nbTxBlocks].m_nbOriginalBlocks) && (i == SDRDAEMON_PUNCTURE)) {
+                continue;
+            }
+#endif
+            blocks[nbBlocks++] = (const void *) txBlock((txIndex + k) % m_nbTxBlocks, i);
         }
+    }
 
-        uint16_t frameIndex = udpSinkFEC->m_txControlBlocks[txIndexProcessing].m_frameIndex;
-        int nbBlocksFEC = udpSinkFEC->m_txControlBlocks[txIndexProcessing].m_nbBlocksFEC;
-        int txDelay = udpSinkFEC->m_txControlBlocks[txIndexProcessing].m_txDelay;
-        SuperBlock *txBlockx = udpSinkFEC->m_txBlocks[txIndexProcessing];
+    double intervalUs = 0.0; // pacing interval between datagrams
 
-        if ((nbBlocksFEC == 0) || !cm256Valid)
+    if ((txPace > 0) && (groupUs > 0.0))
+    {
+        intervalUs = (groupUs * txPace) / (100.0 * nbBlocks);
+        m_pacer.setMaxLag(groupUs);
+        txDelay = 0;
+    }
+    else
+    {
+        m_pacer.reset();
+    }
+
+    if (txBatch == 0) { // default: the whole group in one go unless paced
+        txBatch = ((txDelay == 0) && (intervalUs == 0.0)) ? nbBlocks : 1;
+    }
+
+    // overload: the rest goes at once when too many frames are queued behind the group
+    bool shedPacing = m_overload.load() && ((txDelay > 0) || (intervalUs > 0.0));
+    int paceQueued = std::max(1, (UDPSINKFEC_OVERLOADPACE * (m_nbTxBlocks - 1)) / 100) + nbFrames - 1;
+
+    for (int i = 0; i < nbBlocks; i += txBatch)
+    {
+        int n = (nbBlocks - i < txBatch) ? nbBlocks - i : txBatch;
+
+        if (shedPacing && ((m_txIndexCurrent.load() - txIndex + m_nbTxBlocks) % m_nbTxBlocks >= paceQueued))
         {
-            for (int i = 0; i < UDPSINKFEC_NBORIGINALBLOCKS; i++)
-            {
-                udpSinkFEC->m_socket.SendDataGram((const void *) &txBlockx[i], (int) udpSinkFEC->m_udpSize, udpSinkFEC->m_address, udpSinkFEC->m_port);
-                usleep(txDelay);
-            }
+            shedPacing = false;
+            txDelay = 0;
+            intervalUs = 0.0;
+            m_nbUnpacedFrames += nbFrames;
         }
-        else
+
+        if (intervalUs > 0.0) {
+            m_pacer.pace(intervalUs * n);
+        }
+
+        m_socket.SendDataGramList(&blocks[i], (int) m_udpSize, n);
+        SDMN_TRACE3(udp_send, first.m_frameIndex, i, n);
+        m_nbBlocksSent += n;
+
+        if (txDelay > 0) {
+            usleep(txDelay * n);
+        }
+    }
+}
+
+/** Number of blocks to send of the frame in the Tx ring row txIndex */
+int UDPSinkFEC::frameBlocks(int txIndex) const
+{
+    const TxControlBlock& control = m_txControlBlocks[txIndex];
+
+    if (control.m_squelched) {
+        return control.m_nbBlocksFEC == 0 ? 1 : 2; // the meta data block and its copy
+    }
+
+    return control.m_nbOriginalBlocks + (((control.m_nbBlocksFEC == 0) || !control.m_fecCodec) ? 0 : control.m_nbBlocksFEC);
+}
+
+void UDPSinkFEC::pollFeedback()
+{
+    int maxNbBlocksFEC = m_fecAuto.load();
+
+    if (maxNbBlocksFEC != m_fecController.getMaxNbBlocksFEC()) {
+        m_fecController.setMaxNbBlocksFEC(maxNbBlocksFEC);
+    }
+
+    bool nack = m_nack.load();
+
+    if ((maxNbBlocksFEC == 0) && !nack) {
+        return;
+    }
+
+    m_fecController.setMinTxPace(m_txPaceMin.load());
+    uint8_t buf[64];
+    int len;
+
+    try
+    {
+        while ((len = m_socket.RecvDataGramNoWait((void *) buf, sizeof(buf))) > 0)
         {
-            cm256Params.BlockBytes = sizeof(ProtectedBlock);
-            cm256Params.OriginalCount = UDPSINKFEC_NBORIGINALBLOCKS;
-            cm256Params.RecoveryCount = nbBlocksFEC;
+            FECFeedback *feedback = (FECFeedback *) buf;
 
-            // Fill pointers to data
-            for (int i = 0; i < cm256Params.OriginalCount + cm256Params.RecoveryCount; ++i)
+            if ((len == sizeof(FECNack)) && (((FECNack *) buf)->m_magic == FECNACK_MAGIC))
             {
-                if (i >= cm256Params.OriginalCount) {
-                    memset((void *) &txBlockx[i].protectedBlock, 0, sizeof(ProtectedBlock));
+                if (nack) {
+                    resendBlocks(*((FECNack *) buf));
                 }
 
-                txBlockx[i].header.frameIndex = frameIndex;
-                txBlockx[i].header.blockIndex = i;
-                descriptorBlocks[i].Block = (void *) &(txBlockx[i].protectedBlock);
-                descriptorBlocks[i].Index = txBlockx[i].header.blockIndex;
+                continue;
             }
 
-            // Encode FEC blocks
-            if (udpSinkFEC->m_cm256.cm256_encode(cm256Params, descriptorBlocks, fecBlocks))
+            if ((len != sizeof(FECFeedback)) || (feedback->m_magic != FECFEEDBACK_MAGIC) || (maxNbBlocksFEC == 0)) {
+                continue; // not a report or not used
+            }
+
+            int nbBlocksFEC = m_nbBlocksFEC.load();
+            int txPace = m_txPace.load();
+
+            if (m_fecController.update(*feedback, nbBlocksFEC, txPace))
             {
-                std::cerr << "UDPSinkFEC::transmitUDP: CM256 encode failed. No transmission." << std::endl;
+                std::cerr << "UDPSinkFEC::pollFeedback:"
+                        << " lost frames: " << feedback->m_nbLostFrames << "/" << feedback->m_nbFrames
+                        << " max lost blocks: " << feedback->m_maxLostBlocks
+                        << " -> nbBlocksFEC: " << nbBlocksFEC
+                        << " txPace: " << txPace << "%" << std::endl;
+                m_nbBlocksFEC = nbBlocksFEC;
+                m_txPace = txPace;
+            }
+        }
+    }
+    catch (CSocketException& e)
+    {
+        std::cerr << "UDPSinkFEC::pollFeedback: " << e.what() << std::endl;
+    }
+}
+
+/** Copy the frame just sent for the retransmission requests */
+void UDPSinkFEC::keepFrame(int txIndex)
+{
+    int nbBlocksFEC = m_txControlBlocks[txIndex].m_nbBlocksFEC;
+    int nbOriginalBlocks = m_txControlBlocks[txIndex].m_nbOriginalBlocks;
+    int nbBlocks = m_txControlBlocks[txIndex].m_squelched ? 1 : nbOriginalBlocks + (((nbBlocksFEC == 0) || !m_txControlBlocks[txIndex].m_fecCodec) ? 0 : nbBlocksFEC);
+    uint16_t frameIndex = m_txControlBlocks[txIndex].m_frameIndex;
+    int nackIndex = frameIndex % UDPSINKFEC_NACKFRAMES;
+
+    if (m_nackBlocks.empty()) {
+        m_nackBlocks.resize(UDPSINKFEC_NACKFRAMES * m_frameStride * m_udpSize);
+    }
+
+    memcpy((void *) nackBlock(nackIndex, 0), (const void *) txBlock(txIndex, 0), nbBlocks * m_udpSize);
+    m_nackFrames[nackIndex].m_valid = true;
+    m_nackFrames[nackIndex].m_frameIndex = frameIndex;
+    m_nackFrames[nackIndex].m_nbBlocks = nbBlocks;
+    m_nackFrames[nackIndex].m_nbOriginalBlocks = nbOriginalBlocks;
+    m_nackFrames[nackIndex].m_mds = !m_txControlBlocks[txIndex].m_fecCodec || m_txControlBlocks[txIndex].m_fecCodec->isMDS();
+}
+
+/** Resend the blocks missed by the receiver, original blocks first and no more than it needs to restore the frame */
+void UDPSinkFEC::resendBlocks(const FECNack& nack)
+{
+    int nackIndex = nack.m_frameIndex % UDPSINKFEC_NACKFRAMES;
+    const NackFrame& nackFrame = m_nackFrames[nackIndex];
+
+    if (!nackFrame.m_valid || (nackFrame.m_frameIndex != nack.m_frameIndex)) {
+        return; // too old or not sent yet
+    }
+
+    int nbReceived = 0;
+
+    for (int i = 0; i < 4; i++) {
+        nbReceived += __builtin_popcountll(nack.m_received[i]);
+    }
+
+    int nbNeeded = nackFrame.m_nbOriginalBlocks - nbReceived;
+    int nbBlocks = nackFrame.m_nbBlocks;
+
+    if (!nackFrame.m_mds) // the blocks received may not restore it whatever their count: resend the original blocks missing
+    {
+        nbNeeded = nackFrame.m_nbOriginalBlocks;
+        nbBlocks = nackFrame.m_nbOriginalBlocks;
+    }
+
+    for (int i = 0; (i < nbBlocks) && (nbNeeded > 0); i++)
+    {
+        if (nack.received(i)) {
+            continue;
+        }
+
+        m_socket.SendDataGram((const void *) nackBlock(nackIndex, i), (int) m_udpSize);
+        m_nbResentBlocks++;
+        nbNeeded--;
+    }
+}
+
+void UDPSinkFEC::transmitUDP(UDPSinkFEC *udpSinkFEC)
+{
+	CM256::cm256_encoder_params cm256Params;  //!< Main interface with CM256 encoder
+	FECBlock descriptorBlocks[FECCODEC_NBBLOCKSMAX]; //!< Pointers to data for the FEC encoder
+	AlignedVector<uint8_t> fecBlocks(udpSinkFEC->getFECScratchBytes()); //!< FEC data (the protected block size is only final at the first write)
+
+	while (udpSinkFEC->m_running.load())
+	{
+        int txIndexProcessing = udpSinkFEC->m_txIndexProcessing.load();
+        int nbFrames = udpSinkFEC->interleaveFrames();
+        int nbTxBlocks = udpSinkFEC->m_nbTxBlocks;
+
+        udpSinkFEC->waitTx([udpSinkFEC, txIndexProcessing, nbFrames, nbTxBlocks]() {
+            return (udpSinkFEC->m_txIndexCurrent.load() - txIndexProcessing + nbTxBlocks) % nbTxBlocks >= nbFrames;
+        });
+
+        if (!udpSinkFEC->m_running.load()) {
+            break;
+        }
+
+        for (int k = 0; k < nbFrames; k++)
+        {
+            if (!udpSinkFEC->encodeFrame((txIndexProcessing + k) % nbTxBlocks, cm256Params, descriptorBlocks, &fecBlocks[0])) {
                 return;
             }
+        }
 
-            // Merge FEC with data to transmit
-            for (int i = 0; i < cm256Params.RecoveryCount; i++)
-            {
-                txBlockx[i + cm256Params.OriginalCount].protectedBlock = fecBlocks[i];
+        udpSinkFEC->pollFeedback(); // resend before the next frame the blocks asked for meanwhile
+        udpSinkFEC->sendFrames(txIndexProcessing, nbFrames);
+
+        if (udpSinkFEC->m_nack.load() && (nbFrames == 1)) {
+            udpSinkFEC->keepFrame(txIndexProcessing);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(udpSinkFEC->m_txMutex);
+
+            for (int k = 0; k < nbFrames; k++) {
+                udpSinkFEC->m_txControlBlocks[(txIndexProcessing + k) % nbTxBlocks].m_processed = true;
+            }
+
+            udpSinkFEC->m_txIndexProcessing.store((txIndexProcessing + nbFrames) % nbTxBlocks);
+            udpSinkFEC->m_txCond.notify_all();
+        }
+
+        udpSinkFEC->pollFeedback();
+	}
+}
+
+/**
+ * Pipelined mode first stage: FEC encode frames as they are completed by write.
+ * Several of these may run: each one takes the next completed row and encodes it in place
+ * with its own scratch FEC buffer so consecutive frames are encoded in parallel.
+ */
+void UDPSinkFEC::encodeUDP(UDPSinkFEC *udpSinkFEC)
+{
+	CM256::cm256_encoder_params cm256Params;  //!< Main interface with CM256 encoder
+	FECBlock descriptorBlocks[FECCODEC_NBBLOCKSMAX]; //!< Pointers to data for the FEC encoder
+	AlignedVector<uint8_t> fecBlocks(udpSinkFEC->getFECScratchBytes()); //!< FEC data (the protected block size is only final at the first write)
+
+	while (udpSinkFEC->m_running.load())
+	{
+        int txIndexEncoding;
+
+        {
+            std::unique_lock<std::mutex> lock(udpSinkFEC->m_txMutex);
+            udpSinkFEC->m_txCond.wait(lock, [udpSinkFEC]() {
+                return (udpSinkFEC->m_txIndexCurrent.load() != udpSinkFEC->m_txIndexEncoding.load()) || !udpSinkFEC->m_running.load();
+            });
+
+            if (!udpSinkFEC->m_running.load()) {
+                break;
             }
 
-            // Transmit all blocks
-            for (int i = 0; i < cm256Params.OriginalCount + cm256Params.RecoveryCount; i++)
+            // write cannot reuse the row before it is sent so the encoders never get ahead of the sender by a full turn
+            txIndexEncoding = udpSinkFEC->m_txIndexEncoding.load();
+            udpSinkFEC->m_txIndexEncoding.store((txIndexEncoding + 1) % udpSinkFEC->m_nbTxBlocks);
+        }
+
+        if (!udpSinkFEC->encodeFrame(txIndexEncoding, cm256Params, descriptorBlocks, &fecBlocks[0])) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(udpSinkFEC->m_txMutex);
+        udpSinkFEC->m_txControlBlocks[txIndexEncoding].m_encoded = true;
+        udpSinkFEC->m_txCond.notify_all();
+	}
+}
+
+/**
+ * Pipelined mode first stage on a thread of the shared encoder pool. The frame is sent without
+ * its FEC blocks if the encoding fails so that the sending thread does not wait for it.
+ */
+void UDPSinkFEC::encodePooled(int txIndex, CM256::cm256_encoder_params& cm256Params, FECBlock *descriptorBlocks, uint8_t *fecBlocks)
+{
+    if (!encodeFrame(txIndex, cm256Params, descriptorBlocks, fecBlocks)) {
+        m_txControlBlocks[txIndex].m_nbBlocksFEC = 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_txMutex);
+    m_txControlBlocks[txIndex].m_encoded = true;
+    m_txCond.notify_all();
+}
+
+/** Pipelined mode second stage: send frames in order once encoded */
+void UDPSinkFEC::sendUDP(UDPSinkFEC *udpSinkFEC)
+{
+	while (udpSinkFEC->m_running.load())
+	{
+        int txIndexProcessing = udpSinkFEC->m_txIndexProcessing.load();
+        int nbFrames = udpSinkFEC->interleaveFrames();
+        int nbTxBlocks = udpSinkFEC->m_nbTxBlocks;
+
+        udpSinkFEC->waitTx([udpSinkFEC, txIndexProcessing, nbFrames, nbTxBlocks]() {
+            for (int k = 0; k < nbFrames; k++)
             {
-    #ifdef SDRDAEMON_PUNCTURE
-                if (i == SDRDAEMON_PUNCTURE) {
-                    continue;
+                if (!udpSinkFEC->m_txControlBlocks[(txIndexProcessing + k) % nbTxBlocks].m_encoded) {
+                    return false;
                 }
-    #endif
-    //            std::cerr << "UDPSinkFEC::transmitUDP:"
-    //                  << " i: " << i
-    //                  << " frameIndex: " << (int) m_txBlocks[i].header.frameIndex
-    //                  << " blockIndex: " << (int) m_txBlocks[i].header.blockIndex
-    //                  << " i.q:";
-    //
-    //            for (int j = 0; j < 10; j++)
-    //            {
-    //                std::cerr << " " << (int) m_txBlocks[i].protectedBlock.m_samples[j].m_real
-    //                        << "." << (int) m_txBlocks[i].protectedBlock.m_samples[j].m_imag;
-    //            }
-    //
-    //            std::cerr << std::endl;
-
-                udpSinkFEC->m_socket.SendDataGram((const void *) &txBlockx[i], (int) udpSinkFEC->m_udpSize, udpSinkFEC->m_address, udpSinkFEC->m_port);
-                usleep(txDelay);
             }
+
+            return true;
+        });
+
+        if (!udpSinkFEC->m_running.load()) {
+            break;
+        }
+
+        udpSinkFEC->pollFeedback(); // resend before the next frame the blocks asked for meanwhile
+        udpSinkFEC->sendFrames(txIndexProcessing, nbFrames);
+
+        if (udpSinkFEC->m_nack.load() && (nbFrames == 1)) {
+            udpSinkFEC->keepFrame(txIndexProcessing);
+        }
+
+        std::unique_lock<std::mutex> lock(udpSinkFEC->m_txMutex);
+
+        for (int k = 0; k < nbFrames; k++)
+        {
+            udpSinkFEC->m_txControlBlocks[(txIndexProcessing + k) % nbTxBlocks].m_encoded = false;
+            udpSinkFEC->m_txControlBlocks[(txIndexProcessing + k) % nbTxBlocks].m_processed = true;
         }
 
-        udpSinkFEC->m_txControlBlocks[txIndexProcessing].m_processed = true;
-        udpSinkFEC->m_txIndexProcessing.store((txIndexProcessing + 1) % UDPSINKFEC_NBTXBLOCKS);
+        udpSinkFEC->m_txIndexProcessing.store((txIndexProcessing + nbFrames) % nbTxBlocks);
+        udpSinkFEC->m_txCond.notify_all();
+        lock.unlock();
+        udpSinkFEC->pollFeedback();
 	}
 }
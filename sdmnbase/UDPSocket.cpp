@@ -28,6 +28,14 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <net/if.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103 // Linux 4.18 and later
+#endif
 
 CSocketException::CSocketException( const string &sMessage, bool blSysMsg /*= false*/ ) throw() :m_sMsg(sMessage)
 {
@@ -155,6 +163,63 @@ void CSocket::SetReadBufferSize( unsigned int nSize ) throw(CSocketException)
     }
 }
 
+void CSocket::SetReadTimeout( unsigned int timeoutMs ) throw(CSocketException)
+{
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+
+    if (setsockopt(m_sockDesc, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1)
+    {
+        throw CSocketException("Error in setting socket read timeout ", true);
+    }
+}
+
+void CSocket::SetReusePort( bool reusePort ) throw(CSocketException)
+{
+    int optval = reusePort ? 1 : 0;
+
+    if (setsockopt(m_sockDesc, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) == -1)
+    {
+        throw CSocketException("Error in setting socket address port reuse ", true);
+    }
+}
+
+void CSocket::SetTimestamping( bool hardware ) throw(CSocketException)
+{
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+
+    if (hardware) {
+        flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    }
+
+    if (setsockopt(m_sockDesc, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == -1)
+    {
+        throw CSocketException("Error in setting socket timestamping ", true);
+    }
+}
+
+void CSocket::SetDropFilter( bool drop ) throw(CSocketException)
+{
+    if (drop)
+    {
+        struct sock_filter filter[] = { { BPF_RET | BPF_K, 0, 0, 0 } }; // keep 0 bytes: drop
+        struct sock_fprog fprog;
+        fprog.len = 1;
+        fprog.filter = filter;
+
+        if (setsockopt(m_sockDesc, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == -1)
+        {
+            throw CSocketException("Error in attaching socket filter ", true);
+        }
+    }
+    else
+    {
+        int dummy = 0;
+        setsockopt(m_sockDesc, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy)); // fails if none attached
+    }
+}
+
 void CSocket::SetNonBlocking( bool bBlocking ) throw(CSocketException)
 {
     int opts;
@@ -310,20 +375,26 @@ void CSocket::SetBindToDevice( const string& sInterface ) throw(CSocketException
     }*/
 }
 
-UDPSocket::UDPSocket() throw(CSocketException):CSocket(UdpSocket,IPv4Protocol)
+UDPSocket::UDPSocket() throw(CSocketException):CSocket(UdpSocket,IPv4Protocol),
+m_connected(false),
+m_gso(false)
 {
     SetBroadcast();
 }
 
 UDPSocket::UDPSocket( unsigned short localPort ) throw(CSocketException):
-CSocket(UdpSocket,IPv4Protocol)
+CSocket(UdpSocket,IPv4Protocol),
+m_connected(false),
+m_gso(false)
 {
     BindLocalPort(localPort);
     SetBroadcast();
 }
 
 UDPSocket::UDPSocket( const string &localAddress, unsigned short localPort ) throw(CSocketException):
-CSocket(UdpSocket,IPv4Protocol)
+CSocket(UdpSocket,IPv4Protocol),
+m_connected(false),
+m_gso(false)
 {
     BindLocalAddressAndPort(localAddress, localPort);
     SetBroadcast();
@@ -342,6 +413,42 @@ void UDPSocket::DisconnectFromHost() throw(CSocketException)
             throw CSocketException("Disconnect failed (connect())", true);
         }
     }
+
+    m_connected = false;
+}
+
+void UDPSocket::SetForeignAddress( const string &foreignAddress, unsigned short foreignPort, bool connectSocket )
+    throw(CSocketException)
+{
+    sockaddr_in destAddr;
+    FillAddr(foreignAddress, foreignPort, destAddr);
+
+    if (m_connected) {
+        DisconnectFromHost();
+    }
+
+    m_foreignAddrs.assign(1, destAddr);
+
+    if (connectSocket)
+    {
+        if (::connect(m_sockDesc, (sockaddr *) &m_foreignAddrs[0], sizeof(sockaddr_in)) < 0) {
+            throw CSocketException("Connect failed (connect())", true);
+        }
+
+        m_connected = true;
+    }
+}
+
+void UDPSocket::AddForeignAddress( const string &foreignAddress, unsigned short foreignPort )
+    throw(CSocketException)
+{
+    if (m_connected) {
+        throw CSocketException("Cannot add a destination to a connected socket", false);
+    }
+
+    sockaddr_in destAddr;
+    FillAddr(foreignAddress, foreignPort, destAddr);
+    m_foreignAddrs.push_back(destAddr);
 }
 
 void UDPSocket::SendDataGram( const void *buffer, int bufferLen, const string &foreignAddress,
@@ -359,6 +466,235 @@ void UDPSocket::SendDataGram( const void *buffer, int bufferLen, const string &f
 
 }
 
+void UDPSocket::SendDataGrams( const void *buffer, int bufferLen, int count, const string &foreignAddress,
+    unsigned short foreignPort )  throw(CSocketException)
+{
+    sockaddr_in destAddr;
+    FillAddr(foreignAddress, foreignPort, destAddr);
+    SendDataGrams(buffer, bufferLen, count, &destAddr);
+}
+
+void UDPSocket::SendDataGram( const void *buffer, int bufferLen )  throw(CSocketException)
+{
+    if (m_foreignAddrs.empty()) {
+        throw CSocketException("Send failed (no foreign address)", false);
+    }
+
+    for (std::vector<sockaddr_in>::iterator it = m_foreignAddrs.begin(); it != m_foreignAddrs.end();)
+    {
+        ssize_t sent = m_connected ?
+                send(m_sockDesc, buffer, bufferLen, 0) :
+                sendto(m_sockDesc, buffer, bufferLen, 0, (sockaddr *) &(*it), sizeof(sockaddr_in));
+
+        // a connected socket reports an earlier ICMP port unreachable once, the datagram itself was not sent
+        if ((sent < 0) && m_connected && (errno == ECONNREFUSED)) {
+            continue;
+        }
+
+        if (sent != bufferLen) {
+            throw CSocketException("Send failed (send())", true);
+        }
+
+        ++it;
+    }
+}
+
+void UDPSocket::SendDataGrams( const void *buffer, int bufferLen, int count )  throw(CSocketException)
+{
+    if (m_foreignAddrs.empty()) {
+        throw CSocketException("Send failed (no foreign address)", false);
+    }
+
+    // the same buffer goes to every destination: it is built (and FEC encoded) only once
+    for (std::vector<sockaddr_in>::iterator it = m_foreignAddrs.begin(); it != m_foreignAddrs.end(); ++it)
+    {
+        sockaddr_in *destAddr = m_connected ? 0 : &(*it);
+
+        if (m_gso && (count > 1))
+        {
+            if (SendSegmented(buffer, bufferLen, count, destAddr)) {
+                continue;
+            }
+
+            std::cerr << "UDPSocket::SendDataGrams: UDP segmentation offload not supported: " << strerror(errno)
+                    << ": using sendmmsg" << std::endl;
+            m_gso = false;
+        }
+
+        SendDataGrams(buffer, bufferLen, count, destAddr);
+    }
+}
+
+void UDPSocket::SendDataGramList( const void * const *buffers, int bufferLen, int count )  throw(CSocketException)
+{
+    if (m_foreignAddrs.empty()) {
+        throw CSocketException("Send failed (no foreign address)", false);
+    }
+
+    for (std::vector<sockaddr_in>::iterator it = m_foreignAddrs.begin(); it != m_foreignAddrs.end(); ++it) {
+        SendDataGramList(buffers, bufferLen, count, m_connected ? 0 : &(*it));
+    }
+}
+
+/** Returns false if segmentation offload is not supported, nothing has been sent then */
+bool UDPSocket::SendSegmented( const void *buffer, int bufferLen, int count, sockaddr_in *destAddr )  throw(CSocketException)
+{
+    // at most UDP_MAX_SEGMENTS (64) datagrams and 64kB in one send
+    int maxSegments = 65000 / bufferLen < 64 ? 65000 / bufferLen : 64;
+    const char *p = (const char *) buffer;
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    bool first = true;
+
+    while (count > 0)
+    {
+        int segments = count < maxSegments ? count : maxSegments;
+        iovec iov;
+        msghdr msg;
+
+        iov.iov_base = (void *) p;
+        iov.iov_len = segments * bufferLen;
+        memset(&msg, 0, sizeof(msg));
+        memset(control, 0, sizeof(control));
+        msg.msg_name = (void *) destAddr; // null when connected
+        msg.msg_namelen = destAddr ? sizeof(sockaddr_in) : 0;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *((uint16_t *) CMSG_DATA(cm)) = bufferLen;
+
+        ssize_t sent = sendmsg(m_sockDesc, &msg, 0);
+
+        if (sent < 0)
+        {
+            if ((errno == EINTR) || ((errno == ECONNREFUSED) && !destAddr)) {
+                continue;
+            }
+
+            if (first && ((errno == EINVAL) || (errno == EIO) || (errno == ENOPROTOOPT) || (errno == EOPNOTSUPP))) {
+                return false;
+            }
+
+            throw CSocketException("Send failed (sendmsg() UDP_SEGMENT)", true);
+        }
+
+        if (sent != (ssize_t) iov.iov_len) {
+            throw CSocketException("Send failed (sendmsg() UDP_SEGMENT short send)", false);
+        }
+
+        first = false;
+        p += sent;
+        count -= segments;
+    }
+
+    return true;
+}
+
+void UDPSocket::SendDataGrams( const void *buffer, int bufferLen, int count, sockaddr_in *destAddr )
+    throw(CSocketException)
+{
+    static const int maxBatch = 64;
+    mmsghdr msgs[maxBatch];
+    iovec iovecs[maxBatch];
+    const char *p = (const char *) buffer;
+
+    memset(msgs, 0, sizeof(msgs));
+
+    for (int i = 0; i < maxBatch; i++)
+    {
+        iovecs[i].iov_len = bufferLen;
+        msgs[i].msg_hdr.msg_name = (void *) destAddr; // null when connected
+        msgs[i].msg_hdr.msg_namelen = destAddr ? sizeof(sockaddr_in) : 0;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (count > 0)
+    {
+        int batch = count < maxBatch ? count : maxBatch;
+
+        for (int i = 0; i < batch; i++) {
+            iovecs[i].iov_base = (void *) (p + i*bufferLen);
+        }
+
+        // the kernel may stop short of the batch (e.g. interrupted) then the rest is resubmitted
+        int sent = sendmmsg(m_sockDesc, msgs, batch, 0);
+
+        if (sent < 0)
+        {
+            if ((errno == EINTR) || ((errno == ECONNREFUSED) && !destAddr)) {
+                continue;
+            }
+
+            throw CSocketException("Send failed (sendmmsg())", true);
+        }
+
+        for (int i = 0; i < sent; i++)
+        {
+            if (msgs[i].msg_len != (unsigned int) bufferLen) {
+                throw CSocketException("Send failed (sendmmsg() short datagram)", false);
+            }
+        }
+
+        p += sent*bufferLen;
+        count -= sent;
+    }
+}
+
+void UDPSocket::SendDataGramList( const void * const *buffers, int bufferLen, int count, sockaddr_in *destAddr )
+    throw(CSocketException)
+{
+    static const int maxBatch = 64;
+    mmsghdr msgs[maxBatch];
+    iovec iovecs[maxBatch];
+
+    memset(msgs, 0, sizeof(msgs));
+
+    for (int i = 0; i < maxBatch; i++)
+    {
+        iovecs[i].iov_len = bufferLen;
+        msgs[i].msg_hdr.msg_name = (void *) destAddr; // null when connected
+        msgs[i].msg_hdr.msg_namelen = destAddr ? sizeof(sockaddr_in) : 0;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while (count > 0)
+    {
+        int batch = count < maxBatch ? count : maxBatch;
+
+        for (int i = 0; i < batch; i++) {
+            iovecs[i].iov_base = (void *) buffers[i];
+        }
+
+        int sent = sendmmsg(m_sockDesc, msgs, batch, 0);
+
+        if (sent < 0)
+        {
+            if ((errno == EINTR) || ((errno == ECONNREFUSED) && !destAddr)) {
+                continue;
+            }
+
+            throw CSocketException("Send failed (sendmmsg())", true);
+        }
+
+        for (int i = 0; i < sent; i++)
+        {
+            if (msgs[i].msg_len != (unsigned int) bufferLen) {
+                throw CSocketException("Send failed (sendmmsg() short datagram)", false);
+            }
+        }
+
+        buffers += sent;
+        count -= sent;
+    }
+}
+
 int UDPSocket::RecvDataGram( void *buffer, int bufferLen, string &sourceAddress, unsigned short &sourcePort )
     throw(CSocketException)
 {
@@ -377,6 +713,105 @@ int UDPSocket::RecvDataGram( void *buffer, int bufferLen, string &sourceAddress,
     return nBytes;
 }
 
+int UDPSocket::RecvDataGramNoWait( void *buffer, int bufferLen ) throw(CSocketException)
+{
+    while (true)
+    {
+        ssize_t nBytes = recv(m_sockDesc, buffer, bufferLen, MSG_DONTWAIT);
+
+        if (nBytes >= 0) {
+            return nBytes;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        // a connected socket reports an earlier ICMP port unreachable on receive as well
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == ECONNREFUSED)) {
+            return 0;
+        }
+
+        throw CSocketException("Receive failed (recv())", true);
+    }
+}
+
+int UDPSocket::RecvDataGrams( void *buffer, int bufferLen, int count, int *lengths, sockaddr_in *sourceAddrs, timespec *timestamps )
+    throw(CSocketException)
+{
+    static const int maxBatch = 64;
+    static const int controlLen = CMSG_SPACE(sizeof(scm_timestamping));
+    mmsghdr msgs[maxBatch];
+    iovec iovecs[maxBatch];
+    char control[maxBatch][controlLen];
+    char *p = (char *) buffer;
+
+    if (count > maxBatch) {
+        count = maxBatch;
+    }
+
+    memset(msgs, 0, count * sizeof(mmsghdr));
+
+    for (int i = 0; i < count; i++)
+    {
+        iovecs[i].iov_base = (void *) (p + i*bufferLen);
+        iovecs[i].iov_len = bufferLen;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+
+        if (sourceAddrs)
+        {
+            msgs[i].msg_hdr.msg_name = (void *) &sourceAddrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+
+        if (timestamps)
+        {
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = controlLen;
+        }
+    }
+
+    while (true)
+    {
+        int received = recvmmsg(m_sockDesc, msgs, count, MSG_WAITFORONE, 0);
+
+        if (received < 0)
+        {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return 0; // read timeout
+            }
+
+            throw CSocketException("Receive failed (recvmmsg())", true);
+        }
+
+        for (int i = 0; i < received; i++) {
+            lengths[i] = msgs[i].msg_len;
+        }
+
+        for (int i = 0; timestamps && (i < received); i++)
+        {
+            timestamps[i].tv_sec = 0;
+            timestamps[i].tv_nsec = 0;
+
+            for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+            {
+                if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPING))
+                {
+                    scm_timestamping *stamps = (scm_timestamping *) CMSG_DATA(cmsg);
+                    timestamps[i] = (stamps->ts[2].tv_sec != 0) ? stamps->ts[2] : stamps->ts[0]; // hardware if any else software
+                }
+            }
+        }
+
+        return received;
+    }
+}
+
 void UDPSocket::SetMulticastTTL( unsigned char multicastTTL ) throw(CSocketException)
 {
     if (setsockopt(m_sockDesc, IPPROTO_IP, IP_MULTICAST_TTL, (void *) &multicastTTL, sizeof(multicastTTL)) < 0)
@@ -25,7 +25,8 @@ UDPSource::UDPSource(const std::string& address, unsigned int port, unsigned int
 		m_udpSize(udpSize),
 		m_sampleBytes(1),
 		m_sampleBits(8),
-		m_nbSamples(0)
+		m_nbSamples(0),
+		m_sampleRate(0)
 {
 	m_currentMeta.init();
 	m_bufMeta = new uint8_t[m_udpSize];
@@ -24,57 +24,228 @@
 #include <boost/crc.hpp>
 #include <boost/cstdint.hpp>
 #include "UDPSourceFEC.h"
+#include "CRC32C.h"
+#include "util.h"
 
 //#define SDRDAEMON_PUNCTURE 101 // debug: test FEC
 
 UDPSourceFEC::UDPSourceFEC(const std::string& address, unsigned int port) :
-    UDPSource::UDPSource(address, port, UDPSOURCEFEC_UDPSIZE),
+    UDPSource::UDPSource(address, port, UDPSOURCEFEC_UDPSIZEMAX),
+    m_timestamping(false),
+    m_rxCount(0),
+    m_rxNext(0),
     m_rxThread(0),
-	m_rxBlockIndex(0),
-	m_rxBlocksIndex(0),
-	m_frameCount(0),
-	m_sampleIndex(0)
+    m_rxRunning(false),
+    m_rxFrames(UDPSOURCEFEC_NBRXFRAMES),
+    m_rxFramesPool(UDPSOURCEFEC_NBRXFRAMES),
+    m_rxDropTime(0),
+	m_feedback(false),
+	m_feedbackTime(0),
+	m_nack(false)
 {
     m_currentMetaFEC.init();
-    m_udpReceived.store(true);
+    m_rxBlocks.resize(UDPSOURCEFEC_RXBATCH * m_udpSize);
+    m_rxLengths.resize(UDPSOURCEFEC_RXBATCH);
+    m_rxAddrs.resize(UDPSOURCEFEC_RXBATCH);
+    m_rxStamps.resize(UDPSOURCEFEC_RXBATCH);
+    m_rxPtrs.resize(UDPSOURCEFEC_RXBATCH);
+
+    for (int i = 0; i < UDPSOURCEFEC_RXBATCH; i++) {
+        m_rxPtrs[i] = &m_rxBlocks[i * m_udpSize];
+    }
+
+    memset(&m_senderAddr, 0, sizeof(m_senderAddr));
+    m_rxFrames.set_pool(&m_rxFramesPool);
+    m_feedbackReport.init();
     m_socket.BindLocalAddressAndPort(m_address, m_port);
 }
 
 UDPSourceFEC::~UDPSourceFEC()
 {
-	if (m_rxThread)
-	{
-		m_rxThread->join();
-		delete m_rxThread;
-	}
+    setReceiveThread(false);
+}
+
+void UDPSourceFEC::setReceiveThread(bool receiveThread)
+{
+    if (receiveThread && !m_rxThread)
+    {
+        m_socket.SetReadTimeout(UDPSOURCEFEC_RXTIMEOUT);
+        m_rxRunning.store(true);
+        m_rxThread = new std::thread(receiveFrames, this);
+        set_thread_name(m_rxThread->native_handle(), "sdmn-udprx");
+    }
+    else if (!receiveThread && m_rxThread)
+    {
+        m_rxRunning.store(false);
+        m_rxThread->join();
+        delete m_rxThread;
+        m_rxThread = 0;
+    }
+}
+
+bool UDPSourceFEC::setPacketRing(const std::string& interface)
+{
+    if (!m_packetRing.open(interface, m_port))
+    {
+        std::cerr << m_packetRing.error() << std::endl;
+        return false;
+    }
+
+    try
+    {
+        m_socket.SetDropFilter(true); // stays bound for the host not to answer port unreachable
+    }
+    catch (CSocketException& e)
+    {
+        std::cerr << "UDPSourceFEC::setPacketRing: " << e.what() << std::endl;
+    }
+
+    std::cerr << "UDPSourceFEC::setPacketRing: receiving through a packet ring on " << interface << std::endl;
+    return true;
+}
+
+bool UDPSourceFEC::setCapture(const std::string& filename)
+{
+    if (!m_capture.open(filename))
+    {
+        std::cerr << m_capture.error() << std::endl;
+        return false;
+    }
+
+    std::cerr << "UDPSourceFEC::setCapture: recording the datagrams received to " << filename << std::endl;
+    return true;
+}
+
+void UDPSourceFEC::setTimestamping(bool timestamping, bool hardware)
+{
+    if (timestamping && !m_packetRing) // the packet ring always has kernel timestamps
+    {
+        try
+        {
+            m_socket.SetTimestamping(hardware);
+        }
+        catch (CSocketException& e)
+        {
+            std::cerr << "UDPSourceFEC::setTimestamping: " << e.what() << std::endl;
+            return;
+        }
+    }
+
+    m_timestamping = timestamping;
+    m_latencyStats.reset();
+}
+
+void UDPSourceFEC::setNack(bool nack)
+{
+    m_nack = nack;
+    m_sdmnFECBuffer.setNack(nack);
 }
 
 void UDPSourceFEC::read(IQSampleVector& samples_out)
 {
-    SuperBlock superBlock;
+    if (m_rxThread)
+    {
+        m_rxFrames.recycle(std::move(samples_out));
+        samples_out.clear();
+        m_rxFrames.pull(samples_out); // stays empty when the receive thread is stopped
+    }
+    else
+    {
+        readFrame(samples_out);
+    }
+}
+
+/** Receive UDP blocks until a frame is output by the FEC decoder. Returns false if the receive thread is stopped meanwhile */
+bool UDPSourceFEC::readFrame(IQSampleVector& samples_out)
+{
     bool dataAvailable = false;
-    uint8_t data[128*512];
-    std::size_t dataLength;
 
     while (!dataAvailable)
     {
-        int received = receiveUDP(this, &superBlock);
+        if (m_rxNext == m_rxCount) // batch used up: get all the blocks queued in the socket at once
+        {
+            m_rxCount = receiveUDP(this);
+            m_rxNext = 0;
+
+            if ((m_rxCount == 0) && !m_rxRunning.load()) { // receive timeout: only set with the receive thread
+                return false;
+            }
+
+            continue;
+        }
 
-        if (received == sizeof(SuperBlock))
+        // blocks left after a complete frame are kept for the next read
+        int received = m_rxLengths[m_rxNext];
+        uint8_t *rxBlock = m_rxPtrs[m_rxNext];
+        m_rxNext++;
+
+        if (received > 0)
         {
-            dataAvailable = m_sdmnFECBuffer.writeAndRead((uint8_t*) &superBlock, data, dataLength);
+            if (m_timestamping) {
+                updateLatency(rxBlock, received, m_rxStamps[m_rxNext-1]);
+            }
+
+            dataAvailable = m_sdmnFECBuffer.write(rxBlock, received);
+
+            if (m_nack) {
+                sendNacks();
+            }
         }
     }
 
-    // Each complete read returns a complete frame of 127*127 samples (127 data blocks of 128 samples less the 1 sample header)
-    // that is 127*127*4 = 64516 bytes
+    if (m_feedback) {
+        updateFeedback();
+    }
+
+    // Each complete read returns a complete frame of 127 data blocks (the first of the 128 original blocks is meta data)
+    // or less when the sender shortens the frames (frameblk, framems)
+    // With 512 bytes datagrams that is 127*127 samples (128 samples less the 1 sample header) or 127*127*4 = 64516 bytes
+    // The decoded data is read in place in the decoder slot: the only copy is to the output samples (unpacking packed frames)
+    std::size_t nbSamples = m_sdmnFECBuffer.getFrameNbSamples();
 
-    if (dataLength > 0)
+    if (nbSamples > 0)
     {
-        samples_out.resize(dataLength/4);
-        memcpy(&samples_out[0], data, dataLength);
+        m_sampleRate = m_sdmnFECBuffer.getOutputMeta().m_sampleRate;
+        samples_out.resize(nbSamples);
+        m_sdmnFECBuffer.getFrameSamples((SDRdaemonFECBuffer::Sample *) &samples_out[0]);
 //        fprintf(stderr, "UDPSourceFEC::read %lu bytes\n", dataLength); // always 64516 bytes
     }
+
+    return true;
+}
+
+/** Receive thread: decode frames continuously and queue them for read() */
+void UDPSourceFEC::receiveFrames(UDPSourceFEC *udpSourceFEC)
+{
+    IQSampleVector frame;
+    std::size_t frameSize = (UDPSOURCEFEC_NBORIGINALBLOCKS - 1) * ((UDPSOURCEFEC_UDPSIZE - 4) / 4); // resized by readFrame()
+
+    while (udpSourceFEC->m_rxRunning.load())
+    {
+        udpSourceFEC->m_rxFrames.get_vector(frame, frameSize); // recycled vector: no allocation in steady state
+
+        if (!udpSourceFEC->readFrame(frame) || frame.empty()) {
+            continue;
+        }
+
+        frameSize = frame.size();
+        std::size_t droppedBlocks = udpSourceFEC->m_rxFrames.dropped_blocks();
+        udpSourceFEC->m_rxFrames.push(std::move(frame));
+
+        if (udpSourceFEC->m_rxFrames.dropped_blocks() != droppedBlocks)
+        {
+            time_t now = time(0);
+
+            if (now != udpSourceFEC->m_rxDropTime) // at most once per second
+            {
+                fprintf(stderr, "UDPSourceFEC::receiveFrames: frame queue full: %lu frames dropped\n",
+                        (unsigned long) udpSourceFEC->m_rxFrames.dropped_blocks());
+                udpSourceFEC->m_rxDropTime = now;
+            }
+        }
+    }
+
+    udpSourceFEC->m_rxFrames.push_end();
 }
 
 void UDPSourceFEC::getStatusMessage(char *messageBuffer)
@@ -82,24 +253,157 @@ void UDPSourceFEC::getStatusMessage(char *messageBuffer)
     int msgLen = strlen(messageBuffer);
     int statusCode;
     int minNbBlocks = m_sdmnFECBuffer.getMinNbBlocks();
+    int nbOriginalBlocks = m_sdmnFECBuffer.getCurNbOriginalBlocks();
 
-    if (minNbBlocks < UDPSOURCEFEC_NBORIGINALBLOCKS) {
+    if (minNbBlocks < nbOriginalBlocks) {
         statusCode = 1; // Some data is definitely lost
-    } else if (minNbBlocks < UDPSOURCEFEC_NBORIGINALBLOCKS + m_sdmnFECBuffer.getCurrentMeta().m_nbFECBlocks) {
+    } else if (minNbBlocks < nbOriginalBlocks + SDRdaemonFECBuffer::metaNbFECBlocks(m_sdmnFECBuffer.getCurrentMeta())) {
         statusCode = 0; // Recovereable or unknown
     } else {
         statusCode = 2; // all OK
     }
 
     sprintf(&messageBuffer[msgLen], ":%d:%03d/%03d", statusCode, minNbBlocks, m_sdmnFECBuffer.getMaxNbRecovery());
+
+    if (m_timestamping)
+    {
+        msgLen = strlen(messageBuffer);
+        sprintf(&messageBuffer[msgLen], ":%.3f/%.3f/%.3f", m_latencyStats.getAvgLatency(), m_latencyStats.getMaxLatency(), m_latencyStats.getJitter());
+    }
+}
+
+/** The meta data block, the first block sent for a frame, gives the time the sender started the frame */
+void UDPSourceFEC::updateLatency(uint8_t *rxBlock, int length, const timespec& arrival)
+{
+    Header *header = (Header *) rxBlock;
+
+    if ((header->blockIndex != 0) || (length < (int) (sizeof(Header) + sizeof(MetaDataFEC))) || (arrival.tv_sec == 0)) {
+        return;
+    }
+
+    MetaDataFEC *metaData = (MetaDataFEC *) &rxBlock[sizeof(Header)];
+    uint32_t crc;
+
+    if (header->filler & SDRDAEMONFEC_BLOCKCRC) // senders checking the blocks use CRC32C for the meta data as well
+    {
+        crc = CRC32C::calculate((const uint8_t *) metaData, 20);
+    }
+    else
+    {
+        boost::crc_32_type crc32;
+        crc32.process_bytes(metaData, 20);
+        crc = crc32.checksum();
+    }
+
+    if (crc == metaData->m_crc32) {
+        m_latencyStats.update(metaData->m_tv_sec, metaData->m_tv_usec, arrival);
+    }
 }
 
-int UDPSourceFEC::receiveUDP(UDPSourceFEC *udpSourceFEC, SuperBlock *superBlock)
+void UDPSourceFEC::updateFeedback()
+{
+    // the frame just output: the buffer stats and output meta data are about it
+    const SDRdaemonFECBuffer::MetaDataFEC& meta = m_sdmnFECBuffer.getOutputMeta();
+    int nbOriginalBlocks = m_sdmnFECBuffer.getCurNbOriginalBlocks();
+    int nbBlocksFEC = (SDRdaemonFECBuffer::metaNbOriginalBlocks(meta) == nbOriginalBlocks) ? SDRdaemonFECBuffer::metaNbFECBlocks(meta) : 0;
+    int nbBlocks = m_sdmnFECBuffer.getCurNbBlocks();
+    int nbLostBlocks = nbOriginalBlocks + nbBlocksFEC - nbBlocks;
+
+    if ((m_feedbackTime == 0) || (nbBlocks == 0)) // the first frame is usually joined halfway
+    {
+        m_feedbackTime = time(0);
+        return;
+    }
+
+    if ((m_feedbackReport.m_nbFrames == 0) || (nbBlocksFEC < m_feedbackReport.m_nbFECBlocks)) {
+        m_feedbackReport.m_nbFECBlocks = nbBlocksFEC;
+    }
+
+    m_feedbackReport.m_nbFrames++;
+
+    if (nbBlocks < nbOriginalBlocks) {
+        m_feedbackReport.m_nbLostFrames++;
+    }
+
+    if (nbLostBlocks > m_feedbackReport.m_maxLostBlocks) {
+        m_feedbackReport.m_maxLostBlocks = nbLostBlocks;
+    }
+
+    time_t now = time(0);
+
+    if ((now == m_feedbackTime) || (m_senderAddr.sin_family != AF_INET)) {
+        return;
+    }
+
+    try
+    {
+        m_socket.SendDataGram((const void *) &m_feedbackReport, sizeof(FECFeedback),
+                inet_ntoa(m_senderAddr.sin_addr), ntohs(m_senderAddr.sin_port));
+    }
+    catch (CSocketException& e)
+    {
+        std::cerr << "UDPSourceFEC::updateFeedback: " << e.what() << std::endl;
+    }
+
+    m_feedbackReport.init();
+    m_feedbackTime = now;
+}
+
+void UDPSourceFEC::sendNacks()
+{
+    FECNack nack;
+
+    while (m_sdmnFECBuffer.getNack(nack))
+    {
+        if (m_senderAddr.sin_family != AF_INET) {
+            continue;
+        }
+
+        try
+        {
+            m_socket.SendDataGram((const void *) &nack, sizeof(FECNack),
+                    inet_ntoa(m_senderAddr.sin_addr), ntohs(m_senderAddr.sin_port));
+        }
+        catch (CSocketException& e)
+        {
+            std::cerr << "UDPSourceFEC::sendNacks: " << e.what() << std::endl;
+        }
+    }
+}
+
+/** Receive a batch of UDP blocks. Returns the number of blocks received. */
+int UDPSourceFEC::receiveUDP(UDPSourceFEC *udpSourceFEC)
 {
-    std::string fromAddress;
-    unsigned short fromPort;
     //fprintf(stderr, "UDPSourceFEC::receiveUDP at %s:%u\n", udpSourceFEC->m_address.c_str(), udpSourceFEC->m_port);
-    int nbRead = udpSourceFEC->m_socket.RecvDataGram((void *) superBlock, (int) udpSourceFEC->m_udpSize, fromAddress, fromPort);
-    //fprintf(stderr, "UDPSourceFEC::receiveUDP: received %d bytes from %s:%u\n", nbRead, fromAddress.c_str(), fromPort);
+    int nbRead;
+
+    if (udpSourceFEC->m_packetRing) // blocks are used in place in the ring
+    {
+        nbRead = udpSourceFEC->m_packetRing.receive(&udpSourceFEC->m_rxPtrs[0], &udpSourceFEC->m_rxLengths[0], UDPSOURCEFEC_RXBATCH,
+                udpSourceFEC->m_rxRunning.load() ? UDPSOURCEFEC_RXTIMEOUT : -1, (udpSourceFEC->m_feedback || udpSourceFEC->m_nack) ? &udpSourceFEC->m_rxAddrs[0] : 0,
+                udpSourceFEC->m_timestamping ? &udpSourceFEC->m_rxStamps[0] : 0);
+    }
+    else
+    {
+        nbRead = udpSourceFEC->m_socket.RecvDataGrams((void *) &udpSourceFEC->m_rxBlocks[0], (int) udpSourceFEC->m_udpSize,
+                UDPSOURCEFEC_RXBATCH, &udpSourceFEC->m_rxLengths[0], (udpSourceFEC->m_feedback || udpSourceFEC->m_nack) ? &udpSourceFEC->m_rxAddrs[0] : 0,
+                udpSourceFEC->m_timestamping ? &udpSourceFEC->m_rxStamps[0] : 0);
+    }
+
+    if ((udpSourceFEC->m_feedback || udpSourceFEC->m_nack) && (nbRead > 0)) {
+        udpSourceFEC->m_senderAddr = udpSourceFEC->m_rxAddrs[nbRead - 1];
+    }
+
+    if (udpSourceFEC->m_capture && (nbRead > 0))
+    {
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now); // batch arrival when the datagrams are not time stamped
+
+        for (int i = 0; i < nbRead; i++) {
+            udpSourceFEC->m_capture.write(udpSourceFEC->m_rxPtrs[i], udpSourceFEC->m_rxLengths[i], udpSourceFEC->m_timestamping ? udpSourceFEC->m_rxStamps[i] : now);
+        }
+    }
+
+    //fprintf(stderr, "UDPSourceFEC::receiveUDP: received %d datagrams\n", nbRead);
     return nbRead;
 }
@@ -20,7 +20,9 @@
 #include "Upsampler.h"
 
 Upsampler::Upsampler(unsigned int interp) :
-	m_interp(interp)
+	m_interp(interp),
+	m_blockInterp(false),
+	m_srateOut(0)
 {
 }
 
@@ -46,15 +48,70 @@ bool Upsampler::configure(parsekv::pairs_type& m)
 		}
 	}
 
+	if (m.find("intblk") != m.end())
+	{
+		std::cerr << "Upsampler::configure: intblk: " << m["intblk"] << std::endl;
+		m_blockInterp = atoi(m["intblk"].c_str()) != 0;
+	}
+
+	if (m.find("srate_out") != m.end())
+	{
+		std::cerr << "Upsampler::configure: srate_out: " << m["srate_out"] << std::endl;
+		int srateOut = atoi(m["srate_out"].c_str());
+
+		if (srateOut < 0)
+		{
+			m_error = "Invalid output sample rate";
+			return false;
+		}
+		else
+		{
+			m_srateOut = srateOut;
+		}
+	}
+
+	return true;
+}
+
+bool Upsampler::setSampleRate(uint32_t sampleRate)
+{
+	uint32_t inRate = m_srateOut ? sampleRate : 0;
+
+	if (!m_resampler.setRates(inRate, m_srateOut))
+	{
+		std::cerr << "Upsampler::setSampleRate: cannot resample " << inRate << " to " << m_srateOut << " S/s: ratio too complex" << std::endl;
+		m_error = "Output sample rate ratio too complex";
+		m_srateOut = 0;
+		m_resampler.setRates(0, 0);
+		return false;
+	}
+
 	return true;
 }
 
 void Upsampler::process(const IQSampleVector& samples_in, IQSampleVector& samples_out)
+{
+	if (m_resampler.active())
+	{
+		m_resampler.process(samples_in, m_resampled);
+		interpolate(m_resampled, samples_out);
+	}
+	else
+	{
+		interpolate(samples_in, samples_out);
+	}
+}
+
+void Upsampler::interpolate(const IQSampleVector& samples_in, IQSampleVector& samples_out)
 {
 	if (m_interp == 0)
 	{
 		samples_out = samples_in;
 	}
+	else if (m_blockInterp)
+	{
+		m_interpolators.interpolateBlock(m_interp, samples_in, samples_out);
+	}
 	else
 	{
         switch (m_interp)
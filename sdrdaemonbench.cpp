@@ -0,0 +1,803 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <cstring>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include "util.h"
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+#include "Decimators.h"
+#include "Interpolators.h"
+#include "IntHalfbandFilter.h"
+#include "IntHalfbandFilterDB.h"
+#include "IntHalfbandFilterEO1.h"
+#include "IntHalfbandFilterST.h"
+#include "SampleConversion.h"
+#include "CRC64.h"
+#include "CRC32C.h"
+#include "FECCodec.h"
+#include "UDPSinkFEC.h"
+#include "SDRdaemonFECBuffer.h"
+#include "cm256.h"
+
+/** Results are folded in here so that the compiler cannot drop the work of a kernel */
+static volatile uint64_t bench_sink = 0;
+
+/**
+ * Runs each kernel repeatedly for a fixed time, several trials, and keeps the best rate.
+ * A kernel returns the number of items (samples or bytes) it processed in one call.
+ */
+class Bench
+{
+public:
+    struct Result
+    {
+        std::string name;
+        std::string unit;
+        double rate; //!< millions of items per second on one core
+    };
+
+    Bench(double trialSeconds, int nbTrials, const std::string& filter) :
+        m_trialSeconds(trialSeconds),
+        m_nbTrials(nbTrials),
+        m_filter(filter)
+    {}
+
+    void run(const std::string& name, const char *unit, const std::function<uint64_t()>& kernel)
+    {
+        if (!m_filter.empty() && (name.find(m_filter) == std::string::npos)) {
+            return;
+        }
+
+        double best = 0.0;
+        kernel(); // warm up caches, filter state and lazily built tables
+
+        for (int trial = 0; trial < m_nbTrials; trial++)
+        {
+            uint64_t items = 0;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            double elapsed;
+
+            do
+            {
+                items += kernel();
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (elapsed < m_trialSeconds);
+
+            double rate = items / elapsed / 1e6;
+
+            if (rate > best) {
+                best = rate;
+            }
+        }
+
+        Result result = {name, unit, best};
+        m_results.push_back(result);
+        fprintf(stdout, "%-32s %10.2f %s\n", name.c_str(), best, unit);
+        fflush(stdout);
+    }
+
+    const std::vector<Result>& results() const { return m_results; }
+
+private:
+    double m_trialSeconds;
+    int m_nbTrials;
+    std::string m_filter;
+    std::vector<Result> m_results;
+};
+
+static void usage()
+{
+    fprintf(stderr,
+    "Usage: sdrdaemon_bench [options]\n"
+            "  -s samples     Number of I/Q samples processed by each kernel call (default 65536)\n"
+            "  -t ms          Duration of each trial in milliseconds (default 200)\n"
+            "  -n trials      Number of trials, the best rate is kept (default 5)\n"
+            "  -k name        Run only the kernels with this string in their name\n"
+            "  -A cpu         Pin the benchmark to this CPU (default: no pinning)\n"
+            "  -u size        UDP datagram size in bytes used for the FEC and CRC kernels (default 512)\n"
+            "  -w file        Write the rates to this baseline file\n"
+            "  -c file        Compare the rates to this baseline file\n"
+            "  -r percent     Rate drop below the baseline reported as a regression (default 5)\n"
+            "\n"
+            "Rates are in millions of samples (MS/s) or bytes (MB/s) per second on one core.\n"
+            "Exit status is 2 when a kernel is slower than its baseline.\n"
+            "\n");
+}
+
+static void badarg(const char *label)
+{
+    usage();
+    fprintf(stderr, "ERROR: Invalid argument for %s\n", label);
+    exit(1);
+}
+
+static bool parse_int(const char *s, int& v)
+{
+    char *endp;
+    long t = strtol(s, &endp, 10);
+    if (endp == s)
+        return false;
+    if (*endp != '\0' || t < INT_MIN || t > INT_MAX)
+        return false;
+    v = t;
+    return true;
+}
+
+/** Half band filter variant in the decimation direction: two input samples for one output sample */
+template<class HBFilter>
+static uint64_t hb_decimate(HBFilter& hb, const IQSampleVector& in)
+{
+    uint64_t acc = 0;
+
+    for (std::size_t pos = 0; pos + 1 < in.size(); pos += 2)
+    {
+        int32_t x = in[pos+1].real();
+        int32_t y = in[pos+1].imag();
+        hb.myDecimate(in[pos].real(), in[pos].imag(), &x, &y);
+        acc += x ^ y;
+    }
+
+    bench_sink += acc;
+    return in.size();
+}
+
+/** Half band filter variant in the interpolation direction: one input sample for two output samples */
+template<class HBFilter>
+static uint64_t hb_interpolate(HBFilter& hb, const IQSampleVector& in)
+{
+    uint64_t acc = 0;
+
+    for (std::size_t pos = 0; pos < in.size(); pos++)
+    {
+        int32_t x1 = in[pos].real();
+        int32_t y1 = in[pos].imag();
+        int32_t x2, y2;
+        hb.myInterpolate(&x1, &y1, &x2, &y2);
+        acc += x1 ^ y1 ^ x2 ^ y2;
+    }
+
+    bench_sink += acc;
+    return in.size();
+}
+
+template<uint32_t HBFilterOrder>
+static void bench_halfband(Bench& bench, const IQSampleVector& in)
+{
+    std::string order = std::to_string(HBFilterOrder);
+    std::unique_ptr<IntHalfbandFilter<HBFilterOrder> > hb(new IntHalfbandFilter<HBFilterOrder>());
+    std::unique_ptr<IntHalfbandFilterDB<HBFilterOrder> > hbDB(new IntHalfbandFilterDB<HBFilterOrder>());
+    std::unique_ptr<IntHalfbandFilterEO1<HBFilterOrder> > hbEO1(new IntHalfbandFilterEO1<HBFilterOrder>());
+    std::unique_ptr<IntHalfbandFilterST<HBFilterOrder> > hbST(new IntHalfbandFilterST<HBFilterOrder>());
+
+    bench.run("hb" + order + "_decimate",     "MS/s", [&]() { return hb_decimate(*hb, in); });
+    bench.run("hb" + order + "DB_decimate",   "MS/s", [&]() { return hb_decimate(*hbDB, in); });
+    bench.run("hb" + order + "EO1_decimate",  "MS/s", [&]() { return hb_decimate(*hbEO1, in); });
+    bench.run("hb" + order + "ST_decimate",   "MS/s", [&]() { return hb_decimate(*hbST, in); });
+    bench.run("hb" + order + "_interpolate",    "MS/s", [&]() { return hb_interpolate(*hb, in); });
+    bench.run("hb" + order + "DB_interpolate",  "MS/s", [&]() { return hb_interpolate(*hbDB, in); });
+    bench.run("hb" + order + "EO1_interpolate", "MS/s", [&]() { return hb_interpolate(*hbEO1, in); });
+    bench.run("hb" + order + "ST_interpolate",  "MS/s", [&]() { return hb_interpolate(*hbST, in); });
+}
+
+static void bench_decimators(Bench& bench, const IQSampleVector& in)
+{
+    typedef void (Decimators::*Decimate)(unsigned int&, const IQSampleVector&, IQSampleVector&);
+    static const char *fcPosNames[3] = {"inf", "sup", "cen"};
+    // decimate2 and decimate4 infradyne and supradyne are static members: taken from staticDecimates below
+    static const Decimate decimates[6][3] = {
+        {0, 0, &Decimators::decimate2_cen},
+        {0, 0, &Decimators::decimate4_cen},
+        {&Decimators::decimate8_inf,  &Decimators::decimate8_sup,  &Decimators::decimate8_cen},
+        {&Decimators::decimate16_inf, &Decimators::decimate16_sup, &Decimators::decimate16_cen},
+        {&Decimators::decimate32_inf, &Decimators::decimate32_sup, &Decimators::decimate32_cen},
+        {&Decimators::decimate64_inf, &Decimators::decimate64_sup, &Decimators::decimate64_cen}
+    };
+    typedef void (*StaticDecimate)(unsigned int&, const IQSampleVector&, IQSampleVector&);
+    static const StaticDecimate staticDecimates[2][2] = {
+        {&Decimators::decimate2_inf, &Decimators::decimate2_sup},
+        {&Decimators::decimate4_inf, &Decimators::decimate4_sup}
+    };
+
+    std::unique_ptr<Decimators> decimators(new Decimators());
+    IQSampleVector out;
+    IQSampleVector inout(in);
+
+    bench.run("decimate1", "MS/s", [&]() {
+        unsigned int sampleSize = 12;
+        std::copy(in.begin(), in.end(), inout.begin()); // rescaled in place
+        Decimators::decimate1(sampleSize, inout);
+        bench_sink += inout[0].real();
+        return (uint64_t) in.size();
+    });
+
+    for (unsigned int log2Decim = 1; log2Decim <= 6; log2Decim++)
+    {
+        for (int fcPos = 0; fcPos < 3; fcPos++)
+        {
+            std::string name = "decimate" + std::to_string(1 << log2Decim) + "_" + fcPosNames[fcPos];
+            Decimate decimate = decimates[log2Decim-1][fcPos];
+            StaticDecimate staticDecimate = decimate ? 0 : staticDecimates[log2Decim-1][fcPos];
+
+            bench.run(name, "MS/s", [&]() {
+                unsigned int sampleSize = 12;
+                if (decimate) {
+                    ((*decimators).*decimate)(sampleSize, in, out);
+                } else {
+                    staticDecimate(sampleSize, in, out);
+                }
+                bench_sink += out[0].real();
+                return (uint64_t) in.size();
+            });
+        }
+    }
+
+    for (unsigned int log2Decim = 3; log2Decim <= 6; log2Decim++)
+    {
+        for (int fcPos = 0; fcPos < 3; fcPos++)
+        {
+            std::string name = "decimateBlock" + std::to_string(1 << log2Decim) + "_" + fcPosNames[fcPos];
+
+            bench.run(name, "MS/s", [&]() {
+                unsigned int sampleSize = 12;
+                decimators->decimateBlock(log2Decim, fcPos, sampleSize, in, out);
+                bench_sink += out[0].real();
+                return (uint64_t) in.size();
+            });
+        }
+    }
+
+    for (unsigned int log2Decim = 1; log2Decim <= 6; log2Decim++)
+    {
+        for (int fcPos = 0; fcPos < 3; fcPos++)
+        {
+            std::string name = "decimateChain" + std::to_string(1 << log2Decim) + "_" + fcPosNames[fcPos];
+            Decimators::Chain chain = Decimators::selectChain(log2Decim, fcPos, 12);
+
+            bench.run(name, "MS/s", [&]() {
+                unsigned int sampleSize = 12;
+                ((*decimators).*chain)(sampleSize, in, out);
+                bench_sink += out[0].real();
+                return (uint64_t) in.size();
+            });
+        }
+    }
+}
+
+static void bench_interpolators(Bench& bench, const IQSampleVector& in)
+{
+    typedef void (Interpolators::*Interpolate)(const IQSampleVector&, IQSampleVector&);
+    static const Interpolate interpolates[6] = {
+        &Interpolators::interpolate2_cen,
+        &Interpolators::interpolate4_cen,
+        &Interpolators::interpolate8_cen,
+        &Interpolators::interpolate16_cen,
+        &Interpolators::interpolate32_cen,
+        &Interpolators::interpolate64_cen
+    };
+
+    std::unique_ptr<Interpolators> interpolators(new Interpolators());
+    IQSampleVector out;
+
+    // the input is shortened so that the output stays the same size at all factors (rates are output samples)
+    for (unsigned int log2Interp = 1; log2Interp <= 6; log2Interp++)
+    {
+        IQSampleVector shortIn(in.begin(), in.begin() + (in.size() >> log2Interp));
+        Interpolate interpolate = interpolates[log2Interp-1];
+
+        bench.run("interpolate" + std::to_string(1 << log2Interp) + "_cen", "MS/s", [&]() {
+            ((*interpolators).*interpolate)(shortIn, out);
+            bench_sink += out[0].real();
+            return (uint64_t) out.size();
+        });
+        bench.run("interpolateBlock" + std::to_string(1 << log2Interp), "MS/s", [&]() {
+            interpolators->interpolateBlock(log2Interp, shortIn, out);
+            bench_sink += out[0].real();
+            return (uint64_t) out.size();
+        });
+    }
+}
+
+/** One frame of original blocks as sent by UDPSinkFEC. Rates are I/Q samples carried by the original blocks. */
+static void bench_fec(Bench& bench, unsigned int udpSize)
+{
+    CM256 cm256;
+
+    if (!cm256.isInitialized())
+    {
+        fprintf(stderr, "sdrdaemon_bench: cannot initialize CM256 library, FEC not tested\n");
+        return;
+    }
+
+    const int nbOriginal = UDPSINKFEC_NBORIGINALBLOCKS;
+    const int blockBytes = udpSize - sizeof(SDRdaemonFECBuffer::Header);
+    const uint64_t frameSamples = (uint64_t) nbOriginal * blockBytes / sizeof(IQSample);
+    static const int fecCounts[] = {1, 8, 16, 32, 64, 128};
+    std::vector<uint8_t> originals(nbOriginal * blockBytes);
+    std::mt19937 rng(1);
+
+    for (std::size_t i = 0; i < originals.size(); i++) {
+        originals[i] = rng();
+    }
+
+    for (int nbFEC : fecCounts)
+    {
+        CM256::cm256_encoder_params params;
+        params.BlockBytes = blockBytes;
+        params.OriginalCount = nbOriginal;
+        params.RecoveryCount = nbFEC;
+        CM256::cm256_block blocks[256];
+        std::vector<uint8_t> recovery(nbFEC * blockBytes);
+        std::vector<uint8_t> received(nbFEC * blockBytes);
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            blocks[i].Block = (void *) &originals[i * blockBytes];
+            blocks[i].Index = i;
+        }
+
+        std::string fec = std::to_string(nbFEC);
+
+        bench.run("cm256_encode_fec" + fec, "MS/s", [&]() {
+            cm256.cm256_encode(params, blocks, (void *) &recovery[0]);
+            bench_sink += recovery[0];
+            return frameSamples;
+        });
+
+        // worst case decode: as many original blocks lost as there are recovery blocks
+        bench.run("cm256_decode_fec" + fec, "MS/s", [&]() {
+            memcpy(&received[0], &recovery[0], received.size()); // decoded in place
+            for (int i = 0; i < nbOriginal; i++)
+            {
+                if (i < nbFEC)
+                {
+                    blocks[i].Block = (void *) &received[i * blockBytes];
+                    blocks[i].Index = CM256::cm256_get_recovery_block_index(params, i);
+                }
+                else
+                {
+                    blocks[i].Block = (void *) &originals[i * blockBytes];
+                    blocks[i].Index = i;
+                }
+            }
+            if (cm256.cm256_decode(params, blocks)) {
+                fprintf(stderr, "sdrdaemon_bench: CM256 decode failed with %d FEC blocks\n", nbFEC);
+            }
+            bench_sink += received[0];
+            return frameSamples;
+        });
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            blocks[i].Block = (void *) &originals[i * blockBytes];
+            blocks[i].Index = i;
+        }
+
+        FECCodec *xorCodec = FECCodec::get(FECCODEC_XOR);
+        FECBlock fecBlocks[256];
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            fecBlocks[i].Block = (void *) &originals[i * blockBytes];
+            fecBlocks[i].Index = i;
+        }
+
+        bench.run("xor_encode_fec" + fec, "MS/s", [&]() {
+            xorCodec->encode(params, fecBlocks, (void *) &recovery[0]);
+            bench_sink += recovery[0];
+            return frameSamples;
+        });
+
+        // a burst of as many original blocks lost as there are recovery blocks (one from each parity class)
+        bench.run("xor_decode_fec" + fec, "MS/s", [&]() {
+            memcpy(&received[0], &recovery[0], received.size()); // decoded in place
+            for (int i = 0; i < nbOriginal; i++)
+            {
+                if (i < nbFEC)
+                {
+                    fecBlocks[i].Block = (void *) &received[i * blockBytes];
+                    fecBlocks[i].Index = CM256::cm256_get_recovery_block_index(params, i);
+                }
+                else
+                {
+                    fecBlocks[i].Block = (void *) &originals[i * blockBytes];
+                    fecBlocks[i].Index = i;
+                }
+            }
+            if (xorCodec->decode(params, fecBlocks, nbOriginal)) {
+                fprintf(stderr, "sdrdaemon_bench: XOR decode failed with %d FEC blocks\n", nbFEC);
+            }
+            bench_sink += received[0];
+            return frameSamples;
+        });
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            blocks[i].Block = (void *) &originals[i * blockBytes];
+            blocks[i].Index = i;
+        }
+    }
+}
+
+/** One large frame of original blocks (LDPC staircase codec). Rates are I/Q samples carried by the original blocks. */
+static void bench_ldpc(Bench& bench, unsigned int udpSize)
+{
+    FECCodec *ldpcCodec = FECCodec::get(FECCODEC_LDPC);
+
+    if (!ldpcCodec || !ldpcCodec->isInitialized())
+    {
+        fprintf(stderr, "sdrdaemon_bench: cannot initialize the LDPC codec, not tested\n");
+        return;
+    }
+
+    const int nbOriginal = UDPSINKFEC_NBORIGINALBLOCKSLARGE;
+    const int blockBytes = udpSize - sizeof(SDRdaemonFECBuffer::Header) - sizeof(SDRdaemonFECBuffer::LargeTrailer);
+    const uint64_t frameSamples = (uint64_t) nbOriginal * blockBytes / sizeof(IQSample);
+    static const int fecCounts[] = {32, 128, 512};
+    std::vector<uint8_t> originals(nbOriginal * blockBytes);
+    std::mt19937 rng(1);
+
+    for (std::size_t i = 0; i < originals.size(); i++) {
+        originals[i] = rng();
+    }
+
+    for (int nbFEC : fecCounts)
+    {
+        CM256::cm256_encoder_params params;
+        params.BlockBytes = blockBytes;
+        params.OriginalCount = nbOriginal;
+        params.RecoveryCount = nbFEC;
+        std::vector<FECBlock> blocks(nbOriginal + nbFEC);
+        std::vector<uint8_t> recovery(nbFEC * blockBytes);
+        std::vector<uint8_t> received(nbFEC * blockBytes);
+        int nbLost = nbFEC / 2; // not MDS: leave some margin so that the decoding succeeds
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            blocks[i].Block = (void *) &originals[i * blockBytes];
+            blocks[i].Index = i;
+        }
+
+        std::string fec = std::to_string(nbFEC);
+
+        bench.run("ldpc_encode_fec" + fec, "MS/s", [&]() {
+            ldpcCodec->encode(params, &blocks[0], (void *) &recovery[0]);
+            bench_sink += recovery[0];
+            return frameSamples;
+        });
+
+        // the first nbLost original blocks are lost and all the FEC blocks received
+        bench.run("ldpc_decode_fec" + fec, "MS/s", [&]() {
+            memcpy(&received[0], &recovery[0], received.size()); // decoded in place
+            int nbBlocks = 0;
+            for (int i = nbLost; i < nbOriginal; i++, nbBlocks++)
+            {
+                blocks[nbBlocks].Block = (void *) &originals[i * blockBytes];
+                blocks[nbBlocks].Index = i;
+            }
+            for (int j = 0; j < nbFEC; j++, nbBlocks++)
+            {
+                blocks[nbBlocks].Block = (void *) &received[j * blockBytes];
+                blocks[nbBlocks].Index = nbOriginal + j;
+            }
+            if (ldpcCodec->decode(params, &blocks[0], nbBlocks)) {
+                fprintf(stderr, "sdrdaemon_bench: LDPC decode failed with %d FEC blocks\n", nbFEC);
+            }
+            bench_sink += received[0];
+            return frameSamples;
+        });
+    }
+}
+
+static void bench_crc(Bench& bench, unsigned int udpSize)
+{
+    CRC64 crc64;
+    std::vector<uint8_t> frame(UDPSINKFEC_NBORIGINALBLOCKS * udpSize);
+    std::mt19937 rng(2);
+
+    for (std::size_t i = 0; i < frame.size(); i++) {
+        frame[i] = rng();
+    }
+
+    static const char *engines[] = {"crc64_table", "crc64_slicing8", "crc64_carryless"};
+
+    for (int engine = CRC64::CRCTable; engine <= CRC64::CRCCarryless; engine++)
+    {
+        crc64.setEngine((CRC64::engine_t) engine);
+
+        if (crc64.getEngine() != engine) {
+            continue; // not supported by the CPU
+        }
+
+        bench.run(engines[engine], "MB/s", [&]() {
+            bench_sink += crc64.calculate_crc(&frame[0], frame.size());
+            return (uint64_t) frame.size();
+        });
+    }
+
+    // block integrity check: one CRC32C per datagram
+    bench.run(CRC32C::hardware() ? "crc32c_blocks_hw" : "crc32c_blocks", "MB/s", [&]() {
+        for (std::size_t i = 0; i < frame.size(); i += udpSize) {
+            bench_sink += CRC32C::calculate(&frame[i], udpSize - sizeof(uint32_t));
+        }
+
+        return (uint64_t) frame.size();
+    });
+}
+
+static void bench_conversions(Bench& bench, const IQSampleVector& in)
+{
+    std::vector<uint8_t> bytes(2 * in.size());
+    IQSampleVector out(in.size());
+    std::mt19937 rng(3);
+
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = rng();
+    }
+
+    bench.run("u8ToIQ", "MS/s", [&]() {
+        SampleConversion::u8ToIQ(&bytes[0], &out[0], bytes.size());
+        bench_sink += out[0].real();
+        return (uint64_t) in.size();
+    });
+    bench.run("s8ToIQ", "MS/s", [&]() {
+        SampleConversion::s8ToIQ((const int8_t *) &bytes[0], &out[0], bytes.size());
+        bench_sink += out[0].real();
+        return (uint64_t) in.size();
+    });
+    // no decimation: rescale to 16 bits after the conversion or fused in it
+    bench.run("u8ToIQ_decimate1", "MS/s", [&]() {
+        unsigned int sampleSize = 8;
+        SampleConversion::u8ToIQ(&bytes[0], &out[0], bytes.size());
+        Decimators::decimate1(sampleSize, out);
+        bench_sink += out[0].real();
+        return (uint64_t) in.size();
+    });
+    bench.run("u8ToIQ_normalized", "MS/s", [&]() {
+        SampleConversion::u8ToIQ(&bytes[0], &out[0], bytes.size(), 8);
+        bench_sink += out[0].real();
+        return (uint64_t) in.size();
+    });
+    bench.run("shiftS16", "MS/s", [&]() {
+        SampleConversion::shiftS16(&in[0], &out[0], in.size(), 4);
+        bench_sink += out[0].real();
+        return (uint64_t) in.size();
+    });
+    bench.run("iqToS8", "MS/s", [&]() {
+        SampleConversion::iqToS8(&in[0], (int8_t *) &bytes[0], bytes.size());
+        bench_sink += bytes[0];
+        return (uint64_t) in.size();
+    });
+}
+
+/** Baseline file: one kernel per line as name rate, comment lines start with # */
+static bool read_baseline(const std::string& filename, std::map<std::string, double>& baseline)
+{
+    std::ifstream file(filename);
+    std::string line;
+
+    if (!file) {
+        return false;
+    }
+
+    while (std::getline(file, line))
+    {
+        char name[128];
+        double rate;
+
+        if ((line.size() > 0) && (line[0] != '#') && (sscanf(line.c_str(), "%127s %lf", name, &rate) == 2)) {
+            baseline[name] = rate;
+        }
+    }
+
+    return true;
+}
+
+static bool write_baseline(const std::string& filename, const std::vector<Bench::Result>& results)
+{
+    FILE *file = fopen(filename.c_str(), "w");
+
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file, "# sdrdaemon_bench baseline, SIMD kernels: %s\n", SIMDDispatch::name());
+
+    for (const Bench::Result& result : results) {
+        fprintf(file, "%s %.3f\n", result.name.c_str(), result.rate);
+    }
+
+    return fclose(file) == 0;
+}
+
+/** Print the rates against the baseline and return the number of regressions */
+static int compare_baseline(const std::map<std::string, double>& baseline, const std::vector<Bench::Result>& results, double tolerance)
+{
+    int nbRegressions = 0;
+
+    fprintf(stdout, "\n%-32s %10s %10s %8s\n", "kernel", "rate", "baseline", "ratio");
+
+    for (const Bench::Result& result : results)
+    {
+        std::map<std::string, double>::const_iterator it = baseline.find(result.name);
+
+        if ((it == baseline.end()) || (it->second <= 0.0))
+        {
+            fprintf(stdout, "%-32s %10.2f %10s %8s\n", result.name.c_str(), result.rate, "-", "-");
+            continue;
+        }
+
+        double ratio = result.rate / it->second;
+        bool regression = ratio < 1.0 - tolerance/100.0;
+        nbRegressions += regression ? 1 : 0;
+        fprintf(stdout, "%-32s %10.2f %10.2f %8.3f%s\n", result.name.c_str(), result.rate, it->second, ratio,
+                regression ? "  REGRESSION" : "");
+    }
+
+    return nbRegressions;
+}
+
+int main(int argc, char **argv)
+{
+    int nbSamples = 65536;
+    int trialMs = 200;
+    int nbTrials = 5;
+    int cpu = -1;
+    int udpSize = UDPSINKFEC_UDPSIZE;
+    int tolerance = 5;
+    std::string filter;
+    std::string writeFile;
+    std::string compareFile;
+
+    fprintf(stderr, "SDRdaemon kernels benchmark\n");
+    fprintf(stderr, "SIMD kernels: %s\n", SIMDDispatch::name());
+
+    const struct option longopts[] = {
+        { "samples",    1, NULL, 's' },
+        { "time",       1, NULL, 't' },
+        { "trials",     1, NULL, 'n' },
+        { "kernel",     1, NULL, 'k' },
+        { "affinity",   1, NULL, 'A' },
+        { "udpsize",    1, NULL, 'u' },
+        { "write",      1, NULL, 'w' },
+        { "compare",    1, NULL, 'c' },
+        { "tolerance",  1, NULL, 'r' },
+        { NULL,         0, NULL, 0 } };
+
+    int c, longindex;
+
+    while ((c = getopt_long(argc, argv,
+            "s:t:n:k:A:u:w:c:r:",
+            longopts, &longindex)) >= 0)
+    {
+        switch (c)
+        {
+            case 's':
+                // whole blocks of the block cascades at the largest factor
+                if (!parse_int(optarg, nbSamples) || (nbSamples < 4096) || (nbSamples % 64 != 0)) {
+                    badarg("-s");
+                }
+                break;
+            case 't':
+                if (!parse_int(optarg, trialMs) || (trialMs <= 0)) {
+                    badarg("-t");
+                }
+                break;
+            case 'n':
+                if (!parse_int(optarg, nbTrials) || (nbTrials <= 0)) {
+                    badarg("-n");
+                }
+                break;
+            case 'k':
+                filter.assign(optarg);
+                break;
+            case 'A':
+                if (!parse_int(optarg, cpu) || (cpu < 0) || (cpu >= CPU_SETSIZE)) {
+                    badarg("-A");
+                }
+                break;
+            case 'u':
+                if (!parse_int(optarg, udpSize) || (udpSize < 64) || (udpSize > UDPSINKFEC_UDPSIZEMAX) || (udpSize % 4 != 0)) {
+                    badarg("-u");
+                }
+                break;
+            case 'w':
+                writeFile.assign(optarg);
+                break;
+            case 'c':
+                compareFile.assign(optarg);
+                break;
+            case 'r':
+                if (!parse_int(optarg, tolerance) || (tolerance < 0) || (tolerance > 100)) {
+                    badarg("-r");
+                }
+                break;
+            default:
+                usage();
+                fprintf(stderr, "ERROR: Invalid command line options\n");
+                exit(1);
+        }
+    }
+
+    if (optind < argc)
+    {
+        usage();
+        fprintf(stderr, "ERROR: Unexpected command line options\n");
+        exit(1);
+    }
+
+    std::map<std::string, double> baseline;
+
+    if (!compareFile.empty() && !read_baseline(compareFile, baseline))
+    {
+        fprintf(stderr, "ERROR: cannot read baseline file %s\n", compareFile.c_str());
+        exit(1);
+    }
+
+    if (!set_thread_affinity(pthread_self(), cpu)) {
+        fprintf(stderr, "WARNING: cannot pin the benchmark to CPU %d\n", cpu);
+    }
+
+    // full scale 12 bit noise as from an RTL-SDR or an Airspy
+    IQSampleVector in(nbSamples);
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> dist(-2048, 2047);
+
+    for (IQSample& sample : in)
+    {
+        sample.setReal(dist(rng));
+        sample.setImag(dist(rng));
+    }
+
+    Bench bench(trialMs / 1000.0, nbTrials, filter);
+
+    bench_decimators(bench, in);
+    bench_interpolators(bench, in);
+    bench_halfband<16>(bench, in);
+    bench_halfband<32>(bench, in);
+    bench_halfband<64>(bench, in);
+    bench_fec(bench, udpSize);
+    bench_ldpc(bench, udpSize);
+    bench_crc(bench, udpSize);
+    bench_conversions(bench, in);
+
+    if (!writeFile.empty() && !write_baseline(writeFile, bench.results()))
+    {
+        fprintf(stderr, "ERROR: cannot write baseline file %s\n", writeFile.c_str());
+        exit(1);
+    }
+
+    if (!compareFile.empty() && (compare_baseline(baseline, bench.results(), tolerance) > 0)) {
+        return 2;
+    }
+
+    return 0;
+}
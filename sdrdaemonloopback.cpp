@@ -0,0 +1,818 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include "util.h"
+#include "DataBuffer.h"
+#include "SIMDDispatch.h"
+#include "Downsampler.h"
+#include "TestSource.h"
+#include "FECCodec.h"
+#include "UDPSinkFEC.h"
+#include "UDPSocket.h"
+#include "SDRdaemonFECBuffer.h"
+#include "MultiStreamReceiver.h"
+#include "LatencyStats.h"
+
+#define LOOPBACK_RXBATCH 64
+
+/**
+ * Loss model applied to the datagrams between the network and the FEC decoder.
+ * Losses follow a two state Gilbert-Elliott chain: every datagram is lost in the bad state and none in
+ * the good one. The transition probabilities give the average loss rate and the mean burst length
+ * (burst length 1 is independent random loss). A reordered datagram is held back and delivered after
+ * the given number of following datagrams.
+ */
+class LossChannel
+{
+public:
+    LossChannel(double lossRate, double burstLength, double reorderRate, int reorderDepth, unsigned int seed) :
+        m_reorderRate(reorderRate),
+        m_reorderDepth(reorderDepth),
+        m_bad(false),
+        m_rng(seed),
+        m_uniform(0.0, 1.0),
+        m_nbDatagrams(0),
+        m_nbDropped(0),
+        m_nbReordered(0)
+    {
+        m_pBadGood = 1.0 / burstLength;
+        m_pGoodBad = (lossRate < 1.0) ? lossRate * m_pBadGood / (1.0 - lossRate) : 1.0;
+    }
+
+    /** Pass a datagram and give those coming out of the channel (none, this one and/or held ones) to deliver */
+    template<class Deliver>
+    void pass(const uint8_t *datagram, int length, Deliver deliver)
+    {
+        m_nbDatagrams++;
+        m_bad = m_bad ? (m_uniform(m_rng) >= m_pBadGood) : (m_uniform(m_rng) < m_pGoodBad);
+
+        if (m_bad) {
+            m_nbDropped++;
+        } else if ((m_reorderRate > 0.0) && (m_uniform(m_rng) < m_reorderRate)) {
+            m_nbReordered++;
+            m_held.push_back(Held(m_reorderDepth, datagram, length));
+        } else {
+            deliver(datagram, length);
+        }
+
+        for (std::deque<Held>::iterator it = m_held.begin(); it != m_held.end();)
+        {
+            if (--it->m_countdown < 0)
+            {
+                deliver(&it->m_datagram[0], (int) it->m_datagram.size());
+                it = m_held.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    uint64_t getNbDatagrams() const { return m_nbDatagrams; }
+    uint64_t getNbDropped() const { return m_nbDropped; }
+    uint64_t getNbReordered() const { return m_nbReordered; }
+
+private:
+    struct Held
+    {
+        Held(int countdown, const uint8_t *datagram, int length) :
+            m_countdown(countdown),
+            m_datagram(datagram, datagram + length)
+        {}
+        int m_countdown;
+        std::vector<uint8_t> m_datagram;
+    };
+
+    double m_pGoodBad;
+    double m_pBadGood;
+    double m_reorderRate;
+    int m_reorderDepth;
+    bool m_bad;
+    std::mt19937 m_rng;
+    std::uniform_real_distribution<double> m_uniform;
+    std::deque<Held> m_held;
+    uint64_t m_nbDatagrams;
+    uint64_t m_nbDropped;
+    uint64_t m_nbReordered;
+};
+
+/** Settings of a harness run */
+struct LoopbackSettings
+{
+    std::string address;
+    unsigned int port;
+    unsigned int udpSize;
+    unsigned int log2Decim;
+    unsigned int txDelay;
+    unsigned int reorderWindow;
+    unsigned int interleave;
+    int fecCodec;
+    unsigned int frameBlocks;
+    unsigned int nbStreams;     //!< streams sent to consecutive ports and received by a MultiStreamReceiver (1: LoopbackReceiver)
+    unsigned int nbWorkers;     //!< receive threads of the MultiStreamReceiver
+    double runSeconds;
+    double lossRate;
+    double burstLength;
+    double reorderRate;
+    int reorderDepth;
+    unsigned int seed;
+};
+
+/** Outcome of a run at one sample rate and one number of FEC blocks */
+struct LoopbackResult
+{
+    uint64_t generatedSamples;  //!< samples pushed by the test source
+    uint64_t droppedSamples;    //!< samples dropped in the input buffer (pipeline too slow)
+    uint64_t framesSent;
+    uint64_t framesOutput;
+    uint64_t framesLost;        //!< frames output without enough blocks to restore them
+    uint64_t recoveredBlocks;
+    uint64_t datagramsDropped;  //!< by the loss model
+    double   residualLoss;      //!< fraction of the frames sent that were not restored
+    double   avgLatency;        //!< milliseconds from the start of a frame to its output
+    double   maxLatency;
+    bool     sustained;
+};
+
+/** Receive the datagrams of the loopback, pass them through the loss channel and decode the frames */
+class LoopbackReceiver
+{
+public:
+    LoopbackReceiver(const LoopbackSettings& settings) :
+        m_socket(settings.address, settings.port),
+        m_channel(settings.lossRate, settings.burstLength, settings.reorderRate, settings.reorderDepth, settings.seed),
+        m_rxBlocks(LOOPBACK_RXBATCH * UDPSINKFEC_UDPSIZEMAX),
+        m_rxLengths(LOOPBACK_RXBATCH),
+        m_running(true),
+        m_nbFrames(0),
+        m_nbLostFrames(0)
+    {
+        m_fecBuffer.setReorderWindow(settings.reorderWindow);
+        m_socket.SetReadBufferSize(16*1024*1024);
+        m_socket.SetReadTimeout(100);
+        m_thread = std::thread(&LoopbackReceiver::run, this);
+        set_thread_name(m_thread.native_handle(), "sdmn-udprx");
+    }
+
+    ~LoopbackReceiver()
+    {
+        m_running.store(false);
+        m_thread.join();
+    }
+
+    const LossChannel& getChannel() const { return m_channel; }
+    const SDRdaemonFECBuffer& getFECBuffer() const { return m_fecBuffer; }
+    uint64_t getNbFrames() const { return m_nbFrames; }
+    uint64_t getNbLostFrames() const { return m_nbLostFrames; }
+    LatencyStats& getLatencyStats() { return m_latencyStats; }
+
+private:
+    void run()
+    {
+        while (m_running.load())
+        {
+            int nbRead = m_socket.RecvDataGrams((void *) &m_rxBlocks[0], UDPSINKFEC_UDPSIZEMAX, LOOPBACK_RXBATCH, &m_rxLengths[0]);
+
+            for (int i = 0; i < nbRead; i++)
+            {
+                m_channel.pass(&m_rxBlocks[i * UDPSINKFEC_UDPSIZEMAX], m_rxLengths[i], [this](const uint8_t *datagram, int length)
+                {
+                    uint64_t nbLostFrames = m_fecBuffer.getNbLostFrames();
+
+                    if (m_fecBuffer.write((uint8_t *) datagram, length)) {
+                        frameOutput(m_fecBuffer.getNbLostFrames() != nbLostFrames);
+                    }
+                });
+            }
+        }
+    }
+
+    void frameOutput(bool lost)
+    {
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now); // same clock as the meta data time stamp (gettimeofday)
+        const SDRdaemonFECBuffer::MetaDataFEC *meta = m_fecBuffer.getFrameMeta();
+
+        if (meta) {
+            m_latencyStats.update(meta->m_tv_sec, meta->m_tv_usec, now);
+        }
+
+        m_nbLostFrames += lost ? 1 : 0;
+        m_nbFrames++;
+    }
+
+    UDPSocket m_socket;
+    SDRdaemonFECBuffer m_fecBuffer;
+    LossChannel m_channel;
+    LatencyStats m_latencyStats;
+    std::vector<uint8_t> m_rxBlocks;
+    std::vector<int> m_rxLengths;
+    std::atomic_bool m_running;
+    std::atomic<uint64_t> m_nbFrames;
+    std::atomic<uint64_t> m_nbLostFrames;
+    std::thread m_thread;
+};
+
+/**
+ * Decoded frames of the streams of a MultiStreamReceiver. The calls for a stream are never concurrent so each
+ * stream has its own counters, only read once the receiver is stopped.
+ */
+class MultiStreamCounter : public MultiStreamReceiver::FrameHandler
+{
+public:
+    MultiStreamCounter(int nbStreams) :
+        m_streams(nbStreams)
+    {}
+
+    virtual void frame(int streamIndex, const MultiStreamReceiver::StreamId& streamId, const SDRdaemonFECBuffer& buffer,
+            const uint8_t *data, std::size_t dataLength)
+    {
+        (void) streamId;
+        (void) data;
+        (void) dataLength;
+
+        if (streamIndex >= (int) m_streams.size()) { // stray sender
+            return;
+        }
+
+        timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        StreamCounts& stream = m_streams[streamIndex];
+        const SDRdaemonFECBuffer::MetaDataFEC *meta = buffer.getFrameMeta();
+
+        if (meta) {
+            stream.m_latencyStats.update(meta->m_tv_sec, meta->m_tv_usec, now);
+        }
+
+        stream.m_nbFrames = buffer.getNbFrames();
+        stream.m_nbLostFrames = buffer.getNbLostFrames();
+        stream.m_nbRecoveredBlocks = buffer.getNbRecoveredBlocks();
+    }
+
+    /** Sum of the counters of all streams, average and largest latency of the streams */
+    void getTotals(LoopbackResult& result)
+    {
+        result.framesOutput = 0;
+        result.framesLost = 0;
+        result.recoveredBlocks = 0;
+        result.avgLatency = 0.0;
+        result.maxLatency = 0.0;
+
+        for (std::vector<StreamCounts>::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+        {
+            result.framesOutput += it->m_nbFrames;
+            result.framesLost += it->m_nbLostFrames;
+            result.recoveredBlocks += it->m_nbRecoveredBlocks;
+            result.avgLatency += it->m_latencyStats.getAvgLatency() / m_streams.size();
+            result.maxLatency = std::max(result.maxLatency, it->m_latencyStats.getMaxLatency());
+        }
+    }
+
+private:
+    struct StreamCounts
+    {
+        StreamCounts() : m_nbFrames(0), m_nbLostFrames(0), m_nbRecoveredBlocks(0) {}
+        uint64_t m_nbFrames;
+        uint64_t m_nbLostFrames;
+        uint64_t m_nbRecoveredBlocks;
+        LatencyStats m_latencyStats;
+    };
+
+    std::vector<StreamCounts> m_streams;
+};
+
+/**
+ * Run TestSource -> Downsampler -> UDPSinkFEC -> loopback -> loss channel -> SDRdaemonFECBuffer at one rate. With
+ * several streams the sink sends its frames to as many consecutive ports, received without loss channel by a
+ * MultiStreamReceiver decoding each stream in its own SDRdaemonFECBuffer.
+ */
+static bool run_loopback(const LoopbackSettings& settings, unsigned int sampleRate, int nbFECBlocks, double maxResidualLoss, LoopbackResult& result)
+{
+    std::atomic_bool stop_flag(false);
+    DataBuffer<IQSample> source_buffer;
+    source_buffer.set_capacity(sampleRate, DataBuffer<IQSample>::DropNewest); // one second
+
+    TestSource source(0);
+    Downsampler dn;
+    source.associateDownsampler(&dn);
+    std::ostringstream config;
+    config << "srate=" << sampleRate << ",decim=" << settings.log2Decim;
+    std::string configStr = config.str();
+
+    if (!static_cast<DeviceSource&>(source).configure(configStr)) // the key=value string parser of the base class
+    {
+        fprintf(stderr, "ERROR: source configuration: %s\n", source.error().c_str());
+        return false;
+    }
+
+    std::unique_ptr<LoopbackReceiver> receiver;
+    std::unique_ptr<UDPSinkFEC> udp_output;
+    MultiStreamCounter multiCounter(settings.nbStreams);
+    std::unique_ptr<MultiStreamReceiver> multiReceiver;
+
+    if (settings.nbStreams > 1)
+    {
+        multiReceiver.reset(new MultiStreamReceiver(settings.address, multiCounter));
+        multiReceiver->setReorderWindow(settings.reorderWindow);
+
+        for (unsigned int i = 0; i < settings.nbStreams; i++) {
+            multiReceiver->addPort(settings.port + i);
+        }
+
+        if (!multiReceiver->start(settings.nbWorkers))
+        {
+            fprintf(stderr, "ERROR: %s\n", multiReceiver->error().c_str());
+            return false;
+        }
+    }
+    else
+    {
+        try
+        {
+            receiver.reset(new LoopbackReceiver(settings));
+        }
+        catch (CSocketException& e)
+        {
+            fprintf(stderr, "ERROR: cannot receive on %s:%u: %s\n", settings.address.c_str(), settings.port, e.what());
+            return false;
+        }
+    }
+
+    // the Tx ring holds the frames interleaved twice
+    unsigned int nbTxBlocks = std::max<unsigned int>(UDPSINKFEC_NBTXBLOCKS, 2 * settings.interleave);
+    unsigned int maxNbBlocksFEC = std::max<int>(UDPSINKFEC_NBFECBLOCKS, nbFECBlocks);
+    udp_output.reset(new UDPSinkFEC(settings.address, settings.port, false, settings.udpSize, nbTxBlocks,
+            1, 0, maxNbBlocksFEC, settings.frameBlocks));
+
+    for (unsigned int i = 1; (i < settings.nbStreams) && *udp_output; i++) {
+        udp_output->addDestination(settings.address, settings.port + i);
+    }
+
+    if (!(*udp_output))
+    {
+        fprintf(stderr, "ERROR: UDP output: %s\n", udp_output->error().c_str());
+        return false;
+    }
+
+    udp_output->setNbBlocksFEC(nbFECBlocks);
+    udp_output->setTxDelay(settings.txDelay);
+    udp_output->setInterleave(settings.interleave);
+    udp_output->setFECCodec(settings.fecCodec);
+    udp_output->setFrameBlocks(settings.frameBlocks);
+    udp_output->setCenterFrequency(source.get_frequency());
+
+    if (!source.start(&source_buffer, &stop_flag))
+    {
+        fprintf(stderr, "ERROR: source start: %s\n", source.error().c_str());
+        return false;
+    }
+
+    std::thread timer([&]() {
+        std::this_thread::sleep_for(std::chrono::duration<double>(settings.runSeconds));
+        stop_flag.store(true);
+        source_buffer.push_end();
+    });
+
+    IQSampleVector outsamples;
+
+    while (!stop_flag.load())
+    {
+        IQSampleVector iqsamples = source_buffer.pull();
+
+        if (iqsamples.empty()) {
+            break;
+        }
+
+        dn.setSampleRate(source.get_sample_rate());
+        unsigned int sampleSize = source.get_sample_bits();
+
+        if ((dn.getLog2Decimation() == 0) && !dn.isCIC())
+        {
+            dn.rescale(sampleSize, iqsamples);
+            udp_output->setSampleBits(sampleSize);
+            udp_output->setSampleBytes((sampleSize-1)/8 + 1);
+            udp_output->setSampleRate(source.get_sample_rate());
+            udp_output->write(iqsamples);
+        }
+        else
+        {
+            dn.process(sampleSize, iqsamples, outsamples);
+            udp_output->setSampleBits(sampleSize);
+            udp_output->setSampleBytes((sampleSize-1)/8 + 1);
+            udp_output->setSampleRate(dn.getOutputRate());
+            udp_output->write(outsamples);
+        }
+
+        source_buffer.recycle(move(iqsamples));
+    }
+
+    timer.join();
+    source.stop();
+    result.generatedSamples = source_buffer.pushed_samples();
+    result.droppedSamples = source_buffer.dropped_samples();
+    result.framesSent = udp_output->getNbFramesSent();
+    udp_output.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300)); // last datagrams in flight
+
+    if (multiReceiver)
+    {
+        multiReceiver->stop();
+        multiCounter.getTotals(result);
+        result.datagramsDropped = 0;
+        multiReceiver.reset();
+    }
+    else
+    {
+        result.framesOutput = receiver->getNbFrames();
+        result.framesLost = receiver->getNbLostFrames();
+        result.recoveredBlocks = receiver->getFECBuffer().getNbRecoveredBlocks();
+        result.datagramsDropped = receiver->getChannel().getNbDropped();
+        result.avgLatency = receiver->getLatencyStats().getAvgLatency();
+        result.maxLatency = receiver->getLatencyStats().getMaxLatency();
+        receiver.reset();
+    }
+
+    // the last frames sent are only output when blocks of the frames after the reordering window arrive
+    uint64_t framesExpected = (result.framesSent > settings.reorderWindow) ? (result.framesSent - settings.reorderWindow) * settings.nbStreams : 0;
+    uint64_t framesGood = result.framesOutput - result.framesLost;
+    result.residualLoss = (framesExpected == 0) ? 1.0 :
+            (framesGood >= framesExpected) ? 0.0 : 1.0 - (double) framesGood / framesExpected;
+
+    // sustained: the source kept its rate, nothing piled up before the sender and the losses were restored
+    result.sustained = (framesExpected > 0)
+            && (result.droppedSamples == 0)
+            && (result.generatedSamples >= 0.9 * sampleRate * settings.runSeconds)
+            && (result.residualLoss <= maxResidualLoss);
+
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+    "Usage: sdrdaemon_loopback [options]\n"
+            "  -f list        Comma separated numbers of FEC blocks to test, up to 512 (default 0,8,16,32,64,128)\n"
+            "  -r list        Comma separated sample rates to test in increasing order, k suffix for kS/s\n"
+            "                 (default 250k,500k,1000k,2000k,4000k,8000k, test source limit 10000k)\n"
+            "  -t seconds     Duration of each run (default 2)\n"
+            "  -d log2        log2 of the decimation factor (default 0)\n"
+            "  -u size        UDP datagram size in bytes, multiple of 4 up to 8972 for jumbo frames (default 512)\n"
+            "  -w us          Wait between the UDP datagrams sent in microseconds (txwait, default 0)\n"
+            "  -D port        Loopback UDP port (default 19090)\n"
+            "  -p percent     Average datagram loss (default 0)\n"
+            "  -b datagrams   Mean length of the loss bursts (default 1: independent random losses)\n"
+            "  -o percent     Datagrams delivered out of order (default 0)\n"
+            "  -O datagrams   Number of datagrams a reordered datagram is overtaken by (default 8)\n"
+            "  -W frames      Reordering window of the FEC decoder (default 1, at least -i)\n"
+            "  -i frames      Interleave the blocks of this number of frames (interleave, 1 to 8, default 1: off)\n"
+            "  -c codec       Codec of the FEC blocks: cm256 (default), xor or ldpc (feccodec)\n"
+            "  -B blocks      Original blocks per frame including the meta data block, 2 to 1024 (frameblk, default 128).\n"
+            "                 More than 128 original or FEC blocks send large frames, over 256 blocks in all need ldpc\n"
+            "  -m streams     Send the frames to this number of consecutive ports from -D, received by a\n"
+            "                 MultiStreamReceiver (1 to 64, default 1). Without loss channel: not with -p nor -o\n"
+            "  -M workers     Receive threads of the MultiStreamReceiver (default 1)\n"
+            "  -x percent     Largest residual frame loss for a rate to be sustained (default 0)\n"
+            "  -s seed        Seed of the loss model (default 1)\n"
+            "\n"
+            "For each number of FEC blocks the rates are tried in order until one is not sustained.\n"
+            "A rate is sustained when the test source keeps it, no samples are dropped before\n"
+            "the sender and the residual frame loss after FEC decoding is at most -x.\n"
+            "\n");
+}
+
+static void badarg(const char *label)
+{
+    usage();
+    fprintf(stderr, "ERROR: Invalid argument for %s\n", label);
+    exit(1);
+}
+
+static bool parse_int(const char *s, int& v, bool allow_unit=false)
+{
+    char *endp;
+    long t = strtol(s, &endp, 10);
+    if (endp == s)
+        return false;
+    if ( allow_unit && *endp == 'k' &&
+         t > INT_MIN / 1000 && t < INT_MAX / 1000 ) {
+        t *= 1000;
+        endp++;
+    }
+    if (*endp != '\0' || t < INT_MIN || t > INT_MAX)
+        return false;
+    v = t;
+    return true;
+}
+
+/** Parse a comma separated list of integers in [min, max] */
+static bool parse_list(const char *s, std::vector<int>& values, int min, int max, bool allow_unit=false)
+{
+    std::istringstream is(s);
+    std::string item;
+    values.clear();
+
+    while (std::getline(is, item, ','))
+    {
+        int value;
+
+        if (!parse_int(item.c_str(), value, allow_unit) || (value < min) || (value > max)) {
+            return false;
+        }
+
+        values.push_back(value);
+    }
+
+    return !values.empty();
+}
+
+int main(int argc, char **argv)
+{
+    LoopbackSettings settings;
+    settings.address = "127.0.0.1";
+    settings.port = 19090;
+    settings.udpSize = UDPSINKFEC_UDPSIZE;
+    settings.log2Decim = 0;
+    settings.txDelay = 0;
+    settings.reorderWindow = 1;
+    settings.interleave = 1;
+    settings.fecCodec = FECCODEC_CM256;
+    settings.frameBlocks = UDPSINKFEC_NBORIGINALBLOCKS;
+    settings.nbStreams = 1;
+    settings.nbWorkers = 1;
+    settings.runSeconds = 2.0;
+    settings.lossRate = 0.0;
+    settings.burstLength = 1.0;
+    settings.reorderRate = 0.0;
+    settings.reorderDepth = 8;
+    settings.seed = 1;
+    double maxResidualLoss = 0.0;
+    std::vector<int> fecCounts = {0, 8, 16, 32, 64, 128};
+    std::vector<int> sampleRates = {250000, 500000, 1000000, 2000000, 4000000, 8000000};
+
+    fprintf(stderr, "SDRdaemon loopback harness\n");
+    fprintf(stderr, "SIMD kernels: %s\n", SIMDDispatch::name());
+
+    const struct option longopts[] = {
+        { "fec",        1, NULL, 'f' },
+        { "rates",      1, NULL, 'r' },
+        { "time",       1, NULL, 't' },
+        { "decim",      1, NULL, 'd' },
+        { "udpsize",    1, NULL, 'u' },
+        { "txwait",     1, NULL, 'w' },
+        { "dport",      1, NULL, 'D' },
+        { "loss",       1, NULL, 'p' },
+        { "burst",      1, NULL, 'b' },
+        { "reorder",    1, NULL, 'o' },
+        { "depth",      1, NULL, 'O' },
+        { "window",     1, NULL, 'W' },
+        { "interleave", 1, NULL, 'i' },
+        { "codec",      1, NULL, 'c' },
+        { "blocks",     1, NULL, 'B' },
+        { "streams",    1, NULL, 'm' },
+        { "workers",    1, NULL, 'M' },
+        { "residual",   1, NULL, 'x' },
+        { "seed",       1, NULL, 's' },
+        { NULL,         0, NULL, 0 } };
+
+    int c, longindex, value;
+    double dvalue;
+
+    while ((c = getopt_long(argc, argv,
+            "f:r:t:d:u:w:D:p:b:o:O:W:i:c:B:m:M:x:s:",
+            longopts, &longindex)) >= 0)
+    {
+        switch (c)
+        {
+            case 'f':
+                if (!parse_list(optarg, fecCounts, 0, UDPSINKFEC_NBFECBLOCKSLARGE)) {
+                    badarg("-f");
+                }
+                break;
+            case 'r':
+                if (!parse_list(optarg, sampleRates, 8000, 10000000, true)) {
+                    badarg("-r");
+                }
+                break;
+            case 't':
+                if (!parse_dbl(optarg, dvalue) || (dvalue < 0.5)) {
+                    badarg("-t");
+                } else {
+                    settings.runSeconds = dvalue;
+                }
+                break;
+            case 'd':
+                if (!parse_int(optarg, value) || (value < 0) || (value > 6)) {
+                    badarg("-d");
+                } else {
+                    settings.log2Decim = value;
+                }
+                break;
+            case 'u':
+                if (!parse_int(optarg, value) || (value < 64) || (value > UDPSINKFEC_UDPSIZEMAX) || (value % 4 != 0)) {
+                    badarg("-u");
+                } else {
+                    settings.udpSize = value;
+                }
+                break;
+            case 'w':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-w");
+                } else {
+                    settings.txDelay = value;
+                }
+                break;
+            case 'D':
+                if (!parse_int(optarg, value) || (value <= 0) || (value > 65535)) {
+                    badarg("-D");
+                } else {
+                    settings.port = value;
+                }
+                break;
+            case 'p':
+                if (!parse_dbl(optarg, dvalue) || (dvalue < 0.0) || (dvalue >= 100.0)) {
+                    badarg("-p");
+                } else {
+                    settings.lossRate = dvalue / 100.0;
+                }
+                break;
+            case 'b':
+                if (!parse_dbl(optarg, dvalue) || (dvalue < 1.0)) {
+                    badarg("-b");
+                } else {
+                    settings.burstLength = dvalue;
+                }
+                break;
+            case 'o':
+                if (!parse_dbl(optarg, dvalue) || (dvalue < 0.0) || (dvalue > 100.0)) {
+                    badarg("-o");
+                } else {
+                    settings.reorderRate = dvalue / 100.0;
+                }
+                break;
+            case 'O':
+                if (!parse_int(optarg, value) || (value < 1)) {
+                    badarg("-O");
+                } else {
+                    settings.reorderDepth = value;
+                }
+                break;
+            case 'W':
+                if (!parse_int(optarg, value) || (value < 1)) {
+                    badarg("-W");
+                } else {
+                    settings.reorderWindow = value;
+                }
+                break;
+            case 'i':
+                if (!parse_int(optarg, value) || (value < 1) || (value > UDPSINKFEC_INTERLEAVEMAX)) {
+                    badarg("-i");
+                } else {
+                    settings.interleave = value;
+                }
+                break;
+            case 'c':
+                settings.fecCodec = FECCodec::find(optarg);
+                if (settings.fecCodec < 0) {
+                    badarg("-c");
+                }
+                break;
+            case 'B':
+                if (!parse_int(optarg, value) || (value < UDPSINKFEC_NBORIGINALBLOCKSMIN) || (value > UDPSINKFEC_NBORIGINALBLOCKSLARGE)) {
+                    badarg("-B");
+                } else {
+                    settings.frameBlocks = value;
+                }
+                break;
+            case 'm':
+                if (!parse_int(optarg, value) || (value < 1) || (value > 64)) {
+                    badarg("-m");
+                } else {
+                    settings.nbStreams = value;
+                }
+                break;
+            case 'M':
+                if (!parse_int(optarg, value) || (value < 1) || (value > 64)) {
+                    badarg("-M");
+                } else {
+                    settings.nbWorkers = value;
+                }
+                break;
+            case 'x':
+                if (!parse_dbl(optarg, dvalue) || (dvalue < 0.0) || (dvalue > 100.0)) {
+                    badarg("-x");
+                } else {
+                    maxResidualLoss = dvalue / 100.0;
+                }
+                break;
+            case 's':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-s");
+                } else {
+                    settings.seed = value;
+                }
+                break;
+            default:
+                usage();
+                fprintf(stderr, "ERROR: Invalid command line options\n");
+                exit(1);
+        }
+    }
+
+    if (optind < argc)
+    {
+        usage();
+        fprintf(stderr, "ERROR: Unexpected command line options\n");
+        exit(1);
+    }
+
+    if ((settings.nbStreams > 1) && ((settings.lossRate > 0.0) || (settings.reorderRate > 0.0)))
+    {
+        usage();
+        fprintf(stderr, "ERROR: no loss channel with several streams (-m): -p and -o not possible\n");
+        exit(1);
+    }
+
+    if (settings.port + settings.nbStreams - 1 > 65535) {
+        badarg("-m");
+    }
+
+    // the first frame of a group is only complete once all the frames of the group are sent
+    if (settings.reorderWindow < settings.interleave) {
+        settings.reorderWindow = settings.interleave;
+    }
+
+    fprintf(stderr, "loss: %.3f%% bursts of %.1f datagrams, reordering: %.3f%% by %d datagrams, run: %.1fs\n",
+            settings.lossRate * 100.0, settings.burstLength, settings.reorderRate * 100.0, settings.reorderDepth, settings.runSeconds);
+    fprintf(stdout, "%4s %10s %8s %8s %8s %10s %10s %10s\n",
+            "fec", "rate", "sent", "lost", "restored", "residual%", "lat avg ms", "lat max ms");
+
+    std::vector<unsigned int> maxRates(fecCounts.size(), 0);
+
+    for (std::size_t ifec = 0; ifec < fecCounts.size(); ifec++)
+    {
+        for (int sampleRate : sampleRates)
+        {
+            LoopbackResult result;
+
+            if (!run_loopback(settings, sampleRate, fecCounts[ifec], maxResidualLoss, result)) {
+                exit(1);
+            }
+
+            fprintf(stdout, "%4d %10d %8lu %8lu %8lu %10.4f %10.1f %10.1f%s\n",
+                    fecCounts[ifec], sampleRate,
+                    (unsigned long) result.framesSent, (unsigned long) result.framesLost, (unsigned long) result.recoveredBlocks,
+                    result.residualLoss * 100.0, result.avgLatency, result.maxLatency,
+                    result.sustained ? "" :
+                        result.droppedSamples > 0 ? "  not sustained: sender too slow" :
+                        result.residualLoss > maxResidualLoss ? "  not sustained: residual loss" :
+                        "  not sustained: test source too slow");
+            fflush(stdout);
+
+            if (!result.sustained) {
+                break;
+            }
+
+            maxRates[ifec] = sampleRate;
+        }
+    }
+
+    fprintf(stdout, "\nMaximum sustained sample rate\n");
+
+    for (std::size_t ifec = 0; ifec < fecCounts.size(); ifec++) {
+        fprintf(stdout, "%4d FEC blocks: %d S/s\n", fecCounts[ifec], maxRates[ifec]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdlib>
+#include <cstdio>
+#include <climits>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include "SIMDDispatch.h"
+#include "SDRDaemon.h"
+#include "BlockCapture.h"
+#include "SDRdaemonFECBuffer.h"
+
+/** Datagrams of a capture held in memory so that reading the file is not part of the measure */
+struct Capture
+{
+    std::vector<uint8_t> data;       //!< datagrams one after the other
+    std::vector<std::size_t> offsets; //!< start of each datagram in data
+    std::vector<int> lengths;
+    std::vector<int64_t> arrivals;   //!< nanoseconds since the epoch
+};
+
+/** Decoder settings and statistics of a replay pass */
+struct ReplayResult
+{
+    uint64_t frames;
+    uint64_t lostFrames;
+    uint64_t recoveredBlocks;
+    uint64_t samples;
+    uint32_t lateBlocks;
+    uint32_t staleBlocks;
+    uint32_t duplicateBlocks;
+    uint32_t corruptBlocks;
+    uint32_t overflowBlocks;
+    double   seconds;                //!< wall time of the pass
+};
+
+static bool load_capture(const std::string& filename, Capture& capture)
+{
+    BlockCaptureReader reader;
+
+    if (!reader.open(filename))
+    {
+        fprintf(stderr, "ERROR: %s\n", reader.error().c_str());
+        return false;
+    }
+
+    std::vector<uint8_t> block;
+    int64_t arrival;
+
+    while (reader.next(block, arrival))
+    {
+        capture.offsets.push_back(capture.data.size());
+        capture.lengths.push_back(block.size());
+        capture.arrivals.push_back(arrival);
+        capture.data.insert(capture.data.end(), block.begin(), block.end());
+    }
+
+    if (!reader.error().empty()) {
+        fprintf(stderr, "WARNING: %s: replaying the %lu complete records\n", reader.error().c_str(), (unsigned long) capture.lengths.size());
+    }
+
+    return true;
+}
+
+/**
+ * Feed the datagrams to a new FEC decoder as UDPSourceFEC does and take the samples of each frame out.
+ * With realTime the datagrams are given at their original arrival times, else as fast as possible.
+ */
+static void replay(const Capture& capture, int reorderWindow, int deadlineMs, bool realTime, ReplayResult& result)
+{
+    std::unique_ptr<SDRdaemonFECBuffer> fecBuffer(new SDRdaemonFECBuffer());
+    std::vector<SDRdaemonFECBuffer::Sample> samples;
+    fecBuffer->setReorderWindow(reorderWindow);
+    fecBuffer->setDeadline(deadlineMs);
+    memset(&result, 0, sizeof(result));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (std::size_t i = 0; i < capture.lengths.size(); i++)
+    {
+        if (realTime) {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(capture.arrivals[i] - capture.arrivals[0]));
+        }
+
+        if (fecBuffer->write((uint8_t *) &capture.data[capture.offsets[i]], capture.lengths[i]))
+        {
+            std::size_t nbSamples = fecBuffer->getFrameNbSamples();
+
+            if (nbSamples > 0)
+            {
+                samples.resize(nbSamples);
+                fecBuffer->getFrameSamples(&samples[0]);
+                result.samples += nbSamples;
+            }
+        }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.frames = fecBuffer->getNbFrames();
+    result.lostFrames = fecBuffer->getNbLostFrames();
+    result.recoveredBlocks = fecBuffer->getNbRecoveredBlocks();
+    result.lateBlocks = fecBuffer->getNbLateBlocks();
+    result.staleBlocks = fecBuffer->getNbStaleBlocks();
+    result.duplicateBlocks = fecBuffer->getNbDuplicateBlocks();
+    result.corruptBlocks = fecBuffer->getNbCorruptBlocks();
+    result.overflowBlocks = fecBuffer->getNbOverflowBlocks();
+}
+
+static void usage()
+{
+    fprintf(stderr,
+    "Usage: sdrdaemon_replay [options] capture_file\n"
+            "  -W frames      Reordering window of the FEC decoder (default 1)\n"
+            "  -T ms          Play-out deadline of the FEC decoder (default 0: none)\n"
+            "  -o             Replay at the original arrival times (default: as fast as possible)\n"
+            "  -n passes      Number of replay passes, each with a new decoder (default 3)\n"
+            "\n"
+            "Replays the UDP blocks recorded with the -R option of sdrdaemontx into the FEC decoder\n"
+            "and reports the decoding throughput and the recovery statistics. The best pass is kept\n"
+            "for the throughput; the statistics do not depend on the pass.\n"
+            "\n");
+}
+
+static void badarg(const char *label)
+{
+    usage();
+    fprintf(stderr, "ERROR: Invalid argument for %s\n", label);
+    exit(1);
+}
+
+static bool parse_int(const char *s, int& v)
+{
+    char *endp;
+    long t = strtol(s, &endp, 10);
+    if (endp == s)
+        return false;
+    if (*endp != '\0' || t < INT_MIN || t > INT_MAX)
+        return false;
+    v = t;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int reorderWindow = 1;
+    int deadlineMs = 0;
+    bool realTime = false;
+    int nbPasses = 3;
+
+    fprintf(stderr, "SDRdaemon FEC capture replay\n");
+    fprintf(stderr, "SIMD kernels: %s\n", SIMDDispatch::name());
+
+    const struct option longopts[] = {
+        { "window",     1, NULL, 'W' },
+        { "deadline",   1, NULL, 'T' },
+        { "original",   0, NULL, 'o' },
+        { "passes",     1, NULL, 'n' },
+        { NULL,         0, NULL, 0 } };
+
+    int c, longindex, value;
+
+    while ((c = getopt_long(argc, argv,
+            "W:T:on:",
+            longopts, &longindex)) >= 0)
+    {
+        switch (c)
+        {
+            case 'W':
+                if (!parse_int(optarg, value) || (value < 1)) {
+                    badarg("-W");
+                } else {
+                    reorderWindow = value;
+                }
+                break;
+            case 'T':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-T");
+                } else {
+                    deadlineMs = value;
+                }
+                break;
+            case 'o':
+                realTime = true;
+                break;
+            case 'n':
+                if (!parse_int(optarg, value) || (value < 1)) {
+                    badarg("-n");
+                } else {
+                    nbPasses = value;
+                }
+                break;
+            default:
+                usage();
+                fprintf(stderr, "ERROR: Invalid command line options\n");
+                exit(1);
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        usage();
+        fprintf(stderr, "ERROR: one capture file expected\n");
+        exit(1);
+    }
+
+    Capture capture;
+
+    if (!load_capture(argv[optind], capture)) {
+        exit(1);
+    }
+
+    if (capture.lengths.empty())
+    {
+        fprintf(stderr, "ERROR: %s: no datagram recorded\n", argv[optind]);
+        exit(1);
+    }
+
+    double span = (capture.arrivals.back() - capture.arrivals[0]) * 1e-9;
+    fprintf(stdout, "capture: %lu datagrams, %lu bytes over %.3f s\n",
+            (unsigned long) capture.lengths.size(), (unsigned long) capture.data.size(), span);
+
+    ReplayResult best = ReplayResult();
+
+    for (int pass = 0; pass < nbPasses; pass++)
+    {
+        ReplayResult result;
+        replay(capture, reorderWindow, deadlineMs, realTime, result);
+
+        if ((pass == 0) || (result.seconds < best.seconds)) {
+            best = result;
+        }
+
+        if (realTime) { // the timing is the one of the capture
+            break;
+        }
+    }
+
+    fprintf(stdout, "frames: %lu output, %lu lost, %lu blocks restored by FEC\n",
+            (unsigned long) best.frames, (unsigned long) best.lostFrames, (unsigned long) best.recoveredBlocks);
+    fprintf(stdout, "blocks dropped: %u late, %u stale, %u duplicate, %u corrupt, %u overflow\n",
+            best.lateBlocks, best.staleBlocks, best.duplicateBlocks, best.corruptBlocks, best.overflowBlocks);
+    fprintf(stdout, "residual frame loss: %.4f%%\n", best.frames > 0 ? (100.0 * best.lostFrames) / best.frames : 0.0);
+    fprintf(stdout, "decoding: %.3f s, %.0f datagrams/s, %.1f MB/s, %.3f MS/s (%.0f ns per datagram)\n",
+            best.seconds,
+            capture.lengths.size() / best.seconds,
+            capture.data.size() * 1e-6 / best.seconds,
+            best.samples * 1e-6 / best.seconds,
+            best.seconds * 1e9 / capture.lengths.size());
+
+    return 0;
+}
@@ -32,14 +32,24 @@
 #include <atomic>
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <sstream>
 #include <unistd.h>
 #include <getopt.h>
 #include <sys/time.h>
 
 #include "util.h"
 #include "DataBuffer.h"
-#include "Downsampler.h"
+#include "RingBuffer.h"
+#include "SIMDDispatch.h"
 #include "UDPSinkFEC.h"
+#include "FECEncoderPool.h"
+#include "RxPipeline.h"
+#include "PipelineScheduler.h"
 
 #ifdef HAS_RTLSDR
     #include "RtlSdrSource.h"
@@ -54,12 +64,11 @@
     #include "BladeRFSource.h"
 #endif
 #include "TestSource.h"
+#include "FileSource.h"
 #include "SDRDaemon.h"
 
 //#include <type_traits>
 
-#define UDPSIZE 512
-
 /** Flag is set on SIGINT / SIGTERM. */
 static std::atomic_bool stop_flag(false);
 
@@ -72,44 +81,6 @@ void adjust_gain(SampleVector& samples, double gain)
     }
 }
 
-/**
- * Get data from output buffer and write to output stream.
- *
- * This code runs in a separate thread.
- */
-void write_output_data(UDPSink *output,
-        DataBuffer<IQSample> *buf,
-        std::size_t buf_minfill)
-{
-    while (!stop_flag.load())
-    {
-        if (buf->queued_samples() == 0)
-        {
-            // The buffer is empty. Perhaps the output stream is consuming
-            // samples faster than we can produce them. Wait until the buffer
-            // is back at its nominal level to make sure this does not happen
-            // too often.
-            buf->wait_buffer_fill(buf_minfill);
-        }
-
-        if (buf->pull_end_reached())
-        {
-            // Reached end of stream.
-            break;
-        }
-
-        // Get samples from buffer and write to output.
-        IQSampleVector samples = buf->pull();
-        output->write(samples);
-
-        if (!(*output))
-        {
-            fprintf(stderr, "ERROR: Output: %s\n", output->error().c_str());
-        }
-    }
-}
-
-
 /** Handle Ctrl-C and SIGTERM. */
 static void handle_sigterm(int sig)
 {
@@ -145,28 +116,110 @@ void usage()
 #ifdef HAS_BLADERF
             "                   - bladerf: BladeRF\n"
 #endif
-            "                   - test:    Test signal generator (CW carrier)\n"
+            "                   - test:    Test signal generator (tones, noise, bursts)\n"
+            "                   - file:    Replay of a .sdriq recording\n"
             "  -c config      Startup configuration. Comma separated key=value configuration pairs\n"
             "                 or just key for switches. See below for valid values\n"
             "  -d devidx      Device index, 'list' to show device list (default 0)\n"
+            "  -s serial      Open the device with this serial number directly without listing the\n"
+            "                 devices (rtlsdr, hackrf, airspy, bladerf). Overrides -d\n"
             "  -b blocks      Set buffer size in number of UDP blocks (default: 480 512 samples blocks)\n"
+            "  -L             Use lock-free ring buffers between device, main loop and UDP output\n"
+            "  -Q samples     Maximum number of samples queued in the input and output buffers\n"
+            "                 (default: %d seconds of device samples, 0: unlimited)\n"
+            "  -P policy      What to drop when a buffer is full: 'oldest' or 'newest' samples (default: oldest)\n"
+            "                 Lock-free ring buffers always drop the newest samples\n"
+            "  -p             Pipeline mode: decimation, frame assembly, FEC encoding and UDP sending each run\n"
+            "                 in their own thread connected by lock-free queues (implies -L and an output buffer)\n"
+            "  -i             Inline mode: decimation and frame assembly run in the device thread as the blocks arrive\n"
+            "                 while they take less than half of the block duration, else in the main loop (no -b)\n"
+            "  -A cpus        Pin the decimation, frame assembly, FEC encoding and sending stages to these CPUs.\n"
+            "                 Comma separated list in this order, -1 leaves a stage free (default: no pinning)\n"
             "  -I address     IP address. Samples are sent to this address (default: 127.0.0.1)\n"
+            "                 Comma separated list of address[:port] to send the same frames to several\n"
+            "                 destinations (unicast or multicast groups), port defaults to -D\n"
+            "  -T ttl         Time to live of the datagrams sent to multicast groups (default 1)\n"
             "  -D port        Data port. Samples are sent on this UDP port (default 9090)\n"
+            "  -U             Connect the UDP socket to the data address and port (faster sends, single unicast destination)\n"
+            "  -G             Send batches of UDP blocks with UDP segmentation offload (Linux 4.18+, see txbatch)\n"
+            "  -u size        UDP datagram size in bytes, multiple of 4 up to 8972 for jumbo frames (default 512)\n"
+            "  -w bits        Bits per I or Q sample on the network: 16, 12 (packed, 25%% less bandwidth for\n"
+            "                 devices of 12 bits or less) or 8 (50%% less bandwidth for undecimated 8 bit\n"
+            "                 devices, else as 12). Default 16\n"
+            "  -z             LZ4 compress the frames (needs LZ4 at build time). Fewer frames are sent when\n"
+            "                 the samples compress (decimated, quiet or squelched channels) at the cost of latency\n"
+            "  -V             Block integrity check: each datagram ends with its CRC32C (4 bytes) and the receivers\n"
+            "                 drop the corrupt ones, restored by FEC as if lost. Needs up to date receivers\n"
+            "  -q dB[:ms]     Squelch: while the mean power stays below dB full scale (negative) for ms milliseconds\n"
+            "                 (default 500) only a keep-alive block per frame is sent and the receivers insert silence.\n"
+            "                 Applies to each channel with -K\n"
+            "  -R frames      Number of frames queued between frame assembly and UDP transmission, 2 to 64 (default %d)\n"
+            "  -F blocks      Largest number of FEC blocks per frame, 0 to 512 (default %d). Sizes the frames of the\n"
+            "                 Tx ring: fecblk and fecauto are capped to it. Above 128: large frames (see -B)\n"
+            "  -B blocks      Largest number of original blocks per frame, 2 to 1024 (default 128). Sizes the frames\n"
+            "                 of the Tx ring: frameblk is capped to it. Above 128 the datagrams of the frames end with\n"
+            "                 a 4 bytes trailer giving the 16 bits block index (large frames, needs up to date receivers),\n"
+            "                 frames beyond 256 blocks with their FEC blocks need feccodec=ldpc. No nack with large frames\n"
+            "  -E threads     Number of FEC encoding threads, 1 to 16 (default 1). More than 1 implies -p\n"
             "  -C port        Configuration port (default 9091). The configuration string as described below\n"
             "                 is sent on this port via nanomsg in TCP to control the device\n"
+            "  -m port        Publish the pipeline metrics every second on this port via nanomsg PUB in TCP (default: off)\n"
+            "  -H port        Serve the pipeline metrics to Prometheus on this HTTP port (default: off)\n"
+            "  -Z             Back the UDP block rings with reserved huge pages (vm.nr_hugepages). Without it\n"
+            "                 transparent huge pages are requested\n"
+            "  -K n[:taps]    Channelizer: split the device band in n channels (power of 2) of rate srate/n sent\n"
+            "                 to their own destinations given with -k instead of the decimator output.\n"
+            "                 taps per channel of the filter bank: 4 to 64 (default 24)\n"
+            "  -k chan:address:port[:fecblk] Channel to send: chan from -n/2 to n/2-1 (0: center, negative\n"
+            "                 below), fecblk fixes its FEC blocks (default: fecblk configuration). Repeat for each\n"
+            "  -X policies    Thread CPU sets and scheduling: comma separated name=cpus[:fifo|rr|other[:priority]]\n"
+            "                 cpus: 2, 2-3, 1+3 or - (not pinned). 'rt' alone gives FIFO scheduling to the device\n"
+            "                 and UDP threads. Names: see below (default: no pinning, default scheduler)\n"
+            "                 Threads: device usb control frame fecenc udpsend udptx metrics main dsp\n"
+            "  -l             Measure the latency of each stage from the device callback to the UDP send\n"
+            "                 and add the histograms to the metrics\n"
+            "  -M file        Several devices in one process: one device per line of whitespace separated\n"
+            "                 devtype= dev= serial= config= daddress= dport= cport= metrics= http= shm= (default: the\n"
+            "                 command line values). -E is then the size of the encoder pool shared by all devices\n"
+            "  -W workers     Number of DSP threads shared by the devices of -M (default: one per device up\n"
+            "                 to the number of CPUs)\n"
+            "  -O name[:slots] Also publish the samples in this POSIX shared memory ring for consumers on the same\n"
+            "                 host (sdrdaemontx -O, gr-sdrdaemon with host shm:name). slots: frames kept (default %d).\n"
+            "                 With -D 0 nothing is sent over UDP\n"
             "\n"
             "Configuration options for the UDP sender:\n"
-            "  txwait=<int>   Wait this number of microseconds (usleep) between transmission of each UDP packet (default 200)\n"
+            "  txdelay=<int>  Wait this number of microseconds (usleep) between transmission of each UDP packet (default 0)\n"
             "\n"
             "Configuration options for the decimator:\n"
             "  decim=<int>    log2 of decimation factor (default 0: no decimation)\n"
+            "  cic=<int>      CIC decimation by this integer ratio (2 to 512) ahead of decim (default 0: none)\n"
             "  fcpos=<int>    Center frequency position (default 2: center):\n"
             "                   - 0: Infradyne\n"
             "                   - 1: Supradyne\n"
             "                   - 2: Centered\n"
+            "  decblk=<int>   Decimation by 8 and more: 0: sample by sample (default), 1: block cascade\n"
+            "  shift=<int>    Bring the signal at this offset in Hz from the device frequency to the center\n"
+            "                 of the output with a fine tuning NCO (default 0: none)\n"
+            "  srate_out=<int> Resample the decimator output to this rate in Hz (default 0: no resampling)\n"
+            "\n"
+            "Status request:\n"
+            "  status         Reply with the buffers status on the configuration port as:\n"
+            "                 input queued samples:dropped blocks:dropped samples:output queued samples:dropped blocks:dropped samples\n"
             "\n"
             "Configuration options for the Forward Erasure Correction:\n"
-            "  fecblk=<int>   Number of additional FEC blocks (1..128, default 32)\n"
+            "  fecblk=<int>   Number of additional FEC blocks (1..512 capped to -F, default 32)\n"
+            "  fecauto=<int>  Adapt FEC blocks up to this number and pacing to the receiver reports (0: off, default)\n"
+            "  nack=<int>     1: resend the blocks the receiver asks for (retransmission requests), 0: off (default)\n"
+            "  overload=<int> 1: shed FEC blocks and pacing before samples when the UDP transmission falls behind\n"
+            "                 (default), 0: off\n"
+            "  frameblk=<int> Number of original blocks per frame including the meta data block (2..1024 capped to -B,\n"
+            "                 default 128)\n"
+            "  framems=<int>  Cut the frames to the blocks filled in this time in milliseconds (0: off, default)\n"
+            "  interleave=<int> Interleave the blocks of this number of frames against burst losses (1..8, at most\n"
+            "                 half of -R, default 1: off). The receivers need a reordering window (-W) at least as large\n"
+            "  feccodec=<str> Codec of the FEC blocks: cm256 (Reed-Solomon, default), xor (parity restoring bursts\n"
+            "                 of up to fecblk blocks at a fraction of the CPU, best with interleave) or ldpc (LDPC\n"
+            "                 staircase for large frames up to 1536 blocks, needs a few more blocks than frameblk)\n"
             "\n"
 #ifdef HAS_RTLSDR
             "Configuration options for RTL-SDR devices\n"
@@ -211,6 +264,8 @@ void usage()
             "  antbias=<int>  1: Enable 0: disable antemma bias (default 0: disabled)\n"
             "  lagc=<int>     1: Enable 0: disable  LNA AGC (default 0: disabled)\n"
             "  magc=<int>     1: Enable 0: disable  mixer AGC (default 0: disabled)\n"
+            "  raw=<int>      1: Raw real samples packed over USB converted by the daemon 0: I/Q samples of libairspy\n"
+            "                 Only at start (default 0)\n"
             "\n"
 #endif
 #ifdef HAS_BLADERF
@@ -223,15 +278,30 @@ void usage()
             "  lgain=<int>    LNA gain in dB. 'list' to just get a list of valid values: (default 3)\n"
             "  v1gain=<int>   VGA1 gain in dB. 'list' to just get a list of valid values: (default 20)\n"
             "  v2gain=<int>   VGA2 gain in dB. 'list' to just get a list of valid values: (default 9)\n"
+            "  async=<int>    1: asynchronous stream API 0: synchronous reads (default 0: synchronous)\n"
+            "  nbuf=<int>     Number of USB buffers (default 64)\n"
+            "  bufsize=<int>  USB buffer size in samples. Multiple of 1024 (default 8192)\n"
+            "  nxfer=<int>    Number of USB transfers in flight. Less than nbuf (default 32)\n"
             "\n"
 #endif
             "Configuration options for the test signal generator\n"
             "  freq=<int>     Center frequency sent in meta data in Hz. Valid values 10k to 10G (default 435000000)\n"
-            "  srate=<int>    Sample rate sent in meta data in Hz. Valid values: 8k to 10M (default 5000000)\n"
+            "  srate=<int>    Sample rate sent in meta data in Hz. Valid values: 8k to 61.44M (default 5000000)\n"
             "  dfp=<int>      Positive shift frequency of carrier from center frequency in Hz (default 100000)\n"
             "  dfn=<int>      Negative shift frequency of carrier from center frequency in Hz (default 100000)\n"
             "  power=<int>    Signal peak power in negative dB. (default 0)\n"
-            "\n");
+            "  gen=<string>   Signal profile: float (legacy), tone, tones, noise or burst (default tone)\n"
+            "  tones=<list>   Colon separated signed carrier offsets in Hz for the tones and burst profiles\n"
+            "  noise=<int>    Add white noise at this power in negative dB (default none, 20 for gen=noise)\n"
+            "  burst=<on:period> Burst on time and period in ms (default 10:100)\n"
+            "  realtime=<int> Pace at the sample rate (1) or as fast as possible (0) (default 1)\n"
+            "\n"
+            "Configuration options for the file replay\n"
+            "  file=<string>  .sdriq file to replay (mandatory). Sample rate and frequency are read from the file\n"
+            "  realtime=<int> Pace at the recorded sample rate (1) or as fast as possible (0) (default 1)\n"
+            "  loop=<int>     Restart at end of file (1) or stop (0) (default 0)\n"
+            "  blklen=<int>   Block length in number of samples (default 65536)\n"
+            "\n", RXQUEUE_SECONDS, UDPSINKFEC_NBTXBLOCKS, UDPSINKFEC_NBFECBLOCKS, SHAREDRING_NBSLOTS);
 }
 
 
@@ -261,6 +331,68 @@ bool parse_int(const char *s, int& v, bool allow_unit=false)
 }
 
 
+/** Parse comma separated list of at most 4 CPU numbers (-1: not pinned) */
+bool parse_cpus(const char *s, int cpus[4])
+{
+    std::string str(s);
+    std::size_t start = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        std::size_t end = str.find(',', start);
+        std::string item = str.substr(start, end == std::string::npos ? std::string::npos : end - start);
+
+        if (!parse_int(item.c_str(), cpus[i]) || (cpus[i] < -1) || (cpus[i] >= CPU_SETSIZE)) {
+            return false;
+        }
+
+        if (end == std::string::npos) {
+            return true;
+        }
+
+        start = end + 1;
+    }
+
+    return false; // more than 4 items
+}
+
+/** Open a device of type devtype directly from its serial number without enumerating the devices */
+static bool get_device_by_serial(std::string& devtype, DeviceSource **srcsdr, const std::string& serial)
+{
+#ifdef HAS_RTLSDR
+    if (strcasecmp(devtype.c_str(), "rtlsdr") == 0)
+    {
+        *srcsdr = new RtlSdrSource(0, serial);
+    }
+#endif
+#ifdef HAS_HACKRF
+    if (strcasecmp(devtype.c_str(), "hackrf") == 0)
+    {
+        *srcsdr = new HackRFSource(0, serial);
+    }
+#endif
+#ifdef HAS_AIRSPY
+    if (strcasecmp(devtype.c_str(), "airspy") == 0)
+    {
+        *srcsdr = new AirspySource(0, serial);
+    }
+#endif
+#ifdef HAS_BLADERF
+    if (strcasecmp(devtype.c_str(), "bladerf") == 0)
+    {
+        *srcsdr = new BladeRFSource(serial.c_str());
+    }
+#endif
+    if (*srcsdr == 0)
+    {
+        fprintf(stderr, "ERROR: device type %s cannot be opened by serial number (-s option)\n", devtype.c_str());
+        return false;
+    }
+
+    fprintf(stderr, "using device %s serial %s\n", devtype.c_str(), serial.c_str());
+    return true;
+}
+
 static bool get_device(std::vector<std::string> &devnames, std::string& devtype, DeviceSource **srcsdr, int devidx)
 {
     bool deviceDefined = false;
@@ -298,6 +430,12 @@ static bool get_device(std::vector<std::string> &devnames, std::string& devtype,
         deviceDefined = true;
     }
 
+    if (strcasecmp(devtype.c_str(), "file") == 0)
+    {
+        FileSource::get_device_names(devnames);
+        deviceDefined = true;
+    }
+
     if (!deviceDefined)
     {
         fprintf(stderr, "ERROR: wrong device type (-t option) must be one of the following:\n");
@@ -314,6 +452,7 @@ static bool get_device(std::vector<std::string> &devnames, std::string& devtype,
         fprintf(stderr, "       bladerf\n");
 #endif
         fprintf(stderr, "       test\n");
+        fprintf(stderr, "       file\n");
         return false;
     }
 
@@ -370,79 +509,444 @@ static bool get_device(std::vector<std::string> &devnames, std::string& devtype,
         *srcsdr = new TestSource(0);
     }
 
+    if (strcasecmp(devtype.c_str(), "file") == 0)
+    {
+        // Open file replay device.
+        *srcsdr = new FileSource(0);
+    }
+
     return true;
 }
 
-int main(int argc, char **argv)
+/** Open the device of the spec by serial number or by index. The device is checked but not yet configured. */
+static bool open_device(DeviceSpec& spec, DeviceSource **srcsdr)
 {
-    int     devidx  = 0;
-    std::string  filename;
-    std::string  alsadev("default");
-    std::string config_str;
-    std::string devtype_str;
     std::vector<std::string> devnames;
-    std::string dataaddress("127.0.0.1");
-    unsigned int dataport = 9090;
-    unsigned int cfgport = 9091;
-    DeviceSource  *srcsdr = 0;
-    unsigned int outputbuf_samples = 48 * UDPSIZE;
-//    uint32_t compressedMinSize = 0;
-//    bool useFec = true;
-    unsigned int nbFECBlocks = 0;
-    unsigned int txDelay = 0;
+    *srcsdr = 0;
+
+    if (!spec.serial.empty())
+    {
+        if (!get_device_by_serial(spec.devtype, srcsdr, spec.serial)) {
+            return false;
+        }
+    }
+    else if (!get_device(devnames, spec.devtype, srcsdr, spec.devidx))
+    {
+        return false;
+    }
+
+    if (!(**srcsdr))
+    {
+        fprintf(stderr, "ERROR source: %s\n", (*srcsdr)->error().c_str());
+        delete *srcsdr;
+        return false;
+    }
+
+    return true;
+}
+
+/** name[:slots] of the shared memory ring */
+static bool parse_shm(const std::string& str, DeviceSpec& spec)
+{
+    std::size_t colon = str.find(':');
+    spec.shmname = str.substr(0, colon);
+    int slots;
+
+    if (colon != std::string::npos)
+    {
+        if (!parse_int(str.substr(colon + 1).c_str(), slots) || (slots < 2)) {
+            return false;
+        }
+
+        spec.shmslots = slots;
+    }
+
+    return !spec.shmname.empty();
+}
+
+/**
+ * Read the devices of the multi-device mode: one per line as whitespace separated key=value pairs with the
+ * long option names devtype, dev, serial, config, daddress, dport, cport, metrics, http and shm. The values
+ * not given are those of the command line. Empty lines and lines starting with # are ignored.
+ */
+static bool read_devices(const std::string& filename, const DeviceSpec& defaults, std::vector<DeviceSpec>& specs)
+{
+    std::ifstream file(filename.c_str());
+
+    if (!file)
+    {
+        fprintf(stderr, "ERROR: multi-device file %s: %s\n", filename.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::string line;
+    unsigned int lineNumber = 0;
+    std::vector<unsigned int> boundPorts; // of the devices already read
+
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        std::istringstream is(line);
+        std::string item;
+        DeviceSpec spec(defaults);
+        bool empty = true;
+
+        while (is >> item)
+        {
+            if (item[0] == '#') {
+                break;
+            }
+
+            std::size_t eq = item.find('=');
+            std::string key = item.substr(0, eq);
+            std::string value = eq == std::string::npos ? std::string() : item.substr(eq + 1);
+            int v;
+            bool ok = true;
+
+            if (key == "devtype") {
+                spec.devtype = value;
+            } else if (key == "dev") {
+                ok = parse_int(value.c_str(), spec.devidx) && (spec.devidx >= 0);
+            } else if (key == "serial") {
+                spec.serial = value;
+            } else if (key == "config") {
+                spec.config = value;
+            } else if (key == "daddress") {
+                spec.dataaddress = value;
+            } else if (key == "shm") {
+                ok = parse_shm(value, spec);
+            } else if ((key == "dport") || (key == "cport") || (key == "metrics") || (key == "http")) {
+                unsigned int *port = key == "dport" ? &spec.dataport : key == "cport" ? &spec.cfgport : key == "metrics" ? &spec.metricsport : &spec.httpport;
+                ok = parse_int(value.c_str(), v) && ((v > 0) || (key == "dport")) && (v < 65536);
+
+                if (ok) {
+                    *port = v;
+                }
+            } else {
+                ok = false;
+            }
+
+            if (!ok || (eq == std::string::npos))
+            {
+                fprintf(stderr, "ERROR: multi-device file %s line %u: invalid %s\n", filename.c_str(), lineNumber, item.c_str());
+                return false;
+            }
+
+            empty = false;
+        }
+
+        if (empty) {
+            continue;
+        }
+
+        // the configuration, metrics and http ports are bound by each device: they must all differ
+        std::vector<std::pair<unsigned int, const char *> > ports;
+        ports.push_back(std::make_pair(spec.cfgport, "configuration"));
+
+        if (spec.metricsport > 0) {
+            ports.push_back(std::make_pair(spec.metricsport, "metrics"));
+        }
+
+        if (spec.httpport > 0) {
+            ports.push_back(std::make_pair(spec.httpport, "http"));
+        }
+
+        for (std::size_t i = 0; i < ports.size(); i++)
+        {
+            bool used = std::find(boundPorts.begin(), boundPorts.end(), ports[i].first) != boundPorts.end();
+
+            for (std::size_t j = 0; j < i; j++) {
+                used = used || (ports[j].first == ports[i].first);
+            }
+
+            if (used)
+            {
+                fprintf(stderr, "ERROR: multi-device file %s line %u: %s port %u already used\n", filename.c_str(), lineNumber, ports[i].second, ports[i].first);
+                return false;
+            }
+        }
+
+        for (std::size_t i = 0; i < ports.size(); i++) {
+            boundPorts.push_back(ports[i].first);
+        }
+
+        specs.push_back(spec);
+    }
+
+    if (specs.empty())
+    {
+        fprintf(stderr, "ERROR: multi-device file %s: no device\n", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    RxOptions options;
+    DeviceSpec spec;
+    bool outputbuf_given = false;
+    std::string multi_file;
+    unsigned int dsp_workers = 0;
 
     fprintf(stderr,
             "SDRDaemonRx - Collect samples from SDR device and send it over the network via UDP\n");
+    fprintf(stderr, "SIMD kernels: %s\n", SIMDDispatch::name());
 
     const struct option longopts[] = {
         { "devtype",    2, NULL, 't' },
         { "config",     2, NULL, 'c' },
         { "dev",        1, NULL, 'd' },
+        { "serial",     1, NULL, 's' },
         { "buffer",     1, NULL, 'b' },
         { "daddress",   2, NULL, 'I' },
         { "dport",      1, NULL, 'D' },
         { "cport",      1, NULL, 'C' },
+        { "lockfree",   0, NULL, 'L' },
+        { "qcapacity",  1, NULL, 'Q' },
+        { "qpolicy",    1, NULL, 'P' },
+        { "pipeline",   0, NULL, 'p' },
+        { "inline",     0, NULL, 'i' },
+        { "affinity",   1, NULL, 'A' },
+        { "connect",    0, NULL, 'U' },
+        { "gso",        0, NULL, 'G' },
+        { "udpsize",    1, NULL, 'u' },
+        { "wirebits",   1, NULL, 'w' },
+        { "compress",   0, NULL, 'z' },
+        { "blockcrc",   0, NULL, 'V' },
+        { "squelch",    1, NULL, 'q' },
+        { "ttl",        1, NULL, 'T' },
+        { "txring",     1, NULL, 'R' },
+        { "fecmax",     1, NULL, 'F' },
+        { "blocksmax",  1, NULL, 'B' },
+        { "encoders",   1, NULL, 'E' },
+        { "metrics",    1, NULL, 'm' },
+        { "http",       1, NULL, 'H' },
+        { "threads",    1, NULL, 'X' },
+        { "hugepages",  0, NULL, 'Z' },
+        { "channels",   1, NULL, 'K' },
+        { "channel",    1, NULL, 'k' },
+        { "latency",    0, NULL, 'l' },
+        { "multi",      1, NULL, 'M' },
+        { "workers",    1, NULL, 'W' },
+        { "shm",        1, NULL, 'O' },
         { NULL,         0, NULL, 0 } };
 
     int c, longindex, value;
+    std::string thread_error;
     while ((c = getopt_long(argc, argv,
-            "t:c:d:b:I:D:C:",
+            "t:c:d:s:b:I:D:C:LQ:P:piA:UGu:w:zVq:R:F:B:E:T:m:H:lX:ZK:k:M:W:O:",
             longopts, &longindex)) >= 0)
     {
         switch (c)
         {
             case 't':
-                devtype_str.assign(optarg);
+                spec.devtype.assign(optarg);
                 break;
             case 'c':
-                config_str.assign(optarg);
+                spec.config.assign(optarg);
                 break;
             case 'd':
-                if (!parse_int(optarg, devidx))
-                    devidx = -1;
+                if (!parse_int(optarg, spec.devidx))
+                    spec.devidx = -1;
+                break;
+            case 's':
+                spec.serial.assign(optarg);
                 break;
             case 'b':
                 if (!parse_int(optarg, value) || (value < 0)) {
                     badarg("-b");
                 } else {
-                    outputbuf_samples = value;
+                    options.outputbuf_samples = value;
+                    outputbuf_given = true;
                 }
                 break;
             case 'I':
-                dataaddress.assign(optarg);
+                spec.dataaddress.assign(optarg);
                 break;
             case 'D':
                 if (!parse_int(optarg, value) || (value < 0)) {
                     badarg("-D");
                 } else {
-                    dataport = value;
+                    spec.dataport = value;
                 }
                 break;
             case 'C':
                 if (!parse_int(optarg, value) || (value < 0)) {
                     badarg("-C");
                 } else {
-                    cfgport = value;
+                    spec.cfgport = value;
+                }
+                break;
+            case 'L':
+                options.lockfree_buffers = true;
+                break;
+            case 'Q':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-Q");
+                } else {
+                    options.queue_capacity = value;
+                }
+                break;
+            case 'P':
+                if (strcasecmp(optarg, "oldest") == 0) {
+                    options.drop_policy = DataBuffer<IQSample>::DropOldest;
+                } else if (strcasecmp(optarg, "newest") == 0) {
+                    options.drop_policy = DataBuffer<IQSample>::DropNewest;
+                } else {
+                    badarg("-P");
+                }
+                break;
+            case 'p':
+                options.pipeline = true;
+                break;
+            case 'i':
+                options.inline_dsp = true;
+                break;
+            case 'A':
+                if (!parse_cpus(optarg, options.stage_cpus)) {
+                    badarg("-A");
+                }
+                break;
+            case 'U':
+                options.udp_connect = true;
+                break;
+            case 'G':
+                options.udp_gso = true;
+                break;
+            case 'u':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-u");
+                } else {
+                    options.udp_size = value;
+                }
+                break;
+            case 'T':
+                if (!parse_int(optarg, value) || (value < 0) || (value > 255)) {
+                    badarg("-T");
+                } else {
+                    options.multicast_ttl = value;
+                }
+                break;
+            case 'R':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-R");
+                } else {
+                    options.tx_ring = value;
+                }
+                break;
+            case 'F':
+                if (!parse_int(optarg, value) || (value < 0) || (value > UDPSINKFEC_NBFECBLOCKSLARGE)) {
+                    badarg("-F");
+                } else {
+                    options.fec_max = value;
+                }
+                break;
+            case 'B':
+                if (!parse_int(optarg, value) || (value < UDPSINKFEC_NBORIGINALBLOCKSMIN) || (value > UDPSINKFEC_NBORIGINALBLOCKSLARGE)) {
+                    badarg("-B");
+                } else {
+                    options.frame_max = value;
+                }
+                break;
+            case 'E':
+                if (!parse_int(optarg, value) || (value < 1)) {
+                    badarg("-E");
+                } else {
+                    options.fec_encoders = value;
+                }
+                break;
+            case 'm':
+                if (!parse_int(optarg, value) || (value <= 0) || (value > 65535)) {
+                    badarg("-m");
+                } else {
+                    spec.metricsport = value;
+                }
+                break;
+            case 'H':
+                if (!parse_int(optarg, value) || (value <= 0) || (value > 65535)) {
+                    badarg("-H");
+                } else {
+                    spec.httpport = value;
+                }
+                break;
+            case 'Z':
+                AlignedMemory::setHugePages(true);
+                break;
+            case 'K':
+            {
+                std::string str(optarg);
+                std::size_t colon = str.find(':');
+
+                if (!parse_int(str.substr(0, colon).c_str(), value) || (value < 2)) {
+                    badarg("-K");
+                }
+
+                options.nb_channels = value;
+
+                if (colon != std::string::npos)
+                {
+                    if (!parse_int(str.substr(colon + 1).c_str(), value) || (value <= 0)) {
+                        badarg("-K");
+                    }
+
+                    options.channel_taps = value;
+                }
+                break;
+            }
+            case 'k':
+                options.channel_specs.push_back(optarg);
+                break;
+            case 'w':
+                if (!parse_int(optarg, value) || ((value != 8) && (value != 12) && (value != 16))) {
+                    badarg("-w");
+                }
+
+                options.wire_bits = value;
+                break;
+            case 'z':
+                options.compression = true;
+                break;
+            case 'V':
+                options.block_crc = true;
+                break;
+            case 'q':
+            {
+                std::string str(optarg);
+                std::size_t colon = str.find(':');
+
+                if (!parse_dbl(str.substr(0, colon).c_str(), options.squelch_db) || (options.squelch_db >= 0.0)) {
+                    badarg("-q");
+                }
+
+                if ((colon != std::string::npos) && (!parse_int(str.substr(colon + 1).c_str(), options.squelch_ms) || (options.squelch_ms < 0))) {
+                    badarg("-q");
+                }
+                break;
+            }
+            case 'X':
+                if (!ThreadPolicy::configure(optarg, thread_error)) {
+                    fprintf(stderr, "ERROR: %s\n", thread_error.c_str());
+                    badarg("-X");
+                }
+                break;
+            case 'l':
+                options.latency = true;
+                break;
+            case 'M':
+                multi_file.assign(optarg);
+                break;
+            case 'W':
+                if (!parse_int(optarg, value) || (value < 1)) {
+                    badarg("-W");
+                } else {
+                    dsp_workers = value;
+                }
+                break;
+            case 'O':
+                if (!parse_shm(optarg, spec)) {
+                    badarg("-O");
                 }
                 break;
             default:
@@ -475,206 +979,145 @@ int main(int argc, char **argv)
         fprintf(stderr, "WARNING: can not install SIGTERM handler (%s)\n", strerror(errno));
     }
 
-    // Prepare output writer.
-    UDPSink *udp_output_instance;
-    udp_output_instance = new UDPSinkFEC(dataaddress, dataport);
-
-//    if (useFec) {
-//        udp_output_instance = new UDPSinkFEC(dataaddress, dataport);
-//    } else if (compressedMinSize) {
-//        udp_output_instance = new UDPSinkLZ4(dataaddress, dataport, UDPSIZE, compressedMinSize);
-//    } else {
-//        udp_output_instance = new UDPSinkUncompressed(dataaddress, dataport, UDPSIZE);
-//    }
-
-    std::unique_ptr<UDPSink> udp_output(udp_output_instance);
-
-    if (!(*udp_output))
+    if (!multi_file.empty())
     {
-        fprintf(stderr, "ERROR: UDP Output: %s\n", udp_output->error().c_str());
-        exit(1);
-    }
+        if (options.nb_channels > 0)
+        {
+            fprintf(stderr, "ERROR: -K: the channelizer is not available with several devices (-M)\n");
+            exit(1);
+        }
 
-    if (!get_device(devnames, devtype_str, &srcsdr, devidx))
-    {
-        exit(1);
-    }
+        if (options.inline_dsp)
+        {
+            fprintf(stderr, "ERROR: -i: the inline mode is for a single device (not with -M)\n");
+            exit(1);
+        }
 
-    if (!(*srcsdr))
-    {
-        fprintf(stderr, "ERROR source: %s\n", srcsdr->error().c_str());
-        delete srcsdr;
-        exit(1);
+        if (!outputbuf_given) {
+            options.outputbuf_samples = 0; // the DSP workers write the frames directly
+        }
     }
-
-    //fprintf(stderr, (std::is_trivially_copyable<IQSample>::value ? "IQSample is trivially copiable\n" : "IQSample is NOT trivially copiable\n"));
-
-    // Configure device and start streaming.
-
-    srcsdr->setConfigurationPort(cfgport);
-
-    // Prepare downsampler.
-    Downsampler dn;
-    srcsdr->associateDownsampler(&dn);
-
-    if (!srcsdr->configure(config_str))
+    else if (options.fec_encoders > 1)
     {
-        fprintf(stderr, "ERROR: source configuration: %s\n", srcsdr->error().c_str());
-        delete srcsdr;
-        exit(1);
+        options.pipeline = true; // the encoders are only separate from the sender in pipeline mode
     }
 
-    /*
-    if (!dn.configure(m))
+    if (options.pipeline)
     {
-        fprintf(stderr, "ERROR: downsampler configuration: %s\n", dn.error().c_str());
-        delete srcsdr;
-        exit(1);
-    }*/
-
-    double freq = srcsdr->get_received_frequency();
-    fprintf(stderr, "tuned for:         %.6f MHz\n", freq * 1.0e-6);
-
-    double tuner_freq = srcsdr->get_frequency();
-    fprintf(stderr, "device tuned for:  %.6f MHz\n", tuner_freq * 1.0e-6);
-
-    double ifrate = srcsdr->get_sample_rate();
-    fprintf(stderr, "IF sample rate:    %.0f Hz\n", ifrate);
-
-    srcsdr->print_specific_parms();
-
-    // Create source data queue.
-    DataBuffer<IQSample> source_buffer;
+        options.lockfree_buffers = true;
 
-    // ownership will be transferred to thread therefore the unique_ptr with move is convenient
-    // if the pointer is to be shared with the main thread use shared_ptr (and no move) instead
-    std::unique_ptr<DeviceSource> up_srcsdr(srcsdr);
+        if (options.outputbuf_samples == 0) {
+            options.outputbuf_samples = RXOUTPUTBUF_SAMPLES; // frame assembly needs its own thread
+        }
 
-    // Start reading from device in separate thread.
-    //std::thread source_thread(read_source_data, std::move(up_srcsdr), &source_buffer);
-    up_srcsdr->start(&source_buffer, &stop_flag);
+        fprintf(stderr, "Pipeline mode\n");
+    }
 
-    if (!up_srcsdr)
+    if (options.inline_dsp)
     {
-        fprintf(stderr, "ERROR: source: %s\n", up_srcsdr->error().c_str());
-        exit(1);
+        options.outputbuf_samples = 0; // the frames are assembled in the device thread too
+        fprintf(stderr, "Inline mode\n");
     }
 
-    // If buffering enabled, start background output thread.
-    DataBuffer<IQSample> output_buffer;
-    std::thread output_thread;
-
-    if (outputbuf_samples > 0)
+    if (multi_file.empty())
     {
-        output_thread = std::thread(write_output_data,
-                               udp_output.get(),
-                               &output_buffer,
-                               outputbuf_samples);
-    }
+        DeviceSource *srcsdr;
 
-    IQSampleVector outsamples;
-    bool inbuf_length_warning = false;
+        if (!open_device(spec, &srcsdr)) {
+            exit(1);
+        }
 
-    // Main loop.
-    for (unsigned int block = 0; !stop_flag.load(); block++)
-    {
+        RxPipeline pipeline(options, spec, &stop_flag);
+        bool opened;
 
-        // Check for overflow of source buffer.
-        if (!inbuf_length_warning && source_buffer.queued_samples() > 10 * ifrate)
+        if (options.inline_dsp)
+        {
+            pipeline.setInline();
+            opened = pipeline.open(srcsdr, [&pipeline]() { pipeline.processInline(); }, 0);
+        }
+        else
         {
-            fprintf(stderr, "\nWARNING: Input buffer is growing (system too slow)\n");
-            inbuf_length_warning = true;
+            opened = pipeline.open(srcsdr, std::function<void()>(), 0);
         }
 
-        // Pull next block from source buffer.
-        IQSampleVector iqsamples = source_buffer.pull();
+        if (!opened) {
+            exit(1);
+        }
 
-        if (iqsamples.empty())
+        ThreadPolicy::apply(pthread_self(), "main"); // not renamed: the process name would change
+        if (!set_thread_affinity(pthread_self(), options.stage_cpus[0]))
         {
-            break;
+            fprintf(stderr, "WARNING: can not set decimation thread CPU affinity\n");
         }
 
-        udp_output->setCenterFrequency(srcsdr->get_received_frequency());
+        // Main loop. In inline mode only if the device thread runs out of time.
+        if (!options.inline_dsp || !pipeline.waitInline()) {
+            while (!stop_flag.load() && pipeline.processBlock()) {}
+        }
 
-        unsigned int confNbFECBlocks = srcsdr->get_nb_fec_blocks();
+        fprintf(stderr, "\n");
 
-        if (confNbFECBlocks != nbFECBlocks)
-        {
-            nbFECBlocks = confNbFECBlocks;
-            udp_output->setNbBlocksFEC(nbFECBlocks);
-        }
+        // Join background threads.
+        pipeline.stop();
 
-        unsigned int confTxDelay = srcsdr->get_tx_delay();
+        // No cleanup needed; everything handled by destructors
 
-        if (confTxDelay != txDelay)
-        {
-            txDelay = confTxDelay;
-            udp_output->setTxDelay(txDelay);
-        }
+        return 0;
+    }
 
-        // Possible downsampling and write to UDP
+    // Multi-device mode: one pipeline per device processed by a pool of DSP workers with shared FEC encoders
+    std::vector<DeviceSpec> specs;
 
-        if (dn.getLog2Decimation() == 0)
-        {
-            unsigned int sampleSize = srcsdr->get_sample_bits();
-        	dn.rescale(sampleSize, iqsamples);
+    if (!read_devices(multi_file, spec, specs)) {
+        exit(1);
+    }
 
-            udp_output->setSampleBits(srcsdr->get_sample_bits());
-            udp_output->setSampleBytes((srcsdr->get_sample_bits()-1)/8 + 1);
-            udp_output->setSampleRate(srcsdr->get_sample_rate());
+    if (dsp_workers == 0) {
+        dsp_workers = std::min((unsigned int) specs.size(), std::max(std::thread::hardware_concurrency(), 1U));
+    }
 
-            if (outputbuf_samples > 0)
-            {
-                // Buffered write.
-                output_buffer.push(move(iqsamples));
-            }
-            else
-            {
-                // Direct write.
-                udp_output->write(iqsamples);
-            }
-        }
-        else
-        {
-            unsigned int sampleSize = srcsdr->get_sample_bits();
-            dn.process(sampleSize, iqsamples, outsamples);
+    FECEncoderPool encoder_pool(options.fec_encoders); // outlives the sinks of the pipelines
+    std::vector<std::unique_ptr<RxPipeline> > pipelines;
+    std::vector<RxPipeline*> scheduled;
 
-            udp_output->setSampleBits(sampleSize);
-            udp_output->setSampleBytes((sampleSize -1)/8 + 1);
-            udp_output->setSampleRate(srcsdr->get_sample_rate() / (1<<dn.getLog2Decimation()));
+    for (std::size_t i = 0; i < specs.size(); i++)
+    {
+        pipelines.push_back(std::unique_ptr<RxPipeline>(new RxPipeline(options, specs[i], &stop_flag)));
+        scheduled.push_back(pipelines.back().get());
+    }
 
-            // Throw away first block. It is noisy because IF filters
-            // are still starting up.
-            if (block > 0)
-            {
-                // Write samples to output.
-                if (outputbuf_samples > 0)
-                {
-                    // Buffered write.
-                    output_buffer.push(move(outsamples));
-                }
-                else
-                {
-                    // Direct write.
-                    udp_output->write(outsamples);
-                }
-            }
+    PipelineScheduler scheduler(scheduled, &stop_flag);
+
+    for (std::size_t i = 0; i < pipelines.size(); i++)
+    {
+        fprintf(stderr, "Device %u: %s %d to %s:%u control port %u\n", (unsigned int) i, specs[i].devtype.c_str(), specs[i].devidx,
+                specs[i].dataaddress.c_str(), specs[i].dataport, specs[i].cfgport);
+        DeviceSource *srcsdr;
+
+        if (!open_device(specs[i], &srcsdr) || !pipelines[i]->open(srcsdr, [&scheduler]() { scheduler.notify(); }, &encoder_pool)) {
+            exit(1);
         }
     }
 
-    fprintf(stderr, "\n");
+    fprintf(stderr, "%u devices, %u DSP workers, %u FEC encoders\n", (unsigned int) pipelines.size(), dsp_workers, encoder_pool.getNbThreads());
 
-    // Join background threads.
-    //source_thread.join();
-    up_srcsdr->stop();
+    std::vector<std::thread> workers;
 
-    if (outputbuf_samples > 0)
+    for (unsigned int i = 0; i < dsp_workers; i++)
     {
-        output_buffer.push_end();
-        output_thread.join();
+        workers.push_back(std::thread(&PipelineScheduler::run, &scheduler, i));
+        set_thread_name(workers.back().native_handle(), "sdmn-dsp");
     }
 
-    // No cleanup needed; everything handled by destructors
+    for (std::vector<std::thread>::iterator it = workers.begin(); it != workers.end(); ++it) {
+        it->join();
+    }
+
+    fprintf(stderr, "\n");
+
+    for (std::size_t i = 0; i < pipelines.size(); i++) {
+        pipelines[i]->stop();
+    }
 
     return 0;
 }
@@ -41,8 +41,13 @@
 
 #include "util.h"
 #include "DataBuffer.h"
+#include "RingBuffer.h"
+#include "SIMDDispatch.h"
 #include "Upsampler.h"
 #include "UDPSourceFEC.h"
+#include "SHMSource.h"
+#include "JitterBuffer.h"
+#include "Metrics.h"
 
 #ifdef HAS_HACKRF
     #include "HackRFSink.h"
@@ -54,6 +59,11 @@
 //#include <type_traits>
 
 #define UDPSIZE 512
+#ifdef SDRDAEMON_SMALL_FOOTPRINT
+#define TXQUEUE_SECONDS 2    // default capacity of the sink buffer in seconds of device samples
+#else
+#define TXQUEUE_SECONDS 0    // default capacity of the sink buffer in seconds of device samples (0: unlimited)
+#endif
 
 /** Flag is set on SIGINT / SIGTERM. */
 static std::atomic_bool stop_flag(false);
@@ -67,39 +77,6 @@ void adjust_gain(SampleVector& samples, double gain)
     }
 }
 
-/**
- * Get data from input UDP stream and write to input buffer.
- *
- * This code runs in a separate thread.
- */
-void read_input_data(UDPSource *input,
-        DataBuffer<IQSample> *buf,
-        std::size_t buf_maxfill)
-{
-    IQSampleVector samples;
-
-    while (!stop_flag.load())
-    {
-        // Get samples from UDP
-        input->read(samples);
-
-        if (!(*input))
-        {
-            fprintf(stderr, "ERROR: Input: %s\n", input->error().c_str());
-        }
-
-        if (buf->queued_samples() < buf_maxfill)
-        {
-            buf->push(move(samples));
-        }
-        else
-        {
-            fprintf(stderr, "Device queing up. Dropping samples");
-        }
-    }
-}
-
-
 /** Handle Ctrl-C and SIGTERM. */
 static void handle_sigterm(int sig)
 {
@@ -130,14 +107,43 @@ void usage()
             "  -c config      Startup configuration. Comma separated key=value configuration pairs\n"
             "                 or just key for switches. See below for valid values\n"
             "  -d devidx      Device index, 'list' to show device list (default 0)\n"
-            "  -b             Buffered UDP reads\n"
+            "  -s serial      Open the HackRF with this serial number directly without listing the devices\n"
+            "  -b             Buffered UDP reads: receive and decode in a separate thread\n"
+            "  -L             Use lock-free ring buffers between UDP input, main loop and device\n"
+            "  -Q samples     Maximum number of samples queued to the device, the oldest are dropped beyond\n"
+            "                 (default: %d seconds of device samples, 0: unlimited)\n"
+            "  -F             Send FEC loss reports back to the sender (see fecauto option of sdrdaemonrx)\n"
+            "  -N             Request the retransmission of the blocks missing to restore a frame from the sender\n"
+            "                 (see nack option of sdrdaemonrx). Sets a reordering window of at least 3\n"
+            "  -W frames      FEC reordering window: number of frames decoded concurrently, 1 to 8 (default 1)\n"
+            "  -T ms          FEC play-out deadline: drop blocks arriving later than this and restart at once after\n"
+            "                 an outage (default 0: none)\n"
+            "  -S sw|hw       Timestamp the datagrams in the kernel (sw) or the network card (hw) and report the\n"
+            "                 one-way latency and jitter of the frames in the status message (needs synchronized clocks)\n"
+            "  -M interface   Receive through a memory mapped packet ring on this network interface (needs root)\n"
+            "  -R file        Record the UDP blocks received with their arrival time to this file (appended) for\n"
+            "                 sdrdaemon_replay\n"
+            "  -O name        Take the samples from this shared memory ring of a sdrdaemonrx on the same host (-O)\n"
+            "                 instead of UDP. The UDP and FEC options are then ignored\n"
+            "  -J ms          Jitter buffer: keep the samples queued to the device near this latency in milliseconds\n"
+            "                 correcting the clock drift between sender and device (default 0: no control)\n"
             "  -I address     IP address. Samples are sent to this address (default: 127.0.0.1)\n"
             "  -D port        Data port. Samples are sent on this UDP port (default 9090)\n"
             "  -C port        Configuration port (default 9091). The configuration string as described below\n"
             "                 is sent on this port via nanomsg in TCP to control the device\n"
+            "  -m port        Publish the pipeline metrics every second on this port via nanomsg PUB in TCP (default: off)\n"
+            "  -H port        Serve the pipeline metrics to Prometheus on this HTTP port (default: off)\n"
+            "  -Z             Back the UDP block rings with reserved huge pages (vm.nr_hugepages). Without it\n"
+            "                 transparent huge pages are requested\n"
+            "  -X policies    Thread CPU sets and scheduling: comma separated name=cpus[:fifo|rr|other[:priority]]\n"
+            "                 cpus: 2, 2-3, 1+3 or - (not pinned). 'rt' alone gives FIFO scheduling to the device\n"
+            "                 and UDP threads. Names: see below (default: no pinning, default scheduler)\n"
+            "                 Threads: device usb feed write control udprx metrics main\n"
             "\n"
             "Configuration options for the interpolator:\n"
             "  interp=<int>   log2 of interpolation factor (default 0: no interpolation)\n"
+            "  intblk=<int>   Interpolation: 0: sample by sample (default), 1: block cascade\n"
+            "  srate_out=<int> Resample the received stream to this rate in Hz before interpolation (default 0: no resampling)\n"
             "\n"
 #ifdef HAS_HACKRF
             "Configuration options for HackRF devices\n"
@@ -162,7 +168,7 @@ void usage()
             "  file=<srting>  Output file name (default: test.sdriq)\n"
             "\n"
             "Note: center frequency and sample rate are taken from the configuration options not the meta data\n"
-            "\n");
+            "\n", TXQUEUE_SECONDS);
 }
 
 
@@ -192,10 +198,94 @@ bool parse_int(const char *s, int& v, bool allow_unit=false)
 }
 
 
-static bool get_device(std::vector<std::string> &devnames, std::string& devtype, DeviceSink **sinksdr, int devidx)
+/**
+ * Register the counters of the UDP source and FEC decoder or of the shared memory source (the other one is 0),
+ * the pipeline stages and the sink buffer
+ */
+static void add_metrics(Metrics& metrics,
+        const UDPSourceFEC *source,
+        const SHMSource *shm_input,
+        const std::atomic<uint64_t>& interpolated_samples,
+        DataBuffer<IQSample>& sink_buffer,
+        const JitterBuffer *jitter)
+{
+    const std::atomic<uint64_t> *interpolated = &interpolated_samples;
+    DataBuffer<IQSample> *buf = &sink_buffer;
+
+    metrics.addCounter("sdrdaemon_samples_total", "stage=\"interpolator\"", "Samples output by the stage",
+            [interpolated]() { return interpolated->load(); });
+    metrics.addCounter("sdrdaemon_samples_total", "stage=\"device\"", "",
+            [buf]() { return buf->pulled_samples(); });
+
+    metrics.addGauge("sdrdaemon_buffer_queued_samples", "buffer=\"sink\"", "Samples queued in the buffer",
+            [buf]() { return buf->queued_samples(); });
+    metrics.addGauge("sdrdaemon_buffer_max_queued_samples", "buffer=\"sink\"", "High-water mark of the samples queued in the buffer",
+            [buf]() { return buf->max_queued_samples(); });
+
+    if (jitter)
+    {
+        metrics.addGauge("sdrdaemon_jitter_latency_ms", "", "Measured latency of the samples queued to the device",
+                [jitter]() { return jitter->getMeasuredLatency(); });
+        metrics.addCounter("sdrdaemon_jitter_underruns_total", "", "Times the device found the queue empty",
+                [jitter]() { return jitter->getNbUnderruns(); });
+        metrics.addCounter("sdrdaemon_jitter_overruns_total", "", "Frames dropped because the queue was too full",
+                [jitter]() { return jitter->getNbOverruns(); });
+    }
+
+    if (shm_input)
+    {
+        metrics.addCounter("sdrdaemon_shm_frames_total", "", "Frames read from the shared memory ring",
+                [shm_input]() { return shm_input->getNbFrames(); });
+        metrics.addCounter("sdrdaemon_shm_frames_lost_total", "", "Frames overwritten in the shared memory ring before they were read",
+                [shm_input]() { return shm_input->getNbLostFrames(); });
+    }
+
+    if (!source) {
+        return;
+    }
+
+    const SDRdaemonFECBuffer *fec = &source->getFECBuffer();
+
+    metrics.addCounter("sdrdaemon_udp_blocks_received_total", "", "UDP blocks received",
+            [fec]() { return fec->getNbBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_frames_decoded_total", "", "Frames output by the FEC decoder",
+            [fec]() { return fec->getNbFrames(); });
+    metrics.addCounter("sdrdaemon_fec_frames_lost_total", "", "Frames output without enough blocks to restore them",
+            [fec]() { return fec->getNbLostFrames(); });
+    metrics.addCounter("sdrdaemon_fec_blocks_recovered_total", "", "Original blocks restored from FEC blocks",
+            [fec]() { return fec->getNbRecoveredBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_blocks_dropped_total", "reason=\"late\"", "Blocks received but not used",
+            [fec]() { return fec->getNbLateBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_blocks_dropped_total", "reason=\"stale\"", "",
+            [fec]() { return fec->getNbStaleBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_blocks_dropped_total", "reason=\"duplicate\"", "",
+            [fec]() { return fec->getNbDuplicateBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_blocks_dropped_total", "reason=\"corrupt\"", "",
+            [fec]() { return fec->getNbCorruptBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_blocks_dropped_total", "reason=\"overflow\"", "",
+            [fec]() { return fec->getNbOverflowBlocks(); });
+    metrics.addCounter("sdrdaemon_fec_nacks_total", "", "Retransmission requests sent",
+            [fec]() { return fec->getNbNacks(); });
+    metrics.addCounter("sdrdaemon_rx_frames_dropped_total", "", "Decoded frames dropped because the main loop did not take them in time",
+            [source]() { return source->getNbDroppedFrames(); });
+}
+
+static bool get_device(std::vector<std::string> &devnames, std::string& devtype, DeviceSink **sinksdr, int devidx, const std::string& serial)
 {
     bool deviceDefined = false;
 
+#ifdef HAS_HACKRF
+    if (!serial.empty() && (strcasecmp(devtype.c_str(), "hackrf") == 0))
+    {
+        // straight to the device without enumerating them
+        fprintf(stderr, "sdrdaemontx: using device serial %s\n", serial.c_str());
+        *sinksdr = new HackRFSink(0, serial);
+        return true;
+    }
+#else
+    (void) serial;
+#endif
+
     if (strcasecmp(devtype.c_str(), "file") == 0)
     {
         FileSink::get_device_names(devnames);
@@ -257,6 +347,7 @@ static bool get_device(std::vector<std::string> &devnames, std::string& devtype,
 int main(int argc, char **argv)
 {
     int     devidx  = 0;
+    std::string  serial;
     std::string  filename;
     std::string  alsadev("default");
     std::string config_str;
@@ -265,24 +356,55 @@ int main(int argc, char **argv)
     std::string dataaddress("127.0.0.1");
     unsigned int dataport = 9090;
     unsigned int cfgport = 9091;
+    unsigned int metricsport = 0;
+    unsigned int httpport = 0;
     DeviceSink  *sinksdr = 0;
     bool buffered_reads = false;
+    bool lockfree_buffers = false;
+    bool fec_feedback = false;
+    bool fec_nack = false;
+    int reorder_window = 1;
+    int deadline = 0;
+    std::string packet_ring_interface;
+    std::string capture_file;
+    std::string timestamping;
+    int jitter_latency = 0;
+    int queue_capacity = -1;
+    std::string shm_name;
 
     fprintf(stderr, "SDRDaemonTx - Collect samples from network via UDP and send it to SDR device\n");
+    fprintf(stderr, "SIMD kernels: %s\n", SIMDDispatch::name());
 
     const struct option longopts[] = {
         { "devtype",    2, NULL, 't' },
         { "config",     2, NULL, 'c' },
         { "dev",        1, NULL, 'd' },
+        { "serial",     1, NULL, 's' },
         { "buffered",   0, NULL, 'b' },
         { "daddress",   2, NULL, 'I' },
         { "dport",      1, NULL, 'D' },
         { "cport",      1, NULL, 'C' },
+        { "lockfree",   0, NULL, 'L' },
+        { "qcapacity",  1, NULL, 'Q' },
+        { "feedback",   0, NULL, 'F' },
+        { "nack",       0, NULL, 'N' },
+        { "reorder",    1, NULL, 'W' },
+        { "deadline",   1, NULL, 'T' },
+        { "timestamps", 1, NULL, 'S' },
+        { "mmapring",   1, NULL, 'M' },
+        { "capture",    1, NULL, 'R' },
+        { "jitter",     1, NULL, 'J' },
+        { "metrics",    1, NULL, 'm' },
+        { "http",       1, NULL, 'H' },
+        { "threads",    1, NULL, 'X' },
+        { "hugepages",  0, NULL, 'Z' },
+        { "shm",        1, NULL, 'O' },
         { NULL,         0, NULL, 0 } };
 
     int c, longindex, value;
+    std::string thread_error;
     while ((c = getopt_long(argc, argv,
-            "t:c:d:bI:D:C:",
+            "t:c:d:s:bI:D:C:LQ:FNW:T:S:M:R:J:m:H:X:ZO:",
             longopts, &longindex)) >= 0)
     {
         switch (c)
@@ -297,6 +419,9 @@ int main(int argc, char **argv)
                 if (!parse_int(optarg, devidx))
                     devidx = -1;
                 break;
+            case 's':
+                serial.assign(optarg);
+                break;
             case 'b':
                 buffered_reads = true;
                 break;
@@ -317,6 +442,82 @@ int main(int argc, char **argv)
                     cfgport = value;
                 }
                 break;
+            case 'L':
+                lockfree_buffers = true;
+                break;
+            case 'Q':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-Q");
+                } else {
+                    queue_capacity = value;
+                }
+                break;
+            case 'F':
+                fec_feedback = true;
+                break;
+            case 'N':
+                fec_nack = true;
+                break;
+            case 'W':
+                if (!parse_int(optarg, value) || (value < 1) || (value > SDRDAEMONFEC_REORDERWINDOWMAX)) {
+                    badarg("-W");
+                } else {
+                    reorder_window = value;
+                }
+                break;
+            case 'T':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-T");
+                } else {
+                    deadline = value;
+                }
+                break;
+            case 'S':
+                if ((strcmp(optarg, "sw") != 0) && (strcmp(optarg, "hw") != 0)) {
+                    badarg("-S");
+                } else {
+                    timestamping.assign(optarg);
+                }
+                break;
+            case 'M':
+                packet_ring_interface.assign(optarg);
+                break;
+            case 'R':
+                capture_file.assign(optarg);
+                break;
+            case 'J':
+                if (!parse_int(optarg, value) || (value < 0)) {
+                    badarg("-J");
+                } else {
+                    jitter_latency = value;
+                }
+                break;
+            case 'm':
+                if (!parse_int(optarg, value) || (value <= 0) || (value > 65535)) {
+                    badarg("-m");
+                } else {
+                    metricsport = value;
+                }
+                break;
+            case 'H':
+                if (!parse_int(optarg, value) || (value <= 0) || (value > 65535)) {
+                    badarg("-H");
+                } else {
+                    httpport = value;
+                }
+                break;
+            case 'Z':
+                AlignedMemory::setHugePages(true);
+                break;
+            case 'O':
+                shm_name.assign(optarg);
+                break;
+            case 'X':
+                if (!ThreadPolicy::configure(optarg, thread_error)) {
+                    fprintf(stderr, "ERROR: %s\n", thread_error.c_str());
+                    badarg("-X");
+                }
+                break;
             default:
                 usage();
                 fprintf(stderr, "ERROR: Invalid command line options\n");
@@ -347,11 +548,23 @@ int main(int argc, char **argv)
         fprintf(stderr, "WARNING: can not install SIGTERM handler (%s)\n", strerror(errno));
     }
 
-    // Prepare reader.
-    UDPSource *udp_input_instance;
-    fprintf(stderr, "Binding to %s:%u\n", dataaddress.c_str(), dataport);
-    udp_input_instance = new UDPSourceFEC(dataaddress, dataport);
-    std::unique_ptr<UDPSource> udp_input(udp_input_instance);
+    // Prepare reader: UDP with FEC or a shared memory ring on the same host
+    UDPSourceFEC *udp_input_instance = 0;
+    SHMSource *shm_input_instance = 0;
+    std::unique_ptr<UDPSource> udp_input;
+
+    if (shm_name.empty())
+    {
+        fprintf(stderr, "Binding to %s:%u\n", dataaddress.c_str(), dataport);
+        udp_input_instance = new UDPSourceFEC(dataaddress, dataport);
+        udp_input.reset(udp_input_instance);
+    }
+    else
+    {
+        fprintf(stderr, "Shared memory ring %s\n", shm_name.c_str());
+        shm_input_instance = new SHMSource(shm_name);
+        udp_input.reset(shm_input_instance);
+    }
 
     if (!(*udp_input))
     {
@@ -359,7 +572,35 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-    if (!get_device(devnames, devtype_str, &sinksdr, devidx))
+    if (fec_nack && (reorder_window < 3))
+    {
+        fprintf(stderr, "Reordering window of 3 frames for the retransmissions\n");
+        reorder_window = 3;
+    }
+
+    udp_input->setFeedback(fec_feedback);
+    udp_input->setReorderWindow(reorder_window);
+    udp_input->setNack(fec_nack);
+    udp_input->setDeadline(deadline);
+
+    if (!packet_ring_interface.empty() && !udp_input->setPacketRing(packet_ring_interface))
+    {
+        fprintf(stderr, "WARNING: cannot use a packet ring on %s, receiving from the socket\n", packet_ring_interface.c_str());
+    }
+
+    if (!capture_file.empty() && !udp_input->setCapture(capture_file))
+    {
+        fprintf(stderr, "ERROR: -R: cannot record to %s\n", capture_file.c_str());
+        exit(1);
+    }
+
+    if (!timestamping.empty()) {
+        udp_input->setTimestamping(true, timestamping == "hw");
+    }
+
+    udp_input->setReceiveThread(buffered_reads);
+
+    if (!get_device(devnames, devtype_str, &sinksdr, devidx, serial))
     {
         exit(1);
     }
@@ -380,7 +621,17 @@ int main(int argc, char **argv)
     // Prepare upsampler.
     Upsampler up;
     sinksdr->associateUpsampler(&up);                // used to pass configuration from device to upsampler and not for upsampling
-    sinksdr->associateUDPSource(udp_input_instance); // used to get status message
+    sinksdr->associateUDPSource(udp_input.get());    // used to get status message
+
+    // Prepare jitter buffer
+    JitterBuffer jitter;
+    jitter.setLatency(jitter_latency);
+
+    if (jitter_latency > 0)
+    {
+        sinksdr->associateJitterBuffer(&jitter);     // device waits for refill after underruns and reports the status
+        fprintf(stderr, "Jitter buffer latency target: %d ms\n", jitter_latency);
+    }
 
     if (!sinksdr->configure(config_str))
     {
@@ -413,7 +664,31 @@ int main(int argc, char **argv)
     sinksdr->print_specific_parms();
 
     // Create source data queue.
-    DataBuffer<IQSample> sink_buffer;
+    std::unique_ptr<DataBuffer<IQSample> > up_sink_buffer(lockfree_buffers ? new RingBuffer<IQSample>() : new DataBuffer<IQSample>());
+    DataBuffer<IQSample>& sink_buffer = *up_sink_buffer;
+
+    if (queue_capacity < 0) {
+        queue_capacity = TXQUEUE_SECONDS * ifrate;
+    }
+
+    sink_buffer.set_capacity(queue_capacity, DataBuffer<IQSample>::DropOldest);
+
+    // Depletion is relative to the capacity when the buffer is bounded
+    std::size_t sink_buf_low = queue_capacity > 0 ? queue_capacity / 5 : 2 * ifrate;
+    std::size_t sink_buf_refilled = queue_capacity > 0 ? queue_capacity / 2 : 6 * ifrate;
+
+    // Memory held by the FEC decoder and how far the sink buffer may grow
+    if (udp_input_instance)
+    {
+        const SDRdaemonFECBuffer& fec_buffer = udp_input_instance->getFECBuffer();
+        fprintf(stderr, "Preallocated:      %lu kB (FEC decoder for %d byte datagrams)\n", (unsigned long) (fec_buffer.getPreallocatedBytes() / 1024), fec_buffer.getUdpSize());
+    }
+
+    if (queue_capacity > 0) {
+        fprintf(stderr, "Sink buffer:       %lu kB at most\n", (unsigned long) (queue_capacity * sizeof(IQSample) / 1024));
+    } else {
+        fprintf(stderr, "Sink buffer:       unbounded\n");
+    }
 
     // ownership will be transferred to thread therefore the unique_ptr with move is convenient
     // if the pointer is to be shared with the main thread use shared_ptr (and no move) instead
@@ -429,18 +704,27 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-    // If buffering enabled, start background input thread.
-    DataBuffer<IQSample> input_buffer;
-    std::thread input_thread;
+    // Declared last so that it stops before the objects it reads are destroyed
+    std::atomic<uint64_t> interpolated_samples(0);
+    Metrics metrics;
 
-    if (buffered_reads)
+    if ((metricsport > 0) || (httpport > 0))
     {
-        input_thread = std::thread(read_input_data,
-                               udp_input.get(),
-                               &input_buffer,
-                               20 * ifrate);
+        add_metrics(metrics, udp_input_instance, shm_input_instance, interpolated_samples, sink_buffer, jitter_latency > 0 ? &jitter : 0);
+
+        if ((metricsport > 0) && !metrics.setPublishPort(metricsport)) {
+            fprintf(stderr, "WARNING: metrics: %s\n", metrics.error().c_str());
+        }
+
+        if ((httpport > 0) && !metrics.setHttpPort(httpport)) {
+            fprintf(stderr, "WARNING: metrics: %s\n", metrics.error().c_str());
+        }
+
+        metrics.start();
     }
 
+    ThreadPolicy::apply(pthread_self(), "main"); // not renamed: the process name would change
+
     IQSampleVector insamples, outsamples;
     bool sink_buf_overflow_warning = false;
     bool sink_buf_underflow_warning = false;
@@ -460,39 +744,41 @@ int main(int argc, char **argv)
             sink_buf_overflow_warning = false;
         }
 
-        // Check for underflow of sink buffer.
-        if (!sink_buf_underflow_warning && sink_buffer.queued_samples() < 2 * sinksdr->get_sample_rate())
+        // Check for underflow of sink buffer. With the jitter buffer the fill is kept low on purpose
+        if (!sink_buf_underflow_warning && (jitter_latency == 0) && sink_buffer.queued_samples() < sink_buf_low)
         {
             fprintf(stderr, "\nWARNING: Sink buffer is depleting (system too slow)\n");
             sink_buf_underflow_warning = true;
         }
 
-        if (sink_buf_underflow_warning && sink_buffer.queued_samples() > 6 * sinksdr->get_sample_rate())
+        if (sink_buf_underflow_warning && sink_buffer.queued_samples() > sink_buf_refilled)
         {
             sink_buf_underflow_warning = false;
         }
 
-        if (buffered_reads)
-        {
-            input_buffer.pull(insamples);
-        }
-        else
-        {
-            udp_input->read(insamples);
-        }
+        udp_input->read(insamples); // with buffered reads only takes a frame decoded by the receive thread
 
         if (insamples.size() > 0)
         {
-            if (up.getLog2Interpolation() == 0)
+            up.setSampleRate(udp_input->getSampleRate()); // only acts when the stream rate changes
+
+            if ((up.getLog2Interpolation() == 0) && !up.isResampling())
             {
 //                fprintf(stderr, "no upsampling: push %lu samples\n", insamples.size());
-                sink_buffer.push(move(insamples));
+                interpolated_samples.fetch_add(insamples.size(), std::memory_order_relaxed);
+
+                if (jitter.process(insamples, sink_buffer.queued_samples(), sinksdr->get_sample_rate())) {
+                    sink_buffer.push(move(insamples));
+                }
             }
             else
             {
                 up.process(insamples, outsamples);
+                interpolated_samples.fetch_add(outsamples.size(), std::memory_order_relaxed);
 //                fprintf(stderr, "upsampling: push %lu samples\n", outsamples.size());
-                sink_buffer.push(move(outsamples));
+                if (jitter.process(outsamples, sink_buffer.queued_samples(), sinksdr->get_sample_rate())) {
+                    sink_buffer.push(move(outsamples));
+                }
             }
         }
     }
@@ -501,13 +787,9 @@ int main(int argc, char **argv)
 
     // Join background threads.
     //source_thread.join();
+    metrics.stop();
     sinksdr_uptr->stop();
-
-    if (buffered_reads)
-    {
-        input_buffer.push_end();
-        input_thread.join();
-    }
+    udp_input->setReceiveThread(false);
 
     // No cleanup needed; everything handled by destructors
 
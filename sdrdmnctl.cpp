@@ -21,9 +21,14 @@
 #include <climits>
 #include <cstring>
 #include <cassert>
+#include <csignal>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
 #include <unistd.h>
 #include <getopt.h>
 #include <nanomsg/nn.h>
@@ -32,6 +37,9 @@
 static void badarg(const char *label);
 static bool parse_int(const char *s, int& v, bool allow_unit);
 
+static std::atomic_bool stop_flag(false);
+static std::atomic_int pending_status(0); // status requests sent and not replied yet
+
 void usage()
 {
     fprintf(stderr,
@@ -42,6 +50,11 @@ void usage()
             "  -C port        Configuration port (default 9091). The configuration string\n"
             "                 is sent on this port via nanomsg in TCP to control the device\n"
             "  -t timeout     Send timeout in seconds (default 2)\n"
+            "  -s             Streaming mode: read configuration strings from the standard input one per line\n"
+            "                 and send them on a single connection without waiting. Ends at end of input\n"
+            "  -f fifo        Streaming mode reading from a FIFO (or file). The FIFO is opened again at end of\n"
+            "                 input so that successive writers can be served. Ends on SIGINT or SIGTERM\n"
+            "  -r             Streaming mode: print every message received from the daemon (status replies)\n"
             "\n");
 }
 
@@ -69,6 +82,156 @@ bool parse_int(const char *s, int& v, bool allow_unit=false)
     return true;
 }
 
+/** Print the messages sent back by the daemon until stopped and no status reply is expected */
+static void receive_replies(int sender)
+{
+    int millis = 100; // to check the stop flag
+    int rc = nn_setsockopt(sender, NN_SOL_SOCKET, NN_RCVTIMEO, &millis, sizeof(millis));
+
+    if (rc != 0)
+    {
+        std::cerr << "Error setting the receive timeout: " << nn_strerror(nn_errno()) << std::endl;
+        return;
+    }
+
+    while (!stop_flag.load() || (pending_status.load() > 0))
+    {
+        void *msgBuf = 0;
+        int len = nn_recv(sender, &msgBuf, NN_MSG, 0);
+
+        if ((len > 0) && msgBuf)
+        {
+            std::cout << std::string((char *) msgBuf, len) << std::endl; // flushed for the scripts reading it
+            nn_freemsg(msgBuf);
+
+            if (pending_status.load() > 0) { // sdrdaemontx also sends its status unasked
+                pending_status--;
+            }
+        }
+        else if ((nn_errno() != EAGAIN) && (nn_errno() != ETIMEDOUT))
+        {
+            break; // socket closed
+        }
+    }
+}
+
+/** Send each line of the stream as a configuration string. Returns the number of strings sent or -1 on error. */
+static int send_lines(int sender, std::istream& is)
+{
+    std::string line;
+    int nbSent = 0;
+
+    while (!stop_flag.load() && std::getline(is, line))
+    {
+        line.erase(line.find_last_not_of(" \t\r") + 1); // CRLF and trailing blanks
+        line.erase(0, line.find_first_not_of(" \t"));
+
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+
+        if (line.find("status") != std::string::npos) {
+            pending_status++;
+        }
+
+        if (nn_send(sender, (void *) line.c_str(), line.size(), 0) != (int) line.size())
+        {
+            std::cerr << "Error sending message: " << nn_strerror(nn_errno()) << std::endl;
+            return -1;
+        }
+
+        nbSent++;
+    }
+
+    return nbSent;
+}
+
+static void handle_signal(int sig __attribute__((unused)))
+{
+    stop_flag.store(true);
+}
+
+/**
+ * Streaming mode: one connection for all the configuration strings read from the standard input or a FIFO.
+ * Strings are sent without waiting for the daemon (nanomsg queues them) so hundreds per second can be sent.
+ */
+static int run_stream(int sender, const std::string& fifo, bool replies, int millis)
+{
+    std::thread *replyThread = 0;
+    int nbSent = 0;
+    int rc = 0;
+
+    if (replies) {
+        replyThread = new std::thread(receive_replies, sender);
+    }
+
+    if (fifo.empty())
+    {
+        nbSent = send_lines(sender, std::cin);
+        rc = nbSent < 0 ? 1 : 0;
+    }
+    else
+    {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = handle_signal; // no SA_RESTART: interrupts the open and reads of the FIFO
+        sigaction(SIGINT, &sa, 0);
+        sigaction(SIGTERM, &sa, 0);
+
+        while (!stop_flag.load())
+        {
+            std::ifstream is(fifo.c_str()); // blocks until a writer opens the FIFO
+
+            if (!is)
+            {
+                if (!stop_flag.load())
+                {
+                    std::cerr << "Cannot open " << fifo << std::endl;
+                    rc = 1;
+                }
+
+                break;
+            }
+
+            int n = send_lines(sender, is);
+
+            if (n < 0)
+            {
+                rc = 1;
+                break;
+            }
+
+            nbSent += n;
+        }
+    }
+
+    std::cerr << nbSent << " configuration strings sent" << std::endl;
+
+    if (replyThread)
+    {
+        // outstanding status replies get one timeout
+        int waitMs = 0;
+
+        while ((pending_status.load() > 0) && (waitMs < millis))
+        {
+            usleep(10000);
+            waitMs += 10;
+        }
+
+        pending_status.store(0);
+        stop_flag.store(true);
+        replyThread->join();
+        delete replyThread;
+    }
+    else
+    {
+        usleep(100000); // let the last messages queued by nanomsg go
+    }
+
+    nn_close(sender);
+    return rc;
+}
+
 int main(int argc, char **argv)
 {
     fprintf(stderr, "sdrdmnctl - Send SDRdaemon instance a configuration string for its attached device using nanomsg\n");
@@ -78,6 +241,9 @@ int main(int argc, char **argv)
         { "daddress",   2, NULL, 'I' },
         { "dport",      1, NULL, 'D' },
         { "timeout",    1, NULL, 't' },
+        { "stream",     0, NULL, 's' },
+        { "fifo",       1, NULL, 'f' },
+        { "replies",    0, NULL, 'r' },
         { NULL,         0, NULL, 0 } };
 
     int c, longindex, value;
@@ -85,9 +251,12 @@ int main(int argc, char **argv)
     std::string cmdaddress("127.0.0.1");
     unsigned int cfgport = 9091;
     unsigned int timeout = 2;
+    bool stream = false;
+    std::string fifo;
+    bool replies = false;
 
     while ((c = getopt_long(argc, argv,
-            "t:c:I:C:",
+            "t:c:I:C:sf:r",
             longopts, &longindex)) >= 0)
     {
         switch (c)
@@ -112,6 +281,16 @@ int main(int argc, char **argv)
             	timeout = value;
             }
             break;
+        case 's':
+            stream = true;
+            break;
+        case 'f':
+            stream = true;
+            fifo.assign(optarg);
+            break;
+        case 'r':
+            replies = true;
+            break;
         default:
             usage();
             fprintf(stderr, "ERROR: Invalid command line options\n");
@@ -133,6 +312,12 @@ int main(int argc, char **argv)
     rc = nn_connect(sender, addrstrng.c_str());
     assert(rc >= 0);
 
+    if (stream)
+    {
+        std::cerr << "Address: " << addrstrng << "; Streaming from " << (fifo.empty() ? "standard input" : fifo) << std::endl;
+        return run_stream(sender, fifo, replies, millis);
+    }
+
     std::cerr << "Address: " << addrstrng << "; Config: " << config_str << std::endl;
 
     int config_size = config_str.size();
@@ -142,6 +327,24 @@ int main(int argc, char **argv)
     {
     	std::cerr << "Error sending message" << std::endl;
     }
+    else if (config_str.find("status") != std::string::npos)
+    {
+        // wait for the status reply
+        rc = nn_setsockopt (sender, NN_SOL_SOCKET, NN_RCVTIMEO, &millis, sizeof (millis));
+        assert (rc == 0);
+        void *msgBuf = 0;
+        int len = nn_recv(sender, &msgBuf, NN_MSG, 0);
+
+        if ((len > 0) && msgBuf)
+        {
+            std::cout << std::string((char *) msgBuf, len) << std::endl;
+            nn_freemsg(msgBuf);
+        }
+        else
+        {
+            std::cerr << "No status received" << std::endl;
+        }
+    }
 
 	return 0;
 }
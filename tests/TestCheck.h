@@ -0,0 +1,44 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef TESTS_TESTCHECK_H_
+#define TESTS_TESTCHECK_H_
+
+#include <cstdio>
+
+/**
+ * Checks of the unit test programs. Unlike assert they are kept in release builds and a failed check
+ * does not stop the program so that all the failures are reported. The program returns TEST_RESULT()
+ * as its exit status for ctest: 1 when any check failed, 0 otherwise.
+ */
+static int test_failures = 0;
+
+#define TEST_CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__); \
+            fprintf(stderr, "\n"); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() (test_failures > 0 ? 1 : 0)
+
+#endif /* TESTS_TESTCHECK_H_ */
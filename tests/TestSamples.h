@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#ifndef TESTS_TESTSAMPLES_H_
+#define TESTS_TESTSAMPLES_H_
+
+#include <random>
+
+#include "SDRDaemon.h"
+
+/** n random I/Q samples of the given effective bits */
+static inline IQSampleVector random_samples(std::size_t n, unsigned int bits, unsigned int seed)
+{
+    IQSampleVector samples(n);
+    std::mt19937 rng(seed);
+    int range = 1 << bits;
+
+    for (std::size_t i = 0; i < n; i++)
+    {
+        samples[i].setReal((int) (rng() % range) - range / 2);
+        samples[i].setImag((int) (rng() % range) - range / 2);
+    }
+
+    return samples;
+}
+
+/** Number of samples that differ, all of them when the sizes differ */
+static inline std::size_t count_diffs(const IQSampleVector& a, const IQSampleVector& b)
+{
+    if (a.size() != b.size()) {
+        return a.size() + b.size();
+    }
+
+    std::size_t diffs = 0;
+
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        if ((a[i].real() != b[i].real()) || (a[i].imag() != b[i].imag())) {
+            diffs++;
+        }
+    }
+
+    return diffs;
+}
+
+#endif /* TESTS_TESTSAMPLES_H_ */
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <memory>
+
+#include "Decimators.h"
+#include "TestCheck.h"
+#include "TestSamples.h"
+
+typedef void (Decimators::*Decimate)(unsigned int&, const IQSampleVector&, IQSampleVector&);
+typedef void (*StaticDecimate)(unsigned int&, const IQSampleVector&, IQSampleVector&);
+
+/** The chains selected by selectChain against the original decimate2..64 at all factors, positions and sample sizes */
+int main()
+{
+    static const Decimate decimates[6][3] = {
+        {0, 0, &Decimators::decimate2_cen},
+        {0, 0, &Decimators::decimate4_cen},
+        {&Decimators::decimate8_inf,  &Decimators::decimate8_sup,  &Decimators::decimate8_cen},
+        {&Decimators::decimate16_inf, &Decimators::decimate16_sup, &Decimators::decimate16_cen},
+        {&Decimators::decimate32_inf, &Decimators::decimate32_sup, &Decimators::decimate32_cen},
+        {&Decimators::decimate64_inf, &Decimators::decimate64_sup, &Decimators::decimate64_cen}
+    };
+    static const StaticDecimate staticDecimates[2][2] = {
+        {&Decimators::decimate2_inf, &Decimators::decimate2_sup},
+        {&Decimators::decimate4_inf, &Decimators::decimate4_sup}
+    };
+    static const unsigned int sampleSizes[] = {8, 10, 12, 13, 16}; // 13: shifts computed at each call
+
+    for (unsigned int bits : sampleSizes)
+    {
+        // two blocks in a row so that the filter states are carried over
+        IQSampleVector in[2] = {random_samples(6000, bits, bits), random_samples(6000, bits, bits + 1)};
+
+        for (unsigned int log2Decim = 1; log2Decim <= 6; log2Decim++)
+        {
+            for (int fcPos = 0; fcPos < 3; fcPos++)
+            {
+                std::unique_ptr<Decimators> reference(new Decimators());
+                std::unique_ptr<Decimators> chained(new Decimators());
+                Decimators::Chain chain = Decimators::selectChain(log2Decim, fcPos, bits);
+                Decimate decimate = decimates[log2Decim-1][fcPos];
+
+                for (int b = 0; b < 2; b++)
+                {
+                    IQSampleVector expected, out;
+                    unsigned int expectedSize = bits, sampleSize = bits;
+
+                    if (decimate) {
+                        ((*reference).*decimate)(expectedSize, in[b], expected);
+                    } else {
+                        staticDecimates[log2Decim-1][fcPos](expectedSize, in[b], expected);
+                    }
+
+                    ((*chained).*chain)(sampleSize, in[b], out);
+                    TEST_CHECK(count_diffs(expected, out) == 0, "decimateChain %d fcpos %d %u bits block %d", 1 << log2Decim, fcPos, bits, b);
+                    TEST_CHECK(sampleSize == expectedSize, "decimateChain %d fcpos %d %u bits: sample size %u", 1 << log2Decim, fcPos, bits, sampleSize);
+                }
+            }
+        }
+    }
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,90 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "CICDecimator.h"
+#include "TestCheck.h"
+#include "TestSamples.h"
+
+/** 16 and 32 bit inputs, phase carried over blocks not multiple of the ratio */
+static void test_blocks()
+{
+    static const unsigned int ratios[] = {2, 3, 5, 16, 100};
+    IQSampleVector in = random_samples(20000, 12, 9);
+    std::vector<int32_t> wide(2 * in.size());
+
+    for (std::size_t k = 0; k < in.size(); k++)
+    {
+        wide[2*k] = in[k].real();
+        wide[2*k+1] = in[k].imag();
+    }
+
+    for (unsigned int ratio : ratios)
+    {
+        CICDecimator whole, pieced, wider;
+        TEST_CHECK(whole.setRatio(ratio) && pieced.setRatio(ratio) && wider.setRatio(ratio), "CIC ratio %u", ratio);
+        IQSampleVector expected, out, out32;
+        unsigned int sampleSize = 12;
+        whole.process(sampleSize, &in[0], in.size(), expected);
+        TEST_CHECK(expected.size() == in.size() / ratio, "CIC ratio %u: %zu samples", ratio, expected.size());
+
+        for (std::size_t k = 0; k < in.size(); k += 37)
+        {
+            sampleSize = 12;
+            pieced.process(sampleSize, &in[k], std::min<std::size_t>(37, in.size() - k), out);
+        }
+
+        TEST_CHECK(count_diffs(expected, out) == 0, "CIC ratio %u in pieces", ratio);
+
+        sampleSize = 12;
+        wider.process(sampleSize, &wide[0], in.size(), out32);
+        TEST_CHECK(count_diffs(expected, out32) == 0, "CIC ratio %u from 32 bit samples", ratio);
+    }
+
+    CICDecimator inactive;
+    TEST_CHECK(!inactive.setRatio(CICDECIMATOR_RATIOMAX + 1), "CIC ratio %d accepted", CICDECIMATOR_RATIOMAX + 1);
+}
+
+/** A DC input comes out at the 16 bits scale */
+static void test_gain()
+{
+    static const unsigned int ratios[] = {3, 8, 512};
+
+    for (unsigned int ratio : ratios)
+    {
+        CICDecimator dc;
+        dc.setRatio(ratio);
+        IQSampleVector constant(64 * ratio, IQSample(1000, -1000)), out;
+        unsigned int sampleSize = 12;
+        dc.process(sampleSize, &constant[0], constant.size(), out);
+        TEST_CHECK(std::abs(out.back().real() - 16000) < 16000 / 100 && std::abs(out.back().imag() + 16000) < 16000 / 100,
+                "CIC ratio %u DC gain: %d %d", ratio, out.back().real(), out.back().imag());
+    }
+}
+
+int main()
+{
+    test_blocks();
+    test_gain();
+
+    return TEST_RESULT();
+}
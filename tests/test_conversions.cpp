@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <random>
+#include <vector>
+
+#include "Decimators.h"
+#include "SampleConversion.h"
+#include "TestCheck.h"
+#include "TestSamples.h"
+
+/** Device conversions fused with the normalization against the conversion then decimate1 */
+static void test_conversions()
+{
+    const unsigned int n = 1021;
+    std::vector<uint8_t> bytes(2*n);
+    std::mt19937 rng(10);
+
+    for (std::size_t k = 0; k < bytes.size(); k++) {
+        bytes[k] = rng();
+    }
+
+    for (unsigned int shift = 0; shift <= 8; shift += 8)
+    {
+        IQSampleVector expected(n), out(n);
+        unsigned int sampleSize = 16 - shift;
+
+        for (unsigned int k = 0; k < n; k++) { // scalar references
+            expected[k] = IQSample(bytes[2*k] - 128, bytes[2*k+1] - 128);
+        }
+
+        Decimators::decimate1(sampleSize, expected);
+        SampleConversion::u8ToIQ(&bytes[0], &out[0], bytes.size(), shift);
+        TEST_CHECK(count_diffs(expected, out) == 0, "u8ToIQ shift %u", shift);
+
+        for (unsigned int k = 0; k < n; k++) {
+            expected[k] = IQSample((int8_t) bytes[2*k], (int8_t) bytes[2*k+1]);
+        }
+
+        sampleSize = 16 - shift;
+        Decimators::decimate1(sampleSize, expected);
+        SampleConversion::s8ToIQ((const int8_t *) &bytes[0], &out[0], bytes.size(), shift);
+        TEST_CHECK(count_diffs(expected, out) == 0, "s8ToIQ shift %u", shift);
+    }
+
+    IQSampleVector in = random_samples(n, 12, 11), expected(in), out(n);
+    unsigned int sampleSize = 12;
+    Decimators::decimate1(sampleSize, expected);
+    SampleConversion::shiftS16(&in[0], &out[0], n, 4);
+    TEST_CHECK(count_diffs(expected, out) == 0, "shiftS16");
+    SampleConversion::shiftS16(&in[0], &in[0], n, 4); // in place
+    TEST_CHECK(count_diffs(expected, in) == 0, "shiftS16 in place");
+}
+
+int main()
+{
+    test_conversions();
+
+    return TEST_RESULT();
+}
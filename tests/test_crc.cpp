@@ -0,0 +1,131 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "CRC64.h"
+#include "CRC32C.h"
+#include "TestCheck.h"
+
+// bit at a time references of the CRCs as specified
+static uint64_t crc64_reference(const uint8_t *stream, int length)
+{
+    uint64_t crc = 0;
+
+    for (int i = 0; i < length; i++)
+    {
+        crc ^= stream[i];
+
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xC96C5795D7870F42ull : 0);
+        }
+    }
+
+    return crc;
+}
+
+static uint32_t crc32c_reference(const uint8_t *stream, std::size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        crc ^= stream[i];
+
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+        }
+    }
+
+    return ~crc;
+}
+
+/** All the CRC64 engines give the reference result for any length and alignment */
+static void test_crc64(const std::vector<uint8_t>& data)
+{
+    static const char *engines[] = {"table", "slicing8", "carryless"};
+    CRC64 crc64;
+
+    for (int engine = CRC64::CRCTable; engine <= CRC64::CRCCarryless; engine++)
+    {
+        crc64.setEngine((CRC64::engine_t) engine);
+
+        if (crc64.getEngine() != engine)
+        {
+            fprintf(stderr, "test_crc: CRC64 %s engine not supported by the CPU\n", engines[engine]);
+            continue;
+        }
+
+        // lengths around the 8 and 16 bytes steps and the 64 bytes folds, from each alignment
+        for (int offset = 0; offset < 16; offset++)
+        {
+            for (int length = 0; length <= 300; length++)
+            {
+                uint64_t crc = crc64.calculate_crc(&data[offset], length);
+                TEST_CHECK(crc == crc64_reference(&data[offset], length), "engine %s offset %d length %d", engines[engine], offset, length);
+            }
+        }
+
+        int length = data.size() - 16; // a whole frame
+        TEST_CHECK(crc64.calculate_crc(&data[16], length) == crc64_reference(&data[16], length), "engine %s length %d", engines[engine], length);
+    }
+}
+
+/** CRC32C check value, reference and continuation over split data */
+static void test_crc32c(const std::vector<uint8_t>& data)
+{
+    const char *check = "123456789";
+    TEST_CHECK(CRC32C::calculate((const uint8_t *) check, strlen(check)) == 0xE3069283, "check value (%s)", CRC32C::hardware() ? "hardware" : "slicing8");
+
+    for (int offset = 0; offset < 8; offset++)
+    {
+        for (int length = 0; length <= 300; length++)
+        {
+            uint32_t crc = CRC32C::calculate(&data[offset], length);
+            TEST_CHECK(crc == crc32c_reference(&data[offset], length), "offset %d length %d", offset, length);
+        }
+    }
+
+    std::size_t length = data.size();
+    uint32_t whole = CRC32C::calculate(&data[0], length);
+    TEST_CHECK(whole == crc32c_reference(&data[0], length), "length %zu", length);
+
+    for (std::size_t split = 1; split < length; split += 997)
+    {
+        uint32_t crc = CRC32C::calculate(&data[split], length - split, CRC32C::calculate(&data[0], split));
+        TEST_CHECK(crc == whole, "split at %zu", split);
+    }
+}
+
+int main()
+{
+    std::vector<uint8_t> data(128 * 512); // a frame of 128 datagrams of 512 bytes
+    std::mt19937 rng(1);
+
+    for (std::size_t i = 0; i < data.size(); i++) {
+        data[i] = rng();
+    }
+
+    test_crc64(data);
+    test_crc32c(data);
+
+    return TEST_RESULT();
+}
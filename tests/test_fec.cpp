@@ -0,0 +1,265 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "FECCodec.h"
+#include "TestCheck.h"
+
+/**
+ * A frame encoded with a codec then received with some of its blocks lost. The blocks are given to the
+ * decoder as the receivers do: the original blocks received first then the FEC blocks received.
+ */
+class Frame
+{
+public:
+    Frame(FECCodec *codec, int nbOriginal, int nbFEC, int blockBytes, unsigned int seed) :
+        m_codec(codec),
+        m_originals(nbOriginal * blockBytes),
+        m_recovery(nbFEC * blockBytes)
+    {
+        m_params.BlockBytes = blockBytes;
+        m_params.OriginalCount = nbOriginal;
+        m_params.RecoveryCount = nbFEC;
+        std::mt19937 rng(seed);
+
+        for (std::size_t i = 0; i < m_originals.size(); i++) {
+            m_originals[i] = rng();
+        }
+
+        std::vector<FECBlock> blocks(nbOriginal);
+
+        for (int i = 0; i < nbOriginal; i++)
+        {
+            blocks[i].Block = (void *) &m_originals[i * blockBytes];
+            blocks[i].Index = i;
+        }
+
+        m_encoded = m_codec->encode(m_params, &blocks[0], (void *) &m_recovery[0]) == 0;
+    }
+
+    bool encoded() const { return m_encoded; }
+
+    /**
+     * Decode with the blocks of these indexes lost (original blocks below OriginalCount, FEC blocks above).
+     * Returns the decoder status and sets restored when all the original blocks came out right.
+     */
+    int decode(const std::vector<int>& lost, bool& restored)
+    {
+        int nbOriginal = m_params.OriginalCount;
+        int nbTotal = nbOriginal + m_params.RecoveryCount;
+        int blockBytes = m_params.BlockBytes;
+        std::vector<uint8_t> received(nbTotal * blockBytes); // decoded in place
+        std::vector<FECBlock> blocks;
+
+        memcpy(&received[0], &m_originals[0], m_originals.size());
+        memcpy(&received[m_originals.size()], &m_recovery[0], m_recovery.size());
+
+        for (int index = 0; index < nbTotal; index++)
+        {
+            if (std::find(lost.begin(), lost.end(), index) == lost.end())
+            {
+                FECBlock block;
+                block.Block = (void *) &received[index * blockBytes];
+                block.Index = index;
+                blocks.push_back(block);
+            }
+        }
+
+        std::vector<uint8_t> before(received);
+        int status = m_codec->decode(m_params, &blocks[0], blocks.size());
+        restored = status == 0;
+
+        if (status != 0)
+        {
+            // the decoding may be tried again with more blocks: nothing touched
+            TEST_CHECK(received == before, "%s: blocks modified by a failed decoding", m_codec->getName());
+            return status;
+        }
+
+        std::vector<bool> seen(nbOriginal, false);
+
+        for (std::size_t b = 0; b < blocks.size(); b++)
+        {
+            int index = blocks[b].Index;
+
+            if ((index < 0) || (index >= nbOriginal)) { // FEC block not used
+                continue;
+            }
+
+            seen[index] = true;
+
+            if (memcmp(blocks[b].Block, &m_originals[index * blockBytes], blockBytes) != 0) {
+                restored = false;
+            }
+        }
+
+        if (std::find(seen.begin(), seen.end(), false) != seen.end()) {
+            restored = false;
+        }
+
+        return status;
+    }
+
+private:
+    FECCodec *m_codec;
+    CM256::cm256_encoder_params m_params;
+    std::vector<uint8_t> m_originals;
+    std::vector<uint8_t> m_recovery;
+    bool m_encoded;
+};
+
+static std::vector<int> range(int from, int count)
+{
+    std::vector<int> indexes;
+
+    for (int i = 0; i < count; i++) {
+        indexes.push_back(from + i);
+    }
+
+    return indexes;
+}
+
+/** Any OriginalCount blocks restore the frame */
+static void test_cm256()
+{
+    FECCodec *codec = FECCodec::get(FECCODEC_CM256);
+
+    if (!codec || !codec->isInitialized())
+    {
+        fprintf(stderr, "test_fec: cannot initialize CM256, not tested\n");
+        return;
+    }
+
+    TEST_CHECK(codec->isMDS(), "cm256 is MDS");
+    static const int fecCounts[] = {1, 8, 32, 128};
+    std::mt19937 rng(2);
+
+    for (int nbFEC : fecCounts)
+    {
+        Frame frame(codec, 128, nbFEC, 500, nbFEC);
+        TEST_CHECK(frame.encoded(), "cm256: encode with %d FEC blocks", nbFEC);
+        bool restored;
+
+        frame.decode(std::vector<int>(), restored);
+        TEST_CHECK(restored, "cm256: nothing lost with %d FEC blocks", nbFEC);
+        frame.decode(range(0, nbFEC), restored);
+        TEST_CHECK(restored, "cm256: first %d original blocks lost", nbFEC);
+
+        std::vector<int> lost(range(0, 128 + nbFEC));
+        std::shuffle(lost.begin(), lost.end(), rng);
+        lost.resize(nbFEC);
+        frame.decode(lost, restored);
+        TEST_CHECK(restored, "cm256: %d random blocks lost", nbFEC);
+    }
+}
+
+/** One lost original block of each parity class j (the blocks i with i % RecoveryCount == j) */
+static void test_xor()
+{
+    FECCodec *codec = FECCodec::get(FECCODEC_XOR);
+    TEST_CHECK(codec && codec->isInitialized(), "xor codec");
+
+    if (!codec) {
+        return;
+    }
+
+    static const int fecCounts[] = {1, 8, 16, 32, 128};
+
+    for (int nbFEC : fecCounts)
+    {
+        Frame frame(codec, 128, nbFEC, 500, nbFEC);
+        TEST_CHECK(frame.encoded(), "xor: encode with %d FEC blocks", nbFEC);
+        bool restored;
+
+        frame.decode(range(0, nbFEC), restored);
+        TEST_CHECK(restored, "xor: burst of %d original blocks lost", nbFEC);
+        frame.decode(range(128 - nbFEC, nbFEC), restored);
+        TEST_CHECK(restored, "xor: last %d original blocks lost", nbFEC);
+
+        std::vector<int> lost(range(5, nbFEC / 2));
+        std::vector<int> fecLost(range(128 + 5 + nbFEC / 2, nbFEC - nbFEC / 2)); // FEC of the classes not lost
+        lost.insert(lost.end(), fecLost.begin(), fecLost.end());
+        frame.decode(lost, restored);
+        TEST_CHECK(restored, "xor: original and FEC blocks of other classes lost with %d FEC blocks", nbFEC);
+
+        if (nbFEC < 128)
+        {
+            std::vector<int> sameClass;
+            sameClass.push_back(3);
+            sameClass.push_back(3 + nbFEC);
+            int status = frame.decode(sameClass, restored);
+            TEST_CHECK(status != 0, "xor: two blocks of a class lost with %d FEC blocks", nbFEC);
+        }
+    }
+}
+
+/** Large frames: random losses with a margin over the FEC blocks as the code is not MDS */
+static void test_ldpc()
+{
+    FECCodec *codec = FECCodec::get(FECCODEC_LDPC);
+    TEST_CHECK(codec && codec->isInitialized(), "ldpc codec");
+
+    if (!codec) {
+        return;
+    }
+
+    TEST_CHECK(codec->getMaxNbBlocks() >= 1024 + 512, "ldpc: %d blocks per frame", codec->getMaxNbBlocks());
+    static const int sizes[][2] = {{128, 32}, {1024, 128}, {1024, 512}};
+    std::mt19937 rng(3);
+
+    for (const int *size : sizes)
+    {
+        int nbOriginal = size[0];
+        int nbFEC = size[1];
+        Frame frame(codec, nbOriginal, nbFEC, 500, nbOriginal + nbFEC);
+        TEST_CHECK(frame.encoded(), "ldpc: encode %d + %d", nbOriginal, nbFEC);
+        bool restored;
+
+        frame.decode(std::vector<int>(), restored);
+        TEST_CHECK(restored, "ldpc %d + %d: nothing lost", nbOriginal, nbFEC);
+        frame.decode(range(0, nbFEC / 2), restored);
+        TEST_CHECK(restored, "ldpc %d + %d: burst of %d original blocks lost", nbOriginal, nbFEC, nbFEC / 2);
+
+        for (int trial = 0; trial < 4; trial++)
+        {
+            std::vector<int> lost(range(0, nbOriginal + nbFEC));
+            std::shuffle(lost.begin(), lost.end(), rng);
+            lost.resize(nbFEC / 4);
+            frame.decode(lost, restored);
+            TEST_CHECK(restored, "ldpc %d + %d: %d random blocks lost", nbOriginal, nbFEC, nbFEC / 4);
+        }
+
+        // more blocks lost than FEC blocks: cannot be restored
+        int status = frame.decode(range(0, nbFEC + 1), restored);
+        TEST_CHECK(status != 0, "ldpc %d + %d: %d blocks lost", nbOriginal, nbFEC, nbFEC + 1);
+    }
+}
+
+int main()
+{
+    test_cm256();
+    test_xor();
+    test_ldpc();
+
+    return TEST_RESULT();
+}
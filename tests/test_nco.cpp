@@ -0,0 +1,132 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Decimators.h"
+#include "NCO.h"
+#include "parsekv.h"
+#include "TestCheck.h"
+#include "TestSamples.h"
+
+/** Negative shift offsets in a configuration string, with the keys after it kept */
+static void test_parse()
+{
+    namespace qi = boost::spirit::qi;
+    parsekv::key_value_sequence<std::string::iterator> p;
+    parsekv::pairs_type m;
+    std::string config("decim=3,shift=-10000,fcpos=2");
+
+    TEST_CHECK(qi::parse(config.begin(), config.end(), p, m), "parse %s", config.c_str());
+    TEST_CHECK(m["shift"] == "-10000", "shift=%s", m["shift"].c_str());
+    TEST_CHECK(m["fcpos"] == "2", "fcpos=%s", m["fcpos"].c_str());
+}
+
+/** Vector kernels against the scalar tail: pieces of a few samples run the scalar code */
+static void test_mix()
+{
+    const unsigned int n = 4 * NCO_BLOCK_SIZE + 13;
+    IQSampleVector in = random_samples(n, 16, 7);
+    static const unsigned int pieces[] = {1, 3, 7, 9, 31};
+
+    for (unsigned int gain = 0; gain <= 3; gain += 3)
+    {
+        NCO whole, pieced;
+        whole.setFrequency(-123457, 2000000);
+        pieced.setFrequency(-123457, 2000000);
+        std::vector<int32_t> expected(2*n), out(2*n);
+        whole.mix(&in[0], &expected[0], n, gain);
+        unsigned int k = 0;
+
+        for (int p = 0; k < n; p++) // the phase is carried over between calls
+        {
+            unsigned int m = std::min(pieces[p % 5], n - k);
+            pieced.mix(&in[k], &out[2*k], m, gain);
+            k += m;
+        }
+
+        TEST_CHECK(out == expected, "NCO mix gain %u in pieces", gain);
+    }
+
+    // in place mix of 16 bit samples: same as the 32 bit mix saturated
+    NCO wide, inplace;
+    wide.setFrequency(250000, 1000000);
+    inplace.setFrequency(250000, 1000000);
+    std::vector<int32_t> expected(2*n);
+    IQSampleVector out(in);
+    wide.mix(&in[0], &expected[0], n);
+    inplace.mix(&out[0], n);
+    std::size_t diffs = 0;
+
+    for (unsigned int k = 0; k < n; k++)
+    {
+        int32_t x = std::max(-32768, std::min(32767, expected[2*k]));
+        int32_t y = std::max(-32768, std::min(32767, expected[2*k+1]));
+
+        if ((out[k].real() != x) || (out[k].imag() != y)) {
+            diffs++;
+        }
+    }
+
+    TEST_CHECK(diffs == 0, "NCO in place mix: %zu samples differ", diffs);
+}
+
+/** The NCO fused with the first stage of the block cascade runs the same in blocks of any size */
+static void test_decimate_nco()
+{
+    IQSampleVector in = random_samples(4 * DECIMATORS_BLOCK_SIZE, 12, 8);
+
+    for (unsigned int log2Decim = 1; log2Decim <= 6; log2Decim++)
+    {
+        std::unique_ptr<Decimators> whole(new Decimators());
+        std::unique_ptr<Decimators> split(new Decimators());
+        NCO ncoWhole, ncoSplit;
+        ncoWhole.setFrequency(333333, 2000000);
+        ncoSplit.setFrequency(333333, 2000000);
+        IQSampleVector expected, out, part;
+        unsigned int sampleSize = 12;
+        whole->decimateBlock(log2Decim, 2, sampleSize, in, expected, &ncoWhole);
+
+        // pieces of whole output samples, not multiples of the block size
+        std::size_t step = (DECIMATORS_BLOCK_SIZE + 64) >> log2Decim << log2Decim;
+
+        for (std::size_t k = 0; k < in.size(); k += step)
+        {
+            IQSampleVector piece(in.begin() + k, in.begin() + std::min(in.size(), k + step));
+            sampleSize = 12;
+            split->decimateBlock(log2Decim, 2, sampleSize, piece, part, &ncoSplit);
+            out.insert(out.end(), part.begin(), part.end());
+        }
+
+        TEST_CHECK(count_diffs(expected, out) == 0, "decimateBlock %d with NCO in pieces", 1 << log2Decim);
+        TEST_CHECK(expected.size() == (in.size() >> log2Decim), "decimateBlock %d with NCO: %zu samples", 1 << log2Decim, expected.size());
+    }
+}
+
+int main()
+{
+    test_parse();
+    test_mix();
+    test_decimate_nco();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <memory>
+#include <vector>
+
+#include "Decimators.h"
+#include "Interpolators.h"
+#include "IQPlanar.h"
+#include "NCO.h"
+#include "TestCheck.h"
+#include "TestSamples.h"
+
+typedef void (Decimators::*Decimate)(unsigned int&, const IQSampleVector&, IQSampleVector&);
+
+/** Planar block cascades against the interleaved sample by sample decimate8..64 */
+static void test_decimate()
+{
+    static const Decimate decimates[4][3] = {
+        {&Decimators::decimate8_inf,  &Decimators::decimate8_sup,  &Decimators::decimate8_cen},
+        {&Decimators::decimate16_inf, &Decimators::decimate16_sup, &Decimators::decimate16_cen},
+        {&Decimators::decimate32_inf, &Decimators::decimate32_sup, &Decimators::decimate32_cen},
+        {&Decimators::decimate64_inf, &Decimators::decimate64_sup, &Decimators::decimate64_cen}
+    };
+    static const unsigned int sampleSizes[] = {8, 12, 16};
+
+    for (unsigned int bits : sampleSizes)
+    {
+        // two blocks in a row so that the filter states are carried over
+        IQSampleVector in[2] = {random_samples(3 * DECIMATORS_BLOCK_SIZE, bits, bits), random_samples(3 * DECIMATORS_BLOCK_SIZE, bits, bits + 1)};
+
+        for (unsigned int log2Decim = 3; log2Decim <= 6; log2Decim++)
+        {
+            for (int fcPos = 0; fcPos < 3; fcPos++)
+            {
+                std::unique_ptr<Decimators> reference(new Decimators());
+                std::unique_ptr<Decimators> block(new Decimators());
+
+                for (int b = 0; b < 2; b++)
+                {
+                    IQSampleVector expected, out;
+                    unsigned int expectedSize = bits, sampleSize = bits;
+                    ((*reference).*decimates[log2Decim-3][fcPos])(expectedSize, in[b], expected);
+                    block->decimateBlock(log2Decim, fcPos, sampleSize, in[b], out);
+                    TEST_CHECK(count_diffs(expected, out) == 0, "decimateBlock %d fcpos %d %u bits block %d", 1 << log2Decim, fcPos, bits, b);
+                    TEST_CHECK(sampleSize == expectedSize, "decimateBlock %d fcpos %d %u bits: sample size %u", 1 << log2Decim, fcPos, bits, sampleSize);
+                }
+            }
+        }
+    }
+}
+
+/** Planar block cascades against interpolate2..32_cen (the original interpolate64_cen runs five stages only) */
+static void test_interpolate()
+{
+    typedef void (Interpolators::*Interpolate)(const IQSampleVector&, IQSampleVector&);
+    static const Interpolate interpolates[5] = {
+        &Interpolators::interpolate2_cen,
+        &Interpolators::interpolate4_cen,
+        &Interpolators::interpolate8_cen,
+        &Interpolators::interpolate16_cen,
+        &Interpolators::interpolate32_cen
+    };
+
+    for (unsigned int log2Interp = 1; log2Interp <= 5; log2Interp++)
+    {
+        std::unique_ptr<Interpolators> reference(new Interpolators());
+        std::unique_ptr<Interpolators> block(new Interpolators());
+
+        for (int b = 0; b < 2; b++)
+        {
+            IQSampleVector in = random_samples(3000, 16, log2Interp + b);
+            IQSampleVector expected, out;
+            ((*reference).*interpolates[log2Interp-1])(in, expected);
+            block->interpolateBlock(log2Interp, in, out);
+            TEST_CHECK(count_diffs(expected, out) == 0, "interpolateBlock %d block %d", 1 << log2Interp, b);
+        }
+    }
+}
+
+/** The planar NCO mix against the interleaved one */
+static void test_mix()
+{
+    const unsigned int n = 4 * NCO_BLOCK_SIZE + 13;
+    IQSampleVector in = random_samples(n, 16, 7);
+
+    for (unsigned int gain = 0; gain <= 3; gain += 3)
+    {
+        NCO interleaved, planar;
+        interleaved.setFrequency(-123457, 2000000);
+        planar.setFrequency(-123457, 2000000);
+        std::vector<int32_t> expected(2*n), i(n), q(n);
+        interleaved.mix(&in[0], &expected[0], n, gain);
+        planar.mixPlanar(&in[0], &i[0], &q[0], n, gain);
+        std::size_t diffs = 0;
+
+        for (unsigned int k = 0; k < n; k++)
+        {
+            if ((i[k] != expected[2*k]) || (q[k] != expected[2*k+1])) {
+                diffs++;
+            }
+        }
+
+        TEST_CHECK(diffs == 0, "NCO mixPlanar gain %u: %zu samples differ", gain, diffs);
+    }
+}
+
+/** Split and merge at the boundaries of the block cascades */
+static void test_interleave()
+{
+    const unsigned int n = 517; // not a multiple of the vector sizes
+    IQSampleVector in = random_samples(n, 16, 12), out(n);
+    std::vector<int32_t> i(n), q(n);
+    IQPlanar::deinterleave(&in[0], &i[0], &q[0], n);
+    IQPlanar::interleave(&i[0], &q[0], &out[0], n);
+    TEST_CHECK(count_diffs(in, out) == 0, "IQPlanar round trip");
+
+    for (unsigned int k = 0; k < n; k++)
+    {
+        i[k] = in[k].real() * 8;
+        q[k] = in[k].imag() * 8;
+    }
+
+    IQPlanar::interleave(&i[0], &q[0], &out[0], n, 1, 4); // as setReal(x << 1 >> 4)
+    std::size_t diffs = 0;
+
+    for (unsigned int k = 0; k < n; k++)
+    {
+        if ((out[k].real() != (int16_t) (i[k] << 1 >> 4)) || (out[k].imag() != (int16_t) (q[k] << 1 >> 4))) {
+            diffs++;
+        }
+    }
+
+    TEST_CHECK(diffs == 0, "IQPlanar interleave with shifts: %zu samples differ", diffs);
+}
+
+int main()
+{
+    test_decimate();
+    test_interpolate();
+    test_mix();
+    test_interleave();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////////
+// SDRdaemon - send I/Q samples read from a SDR device over the network via UDP. //
+//                                                                               //
+// Copyright (C) 2016 Edouard Griffiths, F4EXB                                   //
+//                                                                               //
+// This program is free software; you can redistribute it and/or modify          //
+// it under the terms of the GNU General Public License as published by          //
+// the Free Software Foundation as version 3 of the License, or                  //
+//                                                                               //
+// This program is distributed in the hope that it will be useful,               //
+// but WITHOUT ANY WARRANTY; without even the implied warranty of                //
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                  //
+// GNU General Public License V3 for more details.                               //
+//                                                                               //
+// You should have received a copy of the GNU General Public License             //
+// along with this program. If not, see <http://www.gnu.org/licenses/>.          //
+///////////////////////////////////////////////////////////////////////////////////
+
+
+#include <vector>
+
+#include "RealDDC.h"
+#include "HBFilterTraits.h"
+#include "TestCheck.h"
+#include "TestSamples.h"
+
+/** Airspy real to IQ conversion against its definition: shift by -fs/4, DC removal and the I filter */
+static void test_realddc()
+{
+    const unsigned int n = 1000 + 13; // pairs, not a multiple of the vector sizes
+    IQSampleVector raw = random_samples(n, 12, 13);
+    IQSampleVector blocks[2] = {raw, random_samples(n, 12, 14)};
+    RealDDC ddc;
+    std::vector<int16_t> even(REALDDC_HISTORY, 0), odd(REALDDC_DELAY, 0);
+    int32_t dcEstimate = 0;
+    unsigned int phase = 0;
+
+    for (int b = 0; b < 2; b++)
+    {
+        IQSampleVector out(blocks[b]);
+        ddc.process(out);
+
+        // DC estimate of the first block then following the block means
+        const IQSampleVector& x = blocks[b];
+        int64_t sum = 0;
+
+        for (unsigned int j = 0; j < n; j++) {
+            sum += x[j].real() + x[j].imag();
+        }
+
+        int32_t mean = (int32_t) ((sum << 8) / (int64_t) (2*n));
+
+        if (b == 0) {
+            dcEstimate = mean;
+        }
+
+        int16_t dc = (int16_t) ((dcEstimate + 128) >> 8);
+
+        for (unsigned int j = 0; j < n; j++)
+        {
+            int s = ((phase + j) & 1) ? 1 : -1;
+            even.push_back(s * (x[j].real() - dc));
+            odd.push_back(s * (x[j].imag() - dc));
+        }
+
+        dcEstimate += (mean - dcEstimate) >> REALDDC_DCSHIFT;
+        phase = (phase + n) & 1;
+        std::size_t diffs = 0;
+
+        for (unsigned int j = 0; j < n; j++)
+        {
+            int32_t acc = 1 << (HBFIRFilterTraits<32>::hbShift - 1);
+
+            for (int k = 0; k < 8; k++) {
+                acc += 2 * HBFIRFilterTraits<32>::hbCoeffs[7-k] * (even[j+7-k] + even[j+8+k]);
+            }
+
+            if ((out[j].real() != (int16_t) (acc >> HBFIRFilterTraits<32>::hbShift)) || (out[j].imag() != odd[j])) {
+                diffs++;
+            }
+        }
+
+        TEST_CHECK(diffs == 0, "RealDDC block %d: %zu samples differ", b, diffs);
+        even.erase(even.begin(), even.begin() + n);
+        odd.erase(odd.begin(), odd.begin() + n);
+    }
+}
+
+int main()
+{
+    test_realddc();
+
+    return TEST_RESULT();
+}